@@ -0,0 +1,238 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dcbin.h"
+
+typedef struct dcbin_stream_t {
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+	int error;
+} dcbin_stream_t;
+
+static unsigned int
+dcbin_uint (dcbin_stream_t *s)
+{
+	unsigned long long value = 0;
+	unsigned int shift = 0;
+
+	while (1) {
+		if (s->offset >= s->size || shift > 35) {
+			s->error = 1;
+			return 0;
+		}
+
+		unsigned char c = s->data[s->offset++];
+		value |= (unsigned long long) (c & 0x7F) << shift;
+		if ((c & 0x80) == 0)
+			break;
+		shift += 7;
+	}
+
+	return (unsigned int) value;
+}
+
+static int
+dcbin_int (dcbin_stream_t *s)
+{
+	unsigned int value = dcbin_uint (s);
+
+	return (int) (value >> 1) ^ -(int) (value & 1);
+}
+
+static void *
+dcbin_array (dcbin_stream_t *s, unsigned int count, size_t size)
+{
+	// Every element takes at least one byte, which limits the amount of
+	// memory corrupt data can allocate.
+	if (s->error || count > s->size - s->offset) {
+		s->error = 1;
+		return NULL;
+	}
+
+	if (count == 0)
+		return NULL;
+
+	void *array = calloc (count, size);
+	if (array == NULL)
+		s->error = 1;
+
+	return array;
+}
+
+static void
+dcbin_column (dcbin_stream_t *s, dcbin_column_t *column, int tank)
+{
+	unsigned int row = 0;
+	int value = 0;
+
+	column->count = dcbin_uint (s);
+	column->entries = (dcbin_entry_t *) dcbin_array (s, column->count, sizeof (dcbin_entry_t));
+	if (column->entries == NULL) {
+		column->count = 0;
+		return;
+	}
+
+	for (unsigned int i = 0; i < column->count; ++i) {
+		row += dcbin_uint (s);
+		column->entries[i].row = row;
+		if (tank)
+			column->entries[i].tank = dcbin_uint (s);
+		value += dcbin_int (s);
+		column->entries[i].value = value;
+	}
+}
+
+int
+dcbin_reader_init (dcbin_reader_t *reader, const unsigned char *data, size_t size)
+{
+	static const unsigned char magic[] = {'D', 'C', 'B', 0x01};
+
+	if (size < sizeof (magic) || memcmp (data, magic, sizeof (magic)) != 0)
+		return -1;
+
+	reader->data = data;
+	reader->size = size;
+	reader->offset = sizeof (magic);
+
+	return 0;
+}
+
+int
+dcbin_reader_next (dcbin_reader_t *reader, dcbin_dive_t *dive)
+{
+	memset (dive, 0, sizeof (*dive));
+
+	if (reader->offset >= reader->size)
+		return 0;
+
+	// Get the size of the record.
+	dcbin_stream_t s = {reader->data, reader->size, reader->offset, 0};
+	unsigned int length = dcbin_uint (&s);
+	if (s.error || length > s.size - s.offset)
+		return -1;
+
+	s.size = s.offset + length;
+	reader->offset = s.size;
+
+	dive->number = dcbin_uint (&s);
+	dive->size = dcbin_uint (&s);
+	dive->fsize = dcbin_uint (&s);
+	if (s.error || dive->fsize > s.size - s.offset)
+		return -1;
+	dive->fingerprint = s.data + s.offset;
+	s.offset += dive->fsize;
+
+	dive->year = dcbin_uint (&s);
+	dive->month = dcbin_uint (&s);
+	dive->day = dcbin_uint (&s);
+	dive->hour = dcbin_uint (&s);
+	dive->minute = dcbin_uint (&s);
+	dive->second = dcbin_uint (&s);
+	dive->has_timezone = dcbin_uint (&s) & 1;
+	if (dive->has_timezone)
+		dive->timezone = dcbin_int (&s);
+
+	dive->divetime = dcbin_uint (&s);
+	dive->maxdepth = dcbin_int (&s);
+	dive->fields = dcbin_uint (&s);
+	if (dive->fields & DCBIN_AVGDEPTH)
+		dive->avgdepth = dcbin_int (&s);
+	if (dive->fields & DCBIN_TEMP_SURF)
+		dive->temperature_surface = dcbin_int (&s);
+	if (dive->fields & DCBIN_TEMP_MIN)
+		dive->temperature_minimum = dcbin_int (&s);
+	if (dive->fields & DCBIN_TEMP_MAX)
+		dive->temperature_maximum = dcbin_int (&s);
+	if (dive->fields & DCBIN_DIVEMODE)
+		dive->divemode = dcbin_uint (&s);
+	if (dive->fields & DCBIN_SALINITY) {
+		dive->salinity_type = dcbin_uint (&s);
+		dive->salinity_density = dcbin_uint (&s);
+	}
+	if (dive->fields & DCBIN_ATMOSPHERIC)
+		dive->atmospheric = dcbin_uint (&s);
+
+	dive->ngasmixes = dcbin_uint (&s);
+	dive->gasmixes = (dcbin_gasmix_t *) dcbin_array (&s, dive->ngasmixes, sizeof (dcbin_gasmix_t));
+	for (unsigned int i = 0; dive->gasmixes && i < dive->ngasmixes; ++i) {
+		dive->gasmixes[i].oxygen = dcbin_uint (&s);
+		dive->gasmixes[i].helium = dcbin_uint (&s);
+	}
+
+	dive->ntanks = dcbin_uint (&s);
+	dive->tanks = (dcbin_tank_t *) dcbin_array (&s, dive->ntanks, sizeof (dcbin_tank_t));
+	for (unsigned int i = 0; dive->tanks && i < dive->ntanks; ++i) {
+		dive->tanks[i].gasmix = (int) dcbin_uint (&s) - 1;
+		dive->tanks[i].type = dcbin_uint (&s);
+		dive->tanks[i].volume = dcbin_uint (&s);
+		dive->tanks[i].workpressure = dcbin_uint (&s);
+		dive->tanks[i].beginpressure = dcbin_uint (&s);
+		dive->tanks[i].endpressure = dcbin_uint (&s);
+	}
+
+	dive->nrows = dcbin_uint (&s);
+	dive->time = (unsigned int *) dcbin_array (&s, dive->nrows, sizeof (unsigned int));
+	unsigned int time = 0;
+	for (unsigned int i = 0; dive->time && i < dive->nrows; ++i) {
+		time += dcbin_uint (&s);
+		dive->time[i] = time;
+	}
+
+	dcbin_column (&s, &dive->depth, 0);
+	dcbin_column (&s, &dive->temperature, 0);
+	dcbin_column (&s, &dive->pressure, 1);
+	dcbin_column (&s, &dive->gasmix, 0);
+
+	dive->nevents = dcbin_uint (&s);
+	dive->events = (dcbin_event_t *) dcbin_array (&s, dive->nevents, sizeof (dcbin_event_t));
+	for (unsigned int i = 0; dive->events && i < dive->nevents; ++i) {
+		dive->events[i].row = dcbin_uint (&s);
+		dive->events[i].type = dcbin_uint (&s);
+		dive->events[i].time = dcbin_uint (&s);
+		dive->events[i].flags = dcbin_uint (&s);
+		dive->events[i].value = dcbin_uint (&s);
+	}
+
+	if (s.error) {
+		dcbin_dive_free (dive);
+		return -1;
+	}
+
+	return 1;
+}
+
+void
+dcbin_dive_free (dcbin_dive_t *dive)
+{
+	free (dive->gasmixes);
+	free (dive->tanks);
+	free (dive->time);
+	free (dive->depth.entries);
+	free (dive->temperature.entries);
+	free (dive->pressure.entries);
+	free (dive->gasmix.entries);
+	free (dive->events);
+	memset (dive, 0, sizeof (*dive));
+}
@@ -0,0 +1,162 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCBIN_H
+#define DCBIN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Reader for the compact binary output of "dctool download -f binary"
+ * and "dctool parse -f binary". It only depends on the C library, so it
+ * can be copied into other projects as is.
+ *
+ * All values are metric integers: depths in millimeters, temperatures
+ * in hundredths of a degree Celsius, pressures in millibar, volumes in
+ * milliliters and gas fractions in permille. The atmospheric pressure
+ * is in pascal, for extra resolution.
+ *
+ * The file starts with the four byte magic "DCB" 0x01, followed by the
+ * dives. Each dive is a varint with the size of the record, followed by
+ * the record itself, so unknown records can be skipped:
+ *
+ *   number, size, fingerprint size, fingerprint bytes
+ *   year, month, day, hour, minute, second, flags
+ *   timezone (seconds, only when bit 0 of the flags is set)
+ *   divetime, maxdepth, field mask, fields present in the mask
+ *   gas mix count, (oxygen, helium) per gas mix
+ *   tank count, (gas mix + 1, type, volume, work, begin, end) per tank
+ *   row count, time column
+ *   depth, temperature, pressure and gas mix columns
+ *   event count, (row, type, time, flags, value) per event
+ *
+ * Unsigned numbers are LEB128 varints, signed numbers are zigzag
+ * encoded first. The time column holds the delta to the previous row.
+ * The other columns are sparse: a count, followed by the row delta and
+ * the value delta of each entry. Pressure entries have an additional
+ * tank number before the value delta.
+ */
+
+#define DCBIN_AVGDEPTH    (1 << 0)
+#define DCBIN_TEMP_SURF   (1 << 1)
+#define DCBIN_TEMP_MIN    (1 << 2)
+#define DCBIN_TEMP_MAX    (1 << 3)
+#define DCBIN_DIVEMODE    (1 << 4)
+#define DCBIN_SALINITY    (1 << 5)
+#define DCBIN_ATMOSPHERIC (1 << 6)
+
+typedef struct dcbin_entry_t {
+	unsigned int row;
+	unsigned int tank;
+	int value;
+} dcbin_entry_t;
+
+typedef struct dcbin_column_t {
+	dcbin_entry_t *entries;
+	unsigned int count;
+} dcbin_column_t;
+
+typedef struct dcbin_gasmix_t {
+	unsigned int oxygen;
+	unsigned int helium;
+} dcbin_gasmix_t;
+
+typedef struct dcbin_tank_t {
+	int gasmix; /* -1 if unknown */
+	unsigned int type;
+	unsigned int volume;
+	unsigned int workpressure;
+	unsigned int beginpressure;
+	unsigned int endpressure;
+} dcbin_tank_t;
+
+typedef struct dcbin_event_t {
+	unsigned int row;
+	unsigned int type;
+	unsigned int time;
+	unsigned int flags;
+	unsigned int value;
+} dcbin_event_t;
+
+typedef struct dcbin_dive_t {
+	unsigned int number;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	unsigned int year, month, day, hour, minute, second;
+	int has_timezone;
+	int timezone;
+	unsigned int divetime;
+	int maxdepth;
+	unsigned int fields;
+	int avgdepth;
+	int temperature_surface;
+	int temperature_minimum;
+	int temperature_maximum;
+	unsigned int divemode;
+	unsigned int salinity_type;
+	unsigned int salinity_density; /* kg/m3 x 10 */
+	unsigned int atmospheric;
+	unsigned int ngasmixes;
+	dcbin_gasmix_t *gasmixes;
+	unsigned int ntanks;
+	dcbin_tank_t *tanks;
+	unsigned int nrows;
+	unsigned int *time;
+	dcbin_column_t depth;
+	dcbin_column_t temperature;
+	dcbin_column_t pressure;
+	dcbin_column_t gasmix;
+	unsigned int nevents;
+	dcbin_event_t *events;
+} dcbin_dive_t;
+
+typedef struct dcbin_reader_t {
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+} dcbin_reader_t;
+
+/*
+ * Start reading the file contents. Returns zero on success, or -1 if
+ * the magic doesn't match.
+ */
+int
+dcbin_reader_init (dcbin_reader_t *reader, const unsigned char *data, size_t size);
+
+/*
+ * Decode the next dive. Returns 1 on success, 0 at the end of the data
+ * and -1 for corrupt data. The dive must be released with dcbin_dive_free.
+ */
+int
+dcbin_reader_next (dcbin_reader_t *reader, dcbin_dive_t *dive);
+
+void
+dcbin_dive_free (dcbin_dive_t *dive);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCBIN_H */
@@ -19,6 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -28,11 +32,22 @@
 #include <fcntl.h>
 #endif
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#define USE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include <libdivecomputer/serial.h>
 #include <libdivecomputer/bluetooth.h>
 #include <libdivecomputer/irda.h>
 #include <libdivecomputer/usb.h>
 #include <libdivecomputer/usbhid.h>
+#include <libdivecomputer/codec.h>
 
 #include "common.h"
 #include "utils.h"
@@ -139,6 +154,10 @@ dctool_errmsg (dc_status_t status)
 		return "Data format error";
 	case DC_STATUS_CANCELLED:
 		return "Cancelled";
+	case DC_STATUS_FULLSCAN:
+		return "Full profile scan required";
+	case DC_STATUS_LIMIT:
+		return "Resource limit exceeded";
 	default:
 		return "Unknown error";
 	}
@@ -225,9 +244,16 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 		message ("Event: waiting for user action\n");
 		break;
 	case DC_EVENT_PROGRESS:
-		message ("Event: progress %3.2f%% (%u/%u)\n",
+		message ("Event: progress %3.2f%% (%u/%u",
 			100.0 * (double) progress->current / (double) progress->maximum,
 			progress->current, progress->maximum);
+		if (progress->throughput)
+			message (", %u bytes/s", progress->throughput);
+		if (progress->phase == DC_PROGRESS_PROFILE && progress->ndives)
+			message (", dive %u/%u", progress->dive, progress->ndives);
+		if (progress->eta)
+			message (", eta %us", progress->eta);
+		message (")\n");
 		break;
 	case DC_EVENT_DEVINFO:
 		message ("Event: model=%u (0x%08x), firmware=%u (0x%08x), serial=%u (0x%08x)\n",
@@ -408,6 +434,179 @@ dctool_file_read (const char *filename)
 	return buffer;
 }
 
+/*
+ * Replace the contents of a compressed file with the decompressed data.
+ */
+static int
+dctool_file_decompress (dctool_mapping_t *mapping)
+{
+	if (!dc_codec_detect (mapping->data, mapping->size))
+		return 0;
+
+	dc_buffer_t *buffer = dc_buffer_new (0);
+	if (buffer == NULL)
+		return -1;
+
+	dc_status_t rc = dc_codec_decompress (NULL, mapping->data, mapping->size, buffer);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return -1;
+	}
+
+	dctool_file_unmap (mapping);
+
+	mapping->data = dc_buffer_get_data (buffer);
+	mapping->size = dc_buffer_get_size (buffer);
+	mapping->buffer = buffer;
+
+	return 0;
+}
+
+int
+dctool_file_map (dctool_mapping_t *mapping, const char *filename)
+{
+	mapping->data = NULL;
+	mapping->size = 0;
+	mapping->buffer = NULL;
+
+#ifdef USE_MMAP
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	struct stat st;
+	if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0) {
+		void *data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			close (fd);
+			mapping->data = (const unsigned char *) data;
+			mapping->size = st.st_size;
+			return dctool_file_decompress (mapping);
+		}
+	}
+
+	close (fd);
+#endif
+
+	// Fallback to reading the entire file.
+	mapping->buffer = dctool_file_read (filename);
+	if (mapping->buffer == NULL)
+		return -1;
+
+	mapping->data = dc_buffer_get_data (mapping->buffer);
+	mapping->size = dc_buffer_get_size (mapping->buffer);
+
+	return dctool_file_decompress (mapping);
+}
+
+void
+dctool_file_unmap (dctool_mapping_t *mapping)
+{
+	if (mapping->buffer) {
+		dc_buffer_free (mapping->buffer);
+	}
+#ifdef USE_MMAP
+	else if (mapping->data) {
+		munmap ((void *) mapping->data, mapping->size);
+	}
+#endif
+
+	mapping->data = NULL;
+	mapping->size = 0;
+	mapping->buffer = NULL;
+}
+
+static int
+dctool_input_add (dctool_input_list_t *list, const char *filename)
+{
+	if (list->count == list->capacity) {
+		unsigned int capacity = list->capacity ? list->capacity * 2 : 64;
+		dctool_input_t *inputs = (dctool_input_t *) realloc (list->inputs, capacity * sizeof (dctool_input_t));
+		if (inputs == NULL)
+			return -1;
+		list->inputs = inputs;
+		list->capacity = capacity;
+	}
+
+	char *copy = (char *) malloc (strlen (filename) + 1);
+	if (copy == NULL)
+		return -1;
+	strcpy (copy, filename);
+
+	memset (list->inputs + list->count, 0, sizeof (dctool_input_t));
+	list->inputs[list->count].filename = copy;
+	list->count++;
+
+	return 0;
+}
+
+static int
+dctool_input_cmp (const void *a, const void *b)
+{
+	const dctool_input_t *x = (const dctool_input_t *) a;
+	const dctool_input_t *y = (const dctool_input_t *) b;
+
+	return strcmp (x->filename, y->filename);
+}
+
+int
+dctool_input_expand (dctool_input_list_t *list, const char *pathname)
+{
+	struct stat st;
+	if (stat (pathname, &st) != 0 || !S_ISDIR (st.st_mode))
+		return dctool_input_add (list, pathname);
+
+	DIR *dir = opendir (pathname);
+	if (dir == NULL)
+		return -1;
+
+	// Add all regular files in the directory, sorted by name.
+	unsigned int first = list->count;
+	struct dirent *entry = NULL;
+	while ((entry = readdir (dir)) != NULL) {
+		char filename[1024] = {0};
+		snprintf (filename, sizeof (filename), "%s/%s", pathname, entry->d_name);
+		if (entry->d_name[0] == '.' || stat (filename, &st) != 0 || !S_ISREG (st.st_mode))
+			continue;
+
+		if (dctool_input_add (list, filename) != 0) {
+			closedir (dir);
+			return -1;
+		}
+	}
+
+	closedir (dir);
+
+	qsort (list->inputs + first, list->count - first, sizeof (dctool_input_t), dctool_input_cmp);
+
+	return 0;
+}
+
+int
+dctool_input_map (dctool_input_list_t *list)
+{
+	for (unsigned int i = 0; i < list->count; ++i) {
+		if (dctool_file_map (&list->inputs[i].mapping, list->inputs[i].filename) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+void
+dctool_input_free (dctool_input_list_t *list)
+{
+	for (unsigned int i = 0; i < list->count; ++i) {
+		dctool_file_unmap (&list->inputs[i].mapping);
+		free (list->inputs[i].filename);
+	}
+	free (list->inputs);
+
+	list->inputs = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
 static dc_status_t
 dctool_usb_open (dc_iostream_t **out, dc_context_t *context, dc_descriptor_t *descriptor)
 {
@@ -67,6 +67,50 @@ dctool_file_write (const char *filename, dc_buffer_t *buffer);
 dc_buffer_t *
 dctool_file_read (const char *filename);
 
+typedef struct dctool_mapping_t {
+	const unsigned char *data;
+	size_t size;
+	dc_buffer_t *buffer;
+} dctool_mapping_t;
+
+/*
+ * Map the file into memory, or read it into a buffer if mapping is not
+ * supported. Compressed files are decompressed transparently. Returns
+ * zero on success.
+ */
+int
+dctool_file_map (dctool_mapping_t *mapping, const char *filename);
+
+void
+dctool_file_unmap (dctool_mapping_t *mapping);
+
+typedef struct dctool_input_t {
+	char *filename;
+	dctool_mapping_t mapping;
+} dctool_input_t;
+
+typedef struct dctool_input_list_t {
+	dctool_input_t *inputs;
+	unsigned int count;
+	unsigned int capacity;
+} dctool_input_list_t;
+
+/*
+ * Add a file to the list, or all regular files in a directory, sorted
+ * by name. Returns zero on success.
+ */
+int
+dctool_input_expand (dctool_input_list_t *list, const char *pathname);
+
+/*
+ * Map all files in the list into memory. Returns zero on success.
+ */
+int
+dctool_input_map (dctool_input_list_t *list);
+
+void
+dctool_input_free (dctool_input_list_t *list);
+
 dc_status_t
 dctool_iostream_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname);
 
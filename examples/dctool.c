@@ -62,10 +62,12 @@ static const dctool_command_t *g_commands[] = {
 	&dctool_download,
 	&dctool_dump,
 	&dctool_parse,
+	&dctool_bench,
 	&dctool_read,
 	&dctool_write,
 	&dctool_timesync,
 	&dctool_fwupdate,
+	&dctool_ping,
 	NULL
 };
 
@@ -0,0 +1,601 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+#include <libdivecomputer/simulator.h>
+#include <libdivecomputer/replay.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define MAXVALUES 16
+
+#define NPAGES 64
+
+typedef struct bench_alloc_t {
+	unsigned long long count;
+} bench_alloc_t;
+
+typedef struct bench_phase_t {
+	const char *name;
+	double elapsed;
+} bench_phase_t;
+
+typedef struct bench_list_t {
+	unsigned int values[MAXVALUES];
+	unsigned int count;
+} bench_list_t;
+
+typedef struct bench_download_t {
+	double start;
+	double first;
+	unsigned long long ndives;
+	unsigned long long nbytes;
+} bench_download_t;
+
+typedef struct bench_field_t {
+	dc_field_type_t type;
+	unsigned int flags;
+} bench_field_t;
+
+static const bench_field_t g_fields[] = {
+	{DC_FIELD_DIVETIME, 0},
+	{DC_FIELD_MAXDEPTH, 0},
+	{DC_FIELD_AVGDEPTH, 0},
+	{DC_FIELD_GASMIX_COUNT, 0},
+	{DC_FIELD_GASMIX, 0},
+	{DC_FIELD_SALINITY, 0},
+	{DC_FIELD_ATMOSPHERIC, 0},
+	{DC_FIELD_TEMPERATURE_SURFACE, 0},
+	{DC_FIELD_TEMPERATURE_MINIMUM, 0},
+	{DC_FIELD_TEMPERATURE_MAXIMUM, 0},
+	{DC_FIELD_TANK_COUNT, 0},
+	{DC_FIELD_TANK, 0},
+	{DC_FIELD_DIVEMODE, 0},
+};
+
+static double
+bench_now (void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&now);
+	return (double) now.QuadPart / (double) frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+#else
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	return now.tv_sec + now.tv_usec / 1000000.0;
+#endif
+}
+
+static double
+bench_cpu (void)
+{
+	return (double) clock () / CLOCKS_PER_SEC;
+}
+
+static int
+bench_list_parse (bench_list_t *list, const char *str)
+{
+	list->count = 0;
+
+	while (*str) {
+		if (list->count >= MAXVALUES)
+			return -1;
+
+		char *end = NULL;
+		unsigned long value = strtoul (str, &end, 0);
+		if (end == str || (*end != ',' && *end != '\0'))
+			return -1;
+
+		list->values[list->count++] = value;
+
+		str = *end ? end + 1 : end;
+	}
+
+	return list->count ? 0 : -1;
+}
+
+static void *
+bench_alloc_cb (void *ptr, size_t size, void *userdata)
+{
+	bench_alloc_t *alloc = (bench_alloc_t *) userdata;
+
+	if (size == 0) {
+		free (ptr);
+		return NULL;
+	}
+
+	alloc->count++;
+
+	return realloc (ptr, size);
+}
+
+static void
+bench_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	unsigned long long *nsamples = (unsigned long long *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		(*nsamples)++;
+}
+
+static void
+bench_fields (dc_parser_t *parser)
+{
+	union {
+		unsigned int number;
+		double real;
+		dc_gasmix_t gasmix;
+		dc_salinity_t salinity;
+		dc_tank_t tank;
+		dc_divemode_t divemode;
+		dc_field_string_t string;
+	} value;
+
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (g_fields); ++i) {
+		dc_parser_get_field (parser, g_fields[i].type, g_fields[i].flags, &value);
+	}
+}
+
+static void
+bench_report (const char *name, double elapsed, unsigned long long ndives, unsigned long long nsamples, unsigned long long nbytes)
+{
+	if (elapsed <= 0.0) {
+		printf ("%-12s %10.6f %14s %14s %14s\n", name, elapsed, "-", "-", "-");
+		return;
+	}
+
+	printf ("%-12s %10.6f %14.0f %14.0f %14.0f\n", name, elapsed,
+		ndives / elapsed, nsamples / elapsed, nbytes / elapsed);
+}
+
+static int
+bench_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	bench_download_t *download = (bench_download_t *) userdata;
+
+	if (download->ndives == 0)
+		download->first = bench_now () - download->start;
+
+	download->ndives++;
+	download->nbytes += size;
+
+	return 1;
+}
+
+static dc_status_t
+bench_download_run (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], size_t size, const char *replay, const dc_simulator_link_t *link, unsigned int pagesize, bench_download_t *download, dc_iostream_stats_t *stats)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_iostream_t *iostream = NULL;
+	dc_device_t *device = NULL;
+
+	memset (download, 0, sizeof (*download));
+	memset (stats, 0, sizeof (*stats));
+
+	download->start = bench_now ();
+
+	if (replay) {
+		rc = dc_replay_open (&iostream, context, replay, 1);
+	} else {
+		rc = dc_simulator_open (&iostream, context, dc_descriptor_get_type (descriptor), data, size, link);
+	}
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the I/O stream.");
+		goto cleanup;
+	}
+
+	rc = dc_device_open (&device, context, descriptor, iostream);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the device.");
+		goto cleanup;
+	}
+
+	if (pagesize) {
+		rc = dc_device_set_readcache (device, pagesize, NPAGES);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error enabling the read cache.");
+			goto cleanup;
+		}
+	}
+
+	rc = dc_device_foreach (device, bench_dive_cb, download);
+
+	dc_iostream_get_stats (iostream, stats);
+
+cleanup:
+	dc_device_close (device);
+	dc_iostream_close (iostream);
+	return rc;
+}
+
+static dc_status_t
+bench_download (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], size_t size, const char *replay, const bench_list_t *latency, const bench_list_t *bandwidth, const bench_list_t *loss, const bench_list_t *pagesize, unsigned int iterations)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	printf ("%10s %10s %8s %8s %6s %10s %12s %10s %10s %10s\n",
+		"Latency", "Bandwidth", "Loss", "Block", "Errors",
+		"Time (s)", "Bytes/s", "Trips", "First (s)", "CPU (s/MB)");
+
+	// The read cache is only a parameter for the simulator, because a
+	// replay has to issue exactly the same requests as the recording.
+	unsigned int nlatency = replay ? 1 : latency->count;
+	unsigned int nbandwidth = replay ? 1 : bandwidth->count;
+	unsigned int nloss = replay ? 1 : loss->count;
+
+	for (unsigned int a = 0; a < nlatency; ++a) {
+	for (unsigned int b = 0; b < nbandwidth; ++b) {
+	for (unsigned int c = 0; c < nloss; ++c) {
+	for (unsigned int d = 0; d < pagesize->count; ++d) {
+		dc_simulator_link_t link = {DC_TRANSPORT_NONE, 0, 0, 0, 0};
+		link.latency = latency->values[a];
+		link.bandwidth = bandwidth->values[b];
+		link.loss = loss->values[c];
+
+		double elapsed = 0.0, first = 0.0, cpu = 0.0;
+		unsigned long long nbytes = 0, ntrips = 0, nerrors = 0, nfirst = 0;
+		for (unsigned int n = 0; n < iterations; ++n) {
+			bench_download_t download;
+			dc_iostream_stats_t stats;
+
+			// Use a different packet loss pattern for every iteration.
+			link.seed = n + 1;
+
+			double c0 = bench_cpu ();
+			dc_status_t status = bench_download_run (context, descriptor, data, size, replay, &link, pagesize->values[d], &download, &stats);
+			double c1 = bench_cpu ();
+			double t1 = bench_now ();
+
+			if (status != DC_STATUS_SUCCESS) {
+				nerrors++;
+				rc = status;
+			}
+
+			elapsed += t1 - download.start;
+			cpu += c1 - c0;
+			nbytes += stats.nbytes_in + stats.nbytes_out;
+			ntrips += stats.nwrites;
+			if (download.ndives) {
+				first += download.first;
+				nfirst++;
+			}
+		}
+
+		char strlatency[16], strbandwidth[16], strloss[16];
+		if (replay) {
+			snprintf (strlatency, sizeof (strlatency), "-");
+			snprintf (strbandwidth, sizeof (strbandwidth), "-");
+			snprintf (strloss, sizeof (strloss), "-");
+		} else {
+			snprintf (strlatency, sizeof (strlatency), "%u", link.latency);
+			snprintf (strbandwidth, sizeof (strbandwidth), "%u", link.bandwidth);
+			snprintf (strloss, sizeof (strloss), "%u", link.loss);
+		}
+
+		printf ("%10s %10s %8s %8u %6llu %10.3f %12.0f %10.1f %10.3f %10.3f\n",
+			strlatency, strbandwidth, strloss, pagesize->values[d], nerrors,
+			elapsed / iterations,
+			elapsed > 0.0 ? nbytes / elapsed : 0.0,
+			(double) ntrips / iterations,
+			nfirst ? first / nfirst : 0.0,
+			nbytes ? cpu / (nbytes / 1000000.0) : 0.0);
+	}
+	}
+	}
+	}
+
+	return rc;
+}
+
+static dc_status_t
+bench (const dctool_input_t inputs[], unsigned int count, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int iterations)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+	bench_alloc_t alloc = {0};
+
+	// Count the allocations made through the context.
+	dc_context_set_allocator (context, bench_alloc_cb, &alloc);
+
+	rc = dc_parser_new2 (&parser, context, descriptor, 0, 0);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the parser.");
+		goto cleanup;
+	}
+
+	unsigned long long nbytes = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		nbytes += inputs[i].mapping.size;
+	}
+
+	// Each phase is timed separately for every dive, in the same order
+	// as a regular import: assign the data, query the summary fields
+	// and walk the profile.
+	bench_phase_t phases[] = {
+		{"set_data", 0.0},
+		{"get_field", 0.0},
+		{"samples", 0.0},
+	};
+
+	unsigned long long nsamples = 0, nerrors = 0;
+	unsigned long long nallocs = alloc.count;
+	for (unsigned int n = 0; n < iterations; ++n) {
+		for (unsigned int i = 0; i < count; ++i) {
+			double t0 = bench_now ();
+
+			dc_status_t status = dc_parser_set_data (parser, inputs[i].mapping.data, inputs[i].mapping.size);
+
+			double t1 = bench_now ();
+
+			if (status != DC_STATUS_SUCCESS) {
+				phases[0].elapsed += t1 - t0;
+				nerrors++;
+				continue;
+			}
+
+			bench_fields (parser);
+
+			double t2 = bench_now ();
+
+			status = dc_parser_samples_foreach (parser, bench_sample_cb, &nsamples);
+			if (status != DC_STATUS_SUCCESS)
+				nerrors++;
+
+			double t3 = bench_now ();
+
+			phases[0].elapsed += t1 - t0;
+			phases[1].elapsed += t2 - t1;
+			phases[2].elapsed += t3 - t2;
+		}
+	}
+	nallocs = alloc.count - nallocs;
+
+	unsigned long long ndives = (unsigned long long) count * iterations;
+	double total = phases[0].elapsed + phases[1].elapsed + phases[2].elapsed;
+
+	printf ("Dives:       %u (%llu bytes)\n", count, nbytes);
+	printf ("Iterations:  %u\n", iterations);
+	printf ("Samples:     %llu per iteration\n", nsamples / (iterations ? iterations : 1));
+	printf ("Errors:      %llu\n", nerrors);
+	printf ("Allocations: %.2f per dive\n", ndives ? (double) nallocs / ndives : 0.0);
+	printf ("\n");
+	printf ("%-12s %10s %14s %14s %14s\n", "Phase", "Time (s)", "Dives/s", "Samples/s", "Bytes/s");
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (phases); ++i) {
+		bench_report (phases[i].name, phases[i].elapsed, ndives, nsamples, nbytes * iterations);
+	}
+	bench_report ("total", total, ndives, nsamples, nbytes * iterations);
+
+cleanup:
+	dc_parser_destroy (parser);
+	dc_context_set_allocator (context, NULL, NULL);
+	return rc;
+}
+
+static int
+dctool_bench_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dctool_input_list_t list = {NULL, 0, 0};
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int iterations = 0;
+	const char *simulate = NULL;
+	const char *replay = NULL;
+	bench_list_t latency = {{0}, 1};
+	bench_list_t bandwidth = {{0}, 1};
+	bench_list_t loss = {{0}, 1};
+	bench_list_t pagesize = {{0}, 1};
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hn:s:r:l:w:p:c:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"iterations",  required_argument, 0, 'n'},
+		{"simulate",    required_argument, 0, 's'},
+		{"replay",      required_argument, 0, 'r'},
+		{"latency",     required_argument, 0, 'l'},
+		{"bandwidth",   required_argument, 0, 'w'},
+		{"loss",        required_argument, 0, 'p'},
+		{"cache",       required_argument, 0, 'c'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			if (iterations == 0) {
+				message ("Invalid number of iterations.\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 's':
+			simulate = optarg;
+			break;
+		case 'r':
+			replay = optarg;
+			break;
+		case 'l':
+		case 'w':
+		case 'p':
+		case 'c':
+			if (bench_list_parse (
+				opt == 'l' ? &latency :
+				opt == 'w' ? &bandwidth :
+				opt == 'p' ? &loss : &pagesize, optarg) != 0) {
+				message ("Invalid list of values.\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_bench);
+		return EXIT_SUCCESS;
+	}
+
+	if (simulate && replay) {
+		message ("The simulator and replay options are mutually exclusive.\n");
+		return EXIT_FAILURE;
+	}
+
+	// Benchmark a download.
+	if (simulate || replay) {
+		dctool_mapping_t mapping = {NULL, 0, NULL};
+		if (simulate && dctool_file_map (&mapping, simulate) != 0) {
+			message ("Failed to open the simulator file.\n");
+			return EXIT_FAILURE;
+		}
+
+		status = bench_download (context, descriptor, mapping.data, mapping.size, replay,
+			&latency, &bandwidth, &loss, &pagesize, iterations ? iterations : 1);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+		}
+
+		if (simulate)
+			dctool_file_unmap (&mapping);
+
+		return exitcode;
+	}
+
+	if (iterations == 0)
+		iterations = 10;
+
+	// Collect the input files.
+	for (unsigned int i = 0; i < argc; ++i) {
+		if (dctool_input_expand (&list, argv[i]) != 0) {
+			message ("Failed to open the input file.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	// Map the input files.
+	if (dctool_input_map (&list) != 0) {
+		message ("Failed to open the input file.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Run the benchmark.
+	status = bench (list.inputs, list.count, context, descriptor, iterations);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+cleanup:
+	dctool_input_free (&list);
+	return exitcode;
+}
+
+const dctool_command_t dctool_bench = {
+	dctool_bench_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"bench",
+	"Measure the parse or download throughput",
+	"Usage:\n"
+	"   dctool bench [options] <filename|directory> ...\n"
+	"   dctool bench [options] -s <filename>\n"
+	"   dctool bench [options] -r <filename>\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -n, --iterations <count>   Number of iterations (default 10, or 1\n"
+	"                              for a download)\n"
+	"   -s, --simulate <filename>  Download from a simulated device\n"
+	"   -r, --replay <filename>    Download from a recorded session\n"
+	"   -l, --latency <list>       One way delay (microseconds)\n"
+	"   -w, --bandwidth <list>     Throughput (bytes per second)\n"
+	"   -p, --loss <list>          Packet loss (parts per million)\n"
+	"   -c, --cache <list>         Read cache page size (bytes)\n"
+#else
+	"   -h              Show help message\n"
+	"   -n <count>      Number of iterations (default 10, or 1 for a\n"
+	"                   download)\n"
+	"   -s <filename>   Download from a simulated device\n"
+	"   -r <filename>   Download from a recorded session\n"
+	"   -l <list>       One way delay (microseconds)\n"
+	"   -w <list>       Throughput (bytes per second)\n"
+	"   -p <list>       Packet loss (parts per million)\n"
+	"   -c <list>       Read cache page size (bytes)\n"
+#endif
+	"\n"
+	"Only the allocations made through the library context are counted.\n"
+	"\n"
+	"A download benchmark runs every combination of the comma separated\n"
+	"lists of link conditions. A value of zero means a perfect link, or\n"
+	"no read cache. The link conditions don't apply to a replay, which\n"
+	"reproduces the recorded timing. The round trips are the number of\n"
+	"write operations, and the bytes are counted in both directions.\n"
+};
@@ -30,6 +30,9 @@
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
@@ -46,13 +49,170 @@ typedef struct event_data_t {
 	dc_event_devinfo_t devinfo;
 } event_data_t;
 
+#define MAXJOBS 16
+#define QUEUE_SIZE 16
+
+typedef struct dive_queue_t dive_queue_t;
+
 typedef struct dive_data_t {
 	dc_device_t *device;
 	dc_buffer_t **fingerprint;
 	unsigned int number;
 	dctool_output_t *output;
+	dive_queue_t *queue;
 } dive_data_t;
 
+#ifdef HAVE_PTHREAD_H
+typedef struct dive_job_t {
+	dc_parser_t *parser;
+	dc_buffer_t *data;
+	dc_buffer_t *fingerprint;
+	dc_status_t status;
+	unsigned int parsed;
+} dive_job_t;
+
+/*
+ * The download thread only copies the dives into a bounded queue. The
+ * worker threads parse them, and a single writer thread outputs them in
+ * the order they were downloaded.
+ */
+struct dive_queue_t {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	dive_job_t jobs[QUEUE_SIZE];
+	unsigned int queued;
+	unsigned int taken;
+	unsigned int written;
+	unsigned int stop;
+	dctool_output_t *output;
+};
+
+static dc_status_t
+dive_queue_push (dive_queue_t *queue, dc_device_t *device, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+
+	// The parser is created on the download thread, because it needs
+	// the device handle.
+	rc = dc_parser_new (&parser, device);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the parser.");
+		return rc;
+	}
+
+	// Keep the decoded samples, so the output replays them.
+	dc_parser_set_flags (parser, DC_PARSER_FLAG_CACHE);
+
+	dc_buffer_t *copy = dc_buffer_new (size);
+	dc_buffer_t *fp = dc_buffer_new (fsize);
+	if (copy == NULL || fp == NULL ||
+		!dc_buffer_append (copy, data, size) ||
+		!dc_buffer_append (fp, fingerprint, fsize)) {
+		ERROR ("Error copying the dive data.");
+		dc_buffer_free (copy);
+		dc_buffer_free (fp);
+		dc_parser_destroy (parser);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	pthread_mutex_lock (&queue->mutex);
+
+	// Wait for a free slot.
+	while (queue->queued - queue->written >= QUEUE_SIZE)
+		pthread_cond_wait (&queue->cond, &queue->mutex);
+
+	dive_job_t *job = queue->jobs + queue->queued % QUEUE_SIZE;
+	job->parser = parser;
+	job->data = copy;
+	job->fingerprint = fp;
+	job->status = DC_STATUS_SUCCESS;
+	job->parsed = 0;
+	queue->queued++;
+
+	pthread_cond_broadcast (&queue->cond);
+	pthread_mutex_unlock (&queue->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void *
+dive_queue_worker (void *userdata)
+{
+	dive_queue_t *queue = (dive_queue_t *) userdata;
+
+	pthread_mutex_lock (&queue->mutex);
+	while (1) {
+		while (queue->taken == queue->queued && !queue->stop)
+			pthread_cond_wait (&queue->cond, &queue->mutex);
+
+		if (queue->taken == queue->queued)
+			break;
+
+		dive_job_t *job = queue->jobs + queue->taken % QUEUE_SIZE;
+		queue->taken++;
+		pthread_mutex_unlock (&queue->mutex);
+
+		// Decode the dive, and fill the sample cache.
+		dc_status_t rc = dc_parser_set_data (job->parser,
+			dc_buffer_get_data (job->data), dc_buffer_get_size (job->data));
+		if (rc == DC_STATUS_SUCCESS) {
+			dc_parser_samples_foreach (job->parser, NULL, NULL);
+		}
+
+		pthread_mutex_lock (&queue->mutex);
+		job->status = rc;
+		job->parsed = 1;
+		pthread_cond_broadcast (&queue->cond);
+	}
+	pthread_mutex_unlock (&queue->mutex);
+
+	return NULL;
+}
+
+static void *
+dive_queue_writer (void *userdata)
+{
+	dive_queue_t *queue = (dive_queue_t *) userdata;
+
+	pthread_mutex_lock (&queue->mutex);
+	while (1) {
+		dive_job_t *job = queue->jobs + queue->written % QUEUE_SIZE;
+		while ((queue->written == queue->queued || !job->parsed) &&
+			!(queue->stop && queue->written == queue->queued))
+			pthread_cond_wait (&queue->cond, &queue->mutex);
+
+		if (queue->written == queue->queued)
+			break;
+
+		pthread_mutex_unlock (&queue->mutex);
+
+		if (job->status != DC_STATUS_SUCCESS) {
+			ERROR ("Error registering the data.");
+		} else if (dctool_output_write (queue->output, job->parser,
+			dc_buffer_get_data (job->data), dc_buffer_get_size (job->data),
+			dc_buffer_get_data (job->fingerprint), dc_buffer_get_size (job->fingerprint)) != DC_STATUS_SUCCESS) {
+			ERROR ("Error parsing the dive data.");
+		}
+
+		dc_parser_destroy (job->parser);
+		dc_buffer_free (job->data);
+		dc_buffer_free (job->fingerprint);
+
+		pthread_mutex_lock (&queue->mutex);
+		job->parser = NULL;
+		job->data = NULL;
+		job->fingerprint = NULL;
+		job->parsed = 0;
+		queue->written++;
+		pthread_cond_broadcast (&queue->cond);
+	}
+	pthread_mutex_unlock (&queue->mutex);
+
+	return NULL;
+}
+#endif
+
 static int
 dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
 {
@@ -76,6 +236,15 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 		*divedata->fingerprint = fp;
 	}
 
+#ifdef HAVE_PTHREAD_H
+	// Hand the dive over to the parse workers.
+	if (divedata->queue) {
+		message ("Queueing the dive data.\n");
+		dive_queue_push (divedata->queue, divedata->device, data, size, fingerprint, fsize);
+		return 1;
+	}
+#endif
+
 	// Create the parser.
 	message ("Creating the parser.\n");
 	rc = dc_parser_new (&parser, divedata->device);
@@ -152,12 +321,16 @@ event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *us
 }
 
 static dc_status_t
-download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output)
+download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output, unsigned int njobs)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_iostream_t *iostream = NULL;
 	dc_device_t *device = NULL;
 	dc_buffer_t *ofingerprint = NULL;
+	dc_fpstore_t *fpstore = NULL;
+	char fpfilename[1024] = {0};
+	dc_pacing_t *pacing = NULL;
+	char pcfilename[1024] = {0};
 
 	// Open the I/O stream.
 	message ("Opening the I/O stream (%s, %s).\n",
@@ -214,16 +387,116 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t tra
 		}
 	}
 
+	// Load the fingerprints of all previously downloaded dives. A
+	// missing file is not an error, the store is simply empty.
+	if (cachedir && fingerprint == NULL) {
+		rc = dc_fpstore_new (&fpstore, context);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error creating the fingerprint store.");
+			goto cleanup;
+		}
+
+		snprintf (fpfilename, sizeof (fpfilename), "%s/fingerprints.dcfp", cachedir);
+		dc_fpstore_load (fpstore, fpfilename);
+
+		dc_device_set_fpstore (device, fpstore);
+	}
+
+	// Load the learned inter-packet delays.
+	if (cachedir) {
+		rc = dc_pacing_new (&pacing, context);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error creating the pacing cache.");
+			goto cleanup;
+		}
+
+		snprintf (pcfilename, sizeof (pcfilename), "%s/pacing.dcpc", cachedir);
+		dc_pacing_load (pacing, pcfilename);
+
+		dc_device_set_pacing (device, pacing);
+	}
+
 	// Initialize the dive data.
 	dive_data_t divedata = {0};
 	divedata.device = device;
 	divedata.fingerprint = &ofingerprint;
 	divedata.number = 0;
 	divedata.output = output;
+	divedata.queue = NULL;
+
+#ifdef HAVE_PTHREAD_H
+	// Start the parse workers and the writer.
+	dive_queue_t queue;
+	pthread_t workers[MAXJOBS], writer;
+	unsigned int nworkers = 0, nwriters = 0;
+	if (njobs) {
+		memset (&queue, 0, sizeof (queue));
+		queue.output = output;
+		pthread_mutex_init (&queue.mutex, NULL);
+		pthread_cond_init (&queue.cond, NULL);
+
+		if (pthread_create (&writer, NULL, dive_queue_writer, &queue) == 0)
+			nwriters++;
+		while (nwriters && nworkers < njobs && nworkers < MAXJOBS) {
+			if (pthread_create (&workers[nworkers], NULL, dive_queue_worker, &queue) != 0)
+				break;
+			nworkers++;
+		}
+
+		if (nworkers) {
+			message ("Parsing with %u threads.\n", nworkers);
+			divedata.queue = &queue;
+		} else {
+			message ("Failed to start the parse threads.\n");
+		}
+	}
+#else
+	if (njobs) {
+		message ("Parallel parsing is not supported.\n");
+	}
+#endif
 
 	// Download the dives.
 	message ("Downloading the dives.\n");
 	rc = dc_device_foreach (device, dive_cb, &divedata);
+
+#ifdef HAVE_PTHREAD_H
+	// Wait until all queued dives have been written.
+	if (njobs) {
+		pthread_mutex_lock (&queue.mutex);
+		queue.stop = 1;
+		pthread_cond_broadcast (&queue.cond);
+		pthread_mutex_unlock (&queue.mutex);
+
+		for (unsigned int i = 0; i < nworkers; ++i)
+			pthread_join (workers[i], NULL);
+		if (nwriters)
+			pthread_join (writer, NULL);
+
+		pthread_cond_destroy (&queue.cond);
+		pthread_mutex_destroy (&queue.mutex);
+	}
+#endif
+
+	// Report the transport statistics.
+	dc_iostream_stats_t stats;
+	if (dc_iostream_get_stats (iostream, &stats) == DC_STATUS_SUCCESS) {
+		message ("Transport: in=%u, out=%u, reads=%u, writes=%u, timeouts=%u, retries=%u, poll=%ums, read=%ums\n",
+			stats.nbytes_in, stats.nbytes_out, stats.nreads, stats.nwrites,
+			stats.ntimeouts, stats.nretries, stats.polltime, stats.readtime);
+	}
+
+	// Store the fingerprints of all downloaded dives. This is done even
+	// if the download failed halfway, so the next attempt can resume
+	// with the remaining dives.
+	if (fpstore) {
+		dc_fpstore_save (fpstore, fpfilename);
+	}
+
+	if (pacing) {
+		dc_pacing_save (pacing, pcfilename);
+	}
+
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error downloading the dives.");
 		goto cleanup;
@@ -246,6 +519,8 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t tra
 cleanup:
 	dc_buffer_free (ofingerprint);
 	dc_device_close (device);
+	dc_fpstore_free (fpstore);
+	dc_pacing_free (pacing);
 	dc_iostream_close (iostream);
 	return rc;
 }
@@ -266,10 +541,12 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	const char *filename = NULL;
 	const char *cachedir = NULL;
 	const char *format = "xml";
+	unsigned int njobs = 0;
+	unsigned int compress = 0;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ht:o:p:c:f:u:";
+	const char *optstring = "ht:o:p:c:f:u:j:z";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
@@ -279,6 +556,8 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		{"cache",       required_argument, 0, 'c'},
 		{"format",      required_argument, 0, 'f'},
 		{"units",       required_argument, 0, 'u'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"compress",    no_argument,       0, 'z'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -310,6 +589,12 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 			if (strcmp (optarg, "imperial") == 0)
 				units = DCTOOL_UNITS_IMPERIAL;
 			break;
+		case 'j':
+			njobs = strtoul (optarg, NULL, 0);
+			break;
+		case 'z':
+			compress = 1;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -336,9 +621,13 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 
 	// Create the output.
 	if (strcasecmp(format, "raw") == 0) {
-		output = dctool_raw_output_new (filename);
+		output = dctool_raw_output_new (filename, compress);
 	} else if (strcasecmp(format, "xml") == 0) {
 		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "ndjson") == 0) {
+		output = dctool_ndjson_output_new (filename, units);
+	} else if (strcasecmp(format, "binary") == 0) {
+		output = dctool_binary_output_new (filename);
 	} else {
 		message ("Unknown output format: %s\n", format);
 		exitcode = EXIT_FAILURE;
@@ -351,7 +640,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	}
 
 	// Download the dives.
-	status = download (context, descriptor, transport, argv[0], cachedir, fingerprint, output);
+	status = download (context, descriptor, transport, argv[0], cachedir, fingerprint, output, njobs);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -381,6 +670,8 @@ const dctool_command_t dctool_download = {
 	"   -c, --cache <directory>    Cache directory\n"
 	"   -f, --format <format>      Output format\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
+	"   -j, --jobs <count>         Number of parse threads\n"
+	"   -z, --compress             Compress the raw output\n"
 #else
 	"   -h                 Show help message\n"
 	"   -t <transport>     Transport type\n"
@@ -389,6 +680,8 @@ const dctool_command_t dctool_download = {
 	"   -c <directory>     Cache directory\n"
 	"   -f <format>        Output format\n"
 	"   -u <units>         Set units (metric or imperial)\n"
+	"   -j <count>         Number of parse threads\n"
+	"   -z                 Compress the raw output\n"
 #endif
 	"\n"
 	"Supported output formats:\n"
@@ -401,7 +694,19 @@ const dctool_command_t dctool_download = {
 	"\n"
 	"      Each dive is exported to a raw (binary) file. To output multiple\n"
 	"      files, the filename is interpreted as a template and should\n"
-	"      contain one or more placeholders.\n"
+	"      contain one or more placeholders. With the compress option, the\n"
+	"      files are compressed, and can be read back with dctool parse.\n"
+	"\n"
+	"   NDJSON\n"
+	"\n"
+	"      All dives are exported to a single file, with one JSON object\n"
+	"      per line. The samples are stored as compact arrays.\n"
+	"\n"
+	"   BINARY\n"
+	"\n"
+	"      All dives are exported to a single file in a compact binary\n"
+	"      format, with the samples stored per column. The values are\n"
+	"      always in metric units. See contrib/dcbin for a reader.\n"
 	"\n"
 	"Supported template placeholders:\n"
 	"\n"
@@ -34,17 +34,20 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/diveindex.h>
+#include <libdivecomputer/codec.h>
 
 #include "dctool.h"
 #include "common.h"
 #include "utils.h"
 
 static dc_status_t
-dump (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, dc_buffer_t *fingerprint, dc_buffer_t *buffer)
+dump (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, dc_buffer_t *fingerprint, dc_buffer_t *buffer, const char *indexname)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_iostream_t *iostream = NULL;
 	dc_device_t *device = NULL;
+	dc_diveindex_t *index = NULL;
 
 	// Open the I/O stream.
 	message ("Opening the I/O stream (%s, %s).\n",
@@ -101,7 +104,30 @@ dump (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transpo
 		goto cleanup;
 	}
 
+	// Index the dives in the memory dump.
+	if (indexname) {
+		message ("Building the dive index.\n");
+		rc = dc_diveindex_new (&index, context);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error creating the dive index.");
+			goto cleanup;
+		}
+
+		rc = dc_diveindex_build (index, device, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error building the dive index.");
+			goto cleanup;
+		}
+
+		rc = dc_diveindex_save (index, indexname);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error writing the dive index.");
+			goto cleanup;
+		}
+	}
+
 cleanup:
+	dc_diveindex_free (index);
 	dc_device_close (device);
 	dc_iostream_close (iostream);
 	return rc;
@@ -118,18 +144,22 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 
 	// Default option values.
 	unsigned int help = 0;
+	unsigned int compress = 0;
 	const char *fphex = NULL;
 	const char *filename = NULL;
+	const char *indexname = NULL;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ht:o:p:";
+	const char *optstring = "ht:o:p:i:z";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"transport",   required_argument, 0, 't'},
 		{"output",      required_argument, 0, 'o'},
 		{"fingerprint", required_argument, 0, 'p'},
+		{"index",       required_argument, 0, 'i'},
+		{"compress",    no_argument,       0, 'z'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -149,6 +179,12 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 'p':
 			fphex = optarg;
 			break;
+		case 'i':
+			indexname = optarg;
+			break;
+		case 'z':
+			compress = 1;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -173,19 +209,44 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	// Convert the fingerprint to binary.
 	fingerprint = dctool_convert_hex2bin (fphex);
 
-	// Allocate a memory buffer.
-	buffer = dc_buffer_new (0);
+	// Allocate a memory buffer. Without compression, the memory dump is
+	// downloaded directly into the output file.
+	if (filename && !compress) {
+		buffer = dc_buffer_new_file (filename);
+		if (buffer == NULL) {
+			message ("ERROR: Failed to open the output file.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	} else {
+		buffer = dc_buffer_new (0);
+	}
 
 	// Download the memory dump.
-	status = dump (context, descriptor, transport, argv[0], fingerprint, buffer);
+	status = dump (context, descriptor, transport, argv[0], fingerprint, buffer, indexname);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
 		goto cleanup;
 	}
 
+	// Compress the memory dump.
+	if (compress) {
+		dc_buffer_t *compressed = dc_buffer_new (0);
+		status = dc_codec_compress (context, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), compressed);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			dc_buffer_free (compressed);
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+		dc_buffer_free (buffer);
+		buffer = compressed;
+	}
+
 	// Write the memory dump to disk.
-	dctool_file_write (filename, buffer);
+	if (!filename || compress)
+		dctool_file_write (filename, buffer);
 
 cleanup:
 	dc_buffer_free (buffer);
@@ -207,10 +268,14 @@ const dctool_command_t dctool_dump = {
 	"   -t, --transport <name>     Transport type\n"
 	"   -o, --output <filename>    Output filename\n"
 	"   -p, --fingerprint <data>   Fingerprint data (hexadecimal)\n"
+	"   -i, --index <filename>     Dive index filename\n"
+	"   -z, --compress             Compress the memory dump\n"
 #else
 	"   -h                 Show help message\n"
 	"   -t <transport>     Transport type\n"
 	"   -o <filename>      Output filename\n"
 	"   -p <fingerprint>   Fingerprint data (hexadecimal)\n"
+	"   -i <filename>      Dive index filename\n"
+	"   -z                 Compress the memory dump\n"
 #endif
 };
@@ -42,40 +42,70 @@
 
 #define REACTPROWHITE 0x4354
 
+typedef struct parse_data_t {
+	const dctool_input_t *inputs;
+	dctool_output_t *output;
+	dc_status_t status;
+} parse_data_t;
+
+static int
+parse_cb (dc_parser_t *parser, unsigned int index, dc_status_t status, void *userdata)
+{
+	parse_data_t *data = (parse_data_t *) userdata;
+	const dctool_input_t *input = data->inputs + index;
+
+	message ("Parsing the dive data (%s).\n", input->filename);
+
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error registering the data.");
+		data->status = status;
+		return 0;
+	}
+
+	status = dctool_output_write (data->output, parser, input->mapping.data, input->mapping.size, NULL, 0);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the dive data.");
+		data->status = status;
+		return 0;
+	}
+
+	return 1;
+}
+
 static dc_status_t
-parse (dc_buffer_t *buffer, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, dctool_output_t *output)
+parse (const dctool_input_t inputs[], unsigned int count, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, unsigned int njobs, dctool_output_t *output)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_parser_t *parser = NULL;
-	unsigned char *data = dc_buffer_get_data (buffer);
-	unsigned int size = dc_buffer_get_size (buffer);
+	dc_parser_blob_t *blobs = NULL;
 
-	// Create the parser.
-	message ("Creating the parser.\n");
-	rc = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error creating the parser.");
-		goto cleanup;
-	}
+	if (count == 0)
+		return DC_STATUS_SUCCESS;
 
-	// Register the data.
-	message ("Registering the data.\n");
-	rc = dc_parser_set_data (parser, data, size);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error registering the data.");
-		goto cleanup;
+	blobs = (dc_parser_blob_t *) malloc (count * sizeof (dc_parser_blob_t));
+	if (blobs == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		blobs[i].data = inputs[i].mapping.data;
+		blobs[i].size = inputs[i].mapping.size;
 	}
 
-	// Parse the dive data.
-	message ("Parsing the dive data.\n");
-	rc = dctool_output_write (output, parser, data, size, NULL, 0);
+	// Parse the dives. The output is always written in the order of the
+	// input files, regardless of the number of threads.
+	parse_data_t data = {inputs, output, DC_STATUS_SUCCESS};
+	message ("Parsing %u dives.\n", count);
+	if (njobs == 1) {
+		rc = dc_parser_parse_batch (context, descriptor, devtime, systime, blobs, count, parse_cb, &data);
+	} else {
+		rc = dc_parser_parse_parallel (context, descriptor, devtime, systime, blobs, count, njobs, parse_cb, &data);
+	}
 	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error parsing the dive data.");
-		goto cleanup;
+		ERROR ("Error creating the parser.");
+	} else {
+		rc = data.status;
 	}
 
-cleanup:
-	dc_parser_destroy (parser);
+	free (blobs);
 	return rc;
 }
 
@@ -85,7 +115,7 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	// Default values.
 	int exitcode = EXIT_SUCCESS;
 	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_buffer_t *buffer = NULL;
+	dctool_input_list_t list = {NULL, 0, 0};
 	dctool_output_t *output = NULL;
 	dctool_units_t units = DCTOOL_UNITS_METRIC;
 
@@ -94,17 +124,21 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	const char *filename = NULL;
 	unsigned int devtime = 0;
 	dc_ticks_t systime = 0;
+	unsigned int njobs = 1;
+	const char *format = "xml";
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:d:s:u:";
+	const char *optstring = "ho:d:s:f:u:j:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"output",      required_argument, 0, 'o'},
 		{"devtime",     required_argument, 0, 'd'},
 		{"systime",     required_argument, 0, 's'},
+		{"format",      required_argument, 0, 'f'},
 		{"units",       required_argument, 0, 'u'},
+		{"jobs",        required_argument, 0, 'j'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -124,12 +158,18 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 's':
 			systime = strtoll (optarg, NULL, 0);
 			break;
+		case 'f':
+			format = optarg;
+			break;
 		case 'u':
 			if (strcmp (optarg, "metric") == 0)
 				units = DCTOOL_UNITS_METRIC;
 			if (strcmp (optarg, "imperial") == 0)
 				units = DCTOOL_UNITS_IMPERIAL;
 			break;
+		case 'j':
+			njobs = strtoul (optarg, NULL, 0);
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -145,37 +185,49 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Create the output.
-	output = dctool_xml_output_new (filename, units);
+	if (strcasecmp(format, "xml") == 0) {
+		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "ndjson") == 0) {
+		output = dctool_ndjson_output_new (filename, units);
+	} else if (strcasecmp(format, "binary") == 0) {
+		output = dctool_binary_output_new (filename);
+	} else {
+		message ("Unknown output format: %s\n", format);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
 	if (output == NULL) {
 		message ("Failed to create the output.\n");
 		exitcode = EXIT_FAILURE;
 		goto cleanup;
 	}
 
+	// Collect the input files.
 	for (unsigned int i = 0; i < argc; ++i) {
-		// Read the input file.
-		buffer = dctool_file_read (argv[i]);
-		if (buffer == NULL) {
+		if (dctool_input_expand (&list, argv[i]) != 0) {
 			message ("Failed to open the input file.\n");
 			exitcode = EXIT_FAILURE;
 			goto cleanup;
 		}
+	}
 
-		// Parse the dive.
-		status = parse (buffer, context, descriptor, devtime, systime, output);
-		if (status != DC_STATUS_SUCCESS) {
-			message ("ERROR: %s\n", dctool_errmsg (status));
-			exitcode = EXIT_FAILURE;
-			goto cleanup;
-		}
+	// Map the input files.
+	if (dctool_input_map (&list) != 0) {
+		message ("Failed to open the input file.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
 
-		// Cleanup.
-		dc_buffer_free (buffer);
-		buffer = NULL;
+	// Parse the dives.
+	status = parse (list.inputs, list.count, context, descriptor, devtime, systime, njobs, output);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
 	}
 
 cleanup:
-	dc_buffer_free (buffer);
+	dctool_input_free (&list);
 	dctool_output_free (output);
 	return exitcode;
 }
@@ -186,7 +238,7 @@ const dctool_command_t dctool_parse = {
 	"parse",
 	"Parse previously downloaded dives",
 	"Usage:\n"
-	"   dctool parse [options] <filename>\n"
+	"   dctool parse [options] <filename|directory> ...\n"
 	"\n"
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
@@ -194,12 +246,16 @@ const dctool_command_t dctool_parse = {
 	"   -o, --output <filename>    Output filename\n"
 	"   -d, --devtime <timestamp>  Device time\n"
 	"   -s, --systime <timestamp>  System time\n"
+	"   -f, --format <format>      Output format (xml, ndjson or binary)\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
+	"   -j, --jobs <count>         Number of parse threads (0 for default)\n"
 #else
 	"   -h              Show help message\n"
 	"   -o <filename>   Output filename\n"
 	"   -d <devtime>    Device time\n"
 	"   -s <systime>    System time\n"
+	"   -f <format>     Output format (xml, ndjson or binary)\n"
 	"   -u <units>      Set units (metric or imperial)\n"
+	"   -j <count>      Number of parse threads (0 for default)\n"
 #endif
 };
@@ -0,0 +1,419 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <sys/time.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/hw_ostc3.h>
+#include <libdivecomputer/hw_frog.h>
+#include <libdivecomputer/suunto_d9.h>
+#include <libdivecomputer/suunto_vyper2.h>
+#include <libdivecomputer/oceanic_atom2.h>
+#include <libdivecomputer/oceanic_veo250.h>
+#include <libdivecomputer/oceanic_vtpro.h>
+#include <libdivecomputer/atomics_cobalt.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+#define NBINS 12
+
+#define SZ_BUFFER 256
+#define SZ_READ   16
+
+typedef struct ping_stats_t {
+	unsigned int count;
+	unsigned int errors;
+	double *samples;
+	unsigned int nsamples;
+	unsigned int histogram[NBINS];
+} ping_stats_t;
+
+static double
+ping_now (void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&now);
+	return (double) now.QuadPart / (double) frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1000000000.0;
+#else
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	return now.tv_sec + now.tv_usec / 1000000.0;
+#endif
+}
+
+static int
+ping_compare (const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static const char *
+ping_command (dc_family_t family)
+{
+	switch (family) {
+	case DC_FAMILY_HW_OSTC3:
+	case DC_FAMILY_HW_FROG:
+	case DC_FAMILY_SUUNTO_D9:
+	case DC_FAMILY_SUUNTO_VYPER2:
+	case DC_FAMILY_ATOMICS_COBALT:
+		return "version";
+	case DC_FAMILY_OCEANIC_ATOM2:
+	case DC_FAMILY_OCEANIC_VEO250:
+	case DC_FAMILY_OCEANIC_VTPRO:
+		return "keepalive";
+	default:
+		return "read";
+	}
+}
+
+static dc_status_t
+ping_once (dc_device_t *device, dc_family_t family, unsigned int address, unsigned int size)
+{
+	unsigned char data[SZ_BUFFER] = {0};
+
+	// Issue the cheapest command of the backend that round-trips to the
+	// device. Without a dedicated command, a small memory read is used.
+	switch (family) {
+	case DC_FAMILY_HW_OSTC3:
+		return hw_ostc3_device_version (device, data, HW_OSTC3_CUSTOMTEXT_SIZE + 4);
+	case DC_FAMILY_HW_FROG:
+		return hw_frog_device_version (device, data, HW_FROG_CUSTOMTEXT_SIZE + 4);
+	case DC_FAMILY_SUUNTO_D9:
+		return suunto_d9_device_version (device, data, SUUNTO_D9_VERSION_SIZE);
+	case DC_FAMILY_SUUNTO_VYPER2:
+		return suunto_vyper2_device_version (device, data, SUUNTO_VYPER2_VERSION_SIZE);
+	case DC_FAMILY_ATOMICS_COBALT:
+		return atomics_cobalt_device_version (device, data, sizeof (data));
+	case DC_FAMILY_OCEANIC_ATOM2:
+		return oceanic_atom2_device_keepalive (device);
+	case DC_FAMILY_OCEANIC_VEO250:
+		return oceanic_veo250_device_keepalive (device);
+	case DC_FAMILY_OCEANIC_VTPRO:
+		return oceanic_vtpro_device_keepalive (device);
+	default:
+		return dc_device_read (device, address, data, size);
+	}
+}
+
+static void
+ping_report (const ping_stats_t *stats)
+{
+	message ("Sent %u, received %u, failed %u.\n",
+		stats->count, stats->nsamples, stats->errors);
+
+	if (stats->nsamples == 0)
+		return;
+
+	// The jitter is the mean difference between consecutive round-trips,
+	// in the order they were measured.
+	double sum = 0.0, jitter = 0.0;
+	for (unsigned int i = 0; i < stats->nsamples; ++i) {
+		sum += stats->samples[i];
+		if (i) {
+			double delta = stats->samples[i] - stats->samples[i - 1];
+			jitter += delta < 0.0 ? -delta : delta;
+		}
+	}
+	if (stats->nsamples > 1)
+		jitter /= stats->nsamples - 1;
+
+	qsort (stats->samples, stats->nsamples, sizeof (double), ping_compare);
+
+	unsigned int n = stats->nsamples;
+	message ("Round-trip (ms): min %.3f, avg %.3f, max %.3f, jitter %.3f\n",
+		stats->samples[0], sum / n, stats->samples[n - 1], jitter);
+	message ("Percentiles (ms): p50 %.3f, p90 %.3f, p99 %.3f\n",
+		stats->samples[(n - 1) * 50 / 100],
+		stats->samples[(n - 1) * 90 / 100],
+		stats->samples[(n - 1) * 99 / 100]);
+
+	message ("Histogram:\n");
+	for (unsigned int i = 0; i < NBINS; ++i) {
+		if (stats->histogram[i] == 0)
+			continue;
+
+		char label[32];
+		if (i == NBINS - 1) {
+			snprintf (label, sizeof (label), ">= %u ms", 1u << (i - 1));
+		} else {
+			snprintf (label, sizeof (label), "<  %u ms", 1u << i);
+		}
+
+		unsigned int width = stats->histogram[i] * 40 / n;
+		char bar[41];
+		memset (bar, '#', width);
+		bar[width] = 0;
+
+		message ("   %-10s %6u %s\n", label, stats->histogram[i], bar);
+	}
+}
+
+static dc_status_t
+do_ping (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, const char *devname, unsigned int count, unsigned int interval, unsigned int address, unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_iostream_t *iostream = NULL;
+	dc_device_t *device = NULL;
+	ping_stats_t stats = {0};
+	dc_family_t family = dc_descriptor_get_type (descriptor);
+
+	stats.samples = (double *) malloc (count * sizeof (double));
+	if (stats.samples == NULL) {
+		ERROR ("Error allocating memory.");
+		rc = DC_STATUS_NOMEMORY;
+		goto cleanup;
+	}
+
+	// Open the I/O stream.
+	message ("Opening the I/O stream (%s, %s).\n",
+		dctool_transport_name (transport),
+		devname ? devname : "null");
+	rc = dctool_iostream_open (&iostream, context, descriptor, transport, devname);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the I/O stream.");
+		goto cleanup;
+	}
+
+	// Open the device.
+	message ("Opening the device (%s %s).\n",
+		dc_descriptor_get_vendor (descriptor),
+		dc_descriptor_get_product (descriptor));
+	rc = dc_device_open (&device, context, descriptor, iostream);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the device.");
+		goto cleanup;
+	}
+
+	// Register the cancellation handler.
+	message ("Registering the cancellation handler.\n");
+	rc = dc_device_set_cancel (device, dctool_cancel_cb, NULL);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error registering the cancellation handler.");
+		goto cleanup;
+	}
+
+	// Measure the round-trips.
+	message ("Pinging the device (%s command).\n", ping_command (family));
+	for (unsigned int i = 0; i < count; ++i) {
+		if (dctool_cancel_cb (NULL)) {
+			rc = DC_STATUS_CANCELLED;
+			break;
+		}
+
+		if (i && interval) {
+			dc_iostream_sleep (iostream, interval);
+		}
+
+		double begin = ping_now ();
+		rc = ping_once (device, family, address, size);
+		double elapsed = (ping_now () - begin) * 1000.0;
+
+		stats.count++;
+
+		if (rc == DC_STATUS_TIMEOUT || rc == DC_STATUS_PROTOCOL) {
+			// A lost or corrupted answer is counted and the next round-trip
+			// is attempted, as with a regular ping.
+			message ("Ping %u: %s\n", i + 1, dctool_errmsg (rc));
+			stats.errors++;
+			continue;
+		} else if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error sending the command.");
+			stats.errors++;
+			break;
+		}
+
+		unsigned int bin = 0;
+		while (bin < NBINS - 1 && elapsed >= (double) (1u << bin))
+			bin++;
+
+		stats.samples[stats.nsamples++] = elapsed;
+		stats.histogram[bin]++;
+
+		message ("Ping %u: %.3f ms\n", i + 1, elapsed);
+	}
+
+	ping_report (&stats);
+
+	// A ping is successful as long as one round-trip completed.
+	if (rc == DC_STATUS_TIMEOUT || rc == DC_STATUS_PROTOCOL)
+		rc = stats.nsamples ? DC_STATUS_SUCCESS : rc;
+
+cleanup:
+	dc_device_close (device);
+	dc_iostream_close (iostream);
+	free (stats.samples);
+	return rc;
+}
+
+static int
+dctool_ping_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_transport_t transport = dctool_transport_default (descriptor);
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int count = 20;
+	unsigned int interval = 100;
+	unsigned int address = 0;
+	unsigned int size = SZ_READ;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ht:n:i:a:c:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"transport",   required_argument, 0, 't'},
+		{"number",      required_argument, 0, 'n'},
+		{"interval",    required_argument, 0, 'i'},
+		{"address",     required_argument, 0, 'a'},
+		{"count",       required_argument, 0, 'c'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 't':
+			transport = dctool_transport_type (optarg);
+			break;
+		case 'n':
+			count = strtoul (optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul (optarg, NULL, 0);
+			break;
+		case 'a':
+			address = strtoul (optarg, NULL, 0);
+			break;
+		case 'c':
+			size = strtoul (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_ping);
+		return EXIT_SUCCESS;
+	}
+
+	// Check the transport type.
+	if (transport == DC_TRANSPORT_NONE) {
+		message ("No valid transport type specified.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Check the number of pings.
+	if (count == 0) {
+		message ("No valid number of pings specified.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Check the read size.
+	if (size == 0 || size > SZ_BUFFER) {
+		message ("No valid number of bytes specified.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Ping the device.
+	status = do_ping (context, descriptor, transport, argv[0], count, interval, address, size);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+cleanup:
+	return exitcode;
+}
+
+const dctool_command_t dctool_ping = {
+	dctool_ping_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"ping",
+	"Measure the round-trip latency",
+	"Usage:\n"
+	"   dctool ping [options] <devname>\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -t, --transport <name>     Transport type\n"
+	"   -n, --number <count>       Number of pings\n"
+	"   -i, --interval <ms>        Delay between the pings\n"
+	"   -a, --address <address>    Memory address of the read\n"
+	"   -c, --count <count>        Number of bytes of the read\n"
+#else
+	"   -h              Show help message\n"
+	"   -t <transport>  Transport type\n"
+	"   -n <count>      Number of pings\n"
+	"   -i <ms>         Delay between the pings\n"
+	"   -a <address>    Memory address of the read\n"
+	"   -c <count>      Number of bytes of the read\n"
+#endif
+	"\n"
+	"The backends with a version or keepalive command send that command,\n"
+	"the others a small memory read.\n"
+};
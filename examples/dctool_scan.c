@@ -29,6 +29,9 @@
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
@@ -43,8 +46,85 @@
 #include "common.h"
 #include "utils.h"
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+static const dc_transport_t g_transports[] = {
+	DC_TRANSPORT_SERIAL,
+	DC_TRANSPORT_USB,
+	DC_TRANSPORT_USBHID,
+	DC_TRANSPORT_IRDA,
+	DC_TRANSPORT_BLUETOOTH,
+};
+
+/*
+ * The results of the scans are shared between the transports, which are
+ * scanned concurrently (if threads are supported). Every device is
+ * printed as soon as it's found.
+ */
+typedef struct scan_state_t {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+#endif
+	unsigned int prefix;
+	unsigned int first;
+	unsigned int found;
+	unsigned int running;
+} scan_state_t;
+
+typedef struct scan_job_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	dc_transport_t transport;
+	scan_state_t *state;
+	dc_status_t status;
+} scan_job_t;
+
+static void
+scan_lock (scan_state_t *state)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock (&state->mutex);
+#endif
+}
+
+static void
+scan_unlock (scan_state_t *state)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_cond_broadcast (&state->cond);
+	pthread_mutex_unlock (&state->mutex);
+#endif
+}
+
+static unsigned int
+scan_done (scan_state_t *state)
+{
+	return state->first && state->found;
+}
+
+static unsigned int
+scan_report (scan_state_t *state, dc_transport_t transport, const char *line)
+{
+	scan_lock (state);
+
+	if (!scan_done (state)) {
+		if (state->prefix)
+			printf ("%s\t", dctool_transport_name (transport));
+		printf ("%s\n", line);
+		fflush (stdout);
+		state->found++;
+	}
+
+	unsigned int done = scan_done (state);
+
+	scan_unlock (state);
+
+	return done;
+}
+
 static dc_status_t
-scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport)
+scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transport, scan_state_t *state)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_iterator_t *iterator = NULL;
@@ -71,38 +151,48 @@ scan (dc_context_t *context, dc_descriptor_t *descriptor, dc_transport_t transpo
 		break;
 	}
 	if (status != DC_STATUS_SUCCESS) {
-		ERROR ("Failed to create the device iterator.");
+		// Transports which are not built in are silently skipped when
+		// scanning all of them.
+		if (status != DC_STATUS_UNSUPPORTED || !state->prefix)
+			ERROR ("Failed to create the device iterator.");
 		goto cleanup;
 	}
 
 	// Enumerate the devices.
 	void *device = NULL;
 	while ((status = dc_iterator_next (iterator, &device)) == DC_STATUS_SUCCESS) {
+		char line[256];
 		char buffer[DC_BLUETOOTH_SIZE];
 		switch (transport) {
 		case DC_TRANSPORT_SERIAL:
-			printf ("%s\n", dc_serial_device_get_name (device));
+			snprintf (line, sizeof (line), "%s", dc_serial_device_get_name (device));
 			dc_serial_device_free (device);
 			break;
 		case DC_TRANSPORT_IRDA:
-			printf ("%08x\t%s\n", dc_irda_device_get_address (device), dc_irda_device_get_name (device));
+			snprintf (line, sizeof (line), "%08x\t%s", dc_irda_device_get_address (device), dc_irda_device_get_name (device));
 			dc_irda_device_free (device);
 			break;
 		case DC_TRANSPORT_BLUETOOTH:
-			printf ("%s\t%s\n",
+			snprintf (line, sizeof (line), "%s\t%s",
 				dc_bluetooth_addr2str(dc_bluetooth_device_get_address (device), buffer, sizeof(buffer)),
 				dc_bluetooth_device_get_name (device));
 			dc_bluetooth_device_free (device);
 			break;
 		case DC_TRANSPORT_USB:
-			printf ("%04x:%04x\n", dc_usb_device_get_vid (device), dc_usb_device_get_pid (device));
+			snprintf (line, sizeof (line), "%04x:%04x", dc_usb_device_get_vid (device), dc_usb_device_get_pid (device));
 			dc_usb_device_free (device);
 			break;
 		case DC_TRANSPORT_USBHID:
-			printf ("%04x:%04x\n", dc_usbhid_device_get_vid (device), dc_usbhid_device_get_pid (device));
+			snprintf (line, sizeof (line), "%04x:%04x", dc_usbhid_device_get_vid (device), dc_usbhid_device_get_pid (device));
 			dc_usbhid_device_free (device);
 			break;
 		default:
+			line[0] = '\0';
+			break;
+		}
+
+		if (scan_report (state, transport, line)) {
+			status = DC_STATUS_DONE;
 			break;
 		}
 	}
@@ -118,6 +208,112 @@ cleanup:
 	return status;
 }
 
+#ifdef HAVE_PTHREAD_H
+static void *
+scan_thread (void *userdata)
+{
+	scan_job_t *job = (scan_job_t *) userdata;
+
+	job->status = scan (job->context, job->descriptor, job->transport, job->state);
+
+	scan_lock (job->state);
+	job->state->running--;
+	scan_unlock (job->state);
+
+	return NULL;
+}
+#endif
+
+static dc_status_t
+scan_all (dc_context_t *context, dc_descriptor_t *descriptor, scan_state_t *state)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	scan_job_t jobs[C_ARRAY_SIZE (g_transports)];
+	unsigned int njobs = 0;
+
+	// Only scan the transports supported by both the library and the
+	// dive computer (if any).
+	unsigned int transports = dc_context_get_transports (context);
+	if (descriptor)
+		transports &= dc_descriptor_get_transports (descriptor);
+
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (g_transports); ++i) {
+		if ((transports & g_transports[i]) == 0)
+			continue;
+
+		jobs[njobs].context = context;
+		jobs[njobs].descriptor = descriptor;
+		jobs[njobs].transport = g_transports[i];
+		jobs[njobs].state = state;
+		jobs[njobs].status = DC_STATUS_SUCCESS;
+		njobs++;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init (&state->mutex, NULL);
+	pthread_cond_init (&state->cond, NULL);
+
+	// Start a thread for every transport. Scanning some transports, like
+	// a bluetooth inquiry, takes several seconds.
+	pthread_t threads[C_ARRAY_SIZE (g_transports)];
+	unsigned int started[C_ARRAY_SIZE (g_transports)] = {0};
+	for (unsigned int i = 0; i < njobs; ++i) {
+		scan_lock (state);
+		state->running++;
+		scan_unlock (state);
+
+		if (pthread_create (&threads[i], NULL, scan_thread, &jobs[i]) == 0) {
+			started[i] = 1;
+		} else {
+			scan_lock (state);
+			state->running--;
+			scan_unlock (state);
+
+			jobs[i].status = scan (context, descriptor, jobs[i].transport, state);
+		}
+	}
+
+	// Wait until all scans are finished, or the first device is found.
+	pthread_mutex_lock (&state->mutex);
+	while (state->running && !scan_done (state))
+		pthread_cond_wait (&state->cond, &state->mutex);
+	unsigned int running = state->running;
+	pthread_mutex_unlock (&state->mutex);
+
+	// The remaining scans may be blocked in the operating system, for
+	// example during a bluetooth inquiry, and can't be interrupted.
+	// Instead of waiting for them, terminate the process immediately.
+	if (running) {
+		fflush (stdout);
+		exit (EXIT_SUCCESS);
+	}
+
+	for (unsigned int i = 0; i < njobs; ++i) {
+		if (started[i])
+			pthread_join (threads[i], NULL);
+	}
+
+	pthread_cond_destroy (&state->cond);
+	pthread_mutex_destroy (&state->mutex);
+#else
+	for (unsigned int i = 0; i < njobs && !scan_done (state); ++i) {
+		jobs[i].status = scan (context, descriptor, jobs[i].transport, state);
+	}
+#endif
+
+	// Report the first error, but only if no device was found at all.
+	for (unsigned int i = 0; i < njobs; ++i) {
+		if (jobs[i].status != DC_STATUS_SUCCESS &&
+			jobs[i].status != DC_STATUS_UNSUPPORTED &&
+			state->found == 0) {
+			status = jobs[i].status;
+			break;
+		}
+	}
+
+	return status;
+}
+
 static int
 dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
 {
@@ -126,15 +322,19 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 
 	// Default option values.
 	unsigned int help = 0;
+	unsigned int all = 0;
+	unsigned int first = 0;
 	dc_transport_t transport = dctool_transport_default (descriptor);
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ht:";
+	const char *optstring = "ht:a1";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"transport",   required_argument, 0, 't'},
+		{"all",         no_argument,       0, 'a'},
+		{"first",       no_argument,       0, '1'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -148,6 +348,12 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 't':
 			transport = dctool_transport_type (optarg);
 			break;
+		case 'a':
+			all = 1;
+			break;
+		case '1':
+			first = 1;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -158,19 +364,40 @@ dctool_scan_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 
 	// Show help message.
 	if (help) {
-		dctool_command_showhelp (&dctool_list);
+		dctool_command_showhelp (&dctool_scan);
 		return EXIT_SUCCESS;
 	}
 
-	// Check the transport type.
-	if (transport == DC_TRANSPORT_NONE) {
-		message ("No valid transport type specified.\n");
-		exitcode = EXIT_FAILURE;
-		goto cleanup;
-	}
+	scan_state_t state;
+	state.prefix = all;
+	state.first = first;
+	state.found = 0;
+	state.running = 0;
+
+	if (all) {
+		// Scan all transports.
+		status = scan_all (context, descriptor, &state);
+	} else {
+		// Check the transport type.
+		if (transport == DC_TRANSPORT_NONE) {
+			message ("No valid transport type specified.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_init (&state.mutex, NULL);
+		pthread_cond_init (&state.cond, NULL);
+#endif
+
+		// Scan for supported devices.
+		status = scan (context, descriptor, transport, &state);
 
-	// Scan for supported devices.
-	status = scan (context, descriptor, transport);
+#ifdef HAVE_PTHREAD_H
+		pthread_cond_destroy (&state.cond);
+		pthread_mutex_destroy (&state.mutex);
+#endif
+	}
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -193,8 +420,15 @@ const dctool_command_t dctool_scan = {
 #ifdef HAVE_GETOPT_LONG
 	"   -h, --help               Show help message\n"
 	"   -t, --transport <name>   Transport type\n"
+	"   -a, --all                Scan all transports concurrently\n"
+	"   -1, --first              Stop after the first device\n"
 #else
 	"   -h               Show help message\n"
 	"   -t <transport>   Transport type\n"
+	"   -a               Scan all transports concurrently\n"
+	"   -1               Stop after the first device\n"
 #endif
+	"\n"
+	"When scanning all transports, every device is prefixed with the name\n"
+	"of its transport.\n"
 };
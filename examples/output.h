@@ -40,7 +40,13 @@ dctool_output_t *
 dctool_xml_output_new (const char *filename, dctool_units_t units);
 
 dctool_output_t *
-dctool_raw_output_new (const char *template);
+dctool_ndjson_output_new (const char *filename, dctool_units_t units);
+
+dctool_output_t *
+dctool_raw_output_new (const char *template, unsigned int compress);
+
+dctool_output_t *
+dctool_binary_output_new (const char *filename);
 
 dc_status_t
 dctool_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
@@ -0,0 +1,478 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <libdivecomputer/buffer.h>
+
+#include "output-private.h"
+#include "writer.h"
+#include "utils.h"
+
+/*
+ * The file format is described in contrib/dcbin/dcbin.h, along with a
+ * small reader.
+ */
+
+#define FIELD_AVGDEPTH    (1 << 0)
+#define FIELD_TEMP_SURF   (1 << 1)
+#define FIELD_TEMP_MIN    (1 << 2)
+#define FIELD_TEMP_MAX    (1 << 3)
+#define FIELD_DIVEMODE    (1 << 4)
+#define FIELD_SALINITY    (1 << 5)
+#define FIELD_ATMOSPHERIC (1 << 6)
+
+#define CHUNKSIZE 256
+
+static dc_status_t dctool_binary_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_binary_output_free (dctool_output_t *output);
+
+typedef struct entry_t {
+	unsigned int row;
+	unsigned int tank;
+	int value;
+} entry_t;
+
+typedef struct column_t {
+	entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+} column_t;
+
+typedef struct event_t {
+	unsigned int row;
+	dc_sample_value_t value;
+} event_t;
+
+typedef struct dctool_binary_output_t {
+	dctool_output_t base;
+	dctool_writer_t *ostream;
+	dc_buffer_t *record;
+	// Sample columns, reused for every dive.
+	unsigned int *time;
+	unsigned int nrows;
+	unsigned int capacity;
+	column_t depth;
+	column_t temperature;
+	column_t pressure;
+	column_t gasmix;
+	event_t *events;
+	unsigned int nevents;
+	unsigned int maxevents;
+	dc_sample_record_t chunk[CHUNKSIZE];
+	int failed;
+} dctool_binary_output_t;
+
+static const dctool_output_vtable_t binary_vtable = {
+	sizeof(dctool_binary_output_t), /* size */
+	dctool_binary_output_write, /* write */
+	dctool_binary_output_free, /* free */
+};
+
+static int
+grow (void **array, unsigned int *capacity, unsigned int count, size_t size)
+{
+	if (count < *capacity)
+		return 0;
+
+	unsigned int n = *capacity ? *capacity * 2 : 256;
+	void *tmp = realloc (*array, n * size);
+	if (tmp == NULL)
+		return -1;
+
+	*array = tmp;
+	*capacity = n;
+
+	return 0;
+}
+
+static int
+to_fixed (double value, double scale)
+{
+	double x = value * scale;
+
+	return x < 0 ? -(int) (0.5 - x) : (int) (x + 0.5);
+}
+
+static void
+put_uint (dc_buffer_t *buffer, unsigned int value)
+{
+	unsigned char data[5];
+	unsigned int n = 0;
+
+	while (value >= 0x80) {
+		data[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+
+	dc_buffer_append (buffer, data, n);
+}
+
+static void
+put_int (dc_buffer_t *buffer, int value)
+{
+	put_uint (buffer, ((unsigned int) value << 1) ^ (unsigned int) (value >> 31));
+}
+
+static void
+put_column (dc_buffer_t *buffer, const column_t *column, int tank)
+{
+	unsigned int row = 0;
+	int value = 0;
+
+	put_uint (buffer, column->count);
+	for (unsigned int i = 0; i < column->count; ++i) {
+		const entry_t *entry = column->entries + i;
+		put_uint (buffer, entry->row - row);
+		if (tank)
+			put_uint (buffer, entry->tank);
+		put_int (buffer, (int) ((unsigned int) entry->value - (unsigned int) value));
+		row = entry->row;
+		value = entry->value;
+	}
+}
+
+static void
+add_entry (dctool_binary_output_t *output, column_t *column, unsigned int tank, int value)
+{
+	if (grow ((void **) &column->entries, &column->capacity, column->count, sizeof (entry_t)) != 0) {
+		output->failed = 1;
+		return;
+	}
+
+	column->entries[column->count].row = output->nrows - 1;
+	column->entries[column->count].tank = tank;
+	column->entries[column->count].value = value;
+	column->count++;
+}
+
+static void
+add_row (dctool_binary_output_t *output, unsigned int time)
+{
+	if (grow ((void **) &output->time, &output->capacity, output->nrows, sizeof (unsigned int)) != 0) {
+		output->failed = 1;
+		return;
+	}
+
+	output->time[output->nrows++] = time;
+}
+
+static void
+add_sample (dctool_binary_output_t *output, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	if (type == DC_SAMPLE_TIME) {
+		add_row (output, value->time);
+		return;
+	}
+
+	// Samples before the first time sample belong to an implicit row.
+	if (output->nrows == 0)
+		add_row (output, 0);
+	if (output->failed)
+		return;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		add_entry (output, &output->depth, 0, to_fixed (value->depth, 1000.0));
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		add_entry (output, &output->temperature, 0, to_fixed (value->temperature, 100.0));
+		break;
+	case DC_SAMPLE_PRESSURE:
+		add_entry (output, &output->pressure, value->pressure.tank, to_fixed (value->pressure.value, 1000.0));
+		break;
+	case DC_SAMPLE_GASMIX:
+		add_entry (output, &output->gasmix, 0, value->gasmix);
+		break;
+	case DC_SAMPLE_EVENT:
+		if (grow ((void **) &output->events, &output->maxevents, output->nevents, sizeof (event_t)) != 0) {
+			output->failed = 1;
+			break;
+		}
+		output->events[output->nevents].row = output->nrows - 1;
+		output->events[output->nevents].value = *value;
+		output->nevents++;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+chunk_cb (const dc_sample_record_t records[], unsigned int count, void *userdata)
+{
+	dctool_binary_output_t *output = (dctool_binary_output_t *) userdata;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		add_sample (output, records[i].type, &records[i].value);
+	}
+}
+
+dctool_output_t *
+dctool_binary_output_new (const char *filename)
+{
+	static const unsigned char magic[] = {'D', 'C', 'B', 0x01};
+	dctool_binary_output_t *output = NULL;
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_binary_output_t *) dctool_output_allocate (&binary_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	memset ((unsigned char *) output + sizeof (dctool_output_t), 0, sizeof (*output) - sizeof (dctool_output_t));
+
+	output->record = dc_buffer_new (4096);
+	if (output->record == NULL) {
+		goto error_free;
+	}
+
+	// Open the output file.
+	output->ostream = dctool_writer_new (filename);
+	if (output->ostream == NULL) {
+		goto error_buffer;
+	}
+
+	dctool_writer_write (output->ostream, magic, sizeof (magic));
+
+	return (dctool_output_t *) output;
+
+error_buffer:
+	dc_buffer_free (output->record);
+error_free:
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dc_status_t
+dctool_binary_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_binary_output_t *output = (dctool_binary_output_t *) abstract;
+	dc_buffer_t *record = output->record;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	dc_buffer_clear (record);
+
+	put_uint (record, abstract->number);
+	put_uint (record, size);
+	put_uint (record, fingerprint ? fsize : 0);
+	if (fingerprint)
+		dc_buffer_append (record, fingerprint, fsize);
+
+	// Parse the datetime.
+	dc_datetime_t dt = {0};
+	status = dc_parser_get_datetime (parser, &dt);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the datetime.");
+		return status;
+	}
+
+	put_uint (record, dt.year);
+	put_uint (record, dt.month);
+	put_uint (record, dt.day);
+	put_uint (record, dt.hour);
+	put_uint (record, dt.minute);
+	put_uint (record, dt.second);
+	put_uint (record, dt.timezone != DC_TIMEZONE_NONE);
+	if (dt.timezone != DC_TIMEZONE_NONE)
+		put_int (record, dt.timezone);
+
+	// Parse the summary fields.
+	unsigned int divetime = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the divetime.");
+		return status;
+	}
+
+	double maxdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the maxdepth.");
+		return status;
+	}
+
+	put_uint (record, divetime);
+	put_int (record, to_fixed (maxdepth, 1000.0));
+
+	unsigned int fields = 0;
+	double avgdepth = 0.0, temperature[3] = {0.0, 0.0, 0.0}, atmospheric = 0.0;
+	dc_divemode_t divemode = DC_DIVEMODE_OC;
+	dc_salinity_t salinity = {DC_WATER_FRESH, 0.0};
+	const dc_field_type_t types[] = {
+		DC_FIELD_AVGDEPTH,
+		DC_FIELD_TEMPERATURE_SURFACE, DC_FIELD_TEMPERATURE_MINIMUM, DC_FIELD_TEMPERATURE_MAXIMUM,
+		DC_FIELD_DIVEMODE, DC_FIELD_SALINITY, DC_FIELD_ATMOSPHERIC};
+	void *values[] = {
+		&avgdepth,
+		temperature + 0, temperature + 1, temperature + 2,
+		&divemode, &salinity, &atmospheric};
+	for (unsigned int i = 0; i < sizeof (types) / sizeof (types[0]); ++i) {
+		status = dc_parser_get_field (parser, types[i], 0, values[i]);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the dive fields.");
+			return status;
+		}
+		if (status == DC_STATUS_SUCCESS)
+			fields |= (1 << i);
+	}
+
+	put_uint (record, fields);
+	if (fields & FIELD_AVGDEPTH)
+		put_int (record, to_fixed (avgdepth, 1000.0));
+	for (unsigned int i = 0; i < 3; ++i) {
+		if (fields & (FIELD_TEMP_SURF << i))
+			put_int (record, to_fixed (temperature[i], 100.0));
+	}
+	if (fields & FIELD_DIVEMODE)
+		put_uint (record, divemode);
+	if (fields & FIELD_SALINITY) {
+		put_uint (record, salinity.type);
+		put_uint (record, to_fixed (salinity.density, 10.0));
+	}
+	if (fields & FIELD_ATMOSPHERIC)
+		put_uint (record, to_fixed (atmospheric, 100000.0));
+
+	// Parse the gas mixes.
+	unsigned int ngases = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the gas mix count.");
+		return status;
+	}
+
+	put_uint (record, ngases);
+	for (unsigned int i = 0; i < ngases; ++i) {
+		dc_gasmix_t gasmix = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the gas mix.");
+			return status;
+		}
+
+		put_uint (record, to_fixed (gasmix.oxygen, 1000.0));
+		put_uint (record, to_fixed (gasmix.helium, 1000.0));
+	}
+
+	// Parse the tanks.
+	unsigned int ntanks = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the tank count.");
+		return status;
+	}
+
+	put_uint (record, ntanks);
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		dc_tank_t tank = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the tank.");
+			return status;
+		}
+
+		put_uint (record, tank.gasmix == DC_GASMIX_UNKNOWN ? 0 : tank.gasmix + 1);
+		put_uint (record, tank.type);
+		put_uint (record, to_fixed (tank.volume, 1000.0));
+		put_uint (record, to_fixed (tank.workpressure, 1000.0));
+		put_uint (record, to_fixed (tank.beginpressure, 1000.0));
+		put_uint (record, to_fixed (tank.endpressure, 1000.0));
+	}
+
+	// Parse the sample data.
+	output->nrows = 0;
+	output->depth.count = 0;
+	output->temperature.count = 0;
+	output->pressure.count = 0;
+	output->gasmix.count = 0;
+	output->nevents = 0;
+	output->failed = 0;
+	status = dc_parser_samples_foreach_chunk (parser, output->chunk, CHUNKSIZE, chunk_cb, output);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the sample data.");
+		return status;
+	}
+	if (output->failed) {
+		ERROR ("Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	put_uint (record, output->nrows);
+	for (unsigned int i = 0; i < output->nrows; ++i) {
+		put_uint (record, output->time[i] - (i ? output->time[i - 1] : 0));
+	}
+
+	put_column (record, &output->depth, 0);
+	put_column (record, &output->temperature, 0);
+	put_column (record, &output->pressure, 1);
+	put_column (record, &output->gasmix, 0);
+
+	put_uint (record, output->nevents);
+	for (unsigned int i = 0; i < output->nevents; ++i) {
+		const event_t *event = output->events + i;
+		put_uint (record, event->row);
+		put_uint (record, event->value.event.type);
+		put_uint (record, event->value.event.time);
+		put_uint (record, event->value.event.flags);
+		put_uint (record, event->value.event.value);
+	}
+
+	// Write the record, prefixed with its size.
+	unsigned char prefix[5];
+	unsigned int n = 0, length = dc_buffer_get_size (record);
+	while (length >= 0x80) {
+		prefix[n++] = (length & 0x7F) | 0x80;
+		length >>= 7;
+	}
+	prefix[n++] = length;
+
+	dctool_writer_write (output->ostream, prefix, n);
+	dctool_writer_write (output->ostream, dc_buffer_get_data (record), dc_buffer_get_size (record));
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_binary_output_free (dctool_output_t *abstract)
+{
+	dctool_binary_output_t *output = (dctool_binary_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (dctool_writer_free (output->ostream) != 0)
+		status = DC_STATUS_IO;
+
+	dc_buffer_free (output->record);
+	free (output->time);
+	free (output->depth.entries);
+	free (output->temperature.entries);
+	free (output->pressure.entries);
+	free (output->gasmix.entries);
+	free (output->events);
+
+	return status;
+}
@@ -0,0 +1,683 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <libdivecomputer/units.h>
+
+#include "output-private.h"
+#include "writer.h"
+#include "utils.h"
+
+/*
+ * Every dive is written as a single JSON object on its own line. The
+ * time, depth and temperature samples are stored as one array per
+ * sample time ("samples"), with null for a missing value. All other
+ * sample types are sparse, and stored as a separate list of arrays,
+ * starting with the time of the sample. The vendor samples are not
+ * exported.
+ */
+
+#define CHUNKSIZE 256
+
+#define HAS_DEPTH       (1 << 0)
+#define HAS_TEMPERATURE (1 << 1)
+
+static dc_status_t dctool_ndjson_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_ndjson_output_free (dctool_output_t *output);
+
+typedef struct row_t {
+	unsigned int time;
+	unsigned int flags;
+	double depth;
+	double temperature;
+} row_t;
+
+typedef struct entry_t {
+	unsigned int time;
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} entry_t;
+
+typedef struct dctool_ndjson_output_t {
+	dctool_output_t base;
+	dctool_writer_t *ostream;
+	dctool_units_t units;
+	// Sample data, reused for every dive.
+	row_t *rows;
+	unsigned int nrows;
+	unsigned int maxrows;
+	entry_t *entries;
+	unsigned int nentries;
+	unsigned int maxentries;
+	dc_sample_record_t chunk[CHUNKSIZE];
+	int failed;
+} dctool_ndjson_output_t;
+
+static const dctool_output_vtable_t ndjson_vtable = {
+	sizeof(dctool_ndjson_output_t), /* size */
+	dctool_ndjson_output_write, /* write */
+	dctool_ndjson_output_free, /* free */
+};
+
+static double
+convert_depth (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value / FEET;
+	} else {
+		return value;
+	}
+}
+
+static double
+convert_temperature (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value * (9.0 / 5.0) + 32.0;
+	} else {
+		return value;
+	}
+}
+
+static double
+convert_pressure (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value * BAR / PSI;
+	} else {
+		return value;
+	}
+}
+
+static double
+convert_volume (double value, dctool_units_t units)
+{
+	if (units == DCTOOL_UNITS_IMPERIAL) {
+		return value / 1000.0 / CUFT;
+	} else {
+		return value;
+	}
+}
+
+static int
+grow (void **array, unsigned int *capacity, unsigned int count, size_t size)
+{
+	if (count < *capacity)
+		return 0;
+
+	unsigned int n = *capacity ? *capacity * 2 : 256;
+	void *tmp = realloc (*array, n * size);
+	if (tmp == NULL)
+		return -1;
+
+	*array = tmp;
+	*capacity = n;
+
+	return 0;
+}
+
+static void
+json_uint (dctool_writer_t *ostream, const char *prefix, unsigned int value)
+{
+	if (prefix)
+		dctool_writer_puts (ostream, prefix);
+	dctool_writer_uint (ostream, value, 0);
+}
+
+static void
+json_double (dctool_writer_t *ostream, const char *prefix, double value, unsigned int decimals)
+{
+	if (prefix)
+		dctool_writer_puts (ostream, prefix);
+
+	// JSON has no representation for infinity and NaN.
+	if (isfinite (value))
+		dctool_writer_double (ostream, value, decimals);
+	else
+		dctool_writer_puts (ostream, "null");
+}
+
+static void
+json_string (dctool_writer_t *ostream, const char *str)
+{
+	static const char ascii[] = "0123456789abcdef";
+	const char *p = str, *begin = str;
+
+	dctool_writer_puts (ostream, "\"");
+	while (*p) {
+		unsigned char c = *p;
+		if (c >= 0x20 && c != '"' && c != '\\') {
+			p++;
+			continue;
+		}
+
+		dctool_writer_write (ostream, begin, p - begin);
+		if (c == '"') {
+			dctool_writer_puts (ostream, "\\\"");
+		} else if (c == '\\') {
+			dctool_writer_puts (ostream, "\\\\");
+		} else if (c == '\n') {
+			dctool_writer_puts (ostream, "\\n");
+		} else if (c == '\r') {
+			dctool_writer_puts (ostream, "\\r");
+		} else if (c == '\t') {
+			dctool_writer_puts (ostream, "\\t");
+		} else {
+			char buffer[6] = {'\\', 'u', '0', '0', ascii[c >> 4], ascii[c & 0x0F]};
+			dctool_writer_write (ostream, buffer, sizeof (buffer));
+		}
+		begin = ++p;
+	}
+	dctool_writer_write (ostream, begin, p - begin);
+	dctool_writer_puts (ostream, "\"");
+}
+
+static void
+add_row (dctool_ndjson_output_t *output, unsigned int time)
+{
+	if (grow ((void **) &output->rows, &output->maxrows, output->nrows, sizeof (row_t)) != 0) {
+		output->failed = 1;
+		return;
+	}
+
+	output->rows[output->nrows].time = time;
+	output->rows[output->nrows].flags = 0;
+	output->nrows++;
+}
+
+static void
+add_sample (dctool_ndjson_output_t *output, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	if (type == DC_SAMPLE_TIME) {
+		add_row (output, value->time);
+		return;
+	}
+
+	// Samples before the first time sample belong to an implicit row.
+	if (output->nrows == 0)
+		add_row (output, 0);
+	if (output->failed)
+		return;
+
+	row_t *row = output->rows + output->nrows - 1;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		row->depth = value->depth;
+		row->flags |= HAS_DEPTH;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		row->temperature = value->temperature;
+		row->flags |= HAS_TEMPERATURE;
+		break;
+	case DC_SAMPLE_VENDOR:
+		break;
+	default:
+		if (grow ((void **) &output->entries, &output->maxentries, output->nentries, sizeof (entry_t)) != 0) {
+			output->failed = 1;
+			break;
+		}
+		output->entries[output->nentries].time = row->time;
+		output->entries[output->nentries].type = type;
+		output->entries[output->nentries].value = *value;
+		output->nentries++;
+		break;
+	}
+}
+
+static void
+chunk_cb (const dc_sample_record_t records[], unsigned int count, void *userdata)
+{
+	dctool_ndjson_output_t *output = (dctool_ndjson_output_t *) userdata;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		add_sample (output, records[i].type, &records[i].value);
+	}
+}
+
+static void
+write_entry (dctool_ndjson_output_t *output, const entry_t *entry)
+{
+	dctool_writer_t *ostream = output->ostream;
+	const dc_sample_value_t *value = &entry->value;
+
+	json_uint (ostream, "[", entry->time);
+
+	switch (entry->type) {
+	case DC_SAMPLE_PRESSURE:
+		json_uint (ostream, ",", value->pressure.tank);
+		json_double (ostream, ",", convert_pressure (value->pressure.value, output->units), 2);
+		break;
+	case DC_SAMPLE_EVENT:
+		json_uint (ostream, ",", value->event.type);
+		json_uint (ostream, ",", value->event.time);
+		json_uint (ostream, ",", value->event.flags);
+		json_uint (ostream, ",", value->event.value);
+		break;
+	case DC_SAMPLE_RBT:
+		json_uint (ostream, ",", value->rbt);
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		json_uint (ostream, ",", value->heartbeat);
+		break;
+	case DC_SAMPLE_BEARING:
+		json_uint (ostream, ",", value->bearing);
+		break;
+	case DC_SAMPLE_SETPOINT:
+		json_double (ostream, ",", value->setpoint, 2);
+		break;
+	case DC_SAMPLE_PPO2:
+		json_double (ostream, ",", value->ppo2, 2);
+		break;
+	case DC_SAMPLE_CNS:
+		json_double (ostream, ",", value->cns * 100.0, 1);
+		break;
+	case DC_SAMPLE_DECO:
+		json_uint (ostream, ",", value->deco.type);
+		json_uint (ostream, ",", value->deco.time);
+		json_double (ostream, ",", convert_depth (value->deco.depth, output->units), 2);
+		break;
+	case DC_SAMPLE_GASMIX:
+		json_uint (ostream, ",", value->gasmix);
+		break;
+	default:
+		break;
+	}
+
+	dctool_writer_puts (ostream, "]");
+}
+
+static void
+write_samples (dctool_ndjson_output_t *output)
+{
+	static const struct {
+		dc_sample_type_t type;
+		const char *name;
+	} series[] = {
+		{DC_SAMPLE_PRESSURE,  "pressure"},
+		{DC_SAMPLE_EVENT,     "events"},
+		{DC_SAMPLE_RBT,       "rbt"},
+		{DC_SAMPLE_HEARTBEAT, "heartbeat"},
+		{DC_SAMPLE_BEARING,   "bearing"},
+		{DC_SAMPLE_SETPOINT,  "setpoint"},
+		{DC_SAMPLE_PPO2,      "ppo2"},
+		{DC_SAMPLE_CNS,       "cns"},
+		{DC_SAMPLE_DECO,      "deco"},
+		{DC_SAMPLE_GASMIX,    "gasmix"},
+	};
+
+	dctool_writer_t *ostream = output->ostream;
+
+	dctool_writer_puts (ostream, ",\"samples\":[");
+	for (unsigned int i = 0; i < output->nrows; ++i) {
+		const row_t *row = output->rows + i;
+		json_uint (ostream, i ? ",[" : "[", row->time);
+		if (row->flags & HAS_DEPTH)
+			json_double (ostream, ",", convert_depth (row->depth, output->units), 2);
+		else
+			dctool_writer_puts (ostream, ",null");
+		if (row->flags & HAS_TEMPERATURE)
+			json_double (ostream, ",", convert_temperature (row->temperature, output->units), 2);
+		else
+			dctool_writer_puts (ostream, ",null");
+		dctool_writer_puts (ostream, "]");
+	}
+	dctool_writer_puts (ostream, "]");
+
+	for (unsigned int i = 0; i < sizeof (series) / sizeof (series[0]); ++i) {
+		unsigned int count = 0;
+		for (unsigned int j = 0; j < output->nentries; ++j) {
+			const entry_t *entry = output->entries + j;
+			if (entry->type != series[i].type)
+				continue;
+
+			if (count++ == 0) {
+				dctool_writer_puts (ostream, ",\"");
+				dctool_writer_puts (ostream, series[i].name);
+				dctool_writer_puts (ostream, "\":[");
+			} else {
+				dctool_writer_puts (ostream, ",");
+			}
+			write_entry (output, entry);
+		}
+		if (count)
+			dctool_writer_puts (ostream, "]");
+	}
+}
+
+dctool_output_t *
+dctool_ndjson_output_new (const char *filename, dctool_units_t units)
+{
+	dctool_ndjson_output_t *output = NULL;
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_ndjson_output_t *) dctool_output_allocate (&ndjson_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	memset ((unsigned char *) output + sizeof (dctool_output_t), 0, sizeof (*output) - sizeof (dctool_output_t));
+
+	// Open the output file.
+	output->ostream = dctool_writer_new (filename);
+	if (output->ostream == NULL) {
+		goto error_free;
+	}
+
+	output->units = units;
+
+	return (dctool_output_t *) output;
+
+error_free:
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dc_status_t
+dctool_ndjson_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_ndjson_output_t *output = (dctool_ndjson_output_t *) abstract;
+	dctool_writer_t *ostream = output->ostream;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Parse the sample data first, such that a failure doesn't leave an
+	// incomplete line behind.
+	message ("Parsing the sample data.\n");
+	output->nrows = 0;
+	output->nentries = 0;
+	output->failed = 0;
+	status = dc_parser_samples_foreach_chunk (parser, output->chunk, CHUNKSIZE, chunk_cb, output);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the sample data.");
+		return status;
+	}
+	if (output->failed) {
+		ERROR ("Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	json_uint (ostream, "{\"number\":", abstract->number);
+	json_uint (ostream, ",\"size\":", size);
+
+	if (fingerprint) {
+		dctool_writer_puts (ostream, ",\"fingerprint\":\"");
+		dctool_writer_hex (ostream, fingerprint, fsize);
+		dctool_writer_puts (ostream, "\"");
+	}
+
+	// Parse the datetime.
+	message ("Parsing the datetime.\n");
+	dc_datetime_t dt = {0};
+	status = dc_parser_get_datetime (parser, &dt);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the datetime.");
+		goto cleanup;
+	}
+
+	dctool_writer_puts (ostream, ",\"datetime\":\"");
+	dctool_writer_int (ostream, dt.year, 4, 0);
+	dctool_writer_puts (ostream, "-");
+	dctool_writer_int (ostream, dt.month, 2, 0);
+	dctool_writer_puts (ostream, "-");
+	dctool_writer_int (ostream, dt.day, 2, 0);
+	dctool_writer_puts (ostream, "T");
+	dctool_writer_int (ostream, dt.hour, 2, 0);
+	dctool_writer_puts (ostream, ":");
+	dctool_writer_int (ostream, dt.minute, 2, 0);
+	dctool_writer_puts (ostream, ":");
+	dctool_writer_int (ostream, dt.second, 2, 0);
+	if (dt.timezone != DC_TIMEZONE_NONE) {
+		int tz = dt.timezone < 0 ? -dt.timezone : dt.timezone;
+		dctool_writer_puts (ostream, dt.timezone < 0 ? "-" : "+");
+		dctool_writer_int (ostream, tz / 3600, 2, 0);
+		dctool_writer_puts (ostream, ":");
+		dctool_writer_int (ostream, (tz % 3600) / 60, 2, 0);
+	}
+	dctool_writer_puts (ostream, "\"");
+
+	// Parse the divetime.
+	message ("Parsing the divetime.\n");
+	unsigned int divetime = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the divetime.");
+		goto cleanup;
+	}
+
+	json_uint (ostream, ",\"divetime\":", divetime);
+
+	// Parse the maxdepth.
+	message ("Parsing the maxdepth.\n");
+	double maxdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the maxdepth.");
+		goto cleanup;
+	}
+
+	json_double (ostream, ",\"maxdepth\":", convert_depth (maxdepth, output->units), 2);
+
+	// Parse the avgdepth.
+	message ("Parsing the avgdepth.\n");
+	double avgdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_AVGDEPTH, 0, &avgdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the avgdepth.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_double (ostream, ",\"avgdepth\":", convert_depth (avgdepth, output->units), 2);
+	}
+
+	// Parse the temperature.
+	message ("Parsing the temperature.\n");
+	const dc_field_type_t temperatures[] = {
+		DC_FIELD_TEMPERATURE_SURFACE,
+		DC_FIELD_TEMPERATURE_MINIMUM,
+		DC_FIELD_TEMPERATURE_MAXIMUM};
+	const char *names[] = {"surface", "minimum", "maximum"};
+	unsigned int ntemperatures = 0;
+	for (unsigned int i = 0; i < 3; ++i) {
+		double temperature = 0.0;
+		status = dc_parser_get_field (parser, temperatures[i], 0, &temperature);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the temperature.");
+			break;
+		}
+
+		if (status != DC_STATUS_UNSUPPORTED) {
+			dctool_writer_puts (ostream, ntemperatures++ ? ",\"" : ",\"temperature\":{\"");
+			dctool_writer_puts (ostream, names[i]);
+			json_double (ostream, "\":", convert_temperature (temperature, output->units), 1);
+		}
+	}
+	if (ntemperatures)
+		dctool_writer_puts (ostream, "}");
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		goto cleanup;
+
+	// Parse the gas mixes.
+	message ("Parsing the gas mixes.\n");
+	unsigned int ngases = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the gas mix count.");
+		goto cleanup;
+	}
+
+	dctool_writer_puts (ostream, ",\"gasmixes\":[");
+	for (unsigned int i = 0; i < ngases; ++i) {
+		dc_gasmix_t gasmix = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the gas mix.");
+			break;
+		}
+
+		json_double (ostream, i ? ",[" : "[", gasmix.helium * 100.0, 1);
+		json_double (ostream, ",", gasmix.oxygen * 100.0, 1);
+		json_double (ostream, ",", gasmix.nitrogen * 100.0, 1);
+		dctool_writer_puts (ostream, "]");
+	}
+	dctool_writer_puts (ostream, "]");
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		goto cleanup;
+
+	// Parse the tanks.
+	message ("Parsing the tanks.\n");
+	unsigned int ntanks = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the tank count.");
+		goto cleanup;
+	}
+
+	// Each tank is stored as [gasmix, type, volume, workpressure,
+	// beginpressure, endpressure], with null for the unknown values.
+	dctool_writer_puts (ostream, ",\"tanks\":[");
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		dc_tank_t tank = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the tank.");
+			break;
+		}
+
+		dctool_writer_puts (ostream, i ? ",[" : "[");
+		if (tank.gasmix != DC_GASMIX_UNKNOWN)
+			json_uint (ostream, NULL, tank.gasmix);
+		else
+			dctool_writer_puts (ostream, "null");
+		json_uint (ostream, ",", tank.type);
+		if (tank.type != DC_TANKVOLUME_NONE) {
+			json_double (ostream, ",", convert_volume (tank.volume, output->units), 1);
+			json_double (ostream, ",", convert_pressure (tank.workpressure, output->units), 2);
+		} else {
+			dctool_writer_puts (ostream, ",null,null");
+		}
+		json_double (ostream, ",", convert_pressure (tank.beginpressure, output->units), 2);
+		json_double (ostream, ",", convert_pressure (tank.endpressure, output->units), 2);
+		dctool_writer_puts (ostream, "]");
+	}
+	dctool_writer_puts (ostream, "]");
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		goto cleanup;
+
+	// Parse the dive mode.
+	message ("Parsing the dive mode.\n");
+	dc_divemode_t divemode = DC_DIVEMODE_OC;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVEMODE, 0, &divemode);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the dive mode.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		const char *modes[] = {"freedive", "gauge", "oc", "ccr", "scr"};
+		dctool_writer_puts (ostream, ",\"divemode\":\"");
+		dctool_writer_puts (ostream, modes[divemode]);
+		dctool_writer_puts (ostream, "\"");
+	}
+
+	// Parse the salinity.
+	message ("Parsing the salinity.\n");
+	dc_salinity_t salinity = {DC_WATER_FRESH, 0.0};
+	status = dc_parser_get_field (parser, DC_FIELD_SALINITY, 0, &salinity);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the salinity.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_uint (ostream, ",\"salinity\":[", salinity.type);
+		json_double (ostream, ",", salinity.density, 1);
+		dctool_writer_puts (ostream, "]");
+	}
+
+	// Parse the atmospheric pressure.
+	message ("Parsing the atmospheric pressure.\n");
+	double atmospheric = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_ATMOSPHERIC, 0, &atmospheric);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the atmospheric pressure.");
+		goto cleanup;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_double (ostream, ",\"atmospheric\":", convert_pressure (atmospheric, output->units), 5);
+	}
+
+	message ("Parsing strings.\n");
+	unsigned int nstrings = 0;
+	for (unsigned int i = 0; i < 100; i++) {
+		dc_field_string_t str = { NULL };
+		status = dc_parser_get_field (parser, DC_FIELD_STRING, i, &str);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing strings");
+			break;
+		}
+		if (status == DC_STATUS_UNSUPPORTED)
+			break;
+		if (!str.desc || !str.value)
+			break;
+		dctool_writer_puts (ostream, nstrings++ ? "," : ",\"strings\":{");
+		json_string (ostream, str.desc);
+		dctool_writer_puts (ostream, ":");
+		json_string (ostream, str.value);
+	}
+	if (nstrings)
+		dctool_writer_puts (ostream, "}");
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		goto cleanup;
+
+	write_samples (output);
+
+	status = DC_STATUS_SUCCESS;
+
+cleanup:
+	dctool_writer_puts (ostream, "}\n");
+
+	return status;
+}
+
+static dc_status_t
+dctool_ndjson_output_free (dctool_output_t *abstract)
+{
+	dctool_ndjson_output_t *output = (dctool_ndjson_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (dctool_writer_free (output->ostream) != 0)
+		status = DC_STATUS_IO;
+
+	free (output->rows);
+	free (output->entries);
+
+	return status;
+}
@@ -23,6 +23,8 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <libdivecomputer/codec.h>
+
 #include "output-private.h"
 #include "utils.h"
 
@@ -32,6 +34,8 @@ static dc_status_t dctool_raw_output_free (dctool_output_t *output);
 typedef struct dctool_raw_output_t {
 	dctool_output_t base;
 	char *template;
+	unsigned int compress;
+	dc_buffer_t *buffer;
 } dctool_raw_output_t;
 
 static const dctool_output_vtable_t raw_vtable = {
@@ -155,7 +159,7 @@ mktemplate (char *buffer, size_t size, const char *format, dc_parser_t *parser,
 }
 
 dctool_output_t *
-dctool_raw_output_new (const char *template)
+dctool_raw_output_new (const char *template, unsigned int compress)
 {
 	dctool_raw_output_t *output = NULL;
 
@@ -173,8 +177,19 @@ dctool_raw_output_new (const char *template)
 		goto error_free;
 	}
 
+	output->compress = compress;
+	output->buffer = NULL;
+	if (compress) {
+		output->buffer = dc_buffer_new (0);
+		if (output->buffer == NULL) {
+			goto error_free_template;
+		}
+	}
+
 	return (dctool_output_t *) output;
 
+error_free_template:
+	free (output->template);
 error_free:
 	dctool_output_deallocate ((dctool_output_t *) output);
 error_exit:
@@ -201,6 +216,19 @@ dctool_raw_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		return DC_STATUS_SUCCESS;
 	}
 
+	// Compress the data.
+	if (output->compress) {
+		dc_buffer_clear (output->buffer);
+		dc_status_t rc = dc_codec_compress (NULL, data, size, output->buffer);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR("Failed to compress the data.");
+			fclose (fp);
+			return DC_STATUS_SUCCESS;
+		}
+		data = dc_buffer_get_data (output->buffer);
+		size = dc_buffer_get_size (output->buffer);
+	}
+
 	// Write the data.
 	fwrite (data, sizeof (unsigned char), size, fp);
 	fclose (fp);
@@ -213,6 +241,7 @@ dctool_raw_output_free (dctool_output_t *abstract)
 {
 	dctool_raw_output_t *output = (dctool_raw_output_t *) abstract;
 
+	dc_buffer_free (output->buffer);
 	free (output->template);
 
 	return DC_STATUS_SUCCESS;
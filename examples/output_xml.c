@@ -26,6 +26,7 @@
 #include <libdivecomputer/units.h>
 
 #include "output-private.h"
+#include "writer.h"
 #include "utils.h"
 
 static dc_status_t dctool_xml_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
@@ -33,7 +34,7 @@ static dc_status_t dctool_xml_output_free (dctool_output_t *output);
 
 typedef struct dctool_xml_output_t {
 	dctool_output_t base;
-	FILE *ostream;
+	dctool_writer_t *ostream;
 	dctool_units_t units;
 } dctool_xml_output_t;
 
@@ -44,7 +45,7 @@ static const dctool_output_vtable_t xml_vtable = {
 };
 
 typedef struct sample_data_t {
-	FILE *ostream;
+	dctool_writer_t *ostream;
 	dctool_units_t units;
 	unsigned int nsamples;
 } sample_data_t;
@@ -89,6 +90,26 @@ convert_volume (double value, dctool_units_t units)
 	}
 }
 
+static void
+xml_uint (dctool_writer_t *ostream, const char *prefix, unsigned int value, const char *suffix)
+{
+	if (prefix)
+		dctool_writer_puts (ostream, prefix);
+	dctool_writer_uint (ostream, value, 0);
+	if (suffix)
+		dctool_writer_puts (ostream, suffix);
+}
+
+static void
+xml_double (dctool_writer_t *ostream, const char *prefix, double value, unsigned int decimals, const char *suffix)
+{
+	if (prefix)
+		dctool_writer_puts (ostream, prefix);
+	dctool_writer_double (ostream, value, decimals);
+	if (suffix)
+		dctool_writer_puts (ostream, suffix);
+}
+
 static void
 sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
 {
@@ -103,65 +124,74 @@ sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
 		"ndl", "safety", "deco", "deep"};
 
 	sample_data_t *sampledata = (sample_data_t *) userdata;
+	dctool_writer_t *ostream = sampledata->ostream;
 
 	switch (type) {
 	case DC_SAMPLE_TIME:
 		if (sampledata->nsamples++)
-			fprintf (sampledata->ostream, "</sample>\n");
-		fprintf (sampledata->ostream, "<sample>\n");
-		fprintf (sampledata->ostream, "   <time>%02u:%02u</time>\n", value.time / 60, value.time % 60);
+			dctool_writer_puts (ostream, "</sample>\n");
+		dctool_writer_puts (ostream, "<sample>\n   <time>");
+		dctool_writer_uint (ostream, value.time / 60, 2);
+		dctool_writer_puts (ostream, ":");
+		dctool_writer_uint (ostream, value.time % 60, 2);
+		dctool_writer_puts (ostream, "</time>\n");
 		break;
 	case DC_SAMPLE_DEPTH:
-		fprintf (sampledata->ostream, "   <depth>%.2f</depth>\n",
-			convert_depth(value.depth, sampledata->units));
+		xml_double (ostream, "   <depth>",
+			convert_depth(value.depth, sampledata->units), 2, "</depth>\n");
 		break;
 	case DC_SAMPLE_PRESSURE:
-		fprintf (sampledata->ostream, "   <pressure tank=\"%u\">%.2f</pressure>\n",
-			value.pressure.tank,
-			convert_pressure(value.pressure.value, sampledata->units));
+		xml_uint (ostream, "   <pressure tank=\"", value.pressure.tank, "\">");
+		xml_double (ostream, NULL,
+			convert_pressure(value.pressure.value, sampledata->units), 2, "</pressure>\n");
 		break;
 	case DC_SAMPLE_TEMPERATURE:
-		fprintf (sampledata->ostream, "   <temperature>%.2f</temperature>\n",
-			convert_temperature(value.temperature, sampledata->units));
+		xml_double (ostream, "   <temperature>",
+			convert_temperature(value.temperature, sampledata->units), 2, "</temperature>\n");
 		break;
 	case DC_SAMPLE_EVENT:
 		if (value.event.type != SAMPLE_EVENT_GASCHANGE && value.event.type != SAMPLE_EVENT_GASCHANGE2) {
-			fprintf (sampledata->ostream, "   <event type=\"%u\" time=\"%u\" flags=\"%u\" value=\"%u\">%s</event>\n",
-				value.event.type, value.event.time, value.event.flags, value.event.value, events[value.event.type]);
+			xml_uint (ostream, "   <event type=\"", value.event.type, "\"");
+			xml_uint (ostream, " time=\"", value.event.time, "\"");
+			xml_uint (ostream, " flags=\"", value.event.flags, "\"");
+			xml_uint (ostream, " value=\"", value.event.value, "\">");
+			dctool_writer_puts (ostream, events[value.event.type]);
+			dctool_writer_puts (ostream, "</event>\n");
 		}
 		break;
 	case DC_SAMPLE_RBT:
-		fprintf (sampledata->ostream, "   <rbt>%u</rbt>\n", value.rbt);
+		xml_uint (ostream, "   <rbt>", value.rbt, "</rbt>\n");
 		break;
 	case DC_SAMPLE_HEARTBEAT:
-		fprintf (sampledata->ostream, "   <heartbeat>%u</heartbeat>\n", value.heartbeat);
+		xml_uint (ostream, "   <heartbeat>", value.heartbeat, "</heartbeat>\n");
 		break;
 	case DC_SAMPLE_BEARING:
-		fprintf (sampledata->ostream, "   <bearing>%u</bearing>\n", value.bearing);
+		xml_uint (ostream, "   <bearing>", value.bearing, "</bearing>\n");
 		break;
 	case DC_SAMPLE_VENDOR:
-		fprintf (sampledata->ostream, "   <vendor type=\"%u\" size=\"%u\">", value.vendor.type, value.vendor.size);
-		for (unsigned int i = 0; i < value.vendor.size; ++i)
-			fprintf (sampledata->ostream, "%02X", ((const unsigned char *) value.vendor.data)[i]);
-		fprintf (sampledata->ostream, "</vendor>\n");
+		xml_uint (ostream, "   <vendor type=\"", value.vendor.type, "\"");
+		xml_uint (ostream, " size=\"", value.vendor.size, "\">");
+		dctool_writer_hex (ostream, (const unsigned char *) value.vendor.data, value.vendor.size);
+		dctool_writer_puts (ostream, "</vendor>\n");
 		break;
 	case DC_SAMPLE_SETPOINT:
-		fprintf (sampledata->ostream, "   <setpoint>%.2f</setpoint>\n", value.setpoint);
+		xml_double (ostream, "   <setpoint>", value.setpoint, 2, "</setpoint>\n");
 		break;
 	case DC_SAMPLE_PPO2:
-		fprintf (sampledata->ostream, "   <ppo2>%.2f</ppo2>\n", value.ppo2);
+		xml_double (ostream, "   <ppo2>", value.ppo2, 2, "</ppo2>\n");
 		break;
 	case DC_SAMPLE_CNS:
-		fprintf (sampledata->ostream, "   <cns>%.1f</cns>\n", value.cns * 100.0);
+		xml_double (ostream, "   <cns>", value.cns * 100.0, 1, "</cns>\n");
 		break;
 	case DC_SAMPLE_DECO:
-		fprintf (sampledata->ostream, "   <deco time=\"%u\" depth=\"%.2f\">%s</deco>\n",
-			value.deco.time,
-			convert_depth(value.deco.depth, sampledata->units),
-			decostop[value.deco.type]);
+		xml_uint (ostream, "   <deco time=\"", value.deco.time, "\"");
+		xml_double (ostream, " depth=\"",
+			convert_depth(value.deco.depth, sampledata->units), 2, "\">");
+		dctool_writer_puts (ostream, decostop[value.deco.type]);
+		dctool_writer_puts (ostream, "</deco>\n");
 		break;
 	case DC_SAMPLE_GASMIX:
-		fprintf (sampledata->ostream, "   <gasmix>%u</gasmix>\n", value.gasmix);
+		xml_uint (ostream, "   <gasmix>", value.gasmix, "</gasmix>\n");
 		break;
 	default:
 		break;
@@ -183,14 +213,14 @@ dctool_xml_output_new (const char *filename, dctool_units_t units)
 	}
 
 	// Open the output file.
-	output->ostream = fopen (filename, "w");
+	output->ostream = dctool_writer_new (filename);
 	if (output->ostream == NULL) {
 		goto error_free;
 	}
 
 	output->units = units;
 
-	fprintf (output->ostream, "<device>\n");
+	dctool_writer_puts (output->ostream, "<device>\n");
 
 	return (dctool_output_t *) output;
 
@@ -212,13 +242,13 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	sampledata.ostream = output->ostream;
 	sampledata.units = output->units;
 
-	fprintf (output->ostream, "<dive>\n<number>%u</number>\n<size>%u</size>\n", abstract->number, size);
+	xml_uint (output->ostream, "<dive>\n<number>", abstract->number, "</number>\n");
+	xml_uint (output->ostream, "<size>", size, "</size>\n");
 
 	if (fingerprint) {
-		fprintf (output->ostream, "<fingerprint>");
-		for (unsigned int i = 0; i < fsize; ++i)
-			fprintf (output->ostream, "%02X", fingerprint[i]);
-		fprintf (output->ostream, "</fingerprint>\n");
+		dctool_writer_puts (output->ostream, "<fingerprint>");
+		dctool_writer_hex (output->ostream, fingerprint, fsize);
+		dctool_writer_puts (output->ostream, "</fingerprint>\n");
 	}
 
 	// Parse the datetime.
@@ -230,16 +260,25 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	if (dt.timezone == DC_TIMEZONE_NONE) {
-		fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i</datetime>\n",
-			dt.year, dt.month, dt.day,
-			dt.hour, dt.minute, dt.second);
-	} else {
-		fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i %+03i:%02i</datetime>\n",
-			dt.year, dt.month, dt.day,
-			dt.hour, dt.minute, dt.second,
-			dt.timezone / 3600, (dt.timezone % 3600) / 60);
+	dctool_writer_puts (output->ostream, "<datetime>");
+	dctool_writer_int (output->ostream, dt.year, 4, 0);
+	dctool_writer_puts (output->ostream, "-");
+	dctool_writer_int (output->ostream, dt.month, 2, 0);
+	dctool_writer_puts (output->ostream, "-");
+	dctool_writer_int (output->ostream, dt.day, 2, 0);
+	dctool_writer_puts (output->ostream, " ");
+	dctool_writer_int (output->ostream, dt.hour, 2, 0);
+	dctool_writer_puts (output->ostream, ":");
+	dctool_writer_int (output->ostream, dt.minute, 2, 0);
+	dctool_writer_puts (output->ostream, ":");
+	dctool_writer_int (output->ostream, dt.second, 2, 0);
+	if (dt.timezone != DC_TIMEZONE_NONE) {
+		dctool_writer_puts (output->ostream, " ");
+		dctool_writer_int (output->ostream, dt.timezone / 3600, 3, 1);
+		dctool_writer_puts (output->ostream, ":");
+		dctool_writer_int (output->ostream, (dt.timezone % 3600) / 60, 2, 0);
 	}
+	dctool_writer_puts (output->ostream, "</datetime>\n");
 
 	// Parse the divetime.
 	message ("Parsing the divetime.\n");
@@ -250,8 +289,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	fprintf (output->ostream, "<divetime>%02u:%02u</divetime>\n",
-		divetime / 60, divetime % 60);
+	dctool_writer_puts (output->ostream, "<divetime>");
+	dctool_writer_uint (output->ostream, divetime / 60, 2);
+	dctool_writer_puts (output->ostream, ":");
+	dctool_writer_uint (output->ostream, divetime % 60, 2);
+	dctool_writer_puts (output->ostream, "</divetime>\n");
 
 	// Parse the maxdepth.
 	message ("Parsing the maxdepth.\n");
@@ -262,8 +304,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	fprintf (output->ostream, "<maxdepth>%.2f</maxdepth>\n",
-		convert_depth(maxdepth, output->units));
+	xml_double (output->ostream, "<maxdepth>",
+		convert_depth(maxdepth, output->units), 2, "</maxdepth>\n");
 
 	// Parse the avgdepth.
 	message ("Parsing the avgdepth.\n");
@@ -275,8 +317,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<avgdepth>%.2f</avgdepth>\n",
-			convert_depth(avgdepth, output->units));
+		xml_double (output->ostream, "<avgdepth>",
+			convert_depth(avgdepth, output->units), 2, "</avgdepth>\n");
 	}
 
 	// Parse the temperature.
@@ -295,9 +337,10 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		}
 
 		if (status != DC_STATUS_UNSUPPORTED) {
-			fprintf (output->ostream, "<temperature type=\"%s\">%.1f</temperature>\n",
-				names[i],
-				convert_temperature(temperature, output->units));
+			dctool_writer_puts (output->ostream, "<temperature type=\"");
+			dctool_writer_puts (output->ostream, names[i]);
+			xml_double (output->ostream, "\">",
+				convert_temperature(temperature, output->units), 1, "</temperature>\n");
 		}
 	}
 
@@ -318,15 +361,9 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			goto cleanup;
 		}
 
-		fprintf (output->ostream,
-			"<gasmix>\n"
-			"   <he>%.1f</he>\n"
-			"   <o2>%.1f</o2>\n"
-			"   <n2>%.1f</n2>\n"
-			"</gasmix>\n",
-			gasmix.helium * 100.0,
-			gasmix.oxygen * 100.0,
-			gasmix.nitrogen * 100.0);
+		xml_double (output->ostream, "<gasmix>\n   <he>", gasmix.helium * 100.0, 1, "</he>\n");
+		xml_double (output->ostream, "   <o2>", gasmix.oxygen * 100.0, 1, "</o2>\n");
+		xml_double (output->ostream, "   <n2>", gasmix.nitrogen * 100.0, 1, "</n2>\n</gasmix>\n");
 	}
 
 	// Parse the tanks.
@@ -348,27 +385,22 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			goto cleanup;
 		}
 
-		fprintf (output->ostream, "<tank>\n");
+		dctool_writer_puts (output->ostream, "<tank>\n");
 		if (tank.gasmix != DC_GASMIX_UNKNOWN) {
-			fprintf (output->ostream,
-				"   <gasmix>%u</gasmix>\n",
-				tank.gasmix);
+			xml_uint (output->ostream, "   <gasmix>", tank.gasmix, "</gasmix>\n");
 		}
 		if (tank.type != DC_TANKVOLUME_NONE) {
-			fprintf (output->ostream,
-				"   <type>%s</type>\n"
-				"   <volume>%.1f</volume>\n"
-				"   <workpressure>%.2f</workpressure>\n",
-				names[tank.type],
-				convert_volume(tank.volume, output->units),
-				convert_pressure(tank.workpressure, output->units));
+			dctool_writer_puts (output->ostream, "   <type>");
+			dctool_writer_puts (output->ostream, names[tank.type]);
+			xml_double (output->ostream, "</type>\n   <volume>",
+				convert_volume(tank.volume, output->units), 1, "</volume>\n");
+			xml_double (output->ostream, "   <workpressure>",
+				convert_pressure(tank.workpressure, output->units), 2, "</workpressure>\n");
 		}
-		fprintf (output->ostream,
-			"   <beginpressure>%.2f</beginpressure>\n"
-			"   <endpressure>%.2f</endpressure>\n"
-			"</tank>\n",
-			convert_pressure(tank.beginpressure, output->units),
-			convert_pressure(tank.endpressure, output->units));
+		xml_double (output->ostream, "   <beginpressure>",
+			convert_pressure(tank.beginpressure, output->units), 2, "</beginpressure>\n");
+		xml_double (output->ostream, "   <endpressure>",
+			convert_pressure(tank.endpressure, output->units), 2, "</endpressure>\n</tank>\n");
 	}
 
 	// Parse the dive mode.
@@ -382,8 +414,9 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 
 	if (status != DC_STATUS_UNSUPPORTED) {
 		const char *names[] = {"freedive", "gauge", "oc", "ccr", "scr"};
-		fprintf (output->ostream, "<divemode>%s</divemode>\n",
-			names[divemode]);
+		dctool_writer_puts (output->ostream, "<divemode>");
+		dctool_writer_puts (output->ostream, names[divemode]);
+		dctool_writer_puts (output->ostream, "</divemode>\n");
 	}
 
 	// Parse the salinity.
@@ -396,8 +429,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<salinity type=\"%u\">%.1f</salinity>\n",
-			salinity.type, salinity.density);
+		xml_uint (output->ostream, "<salinity type=\"", salinity.type, "\">");
+		xml_double (output->ostream, NULL, salinity.density, 1, "</salinity>\n");
 	}
 
 	// Parse the atmospheric pressure.
@@ -410,8 +443,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<atmospheric>%.5f</atmospheric>\n",
-			convert_pressure(atmospheric, output->units));
+		xml_double (output->ostream, "<atmospheric>",
+			convert_pressure(atmospheric, output->units), 5, "</atmospheric>\n");
 	}
 
 	message ("Parsing strings.\n");
@@ -427,8 +460,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			break;
 		if (!str.desc || !str.value)
 			break;
-		fprintf (output->ostream, "<extradata key='%s' value='%s' />\n",
-			str.desc, str.value);
+		dctool_writer_puts (output->ostream, "<extradata key='");
+		dctool_writer_puts (output->ostream, str.desc);
+		dctool_writer_puts (output->ostream, "' value='");
+		dctool_writer_puts (output->ostream, str.value);
+		dctool_writer_puts (output->ostream, "' />\n");
 
 	}
 
@@ -443,8 +479,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 cleanup:
 
 	if (sampledata.nsamples)
-		fprintf (output->ostream, "</sample>\n");
-	fprintf (output->ostream, "</dive>\n");
+		dctool_writer_puts (output->ostream, "</sample>\n");
+	dctool_writer_puts (output->ostream, "</dive>\n");
 
 	return status;
 }
@@ -454,9 +490,10 @@ dctool_xml_output_free (dctool_output_t *abstract)
 {
 	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
 
-	fprintf (output->ostream, "</device>\n");
+	dctool_writer_puts (output->ostream, "</device>\n");
 
-	fclose (output->ostream);
+	if (dctool_writer_free (output->ostream) != 0)
+		return DC_STATUS_IO;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -0,0 +1,218 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "writer.h"
+
+#define BUFSIZE (64 * 1024)
+
+struct dctool_writer_t {
+	FILE *ostream;
+	size_t size;
+	unsigned char buffer[BUFSIZE];
+};
+
+dctool_writer_t *
+dctool_writer_new (const char *filename)
+{
+	dctool_writer_t *writer = NULL;
+
+	if (filename == NULL)
+		return NULL;
+
+	writer = (dctool_writer_t *) malloc (sizeof (dctool_writer_t));
+	if (writer == NULL)
+		return NULL;
+
+	writer->ostream = fopen (filename, "w");
+	if (writer->ostream == NULL) {
+		free (writer);
+		return NULL;
+	}
+
+	writer->size = 0;
+
+	return writer;
+}
+
+void
+dctool_writer_write (dctool_writer_t *writer, const void *data, size_t size)
+{
+	if (writer->size + size > sizeof (writer->buffer)) {
+		dctool_writer_flush (writer);
+
+		// Write large blocks directly.
+		if (size > sizeof (writer->buffer)) {
+			fwrite (data, 1, size, writer->ostream);
+			return;
+		}
+	}
+
+	memcpy (writer->buffer + writer->size, data, size);
+	writer->size += size;
+}
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *str)
+{
+	dctool_writer_write (writer, str, strlen (str));
+}
+
+static void
+dctool_writer_digits (dctool_writer_t *writer, const char *sign, unsigned long long value, unsigned int width)
+{
+	char buffer[32];
+	size_t n = sizeof (buffer);
+
+	do {
+		buffer[--n] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	if (sign)
+		width = width ? width - 1 : 0;
+	while (sizeof (buffer) - n < width && n > 1)
+		buffer[--n] = '0';
+
+	if (sign)
+		buffer[--n] = *sign;
+
+	dctool_writer_write (writer, buffer + n, sizeof (buffer) - n);
+}
+
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width)
+{
+	dctool_writer_digits (writer, NULL, value, width);
+}
+
+void
+dctool_writer_int (dctool_writer_t *writer, int value, unsigned int width, int sign)
+{
+	unsigned long long magnitude = value < 0 ? -(long long) value : value;
+
+	if (value < 0)
+		dctool_writer_digits (writer, "-", magnitude, width);
+	else if (sign)
+		dctool_writer_digits (writer, "+", magnitude, width);
+	else
+		dctool_writer_digits (writer, NULL, magnitude, width);
+}
+
+void
+dctool_writer_double (dctool_writer_t *writer, double value, unsigned int decimals)
+{
+	static const double scale[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+	// Large values, infinity and NaN are rare enough to use the regular
+	// formatting.
+	if (decimals >= sizeof (scale) / sizeof (scale[0]) || !(fabs (value) * scale[decimals] < 1e9)) {
+		char buffer[512];
+		int n = snprintf (buffer, sizeof (buffer), "%.*f", decimals, value);
+		if (n > 0)
+			dctool_writer_write (writer, buffer, (size_t) n < sizeof (buffer) ? (size_t) n : sizeof (buffer) - 1);
+		return;
+	}
+
+	// Round to the nearest integer. The scaled value isn't exact, so
+	// the values close to a tie are left to the regular formatting, which
+	// rounds the exact decimal value.
+	double x = fabs (value) * scale[decimals];
+	double r = floor (x);
+	double d = x - r;
+	if (fabs (d - 0.5) < 1e-6) {
+		char buffer[64];
+		int n = snprintf (buffer, sizeof (buffer), "%.*f", decimals, value);
+		if (n > 0)
+			dctool_writer_write (writer, buffer, n);
+		return;
+	}
+	if (d > 0.5)
+		r += 1.0;
+
+	unsigned long long fixed = (unsigned long long) r;
+	unsigned long long divisor = (unsigned long long) scale[decimals];
+
+	dctool_writer_digits (writer, signbit (value) ? "-" : NULL, fixed / divisor, 0);
+
+	if (decimals) {
+		dctool_writer_write (writer, ".", 1);
+		dctool_writer_digits (writer, NULL, fixed % divisor, decimals);
+	}
+}
+
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], size_t size)
+{
+	static const char ascii[] = "0123456789ABCDEF";
+	char buffer[256];
+
+	for (size_t i = 0; i < size; i += sizeof (buffer) / 2) {
+		size_t n = size - i;
+		if (n > sizeof (buffer) / 2)
+			n = sizeof (buffer) / 2;
+
+		for (size_t j = 0; j < n; ++j) {
+			buffer[2 * j + 0] = ascii[(data[i + j] >> 4) & 0x0F];
+			buffer[2 * j + 1] = ascii[(data[i + j]     ) & 0x0F];
+		}
+
+		dctool_writer_write (writer, buffer, 2 * n);
+	}
+}
+
+int
+dctool_writer_flush (dctool_writer_t *writer)
+{
+	if (writer->size) {
+		size_t n = fwrite (writer->buffer, 1, writer->size, writer->ostream);
+		if (n != writer->size) {
+			writer->size = 0;
+			return -1;
+		}
+		writer->size = 0;
+	}
+
+	return 0;
+}
+
+int
+dctool_writer_free (dctool_writer_t *writer)
+{
+	int rc = 0;
+
+	if (writer == NULL)
+		return 0;
+
+	if (dctool_writer_flush (writer) != 0)
+		rc = -1;
+
+	if (fclose (writer->ostream) != 0)
+		rc = -1;
+
+	free (writer);
+
+	return rc;
+}
@@ -0,0 +1,78 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_WRITER_H
+#define DCTOOL_WRITER_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Buffered output stream. The data is collected in a large buffer and
+ * written to the file in big blocks. The number formatting is done by
+ * hand, and doesn't depend on the locale.
+ */
+typedef struct dctool_writer_t dctool_writer_t;
+
+dctool_writer_t *
+dctool_writer_new (const char *filename);
+
+void
+dctool_writer_write (dctool_writer_t *writer, const void *data, size_t size);
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *str);
+
+/*
+ * Write an unsigned integer, padded with zeros to the minimum width.
+ */
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width);
+
+/*
+ * Write a signed integer, padded with zeros to the minimum width. The
+ * width includes the sign, which is always written if requested.
+ */
+void
+dctool_writer_int (dctool_writer_t *writer, int value, unsigned int width, int sign);
+
+/*
+ * Write a floating point number with a fixed number of decimals.
+ */
+void
+dctool_writer_double (dctool_writer_t *writer, double value, unsigned int decimals);
+
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], size_t size);
+
+int
+dctool_writer_flush (dctool_writer_t *writer);
+
+int
+dctool_writer_free (dctool_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_WRITER_H */
@@ -33,6 +33,14 @@ extern "C" {
  */
 #define DC_IOCTL_BLE_GET_NAME   DC_IOCTL_IOR('b', 0, DC_IOCTL_SIZE_VARIABLE)
 
+/**
+ * Get the maximum number of bytes in a single packet (unsigned int).
+ *
+ * This is the payload size for the negotiated ATT MTU (the MTU minus
+ * the 3 byte ATT header).
+ */
+#define DC_IOCTL_BLE_GET_MTU    DC_IOCTL_IOR('b', 1, sizeof(unsigned int))
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -47,6 +47,24 @@ typedef unsigned __int64 dc_bluetooth_address_t;
 typedef unsigned long long dc_bluetooth_address_t;
 #endif
 
+/**
+ * Bluetooth scan flags.
+ *
+ * DC_BLUETOOTH_SCAN_STREAM: Return each matching device as soon as it
+ * responds to the inquiry, instead of waiting for the inquiry to finish.
+ * The user friendly names are resolved while the inquiry is still
+ * running, or taken directly from the extended inquiry response.
+ *
+ * DC_BLUETOOTH_SCAN_FIRST: Stop the scan after the first matching
+ * device. Combined with a device descriptor, this ends the discovery as
+ * soon as the requested dive computer is found.
+ */
+typedef enum dc_bluetooth_scan_t {
+	DC_BLUETOOTH_SCAN_NONE = 0,
+	DC_BLUETOOTH_SCAN_STREAM = (1 << 0),
+	DC_BLUETOOTH_SCAN_FIRST = (1 << 1),
+} dc_bluetooth_scan_t;
+
 /**
  * Convert a bluetooth address to a string.
  *
@@ -116,6 +134,56 @@ dc_bluetooth_device_free (dc_bluetooth_device_t *device);
 dc_status_t
 dc_bluetooth_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor);
 
+/**
+ * Create an iterator to enumerate the bluetooth devices, with control
+ * over the scan.
+ *
+ * Freeing the iterator before the end of the enumeration cancels the
+ * scan that is still in progress.
+ *
+ * @param[out] iterator    A location to store the iterator.
+ * @param[in]  context     A valid context object.
+ * @param[in]  descriptor  A valid device descriptor or NULL.
+ * @param[in]  flags       A bitmask of #dc_bluetooth_scan_t values.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_iterator_new2 (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int flags);
+
+/**
+ * Store the RFCOMM channel of a bluetooth device.
+ *
+ * When a connection is opened without a port number, the channel is
+ * looked up with a service discovery (SDP) query. The channel found
+ * this way is remembered by the context, and tried first the next time
+ * the same device is opened. If that fails, the service discovery is
+ * repeated. This function imports a channel, for example one saved by
+ * the application from a previous session. A zero port number removes
+ * the channel from the cache.
+ *
+ * @param[in]  context  A valid context object.
+ * @param[in]  address  The bluetooth device address.
+ * @param[in]  port     The RFCOMM channel, or zero.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_set_port (dc_context_t *context, dc_bluetooth_address_t address, unsigned int port);
+
+/**
+ * Get the cached RFCOMM channel of a bluetooth device.
+ *
+ * @param[in]  context  A valid context object.
+ * @param[in]  address  The bluetooth device address.
+ * @param[out] port     A location to store the RFCOMM channel.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if no
+ * channel is known for the device, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_bluetooth_get_port (dc_context_t *context, dc_bluetooth_address_t address, unsigned int *port);
+
 /**
  * Open an bluetooth connection.
  *
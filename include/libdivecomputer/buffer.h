@@ -33,6 +33,19 @@ typedef struct dc_buffer_t dc_buffer_t;
 dc_buffer_t *
 dc_buffer_new (size_t capacity);
 
+/*
+ * Create a buffer backed by a file, for large memory dumps.
+ *
+ * The file is created, or truncated if it already exists, and the
+ * contents of the buffer are stored in the file instead of the heap.
+ * Where supported, the file is mapped into memory, such that the data
+ * can be written back to disk at any time, and the memory use stays
+ * small. The file contains the final contents of the buffer once the
+ * buffer is freed. File backed buffers are never kept in a buffer pool.
+ */
+dc_buffer_t *
+dc_buffer_new_file (const char *filename);
+
 void
 dc_buffer_free (dc_buffer_t *buffer);
 
@@ -42,6 +55,17 @@ dc_buffer_clear (dc_buffer_t *buffer);
 int
 dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity);
 
+/*
+ * Reserve space for data that is filled from the end.
+ *
+ * The buffer is expanded to hold at least the specified number of bytes,
+ * and the current contents are moved to the end. As long as the total
+ * size stays within the reserved capacity, prepending data never needs
+ * to move or reallocate the existing contents.
+ */
+int
+dc_buffer_reserve_prepend (dc_buffer_t *buffer, size_t capacity);
+
 int
 dc_buffer_resize (dc_buffer_t *buffer, size_t size);
 
@@ -60,6 +84,28 @@ dc_buffer_get_size (dc_buffer_t *buffer);
 unsigned char *
 dc_buffer_get_data (dc_buffer_t *buffer);
 
+/*
+ * Buffer pool.
+ *
+ * A pool keeps up to a maximum number of released buffers, along with
+ * their allocated capacity, so they can be acquired again without another
+ * heap allocation. A pool is not thread-safe; use one pool per thread.
+ */
+
+typedef struct dc_buffer_pool_t dc_buffer_pool_t;
+
+dc_buffer_pool_t *
+dc_buffer_pool_new (size_t maximum);
+
+void
+dc_buffer_pool_free (dc_buffer_pool_t *pool);
+
+dc_buffer_t *
+dc_buffer_pool_acquire (dc_buffer_pool_t *pool, size_t capacity);
+
+void
+dc_buffer_pool_release (dc_buffer_pool_t *pool, dc_buffer_t *buffer);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,145 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CODEC_H
+#define DC_CODEC_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "context.h"
+#include "buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Compression of memory dumps and dive data.
+ *
+ * The data is split into independent blocks of at most 64 KiB. Every
+ * block is stored with the cheapest of a few encodings: a single byte
+ * repeated over the entire block (typical for erased flash pages), a
+ * fast LZ77 compression of the bytes or of the differences between
+ * consecutive bytes (typical for slowly changing sample data), or the
+ * bytes as is. The compressed stream ends with a checksum of the
+ * original data.
+ */
+
+/**
+ * Check whether the data starts with the signature of a compressed stream.
+ *
+ * @param[in]  data  The data.
+ * @param[in]  size  The size of the data.
+ * @returns Non-zero if the data is compressed, or zero otherwise.
+ */
+int
+dc_codec_detect (const unsigned char data[], size_t size);
+
+/**
+ * Compress the data and append the compressed stream to the output buffer.
+ *
+ * @param[in]  context  A valid context object.
+ * @param[in]  data     The data to compress.
+ * @param[in]  size     The size of the data.
+ * @param[in]  output   The output buffer.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_codec_compress (dc_context_t *context, const unsigned char data[], size_t size, dc_buffer_t *output);
+
+/**
+ * Decompress a complete compressed stream and append the data to the
+ * output buffer.
+ *
+ * @param[in]  context  A valid context object.
+ * @param[in]  data     The compressed stream.
+ * @param[in]  size     The size of the compressed stream.
+ * @param[in]  output   The output buffer.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_DATAFORMAT if the
+ * stream is corrupt or truncated, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_codec_decompress (dc_context_t *context, const unsigned char data[], size_t size, dc_buffer_t *output);
+
+/**
+ * Opaque object representing a streaming decoder.
+ *
+ * The compressed stream can be passed to the decoder in pieces of any
+ * size, for example while reading a file. Every block is decoded as
+ * soon as it is complete, so there is no need to keep the entire
+ * compressed stream in memory.
+ */
+typedef struct dc_codec_decoder_t dc_codec_decoder_t;
+
+/**
+ * Create a new streaming decoder.
+ *
+ * @param[out]  decoder  A location to store the decoder.
+ * @param[in]   context  A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_codec_decoder_new (dc_codec_decoder_t **decoder, dc_context_t *context);
+
+/**
+ * Pass the next piece of the compressed stream to the decoder, and
+ * append the decoded data to the output buffer.
+ *
+ * @param[in]  decoder  A valid decoder.
+ * @param[in]  data     The next piece of the compressed stream.
+ * @param[in]  size     The size of the data.
+ * @param[in]  output   The output buffer.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_DATAFORMAT if the
+ * stream is corrupt, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_codec_decoder_update (dc_codec_decoder_t *decoder, const unsigned char data[], size_t size, dc_buffer_t *output);
+
+/**
+ * Check whether the end of the compressed stream has been reached, and
+ * the checksum is correct.
+ *
+ * @param[in]  decoder  A valid decoder.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_DATAFORMAT if the
+ * stream is truncated or the checksum is wrong, or another
+ * #dc_status_t code on failure.
+ */
+dc_status_t
+dc_codec_decoder_finish (dc_codec_decoder_t *decoder);
+
+/**
+ * Destroy the decoder and free all resources.
+ *
+ * @param[in]  decoder  A valid decoder.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_codec_decoder_free (dc_codec_decoder_t *decoder);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CODEC_H */
@@ -38,7 +38,9 @@ typedef enum dc_status_t {
 	DC_STATUS_TIMEOUT = -7,
 	DC_STATUS_PROTOCOL = -8,
 	DC_STATUS_DATAFORMAT = -9,
-	DC_STATUS_CANCELLED = -10
+	DC_STATUS_CANCELLED = -10,
+	DC_STATUS_FULLSCAN = -11,
+	DC_STATUS_LIMIT = -12
 } dc_status_t;
 
 typedef enum dc_transport_t {
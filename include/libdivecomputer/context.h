@@ -22,6 +22,8 @@
 #ifndef DC_CONTEXT_H
 #define DC_CONTEXT_H
 
+#include <stddef.h>
+
 #include "common.h"
 
 #ifdef __cplusplus
@@ -41,6 +43,85 @@ typedef enum dc_loglevel_t {
 
 typedef void (*dc_logfunc_t) (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *message, void *userdata);
 
+/*
+ * Memory allocation function.
+ *
+ * The allocation function has the semantics of the standard realloc
+ * function. It is called with a NULL pointer to allocate a new block, and
+ * with a zero size to free an existing block (and must return NULL in that
+ * case). If the request can't be satisfied, NULL is returned.
+ */
+typedef void *(*dc_allocfunc_t) (void *ptr, size_t size, void *userdata);
+
+/*
+ * Memory statistics.
+ *
+ * All memory allocated by the library on behalf of a context is
+ * accounted: the number of allocations (including the reallocations),
+ * the total number of bytes requested, the number of bytes currently
+ * in use and its maximum, and the size of the largest single block.
+ */
+typedef struct dc_context_memstats_t {
+	unsigned long long count;
+	unsigned long long total;
+	size_t current;
+	size_t peak;
+	size_t largest;
+} dc_context_memstats_t;
+
+typedef enum dc_trace_phase_t {
+	DC_TRACE_BEGIN,
+	DC_TRACE_END
+} dc_trace_phase_t;
+
+/*
+ * Tracing of the protocol transfers.
+ *
+ * The backends report the start and the end of every logical transfer,
+ * including any retries. The command is the backend specific command
+ * identifier, and the sizes are the number of bytes sent and expected
+ * in return. The status and the duration (in microseconds) are only
+ * valid at the end of the transfer.
+ */
+typedef struct dc_trace_t {
+	dc_trace_phase_t phase;
+	const char *function;
+	unsigned int command;
+	unsigned int isize;
+	unsigned int osize;
+	dc_status_t status;
+	unsigned int duration;
+} dc_trace_t;
+
+typedef void (*dc_tracefunc_t) (dc_context_t *context, const dc_trace_t *trace, void *userdata);
+
+/*
+ * Executor for the background work of the library.
+ *
+ * The submit function starts running the task function, now or at some
+ * later time, and stores an opaque handle for the task. The wait function
+ * blocks until the task has finished, and releases the handle. Tasks that
+ * are submitted together may wait for each other's results, but always
+ * make progress as long as at least one of them runs. An executor must
+ * therefore eventually run every task, but is free to limit the number of
+ * tasks running at the same time. The submitting thread only waits for
+ * tasks it submitted itself.
+ */
+typedef void (*dc_taskfunc_t) (void *data);
+
+typedef dc_status_t (*dc_submitfunc_t) (void **task, dc_taskfunc_t taskfunc, void *data, void *userdata);
+
+typedef void (*dc_waitfunc_t) (void *task, void *userdata);
+
+/*
+ * Create a new library context.
+ *
+ * Creating a context is cheap. None of the transport subsystems (such
+ * as libusb, hidapi or bluetooth) are initialized here, but only when
+ * the first iterator for that transport is created. The processor
+ * features are detected when the first optimized kernel is selected.
+ * Applications which only parse dives never touch any transport.
+ */
 dc_status_t
 dc_context_new (dc_context_t **context);
 
@@ -53,6 +134,30 @@ dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel);
 dc_status_t
 dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata);
 
+dc_status_t
+dc_context_set_allocator (dc_context_t *context, dc_allocfunc_t allocfunc, void *userdata);
+
+dc_status_t
+dc_context_get_memstats (dc_context_t *context, dc_context_memstats_t *stats);
+
+dc_status_t
+dc_context_set_tracefunc (dc_context_t *context, dc_tracefunc_t tracefunc, void *userdata);
+
+/*
+ * Replace the executor used for all parallel work on behalf of the
+ * context, such as the parallel parsing and the download sessions.
+ * Passing NULL functions restores the built-in thread pool. The executor
+ * must not be changed while tasks are still outstanding.
+ */
+dc_status_t
+dc_context_set_executor (dc_context_t *context, dc_submitfunc_t submitfunc, dc_waitfunc_t waitfunc, void *userdata);
+
+/*
+ * Get the transports supported by the library. The result is known at
+ * build time, and is returned without initializing or probing any of
+ * the transports. A supported transport can still fail to open, for
+ * example when no adapter is present.
+ */
 unsigned int
 dc_context_get_transports (dc_context_t *context);
 
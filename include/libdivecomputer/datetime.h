@@ -55,6 +55,29 @@ dc_datetime_t *
 dc_datetime_gmtime (dc_datetime_t *result,
                     dc_ticks_t ticks);
 
+/*
+ * Convert a timestamp to the date and time at a fixed offset from UTC
+ * (in seconds), stored in the timezone field. DC_TIMEZONE_NONE is
+ * treated as UTC, but stored as is. Unlike dc_datetime_localtime, the
+ * conversion is pure arithmetic, and doesn't depend on the timezone
+ * settings of the system.
+ */
+dc_datetime_t *
+dc_datetime_convert (dc_datetime_t *result,
+                     dc_ticks_t ticks,
+                     int timezone);
+
+/*
+ * Convert an array of timestamps at once, with the same offset from
+ * UTC. Returns the results array, or NULL if a timestamp is out of
+ * range.
+ */
+dc_datetime_t *
+dc_datetime_convert_batch (dc_datetime_t results[],
+                           const dc_ticks_t ticks[],
+                           unsigned int count,
+                           int timezone);
+
 dc_ticks_t
 dc_datetime_mktime (const dc_datetime_t *dt);
 
@@ -52,6 +52,52 @@ dc_descriptor_get_model (dc_descriptor_t *descriptor);
 unsigned int
 dc_descriptor_get_transports (dc_descriptor_t *descriptor);
 
+/**
+ * Find the descriptor for a model of a device family.
+ *
+ * The returned descriptor is a reference to the built-in table, and
+ * doesn't need to be freed.
+ *
+ * @param[out]  descriptor  A location to store the descriptor.
+ * @param[in]   family      The device family.
+ * @param[in]   model       The model number.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * there is no such model, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_descriptor_find (dc_descriptor_t **descriptor, dc_family_t family, unsigned int model);
+
+/**
+ * Find the descriptor for a USB or USB HID device.
+ *
+ * If several models share the same identifiers, the first one is
+ * returned. The device family is always correct, but the exact model
+ * is only known after connecting to the device.
+ *
+ * @param[out]  descriptor  A location to store the descriptor.
+ * @param[in]   vid         The USB vendor id.
+ * @param[in]   pid         The USB product id.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the device isn't recognized, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_descriptor_find_usb (dc_descriptor_t **descriptor, unsigned int vid, unsigned int pid);
+
+/**
+ * Find the descriptor for an IrDA, bluetooth or BLE device name.
+ *
+ * If several models accept the same name, the one whose product name
+ * appears in the device name is preferred.
+ *
+ * @param[out]  descriptor  A location to store the descriptor.
+ * @param[in]   transport   The transport type.
+ * @param[in]   name        The device name.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the device isn't recognized, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_descriptor_find_name (dc_descriptor_t **descriptor, dc_transport_t transport, const char *name);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
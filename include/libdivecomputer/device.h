@@ -28,6 +28,8 @@
 #include "iostream.h"
 #include "buffer.h"
 #include "datetime.h"
+#include "fpstore.h"
+#include "pacing.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,14 +40,48 @@ typedef enum dc_event_type_t {
 	DC_EVENT_PROGRESS = (1 << 1),
 	DC_EVENT_DEVINFO = (1 << 2),
 	DC_EVENT_CLOCK = (1 << 3),
-	DC_EVENT_VENDOR = (1 << 4)
+	DC_EVENT_VENDOR = (1 << 4),
+	DC_EVENT_PARTIAL = (1 << 5)
 } dc_event_type_t;
 
 typedef struct dc_device_t dc_device_t;
 
+/*
+ * The phase of the operation reported in the progress events. Backends
+ * which download the logbook headers and the dive profiles separately
+ * report the logbook and profile phases, the latter together with the
+ * number of the dive being downloaded. The other backends report the
+ * memory phase for a memory dump, or an unknown phase.
+ */
+typedef enum dc_progress_phase_t {
+	DC_PROGRESS_UNKNOWN = 0,
+	DC_PROGRESS_MEMORY,
+	DC_PROGRESS_LOGBOOK,
+	DC_PROGRESS_PROFILE,
+} dc_progress_phase_t;
+
+/*
+ * Progress of the current operation.
+ *
+ * The current and maximum values are set by the backend, in a unit of
+ * its choice, usually bytes. The maximum can still increase during the
+ * operation, once the backend knows the total amount of data.
+ *
+ * The timing fields are filled in by the library, for every progress
+ * event. The rate is the smoothed number of units per second, and the
+ * ETA is derived from it and the remaining units. Both are zero until
+ * enough data has been transferred to estimate them.
+ */
 typedef struct dc_event_progress_t {
 	unsigned int current;
 	unsigned int maximum;
+	unsigned int throughput; /* Bytes per second, or zero if unknown. */
+	unsigned int elapsed; /* Time since the start of the operation (ms). */
+	unsigned int rate; /* Smoothed units per second, or zero if unknown. */
+	unsigned int eta; /* Estimated remaining time (s), or zero if unknown. */
+	dc_progress_phase_t phase;
+	unsigned int dive; /* Dive being downloaded (one based), or zero. */
+	unsigned int ndives; /* Number of dives to download, or zero. */
 } dc_event_progress_t;
 
 typedef struct dc_event_devinfo_t {
@@ -64,12 +100,104 @@ typedef struct dc_event_vendor_t {
 	unsigned int size;
 } dc_event_vendor_t;
 
+/*
+ * The part of the dive which has been downloaded so far, for backends
+ * which download the dives one at a time. The data always starts at
+ * the beginning of the dive, and is in the same format as the final
+ * dive data passed to the dive callback. The size can shrink again if
+ * the backend has to restart the download of the dive. The data is
+ * only valid for the duration of the event callback, and a truncated
+ * dive is not guaranteed to be accepted by the parser.
+ */
+typedef struct dc_event_partial_t {
+	const unsigned char *data;
+	unsigned int size;
+} dc_event_partial_t;
+
 typedef int (*dc_cancel_callback_t) (void *userdata);
 
 typedef void (*dc_event_callback_t) (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata);
 
 typedef int (*dc_dive_callback_t) (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
 
+/*
+ * Content hashes of a dive.
+ *
+ * The hashes are computed over the dive data while it is delivered,
+ * without an extra pass over the memory in the application. The flags
+ * indicate which of the hashes are valid. The fast hash is XXH64 with
+ * a zero seed, and is meant for detecting duplicates. SHA-256 is
+ * available when a collision resistant digest is needed.
+ */
+typedef enum dc_dive_hash_type_t {
+	DC_DIVE_HASH_FAST = (1 << 0),
+	DC_DIVE_HASH_SHA256 = (1 << 1),
+} dc_dive_hash_type_t;
+
+typedef struct dc_dive_hash_t {
+	unsigned int flags;
+	unsigned long long fast;
+	unsigned char sha256[32];
+} dc_dive_hash_t;
+
+/*
+ * Download statistics of a dive.
+ *
+ * The counters are the transport activity since the previous dive was
+ * delivered, or since the start of the download for the first dive. The
+ * elapsed time is the wall-clock time over the same interval, and
+ * includes the time spent in the callback of the previous dive, which is
+ * reported separately. All times are in milliseconds.
+ */
+typedef struct dc_dive_stats_t {
+	unsigned int nbytes_in;
+	unsigned int nbytes_out;
+	unsigned int nreads;
+	unsigned int nwrites;
+	unsigned int ntimeouts;
+	unsigned int nretries;
+	unsigned int elapsed;
+	unsigned int callback;
+} dc_dive_stats_t;
+
+/*
+ * Scatter/gather view of a dive.
+ *
+ * The dive data consists of up to two spans, which should be processed
+ * as if concatenated. The second span is only used when the dive wraps
+ * around the end of a ringbuffer, and is empty otherwise. The pointers are
+ * borrowed from the backend and only valid for the duration of the
+ * callback. The hashes are only available after enabling them with
+ * dc_device_set_hash, and the statistics with dc_device_set_stats. Both
+ * are NULL otherwise.
+ */
+typedef struct dc_dive_view_t {
+	const unsigned char *data[2];
+	unsigned int size[2];
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	const dc_dive_hash_t *hash;
+	const dc_dive_stats_t *stats;
+} dc_dive_view_t;
+
+typedef int (*dc_dive_view_callback_t) (const dc_dive_view_t *view, void *userdata);
+
+/*
+ * Retry policy for failed packets.
+ *
+ * The delay between two attempts starts at the initial delay, and is
+ * doubled after every attempt up to the maximum delay, with a random
+ * jitter of up to half the delay. The budget limits the total time
+ * spent retrying a single packet, or is zero for no limit. All times
+ * are in milliseconds.
+ */
+typedef struct dc_retry_policy_t {
+	unsigned int maxretries;
+	unsigned int delay;
+	unsigned int maxdelay;
+	unsigned int budget;
+} dc_retry_policy_t;
+
 dc_status_t
 dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_iostream_t *iostream);
 
@@ -82,9 +210,63 @@ dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata);
 
+dc_status_t
+dc_device_set_progress_limit (dc_device_t *device, unsigned int interval, unsigned int delta);
+
+dc_status_t
+dc_device_set_retry_policy (dc_device_t *device, const dc_retry_policy_t *policy);
+
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
 
+dc_status_t
+dc_device_set_fpstore (dc_device_t *device, dc_fpstore_t *store);
+
+dc_status_t
+dc_device_set_pacing (dc_device_t *device, dc_pacing_t *pacing);
+
+/*
+ * Compute the content hashes of every dive delivered through the dive
+ * views, as a bitmask of dc_dive_hash_type_t values, or zero to disable
+ * hashing. With a fingerprint store attached, dives without a
+ * fingerprint are identified by their fast hash instead.
+ */
+dc_status_t
+dc_device_set_hash (dc_device_t *device, unsigned int flags);
+
+/*
+ * Enable or disable the download statistics of the dive views.
+ *
+ * The transport counters are only available when the device was opened
+ * with an I/O stream, and are zero otherwise.
+ */
+dc_status_t
+dc_device_set_stats (dc_device_t *device, int enable);
+
+/*
+ * Serve all memory reads from a memory image, typically a memory dump
+ * stored earlier, instead of transferring the data from the device.
+ * This affects dc_device_read, and the dump and download functions of
+ * the backends built on top of the generic memory reads. The memory
+ * image must remain valid until it is detached by passing NULL.
+ */
+dc_status_t
+dc_device_set_memory (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+/*
+ * Cache the memory reads of dc_device_read (and the downloads of the
+ * backends built on top of it) in a number of pages of the given size.
+ * Repeated reads of the same addresses within a session are served from
+ * the cache, and all the missing pages of a read are transferred with a
+ * single request to the device. Reads larger than the cache bypass it.
+ * The page size must be a multiple of the alignment the backend requires
+ * for its reads. The least recently used pages are replaced first, the
+ * cache is invalidated by every write, and a zero page size or number of
+ * pages disables it.
+ */
+dc_status_t
+dc_device_set_readcache (dc_device_t *device, unsigned int pagesize, unsigned int npages);
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size);
 
@@ -94,9 +276,63 @@ dc_device_write (dc_device_t *device, unsigned int address, const unsigned char
 dc_status_t
 dc_device_dump (dc_device_t *device, dc_buffer_t *buffer);
 
+dc_status_t
+dc_device_dump_update (dc_device_t *device, dc_buffer_t *buffer);
+
 dc_status_t
 dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
 
+dc_status_t
+dc_device_foreach_view (dc_device_t *device, dc_dive_view_callback_t callback, void *userdata);
+
+/*
+ * Step based download.
+ *
+ * Instead of blocking inside dc_device_foreach, the download is driven
+ * one step at a time, which allows to service many devices from a single
+ * event loop. Each call runs the download until it would block, or until
+ * the next dive is available, and describes what the device is waiting
+ * for. A step waiting for data should be repeated once the I/O stream
+ * becomes readable (or the timeout expires), and a step waiting for the
+ * timer once the timeout expires. The dive data is only valid until the
+ * next step. The I/O stream must be the one the device was opened on,
+ * and the transport must support polling. Opening the device, and
+ * writing to it, still block. An unfinished download is cancelled when
+ * the device is closed.
+ */
+typedef enum dc_step_type_t {
+	DC_STEP_WANT_READ,
+	DC_STEP_WANT_TIMER,
+	DC_STEP_DIVE,
+	DC_STEP_DONE
+} dc_step_type_t;
+
+typedef struct dc_step_t {
+	dc_step_type_t type;
+	// DC_STEP_WANT_READ and DC_STEP_WANT_TIMER (milliseconds, or negative
+	// for infinite)
+	int timeout;
+	// DC_STEP_DIVE
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	// DC_STEP_DONE
+	dc_status_t status;
+} dc_step_t;
+
+dc_status_t
+dc_device_step (dc_device_t *device, dc_iostream_t *iostream, dc_step_t *step);
+
+/*
+ * Extract the dives from a memory dump, previously obtained with
+ * dc_device_dump. No communication with the device takes place. For
+ * backends with support for views, the dive data points directly into
+ * the memory dump.
+ */
+dc_status_t
+dc_device_extract (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_view_callback_t callback, void *userdata);
+
 dc_status_t
 dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime);
 
@@ -0,0 +1,181 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DIVEINDEX_H
+#define DC_DIVEINDEX_H
+
+#include "common.h"
+#include "context.h"
+#include "device.h"
+#include "descriptor.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing an index over a memory dump.
+ *
+ * The index records the location of every dive in a memory dump,
+ * together with its fingerprint. It is built once, while the device
+ * is still connected, and can be saved next to the memory dump. Later
+ * on, individual dives can be retrieved from the stored memory dump
+ * without a device and without scanning the ringbuffers again.
+ *
+ * The dives are numbered in the order they are extracted by the
+ * backend, starting with the most recent dive at number zero.
+ */
+typedef struct dc_diveindex_t dc_diveindex_t;
+
+/**
+ * Create a new, empty dive index.
+ *
+ * @param[out]  index      A location to store the dive index.
+ * @param[in]   context    A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_diveindex_new (dc_diveindex_t **index, dc_context_t *context);
+
+/**
+ * Destroy the dive index and free all resources.
+ *
+ * @param[in]  index  A valid dive index.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_diveindex_free (dc_diveindex_t *index);
+
+/**
+ * Build the index for a memory dump, replacing the current contents.
+ *
+ * The dives are extracted with #dc_device_extract. Dives older than the
+ * fingerprint of the device are not included, so reset the fingerprint
+ * first to index the complete memory dump.
+ *
+ * @param[in]  index   A valid dive index.
+ * @param[in]  device  A valid device object.
+ * @param[in]  data    The memory dump.
+ * @param[in]  size    The size of the memory dump.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the backend can't locate its dives in the memory dump, or another
+ * #dc_status_t code on failure.
+ */
+dc_status_t
+dc_diveindex_build (dc_diveindex_t *index, dc_device_t *device, const unsigned char data[], unsigned int size);
+
+/**
+ * Get the number of dives in the index.
+ *
+ * @param[in]  index  A valid dive index.
+ * @returns The number of dives.
+ */
+unsigned int
+dc_diveindex_get_count (dc_diveindex_t *index);
+
+/**
+ * Get a view of a dive in the memory dump.
+ *
+ * The view points directly into the memory dump, which must be the
+ * one the index was built for.
+ *
+ * @param[in]   index   A valid dive index.
+ * @param[in]   number  The number of the dive.
+ * @param[in]   data    The memory dump.
+ * @param[in]   size    The size of the memory dump.
+ * @param[out]  view    A location to store the view of the dive.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_INVALIDARGS if
+ * the dive doesn't exist or the memory dump doesn't match the index,
+ * or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_diveindex_get (dc_diveindex_t *index, unsigned int number, const unsigned char data[], unsigned int size, dc_dive_view_t *view);
+
+/**
+ * Find the number of the dive with a fingerprint.
+ *
+ * All dives with a lower number are more recent than this dive.
+ *
+ * @param[in]   index   A valid dive index.
+ * @param[in]   data    The fingerprint data.
+ * @param[in]   size    The size of the fingerprint data.
+ * @param[out]  number  A location to store the number of the dive.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the fingerprint isn't present, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_diveindex_find (dc_diveindex_t *index, const unsigned char data[], unsigned int size, unsigned int *number);
+
+/**
+ * Replace the contents of the index with the contents of a file.
+ *
+ * @param[in]  index     A valid dive index.
+ * @param[in]  filename  The name of the file.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_IO if the file
+ * can't be read, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_diveindex_load (dc_diveindex_t *index, const char *filename);
+
+/**
+ * Write the index to a file, replacing its contents.
+ *
+ * @param[in]  index     A valid dive index.
+ * @param[in]  filename  The name of the file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_diveindex_save (dc_diveindex_t *index, const char *filename);
+
+/**
+ * Parse all dives in a memory dump.
+ *
+ * The dives are decoded in parallel by a pool of worker threads, each
+ * with its own parser, but the callback is invoked on the calling
+ * thread and in the order of the index, exactly as with
+ * #dc_parser_parse_batch. No device is needed.
+ *
+ * @param[in]  index       A valid dive index.
+ * @param[in]  descriptor  The descriptor of the device.
+ * @param[in]  devtime     The device time of the memory dump.
+ * @param[in]  systime     The system time of the memory dump.
+ * @param[in]  data        The memory dump.
+ * @param[in]  size        The size of the memory dump.
+ * @param[in]  nthreads    The number of worker threads, or zero for the
+ *                         default.
+ * @param[in]  callback    The callback function, invoked once per dive.
+ * @param[in]  userdata    User data passed to the callback function.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_INVALIDARGS if
+ * the memory dump doesn't match the index, or another #dc_status_t
+ * code on failure.
+ */
+dc_status_t
+dc_diveindex_parse (dc_diveindex_t *index, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, const unsigned char data[], unsigned int size, unsigned int nthreads, dc_parser_batch_callback_t callback, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DIVEINDEX_H */
@@ -0,0 +1,101 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DOWNLOAD_H
+#define DC_DOWNLOAD_H
+
+#include "common.h"
+#include "context.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Concurrent download of several dive computers.
+ *
+ * Each session runs on its own thread, with its own context and device,
+ * and delivers its dives and events into one queue shared by all sessions.
+ * The queue is consumed with dc_download_next from a single thread.
+ */
+
+typedef struct dc_download_t dc_download_t;
+
+// Cancel all sessions at once.
+#define DC_DOWNLOAD_ALL 0xFFFFFFFFu
+
+typedef enum dc_download_type_t {
+	DC_DOWNLOAD_DIVE,
+	DC_DOWNLOAD_PROGRESS,
+	DC_DOWNLOAD_DEVINFO,
+	DC_DOWNLOAD_FINISHED
+} dc_download_type_t;
+
+typedef struct dc_download_item_t {
+	dc_download_type_t type;
+	unsigned int index;
+	// DC_DOWNLOAD_DIVE
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	// DC_DOWNLOAD_PROGRESS
+	dc_event_progress_t progress;
+	// DC_DOWNLOAD_DEVINFO
+	dc_event_devinfo_t devinfo;
+	// DC_DOWNLOAD_FINISHED
+	dc_status_t status;
+} dc_download_item_t;
+
+/*
+ * Open the device for a session. The callback runs on the thread of the
+ * session, with a new context owned by the session, which can be
+ * configured (e.g. logging) before opening the device.
+ */
+typedef dc_status_t (*dc_download_open_t) (dc_device_t **device, dc_context_t *context, unsigned int index, void *userdata);
+
+dc_status_t
+dc_download_new (dc_download_t **download, dc_context_t *context, unsigned int count, dc_download_open_t open, void *userdata);
+
+dc_status_t
+dc_download_next (dc_download_t *download, dc_download_item_t *item);
+
+dc_status_t
+dc_download_cancel (dc_download_t *download, unsigned int index);
+
+/*
+ * Limit the number of dives waiting in the queue. When the queue is
+ * full, a session stalls inside its dive callback until the consumer
+ * has taken a dive out, so a slow consumer can't exhaust the memory. A
+ * zero limit (the default) disables the back-pressure. Keep the limit
+ * large enough for devices which time out while the host is idle.
+ */
+dc_status_t
+dc_download_set_limit (dc_download_t *download, unsigned int limit);
+
+dc_status_t
+dc_download_free (dc_download_t *download);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DOWNLOAD_H */
@@ -0,0 +1,116 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_FPSTORE_H
+#define DC_FPSTORE_H
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a set of dive fingerprints.
+ *
+ * The store holds the fingerprints of all dives that were already
+ * downloaded, keyed by the model and serial number of the device. When
+ * attached to a device with #dc_device_set_fpstore, known dives are
+ * skipped during the download, even if they are not the most recent
+ * ones, and newly downloaded dives are added to the store.
+ */
+typedef struct dc_fpstore_t dc_fpstore_t;
+
+/**
+ * Create a new, empty fingerprint store.
+ *
+ * @param[out]  store      A location to store the fingerprint store.
+ * @param[in]   context    A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_fpstore_new (dc_fpstore_t **store, dc_context_t *context);
+
+/**
+ * Destroy the fingerprint store and free all resources.
+ *
+ * @param[in]  store  A valid fingerprint store.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_fpstore_free (dc_fpstore_t *store);
+
+/**
+ * Add the fingerprints stored in a file to the fingerprint store.
+ *
+ * @param[in]  store     A valid fingerprint store.
+ * @param[in]  filename  The name of the file.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_IO if the file
+ * can't be read, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_fpstore_load (dc_fpstore_t *store, const char *filename);
+
+/**
+ * Write all fingerprints to a file, replacing its contents.
+ *
+ * @param[in]  store     A valid fingerprint store.
+ * @param[in]  filename  The name of the file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_fpstore_save (dc_fpstore_t *store, const char *filename);
+
+/**
+ * Add a fingerprint to the fingerprint store.
+ *
+ * @param[in]  store   A valid fingerprint store.
+ * @param[in]  model   The model number of the device.
+ * @param[in]  serial  The serial number of the device.
+ * @param[in]  data    The fingerprint data.
+ * @param[in]  size    The size of the fingerprint data.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_fpstore_add (dc_fpstore_t *store, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size);
+
+/**
+ * Check whether a fingerprint is present in the fingerprint store.
+ *
+ * @param[in]  store   A valid fingerprint store.
+ * @param[in]  model   The model number of the device.
+ * @param[in]  serial  The serial number of the device.
+ * @param[in]  data    The fingerprint data.
+ * @param[in]  size    The size of the fingerprint data.
+ * @returns Non-zero if the fingerprint is present, or zero otherwise.
+ */
+int
+dc_fpstore_contains (dc_fpstore_t *store, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_FPSTORE_H */
@@ -32,6 +32,13 @@ extern "C" {
 
 #define HW_OSTC3_DISPLAY_SIZE    16
 #define HW_OSTC3_CUSTOMTEXT_SIZE 60
+#define HW_OSTC3_CONFIG_SIZE     4
+
+typedef struct hw_ostc3_config_t {
+	unsigned int id;
+	unsigned int size;
+	unsigned char data[HW_OSTC3_CONFIG_SIZE];
+} hw_ostc3_config_t;
 
 dc_status_t
 hw_ostc3_device_version (dc_device_t *device, unsigned char data[], unsigned int size);
@@ -51,6 +58,12 @@ hw_ostc3_device_config_read (dc_device_t *abstract, unsigned int config, unsigne
 dc_status_t
 hw_ostc3_device_config_write (dc_device_t *abstract, unsigned int config, const unsigned char data[], unsigned int size);
 
+dc_status_t
+hw_ostc3_device_config_read_batch (dc_device_t *abstract, hw_ostc3_config_t configs[], unsigned int count);
+
+dc_status_t
+hw_ostc3_device_config_write_batch (dc_device_t *abstract, const hw_ostc3_config_t configs[], unsigned int count);
+
 dc_status_t
 hw_ostc3_device_config_reset (dc_device_t *abstract);
 
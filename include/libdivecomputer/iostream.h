@@ -73,6 +73,14 @@ typedef enum dc_direction_t {
 	DC_DIRECTION_ALL = DC_DIRECTION_INPUT | DC_DIRECTION_OUTPUT /**< All directions */
 } dc_direction_t;
 
+/**
+ * A memory buffer for a gather write.
+ */
+typedef struct dc_iovec_t {
+	const void *data; /**< The memory buffer to write the data from. */
+	size_t size;      /**< The number of bytes to write. */
+} dc_iovec_t;
+
 /**
  * The line signals.
  */
@@ -83,6 +91,31 @@ typedef enum dc_line_t {
 	DC_LINE_RNG = 0x08, /**< Ring indicator */
 } dc_line_t;
 
+/**
+ * The number of bins in the latency histogram.
+ */
+#define DC_IOSTREAM_LATENCY_BINS 12
+
+/**
+ * The transport statistics.
+ *
+ * All times are in milliseconds. The latency is the turnaround time
+ * between the end of a write and the first data received after it. Bin
+ * zero counts the turnarounds below one millisecond, bin i those below
+ * 2^i milliseconds, and the last bin all the longer ones.
+ */
+typedef struct dc_iostream_stats_t {
+	unsigned int nbytes_in;  /**< Number of bytes received */
+	unsigned int nbytes_out; /**< Number of bytes sent */
+	unsigned int nreads;     /**< Number of read calls */
+	unsigned int nwrites;    /**< Number of write calls */
+	unsigned int ntimeouts;  /**< Number of reads that timed out */
+	unsigned int nretries;   /**< Number of packets retried by the backend */
+	unsigned int polltime;   /**< Time blocked waiting for data */
+	unsigned int readtime;   /**< Time blocked in the read calls */
+	unsigned int latency[DC_IOSTREAM_LATENCY_BINS]; /**< Latency histogram */
+} dc_iostream_stats_t;
+
 /**
  * Get the transport type.
  *
@@ -253,6 +286,104 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 dc_status_t
 dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+/**
+ * Write data from several memory buffers to the I/O stream.
+ *
+ * The data is written as if the buffers were concatenated and passed to
+ * a single #dc_iostream_write call. Transports that support it natively
+ * send the data with a single system call. Otherwise small writes are
+ * combined into a single packet, and larger writes are sent one buffer
+ * at a time.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  iov       The memory buffers to write the data from.
+ * @param[in]  count     The number of memory buffers.
+ * @param[out] actual    An (optional) location to store the actual
+ *                       number of bytes transferred.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+
+/**
+ * Completion callback for asynchronous requests.
+ *
+ * @param[in]  iostream  The I/O stream.
+ * @param[in]  status    The status of the request. #DC_STATUS_CANCELLED
+ *                       if the request was cancelled.
+ * @param[in]  actual    The actual number of bytes transferred.
+ * @param[in]  userdata  The user data passed with the request.
+ */
+typedef void (*dc_iostream_callback_t) (dc_iostream_t *iostream, dc_status_t status, size_t actual, void *userdata);
+
+/**
+ * Submit an asynchronous read request.
+ *
+ * The request completes once all the requested bytes have been
+ * received. Requests make progress only inside #dc_iostream_process,
+ * which also invokes the completion callback. At most one read request
+ * can be pending at a time, and the memory buffer must remain valid until
+ * the request has completed.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[out] data      The memory buffer to read the data into.
+ * @param[in]  size      The number of bytes to read.
+ * @param[in]  callback  The completion callback.
+ * @param[in]  userdata  User data passed to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_submit_read (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+/**
+ * Submit an asynchronous write request.
+ *
+ * At most one write request can be pending at a time, and the memory
+ * buffer must remain valid until the request has completed.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  data      The memory buffer to write the data from.
+ * @param[in]  size      The number of bytes to write.
+ * @param[in]  callback  The completion callback.
+ * @param[in]  userdata  User data passed to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_submit_write (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata);
+
+/**
+ * Process the pending asynchronous requests.
+ *
+ * The pending write request is performed first. The pending read request
+ * then waits at most the specified amount of time for incoming data, and
+ * consumes the data that is available without blocking. Transports that
+ * can't wait for incoming data fall back to a blocking read.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  timeout   The timeout in milliseconds (negative for no
+ *                       timeout).
+ * @returns #DC_STATUS_SUCCESS if any progress was made,
+ * #DC_STATUS_TIMEOUT if no data arrived, #DC_STATUS_DONE if no requests
+ * are pending, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_iostream_process (dc_iostream_t *iostream, int timeout);
+
+/**
+ * Cancel the pending asynchronous requests.
+ *
+ * The completion callbacks are invoked with #DC_STATUS_CANCELLED.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_cancel (dc_iostream_t *iostream);
+
 /**
  * Perform an I/O stream specific request.
  *
@@ -300,6 +431,48 @@ dc_iostream_purge (dc_iostream_t *iostream, dc_direction_t direction);
 dc_status_t
 dc_iostream_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 
+/**
+ * Interrupt a blocking operation on the I/O stream.
+ *
+ * The blocked read, write or poll operation returns #DC_STATUS_CANCELLED
+ * immediately, without waiting for the timeout to expire. If no
+ * operation is blocked, the next one returns #DC_STATUS_CANCELLED
+ * instead. This function can be called from another thread, to abort a
+ * download without delay, typically together with the cancellation
+ * callback of the device.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if the
+ * I/O stream can't be interrupted, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_iostream_interrupt (dc_iostream_t *iostream);
+
+/**
+ * Get the transport statistics.
+ *
+ * The statistics are collected for all I/O streams, from the moment the
+ * stream is opened, or since the last reset.
+ *
+ * @param[in]   iostream  A valid I/O stream.
+ * @param[out]  stats     A location to store the statistics.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_get_stats (dc_iostream_t *iostream, dc_iostream_stats_t *stats);
+
+/**
+ * Reset the transport statistics.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_reset_stats (dc_iostream_t *iostream);
+
 /**
  * Close the I/O stream and free all resources.
  *
@@ -32,6 +32,18 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * IrDA scan flags.
+ *
+ * DC_IRDA_SCAN_CACHED: Return the devices found by the previous
+ * discovery on the same context, instead of starting a new discovery.
+ * A new discovery is only done if no devices are known yet.
+ */
+typedef enum dc_irda_scan_t {
+	DC_IRDA_SCAN_NONE = 0,
+	DC_IRDA_SCAN_CACHED = (1 << 0),
+} dc_irda_scan_t;
+
 /**
  * Opaque object representing an IrDA device.
  */
@@ -73,13 +85,29 @@ dc_irda_device_free (dc_irda_device_t *device);
 dc_status_t
 dc_irda_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor);
 
+/**
+ * Create an iterator to enumerate the IrDA devices, with control over
+ * the discovery.
+ *
+ * @param[out] iterator    A location to store the iterator.
+ * @param[in]  context     A valid context object.
+ * @param[in]  descriptor  A valid device descriptor or NULL.
+ * @param[in]  flags       A bitmask of #dc_irda_scan_t values.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_irda_iterator_new2 (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int flags);
+
 /**
  * Open an IrDA connection.
  *
  * @param[out]  iostream A location to store the IrDA connection.
  * @param[in]   context  A valid context object.
  * @param[in]   address  The IrDA device address.
- * @param[in]   lsap     The IrDA LSAP number.
+ * @param[in]   lsap     The IrDA LSAP number, or zero to use the LSAP
+ *                       number of the previous connection to the same
+ *                       device on this context.
  * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
  * on failure.
  */
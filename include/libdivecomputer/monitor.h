@@ -0,0 +1,124 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_MONITOR_H
+#define DC_MONITOR_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a device monitor.
+ *
+ * The monitor keeps a cached list of the connected serial, USB and USB
+ * HID devices, and reports when devices are added or removed. Instead
+ * of enumerating everything on every call, a transport is only scanned
+ * again after the operating system signals a change: libusb hotplug
+ * events for USB and USB HID, and inotify on the device directory for
+ * serial ports. Without those, the transport is scanned on every update.
+ *
+ * Bluetooth and BLE devices are not monitored. A bluetooth inquiry
+ * takes several seconds, and BLE scanning is done by the application.
+ */
+typedef struct dc_monitor_t dc_monitor_t;
+
+/**
+ * Monitor event types.
+ */
+typedef enum dc_monitor_event_t {
+	DC_MONITOR_EVENT_ADDED,   /**< The device was connected */
+	DC_MONITOR_EVENT_REMOVED, /**< The device was disconnected */
+} dc_monitor_event_t;
+
+/**
+ * Monitor callback function.
+ *
+ * The device is a #dc_serial_device_t, #dc_usb_device_t or
+ * #dc_usbhid_device_t, depending on the transport. It is owned by the
+ * monitor, and remains valid until the callback for its removal has
+ * returned. The descriptor is the one the device was matched against
+ * when it was added, and may be NULL for serial ports. The monitor
+ * itself must not be used from within the callback.
+ *
+ * @param[in]  event       The type of the event.
+ * @param[in]  transport   The transport of the device.
+ * @param[in]  device      The device.
+ * @param[in]  descriptor  The matching descriptor, or NULL.
+ * @param[in]  userdata    The user data passed to #dc_monitor_new.
+ */
+typedef void (*dc_monitor_callback_t) (dc_monitor_event_t event, dc_transport_t transport, void *device, dc_descriptor_t *descriptor, void *userdata);
+
+/**
+ * Create a new device monitor.
+ *
+ * With a descriptor, only the devices accepted by that descriptor are
+ * reported, exactly as with the iterators. Without a descriptor, the
+ * USB and USB HID devices are matched against the list of supported
+ * devices, once when they are connected, and unknown devices are not
+ * reported. Serial ports can't be matched, and are always reported.
+ *
+ * @param[out]  monitor     A location to store the device monitor.
+ * @param[in]   context     A valid context object.
+ * @param[in]   descriptor  A valid device descriptor or NULL.
+ * @param[in]   transports  The transports to monitor.
+ * @param[in]   callback    The callback function.
+ * @param[in]   userdata    User data passed to the callback function.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_monitor_new (dc_monitor_t **monitor, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int transports, dc_monitor_callback_t callback, void *userdata);
+
+/**
+ * Process the pending changes, and invoke the callback for every device
+ * that was added or removed since the previous update. The first update
+ * reports all connected devices.
+ *
+ * This function doesn't block, and is meant to be called periodically,
+ * for example from the main loop of the application.
+ *
+ * @param[in]  monitor  A valid device monitor.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_monitor_update (dc_monitor_t *monitor);
+
+/**
+ * Destroy the device monitor and free all resources. No events are
+ * reported for the devices that are still connected.
+ *
+ * @param[in]  monitor  A valid device monitor.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_monitor_free (dc_monitor_t *monitor);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_MONITOR_H */
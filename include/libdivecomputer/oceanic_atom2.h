@@ -35,6 +35,24 @@ oceanic_atom2_device_version (dc_device_t *device, unsigned char data[], unsigne
 dc_status_t
 oceanic_atom2_device_keepalive (dc_device_t *device);
 
+/*
+ * Number of pages per read request (1, 8 or 16).
+ *
+ * The default value is based on the model. The probe tries the larger
+ * read commands and keeps the largest one that works, and the reads fall
+ * back to smaller pages automatically on failures. Applications can save
+ * the resulting value per model, and restore it in later sessions to skip
+ * the probe.
+ */
+dc_status_t
+oceanic_atom2_device_get_bigpage (dc_device_t *device, unsigned int *value);
+
+dc_status_t
+oceanic_atom2_device_set_bigpage (dc_device_t *device, unsigned int value);
+
+dc_status_t
+oceanic_atom2_device_probe_bigpage (dc_device_t *device);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,118 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PACING_H
+#define DC_PACING_H
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a cache of learned inter-packet delays.
+ *
+ * Some backends wait a fixed amount of time before every command, tuned
+ * for the slowest hardware. When a cache is attached to a device with
+ * #dc_device_set_pacing, those delays are shortened gradually while the
+ * device keeps responding correctly, and the tuned values are stored in
+ * the cache, keyed by the family and model of the device, so that the
+ * next session can start from them.
+ */
+typedef struct dc_pacing_t dc_pacing_t;
+
+/**
+ * Create a new, empty pacing cache.
+ *
+ * @param[out]  pacing     A location to store the pacing cache.
+ * @param[in]   context    A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pacing_new (dc_pacing_t **pacing, dc_context_t *context);
+
+/**
+ * Destroy the pacing cache and free all resources.
+ *
+ * @param[in]  pacing  A valid pacing cache.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pacing_free (dc_pacing_t *pacing);
+
+/**
+ * Add the delays stored in a file to the pacing cache.
+ *
+ * @param[in]  pacing    A valid pacing cache.
+ * @param[in]  filename  The name of the file.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_IO if the file
+ * can't be read, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_pacing_load (dc_pacing_t *pacing, const char *filename);
+
+/**
+ * Write all delays to a file, replacing its contents.
+ *
+ * @param[in]  pacing    A valid pacing cache.
+ * @param[in]  filename  The name of the file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pacing_save (dc_pacing_t *pacing, const char *filename);
+
+/**
+ * Store a delay in the pacing cache.
+ *
+ * @param[in]  pacing  A valid pacing cache.
+ * @param[in]  family  The family type of the device.
+ * @param[in]  model   The model number of the device.
+ * @param[in]  id      The backend specific identifier of the delay.
+ * @param[in]  delay   The delay (in milliseconds).
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_pacing_set (dc_pacing_t *pacing, dc_family_t family, unsigned int model, unsigned int id, unsigned int delay);
+
+/**
+ * Look up a delay in the pacing cache.
+ *
+ * @param[in]   pacing  A valid pacing cache.
+ * @param[in]   family  The family type of the device.
+ * @param[in]   model   The model number of the device.
+ * @param[in]   id      The backend specific identifier of the delay.
+ * @param[out]  delay   A location to store the delay (in milliseconds).
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the delay is not present, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_pacing_get (dc_pacing_t *pacing, dc_family_t family, unsigned int model, unsigned int id, unsigned int *delay);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PACING_H */
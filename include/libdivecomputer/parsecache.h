@@ -0,0 +1,92 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PARSECACHE_H
+#define DC_PARSECACHE_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a cache of parsed dives.
+ *
+ * The cache holds the result of parsing a dive (the date and time, the
+ * header fields, the strings and the samples) in a compact serialized
+ * form, keyed by the family and model of the parser and a hash of the
+ * dive data. When attached to a parser with #dc_parser_set_cache,
+ * parsing the same dive again replays the result from the cache,
+ * instead of running the backend decoder. A cache can be shared by
+ * multiple parsers, also from different threads.
+ */
+typedef struct dc_parsecache_t dc_parsecache_t;
+
+/**
+ * Create a new, empty cache in memory.
+ *
+ * When the total size of the entries exceeds the capacity, the least
+ * recently used entries are evicted.
+ *
+ * @param[out]  cache     A location to store the cache.
+ * @param[in]   context   A valid context object.
+ * @param[in]   capacity  The maximum size of the cache (in bytes).
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parsecache_new (dc_parsecache_t **cache, dc_context_t *context, size_t capacity);
+
+/**
+ * Open a cache in a directory on disk.
+ *
+ * Every entry is stored in a separate file, which persists between
+ * sessions. The directory must already exist. Entries are never
+ * evicted.
+ *
+ * @param[out]  cache     A location to store the cache.
+ * @param[in]   context   A valid context object.
+ * @param[in]   dirname   The name of the directory.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parsecache_open (dc_parsecache_t **cache, dc_context_t *context, const char *dirname);
+
+/**
+ * Destroy the cache and free all resources. The entries on disk are
+ * kept.
+ *
+ * @param[in]  cache  A valid cache.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_parsecache_free (dc_parsecache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PARSECACHE_H */
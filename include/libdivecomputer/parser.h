@@ -27,6 +27,7 @@
 #include "descriptor.h"
 #include "device.h"
 #include "datetime.h"
+#include "parsecache.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -68,10 +69,19 @@ typedef enum dc_field_type_t {
 	DC_FIELD_TANK,
 	DC_FIELD_DIVEMODE,
 	DC_FIELD_STRING,
+	DC_FIELD_ASCENT_RATE,
+	DC_FIELD_DESCENT_RATE,
+	DC_FIELD_TEMPERATURE_AVERAGE,
+	DC_FIELD_TIME_BELOW,
+	DC_FIELD_CONSUMPTION,
+	DC_FIELD_SAMPLE_COUNT,
+	DC_FIELD_SAMPLE_CAPACITY,
 } dc_field_type_t;
 
 // Make it easy to test support compile-time with "#ifdef DC_FIELD_STRING"
 #define DC_FIELD_STRING DC_FIELD_STRING
+#define DC_FIELD_CONSUMPTION DC_FIELD_CONSUMPTION
+#define DC_FIELD_SAMPLE_COUNT DC_FIELD_SAMPLE_COUNT
 
 typedef enum parser_sample_event_t {
 	SAMPLE_EVENT_NONE,
@@ -262,22 +272,399 @@ typedef union dc_sample_value_t {
 	unsigned int gasmix; /* Gas mix index */
 } dc_sample_value_t;
 
+/*
+ * Fixed-point sample value.
+ *
+ * The same samples as dc_sample_value_t, with all quantities as exactly
+ * rounded integers: the depths in millimeter, the temperature in 1/100
+ * degrees Celsius, the pressures, setpoint and ppO2 in millibar, and the
+ * CNS in 1/100 percent. The other members are identical.
+ */
+typedef union dc_sample_fixed_t {
+	unsigned int time;
+	int depth;
+	struct {
+		unsigned int tank;
+		int value;
+	} pressure;
+	int temperature;
+	struct {
+		unsigned int type;
+		unsigned int time;
+		unsigned int flags;
+		unsigned int value;
+		const char *name;
+	} event;
+	unsigned int rbt;
+	unsigned int heartbeat;
+	unsigned int bearing;
+	struct {
+		unsigned int type;
+		unsigned int size;
+		const void *data;
+	} vendor;
+	int setpoint;
+	int ppo2;
+	int cns;
+	struct {
+		unsigned int type;
+		unsigned int time;
+		int depth;
+	} deco;
+	unsigned int gasmix; /* Gas mix index */
+} dc_sample_fixed_t;
+
+/*
+ * Parser flags.
+ *
+ * DC_PARSER_FLAG_SUMMARY: Only return values which are available at the
+ * cost of parsing the header. Fields which can only be obtained by
+ * decoding the entire profile fail with DC_STATUS_FULLSCAN, instead of
+ * silently scanning all the samples.
+ *
+ * DC_PARSER_FLAG_CACHE: Keep a copy of the decoded samples after the
+ * first walk over the profile. Subsequent calls to get_field and
+ * samples_foreach on the same data replay the samples from memory,
+ * instead of decoding the profile again.
+ *
+ * DC_PARSER_FLAG_STATISTICS: Accumulate the derived dive statistics
+ * while samples_foreach walks the profile, so the DC_FIELD_ASCENT_RATE,
+ * DC_FIELD_DESCENT_RATE, DC_FIELD_TEMPERATURE_AVERAGE,
+ * DC_FIELD_TIME_BELOW and DC_FIELD_CONSUMPTION fields are available
+ * afterwards without a second pass over the samples. Without the flag,
+ * these fields are calculated on request.
+ *
+ * The rates are the maximum ascent and descent rates in meters per
+ * minute. DC_FIELD_TIME_BELOW returns the number of seconds spent
+ * deeper than the depth in meters passed in the flags argument.
+ * DC_FIELD_CONSUMPTION returns the surface consumption rate in bar
+ * per minute of the tank passed in the flags argument.
+ *
+ * DC_FIELD_SAMPLE_COUNT returns the number of samples (DC_SAMPLE_TIME)
+ * in the profile, and DC_FIELD_SAMPLE_CAPACITY an upper bound for it.
+ * Both are counted before the sample mask and the decimation are
+ * applied, so they are sufficient to preallocate the storage for a
+ * single pass over the samples. The backends obtain them from the
+ * header or the size of the profile where possible. In summary mode,
+ * the generic fallback fails with DC_STATUS_FULLSCAN.
+ *
+ * DC_PARSER_FLAG_COUNTERS: Collect the counters of the parser statistics
+ * which have a cost for every sample value. The number of values per
+ * sample type, the time spent in the backend and the allocations made
+ * are only available with the flag.
+ *
+ * DC_PARSER_FLAG_NOVENDOR: Never report DC_SAMPLE_VENDOR samples. The
+ * backends skip building the vendor payloads entirely, also when the
+ * samples are recorded in the sample cache. Without the flag, the
+ * vendor data always points into the buffer passed to
+ * dc_parser_set_data, and remains valid as long as that buffer.
+ *
+ * DC_PARSER_FLAG_TRUSTED: The data passed to dc_parser_set_data was
+ * already verified, for example when it was downloaded, and is known
+ * to be intact. The backends skip recomputing the checksums embedded
+ * in the data. The bounds checks are always done, so corrupt data can
+ * still produce wrong values, but never reads outside the buffer.
+ */
+typedef enum dc_parser_flags_t {
+	DC_PARSER_FLAG_NONE = 0,
+	DC_PARSER_FLAG_SUMMARY = (1 << 0),
+	DC_PARSER_FLAG_CACHE = (1 << 1),
+	DC_PARSER_FLAG_STATISTICS = (1 << 2),
+	DC_PARSER_FLAG_NOVENDOR = (1 << 3),
+	DC_PARSER_FLAG_COUNTERS = (1 << 4),
+	DC_PARSER_FLAG_TRUSTED = (1 << 5),
+} dc_parser_flags_t;
+
+/*
+ * The number of sample types counted in the parser statistics.
+ */
+#define DC_PARSER_STATS_TYPES 32
+
+/*
+ * The parser statistics.
+ *
+ * The counters accumulate over all the dives assigned to the parser,
+ * until they are reset. The sample values are counted as decoded by the
+ * backend, before the sample mask and the decimation are applied, and
+ * include the walks over the profile to obtain the header fields. The
+ * time (in microseconds) covers the backend only, and the allocations
+ * are those made through the context in the meantime, which includes
+ * the allocations of other threads sharing the context.
+ */
+typedef struct dc_parser_stats_t {
+	unsigned int ndives;    /* Number of dives assigned */
+	unsigned int nbytes;    /* Number of bytes of dive data */
+	unsigned int nwalks;    /* Number of passes over the profile */
+	unsigned int nskipped;  /* Number of unknown or skipped records */
+	unsigned int nsamples[DC_PARSER_STATS_TYPES]; /* Number of values per sample type */
+	unsigned int nallocs;   /* Number of allocations */
+	unsigned int allocated; /* Number of bytes allocated */
+	unsigned int time;      /* Time spent in the backend */
+} dc_parser_stats_t;
+
+/*
+ * Sample type mask.
+ *
+ * Selects the sample types reported by dc_parser_samples_foreach. The
+ * backends use the mask to skip decoding the sample types which are
+ * not requested, instead of only suppressing the callback. The
+ * DC_SAMPLE_TIME samples are always reported, because they delimit
+ * the individual samples.
+ */
+#define DC_SAMPLE_MASK(type) (1u << (type))
+#define DC_SAMPLE_MASK_ALL (~0u)
+
+/*
+ * Sample decimation.
+ *
+ * Reduces the number of samples reported by dc_parser_samples_foreach,
+ * for example for thumbnails and previews. The profile is divided into
+ * buckets of interval seconds, or wider if needed to stay within
+ * maxpoints samples. Each bucket reports the samples with the minimum
+ * and the maximum depth, so the extremes of the profile are preserved.
+ * The events and gas switches of the other samples in the bucket are
+ * reported together with the first sample of the bucket. A zero value
+ * disables the corresponding limit.
+ */
+
+/*
+ * Sample change mask.
+ *
+ * Selects the sample types which are only reported when their value
+ * differs from the previous one, for example the temperature, the
+ * decompression status or the setpoint, which change only slowly.
+ * The pressures are compared per tank, and a type reported several
+ * times per sample is compared with the value at the same position in
+ * the previous sample. A suppressed value which is never followed by a
+ * different one is reported once more at the end of the profile,
+ * together with the last sample, so the final value is always known.
+ * The DC_SAMPLE_TIME, DC_SAMPLE_EVENT and DC_SAMPLE_VENDOR samples are
+ * never suppressed.
+ */
+
+/*
+ * Resource limits.
+ *
+ * Protects the application against malformed dive data, which could
+ * otherwise keep a parser busy for a long time, or make it allocate an
+ * excessive amount of memory. The maxsamples value limits the number
+ * of samples (DC_SAMPLE_TIME) reported for a single pass over the
+ * profile, maxmemory the number of bytes allocated by the parser for
+ * a single dive, and timeout the time (in milliseconds) spent on a
+ * dive, counted from the dc_parser_set_data call. Once a limit is
+ * exceeded, the parser stops as soon as possible, and all functions
+ * fail with DC_STATUS_LIMIT until new data is set. A zero value
+ * disables the corresponding limit.
+ */
+
 typedef struct dc_parser_t dc_parser_t;
 
 typedef void (*dc_sample_callback_t) (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+/*
+ * Sample callback receiving the value by reference, which avoids
+ * copying the entire value union for every sample. The value is only
+ * valid for the duration of the callback.
+ */
+typedef void (*dc_sample_callback2_t) (dc_sample_type_t type, const dc_sample_value_t *value, void *userdata);
+
+/*
+ * Sample callback receiving the fixed-point values.
+ */
+typedef void (*dc_sample_fixed_callback_t) (dc_sample_type_t type, const dc_sample_fixed_t *value, void *userdata);
+
+/*
+ * A sample consumer for dc_parser_samples_fanout, with its own sample
+ * type mask (see DC_SAMPLE_MASK).
+ */
+typedef struct dc_sample_consumer_t {
+	unsigned int mask;
+	dc_sample_callback2_t callback;
+	void *userdata;
+} dc_sample_consumer_t;
+
+/*
+ * A single sample value, with its type, for dc_parser_samples_foreach_chunk.
+ */
+typedef struct dc_sample_record_t {
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} dc_sample_record_t;
+
+/*
+ * Chunk callback receiving a number of consecutive sample values. The
+ * values are only valid for the duration of the callback.
+ */
+typedef void (*dc_sample_chunk_callback_t) (const dc_sample_record_t records[], unsigned int count, void *userdata);
+
+/*
+ * Columnar (struct-of-arrays) sample output.
+ *
+ * All arrays are provided by the caller, and can be NULL if the column
+ * isn't needed. The time, depth, temperature and ppo2 arrays hold
+ * capacity elements, the pressure array holds ntanks * capacity
+ * elements, with the values of tank i starting at pressure[i * capacity].
+ * Each DC_SAMPLE_TIME value starts a new row, and values which are not
+ * present in a row are set to NAN. Events are stored in a separate
+ * sparse list, with a reference to the row they belong to.
+ *
+ * On return, count and nevents contain the total number of rows and
+ * events in the dive. If they exceed the capacity, only the first
+ * capacity entries are stored, and the caller can retry with larger
+ * arrays.
+ */
+typedef struct dc_sample_event_entry_t {
+	unsigned int row;
+	unsigned int type;
+	unsigned int time;
+	unsigned int flags;
+	unsigned int value;
+} dc_sample_event_entry_t;
+
+typedef struct dc_sample_columns_t {
+	unsigned int capacity;
+	unsigned int count;
+	unsigned int *time;
+	double *depth;
+	double *temperature;
+	double *ppo2;
+	unsigned int ntanks;
+	double *pressure;
+	unsigned int events_capacity;
+	unsigned int nevents;
+	dc_sample_event_entry_t *events;
+} dc_sample_columns_t;
+
+/*
+ * A single dive blob for the batch parsing interface.
+ */
+typedef struct dc_parser_blob_t {
+	const unsigned char *data;
+	unsigned int size;
+} dc_parser_blob_t;
+
+/*
+ * Invoked once per blob, after the data has been assigned to the
+ * parser. The status is the result of dc_parser_set_data. The parser
+ * can be queried with the regular dc_parser_get_* and samples_foreach
+ * functions, but only for the duration of the callback. Return zero to
+ * stop the iteration.
+ */
+typedef int (*dc_parser_batch_callback_t) (dc_parser_t *parser, unsigned int index, dc_status_t status, void *userdata);
+
+/*
+ * A candidate family for a dive blob, with a score between 1 (barely
+ * plausible) and 100 (signature and size invariants all match).
+ */
+typedef struct dc_parser_candidate_t {
+	dc_family_t family;
+	unsigned int score;
+} dc_parser_candidate_t;
+
+/*
+ * Thread safety.
+ *
+ * A parser must not be used from more than one thread at the same
+ * time. Different parsers can be used concurrently, also for the same
+ * family and with a shared context. The state shared by the parsers of
+ * a family, such as the lookup tables derived from the static tables
+ * of the backend, is built only once per process, and is read-only
+ * afterwards, or protected internally. Creating a parser per thread is
+ * therefore cheap, and doesn't repeat any of that setup.
+ */
+
 dc_status_t
 dc_parser_new (dc_parser_t **parser, dc_device_t *device);
 
 dc_status_t
 dc_parser_new2 (dc_parser_t **parser, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime);
 
+/*
+ * Create a copy of a parser, including the configuration, the cached
+ * header fields and the decoded sample cache. The dive data is shared
+ * instead of copied, so the clone can iterate the samples without
+ * parsing the dive again. The clone must be destroyed before the data
+ * of the original parser is released or replaced, including the data
+ * decompressed or appended by the original parser. The clone and the
+ * original can then be used from different threads.
+ */
+dc_status_t
+dc_parser_clone (dc_parser_t **clone, dc_parser_t *parser);
+
+/*
+ * Guess the family of a dive blob from the header signatures and the
+ * size invariants of the data formats, without creating a parser. On
+ * input, the count is the capacity of the candidates array. On output,
+ * it is the number of candidates stored, ranked by decreasing score.
+ * Only the families with a recognizable format are probed.
+ */
+dc_status_t
+dc_parser_probe (const unsigned char data[], unsigned int size, dc_parser_candidate_t candidates[], unsigned int *count);
+
 dc_family_t
 dc_parser_get_type (dc_parser_t *parser);
 
+dc_status_t
+dc_parser_set_flags (dc_parser_t *parser, unsigned int flags);
+
+dc_status_t
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask);
+
+dc_status_t
+dc_parser_set_change_mask (dc_parser_t *parser, unsigned int mask);
+
+dc_status_t
+dc_parser_set_decimation (dc_parser_t *parser, unsigned int interval, unsigned int maxpoints);
+
+dc_status_t
+dc_parser_set_limits (dc_parser_t *parser, unsigned int maxsamples, unsigned int maxmemory, unsigned int timeout);
+
+/*
+ * Attach a cache of parsed dives, or detach it by passing NULL. The
+ * cache is consulted by dc_parser_set_data. On a miss, the dive is
+ * parsed completely and the result is stored in the cache. On a hit,
+ * the cached result is replayed, and the backend decoder isn't used at
+ * all. The cache must remain valid until it is detached.
+ */
+dc_status_t
+dc_parser_set_cache (dc_parser_t *parser, dc_parsecache_t *cache);
+
 dc_status_t
 dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
 
+/*
+ * Assign a dive blob compressed with dc_codec_compress. The blob is
+ * decoded into a buffer owned by the parser, which is re-used for the
+ * next dive, and remains valid until the data is replaced or the
+ * parser is destroyed.
+ */
+dc_status_t
+dc_parser_set_data_compressed (dc_parser_t *parser, const unsigned char *data, unsigned int size);
+
+/*
+ * Append a chunk of dive data, for dives which are received in pieces
+ * (e.g. for progressive display during the download). The chunks are
+ * collected in a buffer owned by the parser, and the header fields are
+ * always those of all the data received so far. Each samples_foreach
+ * call only returns the samples which were not returned before, so the
+ * application can simply add them to the partial profile.
+ *
+ * The first call after dc_parser_set_data starts a new dive. This is
+ * only meaningful for formats where the samples are appended to the
+ * end of the data, and without decimation.
+ */
+dc_status_t
+dc_parser_append_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
+
+/*
+ * Re-use an existing parser for a dive downloaded in another session.
+ * The clock reference is replaced and the data is assigned, exactly as
+ * with dc_parser_set_data. The family, model and serial number of the
+ * parser remain unchanged.
+ */
+dc_status_t
+dc_parser_reset (dc_parser_t *parser, unsigned int devtime, dc_ticks_t systime, const unsigned char *data, unsigned int size);
+
 dc_status_t
 dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime);
 
@@ -287,9 +674,67 @@ dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int fla
 dc_status_t
 dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+dc_status_t
+dc_parser_samples_foreach2 (dc_parser_t *parser, dc_sample_callback2_t callback, void *userdata);
+
+/*
+ * Report the samples as fixed-point values, with the sample mask and the
+ * decimation of the parser applied, exactly like dc_parser_samples_foreach2.
+ */
+dc_status_t
+dc_parser_samples_foreach_fixed (dc_parser_t *parser, dc_sample_fixed_callback_t callback, void *userdata);
+
+/*
+ * Report the samples in chunks, with the sample mask and the decimation
+ * of the parser applied, exactly like dc_parser_samples_foreach2. The
+ * values are collected in the records array, provided by the caller,
+ * and the callback is invoked each time the array is full, and once
+ * more for the remaining values at the end. A chunk always ends at a
+ * sample boundary (the next DC_SAMPLE_TIME value), unless a single
+ * sample has more values than the capacity of the array.
+ */
+dc_status_t
+dc_parser_samples_foreach_chunk (dc_parser_t *parser, dc_sample_record_t records[], unsigned int capacity, dc_sample_chunk_callback_t callback, void *userdata);
+
+/*
+ * Report the samples to several consumers, from a single pass over the
+ * profile. Every consumer receives the sample types selected by its own
+ * mask, in the same order as with dc_parser_samples_foreach2, while the
+ * backend only decodes the union of the masks. The sample mask of the
+ * parser is not used, but the decimation applies to all consumers. The
+ * samples of the entire profile are always reported, also for a parser
+ * which receives its data with dc_parser_append_data.
+ */
+dc_status_t
+dc_parser_samples_fanout (dc_parser_t *parser, const dc_sample_consumer_t consumers[], unsigned int count);
+
+dc_status_t
+dc_parser_samples_foreach_range (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata);
+
+dc_status_t
+dc_parser_samples_columns (dc_parser_t *parser, dc_sample_columns_t *columns);
+
+dc_status_t
+dc_parser_get_stats (dc_parser_t *parser, dc_parser_stats_t *stats);
+
+dc_status_t
+dc_parser_reset_stats (dc_parser_t *parser);
+
 dc_status_t
 dc_parser_destroy (dc_parser_t *parser);
 
+dc_status_t
+dc_parser_parse_batch (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, const dc_parser_blob_t blobs[], unsigned int count, dc_parser_batch_callback_t callback, void *userdata);
+
+/*
+ * Same as dc_parser_parse_batch, but the dives are decoded by a pool of
+ * worker threads, each with its own parser. The callback is still
+ * invoked on the calling thread, and in the order of the blobs. Pass
+ * zero for the number of threads to use the default.
+ */
+dc_status_t
+dc_parser_parse_parallel (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, const dc_parser_blob_t blobs[], unsigned int count, unsigned int nthreads, dc_parser_batch_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
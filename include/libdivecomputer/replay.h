@@ -0,0 +1,72 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_REPLAY_H
+#define DC_REPLAY_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Create a recording I/O stream.
+ *
+ * All operations are forwarded to the underlying I/O stream, and logged
+ * together with their timing to a binary file, which can be replayed
+ * with #dc_replay_open afterwards. Closing the recording I/O stream also
+ * closes the underlying I/O stream.
+ *
+ * @param[out]  iostream   A location to store the recording I/O stream.
+ * @param[in]   context    A valid context object.
+ * @param[in]   base       The underlying I/O stream.
+ * @param[in]   filename   The name of the file to record to.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_record_open (dc_iostream_t **iostream, dc_context_t *context, dc_iostream_t *base, const char *filename);
+
+/**
+ * Create a replaying I/O stream.
+ *
+ * Serves all operations from a file created with #dc_record_open. The
+ * operations are expected in the same order as they were recorded. Any
+ * deviation fails with #DC_STATUS_PROTOCOL.
+ *
+ * @param[out]  iostream   A location to store the replaying I/O stream.
+ * @param[in]   context    A valid context object.
+ * @param[in]   filename   The name of the file to replay.
+ * @param[in]   realtime   Reproduce the recorded timing (non-zero), or
+ *                         run at full speed (zero).
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_replay_open (dc_iostream_t **iostream, dc_context_t *context, const char *filename, unsigned int realtime);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_REPLAY_H */
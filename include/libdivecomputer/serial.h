@@ -88,6 +88,20 @@ dc_serial_open (dc_iostream_t **iostream, dc_context_t *context, const char *nam
  */
 #define DC_IOCTL_SERIAL_SET_LATENCY DC_IOCTL_IOW('s', 0, sizeof(unsigned int))
 
+/**
+ * Enable or disable the low latency mode.
+ *
+ * When enabled, the receive latency is set to the lowest value, and the
+ * USB serial adapter is tuned as well. On Linux, the latency timer of
+ * FTDI adapters (16 ms by default) is lowered to 1 ms through sysfs,
+ * which requires write access to the sysfs attribute. CP210x and PL2303
+ * adapters have no latency timer, and only get the low latency flag.
+ * The original settings are restored when the mode is disabled again,
+ * or when the serial port is closed. On Windows the mode is not
+ * supported.
+ */
+#define DC_IOCTL_SERIAL_SET_LOW_LATENCY DC_IOCTL_IOW('s', 1, sizeof(unsigned int))
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
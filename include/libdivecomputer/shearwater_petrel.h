@@ -0,0 +1,47 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2013 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SHEARWATER_PETREL_H
+#define DC_SHEARWATER_PETREL_H
+
+#include "common.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Count the new dives without downloading them.
+ *
+ * Only the manifest pages are read, up to the dive matching the
+ * fingerprint. Dives marked as deleted, or already present in the
+ * fingerprint store, are not counted. The manifest is kept for the
+ * next dc_device_foreach call, which then starts downloading the
+ * dives immediately. Changing the fingerprint discards it.
+ */
+dc_status_t
+shearwater_petrel_device_count (dc_device_t *device, unsigned int *count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SHEARWATER_PETREL_H */
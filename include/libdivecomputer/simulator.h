@@ -0,0 +1,89 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SIMULATOR_H
+#define DC_SIMULATOR_H
+
+#include "common.h"
+#include "context.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Link conditions of a simulated device.
+ */
+typedef struct dc_simulator_link_t {
+	dc_transport_t transport; /**< Transport type, or #DC_TRANSPORT_NONE for the default */
+	unsigned int latency;     /**< One way delay (microseconds) */
+	unsigned int bandwidth;   /**< Throughput (bytes per second), or zero for unlimited */
+	unsigned int loss;        /**< Probability to lose a packet (parts per million) */
+	unsigned int seed;        /**< Seed for the packet loss */
+} dc_simulator_link_t;
+
+/**
+ * Create a simulated device.
+ *
+ * The I/O stream emulates the protocol of a dive computer, with the
+ * timing of the link conditions. The answers are served from the
+ * supplied contents, which depend on the family:
+ *
+ * - #DC_FAMILY_SUUNTO_VYPER2 and #DC_FAMILY_SUUNTO_D9: the 4 byte
+ *   version, followed by the memory image.
+ * - #DC_FAMILY_OCEANIC_ATOM2: the 16 byte version page, followed by
+ *   the memory image.
+ * - All other families: a list of records. Each record starts with a
+ *   4 byte key and a 4 byte size (little endian), followed by the
+ *   payload. For #DC_FAMILY_SHEARWATER_PREDATOR and
+ *   #DC_FAMILY_SHEARWATER_PETREL, keys below 0x10000 are identifiers,
+ *   and all other keys are the start address of a memory area. For
+ *   #DC_FAMILY_HW_OSTC3, key 0 is the hardware descriptor, key 1 the
+ *   version information, and key 0x100 + n the dive in logbook slot n.
+ *   For #DC_FAMILY_SUUNTO_EONSTEEL, key 0 is the version information,
+ *   and all other keys are the timestamp of a dive file.
+ *
+ * The contents are copied and may be freed after the call. Commands
+ * which modify the device (e.g. memory writes) only change the copy.
+ *
+ * Every answer is sent as a single packet, which is lost as a whole.
+ * The host notices a lost packet by a timeout, exactly like with a
+ * real device.
+ *
+ * @param[out]  iostream   A location to store the simulated device.
+ * @param[in]   context    A valid context object.
+ * @param[in]   family     The device family.
+ * @param[in]   data       The contents of the simulated device.
+ * @param[in]   size       The size of the contents.
+ * @param[in]   link       The link conditions, or NULL for a perfect
+ *                         link.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the family or transport is not supported, or another #dc_status_t
+ * code on failure.
+ */
+dc_status_t
+dc_simulator_open (dc_iostream_t **iostream, dc_context_t *context, dc_family_t family, const unsigned char data[], size_t size, const dc_simulator_link_t *link);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SIMULATOR_H */
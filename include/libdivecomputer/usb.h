@@ -47,6 +47,20 @@ extern "C" {
 #define DC_IOCTL_USB_CONTROL_READ  DC_IOCTL_IOR('u', 0, DC_IOCTL_SIZE_VARIABLE)
 #define DC_IOCTL_USB_CONTROL_WRITE DC_IOCTL_IOW('u', 0, DC_IOCTL_SIZE_VARIABLE)
 
+/**
+ * Set the number of asynchronous transfers kept queued on the bulk IN
+ * endpoint, or zero to use synchronous transfers (the default).
+ *
+ * The incoming data is received directly into the buffers of the queued
+ * transfers, and served to the next reads. This keeps the endpoint busy
+ * between two read calls, and the download runs at the transfer rate of
+ * the bus instead of the round-trip rate. A read combines consecutive
+ * transfers only as long as they are completely filled, so a short
+ * packet still ends the read. The value is limited to a small maximum.
+ * Changing the setting discards any buffered data.
+ */
+#define DC_IOCTL_USB_SET_QUEUE DC_IOCTL_IOW('u', 1, sizeof(unsigned int))
+
 /**
  * USB control transfer.
  */
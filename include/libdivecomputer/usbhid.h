@@ -27,11 +27,25 @@
 #include "iostream.h"
 #include "iterator.h"
 #include "descriptor.h"
+#include "ioctl.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * Set the number of asynchronous transfers kept queued on the interrupt
+ * IN endpoint, or zero to use synchronous transfers (the default).
+ *
+ * The incoming reports are buffered, and served to the next reads. This
+ * avoids idle USB frames between two read calls, and increases the
+ * sustained throughput for devices which send many reports in a row.
+ * The value is limited to a small maximum. The setting is only used
+ * with the libusb backend. With hidapi, the reports are already
+ * buffered by the operating system or by hidapi itself.
+ */
+#define DC_IOCTL_USBHID_SET_QUEUE DC_IOCTL_IOW('h', 0, sizeof(unsigned int))
+
 /**
  * Opaque object representing a USB HID device.
  */
@@ -57,7 +57,7 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 /*****************************************************************************/
 /* Includes:                                                                 */
 /*****************************************************************************/
-#include <string.h> // CBC mode, for memset
+#include <string.h> // CBC mode, for memset; CFB mode, for memcpy
 #include "aes.h"
 
 
@@ -611,3 +611,177 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 #endif // #if defined(CBC) && CBC
 
 
+
+#if defined(CFB) && CFB
+
+// With GCC and clang on x86, the AES instructions are used when the
+// processor supports them. The implementation is selected at runtime, so
+// the library still runs on processors without AES-NI.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define AESNI 1
+  #include <wmmintrin.h>
+  #include <emmintrin.h>
+#endif
+
+#include "cpu.h"
+
+typedef void (*CFBDecryptFunc)(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
+
+
+#if defined(AESNI) && AESNI
+
+__attribute__((target("aes,sse2")))
+static __m128i AesniExpandStep(__m128i key, __m128i assist)
+{
+  assist = _mm_shuffle_epi32(assist, 0xFF);
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+  return _mm_xor_si128(key, assist);
+}
+
+#define AESNI_ROUND(k, i, rcon) \
+  (k)[i] = AesniExpandStep((k)[(i) - 1], _mm_aeskeygenassist_si128((k)[(i) - 1], rcon))
+
+__attribute__((target("aes,sse2")))
+static __m128i AesniCipher(const __m128i* roundkey, __m128i block)
+{
+  uint8_t round;
+
+  block = _mm_xor_si128(block, roundkey[0]);
+  for(round = 1; round < Nr; ++round)
+  {
+    block = _mm_aesenc_si128(block, roundkey[round]);
+  }
+  return _mm_aesenclast_si128(block, roundkey[Nr]);
+}
+
+__attribute__((target("aes,sse2")))
+static void AesniCFBDecrypt(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv)
+{
+  __m128i roundkey[Nr + 1];
+  __m128i previous, c[4], k[4];
+  uint8_t keystream[KEYLEN];
+  uint32_t i = 0, j;
+  uint8_t round, n;
+
+  roundkey[0] = _mm_loadu_si128((const __m128i*)key);
+  AESNI_ROUND(roundkey, 1, 0x01);
+  AESNI_ROUND(roundkey, 2, 0x02);
+  AESNI_ROUND(roundkey, 3, 0x04);
+  AESNI_ROUND(roundkey, 4, 0x08);
+  AESNI_ROUND(roundkey, 5, 0x10);
+  AESNI_ROUND(roundkey, 6, 0x20);
+  AESNI_ROUND(roundkey, 7, 0x40);
+  AESNI_ROUND(roundkey, 8, 0x80);
+  AESNI_ROUND(roundkey, 9, 0x1B);
+  AESNI_ROUND(roundkey, 10, 0x36);
+
+  previous = _mm_loadu_si128((const __m128i*)iv);
+
+  // Each keystream block depends only on the previous ciphertext block,
+  // so four blocks can go through the cipher side by side.
+  for(; i + 4 * KEYLEN <= length; i += 4 * KEYLEN)
+  {
+    for(j = 0; j < 4; ++j)
+    {
+      c[j] = _mm_loadu_si128((const __m128i*)(input + i + j * KEYLEN));
+    }
+
+    k[0] = _mm_xor_si128(previous, roundkey[0]);
+    k[1] = _mm_xor_si128(c[0], roundkey[0]);
+    k[2] = _mm_xor_si128(c[1], roundkey[0]);
+    k[3] = _mm_xor_si128(c[2], roundkey[0]);
+    for(round = 1; round < Nr; ++round)
+    {
+      for(j = 0; j < 4; ++j)
+      {
+        k[j] = _mm_aesenc_si128(k[j], roundkey[round]);
+      }
+    }
+
+    for(j = 0; j < 4; ++j)
+    {
+      k[j] = _mm_aesenclast_si128(k[j], roundkey[Nr]);
+      _mm_storeu_si128((__m128i*)(output + i + j * KEYLEN), _mm_xor_si128(c[j], k[j]));
+    }
+    previous = c[3];
+  }
+
+  for(; i + KEYLEN <= length; i += KEYLEN)
+  {
+    c[0] = _mm_loadu_si128((const __m128i*)(input + i));
+    k[0] = AesniCipher(roundkey, previous);
+    _mm_storeu_si128((__m128i*)(output + i), _mm_xor_si128(c[0], k[0]));
+    previous = c[0];
+  }
+
+  if(i < length)
+  {
+    n = (uint8_t)(length - i);
+    _mm_storeu_si128((__m128i*)keystream, AesniCipher(roundkey, previous));
+    for(j = 0; j < n; ++j)
+    {
+      output[i + j] = input[i + j] ^ keystream[j];
+    }
+  }
+}
+
+#endif // #if defined(AESNI) && AESNI
+
+
+static void PortableCFBDecrypt(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv)
+{
+  uint32_t i;
+  uint8_t j, n;
+  uint8_t keystream[KEYLEN];
+  uint8_t ciphertext[KEYLEN];
+  aes_state_t state;
+
+  // The key is expanded only once for the entire buffer.
+  state.Key = key;
+  KeyExpansion(&state);
+
+  // The first keystream block is the encrypted Iv.
+  memcpy(keystream, iv, KEYLEN);
+  state.state = (state_t*)keystream;
+  Cipher(&state);
+
+  for(i = 0; i < length; i += KEYLEN)
+  {
+    n = (length - i < KEYLEN) ? (uint8_t)(length - i) : KEYLEN;
+
+    // Save the ciphertext first, to allow decrypting in place.
+    memcpy(ciphertext, input + i, n);
+    for(j = 0; j < n; ++j)
+    {
+      output[i + j] = ciphertext[j] ^ keystream[j];
+    }
+
+    // The next keystream block is the encrypted ciphertext block.
+    if(n == KEYLEN)
+    {
+      memcpy(keystream, ciphertext, KEYLEN);
+      Cipher(&state);
+    }
+  }
+}
+
+
+static const dc_cpu_kernel_t CFBDecryptKernels[] =
+{
+#if defined(AESNI) && AESNI
+  { DC_CPU_AESNI | DC_CPU_SSE2, (dc_cpu_func_t) AesniCFBDecrypt },
+#endif
+  { 0, (dc_cpu_func_t) PortableCFBDecrypt },
+};
+
+void AES128_CFB_decrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv)
+{
+  CFBDecryptFunc decrypt = DC_CPU_RESOLVE(CFBDecryptFunc, CFBDecryptKernels);
+
+  decrypt(output, input, length, key, iv);
+}
+
+
+#endif // #if defined(CFB) && CFB
@@ -49,6 +49,11 @@ typedef unsigned int  uint32_t;
   #define ECB 1
 #endif
 
+// CFB enables AES128 decryption in 128-bit CFB-mode of operation.
+#ifndef CFB
+  #define CFB 1
+#endif
+
 
 
 #if defined(ECB) && ECB
@@ -66,6 +71,11 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 
 #endif // #if defined(CBC) && CBC
 
+#if defined(CFB) && CFB
+// Decrypt a buffer of any length. The output may be the same as the input.
+void AES128_CFB_decrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
+#endif // #if defined(CFB) && CFB
+
 
 
 #endif //_AES_H_
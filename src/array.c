@@ -21,6 +21,12 @@
 
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "array.h"
 
 void
@@ -55,12 +61,13 @@ array_reverse_bits (unsigned char data[], unsigned int size)
 int
 array_isequal (const unsigned char data[], unsigned int size, unsigned char value)
 {
-	for (unsigned int i = 0; i < size; ++i) {
-		if (data[i] != value)
-			return 0;
-	}
+	if (size == 0)
+		return 1;
 
-	return 1;
+	// If the first byte matches, and every byte equals its successor,
+	// then all bytes match. The overlapping comparison lets the
+	// (vectorized) memcmp of the C library do the heavy lifting.
+	return data[0] == value && memcmp (data, data + 1, size - 1) == 0;
 }
 
 
@@ -68,11 +75,19 @@ const unsigned char *
 array_search_forward (const unsigned char *data, unsigned int size,
                       const unsigned char *marker, unsigned int msize)
 {
-	while (size >= msize) {
-		if (memcmp (data, marker, msize) == 0)
-			return data;
-		size--;
-		data++;
+	if (msize == 0)
+		return data;
+
+	const unsigned char *end = data + size;
+	while ((unsigned int) (end - data) >= msize) {
+		// Locate the next candidate with the (vectorized) memchr of the
+		// C library, before comparing the entire marker.
+		const unsigned char *p = (const unsigned char *) memchr (data, marker[0], end - data - msize + 1);
+		if (p == NULL)
+			break;
+		if (memcmp (p, marker, msize) == 0)
+			return p;
+		data = p + 1;
 	}
 	return NULL;
 }
@@ -82,17 +97,126 @@ const unsigned char *
 array_search_backward (const unsigned char *data, unsigned int size,
                        const unsigned char *marker, unsigned int msize)
 {
+	if (msize == 0)
+		return data + size;
+
+	const unsigned char *last = marker + msize - 1;
+	const unsigned char *begin = data + msize - 1;
 	data += size;
-	while (size >= msize) {
-		if (memcmp (data - msize, marker, msize) == 0)
+	while (data > begin) {
+		// Only compare the entire marker if the last byte matches.
+		if (data[-1] == *last && memcmp (data - msize, marker, msize) == 0)
 			return data;
-		size--;
 		data--;
 	}
 	return NULL;
 }
 
 
+/*
+ * Convert eight bytes to sixteen hexadecimal characters, or sixteen
+ * hexadecimal characters to eight bytes, with the SIMD instructions
+ * that are always available on the target architecture. The hex2bin
+ * block returns non-zero if any of the characters is invalid.
+ */
+#if defined(__SSE2__)
+static void
+array_bin2hex_block (const unsigned char input[8], unsigned char output[16])
+{
+	const __m128i mask = _mm_set1_epi8 (0x0F);
+	__m128i x = _mm_loadl_epi64 ((const __m128i *) input);
+
+	// Interleave the most and least significant nibbles.
+	__m128i msn = _mm_and_si128 (_mm_srli_epi16 (x, 4), mask);
+	__m128i lsn = _mm_and_si128 (x, mask);
+	__m128i nibbles = _mm_unpacklo_epi8 (msn, lsn);
+
+	// Map 0-9 to '0'-'9', and 10-15 to 'A'-'F'.
+	__m128i letter = _mm_and_si128 (_mm_cmpgt_epi8 (nibbles, _mm_set1_epi8 (9)), _mm_set1_epi8 ('A' - '0' - 10));
+	__m128i ascii = _mm_add_epi8 (_mm_add_epi8 (nibbles, _mm_set1_epi8 ('0')), letter);
+
+	_mm_storeu_si128 ((__m128i *) output, ascii);
+}
+
+static int
+array_hex2bin_block (const unsigned char input[16], unsigned char output[8])
+{
+	__m128i c = _mm_loadu_si128 ((const __m128i *) input);
+	__m128i l = _mm_or_si128 (c, _mm_set1_epi8 (0x20));
+
+	// Classify the characters. Setting bit 5 turns 'A'-'F' into
+	// 'a'-'f', and leaves the rest of the letter range invalid.
+	__m128i digit = _mm_and_si128 (
+		_mm_cmpgt_epi8 (c, _mm_set1_epi8 ('0' - 1)),
+		_mm_cmplt_epi8 (c, _mm_set1_epi8 ('9' + 1)));
+	__m128i letter = _mm_and_si128 (
+		_mm_cmpgt_epi8 (l, _mm_set1_epi8 ('a' - 1)),
+		_mm_cmplt_epi8 (l, _mm_set1_epi8 ('f' + 1)));
+	if (_mm_movemask_epi8 (_mm_or_si128 (digit, letter)) != 0xFFFF)
+		return -1;
+
+	__m128i nibbles = _mm_or_si128 (
+		_mm_and_si128 (digit, _mm_sub_epi8 (c, _mm_set1_epi8 ('0'))),
+		_mm_and_si128 (letter, _mm_sub_epi8 (l, _mm_set1_epi8 ('a' - 10))));
+
+	// Combine each pair of nibbles into a byte.
+	__m128i msn = _mm_and_si128 (nibbles, _mm_set1_epi16 (0x00FF));
+	__m128i lsn = _mm_srli_epi16 (nibbles, 8);
+	__m128i bytes = _mm_or_si128 (_mm_slli_epi16 (msn, 4), lsn);
+
+	_mm_storel_epi64 ((__m128i *) output, _mm_packus_epi16 (bytes, bytes));
+
+	return 0;
+}
+#elif defined(__ARM_NEON)
+static void
+array_bin2hex_block (const unsigned char input[8], unsigned char output[16])
+{
+	uint8x8_t x = vld1_u8 (input);
+
+	uint8x8x2_t nibbles;
+	nibbles.val[0] = vshr_n_u8 (x, 4);
+	nibbles.val[1] = vand_u8 (x, vdup_n_u8 (0x0F));
+
+	// Map 0-9 to '0'-'9', and 10-15 to 'A'-'F'.
+	for (unsigned int i = 0; i < 2; ++i) {
+		uint8x8_t letter = vand_u8 (vcgt_u8 (nibbles.val[i], vdup_n_u8 (9)), vdup_n_u8 ('A' - '0' - 10));
+		nibbles.val[i] = vadd_u8 (vadd_u8 (nibbles.val[i], vdup_n_u8 ('0')), letter);
+	}
+
+	// Store with the most and least significant nibbles interleaved.
+	vst2_u8 (output, nibbles);
+}
+
+static int
+array_hex2bin_block (const unsigned char input[16], unsigned char output[8])
+{
+	// Load the most and least significant nibbles separately.
+	uint8x8x2_t c = vld2_u8 (input);
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		uint8x8_t l = vorr_u8 (c.val[i], vdup_n_u8 (0x20));
+
+		uint8x8_t digit = vand_u8 (
+			vcge_u8 (c.val[i], vdup_n_u8 ('0')),
+			vcle_u8 (c.val[i], vdup_n_u8 ('9')));
+		uint8x8_t letter = vand_u8 (
+			vcge_u8 (l, vdup_n_u8 ('a')),
+			vcle_u8 (l, vdup_n_u8 ('f')));
+		if (vget_lane_u64 (vreinterpret_u64_u8 (vorr_u8 (digit, letter)), 0) != ~(uint64_t) 0)
+			return -1;
+
+		c.val[i] = vorr_u8 (
+			vand_u8 (digit, vsub_u8 (c.val[i], vdup_n_u8 ('0'))),
+			vand_u8 (letter, vsub_u8 (l, vdup_n_u8 ('a' - 10))));
+	}
+
+	vst1_u8 (output, vorr_u8 (vshl_n_u8 (c.val[0], 4), c.val[1]));
+
+	return 0;
+}
+#endif
+
 int
 array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize)
 {
@@ -103,16 +227,37 @@ array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned
 		'0', '1', '2', '3', '4', '5', '6', '7',
 		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
 
-	for (unsigned int i = 0; i < isize; ++i) {
+	// Convert from the end towards the start. Every byte is read before
+	// its output is written, which allows an in place conversion with
+	// the input stored at the start of the output buffer.
+	unsigned int i = isize;
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	unsigned int nblocks = isize / 8;
+	while (i > nblocks * 8) {
+#else
+	while (i > 0) {
+#endif
+		--i;
+
+		// Read the byte first, for the in place conversion.
+		unsigned char value = input[i];
+
 		// Set the most-significant nibble.
-		unsigned char msn = (input[i] >> 4) & 0x0F;
+		unsigned char msn = (value >> 4) & 0x0F;
 		output[i * 2 + 0] = ascii[msn];
 
 		// Set the least-significant nibble.
-		unsigned char lsn = input[i] & 0x0F;
+		unsigned char lsn = value & 0x0F;
 		output[i * 2 + 1] = ascii[lsn];
 	}
 
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	while (i > 0) {
+		i -= 8;
+		array_bin2hex_block (input + i, output + i * 2);
+	}
+#endif
+
 	return 0;
 }
 
@@ -123,7 +268,18 @@ array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned
 	if (isize != 2 * osize)
 		return -1;
 
-	for (unsigned int i = 0; i < osize; ++i) {
+	unsigned int i = 0;
+
+	// The output is never ahead of the input, which allows an in place
+	// conversion with the output at the start of the input buffer.
+#if defined(__SSE2__) || defined(__ARM_NEON)
+	for (; i + 8 <= osize; i += 8) {
+		if (array_hex2bin_block (input + i * 2, output + i) != 0)
+			return -1; /* Invalid character */
+	}
+#endif
+
+	for (; i < osize; ++i) {
 		unsigned char value = 0;
 		for (unsigned int j = 0; j < 2; ++j) {
 			unsigned char number = 0;
@@ -214,6 +370,16 @@ array_uint32_word_be (const unsigned char data[])
 }
 
 
+void
+array_uint32_be_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = (input >> 24) & 0xFF;
+	data[1] = (input >> 16) & 0xFF;
+	data[2] = (input >>  8) & 0xFF;
+	data[3] = input & 0xFF;
+}
+
+
 void
 array_uint32_le_set (unsigned char data[], const unsigned int input)
 {
@@ -265,6 +431,13 @@ array_uint16_le (const unsigned char data[])
 	       ((unsigned int) data[1] <<  8);
 }
 
+void
+array_uint16_le_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = input & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+}
+
 unsigned char
 bcd2dec (unsigned char value)
 {
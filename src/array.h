@@ -43,6 +43,13 @@ const unsigned char *
 array_search_backward (const unsigned char *data, unsigned int size,
                        const unsigned char *marker, unsigned int msize);
 
+/*
+ * Convert binary data to uppercase hexadecimal characters, and back.
+ * The hex2bin conversion accepts both upper and lowercase characters,
+ * and fails on the first block with an invalid character. Both
+ * functions can convert in place, when the input and output start at
+ * the same address.
+ */
 int
 array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize);
 
@@ -67,6 +74,9 @@ array_uint32_le (const unsigned char data[]);
 unsigned int
 array_uint32_word_be (const unsigned char data[]);
 
+void
+array_uint32_be_set (unsigned char data[], const unsigned int input);
+
 void
 array_uint32_le_set (unsigned char data[], const unsigned int input);
 
@@ -85,6 +95,9 @@ array_uint16_be (const unsigned char data[]);
 unsigned short
 array_uint16_le (const unsigned char data[]);
 
+void
+array_uint16_le_set (unsigned char data[], const unsigned int input);
+
 unsigned char
 bcd2dec (unsigned char value);
 
@@ -26,6 +26,7 @@
 
 #include "atomics_cobalt.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -39,6 +40,8 @@
 #define PID 0x0888
 #define TIMEOUT 2000
 
+#define NTRANSFERS 4
+
 #define FP_OFFSET 20
 
 #define SZ_MEMORY1 (29 * 64 * 1024) // Cobalt 1
@@ -63,7 +66,9 @@ static const dc_device_vtable_t atomics_cobalt_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	atomics_cobalt_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -97,6 +102,15 @@ atomics_cobalt_device_open (dc_device_t **out, dc_context_t *context, dc_iostrea
 		goto error_free;
 	}
 
+	// Keep a few bulk transfers queued, to receive the dives at the
+	// full transfer rate. Other transports don't support it.
+	unsigned int ntransfers = NTRANSFERS;
+	status = dc_iostream_ioctl (device->iostream, DC_IOCTL_USB_SET_QUEUE, &ntransfers, sizeof (ntransfers));
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR (context, "Failed to set the transfer queue.");
+		goto error_free;
+	}
+
 	status = atomics_cobalt_device_version ((dc_device_t *) device, device->version, sizeof (device->version));
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to identify the dive computer.");
@@ -323,7 +337,7 @@ atomics_cobalt_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Allocate a memory buffer.
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
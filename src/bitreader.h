@@ -0,0 +1,182 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BITREADER_H
+#define DC_BITREADER_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Reader for bit packed data, with the most significant bit first.
+ *
+ * The bits are buffered in a 64 bit cache, with the next bit in the
+ * most significant position. After a refill, the cache contains at
+ * least 56 bits (or all the remaining bits near the end of the data).
+ * Up to 32 bits can be inspected with dc_bitreader_peek(), which makes
+ * it suitable for dispatching on a prefix code, and then discarded with
+ * dc_bitreader_consume(). Neither function checks the bounds, and the
+ * missing bits past the end of the data read as zero. The caller is
+ * responsible for checking dc_bitreader_available() first.
+ */
+typedef struct dc_bitreader_t {
+	const unsigned char *data;
+	unsigned int size;
+	unsigned int offset;
+	unsigned int count;
+	unsigned long long cache;
+} dc_bitreader_t;
+
+static DC_ALWAYS_INLINE void
+dc_bitreader_init (dc_bitreader_t *reader, const unsigned char data[], unsigned int size)
+{
+	reader->data = data;
+	reader->size = size;
+	reader->offset = 0;
+	reader->count = 0;
+	reader->cache = 0;
+}
+
+static DC_ALWAYS_INLINE void
+dc_bitreader_refill (dc_bitreader_t *reader)
+{
+	if (reader->size - reader->offset >= 8) {
+		// Load eight bytes at once, and keep only the whole bytes. The
+		// bits of a partially loaded byte are loaded again by the next
+		// refill, at the same position in the cache.
+		const unsigned char *p = reader->data + reader->offset;
+		unsigned long long value =
+			((unsigned long long) p[0] << 56) | ((unsigned long long) p[1] << 48) |
+			((unsigned long long) p[2] << 40) | ((unsigned long long) p[3] << 32) |
+			((unsigned long long) p[4] << 24) | ((unsigned long long) p[5] << 16) |
+			((unsigned long long) p[6] << 8) | (unsigned long long) p[7];
+		unsigned int n = (63 - reader->count) >> 3;
+		reader->cache |= value >> reader->count;
+		reader->offset += n;
+		reader->count += n * 8;
+	} else {
+		while (reader->count <= 56 && reader->offset < reader->size) {
+			reader->cache |= (unsigned long long) reader->data[reader->offset] << (56 - reader->count);
+			reader->offset++;
+			reader->count += 8;
+		}
+	}
+}
+
+/*
+ * Get the number of bits remaining.
+ */
+static DC_ALWAYS_INLINE unsigned int
+dc_bitreader_available (const dc_bitreader_t *reader)
+{
+	return (reader->size - reader->offset) * 8 + reader->count;
+}
+
+/*
+ * Get the current position, in bits from the start of the data.
+ */
+static DC_ALWAYS_INLINE unsigned int
+dc_bitreader_tell (const dc_bitreader_t *reader)
+{
+	return reader->offset * 8 - reader->count;
+}
+
+/*
+ * Get the next n bits (0 to 32), without removing them.
+ */
+static DC_ALWAYS_INLINE unsigned int
+dc_bitreader_peek (const dc_bitreader_t *reader, unsigned int n)
+{
+	// The shift is split in two, to remain valid for n equal to zero.
+	return (unsigned int) (reader->cache >> 1 >> (63 - n));
+}
+
+/*
+ * Remove the next n bits, which must be available in the cache.
+ */
+static DC_ALWAYS_INLINE void
+dc_bitreader_consume (dc_bitreader_t *reader, unsigned int n)
+{
+	reader->cache <<= n;
+	reader->count -= n;
+}
+
+/*
+ * Get and remove the next n bits (0 to 32).
+ */
+static DC_ALWAYS_INLINE unsigned int
+dc_bitreader_read (dc_bitreader_t *reader, unsigned int n)
+{
+	if (reader->count < n)
+		dc_bitreader_refill (reader);
+
+	unsigned int value = dc_bitreader_peek (reader, n);
+	dc_bitreader_consume (reader, n);
+
+	return value;
+}
+
+/*
+ * Move to an absolute position, in bits from the start of the data.
+ */
+static DC_ALWAYS_INLINE void
+dc_bitreader_seek (dc_bitreader_t *reader, unsigned int position)
+{
+	reader->offset = position / 8;
+	reader->count = 0;
+	reader->cache = 0;
+
+	dc_bitreader_refill (reader);
+	dc_bitreader_consume (reader, position % 8);
+}
+
+/*
+ * Skip the next n bits.
+ */
+static DC_ALWAYS_INLINE void
+dc_bitreader_skip (dc_bitreader_t *reader, unsigned int n)
+{
+	if (n <= reader->count)
+		dc_bitreader_consume (reader, n);
+	else
+		dc_bitreader_seek (reader, dc_bitreader_tell (reader) + n);
+}
+
+/*
+ * Sign extend a two's complement value of n bits (0 to 32).
+ */
+static DC_ALWAYS_INLINE signed int
+dc_bitreader_signed (unsigned int value, unsigned int n)
+{
+	// Flipping the sign bit and subtracting it again propagates the
+	// sign to all the extra bits, without a branch. A value of zero
+	// bits is zero, regardless of the mask.
+	unsigned int mask = 1u << ((n - 1) & 31);
+	return (signed int) ((value ^ mask) - mask);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BITREADER_H */
@@ -0,0 +1,208 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/ble.h>
+
+#include "bleline.h"
+#include "context-private.h"
+
+// The default ATT MTU is 23 bytes, which leaves 20 bytes of payload.
+#define DEFAULT_MTU 20
+
+// The maximum length of a GATT attribute value.
+#define MAX_PACKET 512
+
+struct dc_bleline_t {
+	dc_context_t *context;
+	dc_iostream_t *iostream;
+	size_t mtu;
+	unsigned char buffer[MAX_PACKET];
+	size_t offset;
+	size_t count;
+};
+
+dc_status_t
+dc_bleline_new (dc_bleline_t **out, dc_context_t *context, dc_iostream_t *iostream)
+{
+	dc_bleline_t *bleline = NULL;
+	unsigned int mtu = 0;
+
+	if (out == NULL || iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	bleline = (dc_bleline_t *) malloc (sizeof(*bleline));
+	if (bleline == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Get the maximum packet size.
+	dc_status_t status = dc_iostream_ioctl (iostream, DC_IOCTL_BLE_GET_MTU, &mtu, sizeof(mtu));
+	if (status != DC_STATUS_SUCCESS || mtu == 0) {
+		mtu = DEFAULT_MTU;
+	} else if (mtu > MAX_PACKET) {
+		mtu = MAX_PACKET;
+	}
+
+	DEBUG (context, "BLE packet size: %u", mtu);
+
+	bleline->context = context;
+	bleline->iostream = iostream;
+	bleline->mtu = mtu;
+	bleline->offset = 0;
+	bleline->count = 0;
+
+	*out = bleline;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bleline_write (dc_bleline_t *bleline, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	if (bleline == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	while (size) {
+		size_t len = size < bleline->mtu ? size : bleline->mtu;
+
+		dc_status_t status = dc_iostream_write (bleline->iostream, p, len, NULL);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		p += len;
+		size -= len;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_bleline_fill (dc_bleline_t *bleline)
+{
+	size_t transferred = 0;
+
+	dc_status_t status = dc_iostream_read (bleline->iostream, bleline->buffer, sizeof(bleline->buffer), &transferred);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (transferred == 0) {
+		ERROR (bleline->context, "Empty packet received.");
+		return DC_STATUS_IO;
+	}
+
+	bleline->offset = 0;
+	bleline->count = transferred;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bleline_read (dc_bleline_t *bleline, void *data, size_t size, size_t *actual)
+{
+	if (bleline == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	if (bleline->count == 0 && size) {
+		dc_status_t status = dc_bleline_fill (bleline);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	size_t len = size < bleline->count ? size : bleline->count;
+	if (len) {
+		memcpy (data, bleline->buffer + bleline->offset, len);
+		bleline->offset += len;
+		bleline->count -= len;
+	}
+
+	if (actual)
+		*actual = len;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bleline_readline (dc_bleline_t *bleline, char *data, size_t size, size_t *actual)
+{
+	size_t nbytes = 0;
+
+	if (bleline == NULL || data == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	while (1) {
+		if (bleline->count == 0) {
+			dc_status_t status = dc_bleline_fill (bleline);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+		}
+
+		// Copy everything up to and including the newline.
+		const unsigned char *p = bleline->buffer + bleline->offset;
+		const unsigned char *nl = (const unsigned char *) memchr (p, '\n', bleline->count);
+		size_t len = nl ? (size_t) (nl - p) + 1 : bleline->count;
+		if (nbytes + len > size) {
+			ERROR (bleline->context, "Line too long for the buffer (%zu bytes).", size);
+			dc_bleline_discard (bleline);
+			return DC_STATUS_PROTOCOL;
+		}
+
+		memcpy (data + nbytes, p, len);
+		nbytes += len;
+		bleline->offset += len;
+		bleline->count -= len;
+
+		if (nl)
+			break;
+	}
+
+	// Replace the newline with the null terminator.
+	data[--nbytes] = '\0';
+
+	if (actual)
+		*actual = nbytes;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_bleline_discard (dc_bleline_t *bleline)
+{
+	if (bleline == NULL)
+		return;
+
+	bleline->offset = 0;
+	bleline->count = 0;
+}
+
+dc_status_t
+dc_bleline_free (dc_bleline_t *bleline)
+{
+	free (bleline);
+
+	return DC_STATUS_SUCCESS;
+}
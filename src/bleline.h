@@ -0,0 +1,124 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BLELINE_H
+#define DC_BLELINE_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/iostream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a BLE packet stream.
+ *
+ * Several BLE devices tunnel a serial (UART) protocol over GATT
+ * notifications. Each read returns a single packet, which does not
+ * necessarily correspond with a protocol message: a line can be split
+ * over several packets, and a packet can contain the start of the next
+ * message. The packet stream buffers the received data, and splits the
+ * outgoing data into packets no larger than the negotiated MTU.
+ */
+typedef struct dc_bleline_t dc_bleline_t;
+
+/**
+ * Create a new BLE packet stream.
+ *
+ * The maximum packet size is obtained from the iostream with the
+ * #DC_IOCTL_BLE_GET_MTU ioctl. If the iostream doesn't support it, the
+ * default BLE payload size of 20 bytes is used.
+ *
+ * @param[out]  bleline   A location to store the packet stream.
+ * @param[in]   context   A valid context object.
+ * @param[in]   iostream  A valid iostream object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bleline_new (dc_bleline_t **bleline, dc_context_t *context, dc_iostream_t *iostream);
+
+/**
+ * Write data, split into as few packets as the MTU allows.
+ *
+ * @param[in]  bleline  A valid packet stream.
+ * @param[in]  data     The data to write.
+ * @param[in]  size     The number of bytes to write.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bleline_write (dc_bleline_t *bleline, const void *data, size_t size);
+
+/**
+ * Read data. The buffered data is returned first. If the buffer is
+ * empty, a single packet is received. Unlike a plain iostream read, the
+ * remainder of a packet that doesn't fit is kept for the next call.
+ *
+ * @param[in]  bleline  A valid packet stream.
+ * @param[out] data     The memory buffer to read the data into.
+ * @param[in]  size     The size of the memory buffer.
+ * @param[out] actual   A location to store the number of bytes read.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bleline_read (dc_bleline_t *bleline, void *data, size_t size, size_t *actual);
+
+/**
+ * Read a single line. Packets are received until a newline character
+ * is found. The newline is removed, and the line is null terminated.
+ *
+ * @param[in]  bleline  A valid packet stream.
+ * @param[out] data     The memory buffer to read the line into.
+ * @param[in]  size     The size of the memory buffer, including the
+ *                      terminating null byte.
+ * @param[out] actual   A location to store the length of the line.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_PROTOCOL if the
+ * line doesn't fit, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_bleline_readline (dc_bleline_t *bleline, char *data, size_t size, size_t *actual);
+
+/**
+ * Discard the buffered data.
+ *
+ * @param[in]  bleline  A valid packet stream.
+ */
+void
+dc_bleline_discard (dc_bleline_t *bleline);
+
+/**
+ * Destroy the packet stream and free all resources.
+ *
+ * @param[in]  bleline  A valid packet stream.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bleline_free (dc_bleline_t *bleline);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BLELINE_H */
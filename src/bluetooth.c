@@ -25,6 +25,7 @@
 
 #include <stdlib.h> // malloc, free
 #include <stdio.h>
+#include <string.h> // memcpy, memset
 
 #include "socket.h"
 
@@ -66,6 +67,15 @@
 #define MAX_DEVICES 255
 #define MAX_PERIODS 8
 
+// Maximum time without any event from the adapter (milliseconds). A
+// remote name request can take several seconds to time out.
+#define EVENT_TIMEOUT 15000
+
+#define ENTRY_NEW     0
+#define ENTRY_PENDING 1
+#define ENTRY_DONE    2
+#define ENTRY_FAILED  3
+
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_bluetooth_vtable)
 
 struct dc_bluetooth_device_t {
@@ -77,9 +87,20 @@ struct dc_bluetooth_device_t {
 static dc_status_t dc_bluetooth_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_bluetooth_iterator_free (dc_iterator_t *iterator);
 
+#ifdef HAVE_BLUEZ
+typedef struct dc_bluetooth_entry_t {
+	bdaddr_t bdaddr;
+	uint8_t pscan_rep_mode;
+	uint16_t clock_offset;
+	unsigned int state;
+} dc_bluetooth_entry_t;
+#endif
+
 typedef struct dc_bluetooth_iterator_t {
 	dc_iterator_t base;
 	dc_descriptor_t *descriptor;
+	unsigned int flags;
+	unsigned int done;
 #ifdef _WIN32
 	HANDLE hLookup;
 #else
@@ -87,6 +108,12 @@ typedef struct dc_bluetooth_iterator_t {
 	inquiry_info *devices;
 	size_t count;
 	size_t current;
+	/* Streaming scan. */
+	unsigned int inquiry;
+	unsigned int deferred;
+	int resolving;
+	dc_bluetooth_entry_t entries[MAX_DEVICES];
+	size_t nentries;
 #endif
 } dc_bluetooth_iterator_t;
 
@@ -108,10 +135,12 @@ static const dc_iostream_vtable_t dc_bluetooth_vtable = {
 	dc_socket_poll, /* poll */
 	dc_socket_read, /* read */
 	dc_socket_write, /* write */
+	NULL, /* writev */
 	dc_socket_ioctl, /* ioctl */
 	NULL, /* flush */
 	NULL, /* purge */
 	dc_socket_sleep, /* sleep */
+	dc_socket_interrupt, /* interrupt */
 	dc_socket_close, /* close */
 };
 
@@ -299,6 +328,184 @@ dc_bluetooth_device_free (dc_bluetooth_device_t *device)
 
 dc_status_t
 dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	return dc_bluetooth_iterator_new2 (out, context, descriptor, DC_BLUETOOTH_SCAN_NONE);
+}
+
+#ifdef BLUETOOTH
+#ifdef HAVE_BLUEZ
+static dc_status_t
+dc_bluetooth_inquiry_start (dc_context_t *context, int fd)
+{
+	// Only the events needed for the discovery are received.
+	struct hci_filter filter;
+	hci_filter_clear (&filter);
+	hci_filter_set_ptype (HCI_EVENT_PKT, &filter);
+	hci_filter_set_event (EVT_CMD_STATUS, &filter);
+	hci_filter_set_event (EVT_INQUIRY_RESULT, &filter);
+	hci_filter_set_event (EVT_INQUIRY_RESULT_WITH_RSSI, &filter);
+	hci_filter_set_event (EVT_EXTENDED_INQUIRY_RESULT, &filter);
+	hci_filter_set_event (EVT_INQUIRY_COMPLETE, &filter);
+	hci_filter_set_event (EVT_REMOTE_NAME_REQ_COMPLETE, &filter);
+	if (setsockopt (fd, SOL_HCI, HCI_FILTER, &filter, sizeof (filter)) < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		return dc_socket_syserror(errcode);
+	}
+
+	// Start the inquiry with the general inquiry access code, and no
+	// limit on the number of responses. Unlike hci_inquiry, the command
+	// returns immediately and the results arrive as events.
+	inquiry_cp cp;
+	cp.lap[0] = 0x33;
+	cp.lap[1] = 0x8B;
+	cp.lap[2] = 0x9E;
+	cp.length = MAX_PERIODS;
+	cp.num_rsp = 0;
+	if (hci_send_cmd (fd, OGF_LINK_CTL, OCF_INQUIRY, INQUIRY_CP_SIZE, &cp) < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		return dc_socket_syserror(errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_bluetooth_inquiry_cancel (dc_bluetooth_iterator_t *iterator)
+{
+	if (iterator->resolving >= 0) {
+		remote_name_req_cancel_cp cp;
+		bacpy (&cp.bdaddr, &iterator->entries[iterator->resolving].bdaddr);
+		hci_send_cmd (iterator->fd, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ_CANCEL, REMOTE_NAME_REQ_CANCEL_CP_SIZE, &cp);
+		iterator->resolving = -1;
+	}
+
+	if (iterator->inquiry) {
+		hci_send_cmd (iterator->fd, OGF_LINK_CTL, OCF_INQUIRY_CANCEL, 0, NULL);
+		iterator->inquiry = 0;
+	}
+}
+
+/*
+ * Parse the extended inquiry response for the (complete or shortened)
+ * local name. Returns non-zero if a name was found.
+ */
+static int
+dc_bluetooth_eir_name (const unsigned char data[], size_t size, char *name, size_t length)
+{
+	size_t offset = 0;
+	while (offset + 1 < size) {
+		size_t len = data[offset];
+		if (len == 0 || offset + 1 + len > size)
+			break;
+
+		unsigned int type = data[offset + 1];
+		if (type == 0x08 || type == 0x09) {
+			size_t n = len - 1;
+			if (n > length - 1)
+				n = length - 1;
+			memcpy (name, data + offset + 2, n);
+			name[n] = '\0';
+			return 1;
+		}
+
+		offset += 1 + len;
+	}
+
+	return 0;
+}
+
+/*
+ * Add a device to the list of discovered devices. Returns the index of
+ * the new entry, or -1 if the device is a duplicate or the list is full.
+ */
+static int
+dc_bluetooth_entry_add (dc_bluetooth_iterator_t *iterator, const bdaddr_t *bdaddr, uint8_t pscan_rep_mode, uint16_t clock_offset, unsigned int state)
+{
+	for (size_t i = 0; i < iterator->nentries; ++i) {
+		if (bacmp (&iterator->entries[i].bdaddr, bdaddr) == 0)
+			return -1;
+	}
+
+	if (iterator->nentries >= C_ARRAY_SIZE(iterator->entries))
+		return -1;
+
+	dc_bluetooth_entry_t *entry = &iterator->entries[iterator->nentries];
+	bacpy (&entry->bdaddr, bdaddr);
+	entry->pscan_rep_mode = pscan_rep_mode;
+	entry->clock_offset = clock_offset;
+	entry->state = state;
+
+	return iterator->nentries++;
+}
+
+/*
+ * Send a remote name request for the next device without a name. The
+ * request completes asynchronously, so the inquiry keeps running.
+ */
+static void
+dc_bluetooth_entry_resolve (dc_bluetooth_iterator_t *iterator)
+{
+	if (iterator->resolving >= 0 || (iterator->deferred && iterator->inquiry))
+		return;
+
+	for (size_t i = 0; i < iterator->nentries; ++i) {
+		dc_bluetooth_entry_t *entry = &iterator->entries[i];
+		if (entry->state != ENTRY_NEW)
+			continue;
+
+		remote_name_req_cp cp;
+		bacpy (&cp.bdaddr, &entry->bdaddr);
+		cp.pscan_rep_mode = entry->pscan_rep_mode;
+		cp.pscan_mode = 0;
+		cp.clock_offset = entry->clock_offset;
+		if (hci_send_cmd (iterator->fd, OGF_LINK_CTL, OCF_REMOTE_NAME_REQ, REMOTE_NAME_REQ_CP_SIZE, &cp) < 0) {
+			entry->state = ENTRY_FAILED;
+			continue;
+		}
+
+		entry->state = ENTRY_PENDING;
+		iterator->resolving = i;
+		break;
+	}
+}
+#endif
+
+static dc_status_t
+dc_bluetooth_device_new (dc_bluetooth_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_bluetooth_address_t address, const char *name)
+{
+	dc_bluetooth_device_t *device = NULL;
+
+	INFO (context, "Discover: address=" DC_ADDRESS_FORMAT ", name=%s",
+		address, name ? name : "");
+
+	if (!dc_descriptor_filter (descriptor, DC_TRANSPORT_BLUETOOTH, name, NULL)) {
+		return DC_STATUS_DONE;
+	}
+
+	device = (dc_bluetooth_device_t *) malloc (sizeof(dc_bluetooth_device_t));
+	if (device == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->address = address;
+	if (name) {
+		strncpy(device->name, name, sizeof(device->name) - 1);
+		device->name[sizeof(device->name) - 1] = '\0';
+	} else {
+		memset(device->name, 0, sizeof(device->name));
+	}
+
+	*out = device;
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
+
+dc_status_t
+dc_bluetooth_iterator_new2 (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int flags)
 {
 #ifdef BLUETOOTH
 	dc_status_t status = DC_STATUS_SUCCESS;
@@ -359,24 +566,40 @@ dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descri
 		goto error_socket_exit;
 	}
 
-	// Perform the bluetooth device discovery. The inquiry lasts for at
-	// most MAX_PERIODS * 1.28 seconds, and at most MAX_DEVICES devices
-	// will be returned.
 	inquiry_info *devices = NULL;
-	int ndevices = hci_inquiry (dev, MAX_PERIODS, MAX_DEVICES, NULL, &devices, IREQ_CACHE_FLUSH);
-	if (ndevices < 0) {
-		s_errcode_t errcode = S_ERRNO;
-		SYSERROR (context, errcode);
-		status = dc_socket_syserror(errcode);
-		goto error_close;
+	int ndevices = 0;
+	if (flags & DC_BLUETOOTH_SCAN_STREAM) {
+		// Start the inquiry in the background. The devices are
+		// processed by the iterator as they respond.
+		status = dc_bluetooth_inquiry_start (context, fd);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_close;
+		}
+	} else {
+		// Perform the bluetooth device discovery. The inquiry lasts for at
+		// most MAX_PERIODS * 1.28 seconds, and at most MAX_DEVICES devices
+		// will be returned.
+		ndevices = hci_inquiry (dev, MAX_PERIODS, MAX_DEVICES, NULL, &devices, IREQ_CACHE_FLUSH);
+		if (ndevices < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			SYSERROR (context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto error_close;
+		}
 	}
 
 	iterator->fd = fd;
 	iterator->devices = devices;
 	iterator->count = ndevices;
 	iterator->current = 0;
+	iterator->inquiry = (flags & DC_BLUETOOTH_SCAN_STREAM) != 0;
+	iterator->deferred = 0;
+	iterator->resolving = -1;
+	iterator->nentries = 0;
 #endif
 	iterator->descriptor = descriptor;
+	iterator->flags = flags;
+	iterator->done = 0;
 
 	*out = (dc_iterator_t *) iterator;
 
@@ -397,12 +620,150 @@ error_free:
 }
 
 #ifdef BLUETOOTH
+#ifdef HAVE_BLUEZ
+static dc_status_t
+dc_bluetooth_iterator_stream (dc_bluetooth_iterator_t *iterator, dc_bluetooth_device_t **out)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *context = iterator->base.context;
+
+	while (1) {
+		dc_bluetooth_entry_resolve (iterator);
+
+		// Nothing left to wait for.
+		if (!iterator->inquiry && iterator->resolving < 0)
+			return DC_STATUS_DONE;
+
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (iterator->fd, &fds);
+
+		struct timeval tv;
+		tv.tv_sec = EVENT_TIMEOUT / 1000;
+		tv.tv_usec = (EVENT_TIMEOUT % 1000) * 1000;
+
+		int rc = select (iterator->fd + 1, &fds, NULL, NULL, &tv);
+		if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == EINTR)
+				continue; // Retry.
+			SYSERROR (context, errcode);
+			return dc_socket_syserror(errcode);
+		} else if (rc == 0) {
+			WARNING (context, "No response from the bluetooth adapter.");
+			dc_bluetooth_inquiry_cancel (iterator);
+			return DC_STATUS_DONE;
+		}
+
+		unsigned char buf[HCI_MAX_EVENT_SIZE];
+		ssize_t n = read (iterator->fd, buf, sizeof (buf));
+		if (n < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == EINTR || errcode == EAGAIN)
+				continue; // Retry.
+			SYSERROR (context, errcode);
+			return dc_socket_syserror(errcode);
+		}
+
+		if ((size_t) n < 1 + HCI_EVENT_HDR_SIZE || buf[0] != HCI_EVENT_PKT)
+			continue;
+
+		const hci_event_hdr *hdr = (const hci_event_hdr *) (buf + 1);
+		const unsigned char *data = buf + 1 + HCI_EVENT_HDR_SIZE;
+		size_t size = n - 1 - HCI_EVENT_HDR_SIZE;
+		if (hdr->plen > size)
+			continue;
+
+		switch (hdr->evt) {
+		case EVT_INQUIRY_COMPLETE:
+			iterator->inquiry = 0;
+			break;
+		case EVT_CMD_STATUS:
+			if (hdr->plen >= EVT_CMD_STATUS_SIZE) {
+				const evt_cmd_status *cs = (const evt_cmd_status *) data;
+				if (cs->status == 0)
+					break;
+				if (btohs(cs->opcode) == cmd_opcode_pack (OGF_LINK_CTL, OCF_INQUIRY)) {
+					ERROR (context, "Failed to start the inquiry (%u).", cs->status);
+					iterator->inquiry = 0;
+				} else if (btohs(cs->opcode) == cmd_opcode_pack (OGF_LINK_CTL, OCF_REMOTE_NAME_REQ) &&
+					iterator->resolving >= 0) {
+					// Some controllers can't page while the inquiry is running.
+					// The name requests are retried once the inquiry is done.
+					dc_bluetooth_entry_t *entry = &iterator->entries[iterator->resolving];
+					entry->state = iterator->inquiry ? ENTRY_NEW : ENTRY_FAILED;
+					iterator->deferred = 1;
+					iterator->resolving = -1;
+				}
+			}
+			break;
+		case EVT_INQUIRY_RESULT:
+			for (size_t i = 0; hdr->plen >= 1 && i < data[0] && 1 + (i + 1) * INQUIRY_INFO_SIZE <= hdr->plen; ++i) {
+				const inquiry_info *info = (const inquiry_info *) (data + 1 + i * INQUIRY_INFO_SIZE);
+				dc_bluetooth_entry_add (iterator, &info->bdaddr, info->pscan_rep_mode, info->clock_offset, ENTRY_NEW);
+			}
+			break;
+		case EVT_INQUIRY_RESULT_WITH_RSSI:
+			for (size_t i = 0; hdr->plen >= 1 && i < data[0] && 1 + (i + 1) * INQUIRY_INFO_WITH_RSSI_SIZE <= hdr->plen; ++i) {
+				const inquiry_info_with_rssi *info = (const inquiry_info_with_rssi *) (data + 1 + i * INQUIRY_INFO_WITH_RSSI_SIZE);
+				dc_bluetooth_entry_add (iterator, &info->bdaddr, info->pscan_rep_mode, info->clock_offset, ENTRY_NEW);
+			}
+			break;
+		case EVT_EXTENDED_INQUIRY_RESULT:
+			if (hdr->plen >= 1 + EXTENDED_INQUIRY_INFO_SIZE) {
+				const extended_inquiry_info *info = (const extended_inquiry_info *) (data + 1);
+
+				// Use the name from the inquiry response, if available.
+				char name[HCI_MAX_NAME_LENGTH];
+				int havename = dc_bluetooth_eir_name (info->data, sizeof (info->data), name, sizeof (name));
+				int idx = dc_bluetooth_entry_add (iterator, &info->bdaddr, info->pscan_rep_mode, info->clock_offset,
+					havename ? ENTRY_DONE : ENTRY_NEW);
+				if (idx < 0 || !havename)
+					break;
+
+				status = dc_bluetooth_device_new (out, context, iterator->descriptor, dc_address_get (&info->bdaddr), name);
+				if (status != DC_STATUS_DONE)
+					return status;
+			}
+			break;
+		case EVT_REMOTE_NAME_REQ_COMPLETE:
+			if (hdr->plen >= EVT_REMOTE_NAME_REQ_COMPLETE_SIZE && iterator->resolving >= 0) {
+				const evt_remote_name_req_complete *rn = (const evt_remote_name_req_complete *) data;
+				dc_bluetooth_entry_t *entry = &iterator->entries[iterator->resolving];
+				if (bacmp (&rn->bdaddr, &entry->bdaddr) != 0)
+					break;
+
+				entry->state = ENTRY_DONE;
+				iterator->resolving = -1;
+
+				// Null terminate the string.
+				char name[HCI_MAX_NAME_LENGTH];
+				memcpy (name, rn->name, sizeof (name) - 1);
+				name[sizeof (name) - 1] = '\0';
+
+				status = dc_bluetooth_device_new (out, context, iterator->descriptor, dc_address_get (&entry->bdaddr),
+					rn->status == 0 ? name : NULL);
+				if (status != DC_STATUS_DONE)
+					return status;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+#endif
+
 static dc_status_t
 dc_bluetooth_iterator_next (dc_iterator_t *abstract, void *out)
 {
 	dc_bluetooth_iterator_t *iterator = (dc_bluetooth_iterator_t *) abstract;
+	dc_status_t status = DC_STATUS_DONE;
 	dc_bluetooth_device_t *device = NULL;
 
+	if (iterator->done)
+		return DC_STATUS_DONE;
+
 #ifdef _WIN32
 	if (iterator->hLookup == NULL) {
 		return DC_STATUS_DONE;
@@ -437,7 +798,11 @@ dc_bluetooth_iterator_next (dc_iterator_t *abstract, void *out)
 		dc_bluetooth_address_t address = sa->btAddr;
 		const char *name = (char *) pwsaResults->lpszServiceInstanceName;
 #else
-	while (iterator->current < iterator->count) {
+	if (iterator->flags & DC_BLUETOOTH_SCAN_STREAM) {
+		status = dc_bluetooth_iterator_stream (iterator, &device);
+	}
+
+	while (!(iterator->flags & DC_BLUETOOTH_SCAN_STREAM) && iterator->current < iterator->count) {
 		inquiry_info *dev = &iterator->devices[iterator->current++];
 
 		dc_bluetooth_address_t address = dc_address_get (&dev->bdaddr);
@@ -453,33 +818,25 @@ dc_bluetooth_iterator_next (dc_iterator_t *abstract, void *out)
 		buf[sizeof(buf) - 1] = '\0';
 #endif
 
-		INFO (abstract->context, "Discover: address=" DC_ADDRESS_FORMAT ", name=%s",
-			address, name ? name : "");
-
-		if (!dc_descriptor_filter (iterator->descriptor, DC_TRANSPORT_BLUETOOTH, name, NULL)) {
-			continue;
-		}
-
-		device = (dc_bluetooth_device_t *) malloc (sizeof(dc_bluetooth_device_t));
-		if (device == NULL) {
-			SYSERROR (abstract->context, S_ENOMEM);
-			return DC_STATUS_NOMEMORY;
-		}
-
-		device->address = address;
-		if (name) {
-			strncpy(device->name, name, sizeof(device->name) - 1);
-			device->name[sizeof(device->name) - 1] = '\0';
-		} else {
-			memset(device->name, 0, sizeof(device->name));
-		}
+		status = dc_bluetooth_device_new (&device, abstract->context, iterator->descriptor, address, name);
+		if (status != DC_STATUS_DONE)
+			break;
+	}
 
-		*(dc_bluetooth_device_t **) out = device;
+	if (status != DC_STATUS_SUCCESS)
+		return status;
 
-		return DC_STATUS_SUCCESS;
+	if (iterator->flags & DC_BLUETOOTH_SCAN_FIRST) {
+		// Stop the scan, and end the enumeration.
+#ifdef HAVE_BLUEZ
+		dc_bluetooth_inquiry_cancel (iterator);
+#endif
+		iterator->done = 1;
 	}
 
-	return DC_STATUS_DONE;
+	*(dc_bluetooth_device_t **) out = device;
+
+	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
@@ -492,6 +849,8 @@ dc_bluetooth_iterator_free (dc_iterator_t *abstract)
 		WSALookupServiceEnd (iterator->hLookup);
 	}
 #else
+	// Stop a scan that is still in progress.
+	dc_bluetooth_inquiry_cancel (iterator);
 	bt_free(iterator->devices);
 	hci_close_dev(iterator->fd);
 #endif
@@ -501,6 +860,32 @@ dc_bluetooth_iterator_free (dc_iterator_t *abstract)
 }
 #endif
 
+dc_status_t
+dc_bluetooth_set_port (dc_context_t *context, dc_bluetooth_address_t address, unsigned int port)
+{
+	if (context == NULL || port > 30)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_context_set_channel (context, address, port);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bluetooth_get_port (dc_context_t *context, dc_bluetooth_address_t address, unsigned int *port)
+{
+	if (context == NULL || port == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int channel = dc_context_get_channel (context, address);
+	if (channel == 0)
+		return DC_STATUS_UNSUPPORTED;
+
+	*port = channel;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_address_t address, unsigned int port)
 {
@@ -540,11 +925,38 @@ dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_addr
 	} else {
 		memset(&sa.serviceClassId, 0, sizeof(sa.serviceClassId));
 	}
+
+	status = dc_socket_connect (&device->base, (struct sockaddr *) &sa, sizeof (sa));
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_close;
+	}
 #else
 	struct sockaddr_rc sa;
 	sa.rc_family = AF_BLUETOOTH;
 	dc_address_set (&sa.rc_bdaddr, address);
 	if (port == 0) {
+		// Try the channel from a previous service discovery first. The
+		// SDP query is slow, and the channel rarely changes.
+		unsigned int channel = dc_context_get_channel (context, address);
+		if (channel) {
+			sa.rc_channel = channel;
+			status = dc_socket_connect (&device->base, (struct sockaddr *) &sa, sizeof (sa));
+			if (status == DC_STATUS_SUCCESS) {
+				*out = (dc_iostream_t *) device;
+				return DC_STATUS_SUCCESS;
+			}
+
+			WARNING (context, "Failed to connect to the cached channel %u.", channel);
+			dc_context_set_channel (context, address, 0);
+
+			// A socket can't be reused after a failed connect.
+			dc_socket_close (&device->base);
+			status = dc_socket_open (&device->base, AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+			if (status != DC_STATUS_SUCCESS) {
+				goto error_free;
+			}
+		}
+
 		status = dc_bluetooth_sdp (&sa.rc_channel, context, &sa.rc_bdaddr);
 		if (status != DC_STATUS_SUCCESS) {
 			goto error_close;
@@ -552,13 +964,17 @@ dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_addr
 	} else {
 		sa.rc_channel = port;
 	}
-#endif
 
 	status = dc_socket_connect (&device->base, (struct sockaddr *) &sa, sizeof (sa));
 	if (status != DC_STATUS_SUCCESS) {
 		goto error_close;
 	}
 
+	if (port == 0) {
+		dc_context_set_channel (context, address, sa.rc_channel);
+	}
+#endif
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
@@ -0,0 +1,42 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BUFFER_PRIVATE_H
+#define DC_BUFFER_PRIVATE_H
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Create a buffer for internal use, with the memory allocated through
+ * the context. The buffer must not outlive the context.
+ */
+dc_buffer_t *
+dc_buffer_allocate (dc_context_t *context, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BUFFER_PRIVATE_H */
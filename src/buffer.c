@@ -19,51 +19,203 @@
  * MA 02110-1301 USA
  */
 
-#include <stdlib.h> // malloc, realloc, free
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h> // malloc, free
 #include <string.h> // memcpy, memmove
+#include <stdio.h>  // fopen, fwrite, fclose
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#define USE_MMAP
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "buffer-private.h"
+#include "context-private.h"
 
-#include <libdivecomputer/buffer.h>
+/*
+ * Small buffers are stored inline in the buffer object itself, and only
+ * larger buffers need a separate heap allocation.
+ */
+#define INLINE_SIZE 128
 
+/*
+ * A file backed buffer maps the file into memory, and grows the file
+ * along with the buffer, such that the kernel can write the contents
+ * back to disk at any time. Without mmap support, the contents are kept
+ * in memory, and written to the file when the buffer is freed.
+ */
 struct dc_buffer_t {
+	dc_context_t *context;
 	unsigned char *data;
 	size_t capacity, offset, size;
+#ifdef USE_MMAP
+	int fd;
+#else
+	FILE *fp;
+#endif
+	unsigned char storage[INLINE_SIZE];
+};
+
+struct dc_buffer_pool_t {
+	dc_buffer_t **buffers;
+	size_t count, maximum;
 };
 
+#define dc_buffer_is_inline(buffer) ((buffer)->data == (buffer)->storage)
+
+#ifdef USE_MMAP
+#define dc_buffer_is_file(buffer) ((buffer)->fd >= 0)
+#define dc_buffer_is_mapped(buffer) ((buffer)->fd >= 0)
+#else
+#define dc_buffer_is_file(buffer) ((buffer)->fp != NULL)
+#define dc_buffer_is_mapped(buffer) 0
+#endif
+
 dc_buffer_t *
 dc_buffer_new (size_t capacity)
 {
-	dc_buffer_t *buffer = (dc_buffer_t *) malloc (sizeof (dc_buffer_t));
+	return dc_buffer_allocate (NULL, capacity);
+}
+
+
+dc_buffer_t *
+dc_buffer_allocate (dc_context_t *context, size_t capacity)
+{
+	dc_buffer_t *buffer = (dc_buffer_t *) dc_context_malloc (context, sizeof (dc_buffer_t));
 	if (buffer == NULL)
 		return NULL;
 
-	if (capacity) {
-		buffer->data = (unsigned char *) malloc (capacity);
+	buffer->context = context;
+
+	if (capacity > INLINE_SIZE) {
+		buffer->data = (unsigned char *) dc_context_malloc (context, capacity);
 		if (buffer->data == NULL) {
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return NULL;
 		}
 	} else {
-		buffer->data = NULL;
+		buffer->data = buffer->storage;
+		capacity = INLINE_SIZE;
 	}
 
 	buffer->capacity = capacity;
 	buffer->offset = 0;
 	buffer->size = 0;
+#ifdef USE_MMAP
+	buffer->fd = -1;
+#else
+	buffer->fp = NULL;
+#endif
+
+	return buffer;
+}
+
+
+dc_buffer_t *
+dc_buffer_new_file (const char *filename)
+{
+	if (filename == NULL)
+		return NULL;
+
+	dc_buffer_t *buffer = dc_buffer_allocate (NULL, 0);
+	if (buffer == NULL)
+		return NULL;
+
+#ifdef USE_MMAP
+	buffer->fd = open (filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (buffer->fd < 0) {
+		dc_buffer_free (buffer);
+		return NULL;
+	}
+
+	// The file is only mapped once it has a size.
+	buffer->data = NULL;
+	buffer->capacity = 0;
+#else
+	buffer->fp = fopen (filename, "wb");
+	if (buffer->fp == NULL) {
+		dc_buffer_free (buffer);
+		return NULL;
+	}
+#endif
 
 	return buffer;
 }
 
 
+#ifdef USE_MMAP
+static int
+dc_buffer_map (dc_buffer_t *buffer, size_t capacity)
+{
+	if (ftruncate (buffer->fd, capacity) != 0)
+		return 0;
+
+	// The old and the new mapping are both shared mappings of the same
+	// file, so the contents don't need to be copied.
+	void *data = mmap (NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+	if (data == MAP_FAILED)
+		return 0;
+
+	if (buffer->data)
+		munmap (buffer->data, buffer->capacity);
+
+	buffer->data = (unsigned char *) data;
+	buffer->capacity = capacity;
+
+	return 1;
+}
+
+
+static void
+dc_buffer_unmap (dc_buffer_t *buffer)
+{
+	// Move the contents to the start of the file, and cut off the
+	// unused space at the end.
+	if (buffer->size && buffer->offset)
+		memmove (buffer->data, buffer->data + buffer->offset, buffer->size);
+
+	if (buffer->data)
+		munmap (buffer->data, buffer->capacity);
+
+	if (ftruncate (buffer->fd, buffer->size) != 0) {
+		// Nothing we can do about it here.
+	}
+
+	close (buffer->fd);
+}
+#endif
+
+
 void
 dc_buffer_free (dc_buffer_t *buffer)
 {
 	if (buffer == NULL)
 		return;
 
-	if (buffer->data)
-		free (buffer->data);
+#ifdef USE_MMAP
+	if (dc_buffer_is_mapped (buffer)) {
+		dc_buffer_unmap (buffer);
+		dc_context_dealloc (buffer->context, buffer);
+		return;
+	}
+#else
+	if (dc_buffer_is_file (buffer)) {
+		if (buffer->size)
+			fwrite (buffer->data + buffer->offset, 1, buffer->size, buffer->fp);
+		fclose (buffer->fp);
+	}
+#endif
 
-	free (buffer);
+	if (!dc_buffer_is_inline (buffer))
+		dc_context_dealloc (buffer->context, buffer->data);
+
+	dc_context_dealloc (buffer->context, buffer);
 }
 
 
@@ -99,14 +251,29 @@ dc_buffer_expand_append (dc_buffer_t *buffer, size_t n)
 		if (n > buffer->capacity) {
 			size_t capacity = dc_buffer_expand_calc (buffer, n);
 
-			unsigned char *data = (unsigned char *) malloc (capacity);
+#ifdef USE_MMAP
+			if (dc_buffer_is_mapped (buffer)) {
+				if (!dc_buffer_map (buffer, capacity))
+					return 0;
+
+				if (buffer->size && buffer->offset)
+					memmove (buffer->data, buffer->data + buffer->offset, buffer->size);
+
+				buffer->offset = 0;
+
+				return 1;
+			}
+#endif
+
+			unsigned char *data = (unsigned char *) dc_context_malloc (buffer->context, capacity);
 			if (data == NULL)
 				return 0;
 
 			if (buffer->size)
 				memcpy (data, buffer->data + buffer->offset, buffer->size);
 
-			free (buffer->data);
+			if (!dc_buffer_is_inline (buffer))
+				dc_context_dealloc (buffer->context, buffer->data);
 
 			buffer->data = data;
 			buffer->capacity = capacity;
@@ -132,14 +299,29 @@ dc_buffer_expand_prepend (dc_buffer_t *buffer, size_t n)
 		if (n > buffer->capacity) {
 			size_t capacity = dc_buffer_expand_calc (buffer, n);
 
-			unsigned char *data = (unsigned char *) malloc (capacity);
+#ifdef USE_MMAP
+			if (dc_buffer_is_mapped (buffer)) {
+				if (!dc_buffer_map (buffer, capacity))
+					return 0;
+
+				if (buffer->size)
+					memmove (buffer->data + capacity - buffer->size, buffer->data + buffer->offset, buffer->size);
+
+				buffer->offset = capacity - buffer->size;
+
+				return 1;
+			}
+#endif
+
+			unsigned char *data = (unsigned char *) dc_context_malloc (buffer->context, capacity);
 			if (data == NULL)
 				return 0;
 
 			if (buffer->size)
 				memcpy (data + capacity - buffer->size, buffer->data + buffer->offset, buffer->size);
 
-			free (buffer->data);
+			if (!dc_buffer_is_inline (buffer))
+				dc_context_dealloc (buffer->context, buffer->data);
 
 			buffer->data = data;
 			buffer->capacity = capacity;
@@ -165,9 +347,23 @@ dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity)
 	if (capacity <= buffer->capacity)
 		return 1;
 
-	unsigned char *data = (unsigned char *) realloc (buffer->data, capacity);
-	if (data == NULL)
-		return 0;
+#ifdef USE_MMAP
+	if (dc_buffer_is_mapped (buffer))
+		return dc_buffer_map (buffer, capacity);
+#endif
+
+	unsigned char *data = NULL;
+	if (dc_buffer_is_inline (buffer)) {
+		data = (unsigned char *) dc_context_malloc (buffer->context, capacity);
+		if (data == NULL)
+			return 0;
+
+		memcpy (data, buffer->data, buffer->offset + buffer->size);
+	} else {
+		data = (unsigned char *) dc_context_realloc (buffer->context, buffer->data, capacity);
+		if (data == NULL)
+			return 0;
+	}
 
 	buffer->data = data;
 	buffer->capacity = capacity;
@@ -176,6 +372,30 @@ dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity)
 }
 
 
+int
+dc_buffer_reserve_prepend (dc_buffer_t *buffer, size_t capacity)
+{
+	if (buffer == NULL)
+		return 0;
+
+	if (capacity < buffer->size)
+		capacity = buffer->size;
+
+	if (!dc_buffer_reserve (buffer, capacity))
+		return 0;
+
+	// Move the contents to the end of the buffer, to make all the free
+	// space available in front of the data.
+	size_t offset = buffer->capacity - buffer->size;
+	if (buffer->size && buffer->offset != offset)
+		memmove (buffer->data + offset, buffer->data + buffer->offset, buffer->size);
+
+	buffer->offset = offset;
+
+	return 1;
+}
+
+
 int
 dc_buffer_resize (dc_buffer_t *buffer, size_t size)
 {
@@ -265,3 +485,89 @@ dc_buffer_get_data (dc_buffer_t *buffer)
 
 	return buffer->size ? buffer->data + buffer->offset : NULL;
 }
+
+
+dc_buffer_pool_t *
+dc_buffer_pool_new (size_t maximum)
+{
+	dc_buffer_pool_t *pool = (dc_buffer_pool_t *) malloc (sizeof (dc_buffer_pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	if (maximum) {
+		pool->buffers = (dc_buffer_t **) malloc (maximum * sizeof (dc_buffer_t *));
+		if (pool->buffers == NULL) {
+			free (pool);
+			return NULL;
+		}
+	} else {
+		pool->buffers = NULL;
+	}
+
+	pool->count = 0;
+	pool->maximum = maximum;
+
+	return pool;
+}
+
+
+void
+dc_buffer_pool_free (dc_buffer_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	for (size_t i = 0; i < pool->count; ++i)
+		dc_buffer_free (pool->buffers[i]);
+
+	free (pool->buffers);
+	free (pool);
+}
+
+
+dc_buffer_t *
+dc_buffer_pool_acquire (dc_buffer_pool_t *pool, size_t capacity)
+{
+	if (pool == NULL || pool->count == 0)
+		return dc_buffer_new (capacity);
+
+	// Prefer the most recently released buffer that is already large
+	// enough, to avoid growing a buffer when another one would fit.
+	size_t index = pool->count - 1;
+	for (size_t i = pool->count; i-- > 0; ) {
+		if (pool->buffers[i]->capacity >= capacity) {
+			index = i;
+			break;
+		}
+	}
+
+	dc_buffer_t *buffer = pool->buffers[index];
+	pool->buffers[index] = pool->buffers[pool->count - 1];
+	pool->count--;
+
+	if (!dc_buffer_reserve (buffer, capacity)) {
+		dc_buffer_free (buffer);
+		return NULL;
+	}
+
+	return buffer;
+}
+
+
+void
+dc_buffer_pool_release (dc_buffer_pool_t *pool, dc_buffer_t *buffer)
+{
+	if (buffer == NULL)
+		return;
+
+	// A file backed buffer is never reused.
+	if (pool == NULL || pool->count >= pool->maximum || dc_buffer_is_file (buffer)) {
+		dc_buffer_free (buffer);
+		return;
+	}
+
+	// The buffer keeps its capacity, but not its contents.
+	dc_buffer_clear (buffer);
+
+	pool->buffers[pool->count++] = buffer;
+}
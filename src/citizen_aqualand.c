@@ -24,6 +24,7 @@
 
 #include "citizen_aqualand.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "ringbuffer.h"
@@ -48,7 +49,9 @@ static const dc_device_vtable_t citizen_aqualand_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	citizen_aqualand_device_dump, /* dump */
+	NULL, /* dump_update */
 	citizen_aqualand_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -187,7 +190,7 @@ citizen_aqualand_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 {
 	citizen_aqualand_device_t *device = (citizen_aqualand_device_t *) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
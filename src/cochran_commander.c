@@ -20,7 +20,6 @@
  */
 
 #include <string.h> // memcpy, memcmp
-#include <stdlib.h> // malloc, free
 #include <assert.h> // assert
 
 #include "cochran_commander.h"
@@ -28,12 +27,14 @@
 #include "device-private.h"
 #include "array.h"
 #include "ringbuffer.h"
-#include "rbstream.h"
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
 #define MAXRETRIES 2
 
+#define LOWSPEED    9600
+#define SZ_LOWSPEED 0x8000
+
 #define COCHRAN_MODEL_COMMANDER_TM 0
 #define COCHRAN_MODEL_COMMANDER_PRE21000 1
 #define COCHRAN_MODEL_COMMANDER_AIR_NITROX 2
@@ -63,12 +64,19 @@ typedef struct cochran_data_t {
 	unsigned int logbook_size;
 } cochran_data_t;
 
+typedef struct cochran_profile_t {
+	unsigned int idx;
+	unsigned int sample_size;
+	unsigned int pre_size;
+	int corrupt;
+} cochran_profile_t;
+
 typedef struct cochran_device_layout_t {
 	unsigned int model;
 	unsigned int address_bits;
 	cochran_endian_t endian;
 	unsigned int baudrate;
-	unsigned int rbstream_size;
+	unsigned int packet_size;
 	// Config data.
 	unsigned int cf_dive_count;
 	unsigned int cf_last_log;
@@ -95,6 +103,8 @@ typedef struct cochran_commander_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
 	const cochran_device_layout_t *layout;
+	unsigned int baudrate;
+	unsigned int id_address;
 	unsigned char id[67];
 	unsigned char fingerprint[6];
 } cochran_commander_device_t;
@@ -111,7 +121,9 @@ static const dc_device_vtable_t cochran_commander_device_vtable = {
 	cochran_commander_device_read, /* read */
 	NULL, /* write */
 	cochran_commander_device_dump, /* dump */
+	NULL, /* dump_update */
 	cochran_commander_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -122,7 +134,7 @@ static const cochran_device_layout_t cochran_cmdr_tm_device_layout = {
 	24,         // address_bits
 	ENDIAN_WORD_BE,	// endian
 	9600,       // baudrate
-	4096,       // rbstream_size
+	4096,       // packet_size
 	0x146,      // cf_dive_count
 	0x158,      // cf_last_log
 	0xffffff,   // cf_last_interdive
@@ -147,7 +159,7 @@ static const cochran_device_layout_t cochran_cmdr_1_device_layout = {
 	24,         // address_bits
 	ENDIAN_WORD_BE,  // endian
 	115200,     // baudrate
-	32768,      // rbstream_size
+	32768,      // packet_size
 	0x046,      // cf_dive_count
 	0x6c,       // cf_last_log
 	0x70,       // cf_last_interdive
@@ -173,7 +185,7 @@ static const cochran_device_layout_t cochran_cmdr_device_layout = {
 	24,         // address_bits
 	ENDIAN_WORD_BE,  // endian
 	115200,     // baudrate
-	32768,      // rbstream_size
+	32768,      // packet_size
 	0x046,      // cf_dive_count
 	0x06C,      // cf_last_log
 	0x070,      // cf_last_interdive
@@ -198,7 +210,7 @@ static const cochran_device_layout_t cochran_emc14_device_layout = {
 	32,         // address_bits
 	ENDIAN_LE,  // endian
 	850000,     // baudrate
-	32768,      // rbstream_size
+	32768,      // packet_size
 	0x0D2,      // cf_dive_count
 	0x13E,      // cf_last_log
 	0x142,      // cf_last_interdive
@@ -223,7 +235,7 @@ static const cochran_device_layout_t cochran_emc16_device_layout = {
 	32,         // address_bits
 	ENDIAN_LE,  // endian
 	850000,     // baudrate
-	32768,      // rbstream_size
+	32768,      // packet_size
 	0x0D2,      // cf_dive_count
 	0x13E,      // cf_last_log
 	0x142,      // cf_last_interdive
@@ -248,7 +260,7 @@ static const cochran_device_layout_t cochran_emc20_device_layout = {
 	32,         // address_bits
 	ENDIAN_LE,  // endian
 	850000,     // baudrate
-	32768,      // rbstream_size
+	32768,      // packet_size
 	0x0D2,      // cf_dive_count
 	0x13E,      // cf_last_log
 	0x142,      // cf_last_interdive
@@ -366,12 +378,12 @@ cochran_commander_packet (cochran_commander_device_t *device, dc_event_progress_
 		}
 	}
 
-	if (high_speed && device->layout->baudrate != 9600) {
+	if (high_speed && device->baudrate != LOWSPEED) {
 		// Give the DC time to process the command.
 		dc_iostream_sleep(device->iostream, 45);
 
 		// Rates are odd, like 850400 for the EMC, 115200 for commander
-		status = dc_iostream_configure(device->iostream, device->layout->baudrate, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
+		status = dc_iostream_configure(device->iostream, device->baudrate, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to set the high baud rate.");
 			return status;
@@ -415,6 +427,8 @@ cochran_commander_read_id (cochran_commander_device_t *device, unsigned char id[
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	device->id_address = 0xFF9D;
+
 	if (memcmp(id, "(C)", 3) != 0) {
 		// It's a Commander, read a different location
 		command[1] = 0xBD;
@@ -423,6 +437,8 @@ cochran_commander_read_id (cochran_commander_device_t *device, unsigned char id[
 		rc = cochran_commander_packet(device, NULL, command, sizeof(command), id, size, 0);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
+
+		device->id_address = 0x7FBD;
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -468,43 +484,54 @@ cochran_commander_read (cochran_commander_device_t *device, dc_event_progress_t
 	// Build the command
 	unsigned char command[10];
 	unsigned char command_size;
-
-	switch (device->layout->address_bits) {
-	case 32:
-		// EMC uses 32 bit addressing
-		command[0] = 0x15;
-		command[1] = (address      ) & 0xff;
-		command[2] = (address >>  8) & 0xff;
-		command[3] = (address >> 16) & 0xff;
-		command[4] = (address >> 24) & 0xff;
-		command[5] = (size         ) & 0xff;
-		command[6] = (size >>  8   ) & 0xff;
-		command[7] = (size >> 16   ) & 0xff;
-		command[8] = (size >> 24   ) & 0xff;
-		command[9] = 0x05;
-		command_size = 10;
-		break;
-	case 24:
-		// Commander uses 24 byte addressing
-		if (device->layout->baudrate == 9600) {
+	unsigned int length = size;
+
+	if (device->baudrate == LOWSPEED) {
+		if (device->layout->baudrate != LOWSPEED) {
+			// A device with a high-speed read command, running at the
+			// low speed after a failed negotiation. The low-speed command
+			// only supports 24 bit addresses and 16 bit sizes, so larger
+			// reads are split into multiple requests.
+			if (address + size > 0x1000000)
+				return DC_STATUS_UNSUPPORTED;
+			if (length > SZ_LOWSPEED)
+				length = SZ_LOWSPEED;
+		} else {
 			// This read command will return 32K bytes if asked to read
 			// 0 bytes. So we can allow a size of up to 0x10000 but if
 			// the user asks for 0 bytes we should just return success
 			// otherwise we'll end end up running past the buffer.
 			if (size > 0x10000)
 				return DC_STATUS_INVALIDARGS;
-			if (size == 0)
-				return DC_STATUS_SUCCESS;
+		}
+		if (size == 0)
+			return DC_STATUS_SUCCESS;
 
-			// Older commander, use low-speed read command
-			command[0] = 0x05;
+		// Use the low-speed read command
+		command[0] = 0x05;
+		command[1] = (address      ) & 0xff;
+		command[2] = (address >>  8) & 0xff;
+		command[3] = (address >> 16) & 0xff;
+		command[4] = (length       ) & 0xff;
+		command[5] = (length >> 8  ) & 0xff;
+		command_size = 6;
+	} else {
+		switch (device->layout->address_bits) {
+		case 32:
+			// EMC uses 32 bit addressing
+			command[0] = 0x15;
 			command[1] = (address      ) & 0xff;
 			command[2] = (address >>  8) & 0xff;
 			command[3] = (address >> 16) & 0xff;
-			command[4] = (size         ) & 0xff;
-			command[5] = (size >> 8    ) & 0xff;
-			command_size = 6;
-		} else {
+			command[4] = (address >> 24) & 0xff;
+			command[5] = (size         ) & 0xff;
+			command[6] = (size >>  8   ) & 0xff;
+			command[7] = (size >> 16   ) & 0xff;
+			command[8] = (size >> 24   ) & 0xff;
+			command[9] = 0x05;
+			command_size = 10;
+			break;
+		case 24:
 			// Newer commander with high-speed read command
 			command[0] = 0x15;
 			command[1] = (address      ) & 0xff;
@@ -515,10 +542,10 @@ cochran_commander_read (cochran_commander_device_t *device, dc_event_progress_t
 			command[6] = (size >> 16   ) & 0xff;
 			command[7] = 0x04;
 			command_size = 8;
+			break;
+		default:
+			return DC_STATUS_UNSUPPORTED;
 		}
-		break;
-	default:
-		return DC_STATUS_UNSUPPORTED;
 	}
 
 	dc_iostream_sleep(device->iostream, 550);
@@ -529,10 +556,56 @@ cochran_commander_read (cochran_commander_device_t *device, dc_event_progress_t
 		return rc;
 
 	// Read data at high speed
-	rc = cochran_commander_packet (device, progress, command, command_size, data, size, 1);
+	rc = cochran_commander_packet (device, progress, command, command_size, data, length, 1);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	// Read the remaining data.
+	if (length < size)
+		return cochran_commander_read (device, progress, address + length, data + length, size - length);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+/*
+ * Select the highest baudrate that works. The high-speed read command of
+ * the device is verified by reading the id again, and if that fails, the
+ * download falls back to the low-speed read command. Not every usb serial
+ * adapter supports the odd high baudrates of the EMC reliably.
+ */
+static dc_status_t
+cochran_commander_negotiate (cochran_commander_device_t *device)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned char id[sizeof (device->id)];
+
+	const unsigned int baudrates[] = {device->layout->baudrate, LOWSPEED};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(baudrates); ++i) {
+		device->baudrate = baudrates[i];
+		if (device->baudrate == LOWSPEED)
+			break;
+
+		rc = cochran_commander_read (device, NULL, device->id_address, id, sizeof (id));
+		if (rc == DC_STATUS_CANCELLED)
+			return rc;
+		if (rc == DC_STATUS_SUCCESS && memcmp (id, device->id, sizeof (id)) == 0)
+			break;
+
+		WARNING (device->base.context, "Failed to communicate at %u baud.", device->baudrate);
+	}
+
+	if (device->baudrate != device->layout->baudrate) {
+		WARNING (device->base.context, "Using the low-speed read command.");
+	}
+
+	// Return to the default baudrate for the next commands.
+	if (device->layout->baudrate != LOWSPEED) {
+		rc = cochran_commander_serial_setup (device);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -546,16 +619,14 @@ cochran_commander_read_retry (cochran_commander_device_t *device, dc_event_progr
 		saved = progress->current;
 	}
 
-	unsigned int nretries = 0;
+	device_retry_t retry;
+	device_retry_init (&retry, (dc_device_t *) device, MAXRETRIES, 0);
+
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = cochran_commander_read (device, progress, address, data, size)) != DC_STATUS_SUCCESS) {
 		// Automatically discard a corrupted packet,
 		// and request a new one.
-		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
-			return rc;
-
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		if (!device_retry_next (&retry, device->iostream, rc))
 			return rc;
 
 		// Restore the state of the progress events.
@@ -568,6 +639,41 @@ cochran_commander_read_retry (cochran_commander_device_t *device, dc_event_progr
 }
 
 
+/*
+ * Read the data that ends at the specified address in the profile
+ * ringbuffer. The data is read with as few requests as possible, taking
+ * into account the maximum packet size and the ringbuffer wrap point.
+ */
+static dc_status_t
+cochran_commander_read_profile (cochran_commander_device_t *device, dc_event_progress_t *progress, unsigned int address, unsigned char data[], unsigned int size)
+{
+	const cochran_device_layout_t *layout = device->layout;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		// Handle the ringbuffer wrap point.
+		if (address == layout->rb_profile_begin)
+			address = layout->rb_profile_end;
+
+		unsigned int len = size - nbytes;
+		if (len > layout->packet_size)
+			len = layout->packet_size;
+		if (len > address - layout->rb_profile_begin)
+			len = address - layout->rb_profile_begin;
+
+		address -= len;
+		nbytes += len;
+
+		rc = cochran_commander_read_retry (device, progress, address, data + size - nbytes, len);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 /*
  *  For corrupt dives the end-of-samples pointer is 0xFFFFFFFF
  *  search for a reasonable size, e.g. using next dive start sample
@@ -731,6 +837,8 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, dc_iost
 
 	// Set the default values.
 	device->iostream = iostream;
+	device->baudrate = LOWSPEED;
+	device->id_address = 0;
 	cochran_commander_device_set_fingerprint((dc_device_t *) device, NULL, 0);
 
 	status = cochran_commander_serial_setup(device);
@@ -771,6 +879,12 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, dc_iost
 		goto error_free;
 	}
 
+	// Select the baudrate.
+	status = cochran_commander_negotiate (device);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
 	*out = (dc_device_t *) device;
 
 	return DC_STATUS_SUCCESS;
@@ -856,7 +970,8 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	cochran_commander_device_t *device = (cochran_commander_device_t *) abstract;
 	const cochran_device_layout_t *layout = device->layout;
 	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_rbstream_t *rbstream = NULL;
+	cochran_profile_t *profiles = NULL;
+	unsigned char *profile = NULL;
 
 	cochran_data_t data;
 	data.logbook = NULL;
@@ -910,7 +1025,7 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate space for log book.
-	data.logbook = (unsigned char *) malloc(data.logbook_size);
+	data.logbook = (unsigned char *) dc_context_malloc (abstract->context, data.logbook_size);
 	if (data.logbook == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -965,21 +1080,35 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	else
 		last_start_address = base + array_uint32_le(data.config + layout->cf_last_log );
 
-	// Create the ringbuffer stream.
-	status = dc_rbstream_new (&rbstream, abstract, 1, layout->rbstream_size, layout->rb_profile_begin, layout->rb_profile_end, last_start_address);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+	if (last_start_address < layout->rb_profile_begin || last_start_address > layout->rb_profile_end) {
+		ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%08x).", last_start_address);
+		status = DC_STATUS_DATAFORMAT;
 		goto error;
 	}
 
-	int invalid_profile_flag = 0;
+	profiles = (cochran_profile_t *) dc_context_malloc (abstract->context, dive_count * sizeof (cochran_profile_t));
+	if (dive_count && profiles == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error;
+	}
 
-	// Loop through each dive
+	// Locate the profile data of the new dives. The profiles are stored
+	// contiguously, so the sample data of all dives can be downloaded
+	// with the minimum number of read requests.
+	unsigned int profile_end = last_start_address;
+	unsigned int profile_size = 0;
+	int invalid_profile_flag = 0;
 	for (unsigned int i = 0; i < dive_count; ++i) {
 		unsigned int idx = (layout->rb_logbook_entry_count + head_dive - (i + 1)) % layout->rb_logbook_entry_count;
 
 		unsigned char *log_entry = data.logbook + idx * layout->rb_logbook_entry_size;
 
+		profiles[i].idx = idx;
+		profiles[i].sample_size = 0;
+		profiles[i].pre_size = 0;
+		profiles[i].corrupt = 0;
+
 		unsigned int sample_start_address = 0;
 		unsigned int sample_end_address = 0;
 		if (layout->model == COCHRAN_MODEL_COMMANDER_TM) {
@@ -991,6 +1120,7 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 				sample_end_address < layout->rb_profile_begin || sample_end_address > layout->rb_profile_end ||
 				array_uint16_le(log_entry + layout->pt_dive_number) % layout->rb_logbook_entry_count != idx) {
 				ERROR(abstract->context, "Corrupt dive (%d).", idx);
+				profiles[i].corrupt = 1;
 				continue;
 			}
 		} else {
@@ -998,21 +1128,59 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 			sample_end_address = base + array_uint32_le (log_entry + layout->pt_profile_end);
 		}
 
-		int sample_size = 0, pre_size = 0;
-
 		// Determine if profile exists
 		if (idx == data.invalid_profile_dive_num)
 			invalid_profile_flag = 1;
 
 		if (!invalid_profile_flag) {
-			sample_size = cochran_commander_profile_size(device, &data, idx, sample_start_address, sample_end_address);
-			pre_size = cochran_commander_profile_size(device, &data, idx, sample_end_address, last_start_address);
+			profiles[i].sample_size = cochran_commander_profile_size(device, &data, idx, sample_start_address, sample_end_address);
+			profiles[i].pre_size = cochran_commander_profile_size(device, &data, idx, sample_end_address, last_start_address);
 			last_start_address = sample_start_address;
 		}
 
+		if (profiles[i].sample_size)
+			profile_size += profiles[i].sample_size + profiles[i].pre_size;
+	}
+
+	if (profile_size > layout->rb_profile_end - layout->rb_profile_begin) {
+		ERROR (abstract->context, "Invalid profile size (%u).", profile_size);
+		status = DC_STATUS_DATAFORMAT;
+		goto error;
+	}
+
+	// Update progress indicator with the exact size.
+	progress.maximum -= profile_read_size;
+	progress.maximum += profile_size;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the profile data.
+	profile = (unsigned char *) dc_context_malloc (abstract->context, profile_size);
+	if (profile_size && profile == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error;
+	}
+
+	rc = cochran_commander_read_profile (device, &progress, profile_end, profile, profile_size);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the sample data.");
+		status = rc;
+		goto error;
+	}
+
+	// Loop through each dive
+	unsigned int offset = profile_size;
+	for (unsigned int i = 0; i < dive_count; ++i) {
+		if (profiles[i].corrupt)
+			continue;
+
+		unsigned char *log_entry = data.logbook + profiles[i].idx * layout->rb_logbook_entry_size;
+		unsigned int sample_size = profiles[i].sample_size;
+		unsigned int pre_size = profiles[i].pre_size;
+
 		// Build dive blob
 		unsigned int dive_size = layout->rb_logbook_entry_size + sample_size;
-		unsigned char *dive = (unsigned char *) malloc(dive_size + pre_size);
+		unsigned char *dive = (unsigned char *) dc_context_malloc (abstract->context, dive_size + pre_size);
 		if (dive == NULL) {
 			status = DC_STATUS_NOMEMORY;
 			goto error;
@@ -1020,27 +1188,23 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 
 		memcpy(dive, log_entry, layout->rb_logbook_entry_size); // log
 
-		// Read profile data
+		// Copy the profile data
 		if (sample_size) {
-			rc = dc_rbstream_read(rbstream, &progress, dive + layout->rb_logbook_entry_size, sample_size + pre_size);
-			if (rc != DC_STATUS_SUCCESS) {
-				ERROR (abstract->context, "Failed to read the sample data.");
-				status = rc;
-				free(dive);
-				goto error;
-			}
+			offset -= sample_size + pre_size;
+			memcpy(dive + layout->rb_logbook_entry_size, profile + offset, sample_size + pre_size);
 		}
 
 		if (callback && !callback (dive, dive_size, dive + layout->pt_fingerprint, layout->fingerprint_size, userdata)) {
-			free(dive);
+			dc_context_dealloc (abstract->context, dive);
 			break;
 		}
 
-		free(dive);
+		dc_context_dealloc (abstract->context, dive);
 	}
 
 error:
-	dc_rbstream_free(rbstream);
-	free(data.logbook);
+	dc_context_dealloc (abstract->context, profile);
+	dc_context_dealloc (abstract->context, profiles);
+	dc_context_dealloc (abstract->context, data.logbook);
 	return status;
 }
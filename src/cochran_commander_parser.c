@@ -101,6 +101,21 @@ typedef struct cochran_commander_parser_t {
 	unsigned int nevents;
 } cochran_commander_parser_t ;
 
+/*
+ * The event lookup table doesn't depend on the model, and is shared by
+ * all parsers.
+ */
+typedef struct cochran_commander_env_t {
+	dc_parser_env_t base;
+	unsigned char eventmap[256]; // One based index into the event table
+} cochran_commander_env_t;
+
+static dc_status_t cochran_commander_env_init (dc_parser_env_t *env);
+
+static cochran_commander_env_t cochran_commander_env = {
+	DC_PARSER_ENV_INIT(cochran_commander_env_init)
+};
+
 static dc_status_t cochran_commander_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
 static dc_status_t cochran_commander_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime);
 static dc_status_t cochran_commander_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value);
@@ -272,20 +287,15 @@ cochran_commander_handle_event (cochran_commander_parser_t *parser, unsigned cha
 {
 	dc_parser_t *abstract = (dc_parser_t *) parser;
 
-	const cochran_events_t *event = NULL;
-	for (unsigned int i = 0; i < C_ARRAY_SIZE(cochran_events); ++i) {
-		if (cochran_events[i].code == code) {
-			event = cochran_events + i;
-			break;
-		}
-	}
-
-	if (event == NULL) {
+	if (cochran_commander_env.eventmap[code] == 0) {
 		// Unknown event, send warning so we know we missed something
 		WARNING(abstract->context, "Unknown event 0x%02x", code);
+		dc_parser_skipped (abstract);
 		return 1;
 	}
 
+	const cochran_events_t *event = cochran_events + cochran_commander_env.eventmap[code] - 1;
+
 	switch (code) {
 	case 0xAB: // Ceiling decrease
 		// Indicated to lower ceiling by 10 ft (deeper)
@@ -350,6 +360,24 @@ cochran_commander_backparse(cochran_commander_parser_t *parser, const unsigned c
 }
 
 
+static dc_status_t
+cochran_commander_env_init (dc_parser_env_t *abstract)
+{
+	cochran_commander_env_t *env = (cochran_commander_env_t *) abstract;
+
+	// Build the event lookup table.
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(env->eventmap); ++i) {
+		env->eventmap[i] = 0;
+	}
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(cochran_events); ++i) {
+		unsigned char code = cochran_events[i].code;
+		if (env->eventmap[code] == 0)
+			env->eventmap[code] = i + 1;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 cochran_commander_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model)
 {
@@ -396,6 +424,10 @@ cochran_commander_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 		goto error_free;
 	}
 
+	status = dc_parser_env_get (&cochran_commander_env.base);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
 	*out = (dc_parser_t *) parser;
 
 	return DC_STATUS_SUCCESS;
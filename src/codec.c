@@ -0,0 +1,566 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/codec.h>
+
+#include "context-private.h"
+#include "buffer-private.h"
+#include "array.h"
+#include "hash.h"
+
+#define MAGIC   0x015A4344 // "DCZ" + format 1
+
+#define HEADERSIZE  4
+#define BLOCKHEADER 9
+#define TRAILERSIZE 4
+#define BLOCKSIZE   0x10000
+
+// Block encodings.
+#define CODEC_STORE 0
+#define CODEC_FILL  1
+#define CODEC_LZ    2
+#define CODEC_DELTA 3
+
+// Parameters of the LZ77 compression.
+#define MINMATCH  4
+#define MAXOFFSET 0xFFFF
+#define HASHLOG   12
+#define HASHSIZE  (1 << HASHLOG)
+#define SKIPLOG   6
+
+typedef enum codec_state_t {
+	CODEC_HEADER,
+	CODEC_BLOCK,
+	CODEC_TRAILER,
+	CODEC_DONE,
+} codec_state_t;
+
+struct dc_codec_decoder_t {
+	dc_context_t *context;
+	codec_state_t state;
+	hash_xxh64_t hash;
+	dc_buffer_t *pending;
+};
+
+typedef struct codec_encoder_t {
+	unsigned int table[HASHSIZE];
+	unsigned char delta[BLOCKSIZE];
+	unsigned char scratch[BLOCKSIZE];
+} codec_encoder_t;
+
+static unsigned int
+codec_lz_hash (const unsigned char data[])
+{
+	return (array_uint32_le (data) * 2654435761u) >> (32 - HASHLOG);
+}
+
+static size_t
+codec_lz_length_size (size_t value)
+{
+	return value >= 15 ? (value - 15) / 255 + 1 : 0;
+}
+
+static void
+codec_lz_length_put (unsigned char dst[], size_t *op, size_t value)
+{
+	if (value < 15)
+		return;
+
+	value -= 15;
+	while (value >= 255) {
+		dst[(*op)++] = 255;
+		value -= 255;
+	}
+	dst[(*op)++] = value;
+}
+
+static int
+codec_lz_length_get (const unsigned char src[], size_t size, size_t *ip, size_t *value)
+{
+	unsigned int byte = 0;
+	do {
+		if (*ip >= size)
+			return 0;
+		byte = src[(*ip)++];
+		*value += byte;
+	} while (byte == 255);
+
+	return 1;
+}
+
+static int
+codec_lz_sequence (unsigned char dst[], size_t capacity, size_t *op, const unsigned char literals[], size_t litlen, size_t offset, size_t matchlen)
+{
+	size_t needed = 1 + codec_lz_length_size (litlen) + litlen;
+	if (matchlen)
+		needed += 2 + codec_lz_length_size (matchlen - MINMATCH);
+	if (needed > capacity - *op)
+		return 0;
+
+	unsigned int token = (litlen < 15 ? litlen : 15) << 4;
+	if (matchlen)
+		token |= (matchlen - MINMATCH < 15 ? matchlen - MINMATCH : 15);
+	dst[(*op)++] = token;
+
+	codec_lz_length_put (dst, op, litlen);
+	memcpy (dst + *op, literals, litlen);
+	*op += litlen;
+
+	if (matchlen) {
+		array_uint16_le_set (dst + *op, offset);
+		*op += 2;
+		codec_lz_length_put (dst, op, matchlen - MINMATCH);
+	}
+
+	return 1;
+}
+
+/*
+ * Compress a block with a greedy LZ77 matcher, in the sequence format
+ * of LZ4. Returns the size of the compressed data, or zero if it does
+ * not fit within the capacity.
+ */
+static size_t
+codec_lz_encode (unsigned int table[], const unsigned char src[], size_t size, unsigned char dst[], size_t capacity)
+{
+	size_t ip = 0, anchor = 0, op = 0;
+
+	memset (table, 0, HASHSIZE * sizeof (unsigned int));
+
+	while (ip + MINMATCH <= size) {
+		unsigned int h = codec_lz_hash (src + ip);
+		size_t ref = table[h];
+		table[h] = ip + 1;
+
+		if (ref == 0 || ip - (ref - 1) > MAXOFFSET ||
+			memcmp (src + ref - 1, src + ip, MINMATCH) != 0) {
+			// Skip faster through data that does not compress.
+			ip += 1 + ((ip - anchor) >> SKIPLOG);
+			continue;
+		}
+		ref--;
+
+		size_t len = MINMATCH;
+		while (ip + len < size && src[ref + len] == src[ip + len])
+			len++;
+
+		if (!codec_lz_sequence (dst, capacity, &op, src + anchor, ip - anchor, ip - ref, len))
+			return 0;
+
+		ip += len;
+		anchor = ip;
+	}
+
+	if (anchor < size) {
+		if (!codec_lz_sequence (dst, capacity, &op, src + anchor, size - anchor, 0, 0))
+			return 0;
+	}
+
+	return op;
+}
+
+static int
+codec_lz_decode (const unsigned char src[], size_t size, unsigned char dst[], size_t rawsize)
+{
+	size_t ip = 0, op = 0;
+
+	while (op < rawsize) {
+		if (ip >= size)
+			return 0;
+		unsigned int token = src[ip++];
+
+		// Literals.
+		size_t litlen = token >> 4;
+		if (litlen == 15 && !codec_lz_length_get (src, size, &ip, &litlen))
+			return 0;
+		if (litlen > size - ip || litlen > rawsize - op)
+			return 0;
+		memcpy (dst + op, src + ip, litlen);
+		ip += litlen;
+		op += litlen;
+
+		// The last sequence has no match.
+		if (op == rawsize)
+			break;
+
+		// Match.
+		if (size - ip < 2)
+			return 0;
+		size_t offset = array_uint16_le (src + ip);
+		ip += 2;
+		size_t matchlen = token & 0x0F;
+		if (matchlen == 15 && !codec_lz_length_get (src, size, &ip, &matchlen))
+			return 0;
+		matchlen += MINMATCH;
+		if (offset == 0 || offset > op || matchlen > rawsize - op)
+			return 0;
+
+		// The source and destination overlap for repeating patterns,
+		// so copy byte by byte in that case.
+		const unsigned char *ref = dst + op - offset;
+		if (offset >= matchlen) {
+			memcpy (dst + op, ref, matchlen);
+		} else {
+			for (size_t i = 0; i < matchlen; ++i)
+				dst[op + i] = ref[i];
+		}
+		op += matchlen;
+	}
+
+	return ip == size;
+}
+
+static size_t
+codec_encode_block (codec_encoder_t *encoder, const unsigned char src[], size_t size, unsigned char dst[])
+{
+	unsigned char *payload = dst + BLOCKHEADER;
+	unsigned int filter = CODEC_STORE;
+	size_t n = 0;
+
+	// Erased or unused memory.
+	size_t i = 1;
+	while (i < size && src[i] == src[0])
+		i++;
+
+	if (i == size) {
+		filter = CODEC_FILL;
+		payload[0] = src[0];
+		n = 1;
+	} else {
+		n = codec_lz_encode (encoder->table, src, size, payload, size - 1);
+		if (n)
+			filter = CODEC_LZ;
+
+		// Sample data often compresses better as the differences
+		// between consecutive bytes.
+		encoder->delta[0] = src[0];
+		for (i = 1; i < size; ++i)
+			encoder->delta[i] = src[i] - src[i - 1];
+
+		size_t m = codec_lz_encode (encoder->table, encoder->delta, size, encoder->scratch, (n ? n : size) - 1);
+		if (m) {
+			filter = CODEC_DELTA;
+			memcpy (payload, encoder->scratch, m);
+			n = m;
+		}
+
+		if (filter == CODEC_STORE) {
+			memcpy (payload, src, size);
+			n = size;
+		}
+	}
+
+	dst[0] = filter;
+	array_uint32_le_set (dst + 1, size);
+	array_uint32_le_set (dst + 5, n);
+
+	return BLOCKHEADER + n;
+}
+
+static int
+codec_decode_block (unsigned int filter, const unsigned char src[], size_t size, unsigned char dst[], size_t rawsize)
+{
+	switch (filter) {
+	case CODEC_STORE:
+		if (size != rawsize)
+			return 0;
+		memcpy (dst, src, size);
+		break;
+	case CODEC_FILL:
+		if (size != 1)
+			return 0;
+		memset (dst, src[0], rawsize);
+		break;
+	case CODEC_LZ:
+		if (!codec_lz_decode (src, size, dst, rawsize))
+			return 0;
+		break;
+	case CODEC_DELTA:
+		if (!codec_lz_decode (src, size, dst, rawsize))
+			return 0;
+		for (size_t i = 1; i < rawsize; ++i)
+			dst[i] += dst[i - 1];
+		break;
+	default:
+		return 0;
+	}
+
+	return 1;
+}
+
+int
+dc_codec_detect (const unsigned char data[], size_t size)
+{
+	return data != NULL && size >= HEADERSIZE && array_uint32_le (data) == MAGIC;
+}
+
+dc_status_t
+dc_codec_compress (dc_context_t *context, const unsigned char data[], size_t size, dc_buffer_t *output)
+{
+	if (output == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	codec_encoder_t *encoder = (codec_encoder_t *) dc_context_malloc (context, sizeof (codec_encoder_t));
+	if (encoder == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	size_t offset = dc_buffer_get_size (output);
+	size_t nblocks = (size + BLOCKSIZE - 1) / BLOCKSIZE;
+
+	// Reserve enough space for the worst case, where every block is
+	// stored without compression.
+	if (!dc_buffer_resize (output, offset + HEADERSIZE + nblocks * BLOCKHEADER + size + BLOCKHEADER + TRAILERSIZE)) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_context_dealloc (context, encoder);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *dst = dc_buffer_get_data (output) + offset;
+	size_t n = 0;
+
+	hash_xxh64_t hash;
+	hash_xxh64_init (&hash, 0);
+
+	array_uint32_le_set (dst, MAGIC);
+	n += HEADERSIZE;
+
+	for (size_t i = 0; i < size; i += BLOCKSIZE) {
+		size_t len = size - i < BLOCKSIZE ? size - i : BLOCKSIZE;
+		hash_xxh64_update (&hash, data + i, len);
+		n += codec_encode_block (encoder, data + i, len, dst + n);
+	}
+
+	// End of stream marker.
+	memset (dst + n, 0, BLOCKHEADER);
+	n += BLOCKHEADER;
+
+	array_uint32_le_set (dst + n, hash_xxh64_final (&hash) & 0xFFFFFFFF);
+	n += TRAILERSIZE;
+
+	dc_buffer_resize (output, offset + n);
+
+	dc_context_dealloc (context, encoder);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Decode as much of the stream as possible. The number of bytes
+ * consumed is returned, and any remaining bytes belong to an incomplete
+ * block.
+ */
+static dc_status_t
+dc_codec_decoder_process (dc_codec_decoder_t *decoder, const unsigned char data[], size_t size, dc_buffer_t *output, size_t *consumed)
+{
+	size_t n = 0;
+
+	while (decoder->state != CODEC_DONE) {
+		size_t available = size - n;
+
+		if (decoder->state == CODEC_HEADER) {
+			if (available < HEADERSIZE)
+				break;
+			if (array_uint32_le (data + n) != MAGIC) {
+				ERROR (decoder->context, "Unexpected compressed stream signature.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			n += HEADERSIZE;
+			decoder->state = CODEC_BLOCK;
+		} else if (decoder->state == CODEC_BLOCK) {
+			if (available < BLOCKHEADER)
+				break;
+			unsigned int filter = data[n];
+			size_t rawsize = array_uint32_le (data + n + 1);
+			size_t encsize = array_uint32_le (data + n + 5);
+			if (rawsize > BLOCKSIZE || encsize > rawsize ||
+				(rawsize == 0 && filter != CODEC_STORE)) {
+				ERROR (decoder->context, "Invalid compressed block (%u %u).",
+					(unsigned int) rawsize, (unsigned int) encsize);
+				return DC_STATUS_DATAFORMAT;
+			}
+			if (available < BLOCKHEADER + encsize)
+				break;
+
+			if (rawsize == 0) {
+				decoder->state = CODEC_TRAILER;
+			} else {
+				size_t offset = dc_buffer_get_size (output);
+				if (!dc_buffer_resize (output, offset + rawsize)) {
+					ERROR (decoder->context, "Failed to allocate memory.");
+					return DC_STATUS_NOMEMORY;
+				}
+
+				unsigned char *dst = dc_buffer_get_data (output) + offset;
+				if (!codec_decode_block (filter, data + n + BLOCKHEADER, encsize, dst, rawsize)) {
+					ERROR (decoder->context, "Corrupt compressed block.");
+					dc_buffer_resize (output, offset);
+					return DC_STATUS_DATAFORMAT;
+				}
+
+				hash_xxh64_update (&decoder->hash, dst, rawsize);
+			}
+
+			n += BLOCKHEADER + encsize;
+		} else {
+			if (available < TRAILERSIZE)
+				break;
+			unsigned int checksum = array_uint32_le (data + n);
+			if (checksum != (hash_xxh64_final (&decoder->hash) & 0xFFFFFFFF)) {
+				ERROR (decoder->context, "Unexpected compressed stream checksum.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			n += TRAILERSIZE;
+			decoder->state = CODEC_DONE;
+		}
+	}
+
+	if (decoder->state == CODEC_DONE && n != size) {
+		ERROR (decoder->context, "Unexpected data after the compressed stream.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	*consumed = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_codec_decompress (dc_context_t *context, const unsigned char data[], size_t size, dc_buffer_t *output)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_codec_decoder_t decoder;
+	size_t consumed = 0;
+
+	if (output == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	decoder.context = context;
+	decoder.state = CODEC_HEADER;
+	decoder.pending = NULL;
+	hash_xxh64_init (&decoder.hash, 0);
+
+	status = dc_codec_decoder_process (&decoder, data, size, output, &consumed);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	return dc_codec_decoder_finish (&decoder);
+}
+
+dc_status_t
+dc_codec_decoder_new (dc_codec_decoder_t **out, dc_context_t *context)
+{
+	dc_codec_decoder_t *decoder = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	decoder = (dc_codec_decoder_t *) dc_context_malloc (context, sizeof (dc_codec_decoder_t));
+	if (decoder == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	decoder->pending = dc_buffer_allocate (context, 0);
+	if (decoder->pending == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_context_dealloc (context, decoder);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	decoder->context = context;
+	decoder->state = CODEC_HEADER;
+	hash_xxh64_init (&decoder->hash, 0);
+
+	*out = decoder;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_codec_decoder_update (dc_codec_decoder_t *decoder, const unsigned char data[], size_t size, dc_buffer_t *output)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t consumed = 0;
+
+	if (decoder == NULL || output == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	size_t npending = dc_buffer_get_size (decoder->pending);
+	if (npending == 0) {
+		// Decode directly from the input, and keep only the incomplete
+		// block at the end.
+		status = dc_codec_decoder_process (decoder, data, size, output, &consumed);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (!dc_buffer_append (decoder->pending, data + consumed, size - consumed)) {
+			ERROR (decoder->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	} else {
+		if (!dc_buffer_append (decoder->pending, data, size)) {
+			ERROR (decoder->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		status = dc_codec_decoder_process (decoder,
+			dc_buffer_get_data (decoder->pending),
+			dc_buffer_get_size (decoder->pending),
+			output, &consumed);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		dc_buffer_slice (decoder->pending, consumed, dc_buffer_get_size (decoder->pending) - consumed);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_codec_decoder_finish (dc_codec_decoder_t *decoder)
+{
+	if (decoder == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (decoder->state != CODEC_DONE) {
+		ERROR (decoder->context, "Truncated compressed stream.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_codec_decoder_free (dc_codec_decoder_t *decoder)
+{
+	if (decoder == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_buffer_free (decoder->pending);
+	dc_context_dealloc (decoder->context, decoder);
+
+	return DC_STATUS_SUCCESS;
+}
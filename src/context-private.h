@@ -28,6 +28,8 @@
 
 #include <libdivecomputer/context.h>
 
+#include "timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -71,6 +73,82 @@ dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *
 dc_status_t
 dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size);
 
+/*
+ * Tracing of a single protocol transfer. The span is cheap when no trace
+ * function is registered, so the backends can call it unconditionally.
+ */
+typedef struct dc_trace_span_t {
+	const char *function;
+	unsigned int command;
+	unsigned int isize;
+	unsigned int osize;
+	dc_usecs_t begin;
+	int active;
+} dc_trace_span_t;
+
+#define TRACE_BEGIN(context, span, command, isize, osize) dc_context_trace_begin (context, span, FUNCTION, command, isize, osize)
+#define TRACE_END(context, span, status) dc_context_trace_end (context, span, status)
+
+void
+dc_context_trace_begin (dc_context_t *context, dc_trace_span_t *span, const char *function, unsigned int command, unsigned int isize, unsigned int osize);
+
+void
+dc_context_trace_end (dc_context_t *context, dc_trace_span_t *span, dc_status_t status);
+
+/*
+ * Memory allocation through the allocator of the context. A NULL context,
+ * or a context without a custom allocator, uses the standard C library.
+ */
+void *
+dc_context_malloc (dc_context_t *context, size_t size);
+
+void *
+dc_context_realloc (dc_context_t *context, void *ptr, size_t size);
+
+void
+dc_context_dealloc (dc_context_t *context, void *ptr);
+
+/*
+ * Run a task through the executor of the context, which is the built-in
+ * thread pool unless the application installed its own. A NULL context
+ * starts a dedicated thread for the task. Every submitted task must be
+ * waited for exactly once.
+ */
+dc_status_t
+dc_context_submit (dc_context_t *context, void **task, dc_taskfunc_t func, void *data);
+
+void
+dc_context_wait (dc_context_t *context, void *task);
+
+/*
+ * Cache of the bluetooth RFCOMM channels, keyed by the device address.
+ * A zero port means the channel is unknown, or removes the entry.
+ */
+unsigned int
+dc_context_get_channel (dc_context_t *context, unsigned long long address);
+
+void
+dc_context_set_channel (dc_context_t *context, unsigned long long address, unsigned int port);
+
+/*
+ * Per context storage for the transport modules, for data that should
+ * outlive a single connection. The cleanup function is called when the
+ * data is replaced, or when the context is destroyed. The caller is
+ * responsible for the locking (dc_global_lock).
+ */
+typedef enum dc_context_cache_id_t {
+	DC_CONTEXT_CACHE_IRDA,
+	DC_CONTEXT_CACHE_MAX
+} dc_context_cache_id_t;
+
+typedef void (*dc_context_cleanup_t) (void *data);
+
+void *
+dc_context_get_cache (dc_context_t *context, dc_context_cache_id_t id);
+
+void
+dc_context_set_cache (dc_context_t *context, dc_context_cache_id_t id, void *data, dc_context_cleanup_t cleanup);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -36,15 +36,71 @@
 
 #include "context-private.h"
 #include "timer.h"
+#include "probes.h"
+#include "thread.h"
+#include "threadpool.h"
+
+#ifndef va_copy
+#define va_copy(dst,src) ((dst) = (src))
+#endif
+
+/*
+ * The log messages are formatted in a small buffer on the stack, and only
+ * when the message doesn't fit, a larger buffer is allocated on the heap.
+ * The maximum message size is capped to keep the hexdump output bounded.
+ */
+#define MSGSIZE_STACK 512
+#define MSGSIZE_MAX   (16384 + 32)
+
+/*
+ * The number of bluetooth channels remembered by the context. When the
+ * cache is full, the least recently used entry is replaced.
+ */
+#define MAXCHANNELS 16
+
+/*
+ * Every memory block starts with a small header with the size of the
+ * block, to keep track of the number of bytes in use when the block is
+ * released again. The union keeps the payload suitably aligned.
+ */
+typedef union dc_context_block_t {
+	size_t size;
+	long double align_float;
+	long long align_int;
+	void *align_ptr;
+} dc_context_block_t;
+
+typedef struct dc_context_cache_t {
+	void *data;
+	dc_context_cleanup_t cleanup;
+} dc_context_cache_t;
+
+typedef struct dc_context_channel_t {
+	unsigned long long address;
+	unsigned int port;
+} dc_context_channel_t;
 
 struct dc_context_t {
 	dc_loglevel_t loglevel;
 	dc_logfunc_t logfunc;
 	void *userdata;
+	dc_allocfunc_t allocfunc;
+	void *allocdata;
+	dc_mutex_t *memlock;
+	dc_context_memstats_t memstats;
 #ifdef ENABLE_LOGGING
-	char msg[16384 + 32];
 	dc_timer_t *timer;
 #endif
+	dc_tracefunc_t tracefunc;
+	void *tracedata;
+	dc_timer_t *tracetimer;
+	dc_context_channel_t channels[MAXCHANNELS];
+	unsigned int nchannels;
+	dc_context_cache_t caches[DC_CONTEXT_CACHE_MAX];
+	dc_submitfunc_t submitfunc;
+	dc_waitfunc_t waitfunc;
+	void *executordata;
+	dc_threadpool_t *pool;
 };
 
 #ifdef ENABLE_LOGGING
@@ -172,9 +228,28 @@ dc_context_new (dc_context_t **out)
 	context->logfunc = NULL;
 #endif
 	context->userdata = NULL;
+	context->allocfunc = NULL;
+	context->allocdata = NULL;
+	memset (&context->memstats, 0, sizeof (context->memstats));
+	context->tracefunc = NULL;
+	context->tracedata = NULL;
+	context->tracetimer = NULL;
+	context->nchannels = 0;
+	memset (context->caches, 0, sizeof (context->caches));
+	context->submitfunc = NULL;
+	context->waitfunc = NULL;
+	context->executordata = NULL;
+	context->pool = NULL;
+
+	// The memory statistics are shared by all threads using the context.
+	context->memlock = NULL;
+	dc_status_t status = dc_mutex_new (&context->memlock);
+	if (status != DC_STATUS_SUCCESS) {
+		free (context);
+		return status;
+	}
 
 #ifdef ENABLE_LOGGING
-	memset (context->msg, 0, sizeof (context->msg));
 	context->timer = NULL;
 	dc_timer_new (&context->timer);
 #endif
@@ -190,9 +265,18 @@ dc_context_free (dc_context_t *context)
 	if (context == NULL)
 		return DC_STATUS_SUCCESS;
 
+	for (unsigned int i = 0; i < DC_CONTEXT_CACHE_MAX; ++i) {
+		if (context->caches[i].cleanup)
+			context->caches[i].cleanup (context->caches[i].data);
+	}
+
+	dc_threadpool_free (context->pool);
+
 #ifdef ENABLE_LOGGING
 	dc_timer_free (context->timer);
 #endif
+	dc_timer_free (context->tracetimer);
+	dc_mutex_free (context->memlock);
 	free (context);
 
 	return DC_STATUS_SUCCESS;
@@ -225,17 +309,261 @@ dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userd
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_context_set_allocator (dc_context_t *context, dc_allocfunc_t allocfunc, void *userdata)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context->allocfunc = allocfunc;
+	context->allocdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_tracefunc (dc_context_t *context, dc_tracefunc_t tracefunc, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (tracefunc && context->tracetimer == NULL) {
+		status = dc_timer_new (&context->tracetimer);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	context->tracefunc = tracefunc;
+	context->tracedata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_executor (dc_context_t *context, dc_submitfunc_t submitfunc, dc_waitfunc_t waitfunc, void *userdata)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if ((submitfunc == NULL) != (waitfunc == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	context->submitfunc = submitfunc;
+	context->waitfunc = waitfunc;
+	context->executordata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_submit (dc_context_t *context, void **task, dc_taskfunc_t func, void *data)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (task == NULL || func == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (context == NULL)
+		return dc_thread_new ((dc_thread_t **) task, func, data);
+
+	if (context->submitfunc)
+		return context->submitfunc (task, func, data, context->executordata);
+
+	// The built-in pool is only created on first use.
+	dc_global_lock ();
+	if (context->pool == NULL)
+		status = dc_threadpool_new (&context->pool);
+	dc_global_unlock ();
+
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the thread pool.");
+		return status;
+	}
+
+	return dc_threadpool_submit (context->pool, (dc_threadpool_task_t **) task, func, data);
+}
+
+void
+dc_context_wait (dc_context_t *context, void *task)
+{
+	if (task == NULL)
+		return;
+
+	if (context == NULL)
+		dc_thread_join ((dc_thread_t *) task);
+	else if (context->waitfunc)
+		context->waitfunc (task, context->executordata);
+	else
+		dc_threadpool_wait (context->pool, (dc_threadpool_task_t *) task);
+}
+
+void
+dc_context_trace_begin (dc_context_t *context, dc_trace_span_t *span, const char *function, unsigned int command, unsigned int isize, unsigned int osize)
+{
+	span->active = 0;
+
+	PROBE4 (transfer__start, context, function, command, isize);
+
+	if (context == NULL || context->tracefunc == NULL)
+		return;
+
+	span->function = function;
+	span->command = command;
+	span->isize = isize;
+	span->osize = osize;
+	span->begin = 0;
+	span->active = 1;
+
+	dc_trace_t trace;
+	trace.phase = DC_TRACE_BEGIN;
+	trace.function = function;
+	trace.command = command;
+	trace.isize = isize;
+	trace.osize = osize;
+	trace.status = DC_STATUS_SUCCESS;
+	trace.duration = 0;
+	context->tracefunc (context, &trace, context->tracedata);
+
+	// Start the clock after the callback, to exclude its own overhead.
+	dc_timer_now (context->tracetimer, &span->begin);
+}
+
+void
+dc_context_trace_end (dc_context_t *context, dc_trace_span_t *span, dc_status_t status)
+{
+	dc_usecs_t now = 0;
+
+	PROBE2 (transfer__done, context, status);
+
+	if (context == NULL || context->tracefunc == NULL || !span->active)
+		return;
+
+	span->active = 0;
+
+	dc_timer_now (context->tracetimer, &now);
+
+	dc_trace_t trace;
+	trace.phase = DC_TRACE_END;
+	trace.function = span->function;
+	trace.command = span->command;
+	trace.isize = span->isize;
+	trace.osize = span->osize;
+	trace.status = status;
+	trace.duration = (unsigned int) (now - span->begin);
+	context->tracefunc (context, &trace, context->tracedata);
+}
+
+static void *
+dc_context_allocate (dc_context_t *context, void *ptr, size_t size)
+{
+	if (context && context->allocfunc)
+		return context->allocfunc (ptr, size, context->allocdata);
+
+	if (size == 0) {
+		free (ptr);
+		return NULL;
+	}
+
+	return realloc (ptr, size);
+}
+
+static void
+dc_context_account (dc_context_t *context, size_t oldsize, size_t newsize, unsigned int allocation)
+{
+	if (context == NULL)
+		return;
+
+	dc_mutex_lock (context->memlock);
+
+	dc_context_memstats_t *stats = &context->memstats;
+	if (allocation) {
+		stats->count++;
+		stats->total += newsize;
+		if (stats->largest < newsize)
+			stats->largest = newsize;
+	}
+	stats->current = stats->current - oldsize + newsize;
+	if (stats->peak < stats->current)
+		stats->peak = stats->current;
+
+	dc_mutex_unlock (context->memlock);
+}
+
+void *
+dc_context_malloc (dc_context_t *context, size_t size)
+{
+	return dc_context_realloc (context, NULL, size);
+}
+
+void *
+dc_context_realloc (dc_context_t *context, void *ptr, size_t size)
+{
+	dc_context_block_t *block = NULL;
+	size_t oldsize = 0;
+
+	if (size > (size_t) -1 - sizeof (dc_context_block_t))
+		return NULL;
+
+	if (ptr) {
+		block = (dc_context_block_t *) ptr - 1;
+		oldsize = block->size;
+	}
+
+	block = (dc_context_block_t *) dc_context_allocate (context, block, sizeof (dc_context_block_t) + size);
+	if (block == NULL)
+		return NULL;
+
+	block->size = size;
+
+	dc_context_account (context, oldsize, size, 1);
+
+	return block + 1;
+}
+
+void
+dc_context_dealloc (dc_context_t *context, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	dc_context_block_t *block = (dc_context_block_t *) ptr - 1;
+	size_t size = block->size;
+
+	dc_context_allocate (context, block, 0);
+
+	dc_context_account (context, size, 0, 0);
+}
+
+dc_status_t
+dc_context_get_memstats (dc_context_t *context, dc_context_memstats_t *stats)
+{
+	if (context == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->memlock);
+	*stats = context->memstats;
+	dc_mutex_unlock (context->memlock);
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
 {
 #ifdef ENABLE_LOGGING
-	va_list ap;
+	char buffer[MSGSIZE_STACK];
+	char *msg = buffer;
+	va_list ap, aq;
+	int n;
 #endif
 
 	if (context == NULL)
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
+	// Filter the message before doing any formatting work.
 	if (loglevel > context->loglevel)
 		return DC_STATUS_SUCCESS;
 
@@ -243,10 +571,24 @@ dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file,
 		return DC_STATUS_SUCCESS;
 
 	va_start (ap, format);
-	l_vsnprintf (context->msg, sizeof (context->msg), format, ap);
+	va_copy (aq, ap);
+	n = l_vsnprintf (buffer, sizeof (buffer), format, ap);
+	if (n < 0) {
+		// Retry with a larger buffer, or fallback to the truncated
+		// message if the allocation fails.
+		char *large = (char *) dc_context_malloc (context, MSGSIZE_MAX);
+		if (large) {
+			l_vsnprintf (large, MSGSIZE_MAX, format, aq);
+			msg = large;
+		}
+	}
+	va_end (aq);
 	va_end (ap);
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	context->logfunc (context, loglevel, file, line, function, msg, context->userdata);
+
+	if (msg != buffer)
+		dc_context_dealloc (context, msg);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -296,6 +638,9 @@ dc_status_t
 dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size)
 {
 #ifdef ENABLE_LOGGING
+	char buffer[MSGSIZE_STACK];
+	char *msg = buffer;
+	size_t length = sizeof (buffer);
 	int n;
 #endif
 
@@ -303,24 +648,122 @@ dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *f
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
+	// Filter the message before doing any formatting work.
 	if (loglevel > context->loglevel)
 		return DC_STATUS_SUCCESS;
 
 	if (context->logfunc == NULL)
 		return DC_STATUS_SUCCESS;
 
-	n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", prefix, size);
+	// The hex string needs two characters per byte, plus room for the
+	// prefix and the size.
+	size_t needed = strlen (prefix) + 32 + (size_t) size * 2;
+	if (needed > length) {
+		if (needed > MSGSIZE_MAX)
+			needed = MSGSIZE_MAX;
+		char *large = (char *) dc_context_malloc (context, needed);
+		if (large) {
+			msg = large;
+			length = needed;
+		}
+	}
+
+	n = l_snprintf (msg, length, "%s: size=%u, data=", prefix, size);
 
 	if (n >= 0) {
-		n = l_hexdump (context->msg + n, sizeof (context->msg) - n, data, size);
+		n = l_hexdump (msg + n, length - n, data, size);
 	}
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	context->logfunc (context, loglevel, file, line, function, msg, context->userdata);
+
+	if (msg != buffer)
+		dc_context_dealloc (context, msg);
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
 
+unsigned int
+dc_context_get_channel (dc_context_t *context, unsigned long long address)
+{
+	unsigned int port = 0;
+
+	if (context == NULL)
+		return 0;
+
+	// The same context can be used by several threads at once.
+	dc_global_lock ();
+
+	for (unsigned int i = 0; i < context->nchannels; ++i) {
+		if (context->channels[i].address == address) {
+			// Move the entry to the front.
+			dc_context_channel_t channel = context->channels[i];
+			memmove (context->channels + 1, context->channels, i * sizeof (channel));
+			context->channels[0] = channel;
+			port = channel.port;
+			break;
+		}
+	}
+
+	dc_global_unlock ();
+
+	return port;
+}
+
+void
+dc_context_set_channel (dc_context_t *context, unsigned long long address, unsigned int port)
+{
+	if (context == NULL)
+		return;
+
+	dc_global_lock ();
+
+	// Remove the existing entry.
+	for (unsigned int i = 0; i < context->nchannels; ++i) {
+		if (context->channels[i].address == address) {
+			memmove (context->channels + i, context->channels + i + 1, (context->nchannels - i - 1) * sizeof (dc_context_channel_t));
+			context->nchannels--;
+			break;
+		}
+	}
+
+	// Insert the new entry at the front, dropping the least recently
+	// used entry if the cache is full.
+	if (port) {
+		if (context->nchannels == MAXCHANNELS)
+			context->nchannels--;
+		memmove (context->channels + 1, context->channels, context->nchannels * sizeof (dc_context_channel_t));
+		context->channels[0].address = address;
+		context->channels[0].port = port;
+		context->nchannels++;
+	}
+
+	dc_global_unlock ();
+}
+
+void *
+dc_context_get_cache (dc_context_t *context, dc_context_cache_id_t id)
+{
+	if (context == NULL || id >= DC_CONTEXT_CACHE_MAX)
+		return NULL;
+
+	return context->caches[id].data;
+}
+
+void
+dc_context_set_cache (dc_context_t *context, dc_context_cache_id_t id, void *data, dc_context_cleanup_t cleanup)
+{
+	if (context == NULL || id >= DC_CONTEXT_CACHE_MAX)
+		return;
+
+	dc_context_cache_t *cache = &context->caches[id];
+	if (cache->cleanup && cache->data != data)
+		cache->cleanup (cache->data);
+
+	cache->data = data;
+	cache->cleanup = cleanup;
+}
+
 unsigned int
 dc_context_get_transports (dc_context_t *context)
 {
@@ -0,0 +1,196 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined (__APPLE__) && !defined (_XOPEN_SOURCE)
+// The ucontext functions are only declared in XSI mode.
+#define _XOPEN_SOURCE 600
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#include <windows.h>
+#define USE_WIN32
+#elif defined (HAVE_UCONTEXT_H)
+#include <ucontext.h>
+#define USE_UCONTEXT
+#endif
+
+#include "coroutine.h"
+
+struct dc_coroutine_t {
+	dc_coroutine_func_t func;
+	void *userdata;
+	int finished;
+#if defined (USE_WIN32)
+	LPVOID fiber;
+	LPVOID caller;
+#elif defined (USE_UCONTEXT)
+	ucontext_t context;
+	ucontext_t caller;
+	void *stack;
+#endif
+};
+
+#if defined (USE_WIN32)
+static VOID CALLBACK
+dc_coroutine_main (LPVOID param)
+{
+	dc_coroutine_t *coroutine = (dc_coroutine_t *) param;
+
+	coroutine->func (coroutine->userdata);
+	coroutine->finished = 1;
+
+	// A fiber must never return.
+	SwitchToFiber (coroutine->caller);
+}
+#elif defined (USE_UCONTEXT)
+static void
+dc_coroutine_main (unsigned int hi, unsigned int lo)
+{
+	// The ucontext functions only pass int arguments, so the pointer is
+	// split into two halves.
+	uintptr_t value = ((uintptr_t) hi << 16 << 16) | lo;
+	dc_coroutine_t *coroutine = (dc_coroutine_t *) value;
+
+	coroutine->func (coroutine->userdata);
+	coroutine->finished = 1;
+
+	// Returning switches to the caller through the uc_link context.
+}
+#endif
+
+dc_status_t
+dc_coroutine_new (dc_coroutine_t **out, size_t stacksize, dc_coroutine_func_t func, void *userdata)
+{
+#if defined (USE_WIN32) || defined (USE_UCONTEXT)
+	dc_coroutine_t *coroutine = NULL;
+
+	if (out == NULL || func == NULL || stacksize == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	coroutine = (dc_coroutine_t *) malloc (sizeof (dc_coroutine_t));
+	if (coroutine == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	coroutine->func = func;
+	coroutine->userdata = userdata;
+	coroutine->finished = 0;
+
+#if defined (USE_WIN32)
+	coroutine->caller = NULL;
+	coroutine->fiber = CreateFiber (stacksize, dc_coroutine_main, coroutine);
+	if (coroutine->fiber == NULL) {
+		free (coroutine);
+		return DC_STATUS_NOMEMORY;
+	}
+#else
+	coroutine->stack = malloc (stacksize);
+	if (coroutine->stack == NULL) {
+		free (coroutine);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (getcontext (&coroutine->context) != 0) {
+		free (coroutine->stack);
+		free (coroutine);
+		return DC_STATUS_IO;
+	}
+
+	uintptr_t value = (uintptr_t) coroutine;
+	coroutine->context.uc_stack.ss_sp = coroutine->stack;
+	coroutine->context.uc_stack.ss_size = stacksize;
+	coroutine->context.uc_link = &coroutine->caller;
+	makecontext (&coroutine->context, (void (*) (void)) dc_coroutine_main, 2,
+		(unsigned int) (value >> 16 >> 16), (unsigned int) (value & 0xFFFFFFFF));
+#endif
+
+	*out = coroutine;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+int
+dc_coroutine_resume (dc_coroutine_t *coroutine)
+{
+	if (coroutine == NULL || coroutine->finished)
+		return 1;
+
+#if defined (USE_WIN32)
+	// Only a fiber can switch to another fiber.
+	int converted = 0;
+	if (IsThreadAFiber ()) {
+		coroutine->caller = GetCurrentFiber ();
+	} else {
+		coroutine->caller = ConvertThreadToFiber (NULL);
+		if (coroutine->caller == NULL)
+			return 0;
+		converted = 1;
+	}
+
+	SwitchToFiber (coroutine->fiber);
+
+	if (converted)
+		ConvertFiberToThread ();
+#elif defined (USE_UCONTEXT)
+	swapcontext (&coroutine->caller, &coroutine->context);
+#endif
+
+	return coroutine->finished;
+}
+
+void
+dc_coroutine_yield (dc_coroutine_t *coroutine)
+{
+	if (coroutine == NULL)
+		return;
+
+#if defined (USE_WIN32)
+	SwitchToFiber (coroutine->caller);
+#elif defined (USE_UCONTEXT)
+	swapcontext (&coroutine->context, &coroutine->caller);
+#endif
+}
+
+void
+dc_coroutine_free (dc_coroutine_t *coroutine)
+{
+	if (coroutine == NULL)
+		return;
+
+#if defined (USE_WIN32)
+	DeleteFiber (coroutine->fiber);
+#elif defined (USE_UCONTEXT)
+	free (coroutine->stack);
+#endif
+
+	free (coroutine);
+}
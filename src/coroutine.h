@@ -0,0 +1,69 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_COROUTINE_H
+#define DC_COROUTINE_H
+
+#include <libdivecomputer/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_coroutine_t dc_coroutine_t;
+
+typedef void (*dc_coroutine_func_t) (void *userdata);
+
+/*
+ * Create a new coroutine running the function on its own stack. The
+ * function only starts running on the first dc_coroutine_resume call.
+ * Returns DC_STATUS_UNSUPPORTED on platforms without coroutines.
+ */
+dc_status_t
+dc_coroutine_new (dc_coroutine_t **coroutine, size_t stacksize, dc_coroutine_func_t func, void *userdata);
+
+/*
+ * Run the coroutine until it yields or its function returns. Returns
+ * non-zero when the function has returned, after which the coroutine
+ * can't be resumed anymore.
+ */
+int
+dc_coroutine_resume (dc_coroutine_t *coroutine);
+
+/*
+ * Suspend the coroutine, and return to the dc_coroutine_resume call.
+ * Must be called from inside the coroutine.
+ */
+void
+dc_coroutine_yield (dc_coroutine_t *coroutine);
+
+/*
+ * Destroy the coroutine. The function of the coroutine should have
+ * returned, because the resources allocated on its stack are not
+ * released otherwise.
+ */
+void
+dc_coroutine_free (dc_coroutine_t *coroutine);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_COROUTINE_H */
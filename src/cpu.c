@@ -0,0 +1,202 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CPU_X86_MSVC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define CPU_X86_GNUC
+#endif
+
+#if defined(_WIN32) && (defined(_M_ARM64) || defined(__aarch64__))
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#include <windows.h>
+#elif defined(HAVE_SYS_AUXV_H) && defined(HAVE_GETAUXVAL) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#define CPU_ARM_AUXV
+#endif
+
+#include "cpu.h"
+#include "thread.h"
+
+static int g_cpu_initialized = 0;
+static unsigned int g_cpu_features = 0;
+
+#if defined(CPU_X86_MSVC) || defined(CPU_X86_GNUC)
+static void
+dc_cpu_cpuid (unsigned int leaf, unsigned int regs[4])
+{
+#if defined(CPU_X86_MSVC)
+	int info[4];
+	__cpuidex (info, leaf, 0);
+	for (unsigned int i = 0; i < 4; ++i)
+		regs[i] = info[i];
+#else
+	regs[0] = regs[1] = regs[2] = regs[3] = 0;
+	__cpuid_count (leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+/*
+ * The AVX registers can only be used if the operating system saves them
+ * on a context switch.
+ */
+static int
+dc_cpu_ymm_enabled (void)
+{
+#if defined(CPU_X86_MSVC)
+	return (_xgetbv (0) & 0x06) == 0x06;
+#else
+	unsigned int eax = 0, edx = 0;
+	__asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return (eax & 0x06) == 0x06;
+#endif
+}
+
+static unsigned int
+dc_cpu_detect (void)
+{
+	unsigned int features = 0;
+	unsigned int regs[4];
+
+	dc_cpu_cpuid (0, regs);
+	unsigned int maxleaf = regs[0];
+	if (maxleaf < 1)
+		return 0;
+
+	dc_cpu_cpuid (1, regs);
+	if (regs[3] & (1u << 26))
+		features |= DC_CPU_SSE2;
+	if (regs[2] & (1u << 20))
+		features |= DC_CPU_SSE42;
+	if (regs[2] & (1u << 1))
+		features |= DC_CPU_PCLMUL;
+	if (regs[2] & (1u << 25))
+		features |= DC_CPU_AESNI;
+
+	// AVX and OSXSAVE, and the registers enabled by the OS.
+	int avx = (regs[2] & (1u << 28)) && (regs[2] & (1u << 27)) && dc_cpu_ymm_enabled ();
+	if (avx && maxleaf >= 7) {
+		dc_cpu_cpuid (7, regs);
+		if (regs[1] & (1u << 5))
+			features |= DC_CPU_AVX2;
+	}
+
+	return features;
+}
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__arm__)
+static unsigned int
+dc_cpu_detect (void)
+{
+	unsigned int features = 0;
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+	// Advanced SIMD is a mandatory part of ARMv8-A.
+	features |= DC_CPU_NEON;
+#endif
+
+#if defined(_WIN32)
+	if (IsProcessorFeaturePresent (PF_ARM_V8_CRC32_INSTRUCTIONS_AVAILABLE))
+		features |= DC_CPU_CRC32;
+	if (IsProcessorFeaturePresent (PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE))
+		features |= DC_CPU_AES | DC_CPU_PMULL;
+#elif defined(__APPLE__) && defined(__aarch64__)
+	// All Apple processors have the CRC and crypto extensions.
+	features |= DC_CPU_CRC32 | DC_CPU_AES | DC_CPU_PMULL;
+#elif defined(CPU_ARM_AUXV) && defined(__aarch64__)
+	unsigned long hwcap = getauxval (AT_HWCAP);
+	if (hwcap & (1ul << 3))
+		features |= DC_CPU_AES;
+	if (hwcap & (1ul << 4))
+		features |= DC_CPU_PMULL;
+	if (hwcap & (1ul << 7))
+		features |= DC_CPU_CRC32;
+#elif defined(CPU_ARM_AUXV)
+	unsigned long hwcap = getauxval (AT_HWCAP);
+	unsigned long hwcap2 = getauxval (AT_HWCAP2);
+	if (hwcap & (1ul << 12))
+		features |= DC_CPU_NEON;
+	if (hwcap2 & (1ul << 0))
+		features |= DC_CPU_AES;
+	if (hwcap2 & (1ul << 1))
+		features |= DC_CPU_PMULL;
+	if (hwcap2 & (1ul << 4))
+		features |= DC_CPU_CRC32;
+#endif
+
+	return features;
+}
+#else
+static unsigned int
+dc_cpu_detect (void)
+{
+	return 0;
+}
+#endif
+
+void
+dc_cpu_init (void)
+{
+	dc_global_lock ();
+
+	if (!g_cpu_initialized) {
+		unsigned int features = dc_cpu_detect ();
+
+		// The override can only disable features, never enable them.
+		const char *mask = getenv ("DC_CPU_FEATURES");
+		if (mask && *mask)
+			features &= (unsigned int) strtoul (mask, NULL, 0);
+
+		g_cpu_features = features;
+		g_cpu_initialized = 1;
+	}
+
+	dc_global_unlock ();
+}
+
+unsigned int
+dc_cpu_features (void)
+{
+	dc_cpu_init ();
+
+	return g_cpu_features;
+}
+
+dc_cpu_func_t
+dc_cpu_resolve (const dc_cpu_kernel_t kernels[], size_t count)
+{
+	unsigned int features = dc_cpu_features ();
+
+	for (size_t i = 0; i < count; ++i) {
+		if ((kernels[i].features & features) == kernels[i].features)
+			return kernels[i].func;
+	}
+
+	return NULL;
+}
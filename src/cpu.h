@@ -0,0 +1,83 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CPU_H
+#define DC_CPU_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Instruction set extensions, which are detected at runtime.
+ */
+typedef enum dc_cpu_feature_t {
+	/* x86 */
+	DC_CPU_SSE2   = (1 << 0),
+	DC_CPU_SSE42  = (1 << 1),
+	DC_CPU_AVX2   = (1 << 2),
+	DC_CPU_PCLMUL = (1 << 3),
+	DC_CPU_AESNI  = (1 << 4),
+	/* ARM */
+	DC_CPU_NEON   = (1 << 8),
+	DC_CPU_CRC32  = (1 << 9),
+	DC_CPU_AES    = (1 << 10),
+	DC_CPU_PMULL  = (1 << 11),
+} dc_cpu_feature_t;
+
+/*
+ * Detect the features of the processor. The detection runs only once,
+ * on the first call, when the first kernel is selected. The result can
+ * be restricted with the DC_CPU_FEATURES environment variable, which
+ * contains the mask of the features that may be used. A mask of zero
+ * forces the portable code everywhere, which is useful for testing.
+ */
+void
+dc_cpu_init (void);
+
+unsigned int
+dc_cpu_features (void);
+
+/*
+ * A candidate implementation of a kernel, and the features it needs.
+ * The candidates are listed from the most to the least specialized one,
+ * and the list ends with the portable implementation, which requires no
+ * features at all and is therefore always selected as the last resort.
+ */
+typedef void (*dc_cpu_func_t) (void);
+
+typedef struct dc_cpu_kernel_t {
+	unsigned int features;
+	dc_cpu_func_t func;
+} dc_cpu_kernel_t;
+
+dc_cpu_func_t
+dc_cpu_resolve (const dc_cpu_kernel_t kernels[], size_t count);
+
+#define DC_CPU_RESOLVE(type, kernels) \
+	((type) dc_cpu_resolve ((kernels), sizeof (kernels) / sizeof (kernels[0])))
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CPU_H */
@@ -20,7 +20,6 @@
  */
 
 #include <string.h> // memcpy, memcmp
-#include <stdlib.h> // malloc, free
 #include <assert.h> // assert
 
 #include "cressi_edy.h"
@@ -73,7 +72,9 @@ static const dc_device_vtable_t cressi_edy_device_vtable = {
 	cressi_edy_device_read, /* read */
 	NULL, /* write */
 	cressi_edy_device_dump, /* dump */
+	NULL, /* dump_update */
 	cressi_edy_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	cressi_edy_device_close /* close */
 };
@@ -319,6 +320,40 @@ cressi_edy_device_close (dc_device_t *abstract)
 }
 
 
+static unsigned int
+cressi_edy_page_command (dc_device_t *abstract, unsigned char command[], unsigned int address, unsigned int npages)
+{
+	unsigned int number = address / SZ_PAGE;
+
+	command[0] = 0x52;
+	command[1] = (number >> 8) & 0xFF; // high
+	command[2] = (number     ) & 0xFF; // low
+
+	return 3;
+}
+
+
+static dc_status_t
+cressi_edy_page_transfer (dc_device_t *abstract, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+{
+	return cressi_edy_packet ((cressi_edy_device_t *) abstract, command, csize, answer, asize, 1);
+}
+
+
+// Every request returns a single packet of four pages.
+static const device_page_protocol_t cressi_edy_page_protocol = {
+	SZ_PACKET, /* pagesize */
+	1, /* maxpages */
+	0, /* header */
+	1, /* trailer */
+	DEVICE_PAGE_CHECKSUM_NONE, /* checksum */
+	MAXRETRIES, /* maxretries */
+	300, /* delay */
+	cressi_edy_page_command, /* command */
+	cressi_edy_page_transfer, /* transfer */
+};
+
+
 static dc_status_t
 cressi_edy_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -328,26 +363,7 @@ cressi_edy_device_read (dc_device_t *abstract, unsigned int address, unsigned ch
 		(size    % SZ_PACKET != 0))
 		return DC_STATUS_INVALIDARGS;
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Read the package.
-		unsigned int number = address / SZ_PAGE;
-		unsigned char answer[SZ_PACKET + 1] = {0};
-		unsigned char command[3] = {0x52,
-				(number >> 8) & 0xFF, // high
-				(number     ) & 0xFF}; // low
-		dc_status_t rc = cressi_edy_transfer (device, command, sizeof (command), answer, sizeof (answer), 1);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		memcpy (data, answer, SZ_PACKET);
-
-		nbytes += SZ_PACKET;
-		address += SZ_PACKET;
-		data += SZ_PACKET;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return device_page_read (abstract, device->iostream, &cressi_edy_page_protocol, address, data, size);
 }
 
 
@@ -472,14 +488,14 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, SZ_PAGE, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, eop);
+	rc = dc_rbstream_new (&rbstream, abstract, SZ_PAGE, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, eop, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
 	}
 
 	// Memory buffer for the profile data.
-	unsigned char *buffer = (unsigned char *) malloc (total);
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (abstract->context, total);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		dc_rbstream_free (rbstream);
@@ -496,7 +512,7 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		if (current < layout->rb_profile_begin || current >= layout->rb_profile_end) {
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x).", current);
 			dc_rbstream_free (rbstream);
-			free(buffer);
+			dc_context_dealloc (abstract->context, buffer);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -511,7 +527,7 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
 			dc_rbstream_free (rbstream);
-			free (buffer);
+			dc_context_dealloc (abstract->context, buffer);
 			return rc;
 		}
 
@@ -531,7 +547,7 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	}
 
 	dc_rbstream_free (rbstream);
-	free(buffer);
+	dc_context_dealloc (abstract->context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
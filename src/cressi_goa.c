@@ -25,10 +25,12 @@
 
 #include "cressi_goa.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
 #include "platform.h"
+#include "bleline.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &cressi_goa_device_vtable)
 
@@ -51,14 +53,18 @@
 #define NSTEPS    1000
 #define STEP(i,n) (NSTEPS * (i) / (n))
 
+#define PACING_SEND 0
+
 typedef struct cressi_goa_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	dc_bleline_t *bleline;
 	unsigned char fingerprint[FP_SIZE];
 } cressi_goa_device_t;
 
 static dc_status_t cressi_goa_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
 static dc_status_t cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
+static dc_status_t cressi_goa_device_close (dc_device_t *abstract);
 
 static const dc_device_vtable_t cressi_goa_device_vtable = {
 	sizeof(cressi_goa_device_t),
@@ -67,11 +73,47 @@ static const dc_device_vtable_t cressi_goa_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	cressi_goa_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
-	NULL /* close */
+	cressi_goa_device_close /* close */
 };
 
+static dc_status_t
+cressi_goa_device_read (cressi_goa_device_t *device, unsigned char data[], size_t size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (device->bleline == NULL) {
+		return dc_iostream_read (device->iostream, data, size, NULL);
+	}
+
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		// Read the data from the (buffered) BLE packets.
+		size_t length = 0;
+		rc = dc_bleline_read (device->bleline, data + nbytes, size - nbytes, &length);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		nbytes += length;
+	}
+
+	return rc;
+}
+
+static dc_status_t
+cressi_goa_device_write (cressi_goa_device_t *device, const unsigned char data[], size_t size)
+{
+	if (device->bleline) {
+		// Split the data into packets no larger than the MTU.
+		return dc_bleline_write (device->bleline, data, size);
+	}
+
+	return dc_iostream_write (device->iostream, data, size, NULL);
+}
+
 static dc_status_t
 cressi_goa_device_send (cressi_goa_device_t *device, unsigned char cmd, const unsigned char data[], unsigned int size)
 {
@@ -100,10 +142,10 @@ cressi_goa_device_send (cressi_goa_device_t *device, unsigned char cmd, const un
 
 	// Wait a small amount of time before sending the command. Without
 	// this delay, the transfer will fail most of the time.
-	dc_iostream_sleep (device->iostream, 100);
+	dc_iostream_sleep (device->iostream, device_pacing_delay (abstract, PACING_SEND, 100));
 
 	// Send the command to the device.
-	status = dc_iostream_write (device->iostream, packet, size + 8, NULL);
+	status = cressi_goa_device_write (device, packet, size + 8);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to send the command.");
 		return status;
@@ -121,7 +163,7 @@ cressi_goa_device_receive (cressi_goa_device_t *device, unsigned char data[], un
 	unsigned char packet[SZ_PACKET + 8];
 
 	// Read the header of the data packet.
-	status = dc_iostream_read (device->iostream, packet, 4, NULL);
+	status = cressi_goa_device_read (device, packet, 4);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the answer.");
 		return status;
@@ -141,7 +183,7 @@ cressi_goa_device_receive (cressi_goa_device_t *device, unsigned char data[], un
 	}
 
 	// Read the remainder of the data packet.
-	status = dc_iostream_read (device->iostream, packet + 4, length + 4, NULL);
+	status = cressi_goa_device_read (device, packet + 4, length + 4);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the answer.");
 		return status;
@@ -195,7 +237,7 @@ cressi_goa_device_download (cressi_goa_device_t *device, dc_buffer_t *buffer, dc
 	while (nbytes < size) {
 		// Read the data packet.
 		unsigned char packet[3 + SZ_DATA + 2];
-		status = dc_iostream_read (device->iostream, packet, sizeof(packet), NULL);
+		status = cressi_goa_device_read (device, packet, sizeof(packet));
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the answer.");
 			return status;
@@ -210,15 +252,20 @@ cressi_goa_device_download (cressi_goa_device_t *device, dc_buffer_t *buffer, dc
 		}
 
 		// Send the ack byte to the device.
-		status = dc_iostream_write (device->iostream, ack, sizeof(ack), NULL);
+		status = cressi_goa_device_write (device, ack, sizeof(ack));
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to send the ack byte.");
 			return status;
 		}
 
-		// Get the total size from the first data packet.
+		// Get the total size from the first data packet, and reserve
+		// the buffer space for the entire payload at once.
 		if (nbytes == 0) {
 			size += array_uint16_le (packet + 3);
+			if (!dc_buffer_reserve (buffer, size - skip)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				return DC_STATUS_NOMEMORY;
+			}
 		}
 
 		// Calculate the payload size of the packet.
@@ -245,7 +292,7 @@ cressi_goa_device_download (cressi_goa_device_t *device, dc_buffer_t *buffer, dc
 
 	// Read the end byte.
 	unsigned char end = 0;
-	status = dc_iostream_read (device->iostream, &end, 1, NULL);
+	status = cressi_goa_device_read (device, &end, 1);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the end byte.");
 		return status;
@@ -258,7 +305,7 @@ cressi_goa_device_download (cressi_goa_device_t *device, dc_buffer_t *buffer, dc
 	}
 
 	// Send the ack byte to the device.
-	status = dc_iostream_write (device->iostream, ack, sizeof(ack), NULL);
+	status = cressi_goa_device_write (device, ack, sizeof(ack));
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to send the ack byte.");
 		return status;
@@ -285,6 +332,7 @@ cressi_goa_device_transfer (cressi_goa_device_t *device,
 
 	// Receive the answer from the dive computer.
 	status = cressi_goa_device_receive (device, output, osize);
+	device_pacing_update ((dc_device_t *) device, PACING_SEND, status);
 	if (status != DC_STATUS_SUCCESS) {
 		return status;
 	}
@@ -319,8 +367,17 @@ cressi_goa_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t
 
 	// Set the default values.
 	device->iostream = iostream;
+	device->bleline = NULL;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 
+	// The BLE packets are buffered, and sized to the negotiated MTU.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) {
+		status = dc_bleline_new (&device->bleline, context, device->iostream);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_free;
+		}
+	}
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -351,16 +408,28 @@ cressi_goa_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t
 
 	dc_iostream_sleep (device->iostream, 100);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+	dc_bleline_discard (device->bleline);
 
 	*out = (dc_device_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_free:
+	dc_bleline_free (device->bleline);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
 
+static dc_status_t
+cressi_goa_device_close (dc_device_t *abstract)
+{
+	cressi_goa_device_t *device = (cressi_goa_device_t *) abstract;
+
+	dc_bleline_free (device->bleline);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 cressi_goa_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -410,8 +479,9 @@ cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	devinfo.serial = array_uint32_le (id + 0);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory for the logbook data.
-	logbook = dc_buffer_new(4096);
+	// Allocate memory for the logbook data. The buffer is sized to the
+	// length reported by the device once the download starts.
+	logbook = dc_buffer_allocate (abstract->context, 0);
 	if (logbook == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		goto error_exit;
@@ -452,7 +522,7 @@ cressi_goa_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the dive data.
-	dive = dc_buffer_new(4096);
+	dive = dc_buffer_allocate (abstract->context, 0);
 	if (dive == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		goto error_free_logbook;
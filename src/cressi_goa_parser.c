@@ -124,9 +124,13 @@ cressi_goa_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsign
 
 	const unsigned char *data = abstract->data;
 
-	if (!parser->cached) {
+	// The maximum depth is only available in the profile.
+	if (!parser->cached && dc_parser_is_summary (parser)) {
+		if (type == DC_FIELD_MAXDEPTH)
+			return DC_STATUS_FULLSCAN;
+	} else if (!parser->cached) {
 		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = cressi_goa_parser_samples_foreach (
+		dc_status_t rc = dc_parser_samples_walk (
 			abstract, sample_statistics_cb, &statistics);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -210,6 +214,7 @@ cressi_goa_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 		} else {
 			WARNING(abstract->context, "Unknown sample type %u.", type);
+			dc_parser_skipped (abstract);
 		}
 
 		offset += 2;
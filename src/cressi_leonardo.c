@@ -20,11 +20,11 @@
  */
 
 #include <string.h> // memcpy, memcmp
-#include <stdlib.h> // malloc, free
 #include <assert.h> // assert
 
 #include "cressi_leonardo.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -43,6 +43,8 @@
 #define RB_PROFILE_END   SZ_MEMORY
 #define RB_PROFILE_DISTANCE(a,b) ringbuffer_distance (a, b, 0, RB_PROFILE_BEGIN, RB_PROFILE_END)
 
+#define SZ_CONFIG 0x68
+
 #define MAXRETRIES 4
 #define PACKETSIZE 32
 
@@ -64,7 +66,9 @@ static const dc_device_vtable_t cressi_leonardo_device_vtable = {
 	cressi_leonardo_device_read, /* read */
 	NULL, /* write */
 	cressi_leonardo_device_dump, /* dump */
+	NULL, /* dump_update */
 	cressi_leonardo_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -381,14 +385,180 @@ cressi_leonardo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+cressi_leonardo_device_read_progress (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size, dc_event_progress_t *progress)
+{
+	dc_status_t rc = cressi_leonardo_device_read (abstract, address, data, size);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory.");
+		return rc;
+	}
+
+	// Update and emit a progress event.
+	progress->current += size;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Read only the parts of the memory that are needed to extract the new
+ * dives. The logbook entries are read newest first, until the entry
+ * matching the fingerprint, followed by the corresponding profiles. The
+ * walk is identical to the one in cressi_leonardo_extract_dives, which
+ * is used afterwards on the (sparse) memory image. If reading the
+ * profiles would take longer than a full memory dump,
+ * DC_STATUS_UNSUPPORTED is returned instead.
+ */
+static dc_status_t
+cressi_leonardo_device_read_new (dc_device_t *abstract, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
+
+	assert (size == SZ_MEMORY);
+
+	// Mark the entire memory as uninitialized.
+	memset (data, 0xFF, size);
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = SZ_MEMORY;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the configuration data with the ringbuffer pointers.
+	rc = cressi_leonardo_device_read_progress (abstract, 0, data, SZ_CONFIG, &progress);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Get the logbook pointer.
+	unsigned int last = array_uint16_le (data + 0x64);
+	if (last < RB_LOGBOOK_BEGIN || last > RB_LOGBOOK_END ||
+		((last - RB_LOGBOOK_BEGIN) % RB_LOGBOOK_SIZE) != 0) {
+		// Leave the error reporting to the extraction.
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Convert to an index.
+	unsigned int latest = (last - RB_LOGBOOK_BEGIN) / RB_LOGBOOK_SIZE;
+
+	// Get the profile pointer.
+	unsigned int eop = array_uint16_le (data + 0x66);
+
+	dc_ringbuffer_t rb_profile;
+	dc_ringbuffer_init (&rb_profile, RB_PROFILE_BEGIN, RB_PROFILE_END);
+
+	// Read the new logbook entries, and calculate the total size of
+	// their profiles.
+	unsigned int count = 0;
+	unsigned int total = 0;
+	unsigned int previous = eop;
+	unsigned int remaining = RB_PROFILE_END - RB_PROFILE_BEGIN;
+	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
+		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
+		unsigned int offset = RB_LOGBOOK_BEGIN + idx * RB_LOGBOOK_SIZE;
+
+		// Read the logbook entry.
+		rc = cressi_leonardo_device_read_progress (abstract, offset, data + offset, RB_LOGBOOK_SIZE, &progress);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		// Ignore uninitialized header entries.
+		if (array_isequal (data + offset, RB_LOGBOOK_SIZE, 0xFF))
+			break;
+
+		// Get the ringbuffer pointers.
+		unsigned int header = array_uint16_le (data + offset + 2);
+		unsigned int footer = array_uint16_le (data + offset + 4);
+		if (header < RB_PROFILE_BEGIN || header + 2 > RB_PROFILE_END ||
+			footer < RB_PROFILE_BEGIN || footer + 2 > RB_PROFILE_END)
+			break;
+
+		if (previous && previous != footer + 2)
+			break;
+
+		// Check the fingerprint data.
+		if (memcmp (data + offset + 8, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
+		// Calculate the profile length, including the pointers.
+		unsigned int length = RB_PROFILE_DISTANCE (header, footer) + 2;
+		if (remaining && remaining >= length) {
+			remaining -= length;
+			total += length;
+		} else {
+			remaining = 0;
+		}
+
+		previous = header;
+		count++;
+	}
+
+	// Every byte is transferred as two hex digits, with a packet for
+	// every 32 bytes. If the profiles are too large, the full memory dump
+	// is faster.
+	if (2 * (progress.current + total) > SZ_MEMORY) {
+		DEBUG (abstract->context, "Falling back to a full memory dump (%u bytes).", total);
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// Read the profiles.
+	remaining = RB_PROFILE_END - RB_PROFILE_BEGIN;
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
+		unsigned int offset = RB_LOGBOOK_BEGIN + idx * RB_LOGBOOK_SIZE;
+
+		// Get the ringbuffer pointers.
+		unsigned int header = array_uint16_le (data + offset + 2);
+		unsigned int footer = array_uint16_le (data + offset + 4);
+
+		// Calculate the profile length, including the pointers.
+		unsigned int length = RB_PROFILE_DISTANCE (header, footer) + 2;
+		if (remaining < length)
+			break;
+
+		dc_ringbuffer_span_t span[2];
+		unsigned int nspans = dc_ringbuffer_spans (&rb_profile, header, length, span);
+		for (unsigned int j = 0; j < nspans; ++j) {
+			rc = cressi_leonardo_device_read_progress (abstract, span[j].address, data + span[j].address, span[j].length, &progress);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
+
+		remaining -= length;
+	}
+
+	// Update and emit a progress event.
+	progress.current = progress.maximum;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 cressi_leonardo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
+
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = cressi_leonardo_device_dump (abstract, buffer);
+	// Without a fingerprint, all dives are downloaded, and a full memory
+	// dump is faster than the (hex encoded) random access reads. With a
+	// fingerprint, only the new logbook entries and profiles are read.
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	if (array_isequal (device->fingerprint, sizeof (device->fingerprint), 0)) {
+		rc = cressi_leonardo_device_dump (abstract, buffer);
+	} else if (!dc_buffer_resize (buffer, SZ_MEMORY)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		rc = DC_STATUS_NOMEMORY;
+	} else {
+		rc = cressi_leonardo_device_read_new (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+		if (rc == DC_STATUS_UNSUPPORTED) {
+			rc = cressi_leonardo_device_dump (abstract, buffer);
+		}
+	}
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
 		return rc;
@@ -442,7 +612,10 @@ cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[]
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	unsigned char *buffer = (unsigned char *) malloc (RB_LOGBOOK_SIZE + RB_PROFILE_END - RB_PROFILE_BEGIN);
+	dc_ringbuffer_t rb_profile;
+	dc_ringbuffer_init (&rb_profile, RB_PROFILE_BEGIN, RB_PROFILE_END);
+
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (context, RB_LOGBOOK_SIZE + RB_PROFILE_END - RB_PROFILE_BEGIN);
 	if (buffer == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -465,13 +638,13 @@ cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[]
 			footer < RB_PROFILE_BEGIN || footer + 2 > RB_PROFILE_END)
 		{
 			ERROR (context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", header, footer);
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return DC_STATUS_DATAFORMAT;
 		}
 
 		if (previous && previous != footer + 2) {
 			ERROR (context, "Profiles are not continuous (0x%04x 0x%04x 0x%04x).", header, footer, previous);
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -492,19 +665,12 @@ cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[]
 			unsigned int footer2 = array_uint16_le (data + header);
 			if (header2 != header || footer2 != footer) {
 				ERROR (context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", header2, footer2);
-				free (buffer);
+				dc_context_dealloc (context, buffer);
 				return DC_STATUS_DATAFORMAT;
 			}
 
 			// Copy the profile data.
-			if (address + length > RB_PROFILE_END) {
-				unsigned int len_a = RB_PROFILE_END - address;
-				unsigned int len_b = length - len_a;
-				memcpy (buffer + RB_LOGBOOK_SIZE, data + address, len_a);
-				memcpy (buffer + RB_LOGBOOK_SIZE + len_a, data + RB_PROFILE_BEGIN, len_b);
-			} else {
-				memcpy (buffer + RB_LOGBOOK_SIZE, data + address, length);
-			}
+			dc_ringbuffer_copy (&rb_profile, buffer + RB_LOGBOOK_SIZE, data, address, length);
 
 			remaining -= length + 4;
 		} else {
@@ -520,7 +686,7 @@ cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[]
 		previous = header;
 	}
 
-	free (buffer);
+	dc_context_dealloc (context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
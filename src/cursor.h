@@ -0,0 +1,211 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CURSOR_H
+#define DC_CURSOR_H
+
+#include "platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Bounds checked cursor over a block of raw data.
+ *
+ * A parser checks the size of a record once with dc_cursor_require()
+ * or dc_cursor_record(), and then uses the unchecked dc_cursor_*_at()
+ * functions to decode the individual fields. The sequential readers
+ * check every field, and return zero once the cursor ran out of data.
+ * The error flag is sticky, so a parser can decode a whole record and
+ * check dc_cursor_failed() only once at the end.
+ *
+ * All functions are inline, to avoid the call overhead of the array
+ * helpers in the inner sample loops.
+ */
+typedef struct dc_cursor_t {
+	const unsigned char *data;
+	unsigned int size;
+	unsigned int offset;
+	unsigned int error;
+} dc_cursor_t;
+
+static DC_ALWAYS_INLINE void
+dc_cursor_init (dc_cursor_t *cursor, const unsigned char data[], unsigned int size)
+{
+	cursor->data = data;
+	cursor->size = size;
+	cursor->offset = 0;
+	cursor->error = 0;
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_remaining (const dc_cursor_t *cursor)
+{
+	return cursor->size - cursor->offset;
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_failed (const dc_cursor_t *cursor)
+{
+	return cursor->error;
+}
+
+/*
+ * Check whether at least n bytes are available at the current position.
+ * On failure, the error flag is set and zero is returned.
+ */
+static DC_ALWAYS_INLINE int
+dc_cursor_require (dc_cursor_t *cursor, unsigned int n)
+{
+	if (n > cursor->size - cursor->offset) {
+		cursor->error = 1;
+		return 0;
+	}
+
+	return 1;
+}
+
+static DC_ALWAYS_INLINE int
+dc_cursor_skip (dc_cursor_t *cursor, unsigned int n)
+{
+	if (!dc_cursor_require (cursor, n))
+		return 0;
+
+	cursor->offset += n;
+
+	return 1;
+}
+
+/*
+ * Split off a record of n bytes into a separate cursor, and advance
+ * past it. The fields of the record can then be decoded with the
+ * unchecked functions, at offsets relative to the start of the record.
+ */
+static DC_ALWAYS_INLINE int
+dc_cursor_record (dc_cursor_t *cursor, dc_cursor_t *record, unsigned int n)
+{
+	if (!dc_cursor_require (cursor, n)) {
+		dc_cursor_init (record, cursor->data + cursor->offset, 0);
+		record->error = 1;
+		return 0;
+	}
+
+	dc_cursor_init (record, cursor->data + cursor->offset, n);
+	cursor->offset += n;
+
+	return 1;
+}
+
+/*
+ * Unchecked reads, relative to the current position. The caller is
+ * responsible for checking the bounds first.
+ */
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u8_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	return cursor->data[cursor->offset + n];
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u16le_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	const unsigned char *p = cursor->data + cursor->offset + n;
+	return p[0] | ((unsigned int) p[1] << 8);
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u16be_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	const unsigned char *p = cursor->data + cursor->offset + n;
+	return ((unsigned int) p[0] << 8) | p[1];
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u24le_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	const unsigned char *p = cursor->data + cursor->offset + n;
+	return p[0] | ((unsigned int) p[1] << 8) | ((unsigned int) p[2] << 16);
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u24be_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	const unsigned char *p = cursor->data + cursor->offset + n;
+	return ((unsigned int) p[0] << 16) | ((unsigned int) p[1] << 8) | p[2];
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u32le_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	const unsigned char *p = cursor->data + cursor->offset + n;
+	return p[0] | ((unsigned int) p[1] << 8) |
+		((unsigned int) p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_u32be_at (const dc_cursor_t *cursor, unsigned int n)
+{
+	const unsigned char *p = cursor->data + cursor->offset + n;
+	return ((unsigned int) p[0] << 24) | ((unsigned int) p[1] << 16) |
+		((unsigned int) p[2] << 8) | p[3];
+}
+
+/*
+ * Checked sequential reads. If not enough data is available, the
+ * error flag is set, the position is left unchanged and zero is
+ * returned.
+ */
+#define DC_CURSOR_READ(name,n) \
+static DC_ALWAYS_INLINE unsigned int \
+dc_cursor_##name (dc_cursor_t *cursor) \
+{ \
+	unsigned int value = 0; \
+	if (dc_cursor_require (cursor, n)) { \
+		value = dc_cursor_##name##_at (cursor, 0); \
+		cursor->offset += n; \
+	} \
+	return value; \
+}
+
+DC_CURSOR_READ(u8, 1)
+DC_CURSOR_READ(u16le, 2)
+DC_CURSOR_READ(u16be, 2)
+DC_CURSOR_READ(u24le, 3)
+DC_CURSOR_READ(u24be, 3)
+DC_CURSOR_READ(u32le, 4)
+DC_CURSOR_READ(u32be, 4)
+
+#undef DC_CURSOR_READ
+
+/*
+ * Extract a bit field of the given width (1 to 31 bits) from a value.
+ */
+static DC_ALWAYS_INLINE unsigned int
+dc_cursor_bits (unsigned int value, unsigned int shift, unsigned int width)
+{
+	return (value >> shift) & ((1u << width) - 1);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CURSOR_H */
@@ -63,10 +63,12 @@ static const dc_iostream_vtable_t dc_custom_vtable = {
 	dc_custom_poll, /* poll */
 	dc_custom_read, /* read */
 	dc_custom_write, /* write */
+	NULL, /* writev */
 	dc_custom_ioctl, /* ioctl */
 	dc_custom_flush, /* flush */
 	dc_custom_purge, /* purge */
 	dc_custom_sleep, /* sleep */
+	NULL, /* interrupt */
 	dc_custom_close, /* close */
 };
 
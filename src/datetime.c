@@ -24,6 +24,7 @@
 #endif
 
 #include <time.h>
+#include <limits.h>
 
 #include <libdivecomputer/datetime.h>
 
@@ -44,63 +45,59 @@ dc_localtime_r (const time_t *t, struct tm *tm)
 #endif
 }
 
-static struct tm *
-dc_gmtime_r (const time_t *t, struct tm *tm)
-{
-#ifdef HAVE_GMTIME_R
-	return gmtime_r (t, tm);
-#else
-	struct tm *p = gmtime (t);
-	if (p == NULL)
-		return NULL;
+#define SECONDS_PER_DAY 86400
 
-	if (tm)
-		*tm = *p;
+/*
+ * Conversion between the number of days since 1970-01-01 and a date in
+ * the proleptic Gregorian calendar, with integer arithmetic only. Out
+ * of range months and days are normalized, like timegm does.
+ */
+static long long
+dc_days_from_civil (long long year, long long month, long long day)
+{
+	// Normalize the month to the range 1-12.
+	long long m = month - 1;
+	long long q = (m >= 0 ? m : m - 11) / 12;
+	year += q;
+	m = m - q * 12 + 1;
+
+	// Count the years from March, so the leap day is at the end.
+	year -= (m <= 2);
+	long long era = (year >= 0 ? year : year - 399) / 400;
+	long long yoe = year - era * 400;
+	long long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1;
+	long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
 
-	return tm;
-#endif
+static void
+dc_civil_from_days (long long days, long long *year, int *month, int *day)
+{
+	days += 719468;
+	long long era = (days >= 0 ? days : days - 146096) / 146097;
+	long long doe = days - era * 146097;
+	long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	long long mp = (5 * doy + 2) / 153;
+
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = yoe + era * 400 + (*month <= 2);
 }
 
+#ifndef HAVE_STRUCT_TM_TM_GMTOFF
 static time_t
 dc_timegm (struct tm *tm)
 {
-#if defined(HAVE_TIMEGM)
-	return timegm (tm);
-#elif defined (HAVE__MKGMTIME)
-	return _mkgmtime (tm);
-#else
-	static const unsigned int mdays[] = {
-		0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
-	};
-
-	if (tm == NULL ||
-		tm->tm_mon  < 0 || tm->tm_mon  > 11 ||
-		tm->tm_mday < 1 || tm->tm_mday > 31 ||
-		tm->tm_hour < 0 || tm->tm_hour > 23 ||
-		tm->tm_min  < 0 || tm->tm_min  > 59 ||
-		tm->tm_sec  < 0 || tm->tm_sec  > 60)
+	if (tm == NULL)
 		return (time_t) -1;
 
-	/* Number of leap days since 1970-01-01. */
-	int year = tm->tm_year + 1900 - (tm->tm_mon < 2);
-	int leapdays =
-		((year / 4) - (year / 100) + (year / 400)) -
-		((1969 / 4) - (1969 / 100) + (1969 / 400));
-
-	time_t result = 0;
-	result += (tm->tm_year - 70) * 365;
-	result += leapdays;
-	result += mdays[tm->tm_mon];
-	result += tm->tm_mday - 1;
-	result *= 24;
-	result += tm->tm_hour;
-	result *= 60;
-	result += tm->tm_min;
-	result *= 60;
-	result += tm->tm_sec;
-	return result;
-#endif
+	long long days = dc_days_from_civil (tm->tm_year + 1900LL, tm->tm_mon + 1, tm->tm_mday);
+
+	return ((days * 24 + tm->tm_hour) * 60 + tm->tm_min) * 60 + tm->tm_sec;
 }
+#endif
 
 dc_ticks_t
 dc_datetime_now (void)
@@ -147,43 +144,75 @@ dc_datetime_t *
 dc_datetime_gmtime (dc_datetime_t *result,
                     dc_ticks_t ticks)
 {
-	time_t t = ticks;
+	return dc_datetime_convert (result, ticks, 0);
+}
 
-	struct tm tm;
-	if (dc_gmtime_r (&t, &tm) == NULL)
+dc_datetime_t *
+dc_datetime_convert (dc_datetime_t *result,
+                     dc_ticks_t ticks,
+                     int timezone)
+{
+	dc_datetime_t datetime;
+
+	if (dc_datetime_convert_batch (&datetime, &ticks, 1, timezone) == NULL)
 		return NULL;
 
-	if (result) {
-		result->year = tm.tm_year + 1900;
-		result->month = tm.tm_mon + 1;
-		result->day = tm.tm_mday;
-		result->hour = tm.tm_hour;
-		result->minute = tm.tm_min;
-		result->second = tm.tm_sec;
-		result->timezone = 0;
-	}
+	if (result)
+		*result = datetime;
 
 	return result;
 }
 
+dc_datetime_t *
+dc_datetime_convert_batch (dc_datetime_t results[],
+                           const dc_ticks_t ticks[],
+                           unsigned int count,
+                           int timezone)
+{
+	long long offset = (timezone != DC_TIMEZONE_NONE) ? timezone : 0;
+	long long previous = 0;
+	long long year = 0;
+	int month = 0, day = 0;
+	int valid = 0;
+
+	if (results == NULL || (ticks == NULL && count))
+		return NULL;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		long long t = ticks[i] + offset;
+		long long days = (t >= 0 ? t : t - (SECONDS_PER_DAY - 1)) / SECONDS_PER_DAY;
+		long long seconds = t - days * SECONDS_PER_DAY;
+
+		// Consecutive timestamps are usually on the same day, so the
+		// calendar date is re-used.
+		if (!valid || days != previous) {
+			dc_civil_from_days (days, &year, &month, &day);
+			if (year < INT_MIN || year > INT_MAX)
+				return NULL;
+			previous = days;
+			valid = 1;
+		}
+
+		results[i].year = year;
+		results[i].month = month;
+		results[i].day = day;
+		results[i].hour = seconds / 3600;
+		results[i].minute = (seconds % 3600) / 60;
+		results[i].second = seconds % 60;
+		results[i].timezone = timezone;
+	}
+
+	return results;
+}
+
 dc_ticks_t
 dc_datetime_mktime (const dc_datetime_t *dt)
 {
 	if (dt == NULL)
 		return -1;
 
-	struct tm tm;
-	tm.tm_year = dt->year - 1900;
-	tm.tm_mon = dt->month - 1;
-	tm.tm_mday = dt->day;
-	tm.tm_hour = dt->hour;
-	tm.tm_min = dt->minute;
-	tm.tm_sec = dt->second;
-	tm.tm_isdst = 0;
-
-	time_t t = dc_timegm (&tm);
-	if (t == (time_t) -1)
-		return t;
+	long long days = dc_days_from_civil (dt->year, dt->month, dt->day);
+	dc_ticks_t t = ((days * 24 + dt->hour) * 60 + dt->minute) * 60 + dt->second;
 
 	if (dt->timezone != DC_TIMEZONE_NONE) {
 		t -= dt->timezone;
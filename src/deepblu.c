@@ -26,6 +26,7 @@
 #include "context-private.h"
 #include "device-private.h"
 #include "array.h"
+#include "bleline.h"
 
 // "Write state"
 #define CMD_SETTIME	0x20	// Send 6 byte date-time, get single-byte 00x00 ack
@@ -64,6 +65,7 @@
 typedef struct deepblu_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	dc_bleline_t *bleline;
 	unsigned char fingerprint[COSMIQ_HDR_SIZE];
 } deepblu_device_t;
 
@@ -79,7 +81,9 @@ static const dc_device_vtable_t deepblu_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	deepblu_device_foreach, /* foreach */
+	NULL, /* extract */
 	deepblu_device_timesync, /* timesync */
 	deepblu_device_close, /* close */
 };
@@ -146,8 +150,8 @@ deepblu_send_cmd(deepblu_device_t *device, const unsigned char cmd, const unsign
 		p = write_hex_byte(data[i], p);
 	*p++ = '\n';
 
-	// .. and send it out
-	return dc_iostream_write(device->iostream, buffer, p-buffer, NULL);
+	// .. and send it out, in as few BLE packets as possible.
+	return dc_bleline_write(device->bleline, buffer, p-buffer);
 }
 
 //
@@ -158,55 +162,30 @@ deepblu_send_cmd(deepblu_device_t *device, const unsigned char cmd, const unsign
 // Semi BLE chip will sometimes send packets early (some internal
 // serial buffer timeout?) with incompete data.
 //
-// So read packets until you get newline.
+// So read packets until you get newline. The packet stream keeps
+// anything after the newline for the next line.
 static dc_status_t
-deepblu_recv_line(deepblu_device_t *device, unsigned char *buf, size_t size)
+deepblu_recv_line(deepblu_device_t *device, char *buf, size_t size, size_t *len)
 {
-	while (1) {
-		unsigned char buffer[20];
-		size_t transferred = 0;
-		dc_status_t status;
+	dc_status_t status;
 
-		status = dc_iostream_read(device->iostream, buffer, sizeof(buffer), &transferred);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR(device->base.context, "Failed to receive Deepblu reply packet.");
-			return status;
-		}
-		if (transferred > size) {
-			ERROR(device->base.context, "Deepblu reply packet with too much data (got %zu, expected %zu)", transferred, size);
-			return DC_STATUS_IO;
-		}
-		if (!transferred) {
-			ERROR(device->base.context, "Empty Deepblu reply packet");
-			return DC_STATUS_IO;
-		}
-		memcpy(buf, buffer, transferred);
-		buf += transferred;
-		size -= transferred;
-		if (buf[-1] == '\n')
-			break;
+	status = dc_bleline_readline(device->bleline, buf, size, len);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR(device->base.context, "Failed to receive Deepblu reply packet.");
+		return status;
 	}
-	buf[-1] = 0;
 	return DC_STATUS_SUCCESS;
 }
 
-static int
-hex_nibble(char c)
-{
-	if (c >= '0' && c <= '9')
-		return c - '0';
-	if (c >= 'a' && c <= 'f')
-		return c - 'a' + 10;
-	if (c >= 'A' && c <= 'F')
-		return c - 'A' + 10;
-	return -1;
-}
-
 static int
 read_hex_byte(char *p)
 {
+	unsigned char byte;
+
 	// This is negative if either of the nibbles is invalid
-	return (hex_nibble(p[0]) << 4) | hex_nibble(p[1]);
+	if (array_convert_hex2bin((const unsigned char *) p, 2, &byte, 1) != 0)
+		return -1;
+	return byte;
 }
 
 
@@ -219,17 +198,18 @@ static dc_status_t
 deepblu_recv_data(deepblu_device_t *device, const unsigned char expected, unsigned char *buf, size_t size, size_t *received)
 {
 	int len, i;
+	size_t length;
 	dc_status_t status;
 	char buffer[8+2*MAX_DATA];
 	int cmd, csum, ndata;
 
-	status = deepblu_recv_line(device, buffer, sizeof(buffer));
+	status = deepblu_recv_line(device, buffer, sizeof(buffer), &length);
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
 	// deepblu_recv_line() always zero-terminates the result
 	// if it returned success, and has removed the final newline.
-	len = strlen(buffer);
+	len = length;
 	HEXDUMP(device->base.context, DC_LOGLEVEL_DEBUG, "rcv", buffer, len);
 
 	// A valid reply should always be at least 7 characters: the
@@ -262,15 +242,13 @@ deepblu_recv_data(deepblu_device_t *device, const unsigned char expected, unsign
 
 	csum += cmd + ndata;
 
-	for (i = 7; i < len; i += 2) {
-		int byte = read_hex_byte(buffer + i);
-		if (byte < 0) {
-			ERROR(device->base.context, "Deepblu reply packet data not valid hex");
-			return DC_STATUS_IO;
-		}
-		*buf++ = byte;
-		csum += byte;
+	// Decode all the data at once, and only then sum the bytes.
+	if (array_convert_hex2bin((const unsigned char *) buffer + 7, ndata, buf, ndata >> 1) != 0) {
+		ERROR(device->base.context, "Deepblu reply packet data not valid hex");
+		return DC_STATUS_IO;
 	}
+	for (i = 0; i < ndata >> 1; i++)
+		csum += buf[i];
 
 	if (csum & 255) {
 		ERROR(device->base.context, "Deepblu reply packet csum not valid (%x)", csum);
@@ -328,6 +306,7 @@ deepblu_recv_bulk(deepblu_device_t *device, const unsigned char cmd, unsigned ch
 dc_status_t
 deepblu_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream)
 {
+	dc_status_t status;
 	deepblu_device_t *device;
 
 	if (out == NULL)
@@ -344,6 +323,12 @@ deepblu_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *io
 	device->iostream = iostream;
 	memset(device->fingerprint, 0, sizeof(device->fingerprint));
 
+	status = dc_bleline_new(&device->bleline, context, iostream);
+	if (status != DC_STATUS_SUCCESS) {
+		dc_device_deallocate((dc_device_t *) device);
+		return status;
+	}
+
 	*out = (dc_device_t *) device;
 	return DC_STATUS_SUCCESS;
 }
@@ -402,6 +387,8 @@ deepblu_device_close (dc_device_t *abstract)
 {
 	deepblu_device_t *device = (deepblu_device_t *) abstract;
 
+	dc_bleline_free(device->bleline);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -429,6 +416,10 @@ deepblu_download_dive(deepblu_device_t *device, unsigned char nr, dc_dive_callba
 	if (memcmp(header, device->fingerprint, sizeof (device->fingerprint)) == 0)
 		return DC_STATUS_DONE;
 
+	/* Skip dives that were already downloaded in an earlier session */
+	if (device_is_known(&device->base, (const unsigned char *) header, header_len))
+		return DC_STATUS_SUCCESS;
+
 	status = deepblu_send_recv(device,  CMD_GETPROFILE, &nr, 1, profilebytes, sizeof(profilebytes));
 	if (status != DC_STATUS_SUCCESS)
 		return status;
@@ -53,6 +53,7 @@ static dc_status_t deepblu_parser_set_data (dc_parser_t *abstract, const unsigne
 static dc_status_t deepblu_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t deepblu_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t deepblu_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t deepblu_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract);
 
 static const dc_parser_vtable_t deepblu_parser_vtable = {
 	sizeof(deepblu_parser_t),
@@ -61,7 +62,8 @@ static const dc_parser_vtable_t deepblu_parser_vtable = {
 	deepblu_parser_get_datetime, /* datetime */
 	deepblu_parser_get_field, /* fields */
 	deepblu_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	NULL, /* destroy */
+	deepblu_parser_clone /* clone */
 };
 
 dc_status_t
@@ -79,11 +81,23 @@ deepblu_parser_create (dc_parser_t **out, dc_context_t *context)
 		return DC_STATUS_NOMEMORY;
 	}
 
+	dc_field_cache_init(&parser->cache);
+
 	*out = (dc_parser_t *) parser;
 
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+deepblu_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract)
+{
+	deepblu_parser_t *parser = (deepblu_parser_t *) clone;
+
+	dc_field_cache_rebase (&parser->cache, abstract, clone, abstract->vtable->size);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static double
 pressure_to_depth(unsigned int mbar)
 {
@@ -111,7 +125,7 @@ deepblu_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsig
 
 	deepblu->callback = NULL;
 	deepblu->userdata = NULL;
-	memset(&deepblu->cache, 0, sizeof(deepblu->cache));
+	dc_field_cache_clear(&deepblu->cache);
 
 	// LE16 at 0 is 'dive number'
 
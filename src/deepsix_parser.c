@@ -55,6 +55,7 @@ static dc_status_t deepsix_parser_set_data (dc_parser_t *abstract, const unsigne
 static dc_status_t deepsix_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t deepsix_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t deepsix_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t deepsix_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract);
 
 static const dc_parser_vtable_t deepsix_parser_vtable = {
         sizeof(deepsix_parser_t),
@@ -63,7 +64,8 @@ static const dc_parser_vtable_t deepsix_parser_vtable = {
         deepsix_parser_get_datetime, /* datetime */
         deepsix_parser_get_field, /* fields */
         deepsix_parser_samples_foreach, /* samples_foreach */
-        NULL /* destroy */
+        NULL, /* destroy */
+        deepsix_parser_clone /* clone */
 };
 
 dc_status_t
@@ -81,11 +83,23 @@ deepsix_parser_create (dc_parser_t **out, dc_context_t *context)
         return DC_STATUS_NOMEMORY;
     }
 
+    dc_field_cache_init(&parser->cache);
+
     *out = (dc_parser_t *) parser;
 
     return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+deepsix_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract)
+{
+    deepsix_parser_t *parser = (deepsix_parser_t *) clone;
+
+    dc_field_cache_rebase (&parser->cache, abstract, clone, abstract->vtable->size);
+
+    return DC_STATUS_SUCCESS;
+}
+
 static double
 pressure_to_depth(unsigned int mbar)
 {
@@ -113,7 +127,7 @@ deepsix_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsig
 
     deepsix->callback = NULL;
     deepsix->userdata = NULL;
-    memset(&deepsix->cache, 0, sizeof(deepsix->cache));
+    dc_field_cache_clear(&deepsix->cache);
 
     // LE16 at 0 is 'dive number'
 
@@ -19,6 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,22 +56,48 @@ typedef int (*dc_match_t)(const void *, const void *);
 
 typedef int (*dc_filter_t) (dc_transport_t transport, const void *userdata, void *params);
 
+#ifdef ENABLE_BACKEND_UWATEC
 static int dc_filter_uwatec (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_SUUNTO
 static int dc_filter_suunto (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 static int dc_filter_shearwater (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_HW
 static int dc_filter_hw (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_TECDIVING
 static int dc_filter_tecdiving (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_MARES
 static int dc_filter_mares (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 static int dc_filter_divesystem (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 static int dc_filter_oceanic (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_MCLEAN
 static int dc_filter_mclean (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 static int dc_filter_atomic (dc_transport_t transport, const void *userdata, void *params);
+#endif
 
 // Not merged upstream yet
+#ifdef ENABLE_BACKEND_GARMIN
 static int dc_filter_garmin (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_DEEPBLU
 static int dc_filter_deepblu (dc_transport_t transport, const void *userdata, void *params);
 static int dc_filter_deepsix (dc_transport_t transport, const void *userdata, void *params);
+#endif
+#ifdef ENABLE_BACKEND_OCEANS
 static int dc_filter_oceans(dc_transport_t transport, const void *userdata, void *params);
+#endif
 
 static dc_status_t dc_descriptor_iterator_next (dc_iterator_t *iterator, void *item);
 
@@ -99,6 +129,7 @@ static const dc_iterator_vtable_t dc_descriptor_iterator_vtable = {
  */
 
 static const dc_descriptor_t g_descriptors[] = {
+#ifdef ENABLE_BACKEND_SUUNTO
 	/* Suunto Solution */
 	{"Suunto", "Solution", DC_FAMILY_SUUNTO_SOLUTION, 0, DC_TRANSPORT_SERIAL, NULL},
 	/* Suunto Eon */
@@ -136,6 +167,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Suunto", "EON Steel", DC_FAMILY_SUUNTO_EONSTEEL, 0, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_suunto},
 	{"Suunto", "EON Core",  DC_FAMILY_SUUNTO_EONSTEEL, 1, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_suunto},
 	{"Suunto", "D5",        DC_FAMILY_SUUNTO_EONSTEEL, 2, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_suunto},
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
 	/* Uwatec Aladin */
 	{"Uwatec", "Aladin Air Twin",     DC_FAMILY_UWATEC_ALADIN, 0x1C, DC_TRANSPORT_SERIAL, NULL},
 	{"Uwatec", "Aladin Sport Plus",   DC_FAMILY_UWATEC_ALADIN, 0x3E, DC_TRANSPORT_SERIAL, NULL},
@@ -176,10 +209,14 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Scubapro", "G2",                  DC_FAMILY_UWATEC_SMART, 0x32, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_uwatec},
 	{"Scubapro", "G2 Console",          DC_FAMILY_UWATEC_SMART, 0x32, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_uwatec},
 	{"Scubapro", "G2 HUD",              DC_FAMILY_UWATEC_SMART, 0x42, DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE, dc_filter_uwatec},
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
 	/* Reefnet */
 	{"Reefnet", "Sensus",       DC_FAMILY_REEFNET_SENSUS, 1, DC_TRANSPORT_SERIAL, NULL},
 	{"Reefnet", "Sensus Pro",   DC_FAMILY_REEFNET_SENSUSPRO, 2, DC_TRANSPORT_SERIAL, NULL},
 	{"Reefnet", "Sensus Ultra", DC_FAMILY_REEFNET_SENSUSULTRA, 3, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 	/* Oceanic VT Pro */
 	{"Aeris",    "500 AI",     DC_FAMILY_OCEANIC_VTPRO, 0x4151, DC_TRANSPORT_SERIAL, NULL},
 	{"Oceanic",  "Versa Pro",  DC_FAMILY_OCEANIC_VTPRO, 0x4155, DC_TRANSPORT_SERIAL, NULL},
@@ -268,6 +305,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Sherwood", "Wisdom 4",            DC_FAMILY_OCEANIC_ATOM2, 0x4655, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_oceanic},
 	{"Oceanic",  "Pro Plus 4",          DC_FAMILY_OCEANIC_ATOM2, 0x4656, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_oceanic},
 	{"Aqualung", "i470TC",              DC_FAMILY_OCEANIC_ATOM2, 0x4743, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_oceanic},
+#endif
+#ifdef ENABLE_BACKEND_MARES
 	/* Mares Nemo */
 	{"Mares", "Nemo",         DC_FAMILY_MARES_NEMO, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Mares", "Nemo Steel",   DC_FAMILY_MARES_NEMO, 0, DC_TRANSPORT_SERIAL, NULL},
@@ -298,6 +337,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Mares", "Quad Air",          DC_FAMILY_MARES_ICONHD , 0x23, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_mares},
 	{"Mares", "Smart Air",         DC_FAMILY_MARES_ICONHD , 0x24, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_mares},
 	{"Mares", "Quad",              DC_FAMILY_MARES_ICONHD , 0x29, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, dc_filter_mares},
+#endif
+#ifdef ENABLE_BACKEND_HW
 	/* Heinrichs Weikamp */
 	{"Heinrichs Weikamp", "OSTC",     DC_FAMILY_HW_OSTC, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Heinrichs Weikamp", "OSTC Mk2", DC_FAMILY_HW_OSTC, 1, DC_TRANSPORT_SERIAL, NULL},
@@ -316,6 +357,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x12, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x13, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
 	{"Heinrichs Weikamp", "OSTC 2 TR",  DC_FAMILY_HW_OSTC3, 0x33, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_hw},
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
 	/* Cressi Edy */
 	{"Tusa",   "IQ-700", DC_FAMILY_CRESSI_EDY, 0x05, DC_TRANSPORT_SERIAL, NULL},
 	{"Cressi", "Edy",    DC_FAMILY_CRESSI_EDY, 0x08, DC_TRANSPORT_SERIAL, NULL},
@@ -327,14 +370,20 @@ static const dc_descriptor_t g_descriptors[] = {
 	/* Cressi Goa */
 	{"Cressi", "Cartesio", DC_FAMILY_CRESSI_GOA, 1, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, NULL},
 	{"Cressi", "Goa",      DC_FAMILY_CRESSI_GOA, 2, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLE, NULL},
+#endif
+#ifdef ENABLE_BACKEND_ZEAGLE
 	/* Zeagle N2iTiON3 */
 	{"Zeagle",    "N2iTiON3",   DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Apeks",     "Quantum X",  DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Dive Rite", "NiTek Trio", DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Scubapro",  "XTender 5",  DC_FAMILY_ZEAGLE_N2ITION3, 0, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 	/* Atomic Aquatics Cobalt */
 	{"Atomic Aquatics", "Cobalt",   DC_FAMILY_ATOMICS_COBALT, 0, DC_TRANSPORT_USB, dc_filter_atomic},
 	{"Atomic Aquatics", "Cobalt 2", DC_FAMILY_ATOMICS_COBALT, 2, DC_TRANSPORT_USB, dc_filter_atomic},
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	/* Shearwater Predator */
 	{"Shearwater", "Predator", DC_FAMILY_SHEARWATER_PREDATOR, 2, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH, dc_filter_shearwater},
 	/* Shearwater Petrel */
@@ -346,10 +395,16 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Shearwater", "Nerd 2",    DC_FAMILY_SHEARWATER_PETREL, 7, DC_TRANSPORT_BLE, dc_filter_shearwater},
 	{"Shearwater", "Teric",     DC_FAMILY_SHEARWATER_PETREL, 8, DC_TRANSPORT_BLE, dc_filter_shearwater},
 	{"Shearwater", "Peregrine", DC_FAMILY_SHEARWATER_PETREL, 9, DC_TRANSPORT_BLE, dc_filter_shearwater},
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
 	/* Dive Rite NiTek Q */
 	{"Dive Rite", "NiTek Q",   DC_FAMILY_DIVERITE_NITEKQ, 0, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifdef ENABLE_BACKEND_CITIZEN
 	/* Citizen Hyper Aqualand */
 	{"Citizen", "Hyper Aqualand", DC_FAMILY_CITIZEN_AQUALAND, 0, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 	/* DiveSystem/Ratio iDive */
 	{"DiveSystem", "Orca",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x02, DC_TRANSPORT_SERIAL, NULL},
 	{"DiveSystem", "iDive Pro",     DC_FAMILY_DIVESYSTEM_IDIVE, 0x03, DC_TRANSPORT_SERIAL, NULL},
@@ -389,6 +444,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Ratio",      "iDive Color Reb",  DC_FAMILY_DIVESYSTEM_IDIVE, 0x56, DC_TRANSPORT_SERIAL, NULL},
 	{"Seac",       "Jack",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x1000, DC_TRANSPORT_SERIAL, NULL},
 	{"Seac",       "Guru",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x1002, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifdef ENABLE_BACKEND_COCHRAN
 	/* Cochran Commander */
 	{"Cochran", "Commander TM", DC_FAMILY_COCHRAN_COMMANDER, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Cochran", "Commander I",  DC_FAMILY_COCHRAN_COMMANDER, 1, DC_TRANSPORT_SERIAL, NULL},
@@ -396,25 +453,40 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Cochran", "EMC-14",       DC_FAMILY_COCHRAN_COMMANDER, 3, DC_TRANSPORT_SERIAL, NULL},
 	{"Cochran", "EMC-16",       DC_FAMILY_COCHRAN_COMMANDER, 4, DC_TRANSPORT_SERIAL, NULL},
 	{"Cochran", "EMC-20H",      DC_FAMILY_COCHRAN_COMMANDER, 5, DC_TRANSPORT_SERIAL, NULL},
+#endif
+#ifdef ENABLE_BACKEND_TECDIVING
 	/* Tecdiving DiveComputer.eu */
 	{"Tecdiving", "DiveComputer.eu", DC_FAMILY_TECDIVING_DIVECOMPUTEREU, 0, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH, dc_filter_tecdiving},
+#endif
+#ifdef ENABLE_BACKEND_MCLEAN
 	/* McLean Extreme */
 	{ "McLean", "Extreme", DC_FAMILY_MCLEAN_EXTREME, 0, DC_TRANSPORT_SERIAL | DC_TRANSPORT_BLUETOOTH | DC_TRANSPORT_BLE, dc_filter_mclean},
+#endif
+#ifdef ENABLE_BACKEND_LIQUIVISION
 	/* Liquivision */
 	{"Liquivision", "Xen",  DC_FAMILY_LIQUIVISION_LYNX, 0, DC_TRANSPORT_SERIAL, NULL},
 	{"Liquivision", "Xeo",  DC_FAMILY_LIQUIVISION_LYNX, 1, DC_TRANSPORT_SERIAL, NULL},
 	{"Liquivision", "Lynx", DC_FAMILY_LIQUIVISION_LYNX, 2, DC_TRANSPORT_SERIAL, NULL},
 	{"Liquivision", "Kaon", DC_FAMILY_LIQUIVISION_LYNX, 3, DC_TRANSPORT_SERIAL, NULL},
+#endif
 
 	// Not merged upstream yet
+#ifdef ENABLE_BACKEND_GARMIN
 	/* Garmin */
 	{"Garmin", "Descent Mk1", DC_FAMILY_GARMIN, 2859, DC_TRANSPORT_USBSTORAGE, dc_filter_garmin},
+#endif
+#ifdef ENABLE_BACKEND_DEEPBLU
 	/* Deepblu */
 	{"Deepblu", "Cosmiq+", DC_FAMILY_DEEPBLU, 0, DC_TRANSPORT_BLE, dc_filter_deepblu},
+#endif
+#ifdef ENABLE_BACKEND_OCEANS
 	/* Oceans S1 */
 	{ "Oceans", "S1", DC_FAMILY_OCEANS_S1, 0, DC_TRANSPORT_BLE, dc_filter_oceans },
+#endif
+#ifdef ENABLE_BACKEND_DEEPBLU
 	/* Deep Six */
     {"Deep Six", "Excursion", DC_FAMILY_DEEPBLU, 0, DC_TRANSPORT_BLE, dc_filter_deepsix },
+#endif
 };
 
 static int
@@ -486,8 +558,9 @@ dc_match_oceanic (const void *key, const void *value)
 		(model     ) & 0xFF,
 		0
 	};
+	const char *p = prefix;
 
-	return dc_match_number_with_prefix (key, &prefix);
+	return dc_match_number_with_prefix (key, &p);
 }
 
 static int
@@ -515,6 +588,7 @@ static const char * const rfcomm[] = {
 	NULL
 };
 
+#ifdef ENABLE_BACKEND_UWATEC
 static int dc_filter_uwatec (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const irda[] = {
@@ -549,7 +623,9 @@ static int dc_filter_uwatec (dc_transport_t transport, const void *userdata, voi
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_SUUNTO
 static int dc_filter_suunto (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const dc_usb_desc_t usbhid[] = {
@@ -571,7 +647,9 @@ static int dc_filter_suunto (dc_transport_t transport, const void *userdata, voi
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_HW
 static int dc_filter_hw (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -587,7 +665,9 @@ static int dc_filter_hw (dc_transport_t transport, const void *userdata, void *p
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_SHEARWATER
 static int dc_filter_shearwater (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -608,7 +688,9 @@ static int dc_filter_shearwater (dc_transport_t transport, const void *userdata,
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_TECDIVING
 static int dc_filter_tecdiving (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -623,7 +705,9 @@ static int dc_filter_tecdiving (dc_transport_t transport, const void *userdata,
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_MARES
 static int dc_filter_mares (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -637,7 +721,9 @@ static int dc_filter_mares (dc_transport_t transport, const void *userdata, void
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 static int dc_filter_divesystem (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -650,7 +736,9 @@ static int dc_filter_divesystem (dc_transport_t transport, const void *userdata,
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_OCEANIC
 static int dc_filter_oceanic (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const unsigned int model[] = {
@@ -672,7 +760,9 @@ static int dc_filter_oceanic (dc_transport_t transport, const void *userdata, vo
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_MCLEAN
 static int dc_filter_mclean(dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -687,7 +777,9 @@ static int dc_filter_mclean(dc_transport_t transport, const void *userdata, void
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_ATOMICS
 static int dc_filter_atomic (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const dc_usb_desc_t usb[] = {
@@ -704,8 +796,10 @@ static int dc_filter_atomic (dc_transport_t transport, const void *userdata, voi
 
 	return 1;
 }
+#endif
 
 // Not merged upstream yet
+#ifdef ENABLE_BACKEND_GARMIN
 static int dc_filter_garmin (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const dc_usb_desc_t usbhid[] = {
@@ -718,7 +812,9 @@ static int dc_filter_garmin (dc_transport_t transport, const void *userdata, voi
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_DEEPBLU
 static int dc_filter_deepblu (dc_transport_t transport, const void *userdata, void *params)
 {
 	static const char * const bluetooth[] = {
@@ -744,7 +840,9 @@ static int dc_filter_deepsix (dc_transport_t transport, const void *userdata, vo
 
     return 1;
 }
+#endif
 
+#ifdef ENABLE_BACKEND_OCEANS
 static int dc_filter_oceans(dc_transport_t transport, const void* userdata, void *params)
 {
 	static const char* const ble[] = {
@@ -757,6 +855,7 @@ static int dc_filter_oceans(dc_transport_t transport, const void* userdata, void
 
 	return 1;
 }
+#endif
 
 dc_status_t
 dc_descriptor_iterator (dc_iterator_t **out)
@@ -857,3 +956,100 @@ dc_descriptor_filter (dc_descriptor_t *descriptor, dc_transport_t transport, con
 
 	return descriptor->filter (transport, userdata, params);
 }
+
+dc_status_t
+dc_descriptor_find (dc_descriptor_t **out, dc_family_t family, unsigned int model)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		if (g_descriptors[i].type == family && g_descriptors[i].model == model) {
+			*out = (dc_descriptor_t *) &g_descriptors[i];
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	return DC_STATUS_UNSUPPORTED;
+}
+
+/*
+ * Check whether the product name appears anywhere in the advertised name.
+ * Several models usually share one transport filter, and the product name
+ * is the only way to tell them apart without connecting to the device.
+ */
+static int
+dc_descriptor_match_product (const dc_descriptor_t *descriptor, const char *name)
+{
+	size_t n = strlen (descriptor->product);
+
+	for (const char *p = name; *p; ++p) {
+		if (strncasecmp (p, descriptor->product, n) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static dc_status_t
+dc_descriptor_find_internal (dc_descriptor_t **out, dc_transport_t transport, const void *userdata, const char *name)
+{
+	const dc_descriptor_t *candidate = NULL;
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		const dc_descriptor_t *descriptor = &g_descriptors[i];
+
+		// Descriptors without a filter accept anything, so they can't
+		// be used to identify a device.
+		if ((descriptor->transports & transport) == 0 || descriptor->filter == NULL)
+			continue;
+
+		if (!descriptor->filter (transport, userdata, NULL))
+			continue;
+
+		if (name == NULL || dc_descriptor_match_product (descriptor, name)) {
+			candidate = descriptor;
+			break;
+		}
+
+		if (candidate == NULL)
+			candidate = descriptor;
+	}
+
+	if (candidate == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	*out = (dc_descriptor_t *) candidate;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_descriptor_find_usb (dc_descriptor_t **out, unsigned int vid, unsigned int pid)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usb_desc_t usb = {vid, pid};
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	status = dc_descriptor_find_internal (out, DC_TRANSPORT_USBHID, &usb, NULL);
+	if (status != DC_STATUS_UNSUPPORTED)
+		return status;
+
+	return dc_descriptor_find_internal (out, DC_TRANSPORT_USB, &usb, NULL);
+}
+
+dc_status_t
+dc_descriptor_find_name (dc_descriptor_t **out, dc_transport_t transport, const char *name)
+{
+	if (out == NULL || name == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (transport != DC_TRANSPORT_IRDA &&
+		transport != DC_TRANSPORT_BLUETOOTH &&
+		transport != DC_TRANSPORT_BLE)
+		return DC_STATUS_INVALIDARGS;
+
+	return dc_descriptor_find_internal (out, transport, name, name);
+}
@@ -28,12 +28,38 @@
 #include <libdivecomputer/device.h>
 
 #include "common-private.h"
+#include "timer.h"
+#include "coroutine.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
-#define EVENT_PROGRESS_INITIALIZER {0, UINT_MAX}
+#define EVENT_PROGRESS_INITIALIZER {0, UINT_MAX, 0}
+
+#define DEVICE_PACING_MAX 2
+
+typedef struct device_pacing_slot_t {
+	int valid;
+	unsigned int model;
+	unsigned int initial;
+	unsigned int minimum;
+	unsigned int current;
+	unsigned int good;
+	unsigned int successes;
+} device_pacing_slot_t;
+
+typedef struct device_read_t {
+	unsigned int address;
+	unsigned int size;
+	unsigned char *data;
+} device_read_t;
+
+typedef struct device_cache_page_t {
+	unsigned int address;
+	// Time of the last access, or zero for an empty slot.
+	unsigned int lastused;
+} device_cache_page_t;
 
 struct dc_device_t;
 struct dc_device_vtable_t;
@@ -48,12 +74,71 @@ struct dc_device_t {
 	unsigned int event_mask;
 	dc_event_callback_t event_callback;
 	void *event_userdata;
+	// Timer for the progress events and the retries.
+	dc_timer_t *timer;
+	// Coalescing of the progress events.
+	unsigned int progress_interval;
+	unsigned int progress_delta;
+	dc_usecs_t progress_time;
+	dc_event_progress_t progress_last;
+	dc_event_progress_t progress_pending;
+	int progress_haspending;
+	// Timing and phase of the progress events.
+	int progress_started;
+	dc_usecs_t progress_start;
+	dc_usecs_t progress_sample_time;
+	unsigned int progress_sample_current;
+	unsigned int progress_rate;
+	dc_progress_phase_t progress_phase;
+	unsigned int progress_dive;
+	unsigned int progress_ndives;
+	// Retry policy, overriding the backend defaults.
+	dc_retry_policy_t retry_policy;
+	int retry_haspolicy;
+	unsigned int retry_seed;
 	// Cancellation support.
 	dc_cancel_callback_t cancel_callback;
 	void *cancel_userdata;
+	// Scatter/gather dive views.
+	dc_dive_view_callback_t view_callback;
+	void *view_userdata;
+	// Fingerprints of the dives that were already downloaded.
+	dc_fpstore_t *fpstore;
+	dc_dive_callback_t dive_callback;
+	void *dive_userdata;
+	// Content hashes of the dives.
+	unsigned int hash_flags;
+	// Download statistics of the dives.
+	dc_iostream_t *iostream;
+	int stats_enabled;
+	dc_iostream_stats_t stats_last;
+	dc_usecs_t stats_time;
+	unsigned int stats_callback;
+	// Learned inter-packet delays.
+	dc_pacing_t *pacing;
+	device_pacing_slot_t pacing_slots[DEVICE_PACING_MAX];
+	// Memory image serving the memory reads.
+	const unsigned char *memory_data;
+	unsigned int memory_size;
+	// Page cache for the memory reads.
+	unsigned int cache_pagesize;
+	unsigned int cache_npages;
+	unsigned int cache_clock;
+	device_cache_page_t *cache_pages;
+	unsigned char *cache_data;
+	unsigned char *cache_scratch;
+	// Adaptive number of pages per request of device_page_read.
+	unsigned int page_npages;
+	unsigned int page_successes;
 	// Cached events for the parsers.
 	dc_event_devinfo_t devinfo;
 	dc_event_clock_t clock;
+	// Step based download.
+	dc_coroutine_t *step_coroutine;
+	dc_iostream_t *step_iostream;
+	dc_step_t step_current;
+	int step_finished;
+	int step_cancel;
 };
 
 struct dc_device_vtable_t {
@@ -69,8 +154,12 @@ struct dc_device_vtable_t {
 
 	dc_status_t (*dump) (dc_device_t *device, dc_buffer_t *buffer);
 
+	dc_status_t (*dump_update) (dc_device_t *device, dc_buffer_t *buffer);
+
 	dc_status_t (*foreach) (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
 
+	dc_status_t (*extract) (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 	dc_status_t (*timesync) (dc_device_t *device, const dc_datetime_t *datetime);
 
 	dc_status_t (*close) (dc_device_t *device);
@@ -88,12 +177,161 @@ dc_device_deallocate (dc_device_t *device);
 void
 device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data);
 
+/*
+ * Deliver the most recent progress event that was held back by the
+ * coalescing, at the end of every public operation.
+ */
+void
+device_event_flush (dc_device_t *device);
+
+/*
+ * Set the phase reported in the next progress events. The phase is
+ * reset at the end of every public operation.
+ */
+void
+device_progress_phase (dc_device_t *device, dc_progress_phase_t phase, unsigned int dive, unsigned int ndives);
+
 int
 device_is_cancelled (dc_device_t *device);
 
+/*
+ * Backends that can deliver a dive without making it contiguous first
+ * check device_has_view, and pass the spans to device_dive_view_emit
+ * instead of calling the regular dive callback.
+ */
+#define device_has_view(device) ((device) != NULL && (device)->view_callback != NULL)
+
+int
+device_dive_view_emit (dc_device_t *device, const unsigned char *data1, unsigned int size1, const unsigned char *data2, unsigned int size2, const unsigned char *fingerprint, unsigned int fsize);
+
+/*
+ * Backends that know the fingerprint of a dive before downloading it
+ * can check device_is_known, and skip the dive if it's already present
+ * in the fingerprint store.
+ */
+int
+device_is_known (dc_device_t *device, const unsigned char *fingerprint, unsigned int fsize);
+
+/*
+ * Backends that can resume an incremental download keep their state
+ * in the fingerprint store. The state is only returned if its size
+ * matches exactly. Without a fingerprint store, there is no state and
+ * storing it is a no-op.
+ */
+int
+device_state_load (dc_device_t *device, unsigned char data[], unsigned int size);
+
+void
+device_state_store (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+/*
+ * State of the retries for a single packet.
+ *
+ * Backends call device_retry_init with their default number of retries
+ * and initial delay (in milliseconds) before sending a packet, and
+ * device_retry_next after every failed attempt. A nonzero return value
+ * means the packet should be sent again, after the backoff delay has
+ * already been waited on the iostream. Without an iostream, the delay
+ * is skipped.
+ */
+typedef struct device_retry_t {
+	dc_device_t *device;
+	unsigned int count;
+	unsigned int maxretries;
+	unsigned int delay;
+	unsigned int maxdelay;
+	unsigned int budget;
+	int jitter;
+	dc_usecs_t start;
+} device_retry_t;
+
+void
+device_retry_init (device_retry_t *retry, dc_device_t *device, unsigned int maxretries, unsigned int delay);
+
+int
+device_retry_next (device_retry_t *retry, dc_iostream_t *iostream, dc_status_t status);
+
+/*
+ * Backends with a fixed delay before every command call device_pacing_delay
+ * with that delay, and report the outcome of the command with
+ * device_pacing_update. When a pacing cache is attached, the delay is
+ * shortened while the commands keep succeeding, and restored to the last
+ * working value as soon as one fails. Without a cache, the fixed delay
+ * is returned unchanged.
+ */
+unsigned int
+device_pacing_delay (dc_device_t *device, unsigned int id, unsigned int delay);
+
+void
+device_pacing_update (dc_device_t *device, unsigned int id, dc_status_t status);
+
 dc_status_t
 device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize);
 
+/*
+ * Read a number of memory ranges with the fewest possible transfers.
+ * The ranges are sorted by address (in place), and overlapping or
+ * adjacent ranges are merged. Every merged range is then transferred in
+ * packets of at most maxpacket bytes (or in a single packet for a zero
+ * maxpacket). A progress event is emitted after each packet, if the
+ * progress structure isn't NULL.
+ */
+dc_status_t
+device_read_batch (dc_device_t *device, dc_event_progress_t *progress, device_read_t reads[], unsigned int count, unsigned int maxpacket);
+
+/*
+ * Same as device_dump_read, but with a block size that adapts to the
+ * link. A block that times out is retried with half the size, down to
+ * the minimum of one unit, and the size grows again up to blocksize
+ * after a series of successful transfers. The blocksize must be a
+ * multiple of the unit.
+ */
+dc_status_t
+device_dump_read_adaptive (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize, unsigned int unit);
+
+/*
+ * Framing of the page based memory reads of the legacy serial protocols.
+ *
+ * The answer to a request for npages pages consists of header bytes,
+ * the pages (each followed by a checksum byte for
+ * DEVICE_PAGE_CHECKSUM_ADD8) and trailer bytes. The command callback
+ * fills in the request for the pages starting at address, and returns
+ * its size (at most DEVICE_PAGE_MAXCOMMAND bytes). The transfer
+ * callback sends the command and receives the answer, including the
+ * verification of the echo and any other protocol specific framing.
+ */
+#define DEVICE_PAGE_MAXCOMMAND 16
+#define DEVICE_PAGE_MAXANSWER  256
+
+typedef enum device_page_checksum_t {
+	DEVICE_PAGE_CHECKSUM_NONE,
+	DEVICE_PAGE_CHECKSUM_ADD8,
+} device_page_checksum_t;
+
+typedef struct device_page_protocol_t {
+	unsigned int pagesize;
+	unsigned int maxpages;
+	unsigned int header;
+	unsigned int trailer;
+	device_page_checksum_t checksum;
+	// Default retry policy for device_retry_init.
+	unsigned int maxretries;
+	unsigned int delay;
+	unsigned int (*command) (dc_device_t *device, unsigned char command[], unsigned int address, unsigned int npages);
+	dc_status_t (*transfer) (dc_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize);
+} device_page_protocol_t;
+
+/*
+ * Read a memory range with the page protocol of the backend. The range
+ * is transferred with requests of at most maxpages pages. A request
+ * that fails is retried with half the number of pages, after the retry
+ * delay and purging the input. The number of pages grows again after a
+ * series of successful requests, and is remembered for the next reads.
+ * The size must be a multiple of the page size.
+ */
+dc_status_t
+device_page_read (dc_device_t *device, dc_iostream_t *iostream, const device_page_protocol_t *protocol, unsigned int address, unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,6 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
@@ -68,6 +72,21 @@
 
 #include "device-private.h"
 #include "context-private.h"
+#include "iostream-private.h"
+#include "fpstore-private.h"
+#include "timer.h"
+#include "coroutine.h"
+#include "hash.h"
+#include "array.h"
+#include "checksum.h"
+#include "probes.h"
+
+#define STEP_STACKSIZE (1024 * 1024)
+
+// A learned delay is never shorter than a quarter of the fixed delay,
+// and is only shortened after a number of consecutive successes.
+#define PACING_FACTOR    4
+#define PACING_SUCCESSES 8
 
 dc_device_t *
 dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
@@ -78,7 +97,7 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_device_t));
 
 	// Allocate memory.
-	device = (dc_device_t *) malloc (vtable->size);
+	device = (dc_device_t *) dc_context_malloc (context, vtable->size);
 	if (device == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return device;
@@ -92,19 +111,87 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	device->event_callback = NULL;
 	device->event_userdata = NULL;
 
+	device->timer = NULL;
+
+	device->progress_interval = 0;
+	device->progress_delta = 0;
+	device->progress_time = 0;
+	memset (&device->progress_last, 0, sizeof (device->progress_last));
+	memset (&device->progress_pending, 0, sizeof (device->progress_pending));
+	device->progress_haspending = 0;
+	device->progress_started = 0;
+	device->progress_start = 0;
+	device->progress_sample_time = 0;
+	device->progress_sample_current = 0;
+	device->progress_rate = 0;
+	device->progress_phase = DC_PROGRESS_UNKNOWN;
+	device->progress_dive = 0;
+	device->progress_ndives = 0;
+
+	memset (&device->retry_policy, 0, sizeof (device->retry_policy));
+	device->retry_haspolicy = 0;
+	device->retry_seed = (unsigned int) (size_t) device ^ 0x9E3779B9;
+	if (device->retry_seed == 0)
+		device->retry_seed = 1;
+
 	device->cancel_callback = NULL;
 	device->cancel_userdata = NULL;
 
+	device->view_callback = NULL;
+	device->view_userdata = NULL;
+
+	device->fpstore = NULL;
+	device->dive_callback = NULL;
+	device->dive_userdata = NULL;
+
+	device->hash_flags = 0;
+
+	device->iostream = NULL;
+	device->stats_enabled = 0;
+	memset (&device->stats_last, 0, sizeof (device->stats_last));
+	device->stats_time = 0;
+	device->stats_callback = 0;
+
+	device->pacing = NULL;
+	memset (device->pacing_slots, 0, sizeof (device->pacing_slots));
+
+	device->memory_data = NULL;
+	device->memory_size = 0;
+
+	device->cache_pagesize = 0;
+	device->cache_npages = 0;
+	device->cache_clock = 0;
+	device->cache_pages = NULL;
+	device->cache_data = NULL;
+	device->cache_scratch = NULL;
+
+	device->page_npages = 0;
+	device->page_successes = 0;
+
 	memset (&device->devinfo, 0, sizeof (device->devinfo));
 	memset (&device->clock, 0, sizeof (device->clock));
 
+	device->step_coroutine = NULL;
+	device->step_iostream = NULL;
+	memset (&device->step_current, 0, sizeof (device->step_current));
+	device->step_finished = 0;
+	device->step_cancel = 0;
+
 	return device;
 }
 
 void
 dc_device_deallocate (dc_device_t *device)
 {
-	free (device);
+	if (device == NULL)
+		return;
+
+	dc_timer_free (device->timer);
+
+	dc_context_dealloc (device->context, device->cache_pages);
+	dc_context_dealloc (device->context, device->cache_data);
+	dc_context_dealloc (device->context, device->cache_scratch);
+	dc_context_dealloc (device->context, device);
 }
 
 dc_status_t
@@ -117,6 +204,7 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 		return DC_STATUS_INVALIDARGS;
 
 	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_BACKEND_SUUNTO
 	case DC_FAMILY_SUUNTO_SOLUTION:
 		rc = suunto_solution_device_open (&device, context, iostream);
 		break;
@@ -135,6 +223,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_SUUNTO_EONSTEEL:
 		rc = suunto_eonsteel_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
 	case DC_FAMILY_UWATEC_ALADIN:
 		rc = uwatec_aladin_device_open (&device, context, iostream);
 		break;
@@ -144,6 +234,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_UWATEC_SMART:
 		rc = uwatec_smart_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
 	case DC_FAMILY_REEFNET_SENSUS:
 		rc = reefnet_sensus_device_open (&device, context, iostream);
 		break;
@@ -153,6 +245,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_REEFNET_SENSUSULTRA:
 		rc = reefnet_sensusultra_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 	case DC_FAMILY_OCEANIC_VTPRO:
 		rc = oceanic_vtpro_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
 		break;
@@ -162,6 +256,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_OCEANIC_ATOM2:
 		rc = oceanic_atom2_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_MARES
 	case DC_FAMILY_MARES_NEMO:
 		rc = mares_nemo_device_open (&device, context, iostream);
 		break;
@@ -174,6 +270,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_MARES_ICONHD:
 		rc = mares_iconhd_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_device_open (&device, context, iostream);
 		break;
@@ -183,6 +281,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
 	case DC_FAMILY_CRESSI_EDY:
 		rc = cressi_edy_device_open (&device, context, iostream);
 		break;
@@ -192,57 +292,89 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_CRESSI_GOA:
 		rc = cressi_goa_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_ZEAGLE
 	case DC_FAMILY_ZEAGLE_N2ITION3:
 		rc = zeagle_n2ition3_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 	case DC_FAMILY_ATOMICS_COBALT:
 		rc = atomics_cobalt_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_device_open (&device, context, iostream);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
 	case DC_FAMILY_DIVERITE_NITEKQ:
 		rc = diverite_nitekq_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CITIZEN
 	case DC_FAMILY_CITIZEN_AQUALAND:
 		rc = citizen_aqualand_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 	case DC_FAMILY_DIVESYSTEM_IDIVE:
 		rc = divesystem_idive_device_open (&device, context, iostream, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_COCHRAN
 	case DC_FAMILY_COCHRAN_COMMANDER:
 		rc = cochran_commander_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_TECDIVING
 	case DC_FAMILY_TECDIVING_DIVECOMPUTEREU:
 		rc = tecdiving_divecomputereu_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_MCLEAN
 	case DC_FAMILY_MCLEAN_EXTREME:
 		rc = mclean_extreme_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_LIQUIVISION
 	case DC_FAMILY_LIQUIVISION_LYNX:
 		rc = liquivision_lynx_device_open (&device, context, iostream);
 		break;
+#endif
 	default:
 		return DC_STATUS_INVALIDARGS;
 
 	// Not merged upstream yet
+#ifdef ENABLE_BACKEND_GARMIN
 	case DC_FAMILY_GARMIN:
 		rc = garmin_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DEEPBLU
 	case DC_FAMILY_DEEPBLU:
 		rc = deepblu_device_open (&device, context, iostream);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DEEPSIX
     case DC_FAMILY_DEEPSIX:
         rc = deepsix_device_open (&device, context, iostream);
         break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANS
 	case DC_FAMILY_OCEANS_S1:
 		rc = oceans_s1_device_open(&device, context, iostream);
 		break;
+#endif
 	}
 
+	if (rc == DC_STATUS_SUCCESS && device != NULL)
+		device->iostream = iostream;
+
 	*out = device;
 
 	return rc;
@@ -282,6 +414,8 @@ dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *
 }
 
 
+static dc_status_t device_timer_init (dc_device_t *device);
+
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata)
 {
@@ -292,6 +426,86 @@ dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callbac
 	device->event_callback = callback;
 	device->event_userdata = userdata;
 
+	// The timing of the progress events is only informational, so a
+	// missing timer is not considered a fatal error.
+	if (events & DC_EVENT_PROGRESS) {
+		device_timer_init (device);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+device_timer_init (dc_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device->timer)
+		return DC_STATUS_SUCCESS;
+
+	status = dc_timer_new (&device->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create a timer.");
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_progress_limit (dc_device_t *device, unsigned int interval, unsigned int delta)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (delta > 1000)
+		return DC_STATUS_INVALIDARGS;
+
+	if (interval) {
+		status = device_timer_init (device);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	device->progress_interval = interval;
+	device->progress_delta = delta;
+	device->progress_haspending = 0;
+	memset (&device->progress_last, 0, sizeof (device->progress_last));
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_retry_policy (dc_device_t *device, const dc_retry_policy_t *policy)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (policy == NULL) {
+		memset (&device->retry_policy, 0, sizeof (device->retry_policy));
+		device->retry_haspolicy = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (policy->maxdelay && policy->maxdelay < policy->delay)
+		return DC_STATUS_INVALIDARGS;
+
+	if (policy->budget) {
+		status = device_timer_init (device);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	device->retry_policy = *policy;
+	device->retry_haspolicy = 1;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -310,172 +524,1428 @@ dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsi
 
 
 dc_status_t
-dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
+dc_device_set_fpstore (dc_device_t *device, dc_fpstore_t *store)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->read == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	device->fpstore = store;
 
-	return device->vtable->read (device, address, data, size);
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_device_write (dc_device_t *device, unsigned int address, const unsigned char data[], unsigned int size)
+dc_device_set_hash (dc_device_t *device, unsigned int flags)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->write == NULL)
+	if (flags & ~(DC_DIVE_HASH_FAST | DC_DIVE_HASH_SHA256))
+		return DC_STATUS_INVALIDARGS;
+
+	device->hash_flags = flags;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_stats (dc_device_t *device, int enable)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->write (device, address, data, size);
+	if (enable) {
+		status = device_timer_init (device);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	device->stats_enabled = enable ? 1 : 0;
+
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
+dc_device_set_pacing (dc_device_t *device, dc_pacing_t *pacing)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->dump == NULL)
+	device->pacing = pacing;
+	memset (device->pacing_slots, 0, sizeof (device->pacing_slots));
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_memory (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (buffer == NULL)
+	if (data == NULL && size)
 		return DC_STATUS_INVALIDARGS;
 
-	dc_buffer_clear (buffer);
+	device->memory_data = data;
+	device->memory_size = data ? size : 0;
 
-	return device->vtable->dump (device, buffer);
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
+dc_device_set_readcache (dc_device_t *device, unsigned int pagesize, unsigned int npages)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->read == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (pagesize == 0 || npages == 0)
+		pagesize = npages = 0;
+
+	if (npages && (size_t) pagesize * npages / npages != pagesize)
+		return DC_STATUS_INVALIDARGS;
+
+	device_cache_page_t *pages = NULL;
+	unsigned char *data = NULL, *scratch = NULL;
+	if (npages) {
+		pages = (device_cache_page_t *) dc_context_malloc (device->context, npages * sizeof (device_cache_page_t));
+		data = (unsigned char *) dc_context_malloc (device->context, (size_t) pagesize * npages);
+		scratch = (unsigned char *) dc_context_malloc (device->context, (size_t) pagesize * npages);
+		if (pages == NULL || data == NULL || scratch == NULL) {
+			ERROR (device->context, "Failed to allocate memory.");
+			dc_context_dealloc (device->context, pages);
+			dc_context_dealloc (device->context, data);
+			dc_context_dealloc (device->context, scratch);
+			return DC_STATUS_NOMEMORY;
+		}
+		memset (pages, 0, npages * sizeof (device_cache_page_t));
+	}
+
+	dc_context_dealloc (device->context, device->cache_pages);
+	dc_context_dealloc (device->context, device->cache_data);
+	dc_context_dealloc (device->context, device->cache_scratch);
+
+	device->cache_pagesize = pagesize;
+	device->cache_npages = npages;
+	device->cache_clock = 0;
+	device->cache_pages = pages;
+	device->cache_data = data;
+	device->cache_scratch = scratch;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+dc_device_cache_invalidate (dc_device_t *device)
+{
+	for (unsigned int i = 0; i < device->cache_npages; ++i) {
+		device->cache_pages[i].lastused = 0;
+	}
+	device->cache_clock = 0;
+}
+
+
+static unsigned int
+dc_device_cache_touch (dc_device_t *device)
+{
+	// Restart the clock, rather than wrapping around.
+	if (device->cache_clock == 0xFFFFFFFF) {
+		dc_device_cache_invalidate (device);
+	}
+
+	return ++device->cache_clock;
+}
 
-	// Enable progress notifications.
-	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = size;
-	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
 
+static device_cache_page_t *
+dc_device_cache_lookup (dc_device_t *device, unsigned int address)
+{
+	for (unsigned int i = 0; i < device->cache_npages; ++i) {
+		device_cache_page_t *page = device->cache_pages + i;
+		if (page->lastused && page->address == address)
+			return page;
+	}
+
+	return NULL;
+}
+
+
+static device_cache_page_t *
+dc_device_cache_evict (dc_device_t *device)
+{
+	device_cache_page_t *oldest = device->cache_pages;
+	for (unsigned int i = 1; i < device->cache_npages; ++i) {
+		device_cache_page_t *page = device->cache_pages + i;
+		if (page->lastused < oldest->lastused)
+			oldest = page;
+	}
+
+	return oldest;
+}
+
+
+static dc_status_t
+dc_device_cache_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int pagesize = device->cache_pagesize;
+
+	// Reads larger than the cache are never cached.
+	unsigned int begin = address / pagesize;
+	unsigned int end = ((unsigned long long) address + size + pagesize - 1) / pagesize;
+	if (size == 0 || end - begin > device->cache_npages) {
+		return device->vtable->read (device, address, data, size);
+	}
+
+	// Mark the cached pages as used, and locate the missing pages. The
+	// pages of the current read are the most recently used ones now, so
+	// they are never evicted by the missing pages.
+	unsigned int first = end, last = begin;
+	for (unsigned int i = begin; i < end; ++i) {
+		device_cache_page_t *page = dc_device_cache_lookup (device, i * pagesize);
+		if (page) {
+			page->lastused = dc_device_cache_touch (device);
+		} else {
+			if (first > i)
+				first = i;
+			last = i + 1;
+		}
+	}
+
+	// Transfer all missing pages at once. If that fails (e.g. for pages
+	// past the end of the memory), the read is passed unchanged.
+	if (first < last) {
+		unsigned int length = (last - first) * pagesize;
+		status = device->vtable->read (device, first * pagesize, device->cache_scratch, length);
+		if (status != DC_STATUS_SUCCESS) {
+			return device->vtable->read (device, address, data, size);
+		}
+
+		for (unsigned int i = first; i < last; ++i) {
+			device_cache_page_t *page = dc_device_cache_lookup (device, i * pagesize);
+			if (page == NULL) {
+				page = dc_device_cache_evict (device);
+				page->address = i * pagesize;
+			}
+			memcpy (device->cache_data + (size_t) (page - device->cache_pages) * pagesize,
+				device->cache_scratch + (size_t) (i - first) * pagesize, pagesize);
+			page->lastused = dc_device_cache_touch (device);
+		}
+	}
+
+	// Copy the requested data from the cache.
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
-		// Calculate the packet size.
-		unsigned int len = size - nbytes;
-		if (len > blocksize)
-			len = blocksize;
+		unsigned int offset = (address + nbytes) % pagesize;
+		unsigned int length = pagesize - offset;
+		if (length > size - nbytes)
+			length = size - nbytes;
 
-		// Read the packet.
-		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+		device_cache_page_t *page = dc_device_cache_lookup (device, address + nbytes - offset);
+		if (page == NULL) {
+			return device->vtable->read (device, address, data, size);
+		}
 
-		// Update and emit a progress event.
-		progress.current += len;
-		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+		memcpy (data + nbytes, device->cache_data + (size_t) (page - device->cache_pages) * pagesize + offset, length);
 
-		nbytes += len;
+		nbytes += length;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+dc_device_memory_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
+{
+	if (address > device->memory_size || size > device->memory_size - address) {
+		ERROR (device->context, "Read outside the memory image (0x%04x, %u bytes).", address, size);
+		return DC_STATUS_INVALIDARGS;
 	}
 
+	memcpy (data, device->memory_data + address, size);
+
 	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->foreach == NULL)
+	if (device->memory_data)
+		return dc_device_memory_read (device, address, data, size);
+
+	if (device->vtable->read == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->foreach (device, callback, userdata);
+	PROBE4 (device__read__start, device, device->vtable->type, address, size);
+	dc_status_t status = DC_STATUS_SUCCESS;
+	if (device->cache_npages)
+		status = dc_device_cache_read (device, address, data, size);
+	else
+		status = device->vtable->read (device, address, data, size);
+	PROBE2 (device__read__done, device, status);
+
+	return status;
 }
 
 
 dc_status_t
-dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime)
+dc_device_write (dc_device_t *device, unsigned int address, const unsigned char data[], unsigned int size)
 {
 	if (device == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->timesync == NULL)
+	if (device->vtable->write == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->timesync (device, datetime);
+	// The cached pages may no longer match the memory.
+	dc_device_cache_invalidate (device);
+
+	return device->vtable->write (device, address, data, size);
 }
 
 
 dc_status_t
-dc_device_close (dc_device_t *device)
+dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->dump == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
 
+	dc_buffer_clear (buffer);
+
+	device_progress_phase (device, DC_PROGRESS_MEMORY, 0, 0);
+
+	dc_status_t status = device->vtable->dump (device, buffer);
+
+	device_event_flush (device);
+
+	return status;
+}
+
+
+dc_status_t
+dc_device_dump_update (dc_device_t *device, dc_buffer_t *buffer)
+{
 	if (device == NULL)
-		return DC_STATUS_SUCCESS;
+		return DC_STATUS_UNSUPPORTED;
 
-	// Disable the cancellation callback.
-	device->cancel_callback = NULL;
-	device->cancel_userdata = NULL;
+	if (device->vtable->dump == NULL)
+		return DC_STATUS_UNSUPPORTED;
 
-	if (device->vtable->close) {
-		status = device->vtable->close (device);
+	if (buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Without support for incremental updates, the previous memory dump
+	// is simply replaced with a full one.
+	dc_status_t status = DC_STATUS_SUCCESS;
+	device_progress_phase (device, DC_PROGRESS_MEMORY, 0, 0);
+	if (device->vtable->dump_update == NULL) {
+		dc_buffer_clear (buffer);
+		status = device->vtable->dump (device, buffer);
+	} else {
+		status = device->vtable->dump_update (device, buffer);
 	}
 
-	dc_device_deallocate (device);
+	device_event_flush (device);
 
 	return status;
 }
 
 
-void
-device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
+static void
+device_dive_hash (dc_device_t *device, const unsigned char *data1, unsigned int size1, const unsigned char *data2, unsigned int size2, dc_dive_hash_t *hash)
 {
-	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+	memset (hash, 0, sizeof (*hash));
+	hash->flags = device->hash_flags;
+
+	// Both spans are hashed incrementally, as if they were concatenated.
+	if (hash->flags & DC_DIVE_HASH_FAST) {
+		hash_xxh64_t xxh64;
+		hash_xxh64_init (&xxh64, 0);
+		hash_xxh64_update (&xxh64, data1, size1);
+		if (size2)
+			hash_xxh64_update (&xxh64, data2, size2);
+		hash->fast = hash_xxh64_final (&xxh64);
+	}
 
-	// Check the event data for errors.
-	switch (event) {
-	case DC_EVENT_WAITING:
-		assert (data == NULL);
-		break;
-	case DC_EVENT_PROGRESS:
-		assert (progress != NULL);
-		assert (progress->maximum != 0);
-		assert (progress->maximum >= progress->current);
-		break;
-	case DC_EVENT_DEVINFO:
-		assert (data != NULL);
-		break;
-	case DC_EVENT_CLOCK:
-		assert (data != NULL);
-		break;
-	default:
-		break;
+	if (hash->flags & DC_DIVE_HASH_SHA256) {
+		hash_sha256_t sha256;
+		hash_sha256_init (&sha256);
+		hash_sha256_update (&sha256, data1, size1);
+		if (size2)
+			hash_sha256_update (&sha256, data2, size2);
+		hash_sha256_final (&sha256, hash->sha256);
 	}
+}
 
-	if (device == NULL)
-		return;
 
-	// Cache the event data.
-	switch (event) {
-	case DC_EVENT_DEVINFO:
-		device->devinfo = *(const dc_event_devinfo_t *) data;
-		break;
-	case DC_EVENT_CLOCK:
-		device->clock = *(const dc_event_clock_t *) data;
-		break;
-	default:
-		break;
+/*
+ * Dives without a fingerprint are identified by their content hash in
+ * the fingerprint store. The fast hash is preferred, because it's the
+ * most compact.
+ */
+static void
+device_dive_hash_key (const dc_dive_hash_t *hash, unsigned char key[8], const unsigned char **id, unsigned int *idsize)
+{
+	if (hash->flags & DC_DIVE_HASH_FAST) {
+		array_uint32_le_set (key, hash->fast & 0xFFFFFFFF);
+		array_uint32_le_set (key + 4, hash->fast >> 32);
+		*id = key;
+		*idsize = 8;
+	} else {
+		*id = hash->sha256;
+		*idsize = sizeof (hash->sha256);
+	}
+}
+
+
+static void
+device_stats_begin (dc_device_t *device)
+{
+	if (!device->stats_enabled)
+		return;
+
+	memset (&device->stats_last, 0, sizeof (device->stats_last));
+	if (device->iostream)
+		dc_iostream_get_stats (device->iostream, &device->stats_last);
+
+	device->stats_time = 0;
+	dc_timer_now (device->timer, &device->stats_time);
+	device->stats_callback = 0;
+}
+
+
+static void
+device_stats_update (dc_device_t *device, dc_dive_stats_t *stats)
+{
+	dc_iostream_stats_t current;
+	memset (&current, 0, sizeof (current));
+	if (device->iostream)
+		dc_iostream_get_stats (device->iostream, &current);
+
+	// The counters only increase, unless the application resets them
+	// during the download. The delta is then taken from zero, instead
+	// of wrapping around.
+	const dc_iostream_stats_t *last = &device->stats_last;
+	if (current.nbytes_in < last->nbytes_in || current.nbytes_out < last->nbytes_out)
+		memset (&device->stats_last, 0, sizeof (device->stats_last));
+
+	stats->nbytes_in = current.nbytes_in - last->nbytes_in;
+	stats->nbytes_out = current.nbytes_out - last->nbytes_out;
+	stats->nreads = current.nreads - last->nreads;
+	stats->nwrites = current.nwrites - last->nwrites;
+	stats->ntimeouts = current.ntimeouts - last->ntimeouts;
+	stats->nretries = current.nretries - last->nretries;
+	stats->callback = device->stats_callback;
+	stats->elapsed = 0;
+
+	dc_usecs_t now = 0;
+	if (dc_timer_now (device->timer, &now) == DC_STATUS_SUCCESS) {
+		if (now > device->stats_time)
+			stats->elapsed = (unsigned int) ((now - device->stats_time) / 1000);
+		device->stats_time = now;
+	}
+
+	device->stats_last = current;
+	device->stats_callback = 0;
+}
+
+
+int
+device_dive_view_emit (dc_device_t *device, const unsigned char *data1, unsigned int size1, const unsigned char *data2, unsigned int size2, const unsigned char *fingerprint, unsigned int fsize)
+{
+	if (!device_has_view (device))
+		return 1;
+
+	if (device_is_known (device, fingerprint, fsize))
+		return 1;
+
+	dc_dive_hash_t hash;
+	unsigned char key[8];
+	const unsigned char *id = fingerprint;
+	unsigned int idsize = fsize;
+	if (device->hash_flags) {
+		device_dive_hash (device, data1, size1, data2, size2, &hash);
+		if (id == NULL || idsize == 0) {
+			device_dive_hash_key (&hash, key, &id, &idsize);
+			if (device_is_known (device, id, idsize))
+				return 1;
+		}
+	}
+
+	dc_dive_stats_t stats;
+	if (device->stats_enabled) {
+		device_stats_update (device, &stats);
+	}
+
+	dc_dive_view_t view;
+	view.data[0] = data1;
+	view.size[0] = size1;
+	view.data[1] = size2 ? data2 : NULL;
+	view.size[1] = size2;
+	view.fingerprint = fingerprint;
+	view.fsize = fsize;
+	view.hash = device->hash_flags ? &hash : NULL;
+	view.stats = device->stats_enabled ? &stats : NULL;
+
+	int result = device->view_callback (&view, device->view_userdata);
+
+	if (device->stats_enabled) {
+		dc_usecs_t now = 0;
+		if (dc_timer_now (device->timer, &now) == DC_STATUS_SUCCESS && now > device->stats_time) {
+			device->stats_callback = (unsigned int) ((now - device->stats_time) / 1000);
+		}
+	}
+
+	if (device->fpstore && id && idsize) {
+		dc_fpstore_add (device->fpstore, device->devinfo.model, device->devinfo.serial, id, idsize);
+	}
+
+	return result;
+}
+
+
+int
+device_is_known (dc_device_t *device, const unsigned char *fingerprint, unsigned int fsize)
+{
+	if (device == NULL || device->fpstore == NULL || fingerprint == NULL || fsize == 0)
+		return 0;
+
+	return dc_fpstore_contains (device->fpstore, device->devinfo.model, device->devinfo.serial, fingerprint, fsize);
+}
+
+
+int
+device_state_load (dc_device_t *device, unsigned char data[], unsigned int size)
+{
+	if (device == NULL || device->fpstore == NULL)
+		return 0;
+
+	unsigned int n = dc_fpstore_get_state (device->fpstore, device->devinfo.model, device->devinfo.serial, NULL, 0);
+	if (n == 0 || n != size)
+		return 0;
+
+	dc_fpstore_get_state (device->fpstore, device->devinfo.model, device->devinfo.serial, data, size);
+
+	return 1;
+}
+
+
+void
+device_state_store (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL || device->fpstore == NULL)
+		return;
+
+	dc_fpstore_set_state (device->fpstore, device->devinfo.model, device->devinfo.serial, data, size);
+}
+
+
+void
+device_retry_init (device_retry_t *retry, dc_device_t *device, unsigned int maxretries, unsigned int delay)
+{
+	retry->device = device;
+	retry->count = 0;
+	retry->start = 0;
+
+	if (device && device->retry_haspolicy) {
+		retry->maxretries = device->retry_policy.maxretries;
+		retry->delay = device->retry_policy.delay;
+		retry->maxdelay = device->retry_policy.maxdelay;
+		retry->budget = device->retry_policy.budget;
+		retry->jitter = 1;
+		if (retry->maxdelay == 0)
+			retry->maxdelay = UINT_MAX;
+	} else {
+		// The backend defaults use a constant delay without jitter.
+		retry->maxretries = maxretries;
+		retry->delay = delay;
+		retry->maxdelay = delay;
+		retry->budget = 0;
+		retry->jitter = 0;
+	}
+
+	if (retry->budget && device->timer) {
+		if (dc_timer_now (device->timer, &retry->start) != DC_STATUS_SUCCESS)
+			retry->budget = 0;
+	}
+}
+
+
+int
+device_retry_next (device_retry_t *retry, dc_iostream_t *iostream, dc_status_t status)
+{
+	dc_device_t *device = retry->device;
+	unsigned int delay = 0, i = 0;
+
+	// Only the errors from a noisy link are worth retrying.
+	if (status != DC_STATUS_TIMEOUT && status != DC_STATUS_PROTOCOL)
+		return 0;
+
+	if (retry->count >= retry->maxretries)
+		return 0;
+
+	if (device_is_cancelled (device))
+		return 0;
+
+	// Exponential backoff.
+	delay = retry->delay;
+	for (i = 0; i < retry->count && delay <= retry->maxdelay / 2; ++i)
+		delay *= 2;
+	if (delay > retry->maxdelay)
+		delay = retry->maxdelay;
+
+	// Random jitter in the range [delay/2, delay].
+	if (retry->jitter && delay > 1) {
+		unsigned int x = device->retry_seed;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		device->retry_seed = x;
+		delay -= x % (delay / 2 + 1);
+	}
+
+	if (retry->budget && device->timer) {
+		dc_usecs_t now = 0;
+		if (dc_timer_now (device->timer, &now) == DC_STATUS_SUCCESS &&
+			now - retry->start + (dc_usecs_t) delay * 1000 > (dc_usecs_t) retry->budget * 1000) {
+			WARNING (device->context, "Retry budget of %u ms exceeded.", retry->budget);
+			return 0;
+		}
+	}
+
+	if (delay) {
+		dc_iostream_sleep (iostream, delay);
+	}
+
+	dc_iostream_stats_retry (iostream);
+
+	retry->count++;
+
+	return 1;
+}
+
+
+unsigned int
+device_pacing_delay (dc_device_t *device, unsigned int id, unsigned int delay)
+{
+	if (device == NULL || device->pacing == NULL || id >= DEVICE_PACING_MAX)
+		return delay;
+
+	device_pacing_slot_t *slot = device->pacing_slots + id;
+	if (!slot->valid || slot->model != device->devinfo.model || slot->initial != delay) {
+		unsigned int cached = 0;
+
+		slot->valid = 1;
+		slot->model = device->devinfo.model;
+		slot->initial = delay;
+		slot->minimum = delay / PACING_FACTOR;
+		slot->good = delay;
+		slot->successes = 0;
+
+		if (dc_pacing_get (device->pacing, device->vtable->type, slot->model, id, &cached) == DC_STATUS_SUCCESS) {
+			if (cached < slot->minimum)
+				cached = slot->minimum;
+			if (cached < slot->good)
+				slot->good = cached;
+		}
+
+		slot->current = slot->good;
+	}
+
+	return slot->current;
+}
+
+
+void
+device_pacing_update (dc_device_t *device, unsigned int id, dc_status_t status)
+{
+	if (device == NULL || device->pacing == NULL || id >= DEVICE_PACING_MAX)
+		return;
+
+	device_pacing_slot_t *slot = device->pacing_slots + id;
+	if (!slot->valid)
+		return;
+
+	if (status == DC_STATUS_SUCCESS) {
+		if (++slot->successes < PACING_SUCCESSES)
+			return;
+
+		// The current delay is proven to work, try a shorter one.
+		slot->successes = 0;
+		slot->good = slot->current;
+		if (slot->current > slot->minimum) {
+			unsigned int step = slot->current / 8;
+			if (step == 0)
+				step = 1;
+			if (slot->current - slot->minimum < step)
+				step = slot->current - slot->minimum;
+			slot->current -= step;
+		}
+	} else if (status == DC_STATUS_TIMEOUT || status == DC_STATUS_PROTOCOL) {
+		// Go back to the last working delay, and don't try to shorten
+		// it again during this session. If even that one failed, back
+		// off towards the fixed delay.
+		slot->successes = 0;
+		if (slot->current >= slot->good) {
+			unsigned int step = slot->good / 2;
+			if (step == 0)
+				step = 1;
+			if (slot->initial - slot->good < step)
+				step = slot->initial - slot->good;
+			slot->good += step;
+		}
+		slot->current = slot->good;
+		slot->minimum = slot->good;
+	} else {
+		return;
+	}
+
+	dc_pacing_set (device->pacing, device->vtable->type, slot->model, id, slot->good);
+}
+
+
+dc_status_t
+device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
+{
+	return device_dump_read_adaptive (device, data, size, blocksize, blocksize);
+}
+
+
+static int
+device_read_cmp (const void *a, const void *b)
+{
+	const device_read_t *ra = (const device_read_t *) a;
+	const device_read_t *rb = (const device_read_t *) b;
+
+	if (ra->address < rb->address)
+		return -1;
+	if (ra->address > rb->address)
+		return 1;
+	return 0;
+}
+
+
+static dc_status_t
+device_read_packets (dc_device_t *device, dc_event_progress_t *progress, unsigned int address, unsigned char data[], unsigned int size, unsigned int maxpacket)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		unsigned int len = size - nbytes;
+		if (maxpacket && len > maxpacket)
+			len = maxpacket;
+
+		status = dc_device_read (device, address + nbytes, data + nbytes, len);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (progress) {
+			progress->current += len;
+			device_event_emit (device, DC_EVENT_PROGRESS, progress);
+		}
+
+		nbytes += len;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+device_read_batch (dc_device_t *device, dc_event_progress_t *progress, device_read_t reads[], unsigned int count, unsigned int maxpacket)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char *scratch = NULL;
+	unsigned int capacity = 0;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (reads == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	qsort (reads, count, sizeof (device_read_t), device_read_cmp);
+
+	unsigned int i = 0;
+	while (i < count) {
+		// Find the ranges which can be merged with the current one.
+		unsigned int begin = reads[i].address;
+		unsigned int end = begin + reads[i].size;
+		unsigned int n = i + 1;
+		while (n < count && reads[n].address <= end) {
+			if (end < reads[n].address + reads[n].size)
+				end = reads[n].address + reads[n].size;
+			n++;
+		}
+
+		if (n == i + 1) {
+			// A single range is read in place.
+			status = device_read_packets (device, progress, begin, reads[i].data, end - begin, maxpacket);
+			if (status != DC_STATUS_SUCCESS)
+				goto error_free;
+		} else {
+			// Merged ranges are read into a temporary buffer first.
+			if (capacity < end - begin) {
+				unsigned char *buffer = (unsigned char *) dc_context_realloc (device->context, scratch, end - begin);
+				if (buffer == NULL) {
+					ERROR (device->context, "Failed to allocate memory.");
+					status = DC_STATUS_NOMEMORY;
+					goto error_free;
+				}
+				scratch = buffer;
+				capacity = end - begin;
+			}
+
+			status = device_read_packets (device, progress, begin, scratch, end - begin, maxpacket);
+			if (status != DC_STATUS_SUCCESS)
+				goto error_free;
+
+			for (unsigned int j = i; j < n; ++j) {
+				if (reads[j].size)
+					memcpy (reads[j].data, scratch + (reads[j].address - begin), reads[j].size);
+			}
+		}
+
+		i = n;
+	}
+
+error_free:
+	dc_context_dealloc (device->context, scratch);
+	return status;
+}
+
+
+dc_status_t
+device_dump_read_adaptive (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize, unsigned int unit)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_timer_t *timer = NULL;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (unit == 0 || blocksize < unit || blocksize % unit != 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// A memory image is copied in a single step.
+	if (device->memory_data) {
+		status = dc_device_memory_read (device, 0, data, size);
+		if (status == DC_STATUS_SUCCESS) {
+			dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+			progress.current = size;
+			progress.maximum = size;
+			device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+		}
+		return status;
+	}
+
+	if (device->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// The throughput is only informational, so a missing timer is not
+	// considered a fatal error.
+	if (dc_timer_new (&timer) != DC_STATUS_SUCCESS) {
+		timer = NULL;
+	}
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = size;
+	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+	unsigned int current = blocksize;
+	unsigned int count = 0;
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		// Calculate the packet size.
+		unsigned int len = size - nbytes;
+		if (len > current)
+			len = current;
+
+		// Read the packet.
+		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
+		if (rc == DC_STATUS_TIMEOUT && current > unit) {
+			// Retry with a smaller block size.
+			current = (current / 2 / unit) * unit;
+			if (current < unit)
+				current = unit;
+			WARNING (device->context, "Reducing the block size to %u bytes.", current);
+			count = 0;
+			continue;
+		} else if (rc != DC_STATUS_SUCCESS) {
+			status = rc;
+			goto error_free;
+		}
+
+		// Grow the block size again once the link looks stable.
+		if (current < blocksize && ++count >= 8) {
+			current *= 2;
+			if (current > blocksize)
+				current = blocksize;
+			count = 0;
+		}
+
+		// Update the throughput.
+		dc_usecs_t now = 0;
+		if (timer && dc_timer_now (timer, &now) == DC_STATUS_SUCCESS && now > 0) {
+			progress.throughput = (unsigned int) ((nbytes + len) * 1000000ULL / now);
+		}
+
+		// Update and emit a progress event.
+		progress.current += len;
+		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+		nbytes += len;
+	}
+
+error_free:
+	dc_timer_free (timer);
+	return status;
+}
+
+
+
+dc_status_t
+device_page_read (dc_device_t *device, dc_iostream_t *iostream, const device_page_protocol_t *protocol, unsigned int address, unsigned char data[], unsigned int size)
+{
+	if (device == NULL || protocol == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int stride = protocol->pagesize + (protocol->checksum != DEVICE_PAGE_CHECKSUM_NONE);
+	if (protocol->pagesize == 0 || protocol->maxpages == 0 ||
+		protocol->header + protocol->maxpages * stride + protocol->trailer > DEVICE_PAGE_MAXANSWER)
+		return DC_STATUS_INVALIDARGS;
+
+	if (size % protocol->pagesize != 0)
+		return DC_STATUS_INVALIDARGS;
+
+	if (device->page_npages == 0 || device->page_npages > protocol->maxpages)
+		device->page_npages = protocol->maxpages;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		device_retry_t retry;
+		device_retry_init (&retry, device, protocol->maxretries, protocol->delay);
+
+		unsigned int npages = 0;
+		unsigned char answer[DEVICE_PAGE_MAXANSWER];
+		while (1) {
+			// Calculate the number of pages.
+			npages = (size - nbytes) / protocol->pagesize;
+			if (npages > device->page_npages)
+				npages = device->page_npages;
+
+			// Transfer the request.
+			unsigned char command[DEVICE_PAGE_MAXCOMMAND];
+			unsigned int csize = protocol->command (device, command, address + nbytes, npages);
+			unsigned int asize = protocol->header + npages * stride + protocol->trailer;
+			dc_status_t rc = protocol->transfer (device, command, csize, answer, asize);
+
+			// Verify the checksum of the pages.
+			if (rc == DC_STATUS_SUCCESS && protocol->checksum == DEVICE_PAGE_CHECKSUM_ADD8) {
+				const unsigned char *page = answer + protocol->header;
+				for (unsigned int i = 0; i < npages; ++i) {
+					unsigned char crc = page[protocol->pagesize];
+					unsigned char ccrc = checksum_add_uint8 (page, protocol->pagesize, 0x00);
+					if (crc != ccrc) {
+						ERROR (device->context, "Unexpected answer checksum.");
+						rc = DC_STATUS_PROTOCOL;
+						break;
+					}
+					page += stride;
+				}
+			}
+
+			if (rc == DC_STATUS_SUCCESS)
+				break;
+
+			if (!device_retry_next (&retry, iostream, rc))
+				return rc;
+
+			dc_iostream_purge (iostream, DC_DIRECTION_INPUT);
+
+			// Retry with fewer pages.
+			device->page_successes = 0;
+			if (device->page_npages > 1) {
+				device->page_npages /= 2;
+				WARNING (device->context, "Reducing the request size to %u pages.", device->page_npages);
+			}
+		}
+
+		// Grow the number of pages again once the link looks stable.
+		if (device->page_npages < protocol->maxpages && ++device->page_successes >= 8) {
+			device->page_npages *= 2;
+			if (device->page_npages > protocol->maxpages)
+				device->page_npages = protocol->maxpages;
+			device->page_successes = 0;
+		}
+
+		// Copy the pages.
+		const unsigned char *page = answer + protocol->header;
+		for (unsigned int i = 0; i < npages; ++i) {
+			memcpy (data + nbytes, page, protocol->pagesize);
+			nbytes += protocol->pagesize;
+			page += stride;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_device_fpstore_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_device_t *device = (dc_device_t *) userdata;
+
+	if (device_is_known (device, fingerprint, fsize))
+		return 1;
+
+	dc_dive_hash_t hash;
+	unsigned char key[8];
+	const unsigned char *id = fingerprint;
+	unsigned int idsize = fsize;
+	if (device->hash_flags && (id == NULL || idsize == 0)) {
+		device_dive_hash (device, data, size, NULL, 0, &hash);
+		device_dive_hash_key (&hash, key, &id, &idsize);
+		if (device_is_known (device, id, idsize))
+			return 1;
+	}
+
+	int result = device->dive_callback (data, size, fingerprint, fsize, device->dive_userdata);
+
+	if (id && idsize) {
+		dc_fpstore_add (device->fpstore, device->devinfo.model, device->devinfo.serial, id, idsize);
+	}
+
+	return result;
+}
+
+
+dc_status_t
+dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->fpstore == NULL || callback == NULL) {
+		status = device->vtable->foreach (device, callback, userdata);
+		device_event_flush (device);
+		return status;
+	}
+
+	// Filter out the dives that are already present in the fingerprint
+	// store, and record the fingerprints of the new ones.
+	device->dive_callback = callback;
+	device->dive_userdata = userdata;
+
+	status = device->vtable->foreach (device, dc_device_fpstore_cb, device);
+
+	device->dive_callback = NULL;
+	device->dive_userdata = NULL;
+
+	device_event_flush (device);
+
+	return status;
+}
+
+
+static int
+dc_device_view_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_device_t *device = (dc_device_t *) userdata;
+
+	return device_dive_view_emit (device, data, size, NULL, 0, fingerprint, fsize);
+}
+
+
+dc_status_t
+dc_device_foreach_view (dc_device_t *device, dc_dive_view_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (callback == NULL) {
+		status = device->vtable->foreach (device, NULL, NULL);
+		device_event_flush (device);
+		return status;
+	}
+
+	// Backends without support for views deliver contiguous dives through
+	// the regular callback, which are forwarded as a single span.
+	device->view_callback = callback;
+	device->view_userdata = userdata;
+	device_stats_begin (device);
+
+	status = device->vtable->foreach (device, dc_device_view_cb, device);
+
+	device->view_callback = NULL;
+	device->view_userdata = NULL;
+
+	device_event_flush (device);
+
+	return status;
+}
+
+
+static dc_status_t
+dc_device_step_wait (dc_iostream_t *iostream, int input, int timeout, void *userdata)
+{
+	dc_device_t *device = (dc_device_t *) userdata;
+
+	if (device->step_cancel)
+		return DC_STATUS_CANCELLED;
+
+	// Hand control back to the caller of dc_device_step, until the
+	// stream is readable or the timeout has expired.
+	memset (&device->step_current, 0, sizeof (device->step_current));
+	device->step_current.type = input ? DC_STEP_WANT_READ : DC_STEP_WANT_TIMER;
+	device->step_current.timeout = timeout;
+	dc_coroutine_yield (device->step_coroutine);
+
+	return device->step_cancel ? DC_STATUS_CANCELLED : DC_STATUS_SUCCESS;
+}
+
+static int
+dc_device_step_dive (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_device_t *device = (dc_device_t *) userdata;
+
+	if (device->step_cancel)
+		return 0;
+
+	// The dive data remains valid while the backend is suspended.
+	memset (&device->step_current, 0, sizeof (device->step_current));
+	device->step_current.type = DC_STEP_DIVE;
+	device->step_current.data = data;
+	device->step_current.size = size;
+	device->step_current.fingerprint = fingerprint;
+	device->step_current.fsize = fsize;
+	dc_coroutine_yield (device->step_coroutine);
+
+	return !device->step_cancel;
+}
+
+static void
+dc_device_step_main (void *userdata)
+{
+	dc_device_t *device = (dc_device_t *) userdata;
+
+	dc_status_t status = dc_device_foreach (device, dc_device_step_dive, device);
+
+	memset (&device->step_current, 0, sizeof (device->step_current));
+	device->step_current.type = DC_STEP_DONE;
+	device->step_current.status = status;
+}
+
+static dc_status_t
+dc_device_step_resume (dc_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Install the wait function only while the backend is running, to
+	// keep the stream blocking for all other uses.
+	status = dc_iostream_set_wait (device->step_iostream, dc_device_step_wait, device);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	device->step_finished = dc_coroutine_resume (device->step_coroutine);
+
+	dc_iostream_set_wait (device->step_iostream, NULL, NULL);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_device_step (dc_device_t *device, dc_iostream_t *iostream, dc_step_t *step)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL || iostream == NULL || step == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (device->vtable->foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->step_coroutine == NULL) {
+		// The backends keep their packet buffers on the stack, so the
+		// stack is sized generously.
+		status = dc_coroutine_new (&device->step_coroutine, STEP_STACKSIZE, dc_device_step_main, device);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to create the coroutine.");
+			return status;
+		}
+
+		device->step_iostream = iostream;
+		device->step_finished = 0;
+		device->step_cancel = 0;
+	} else if (device->step_iostream != iostream) {
+		ERROR (device->context, "Different I/O stream.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	if (!device->step_finished) {
+		status = dc_device_step_resume (device);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	*step = device->step_current;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_extract (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_view_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->extract == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (data == NULL && size)
+		return DC_STATUS_INVALIDARGS;
+
+	if (callback == NULL)
+		return device->vtable->extract (device, data, size, NULL, NULL);
+
+	device->view_callback = callback;
+	device->view_userdata = userdata;
+	device_stats_begin (device);
+
+	status = device->vtable->extract (device, data, size, dc_device_view_cb, device);
+
+	device->view_callback = NULL;
+	device->view_userdata = NULL;
+
+	return status;
+}
+
+
+dc_status_t
+dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->timesync == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return device->vtable->timesync (device, datetime);
+}
+
+
+dc_status_t
+dc_device_close (dc_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Disable the cancellation callback.
+	device->cancel_callback = NULL;
+	device->cancel_userdata = NULL;
+
+	// Cancel an unfinished step based download. The backend returns
+	// through its regular error paths, releasing all its resources.
+	if (device->step_coroutine) {
+		device->step_cancel = 1;
+		while (!device->step_finished) {
+			if (dc_device_step_resume (device) != DC_STATUS_SUCCESS)
+				break;
+		}
+		if (device->step_finished) {
+			dc_coroutine_free (device->step_coroutine);
+		}
+		device->step_coroutine = NULL;
+	}
+
+	if (device->vtable->close) {
+		status = device->vtable->close (device);
+	}
+
+	dc_device_deallocate (device);
+
+	return status;
+}
+
+
+// Minimum time between two samples of the progress rate (us).
+#define PROGRESS_SAMPLE_INTERVAL 250000
+
+static void
+device_progress_update (dc_device_t *device, dc_event_progress_t *progress)
+{
+	progress->phase = device->progress_phase;
+	progress->dive = device->progress_dive;
+	progress->ndives = device->progress_ndives;
+
+	dc_usecs_t now = 0;
+	if (device->timer == NULL ||
+		dc_timer_now (device->timer, &now) != DC_STATUS_SUCCESS)
+		return;
+
+	if (!device->progress_started ||
+		progress->current < device->progress_sample_current) {
+		// Start of a new operation.
+		device->progress_started = 1;
+		device->progress_start = now;
+		device->progress_sample_time = now;
+		device->progress_sample_current = progress->current;
+		device->progress_rate = 0;
+	} else if (now - device->progress_sample_time >= PROGRESS_SAMPLE_INTERVAL) {
+		// Exponential moving average of the rate, to smooth out
+		// the bursts of the individual packets.
+		unsigned long long rate = (unsigned long long)
+			(progress->current - device->progress_sample_current) * 1000000 /
+			(now - device->progress_sample_time);
+		if (device->progress_rate)
+			rate = (3 * (unsigned long long) device->progress_rate + rate) / 4;
+		device->progress_rate = rate > UINT_MAX ? UINT_MAX : (unsigned int) rate;
+		device->progress_sample_time = now;
+		device->progress_sample_current = progress->current;
+	}
+
+	progress->elapsed = (unsigned int) ((now - device->progress_start) / 1000);
+	progress->rate = device->progress_rate;
+	if (device->progress_rate && progress->maximum != UINT_MAX) {
+		progress->eta = (progress->maximum - progress->current + device->progress_rate - 1) / device->progress_rate;
+	} else {
+		progress->eta = 0;
+	}
+}
+
+
+void
+device_progress_phase (dc_device_t *device, dc_progress_phase_t phase, unsigned int dive, unsigned int ndives)
+{
+	if (device == NULL)
+		return;
+
+	device->progress_phase = phase;
+	device->progress_dive = dive;
+	device->progress_ndives = ndives;
+}
+
+
+static int
+device_progress_deliver (dc_device_t *device, const dc_event_progress_t *progress)
+{
+	if (device->progress_interval == 0 && device->progress_delta == 0)
+		return 1;
+
+	const dc_event_progress_t *last = &device->progress_last;
+
+	int deliver = 0;
+	if (progress->current == progress->maximum ||
+		progress->current < last->current ||
+		progress->maximum != last->maximum) {
+		// Always deliver the final event, and the first one of a
+		// new operation.
+		deliver = 1;
+	} else if (device->progress_delta &&
+		(unsigned long long) (progress->current - last->current) * 1000 >=
+		(unsigned long long) device->progress_delta * progress->maximum) {
+		deliver = 1;
+	}
+
+	dc_usecs_t now = 0;
+	if (device->timer &&
+		dc_timer_now (device->timer, &now) == DC_STATUS_SUCCESS) {
+		if (device->progress_interval &&
+			now - device->progress_time >= (dc_usecs_t) device->progress_interval * 1000)
+			deliver = 1;
+	}
+
+	if (!deliver) {
+		// Keep the most recent state, to deliver it at the end.
+		device->progress_pending = *progress;
+		device->progress_haspending = 1;
+		return 0;
+	}
+
+	device->progress_last = *progress;
+	device->progress_time = now;
+	device->progress_haspending = 0;
+
+	return 1;
+}
+
+
+void
+device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
+{
+	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+
+	// Check the event data for errors.
+	switch (event) {
+	case DC_EVENT_WAITING:
+		assert (data == NULL);
+		break;
+	case DC_EVENT_PROGRESS:
+		assert (progress != NULL);
+		assert (progress->maximum != 0);
+		assert (progress->maximum >= progress->current);
+		break;
+	case DC_EVENT_DEVINFO:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_CLOCK:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_PARTIAL:
+		assert (data != NULL);
+		break;
+	default:
+		break;
+	}
+
+	if (device == NULL)
+		return;
+
+	// Cache the event data.
+	switch (event) {
+	case DC_EVENT_DEVINFO:
+		device->devinfo = *(const dc_event_devinfo_t *) data;
+		break;
+	case DC_EVENT_CLOCK:
+		device->clock = *(const dc_event_clock_t *) data;
+		break;
+	default:
+		break;
 	}
 
 	// Check if there is a callback function registered.
@@ -486,10 +1956,46 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	if ((event & device->event_mask) == 0)
 		return;
 
+	dc_event_progress_t current;
+	if (event == DC_EVENT_PROGRESS) {
+		// Fill in the timing and the phase.
+		current = *progress;
+		device_progress_update (device, &current);
+		if (!device_progress_deliver (device, &current))
+			return;
+		data = &current;
+	}
+
 	device->event_callback (device, event, data, device->event_userdata);
 }
 
 
+void
+device_event_flush (dc_device_t *device)
+{
+	if (device == NULL)
+		return;
+
+	// The operation is finished.
+	device->progress_started = 0;
+	device->progress_phase = DC_PROGRESS_UNKNOWN;
+	device->progress_dive = 0;
+	device->progress_ndives = 0;
+
+	if (!device->progress_haspending)
+		return;
+
+	device->progress_haspending = 0;
+
+	if (device->event_callback == NULL ||
+		(device->event_mask & DC_EVENT_PROGRESS) == 0)
+		return;
+
+	device->progress_last = device->progress_pending;
+	device->event_callback (device, DC_EVENT_PROGRESS, &device->progress_pending, device->event_userdata);
+}
+
+
 int
 device_is_cancelled (dc_device_t *device)
 {
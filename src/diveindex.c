@@ -0,0 +1,412 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdio.h>  // fopen, fread, fwrite, fclose
+#include <string.h> // memcmp, memcpy
+
+#include <libdivecomputer/diveindex.h>
+
+#include "context-private.h"
+#include "array.h"
+
+#define MAGIC   0x49444344 // "DCDI"
+#define FORMAT  1
+
+#define MAXSIZE 256
+
+typedef struct dc_diveindex_entry_t {
+	unsigned int offset[2];
+	unsigned int size[2];
+	unsigned int fsize;
+	unsigned char fingerprint[MAXSIZE];
+} dc_diveindex_entry_t;
+
+struct dc_diveindex_t {
+	dc_context_t *context;
+	unsigned int dumpsize;
+	dc_diveindex_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+typedef struct dc_diveindex_build_t {
+	dc_diveindex_t *index;
+	const unsigned char *data;
+	unsigned int size;
+	dc_status_t status;
+} dc_diveindex_build_t;
+
+static dc_status_t
+dc_diveindex_append (dc_diveindex_t *index, const dc_diveindex_entry_t *entry)
+{
+	if (index->count >= index->capacity) {
+		unsigned int capacity = index->capacity ? index->capacity * 2 : 16;
+		dc_diveindex_entry_t *entries = (dc_diveindex_entry_t *) dc_context_realloc (index->context, index->entries, capacity * sizeof (*entries));
+		if (entries == NULL) {
+			ERROR (index->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		index->entries = entries;
+		index->capacity = capacity;
+	}
+
+	index->entries[index->count++] = *entry;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_diveindex_build_cb (const dc_dive_view_t *view, void *userdata)
+{
+	dc_diveindex_build_t *build = (dc_diveindex_build_t *) userdata;
+	dc_diveindex_entry_t entry = {{0}};
+
+	// The dive data must point into the memory dump.
+	for (unsigned int i = 0; i < 2; ++i) {
+		if (view->size[i] == 0)
+			continue;
+
+		if (view->data[i] < build->data ||
+			view->data[i] > build->data + build->size ||
+			view->size[i] > build->size - (unsigned int) (view->data[i] - build->data)) {
+			ERROR (build->index->context, "Dive data outside of the memory dump.");
+			build->status = DC_STATUS_UNSUPPORTED;
+			return 0;
+		}
+
+		entry.offset[i] = view->data[i] - build->data;
+		entry.size[i] = view->size[i];
+	}
+
+	if (view->fsize > MAXSIZE) {
+		ERROR (build->index->context, "Invalid fingerprint size (%u).", view->fsize);
+		build->status = DC_STATUS_DATAFORMAT;
+		return 0;
+	}
+
+	entry.fsize = view->fsize;
+	if (view->fsize)
+		memcpy (entry.fingerprint, view->fingerprint, view->fsize);
+
+	build->status = dc_diveindex_append (build->index, &entry);
+
+	return build->status == DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_diveindex_new (dc_diveindex_t **out, dc_context_t *context)
+{
+	dc_diveindex_t *index = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	index = (dc_diveindex_t *) dc_context_malloc (context, sizeof (dc_diveindex_t));
+	if (index == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	index->context = context;
+	index->dumpsize = 0;
+	index->entries = NULL;
+	index->count = 0;
+	index->capacity = 0;
+
+	*out = index;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_diveindex_free (dc_diveindex_t *index)
+{
+	if (index == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_context_dealloc (index->context, index->entries);
+	dc_context_dealloc (index->context, index);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_diveindex_build (dc_diveindex_t *index, dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (index == NULL || device == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	index->dumpsize = size;
+	index->count = 0;
+
+	dc_diveindex_build_t build = {index, data, size, DC_STATUS_SUCCESS};
+	status = dc_device_extract (device, data, size, dc_diveindex_build_cb, &build);
+	if (status == DC_STATUS_SUCCESS)
+		status = build.status;
+
+	if (status != DC_STATUS_SUCCESS)
+		index->count = 0;
+
+	return status;
+}
+
+unsigned int
+dc_diveindex_get_count (dc_diveindex_t *index)
+{
+	if (index == NULL)
+		return 0;
+
+	return index->count;
+}
+
+dc_status_t
+dc_diveindex_get (dc_diveindex_t *index, unsigned int number, const unsigned char data[], unsigned int size, dc_dive_view_t *view)
+{
+	if (index == NULL || data == NULL || view == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (number >= index->count || size != index->dumpsize)
+		return DC_STATUS_INVALIDARGS;
+
+	const dc_diveindex_entry_t *entry = index->entries + number;
+	for (unsigned int i = 0; i < 2; ++i) {
+		view->data[i] = entry->size[i] ? data + entry->offset[i] : NULL;
+		view->size[i] = entry->size[i];
+	}
+	view->fingerprint = entry->fsize ? entry->fingerprint : NULL;
+	view->fsize = entry->fsize;
+	view->hash = NULL;
+	view->stats = NULL;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_diveindex_find (dc_diveindex_t *index, const unsigned char data[], unsigned int size, unsigned int *number)
+{
+	if (index == NULL || data == NULL || size == 0 || number == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < index->count; ++i) {
+		const dc_diveindex_entry_t *entry = index->entries + i;
+		if (entry->fsize == size && memcmp (entry->fingerprint, data, size) == 0) {
+			*number = i;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	return DC_STATUS_UNSUPPORTED;
+}
+
+dc_status_t
+dc_diveindex_load (dc_diveindex_t *index, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+
+	if (index == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (index->context, "Failed to open the file '%s'.", filename);
+		return DC_STATUS_IO;
+	}
+
+	index->count = 0;
+
+	unsigned char header[16];
+	if (fread (header, sizeof (header), 1, fp) != 1) {
+		ERROR (index->context, "Failed to read the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	if (array_uint32_le (header) != MAGIC ||
+		array_uint32_le (header + 4) != FORMAT) {
+		ERROR (index->context, "Unexpected file header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_fclose;
+	}
+
+	unsigned int dumpsize = array_uint32_le (header + 8);
+	unsigned int count = array_uint32_le (header + 12);
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned char hdr[20];
+		if (fread (hdr, sizeof (hdr), 1, fp) != 1) {
+			ERROR (index->context, "Failed to read the entry header.");
+			status = DC_STATUS_IO;
+			goto error_fclose;
+		}
+
+		dc_diveindex_entry_t entry;
+		for (unsigned int j = 0; j < 2; ++j) {
+			entry.offset[j] = array_uint32_le (hdr + j * 8);
+			entry.size[j]   = array_uint32_le (hdr + j * 8 + 4);
+			if (entry.offset[j] > dumpsize || entry.size[j] > dumpsize - entry.offset[j]) {
+				ERROR (index->context, "Invalid dive location (%u %u).", entry.offset[j], entry.size[j]);
+				status = DC_STATUS_DATAFORMAT;
+				goto error_fclose;
+			}
+		}
+
+		entry.fsize = array_uint32_le (hdr + 16);
+		if (entry.fsize > MAXSIZE) {
+			ERROR (index->context, "Invalid fingerprint size (%u).", entry.fsize);
+			status = DC_STATUS_DATAFORMAT;
+			goto error_fclose;
+		}
+
+		if (entry.fsize && fread (entry.fingerprint, entry.fsize, 1, fp) != 1) {
+			ERROR (index->context, "Failed to read the fingerprint.");
+			status = DC_STATUS_IO;
+			goto error_fclose;
+		}
+
+		status = dc_diveindex_append (index, &entry);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_fclose;
+	}
+
+	index->dumpsize = dumpsize;
+
+	fclose (fp);
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	index->count = 0;
+	fclose (fp);
+	return status;
+}
+
+dc_status_t
+dc_diveindex_save (dc_diveindex_t *index, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+
+	if (index == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fp = fopen (filename, "wb");
+	if (fp == NULL) {
+		ERROR (index->context, "Failed to open the file '%s'.", filename);
+		return DC_STATUS_IO;
+	}
+
+	unsigned char header[16];
+	array_uint32_le_set (header, MAGIC);
+	array_uint32_le_set (header + 4, FORMAT);
+	array_uint32_le_set (header + 8, index->dumpsize);
+	array_uint32_le_set (header + 12, index->count);
+	if (fwrite (header, sizeof (header), 1, fp) != 1) {
+		ERROR (index->context, "Failed to write the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	for (unsigned int i = 0; i < index->count; ++i) {
+		const dc_diveindex_entry_t *entry = index->entries + i;
+		unsigned char hdr[20];
+		for (unsigned int j = 0; j < 2; ++j) {
+			array_uint32_le_set (hdr + j * 8, entry->offset[j]);
+			array_uint32_le_set (hdr + j * 8 + 4, entry->size[j]);
+		}
+		array_uint32_le_set (hdr + 16, entry->fsize);
+		if (fwrite (hdr, sizeof (hdr), 1, fp) != 1 ||
+			(entry->fsize && fwrite (entry->fingerprint, entry->fsize, 1, fp) != 1)) {
+			ERROR (index->context, "Failed to write the dive location.");
+			status = DC_STATUS_IO;
+			goto error_fclose;
+		}
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (index->context, "Failed to close the file.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	fclose (fp);
+	return status;
+}
+
+dc_status_t
+dc_diveindex_parse (dc_diveindex_t *index, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, const unsigned char data[], unsigned int size, unsigned int nthreads, dc_parser_batch_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_blob_t *blobs = NULL;
+	unsigned char *buffer = NULL;
+	unsigned int nbytes = 0, offset = 0;
+
+	if (index == NULL || descriptor == NULL || data == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (size != index->dumpsize)
+		return DC_STATUS_INVALIDARGS;
+
+	if (index->count == 0)
+		return DC_STATUS_SUCCESS;
+
+	// The parsers need contiguous data, so the dives which wrap around
+	// the end of a ringbuffer are copied into a single buffer.
+	for (unsigned int i = 0; i < index->count; ++i) {
+		const dc_diveindex_entry_t *entry = index->entries + i;
+		if (entry->size[1])
+			nbytes += entry->size[0] + entry->size[1];
+	}
+
+	blobs = (dc_parser_blob_t *) dc_context_malloc (index->context, index->count * sizeof (dc_parser_blob_t));
+	if (nbytes)
+		buffer = (unsigned char *) dc_context_malloc (index->context, nbytes);
+	if (blobs == NULL || (nbytes && buffer == NULL)) {
+		ERROR (index->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	for (unsigned int i = 0; i < index->count; ++i) {
+		const dc_diveindex_entry_t *entry = index->entries + i;
+		if (entry->size[1]) {
+			memcpy (buffer + offset, data + entry->offset[0], entry->size[0]);
+			memcpy (buffer + offset + entry->size[0], data + entry->offset[1], entry->size[1]);
+			blobs[i].data = buffer + offset;
+			blobs[i].size = entry->size[0] + entry->size[1];
+			offset += blobs[i].size;
+		} else {
+			blobs[i].data = data + entry->offset[0];
+			blobs[i].size = entry->size[0];
+		}
+	}
+
+	status = dc_parser_parse_parallel (index->context, descriptor, devtime, systime, blobs, index->count, nthreads, callback, userdata);
+
+error_free:
+	dc_context_dealloc (index->context, buffer);
+	dc_context_dealloc (index->context, blobs);
+	return status;
+}
@@ -25,9 +25,11 @@
 
 #include "diverite_nitekq.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
+#include "ringbuffer.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &diverite_nitekq_device_vtable)
 
@@ -67,7 +69,9 @@ static const dc_device_vtable_t diverite_nitekq_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	diverite_nitekq_device_dump, /* dump */
+	NULL, /* dump_update */
 	diverite_nitekq_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	diverite_nitekq_device_close /* close */
 };
@@ -320,7 +324,7 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -358,7 +362,7 @@ diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[]
 	data += SZ_PACKET;
 
 	// Allocate memory.
-	unsigned char *buffer = (unsigned char *) malloc (SZ_LOGBOOK + RB_PROFILE_END - RB_PROFILE_BEGIN);
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (context, SZ_LOGBOOK + RB_PROFILE_END - RB_PROFILE_BEGIN);
 	if (buffer == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -368,10 +372,13 @@ diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[]
 	unsigned int eop = array_uint16_be(data + EOP);
 	if (eop < RB_PROFILE_BEGIN || eop >= RB_PROFILE_END) {
 		ERROR (context, "Invalid ringbuffer pointer detected (0x%04x).", eop);
-		free (buffer);
+		dc_context_dealloc (context, buffer);
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	dc_ringbuffer_t rb_profile;
+	dc_ringbuffer_init (&rb_profile, RB_PROFILE_BEGIN, RB_PROFILE_END);
+
 	// When a new dive is added, the device moves all existing logbook
 	// and address entries towards the end, such that the most recent
 	// one is always the first one. This is not the case for the profile
@@ -389,7 +396,7 @@ diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[]
 		unsigned int address = array_uint16_be(data + ADDRESS + i * 2);
 		if (address < RB_PROFILE_BEGIN || address >= RB_PROFILE_END) {
 			ERROR (context, "Invalid ringbuffer pointer detected (0x%04x).", address);
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -401,17 +408,8 @@ diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[]
 		memcpy (buffer, p, SZ_LOGBOOK);
 
 		// Copy the profile data.
-		unsigned int length = 0;
-		if (previous > address) {
-			length = previous - address;
-			memcpy (buffer + SZ_LOGBOOK, data + address, length);
-		} else {
-			unsigned int len_a = RB_PROFILE_END - address;
-			unsigned int len_b = previous - RB_PROFILE_BEGIN;
-			length = len_a + len_b;
-			memcpy (buffer + SZ_LOGBOOK, data + address, len_a);
-			memcpy (buffer + SZ_LOGBOOK + len_a, data + RB_PROFILE_BEGIN, len_b);
-		}
+		unsigned int length = dc_ringbuffer_distance (&rb_profile, address, previous, 1);
+		dc_ringbuffer_copy (&rb_profile, buffer + SZ_LOGBOOK, data, address, length);
 
 		if (callback && !callback (buffer, length + SZ_LOGBOOK, buffer, SZ_LOGBOOK, userdata)) {
 			break;
@@ -420,7 +418,7 @@ diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[]
 		previous = address;
 	}
 
-	free (buffer);
+	dc_context_dealloc (context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -137,8 +137,11 @@ diverite_nitekq_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, u
 
 	dc_gasmix_t *gasmix = (dc_gasmix_t *) value;
 
-	if (!parser->cached) {
-		dc_status_t rc = diverite_nitekq_parser_samples_foreach (abstract, NULL, NULL);
+	// All fields are only available in the profile.
+	if (!parser->cached && dc_parser_is_summary (parser)) {
+		return DC_STATUS_FULLSCAN;
+	} else if (!parser->cached) {
+		dc_status_t rc = dc_parser_samples_walk (abstract, NULL, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
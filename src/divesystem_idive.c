@@ -25,7 +25,9 @@
 
 #include "divesystem_idive.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
+#include "timer.h"
 #include "platform.h"
 #include "checksum.h"
 #include "array.h"
@@ -38,6 +40,12 @@
 
 #define MAXRETRIES 9
 
+// Maximum number of outstanding sample requests.
+#define PIPELINE 2
+
+// Maximum number of unacknowledged firmware frames.
+#define FW_PIPELINE 2
+
 #define MAXPACKET 0xFF
 #define START     0x55
 #define ACK       0x06
@@ -99,6 +107,7 @@ typedef struct divesystem_idive_device_t {
 	dc_iostream_t *iostream;
 	unsigned char fingerprint[4];
 	unsigned int model;
+	unsigned int pipeline;
 } divesystem_idive_device_t;
 
 static dc_status_t divesystem_idive_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -112,7 +121,9 @@ static const dc_device_vtable_t divesystem_idive_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	divesystem_idive_device_foreach, /* foreach */
+	NULL, /* extract */
 	divesystem_idive_device_timesync, /* timesync */
 	NULL /* close */
 };
@@ -169,6 +180,7 @@ divesystem_idive_device_open (dc_device_t **out, dc_context_t *context, dc_iostr
 	device->iostream = iostream;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 	device->model = model;
+	device->pipeline = PIPELINE;
 
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
@@ -308,7 +320,7 @@ divesystem_idive_receive (divesystem_idive_device_t *device, unsigned char answe
 
 
 static dc_status_t
-divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+divesystem_idive_answer (divesystem_idive_device_t *device, unsigned char cmd, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -316,12 +328,6 @@ divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char
 	unsigned int length = sizeof(packet);
 	unsigned int errcode = 0;
 
-	// Send the command.
-	status = divesystem_idive_send (device, command, csize);
-	if (status != DC_STATUS_SUCCESS) {
-		goto error;
-	}
-
 	// Receive the answer.
 	status = divesystem_idive_receive (device, packet, &length);
 	if (status != DC_STATUS_SUCCESS) {
@@ -329,7 +335,7 @@ divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char
 	}
 
 	// Verify the command byte.
-	if (packet[0] != command[0]) {
+	if (packet[0] != cmd) {
 		ERROR (abstract->context, "Unexpected packet header.");
 		status = DC_STATUS_PROTOCOL;
 		goto error;
@@ -372,29 +378,44 @@ error:
 }
 
 
+static dc_status_t
+divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (errorcode) {
+		*errorcode = 0;
+	}
+
+	// Send the command.
+	status = divesystem_idive_send (device, command, csize);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	// Receive the answer.
+	return divesystem_idive_answer (device, command[0], answer, asize, errorcode);
+}
+
+
 static dc_status_t
 divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	unsigned int errcode = 0;
 
-	unsigned int nretries = 0;
-	while ((status = divesystem_idive_packet (device, command, csize, answer, asize, &errcode)) != DC_STATUS_SUCCESS) {
-		// Automatically discard a corrupted packet,
-		// and request a new one.
-		if (status != DC_STATUS_PROTOCOL && status != DC_STATUS_TIMEOUT)
-			break;
+	device_retry_t retry;
+	device_retry_init (&retry, (dc_device_t *) device, MAXRETRIES, 100);
 
+	while ((status = divesystem_idive_packet (device, command, csize, answer, asize, &errcode)) != DC_STATUS_SUCCESS) {
 		// Abort if the device reports a fatal error.
 		if (errcode && errcode != ERR_BUSY)
 			break;
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		// Automatically discard a corrupted packet,
+		// and request a new one after a delay.
+		if (!device_retry_next (&retry, device->iostream, status))
 			break;
-
-		// Delay the next attempt.
-		dc_iostream_sleep (device->iostream, 100);
 	}
 
 	if (errorcode) {
@@ -404,6 +425,81 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 	return status;
 }
 
+static dc_status_t
+divesystem_idive_samples (divesystem_idive_device_t *device, const divesystem_idive_commands_t *commands, unsigned int nsamples, dc_buffer_t *buffer, dc_event_progress_t *progress, unsigned int base)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned char packet[MAXPACKET - 2];
+	unsigned int errcode = 0;
+
+	unsigned int size = commands->sample.size * commands->nsamples;
+	unsigned int npackets = (nsamples + commands->nsamples - 1) / commands->nsamples;
+
+	unsigned int sent = 0, received = 0;
+	while (received < npackets) {
+		// Keep the next requests queued behind the one being answered,
+		// so the device always has work while the answer is in flight.
+		while (sent < npackets && sent < received + device->pipeline) {
+			unsigned int idx = sent * commands->nsamples + 1;
+			unsigned char cmd_sample[] = {commands->sample.cmd,
+				(idx     ) & 0xFF,
+				(idx >> 8) & 0xFF};
+			rc = divesystem_idive_send (device, cmd_sample, sizeof(cmd_sample));
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+			sent++;
+		}
+
+		rc = divesystem_idive_answer (device, commands->sample.cmd, packet, size, &errcode);
+		if (rc != DC_STATUS_SUCCESS) {
+			if (rc == DC_STATUS_CANCELLED)
+				return rc;
+
+			// The answers of the other outstanding requests can't be
+			// matched anymore. Discard them, and request the failed
+			// packet again with the normal retry logic.
+			if (sent > received + 1) {
+				WARNING (abstract->context, "Pipelined sample request failed, disabling pipelining.");
+				device->pipeline = 1;
+			}
+			dc_iostream_sleep (device->iostream, 100);
+			dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+
+			unsigned int idx = received * commands->nsamples + 1;
+			unsigned char cmd_sample[] = {commands->sample.cmd,
+				(idx     ) & 0xFF,
+				(idx >> 8) & 0xFF};
+			rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, size, &errcode);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+			sent = received + 1;
+		}
+
+		// If the number of samples is not an exact multiple of the
+		// number of samples per packet, then the last packet
+		// appears to contain garbage data. Ignore those samples.
+		unsigned int j = received * commands->nsamples;
+		unsigned int n = commands->nsamples;
+		if (j + n > nsamples) {
+			n = nsamples - j;
+		}
+
+		// Update and emit a progress event.
+		progress->current = base + STEP(j + n + 1, nsamples + 1);
+		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+
+		if (!dc_buffer_append(buffer, packet, commands->sample.size * n)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		received++;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -472,7 +568,7 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 	progress.maximum = ndives * NSTEPS;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	dc_buffer_t *buffer = dc_buffer_new(0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL) {
 		return DC_STATUS_NOMEMORY;
 	}
@@ -511,34 +607,10 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 			return DC_STATUS_NOMEMORY;
 		}
 
-		for (unsigned int j = 0; j < nsamples; j += commands->nsamples) {
-			unsigned int idx = j + 1;
-			unsigned char cmd_sample[] = {commands->sample.cmd,
-				(idx     ) & 0xFF,
-				(idx >> 8) & 0xFF};
-			rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, commands->sample.size * commands->nsamples, &errcode);
-			if (rc != DC_STATUS_SUCCESS) {
-				dc_buffer_free(buffer);
-				return rc;
-			}
-
-			// If the number of samples is not an exact multiple of the
-			// number of samples per packet, then the last packet
-			// appears to contain garbage data. Ignore those samples.
-			unsigned int n = commands->nsamples;
-			if (j + n > nsamples) {
-				n = nsamples - j;
-			}
-
-			// Update and emit a progress event.
-			progress.current = i * NSTEPS + STEP(j + n + 1, nsamples + 1);
-			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
-			if (!dc_buffer_append(buffer, packet, commands->sample.size * n)) {
-				ERROR (abstract->context, "Insufficient buffer space available.");
-				dc_buffer_free(buffer);
-				return DC_STATUS_NOMEMORY;
-			}
+		rc = divesystem_idive_samples (device, commands, nsamples, buffer, &progress, i * NSTEPS);
+		if (rc != DC_STATUS_SUCCESS) {
+			dc_buffer_free(buffer);
+			return rc;
 		}
 
 		unsigned char *data = dc_buffer_get_data(buffer);
@@ -679,67 +751,98 @@ static dc_status_t
 divesystem_idive_firmware_readfile (dc_buffer_t *buffer, dc_context_t *context, const char *filename)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_buffer_t *tmp = NULL;
 	FILE *fp = NULL;
 
-	if (!dc_buffer_clear (buffer)) {
+	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve (buffer, 0x20000)) {
 		ERROR (context, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	// Allocate a temporary buffer.
-	tmp = dc_buffer_new (0x20000);
-	if (tmp == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		status = DC_STATUS_NOMEMORY;
-		goto error_exit;
-	}
-
 	// Open the file.
 	fp = fopen (filename, "rb");
 	if (fp == NULL) {
 		ERROR (context, "Failed to open the file.");
 		status = DC_STATUS_IO;
-		goto error_free;
+		goto error_exit;
 	}
 
 	// Read the entire file into the buffer.
 	size_t n = 0;
 	unsigned char block[4096] = {0};
 	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
-		if (!dc_buffer_append (tmp, block, n)) {
+		if (!dc_buffer_append (buffer, block, n)) {
 			ERROR (context, "Insufficient buffer space available.");
 			status = DC_STATUS_NOMEMORY;
 			goto error_close;
 		}
 	}
 
-	// Resize the output buffer.
-	size_t nbytes = dc_buffer_get_size (tmp);
-	if (!dc_buffer_resize (buffer, nbytes / 2)) {
-		ERROR (context, "Insufficient buffer space available.");
-		status = DC_STATUS_NOMEMORY;
-		goto error_close;
-	}
-
-	// Convert to binary data.
+	// Convert to binary data, in place.
+	size_t nbytes = dc_buffer_get_size (buffer);
 	int rc = array_convert_hex2bin (
-		dc_buffer_get_data (tmp), dc_buffer_get_size (tmp),
-		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+		dc_buffer_get_data (buffer), nbytes,
+		dc_buffer_get_data (buffer), nbytes / 2);
 	if (rc != 0) {
 		ERROR (context, "Unexpected data format.");
 		status = DC_STATUS_DATAFORMAT;
 		goto error_close;
 	}
 
+	// Drop the remaining hexadecimal data.
+	dc_buffer_resize (buffer, nbytes / 2);
+
 error_close:
 	fclose (fp);
-error_free:
-	dc_buffer_free (tmp);
 error_exit:
 	return status;
 }
 
+static dc_status_t
+divesystem_idive_firmware_response (divesystem_idive_device_t *device, const divesystem_idive_signature_t *signature, unsigned int *state)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	// Read the response until an ACK or NAK byte is received.
+	*state = 0;
+	while (*state == 0) {
+		// Receive the response.
+		unsigned char response = 0;
+		status = dc_iostream_read (device->iostream, &response, 1, NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the response.");
+			return status;
+		}
+
+		// Process the response.
+		switch (response) {
+		case ACK:
+		case NAK:
+			*state = response;
+			break;
+		case WAIT:
+			dc_iostream_sleep (device->iostream, signature->delay);
+			break;
+		case 'A':
+		case 'B':
+		case 'C':
+		case 'D':
+		case 'E':
+		case 'F':
+		case 'G':
+		case 'H':
+		case 'K':
+		case 'X':
+			break;
+		default:
+			WARNING (abstract->context, "Unexpected response byte received (%02x)", response);
+			break;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 divesystem_idive_firmware_send (divesystem_idive_device_t *device, const divesystem_idive_signature_t *signature, const unsigned char data[], size_t size)
 {
@@ -755,42 +858,11 @@ divesystem_idive_firmware_send (divesystem_idive_device_t *device, const divesys
 			return status;
 		}
 
-		// Read the response until an ACK or NAK byte is received.
+		// Receive the response.
 		unsigned int state = 0;
-		while (state == 0) {
-			// Receive the response.
-			unsigned char response = 0;
-			status = dc_iostream_read (device->iostream, &response, 1, NULL);
-			if (status != DC_STATUS_SUCCESS) {
-				ERROR (abstract->context, "Failed to receive the response.");
-				return status;
-			}
-
-			// Process the response.
-			switch (response) {
-			case ACK:
-			case NAK:
-				state = response;
-				break;
-			case WAIT:
-				dc_iostream_sleep (device->iostream, signature->delay);
-				break;
-			case 'A':
-			case 'B':
-			case 'C':
-			case 'D':
-			case 'E':
-			case 'F':
-			case 'G':
-			case 'H':
-			case 'K':
-			case 'X':
-				break;
-			default:
-				WARNING (abstract->context, "Unexpected response byte received (%02x)", response);
-				break;
-			}
-		}
+		status = divesystem_idive_firmware_response (device, signature, &state);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
 
 		// Exit if ACK received.
 		if (state == ACK)
@@ -811,10 +883,11 @@ divesystem_idive_device_fwupdate (dc_device_t *abstract, const char *filename)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	divesystem_idive_device_t *device = (divesystem_idive_device_t *) abstract;
+	dc_timer_t *timer = NULL;
 	unsigned int errcode = 0;
 
 	// Allocate memory for the firmware data.
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory for the firmware data.");
 		status = DC_STATUS_NOMEMORY;
@@ -903,32 +976,103 @@ divesystem_idive_device_fwupdate (dc_device_t *abstract, const char *filename)
 		goto error_free;
 	}
 
+	// The throughput is only informational, so a missing timer is not
+	// considered a fatal error.
+	if (dc_timer_new (&timer) != DC_STATUS_SUCCESS) {
+		timer = NULL;
+	}
+
 	// Upload the firmware.
-	unsigned int offset = 0;
+	// The next frames are already sent while the bootloader is still
+	// processing the current one. The bootloader answers the frames in
+	// order, so each ACK or NAK belongs to the oldest frame in flight.
+	unsigned int pipeline = FW_PIPELINE;
+	unsigned int inflight = 0;
+	size_t offset = 0, next = 0;
 	while (offset + 2 <= size) {
-		// Get the number of bytes in the current frame.
-		unsigned int len = array_uint16_be (data + offset) + 2;
-		if (offset + len > size) {
-			ERROR (abstract->context, "Invalid frame size (%u %u " DC_PRINTF_SIZE ")", offset, len, size);
-			status = DC_STATUS_DATAFORMAT;
-			goto error_free;
+		// Keep the next frames queued behind the one being processed.
+		while (inflight < pipeline && next + 2 <= size) {
+			// Get the number of bytes in the current frame.
+			unsigned int len = array_uint16_be (data + next) + 2;
+			if (next + len > size) {
+				ERROR (abstract->context, "Invalid frame size (" DC_PRINTF_SIZE " %u " DC_PRINTF_SIZE ")", next, len, size);
+				status = DC_STATUS_DATAFORMAT;
+				goto error_free;
+			}
+
+			// Send the frame.
+			status = dc_iostream_write (device->iostream, data + next, len, NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to send the frame.");
+				goto error_free;
+			}
+
+			next += len;
+			inflight++;
 		}
 
-		// Send the frame.
-		status = divesystem_idive_firmware_send (device, signature, data + offset, len);
+		// Receive the response of the oldest frame.
+		unsigned int state = 0;
+		status = divesystem_idive_firmware_response (device, signature, &state);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to send the frame.");
 			goto error_free;
 		}
+		inflight--;
+
+		if (state == NAK) {
+			// Collect the responses of the other frames in flight,
+			// and remember the rejected ones.
+			size_t rejected[FW_PIPELINE] = {offset};
+			unsigned int nrejected = 1;
+			size_t current = offset + array_uint16_be (data + offset) + 2;
+			while (current < next) {
+				status = divesystem_idive_firmware_response (device, signature, &state);
+				if (status != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to send the frame.");
+					goto error_free;
+				}
+
+				if (state == NAK)
+					rejected[nrejected++] = current;
+
+				current += array_uint16_be (data + current) + 2;
+			}
+			inflight = 0;
+
+			if (pipeline > 1) {
+				WARNING (abstract->context, "Pipelined firmware frame rejected, disabling pipelining.");
+				pipeline = 1;
+			}
+
+			// Send only the rejected frames again, in their original order.
+			for (unsigned int i = 0; i < nrejected; ++i) {
+				unsigned int len = array_uint16_be (data + rejected[i]) + 2;
+				status = divesystem_idive_firmware_send (device, signature, data + rejected[i], len);
+				if (status != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to send the frame.");
+					goto error_free;
+				}
+			}
+
+			offset = next;
+		} else {
+			offset += array_uint16_be (data + offset) + 2;
+		}
+
+		// Update the throughput.
+		dc_usecs_t now = 0;
+		if (timer && dc_timer_now (timer, &now) == DC_STATUS_SUCCESS && now > 0) {
+			progress.throughput = (unsigned int) (offset * 1000000ULL / now);
+		}
 
 		// Update and emit a progress event.
-		progress.current += len;
+		progress.current = offset;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
-		offset += len;
 	}
 
 error_free:
+	dc_timer_free (timer);
 	dc_buffer_free (buffer);
 error_exit:
 	return status;
@@ -52,30 +52,18 @@
 
 typedef struct divesystem_idive_parser_t divesystem_idive_parser_t;
 
-typedef struct divesystem_idive_gasmix_t {
-	unsigned int oxygen;
-	unsigned int helium;
-} divesystem_idive_gasmix_t;
-
-typedef struct divesystem_idive_tank_t {
-	unsigned int id;
-	unsigned int beginpressure;
-	unsigned int endpressure;
-} divesystem_idive_tank_t;
-
 struct divesystem_idive_parser_t {
 	dc_parser_t base;
 	unsigned int model;
 	unsigned int headersize;
 	// Cached fields.
-	unsigned int cached;
 	unsigned int divemode;
 	unsigned int divetime;
 	unsigned int maxdepth;
 	unsigned int ngasmixes;
 	unsigned int ntanks;
-	divesystem_idive_gasmix_t gasmix[NGASMIXES];
-	divesystem_idive_tank_t tank[NTANKS];
+	dc_parser_gasmix_t gasmix[NGASMIXES];
+	dc_parser_tank_t tank[NTANKS];
 };
 
 static dc_status_t divesystem_idive_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -116,7 +104,6 @@ divesystem_idive_parser_create (dc_parser_t **out, dc_context_t *context, unsign
 	} else {
 		parser->headersize = SZ_HEADER_IDIVE;
 	}
-	parser->cached = 0;
 	parser->divemode = INVALID;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
@@ -144,7 +131,6 @@ divesystem_idive_parser_set_data (dc_parser_t *abstract, const unsigned char *da
 	divesystem_idive_parser_t *parser = (divesystem_idive_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
 	parser->divemode = INVALID;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
@@ -264,6 +250,31 @@ divesystem_idive_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *date
 }
 
 
+static unsigned int
+divesystem_idive_parser_samplesize (divesystem_idive_parser_t *parser)
+{
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	if (!ISIX3M(parser->model))
+		return SZ_SAMPLE_IDIVE;
+
+	// Detect the APOS4 firmware.
+	unsigned int firmware = array_uint32_le(data + 0x2A);
+	unsigned int nsamples = array_uint16_le (data + 1);
+	if ((firmware / 10000000) >= 4) {
+		// Dive downloaded and recorded with the APOS4 firmware.
+		return SZ_SAMPLE_IX3M_APOS4;
+	} else if (size == parser->headersize + nsamples * SZ_SAMPLE_IX3M_APOS4) {
+		// Dive downloaded with the APOS4 firmware, but recorded
+		// with an older firmware.
+		return SZ_SAMPLE_IX3M_APOS4;
+	} else {
+		// Dive downloaded and recorded with an older firmware.
+		return SZ_SAMPLE_IX3M;
+	}
+}
+
 static dc_status_t
 divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
@@ -273,8 +284,28 @@ divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 	if (abstract->size < parser->headersize)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		dc_status_t rc = divesystem_idive_parser_samples_foreach (abstract, NULL, NULL);
+	// The samples have a fixed size.
+	if (type == DC_FIELD_SAMPLE_COUNT || type == DC_FIELD_SAMPLE_CAPACITY) {
+		if (value == NULL)
+			return DC_STATUS_INVALIDARGS;
+		unsigned int samplesize = divesystem_idive_parser_samplesize (parser);
+		*((unsigned int *) value) = (abstract->size - parser->headersize) / samplesize;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// The dive time, maximum depth, dive mode, gas mixes and tanks
+	// are only available in the profile.
+	if (!parser->base.cached && dc_parser_is_summary (parser)) {
+		if (type == DC_FIELD_DIVETIME ||
+			type == DC_FIELD_MAXDEPTH ||
+			type == DC_FIELD_DIVEMODE ||
+			type == DC_FIELD_GASMIX_COUNT ||
+			type == DC_FIELD_GASMIX ||
+			type == DC_FIELD_TANK_COUNT ||
+			type == DC_FIELD_TANK)
+			return DC_STATUS_FULLSCAN;
+	} else {
+		dc_status_t rc = dc_parser_cache_profile (abstract);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -365,8 +396,8 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 	unsigned int maxdepth = 0;
 	unsigned int ngasmixes = 0;
 	unsigned int ntanks = 0;
-	divesystem_idive_gasmix_t gasmix[NGASMIXES] = {0};
-	divesystem_idive_tank_t tank[NTANKS] = {0};
+	dc_parser_gasmix_t gasmix[NGASMIXES] = {0};
+	dc_parser_tank_t tank[NTANKS] = {0};
 	unsigned int o2_previous = 0xFFFFFFFF;
 	unsigned int he_previous = 0xFFFFFFFF;
 	unsigned int mode_previous = INVALID;
@@ -376,23 +407,10 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 
 	unsigned int firmware = 0;
 	unsigned int apos4 = 0;
-	unsigned int nsamples = array_uint16_le (data + 1);
-	unsigned int samplesize = SZ_SAMPLE_IDIVE;
+	unsigned int samplesize = divesystem_idive_parser_samplesize (parser);
 	if (ISIX3M(parser->model)) {
-		// Detect the APOS4 firmware.
 		firmware = array_uint32_le(data + 0x2A);
 		apos4 = (firmware / 10000000) >= 4;
-		if (apos4) {
-			// Dive downloaded and recorded with the APOS4 firmware.
-			samplesize = SZ_SAMPLE_IX3M_APOS4;
-		} else if (size == parser->headersize + nsamples * SZ_SAMPLE_IX3M_APOS4) {
-			// Dive downloaded with the APOS4 firmware, but recorded
-			// with an older firmware.
-			samplesize = SZ_SAMPLE_IX3M_APOS4;
-		} else {
-			// Dive downloaded and recorded with an older firmware.
-			samplesize = SZ_SAMPLE_IX3M;
-		}
 	} else {
 		firmware = array_uint32_le(data + 0x2E);
 	}
@@ -447,12 +465,7 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		unsigned int he = data[offset + 11];
 		if (o2 != o2_previous || he != he_previous) {
 			// Find the gasmix in the list.
-			unsigned int i = 0;
-			while (i < ngasmixes) {
-				if (o2 == gasmix[i].oxygen && he == gasmix[i].helium)
-					break;
-				i++;
-			}
+			unsigned int i = dc_parser_find_gasmix (gasmix, 0, ngasmixes, o2, he);
 
 			// Add it to list if not found.
 			if (i >= ngasmixes) {
@@ -562,7 +575,7 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 	parser->maxdepth = maxdepth;
 	parser->divetime = time;
 	parser->divemode = divemode;
-	parser->cached = 1;
+	parser->base.cached = 1;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -0,0 +1,423 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/download.h>
+
+#include "context-private.h"
+#include "thread.h"
+
+typedef struct dc_download_node_t {
+	struct dc_download_node_t *next;
+	dc_download_item_t item;
+	unsigned char *data;
+} dc_download_node_t;
+
+typedef struct dc_download_session_t {
+	dc_download_t *download;
+	unsigned int index;
+	void *task;
+	int cancelled;
+	// Pending progress event, which is updated in place until it has been
+	// consumed, to avoid flooding the queue.
+	dc_download_node_t *progress;
+} dc_download_session_t;
+
+struct dc_download_t {
+	dc_context_t *context;
+	dc_download_open_t open;
+	void *userdata;
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+	dc_cond_t *space;
+	// Sessions.
+	dc_download_session_t *sessions;
+	unsigned int count;
+	unsigned int running;
+	// Queue, with the maximum and current number of dives.
+	dc_download_node_t *head, *tail;
+	dc_download_node_t *current;
+	unsigned int limit;
+	unsigned int ndives;
+};
+
+static void
+dc_download_push (dc_download_t *download, dc_download_node_t *node)
+{
+	node->next = NULL;
+	if (download->tail)
+		download->tail->next = node;
+	else
+		download->head = node;
+	download->tail = node;
+
+	dc_cond_signal (download->cond);
+}
+
+static dc_download_node_t *
+dc_download_node (dc_download_session_t *session, dc_download_type_t type, size_t size)
+{
+	dc_download_node_t *node = (dc_download_node_t *) malloc (sizeof (dc_download_node_t) + size);
+	if (node == NULL) {
+		ERROR (session->download->context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	memset (&node->item, 0, sizeof (node->item));
+	node->item.type = type;
+	node->item.index = session->index;
+	node->data = size ? (unsigned char *) (node + 1) : NULL;
+
+	return node;
+}
+
+static int
+dc_download_cancel_cb (void *userdata)
+{
+	dc_download_session_t *session = (dc_download_session_t *) userdata;
+	dc_download_t *download = session->download;
+
+	dc_mutex_lock (download->mutex);
+	int cancelled = session->cancelled;
+	dc_mutex_unlock (download->mutex);
+
+	return cancelled;
+}
+
+static void
+dc_download_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	dc_download_session_t *session = (dc_download_session_t *) userdata;
+	dc_download_t *download = session->download;
+
+	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+	const dc_event_devinfo_t *devinfo = (const dc_event_devinfo_t *) data;
+
+	dc_mutex_lock (download->mutex);
+
+	switch (event) {
+	case DC_EVENT_PROGRESS:
+		if (session->progress == NULL) {
+			session->progress = dc_download_node (session, DC_DOWNLOAD_PROGRESS, 0);
+			if (session->progress == NULL)
+				break;
+			dc_download_push (download, session->progress);
+		}
+		session->progress->item.progress = *progress;
+		break;
+	case DC_EVENT_DEVINFO:
+		{
+			dc_download_node_t *node = dc_download_node (session, DC_DOWNLOAD_DEVINFO, 0);
+			if (node == NULL)
+				break;
+			node->item.devinfo = *devinfo;
+			dc_download_push (download, node);
+		}
+		break;
+	default:
+		break;
+	}
+
+	dc_mutex_unlock (download->mutex);
+}
+
+static int
+dc_download_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_download_session_t *session = (dc_download_session_t *) userdata;
+	dc_download_t *download = session->download;
+
+	// The dive data is only valid during the callback, so the dive and its
+	// fingerprint are copied into the queue.
+	dc_download_node_t *node = dc_download_node (session, DC_DOWNLOAD_DIVE, (size_t) size + fsize);
+	if (node == NULL)
+		return 0;
+
+	if (size)
+		memcpy (node->data, data, size);
+	if (fsize)
+		memcpy (node->data + size, fingerprint, fsize);
+
+	node->item.data = node->data;
+	node->item.size = size;
+	node->item.fingerprint = fsize ? node->data + size : NULL;
+	node->item.fsize = fsize;
+
+	dc_mutex_lock (download->mutex);
+
+	// Stall the download while the queue is full, until the consumer
+	// catches up. A cancelled session is never blocked.
+	while (download->limit && download->ndives >= download->limit && !session->cancelled)
+		dc_cond_wait (download->space, download->mutex);
+
+	download->ndives++;
+	dc_download_push (download, node);
+	dc_mutex_unlock (download->mutex);
+
+	return 1;
+}
+
+static void
+dc_download_session_main (void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_download_session_t *session = (dc_download_session_t *) userdata;
+	dc_download_t *download = session->download;
+	dc_context_t *context = NULL;
+	dc_device_t *device = NULL;
+
+	// Every session has its own context, because the device backends
+	// don't share anything through the context.
+	status = dc_context_new (&context);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (download->context, "Failed to create the context.");
+		goto finished;
+	}
+
+	status = download->open (&device, context, session->index, download->userdata);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (download->context, "Failed to open the device for session %u.", session->index);
+		goto finished;
+	}
+
+	dc_device_set_cancel (device, dc_download_cancel_cb, session);
+	dc_device_set_events (device, DC_EVENT_PROGRESS | DC_EVENT_DEVINFO, dc_download_event_cb, session);
+
+	status = dc_device_foreach (device, dc_download_dive_cb, session);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (download->context, "Failed to download the dives for session %u.", session->index);
+	}
+
+finished:
+	dc_device_close (device);
+	dc_context_free (context);
+
+	dc_mutex_lock (download->mutex);
+	dc_download_node_t *node = dc_download_node (session, DC_DOWNLOAD_FINISHED, 0);
+	if (node) {
+		node->item.status = status;
+		dc_download_push (download, node);
+	}
+	download->running--;
+	dc_cond_broadcast (download->cond);
+	dc_mutex_unlock (download->mutex);
+}
+
+dc_status_t
+dc_download_new (dc_download_t **out, dc_context_t *context, unsigned int count, dc_download_open_t open, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_download_t *download = NULL;
+
+	if (out == NULL || open == NULL || count == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	download = (dc_download_t *) malloc (sizeof (dc_download_t));
+	if (download == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	download->context = context;
+	download->open = open;
+	download->userdata = userdata;
+	download->mutex = NULL;
+	download->cond = NULL;
+	download->space = NULL;
+	download->count = 0;
+	download->running = 0;
+	download->head = NULL;
+	download->tail = NULL;
+	download->current = NULL;
+	download->limit = 0;
+	download->ndives = 0;
+
+	download->sessions = (dc_download_session_t *) malloc (count * sizeof (dc_download_session_t));
+	if (download->sessions == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	status = dc_mutex_new (&download->mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+	status = dc_cond_new (&download->cond);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the condition variable.");
+		goto error_free;
+	}
+
+	status = dc_cond_new (&download->space);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the condition variable.");
+		goto error_free;
+	}
+
+	// Start the sessions.
+	dc_mutex_lock (download->mutex);
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_download_session_t *session = download->sessions + i;
+		session->download = download;
+		session->index = i;
+		session->task = NULL;
+		session->cancelled = 0;
+		session->progress = NULL;
+
+		status = dc_context_submit (context, &session->task, dc_download_session_main, session);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to start session %u.", i);
+			break;
+		}
+
+		download->count++;
+		download->running++;
+	}
+	dc_mutex_unlock (download->mutex);
+
+	if (status != DC_STATUS_SUCCESS) {
+		dc_download_free (download);
+		return status;
+	}
+
+	*out = download;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_cond_free (download->space);
+	dc_cond_free (download->cond);
+	dc_mutex_free (download->mutex);
+	free (download->sessions);
+	free (download);
+	return status;
+}
+
+dc_status_t
+dc_download_next (dc_download_t *download, dc_download_item_t *item)
+{
+	if (download == NULL || item == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Release the previous item.
+	free (download->current);
+	download->current = NULL;
+
+	dc_mutex_lock (download->mutex);
+
+	while (download->head == NULL && download->running)
+		dc_cond_wait (download->cond, download->mutex);
+
+	dc_download_node_t *node = download->head;
+	if (node) {
+		download->head = node->next;
+		if (download->head == NULL)
+			download->tail = NULL;
+
+		dc_download_session_t *session = download->sessions + node->item.index;
+		if (session->progress == node)
+			session->progress = NULL;
+
+		if (node->item.type == DC_DOWNLOAD_DIVE) {
+			download->ndives--;
+			dc_cond_broadcast (download->space);
+		}
+	}
+
+	dc_mutex_unlock (download->mutex);
+
+	if (node == NULL)
+		return DC_STATUS_DONE;
+
+	*item = node->item;
+	download->current = node;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_download_cancel (dc_download_t *download, unsigned int index)
+{
+	if (download == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (index != DC_DOWNLOAD_ALL && index >= download->count)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (download->mutex);
+	for (unsigned int i = 0; i < download->count; ++i) {
+		if (index == DC_DOWNLOAD_ALL || index == i)
+			download->sessions[i].cancelled = 1;
+	}
+	dc_cond_broadcast (download->space);
+	dc_mutex_unlock (download->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_download_set_limit (dc_download_t *download, unsigned int limit)
+{
+	if (download == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (download->mutex);
+	download->limit = limit;
+	dc_cond_broadcast (download->space);
+	dc_mutex_unlock (download->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_download_free (dc_download_t *download)
+{
+	if (download == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Stop the sessions that are still running.
+	dc_download_cancel (download, DC_DOWNLOAD_ALL);
+	for (unsigned int i = 0; i < download->count; ++i) {
+		dc_context_wait (download->context, download->sessions[i].task);
+	}
+
+	// Drop the items that were never consumed.
+	dc_download_node_t *node = download->head;
+	while (node) {
+		dc_download_node_t *next = node->next;
+		free (node);
+		node = next;
+	}
+	free (download->current);
+
+	dc_cond_free (download->space);
+	dc_cond_free (download->cond);
+	dc_mutex_free (download->mutex);
+	free (download->sessions);
+	free (download);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -1,17 +1,89 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "parser-private.h"
 #include "field-cache.h"
 
+/*
+ * Fully initialize a freshly allocated cache. After that,
+ * dc_field_cache_clear() is enough to reuse it for the next
+ * dive: it relies on the 'initialized' bits to only wipe
+ * the parts that were filled in, instead of the whole
+ * (mostly unused) gas and string tables.
+ */
+void dc_field_cache_init(dc_field_cache_t *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+}
+
+void dc_field_cache_clear(dc_field_cache_t *cache)
+{
+	const unsigned int gases =
+		(1u << DC_FIELD_GASMIX_COUNT) | (1u << DC_FIELD_GASMIX) |
+		(1u << DC_FIELD_TANK_COUNT) | (1u << DC_FIELD_TANK);
+	int i;
+
+	if (cache->initialized & gases) {
+		memset(cache->GASMIX, 0, sizeof(cache->GASMIX));
+		memset(cache->tankinfo, 0, sizeof(cache->tankinfo));
+		memset(cache->tanksize, 0, sizeof(cache->tanksize));
+		memset(cache->tankworkingpressure, 0, sizeof(cache->tankworkingpressure));
+	}
+
+	// Strings are always added to the first free slot.
+	if (cache->initialized & (1u << DC_FIELD_STRING)) {
+		for (i = 0; i < MAXSTRINGS && cache->strings[i].desc; i++) {
+			cache->strings[i].desc = NULL;
+			cache->strings[i].value = NULL;
+			cache->lazy[i].formatter = NULL;
+		}
+	}
+	cache->stringsize = 0;
+
+	// The remaining fields are small enough to just wipe.
+	memset(cache, 0, offsetof(dc_field_cache_t, GASMIX));
+}
+
+/*
+ * Fix up a cache that was copied together with its parser. The
+ * string values live in the cache itself, and the lazy strings
+ * normally point to the parser, so everything that pointed into
+ * the original parser is moved to the same offset in the copy.
+ */
+static const void *rebase(const void *ptr, const void *from, const void *to, size_t size)
+{
+	const char *p = (const char *) ptr;
+	const char *begin = (const char *) from;
+
+	if (!p || p < begin || p >= begin + size)
+		return ptr;
+	return (const char *) to + (p - begin);
+}
+
+void dc_field_cache_rebase(dc_field_cache_t *cache, const void *from, const void *to, size_t size)
+{
+	int i;
+
+	if (!(cache->initialized & (1u << DC_FIELD_STRING)))
+		return;
+
+	for (i = 0; i < MAXSTRINGS && cache->strings[i].desc; i++) {
+		cache->strings[i].desc = (const char *) rebase(cache->strings[i].desc, from, to, size);
+		cache->strings[i].value = (const char *) rebase(cache->strings[i].value, from, to, size);
+		cache->lazy[i].userdata = rebase(cache->lazy[i].userdata, from, to, size);
+	}
+}
+
 /*
  * The field cache 'string' interface has some simple rules:
  * the "descriptor" part is assumed to be a static allocation,
  * while the "value" is something that this interface will
- * alway sallocate with 'strdup()', so you can generate it
+ * always copy into the cache itself, so you can generate it
  * dynamically on the stack or whatever without having to
- * worry about it.
+ * worry about it. The copy stays valid until the cache is
+ * cleared for the next dive.
  */
 dc_status_t dc_field_add_string(dc_field_cache_t *cache, const char *desc, const char *value)
 {
@@ -20,12 +92,16 @@ dc_status_t dc_field_add_string(dc_field_cache_t *cache, const char *desc, const
 	cache->initialized |= 1 << DC_FIELD_STRING;
 	for (i = 0; i < MAXSTRINGS; i++) {
 		dc_field_string_t *str = cache->strings+i;
+		size_t len;
 		if (str->desc)
 			continue;
-		str->value = strdup(value);
-		if (!str->value)
+		len = strlen(value) + 1;
+		if (len > sizeof(cache->stringdata) - cache->stringsize)
 			return DC_STATUS_NOMEMORY;
+		memcpy(cache->stringdata + cache->stringsize, value, len);
+		str->value = cache->stringdata + cache->stringsize;
 		str->desc = desc;
+		cache->stringsize += len;
 		return DC_STATUS_SUCCESS;
 	}
 	return DC_STATUS_INVALIDARGS;
@@ -51,10 +127,63 @@ dc_status_t dc_field_add_string_fmt(dc_field_cache_t *cache, const char *desc, c
 	return dc_field_add_string(cache, desc, buffer);
 }
 
+/*
+ * Register a string without generating the value yet. The
+ * formatter is only called when the string is requested with
+ * dc_field_get_string(), so the formatting work is skipped
+ * entirely for callers that only want the numeric fields.
+ *
+ * The userdata has to stay valid until the cache is cleared,
+ * which is normally the parser itself.
+ */
+dc_status_t dc_field_add_string_lazy(dc_field_cache_t *cache, const char *desc, dc_field_formatter_t formatter, const void *userdata, unsigned int arg)
+{
+	int i;
+
+	cache->initialized |= 1 << DC_FIELD_STRING;
+	for (i = 0; i < MAXSTRINGS; i++) {
+		dc_field_string_t *str = cache->strings+i;
+		if (str->desc)
+			continue;
+		str->desc = desc;
+		str->value = NULL;
+		cache->lazy[i].formatter = formatter;
+		cache->lazy[i].userdata = userdata;
+		cache->lazy[i].arg = arg;
+		return DC_STATUS_SUCCESS;
+	}
+	return DC_STATUS_INVALIDARGS;
+}
+
+static dc_status_t dc_field_format_string(dc_field_cache_t *cache, unsigned idx)
+{
+	dc_field_lazy_t *lazy = cache->lazy+idx;
+	char buffer[256];
+	size_t len;
+
+	buffer[0] = 0;
+	lazy->formatter(buffer, sizeof(buffer)-1, lazy->userdata, lazy->arg);
+	buffer[sizeof(buffer)-1] = 0;
+
+	len = strlen(buffer) + 1;
+	if (len > sizeof(cache->stringdata) - cache->stringsize)
+		return DC_STATUS_NOMEMORY;
+	memcpy(cache->stringdata + cache->stringsize, buffer, len);
+	cache->strings[idx].value = cache->stringdata + cache->stringsize;
+	cache->stringsize += len;
+	lazy->formatter = NULL;
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t dc_field_get_string(dc_field_cache_t *cache, unsigned idx, dc_field_string_t *value)
 {
 	if (idx < MAXSTRINGS) {
 		dc_field_string_t *res = cache->strings+idx;
+		if (res->desc && !res->value && cache->lazy[idx].formatter) {
+			dc_status_t rc = dc_field_format_string(cache, idx);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
 		if (res->desc && res->value) {
 			*value = *res;
 			return DC_STATUS_SUCCESS;
@@ -2,6 +2,20 @@
 
 #define MAXGASES 16
 #define MAXSTRINGS 32
+#define MAXSTRINGDATA 2048
+
+/*
+ * Formatter for a string value that is only generated when
+ * it's actually requested. The userdata and arg are whatever
+ * was passed to dc_field_add_string_lazy().
+ */
+typedef void (*dc_field_formatter_t)(char *buffer, size_t size, const void *userdata, unsigned int arg);
+
+typedef struct dc_field_lazy {
+	dc_field_formatter_t formatter;
+	const void *userdata;
+	unsigned int arg;
+} dc_field_lazy_t;
 
 // dc_get_field() data
 typedef struct dc_field_cache {
@@ -15,13 +29,16 @@ typedef struct dc_field_cache {
 	dc_divemode_t DIVEMODE;
 	unsigned int GASMIX_COUNT;
 	dc_salinity_t SALINITY;
-	dc_gasmix_t GASMIX[MAXGASES];
 
 	// misc - clean me up!
 	double lowsetpoint;
 	double highsetpoint;
 	double customsetpoint;
 
+	// The bulk arrays below are only cleared when they
+	// were actually used, see dc_field_cache_clear().
+	dc_gasmix_t GASMIX[MAXGASES];
+
 	// This (slong with GASMIX) should be something like
 	//     dc_tank_t TANK[MAXGASES]
 	// but that's for later
@@ -31,10 +48,20 @@ typedef struct dc_field_cache {
 
 	// DC_GET_FIELD_STRING
 	dc_field_string_t strings[MAXSTRINGS];
+	dc_field_lazy_t lazy[MAXSTRINGS];
+
+	// Storage for the string values, so clearing the
+	// cache releases them all at once.
+	unsigned int stringsize;
+	char stringdata[MAXSTRINGDATA];
 } dc_field_cache_t;
 
+void dc_field_cache_init(dc_field_cache_t *);
+void dc_field_cache_clear(dc_field_cache_t *);
+void dc_field_cache_rebase(dc_field_cache_t *, const void *from, const void *to, size_t size);
 dc_status_t dc_field_add_string(dc_field_cache_t *, const char *desc, const char *data);
 dc_status_t dc_field_add_string_fmt(dc_field_cache_t *, const char *desc, const char *fmt, ...);
+dc_status_t dc_field_add_string_lazy(dc_field_cache_t *, const char *desc, dc_field_formatter_t formatter, const void *userdata, unsigned int arg);
 dc_status_t dc_field_get_string(dc_field_cache_t *, unsigned idx, dc_field_string_t *value);
 dc_status_t dc_field_get(dc_field_cache_t *, dc_field_type_t, unsigned int, void *);
 
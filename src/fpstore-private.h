@@ -0,0 +1,52 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_FPSTORE_PRIVATE_H
+#define DC_FPSTORE_PRIVATE_H
+
+#include <libdivecomputer/fpstore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Besides the fingerprints, the store can hold one opaque state record
+ * per device. Backends use it to remember where the previous download
+ * stopped, such that the next one can skip the data that was already
+ * processed. The contents are private to the backend, and are saved
+ * and loaded together with the fingerprints.
+ */
+
+dc_status_t
+dc_fpstore_set_state (dc_fpstore_t *store, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size);
+
+/*
+ * Returns the size of the state record, or zero if there is no record
+ * for the device. The data is only copied if it fits in the buffer.
+ */
+unsigned int
+dc_fpstore_get_state (dc_fpstore_t *store, unsigned int model, unsigned int serial, unsigned char data[], unsigned int size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_FPSTORE_PRIVATE_H */
@@ -0,0 +1,453 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdio.h>  // fopen, fread, fwrite, fclose
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcmp, memcpy
+
+#include "fpstore-private.h"
+#include "context-private.h"
+#include "array.h"
+
+#define MAGIC   0x50464344 // "DCFP"
+#define FORMAT  2
+
+#define MINBUCKETS 64
+#define MAXSIZE    256
+
+typedef struct dc_fpstore_entry_t {
+	struct dc_fpstore_entry_t *next;
+	unsigned int hash;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int size;
+	unsigned char data[1];
+} dc_fpstore_entry_t;
+
+struct dc_fpstore_t {
+	dc_context_t *context;
+	dc_fpstore_entry_t **buckets;
+	unsigned int nbuckets;
+	unsigned int count;
+	// The state records are kept in a separate list, because there is
+	// only one for each device.
+	dc_fpstore_entry_t *states;
+	unsigned int nstates;
+};
+
+static unsigned int
+dc_fpstore_hash (unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	// FNV-1a over the device identity and the fingerprint bytes.
+	unsigned int hash = 2166136261u;
+
+	unsigned char key[8];
+	array_uint32_le_set (key, model);
+	array_uint32_le_set (key + 4, serial);
+	for (unsigned int i = 0; i < sizeof (key); ++i) {
+		hash = (hash ^ key[i]) * 16777619u;
+	}
+
+	for (unsigned int i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+static dc_fpstore_entry_t *
+dc_fpstore_find (dc_fpstore_t *store, unsigned int hash, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	dc_fpstore_entry_t *entry = store->buckets[hash & (store->nbuckets - 1)];
+	while (entry) {
+		if (entry->hash == hash &&
+			entry->model == model &&
+			entry->serial == serial &&
+			entry->size == size &&
+			memcmp (entry->data, data, size) == 0)
+			return entry;
+		entry = entry->next;
+	}
+
+	return NULL;
+}
+
+static dc_status_t
+dc_fpstore_grow (dc_fpstore_t *store)
+{
+	unsigned int nbuckets = store->nbuckets * 2;
+
+	dc_fpstore_entry_t **buckets = (dc_fpstore_entry_t **) dc_context_malloc (store->context, nbuckets * sizeof (*buckets));
+	if (buckets == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (buckets, 0, nbuckets * sizeof (*buckets));
+
+	for (unsigned int i = 0; i < store->nbuckets; ++i) {
+		dc_fpstore_entry_t *entry = store->buckets[i];
+		while (entry) {
+			dc_fpstore_entry_t *next = entry->next;
+			unsigned int idx = entry->hash & (nbuckets - 1);
+			entry->next = buckets[idx];
+			buckets[idx] = entry;
+			entry = next;
+		}
+	}
+
+	dc_context_dealloc (store->context, store->buckets);
+
+	store->buckets = buckets;
+	store->nbuckets = nbuckets;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_fpstore_new (dc_fpstore_t **out, dc_context_t *context)
+{
+	dc_fpstore_t *store = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	store = (dc_fpstore_t *) dc_context_malloc (context, sizeof (dc_fpstore_t));
+	if (store == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	store->context = context;
+	store->nbuckets = MINBUCKETS;
+	store->count = 0;
+	store->states = NULL;
+	store->nstates = 0;
+
+	store->buckets = (dc_fpstore_entry_t **) dc_context_malloc (context, store->nbuckets * sizeof (*store->buckets));
+	if (store->buckets == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_context_dealloc (context, store);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (store->buckets, 0, store->nbuckets * sizeof (*store->buckets));
+
+	*out = store;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_fpstore_free (dc_fpstore_t *store)
+{
+	if (store == NULL)
+		return DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < store->nbuckets; ++i) {
+		dc_fpstore_entry_t *entry = store->buckets[i];
+		while (entry) {
+			dc_fpstore_entry_t *next = entry->next;
+			dc_context_dealloc (store->context, entry);
+			entry = next;
+		}
+	}
+
+	dc_fpstore_entry_t *state = store->states;
+	while (state) {
+		dc_fpstore_entry_t *next = state->next;
+		dc_context_dealloc (store->context, state);
+		state = next;
+	}
+
+	dc_context_dealloc (store->context, store->buckets);
+	dc_context_dealloc (store->context, store);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_fpstore_add (dc_fpstore_t *store, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (store == NULL || data == NULL || size == 0 || size > MAXSIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int hash = dc_fpstore_hash (model, serial, data, size);
+	if (dc_fpstore_find (store, hash, model, serial, data, size))
+		return DC_STATUS_SUCCESS;
+
+	// Keep the load factor below one.
+	if (store->count >= store->nbuckets) {
+		status = dc_fpstore_grow (store);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	dc_fpstore_entry_t *entry = (dc_fpstore_entry_t *) dc_context_malloc (store->context, sizeof (dc_fpstore_entry_t) + size - 1);
+	if (entry == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	entry->hash = hash;
+	entry->model = model;
+	entry->serial = serial;
+	entry->size = size;
+	memcpy (entry->data, data, size);
+
+	unsigned int idx = hash & (store->nbuckets - 1);
+	entry->next = store->buckets[idx];
+	store->buckets[idx] = entry;
+	store->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_fpstore_contains (dc_fpstore_t *store, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	if (store == NULL || data == NULL || size == 0)
+		return 0;
+
+	unsigned int hash = dc_fpstore_hash (model, serial, data, size);
+
+	return dc_fpstore_find (store, hash, model, serial, data, size) != NULL;
+}
+
+dc_status_t
+dc_fpstore_set_state (dc_fpstore_t *store, unsigned int model, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	if (store == NULL || data == NULL || size == 0 || size > MAXSIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_fpstore_entry_t *entry = (dc_fpstore_entry_t *) dc_context_malloc (store->context, sizeof (dc_fpstore_entry_t) + size - 1);
+	if (entry == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	entry->hash = 0;
+	entry->model = model;
+	entry->serial = serial;
+	entry->size = size;
+	memcpy (entry->data, data, size);
+
+	// Replace the existing record, if any.
+	dc_fpstore_entry_t **link = &store->states;
+	while (*link) {
+		dc_fpstore_entry_t *current = *link;
+		if (current->model == model && current->serial == serial) {
+			entry->next = current->next;
+			*link = entry;
+			dc_context_dealloc (store->context, current);
+			return DC_STATUS_SUCCESS;
+		}
+		link = &current->next;
+	}
+
+	entry->next = NULL;
+	*link = entry;
+	store->nstates++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+dc_fpstore_get_state (dc_fpstore_t *store, unsigned int model, unsigned int serial, unsigned char data[], unsigned int size)
+{
+	if (store == NULL)
+		return 0;
+
+	for (dc_fpstore_entry_t *entry = store->states; entry; entry = entry->next) {
+		if (entry->model == model && entry->serial == serial) {
+			if (data && entry->size <= size)
+				memcpy (data, entry->data, entry->size);
+			return entry->size;
+		}
+	}
+
+	return 0;
+}
+
+static dc_status_t
+dc_fpstore_read_entry (dc_fpstore_t *store, FILE *fp, unsigned int state)
+{
+	unsigned char entry[12 + MAXSIZE];
+	if (fread (entry, 12, 1, fp) != 1) {
+		ERROR (store->context, "Failed to read the entry header.");
+		return DC_STATUS_IO;
+	}
+
+	unsigned int model  = array_uint32_le (entry);
+	unsigned int serial = array_uint32_le (entry + 4);
+	unsigned int size   = array_uint32_le (entry + 8);
+	if (size == 0 || size > MAXSIZE) {
+		ERROR (store->context, "Invalid entry size (%u).", size);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	if (fread (entry + 12, size, 1, fp) != 1) {
+		ERROR (store->context, "Failed to read the entry data.");
+		return DC_STATUS_IO;
+	}
+
+	if (state)
+		return dc_fpstore_set_state (store, model, serial, entry + 12, size);
+	else
+		return dc_fpstore_add (store, model, serial, entry + 12, size);
+}
+
+static dc_status_t
+dc_fpstore_write_entry (dc_fpstore_t *store, FILE *fp, const dc_fpstore_entry_t *entry)
+{
+	unsigned char hdr[12];
+	array_uint32_le_set (hdr, entry->model);
+	array_uint32_le_set (hdr + 4, entry->serial);
+	array_uint32_le_set (hdr + 8, entry->size);
+	if (fwrite (hdr, sizeof (hdr), 1, fp) != 1 ||
+		fwrite (entry->data, entry->size, 1, fp) != 1) {
+		ERROR (store->context, "Failed to write the entry.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_fpstore_load (dc_fpstore_t *store, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+
+	if (store == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (store->context, "Failed to open the file '%s'.", filename);
+		return DC_STATUS_IO;
+	}
+
+	unsigned char header[12];
+	if (fread (header, sizeof (header), 1, fp) != 1) {
+		ERROR (store->context, "Failed to read the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	// Version 1 files contain only the fingerprints. Version 2 added a
+	// second section with the state records.
+	unsigned int format = array_uint32_le (header + 4);
+	if (array_uint32_le (header) != MAGIC ||
+		format < 1 || format > FORMAT) {
+		ERROR (store->context, "Unexpected file header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_fclose;
+	}
+
+	unsigned int count = array_uint32_le (header + 8);
+	for (unsigned int i = 0; i < count; ++i) {
+		status = dc_fpstore_read_entry (store, fp, 0);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_fclose;
+	}
+
+	if (format >= 2) {
+		unsigned char nstates[4];
+		if (fread (nstates, sizeof (nstates), 1, fp) != 1) {
+			ERROR (store->context, "Failed to read the state header.");
+			status = DC_STATUS_IO;
+			goto error_fclose;
+		}
+
+		count = array_uint32_le (nstates);
+		for (unsigned int i = 0; i < count; ++i) {
+			status = dc_fpstore_read_entry (store, fp, 1);
+			if (status != DC_STATUS_SUCCESS)
+				goto error_fclose;
+		}
+	}
+
+error_fclose:
+	fclose (fp);
+	return status;
+}
+
+dc_status_t
+dc_fpstore_save (dc_fpstore_t *store, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+
+	if (store == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fp = fopen (filename, "wb");
+	if (fp == NULL) {
+		ERROR (store->context, "Failed to open the file '%s'.", filename);
+		return DC_STATUS_IO;
+	}
+
+	unsigned char header[12];
+	array_uint32_le_set (header, MAGIC);
+	array_uint32_le_set (header + 4, FORMAT);
+	array_uint32_le_set (header + 8, store->count);
+	if (fwrite (header, sizeof (header), 1, fp) != 1) {
+		ERROR (store->context, "Failed to write the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	for (unsigned int i = 0; i < store->nbuckets; ++i) {
+		for (dc_fpstore_entry_t *entry = store->buckets[i]; entry; entry = entry->next) {
+			status = dc_fpstore_write_entry (store, fp, entry);
+			if (status != DC_STATUS_SUCCESS)
+				goto error_fclose;
+		}
+	}
+
+	unsigned char nstates[4];
+	array_uint32_le_set (nstates, store->nstates);
+	if (fwrite (nstates, sizeof (nstates), 1, fp) != 1) {
+		ERROR (store->context, "Failed to write the state header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	for (dc_fpstore_entry_t *entry = store->states; entry; entry = entry->next) {
+		status = dc_fpstore_write_entry (store, fp, entry);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_fclose;
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (store->context, "Failed to close the file.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	fclose (fp);
+	return status;
+}
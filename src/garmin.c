@@ -32,8 +32,18 @@
 
 #include "garmin.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
+#include "thread.h"
+
+// The files are read and verified by a pool of worker threads, at most
+// WINDOW files ahead of the one being delivered to the callback.
+#define NWORKERS 4
+#define WINDOW   (4 * NWORKERS)
+
+// The amount of data read to probe a file before reading all of it.
+#define PROBESIZE 8192
 
 typedef struct garmin_device_t {
 	dc_device_t base;
@@ -52,7 +62,9 @@ static const dc_device_vtable_t garmin_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	garmin_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	garmin_device_close, /* close */
 };
@@ -181,10 +193,15 @@ static int get_file_list(dc_device_t *abstract, DIR *dir, struct file_list *file
 #define O_BINARY 0
 #endif
 
+/*
+ * Read a file, or only its first limit bytes if limit is not zero.
+ */
 static dc_status_t
-read_file(char *pathname, int pathlen, const char *name, dc_buffer_t *file)
+read_file(char *pathname, int pathlen, const char *name, dc_buffer_t *file, size_t limit)
 {
-	int fd, rc;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	struct stat st;
+	int fd;
 
 	pathname[pathlen] = '/';
 	memcpy(pathname+pathlen+1, name, FIT_NAME_SIZE);
@@ -193,26 +210,267 @@ read_file(char *pathname, int pathlen, const char *name, dc_buffer_t *file)
 	if (fd < 0)
 		return DC_STATUS_IO;
 
-	rc = DC_STATUS_SUCCESS;
+	// Size the buffer for the whole file up front, and read straight
+	// into it, instead of growing it in small steps through a bounce
+	// buffer. The file is read until the end, even if it changed size
+	// in the meantime.
+	size_t start = dc_buffer_get_size(file);
+	size_t offset = start;
+	size_t capacity = 4096;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		capacity = (size_t) st.st_size + 1;
+	if (limit && capacity > limit)
+		capacity = limit;
+
 	for (;;) {
-		char buffer[4096];
-		int n;
+		if (!dc_buffer_resize(file, offset + capacity)) {
+			rc = DC_STATUS_NOMEMORY;
+			break;
+		}
 
-		n = read(fd, buffer, sizeof(buffer));
-		if (!n)
+		unsigned char *data = dc_buffer_get_data(file);
+		ssize_t n = read(fd, data + offset, capacity);
+		if (n < 0) {
+			rc = DC_STATUS_IO;
 			break;
-		if (n > 0) {
-			dc_buffer_append(file, buffer, n);
-			continue;
 		}
-		rc = DC_STATUS_IO;
-		break;
+
+		offset += n;
+		if (n == 0 || (limit && offset - start >= limit))
+			break;
+		capacity = (size_t) n < capacity ? capacity - n : 4096;
+		if (limit && capacity > limit - (offset - start))
+			capacity = limit - (offset - start);
 	}
 
+	dc_buffer_resize(file, offset);
+
 	close(fd);
 	return rc;
 }
 
+typedef struct garmin_job_t {
+	dc_buffer_t *buffer;
+	dc_status_t status;
+	int is_dive;
+	int done;
+} garmin_job_t;
+
+typedef struct garmin_pool_t {
+	dc_context_t *context;
+	const struct file_list *files;
+	const char *pathname;
+	size_t pathlen;
+	garmin_job_t *jobs;
+	dc_event_devinfo_t devinfo;
+	int next;
+	int delivered;
+	int stop;
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+} garmin_pool_t;
+
+/*
+ * Read a FIT file and check whether it contains a dive.
+ */
+static dc_status_t
+garmin_verify_file (dc_parser_t *parser, char *pathname, size_t pathlen, const char *name, dc_buffer_t *file, int *is_dive, dc_event_devinfo_t *devinfo_p)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Reset the membuffer, and read the first part of the file. Most
+	// activities can be rejected from their first messages, without
+	// reading and parsing the whole file. The file that provides the
+	// device info is always parsed completely.
+	dc_buffer_clear(file);
+	dc_buffer_append(file, name, FIT_NAME_SIZE);
+
+	status = read_file(pathname, pathlen, name, file, devinfo_p ? 0 : PROBESIZE);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (devinfo_p == NULL && !garmin_parser_probe(dc_buffer_get_data(file), dc_buffer_get_size(file))) {
+		*is_dive = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Read the whole file.
+	if (devinfo_p == NULL && dc_buffer_get_size(file) == FIT_NAME_SIZE + PROBESIZE) {
+		dc_buffer_resize(file, FIT_NAME_SIZE);
+		status = read_file(pathname, pathlen, name, file, 0);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	*is_dive = garmin_parser_is_dive(parser, dc_buffer_get_data(file), dc_buffer_get_size(file), devinfo_p);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+garmin_pool_worker (void *userdata)
+{
+	garmin_pool_t *pool = (garmin_pool_t *) userdata;
+	dc_parser_t *parser = NULL;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	char pathname[PATH_MAX];
+
+	// Every worker needs its own path buffer and parser.
+	memcpy(pathname, pool->pathname, pool->pathlen);
+	rc = garmin_parser_create(&parser, pool->context);
+	if (rc != DC_STATUS_SUCCESS)
+		parser = NULL;
+
+	dc_mutex_lock(pool->mutex);
+	for (;;) {
+		while (!pool->stop && pool->next < pool->files->nr &&
+			pool->next >= pool->delivered + WINDOW)
+			dc_cond_wait(pool->cond, pool->mutex);
+		if (pool->stop || pool->next >= pool->files->nr)
+			break;
+
+		int i = pool->next++;
+		dc_mutex_unlock(pool->mutex);
+
+		dc_event_devinfo_t devinfo = {0};
+		dc_buffer_t *buffer = dc_buffer_allocate (pool->context, 16384);
+		int is_dive = 0;
+		if (parser == NULL || buffer == NULL) {
+			rc = DC_STATUS_NOMEMORY;
+		} else {
+			rc = garmin_verify_file(parser, pathname, pool->pathlen,
+				pool->files->array[i].name, buffer, &is_dive, i == 0 ? &devinfo : NULL);
+		}
+
+		dc_mutex_lock(pool->mutex);
+		pool->jobs[i].buffer = buffer;
+		pool->jobs[i].status = rc;
+		pool->jobs[i].is_dive = is_dive;
+		pool->jobs[i].done = 1;
+		if (i == 0)
+			pool->devinfo = devinfo;
+		dc_cond_broadcast(pool->cond);
+	}
+	dc_mutex_unlock(pool->mutex);
+
+	dc_parser_destroy(parser);
+}
+
+/*
+ * Read and verify the files with a pool of worker threads, and deliver
+ * the dives in the sorted order. Returns DC_STATUS_UNSUPPORTED, before
+ * delivering anything, if no threads can be started.
+ */
+static dc_status_t
+garmin_device_foreach_parallel (dc_device_t *abstract, const char *pathname, size_t pathlen, const struct file_list *files, dc_event_progress_t *progress, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	void *workers[NWORKERS] = {NULL};
+	unsigned int nworkers = 0;
+	garmin_pool_t pool;
+
+	pool.context = abstract->context;
+	pool.files = files;
+	pool.pathname = pathname;
+	pool.pathlen = pathlen;
+	pool.next = 0;
+	pool.delivered = 0;
+	pool.stop = 0;
+	pool.mutex = NULL;
+	pool.cond = NULL;
+	memset(&pool.devinfo, 0, sizeof(pool.devinfo));
+
+	pool.jobs = (garmin_job_t *) calloc(files->nr, sizeof(garmin_job_t));
+	if (pool.jobs == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	status = dc_mutex_new(&pool.mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new(&pool.cond);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	while (nworkers < NWORKERS && (int) nworkers < files->nr) {
+		status = dc_context_submit(abstract->context, &workers[nworkers], garmin_pool_worker, &pool);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+		nworkers++;
+	}
+
+	if (nworkers == 0)
+		goto error_free;
+
+	status = DC_STATUS_SUCCESS;
+	for (int i = 0; i < files->nr; i++) {
+		const char *name = files->array[i].name;
+		garmin_job_t *job = pool.jobs + i;
+
+		if (device_is_cancelled(abstract)) {
+			status = DC_STATUS_CANCELLED;
+			break;
+		}
+
+		dc_mutex_lock(pool.mutex);
+		while (!job->done)
+			dc_cond_wait(pool.cond, pool.mutex);
+		dc_mutex_unlock(pool.mutex);
+
+		status = job->status;
+		if (status != DC_STATUS_SUCCESS)
+			break;
+
+		if (i == 0) {
+			// first time we came through here, let's emit the
+			// devinfo and vendor events
+			device_event_emit (abstract, DC_EVENT_DEVINFO, &pool.devinfo);
+		}
+
+		int more = 1;
+		if (!job->is_dive) {
+			DEBUG (abstract->context, "decided %s isn't a dive.", name);
+		} else if (callback && !callback(dc_buffer_get_data(job->buffer), dc_buffer_get_size(job->buffer), name, FIT_NAME_SIZE, userdata)) {
+			more = 0;
+		} else {
+			progress->current++;
+			device_event_emit(abstract, DC_EVENT_PROGRESS, progress);
+		}
+
+		// Release the buffer and let the workers move ahead.
+		dc_mutex_lock(pool.mutex);
+		dc_buffer_free(job->buffer);
+		job->buffer = NULL;
+		pool.delivered = i + 1;
+		dc_cond_broadcast(pool.cond);
+		dc_mutex_unlock(pool.mutex);
+
+		if (!more)
+			break;
+	}
+
+	// Stop the workers.
+	dc_mutex_lock(pool.mutex);
+	pool.stop = 1;
+	dc_cond_broadcast(pool.cond);
+	dc_mutex_unlock(pool.mutex);
+
+	for (unsigned int i = 0; i < nworkers; ++i) {
+		dc_context_wait(abstract->context, workers[i]);
+	}
+
+error_free:
+	for (int i = 0; i < files->nr; i++) {
+		dc_buffer_free(pool.jobs[i].buffer);
+	}
+	dc_cond_free(pool.cond);
+	dc_mutex_free(pool.mutex);
+	free(pool.jobs);
+	return nworkers ? status : DC_STATUS_UNSUPPORTED;
+}
+
 static dc_status_t
 garmin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -278,7 +536,16 @@ garmin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	progress.current = 0;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	file = dc_buffer_new (16384);
+	// Use the worker pool if possible, and fall back to reading the
+	// files one by one otherwise.
+	status = garmin_device_foreach_parallel (abstract, pathname, pathlen, &files, &progress, callback, userdata);
+	if (status != DC_STATUS_UNSUPPORTED) {
+		free(files.array);
+		return status;
+	}
+	status = DC_STATUS_SUCCESS;
+
+	file = dc_buffer_allocate (abstract->context, 16384);
 	if (file == NULL) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		free(files.array);
@@ -296,25 +563,20 @@ garmin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		const char *name = files.array[i].name;
 		const unsigned char *data;
 		unsigned int size;
-		short is_dive = 0;
+		int is_dive = 0;
 
 		if (device_is_cancelled(abstract)) {
 			status = DC_STATUS_CANCELLED;
 			break;
 		}
 
-		// Reset the membuffer, read the data
-		dc_buffer_clear(file);
-		dc_buffer_append(file, name, FIT_NAME_SIZE);
-
-		status = read_file(pathname, pathlen, name, file);
+		status = garmin_verify_file(parser, pathname, pathlen, name, file, &is_dive, devinfo_p);
 		if (status != DC_STATUS_SUCCESS)
 			break;
 
 		data = dc_buffer_get_data(file);
 		size = dc_buffer_get_size(file);
 
-		is_dive = garmin_parser_is_dive(parser, data, size, devinfo_p);
 		if (devinfo_p) {
 			// first time we came through here, let's emit the
 			// devinfo and vendor events
@@ -37,11 +37,20 @@ garmin_device_open (dc_device_t **device, dc_context_t *context, dc_iostream_t *
 dc_status_t
 garmin_parser_create (dc_parser_t **parser, dc_context_t *context);
 
+// Score the FIT header of a dive blob for dc_parser_probe.
+unsigned int
+garmin_parser_probe_format (const unsigned char data[], unsigned int size);
+
 // we need to be able to call into the parser to check if the
 // files that we find are actual dives
 int
 garmin_parser_is_dive (dc_parser_t *abstract, const unsigned char *data, unsigned int size, dc_event_devinfo_t *devinfo_p);
 
+// Cheap check on the first part of a file, without a full parse.
+// Returns zero if the file is certainly not a dive.
+int
+garmin_parser_probe (const unsigned char *data, unsigned int size);
+
 // The dive names are of the form "2018-08-20-10-23-30.fit"
 // With the terminating zero, that's 24 bytes.
 //
@@ -23,27 +23,77 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <stddef.h>
 
 #include "garmin.h"
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
 #include "field-cache.h"
+#include "thread.h"
 
 #define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
 #define MAXFIELDS 128
+#define MSG_NAME_LEN 16
 
 struct msg_desc;
+struct field_desc;
+
+// One step of the decode plan for a local type. The field
+// descriptor is resolved once, when the definition is seen,
+// so data records only have to walk this flat array.
+struct field_plan {
+	const struct field_desc *desc;
+	unsigned int mask;
+	unsigned short offset;
+	unsigned char field_nr;
+	unsigned char len;
+	unsigned char base_type;
+};
 
 // Local types
 struct type_desc {
 	const char *msg_name;
 	const struct msg_desc *msg_desc;
-	unsigned char nrfields;
-	unsigned char fields[MAXFIELDS][3];
+	unsigned char nrplan;
+	unsigned short size;
+	// Walks which have to look at the records of this type
+	unsigned int mask;
+	// Error in the definition, reported when a record uses it
+	const char *error;
+	// Unknown base type: the rest of the record is skipped
+	unsigned char skiprest;
+	char name[MSG_NAME_LEN];
+	// Must be the last member, shared entries only store nrplan steps
+	struct field_plan plan[MAXFIELDS];
 };
 
+/*
+ * Shared definition.
+ *
+ * The files of the same device re-declare the same handful of
+ * definition messages, so the compiled decode plans are shared in a
+ * process wide table, keyed by the raw bytes of the definition. The
+ * plan only depends on those bytes and on the static message tables.
+ * The entries are immutable once they are published, and never freed.
+ * Once the table is full, new plans stay in the local type slot of the
+ * parser instance.
+ */
+struct def_entry {
+	struct def_entry *next;
+	unsigned int hash;
+	unsigned int length;
+	const unsigned char *text;
+	struct type_desc desc;
+};
+
+#define DEF_BUCKETS  256
+#define DEF_MAXCACHE 4096
+
+static struct def_entry *g_def_cache[DEF_BUCKETS];
+static unsigned int g_def_count;
+
 // Positions are signed 32-bit values, turning
 // into 180 * val // 2**31 degrees.
 struct pos {
@@ -94,6 +144,9 @@ typedef struct garmin_parser_t {
 	// Multi-value record data
 	struct record_data record_data;
 
+	// Decode plan of every local type, and the storage for the plans
+	// which aren't in the shared table.
+	const struct type_desc *types[MAXTYPE];
 	struct type_desc type_desc[MAXTYPE];
 
 	// Field cache
@@ -106,6 +159,7 @@ typedef struct garmin_parser_t {
 		unsigned int profile;
 		unsigned int time;
 		int utc_offset, time_offset;
+		unsigned int ntimestamps;
 	} dive;
 
 	// I count nine (!) different GPS fields Hmm.
@@ -191,6 +245,12 @@ static void garmin_event(struct garmin_parser_t *garmin,
 	}
 }
 
+// Only formatted when the string is actually requested.
+static void format_deco_model(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "Buhlmann ZHL-16C %u/%u", arg >> 8, arg & 0xFF);
+}
+
 /*
  * Some data isn't just something we can save off directly: it's a record with
  * multiple fields where one field describes another.
@@ -220,7 +280,7 @@ static void flush_pending_record(struct garmin_parser_t *garmin)
 			garmin->dive.product = record->product;
 		}
 		if (pending & RECORD_DECO_MODEL)
-			dc_field_add_string_fmt(&garmin->cache, "Deco model", "Buhlmann ZHL-16C %u/%u", record->gf_low, record->gf_high);
+			dc_field_add_string_lazy(&garmin->cache, "Deco model", format_deco_model, NULL, (record->gf_low << 8) | record->gf_high);
 		return;
 	}
 
@@ -243,6 +303,7 @@ static dc_status_t garmin_parser_set_data (dc_parser_t *abstract, const unsigned
 static dc_status_t garmin_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t garmin_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t garmin_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t garmin_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract);
 
 static const dc_parser_vtable_t garmin_parser_vtable = {
 	sizeof(garmin_parser_t),
@@ -251,7 +312,8 @@ static const dc_parser_vtable_t garmin_parser_vtable = {
 	garmin_parser_get_datetime, /* datetime */
 	garmin_parser_get_field, /* fields */
 	garmin_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	NULL, /* destroy */
+	garmin_parser_clone /* clone */
 };
 
 dc_status_t
@@ -269,11 +331,49 @@ garmin_parser_create (dc_parser_t **out, dc_context_t *context)
 		return DC_STATUS_NOMEMORY;
 	}
 
+	dc_field_cache_init(&parser->cache);
+
 	*out = (dc_parser_t *) parser;
 
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+garmin_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract)
+{
+	garmin_parser_t *parser = (garmin_parser_t *) clone;
+
+	dc_field_cache_rebase (&parser->cache, abstract, clone, abstract->vtable->size);
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+garmin_parser_probe_format (const unsigned char data[], unsigned int size)
+{
+	// The FIT file is prefixed with the filename, and its header
+	// contains the ".FIT" signature.
+	if (size < FIT_NAME_SIZE + 12)
+		return 0;
+
+	const unsigned char *fit = data + FIT_NAME_SIZE;
+	if (memcmp (fit + 8, ".FIT", 4) != 0)
+		return 0;
+
+	unsigned int hdrsize = fit[0];
+	unsigned int datasize = array_uint32_le (fit + 4);
+	if (hdrsize < 12)
+		return 0;
+
+	// Check the data size for consistency.
+	unsigned int available = size - FIT_NAME_SIZE;
+	if (hdrsize <= available && datasize <= available - hdrsize &&
+		available - hdrsize - datasize >= 2)
+		return 100;
+
+	return 50;
+}
+
 #define DECLARE_FIT_TYPE(name, ctype, inval) \
 	typedef ctype name;	\
 	static const name name##_INVAL = inval
@@ -330,13 +430,27 @@ static const struct {
  *
  * So instead, we try to make sense of it manually.
  */
+/*
+ * Field projection.
+ *
+ * The data is walked twice: once without a callback, to fill in the
+ * summary fields, and once for every sample walk. Each field declares
+ * which of those walks need it: FIELD_SUMMARY for the first walk, and
+ * the mask of the sample types it produces for the sample walks. The
+ * other fields, and the records without any needed field, are skipped
+ * by their size without decoding them.
+ */
+#define FIELD_SUMMARY (1u << 31)
+
 struct field_desc {
 	const char *name;
+	unsigned int mask;
 	void (*parse)(struct garmin_parser_t *, unsigned char base_type, const unsigned char *data);
 };
 
-#define DECLARE_FIELD(msg, name, type) __DECLARE_FIELD(msg##_##name, type)
-#define __DECLARE_FIELD(name, type) \
+#define DECLARE_FIELD(msg, name, type) __DECLARE_FIELD(msg##_##name, type, FIELD_SUMMARY)
+#define DECLARE_SAMPLE_FIELD(msg, name, type, mask) __DECLARE_FIELD(msg##_##name, type, mask)
+#define __DECLARE_FIELD(name, type, mask) \
 	static void parse_##name(struct garmin_parser_t *, const type); \
 	static void parse_##name##_##type(struct garmin_parser_t *g, unsigned char base_type, const unsigned char *p) \
 	{ \
@@ -347,13 +461,13 @@ struct field_desc {
 		DEBUG(g->base.context, "%s (%s): %lld", #name, #type, (long long)val); \
 		parse_##name(g, *(type *)p); \
 	} \
-	static const struct field_desc name##_field_##type = { #name, parse_##name##_##type }; \
+	static const struct field_desc name##_field_##type = { #name, mask, parse_##name##_##type }; \
 	static void parse_##name(struct garmin_parser_t *garmin, type data)
 
 // All msg formats can have a timestamp
 // Garmin timestamps are in seconds since 00:00 Dec 31 1989 UTC
 // Convert to "standard epoch time" by adding 631065600.
-DECLARE_FIELD(ANY, timestamp, UINT32)
+DECLARE_SAMPLE_FIELD(ANY, timestamp, UINT32, FIELD_SUMMARY | DC_SAMPLE_MASK(DC_SAMPLE_TIME))
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -371,6 +485,11 @@ DECLARE_FIELD(ANY, timestamp, UINT32)
 		garmin->record_data.time = data+1;
 		sample.time = data;
 		garmin->callback(DC_SAMPLE_TIME, sample, garmin->userdata);
+	} else {
+		// Every timestamp results in at most one sample. The start
+		// of the dive is only known at the end of the first walk, so
+		// this is only an upper bound for the number of samples.
+		garmin->dive.ntimestamps++;
 	}
 }
 DECLARE_FIELD(ANY, message_index, UINT16)	{ garmin->record_data.index = data; }
@@ -411,7 +530,7 @@ DECLARE_FIELD(LAP, other_pos_long, SINT32)	{ garmin->gps.LAP.other.lon = data; }
 DECLARE_FIELD(RECORD, position_lat, SINT32)	{ garmin->gps.RECORD.lat = data; }
 DECLARE_FIELD(RECORD, position_long, SINT32)	{ garmin->gps.RECORD.lon = data; }
 DECLARE_FIELD(RECORD, altitude, UINT16) { }		// 5 *m + 500 ?
-DECLARE_FIELD(RECORD, heart_rate, UINT8)		// bpm
+DECLARE_SAMPLE_FIELD(RECORD, heart_rate, UINT8, DC_SAMPLE_MASK(DC_SAMPLE_HEARTBEAT))		// bpm
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -420,7 +539,7 @@ DECLARE_FIELD(RECORD, heart_rate, UINT8)		// bpm
 	}
 }
 DECLARE_FIELD(RECORD, distance, UINT32) { }		// Distance in 100 * m? WTF?
-DECLARE_FIELD(RECORD, temperature, SINT8)		// degrees C
+DECLARE_SAMPLE_FIELD(RECORD, temperature, SINT8, DC_SAMPLE_MASK(DC_SAMPLE_TEMPERATURE))		// degrees C
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -429,7 +548,7 @@ DECLARE_FIELD(RECORD, temperature, SINT8)		// degrees C
 	}
 }
 DECLARE_FIELD(RECORD, abs_pressure, UINT32) {}		// Pascal
-DECLARE_FIELD(RECORD, depth, UINT32)			// mm
+DECLARE_SAMPLE_FIELD(RECORD, depth, UINT32, DC_SAMPLE_MASK(DC_SAMPLE_DEPTH))			// mm
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -437,17 +556,17 @@ DECLARE_FIELD(RECORD, depth, UINT32)			// mm
 		garmin->callback(DC_SAMPLE_DEPTH, sample, garmin->userdata);
 	}
 }
-DECLARE_FIELD(RECORD, next_stop_depth, UINT32)		// mm
+DECLARE_SAMPLE_FIELD(RECORD, next_stop_depth, UINT32, DC_SAMPLE_MASK(DC_SAMPLE_DECO))		// mm
 {
 	garmin->record_data.pending |= RECORD_DECO;
 	garmin->record_data.ceiling = data / 1000.0;
 }
-DECLARE_FIELD(RECORD, next_stop_time, UINT32)		// seconds
+DECLARE_SAMPLE_FIELD(RECORD, next_stop_time, UINT32, DC_SAMPLE_MASK(DC_SAMPLE_DECO))		// seconds
 {
 	garmin->record_data.pending |= RECORD_DECO;
 	garmin->record_data.stop_time = data;
 }
-DECLARE_FIELD(RECORD, tts, UINT32)
+DECLARE_SAMPLE_FIELD(RECORD, tts, UINT32, DC_SAMPLE_MASK(DC_SAMPLE_TTS))
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -455,7 +574,7 @@ DECLARE_FIELD(RECORD, tts, UINT32)
 		garmin->callback(DC_SAMPLE_TTS, sample, garmin->userdata);
 	}
 }
-DECLARE_FIELD(RECORD, ndl, UINT32)			// s
+DECLARE_SAMPLE_FIELD(RECORD, ndl, UINT32, DC_SAMPLE_MASK(DC_SAMPLE_DECO))			// s
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -464,7 +583,7 @@ DECLARE_FIELD(RECORD, ndl, UINT32)			// s
 		garmin->callback(DC_SAMPLE_DECO, sample, garmin->userdata);
 	}
 }
-DECLARE_FIELD(RECORD, cns_load, UINT8)
+DECLARE_SAMPLE_FIELD(RECORD, cns_load, UINT8, DC_SAMPLE_MASK(DC_SAMPLE_CNS))
 {
 	if (garmin->callback) {
 		dc_sample_value_t sample = {0};
@@ -579,25 +698,26 @@ DECLARE_FIELD(DIVE_SETTINGS, heart_rate_source_type, ENUM) { }
 DECLARE_FIELD(DIVE_SETTINGS, hear_rate_device_type, UINT8) { }
 
 // EVENT
-DECLARE_FIELD(EVENT, event, ENUM)
+#define EVENT_MASK (DC_SAMPLE_MASK(DC_SAMPLE_EVENT) | DC_SAMPLE_MASK(DC_SAMPLE_GASMIX))
+DECLARE_SAMPLE_FIELD(EVENT, event, ENUM, EVENT_MASK)
 {
 	garmin->record_data.event_nr = data;
 	garmin->record_data.pending |= RECORD_EVENT;
 }
-DECLARE_FIELD(EVENT, type, ENUM)
+DECLARE_SAMPLE_FIELD(EVENT, type, ENUM, EVENT_MASK)
 {
 	garmin->record_data.event_type = data;
 	garmin->record_data.pending |= RECORD_EVENT;
 }
-DECLARE_FIELD(EVENT, data, UINT32)
+DECLARE_SAMPLE_FIELD(EVENT, data, UINT32, EVENT_MASK)
 {
 	garmin->record_data.event_data = data;
 }
-DECLARE_FIELD(EVENT, event_group, UINT8)
+DECLARE_SAMPLE_FIELD(EVENT, event_group, UINT8, EVENT_MASK)
 {
 	garmin->record_data.event_group = data;
 }
-DECLARE_FIELD(EVENT, unknown, UINT32)
+DECLARE_SAMPLE_FIELD(EVENT, unknown, UINT32, EVENT_MASK)
 {
 	garmin->record_data.event_unknown = data;
 }
@@ -817,28 +937,37 @@ static const struct {
 	SET_MESG(268, DIVE_SUMMARY),
 };
 
-#define MSG_NAME_LEN 16
-static const struct msg_desc *lookup_msg_desc(unsigned short msg, int local, const char **namep)
-{
-	static struct msg_desc local_array[16];
-	static char local_name[16][MSG_NAME_LEN];
-	struct msg_desc *desc;
-	char *name;
+static const struct msg_desc unknown_msg_desc = { 0 };
 
+static const struct msg_desc *lookup_msg_desc(unsigned short msg, struct type_desc *type)
+{
 	/* Do we have a real one? */
 	if (msg < C_ARRAY_SIZE(message_array) && message_array[msg].name) {
-		*namep = message_array[msg].name;
+		type->msg_name = message_array[msg].name;
 		return message_array[msg].desc;
 	}
 
 	/* If not, fake it */
-	desc = &local_array[local];
-	memset(desc, 0, sizeof(*desc));
+	snprintf(type->name, MSG_NAME_LEN, "msg-%d", msg);
+	type->msg_name = type->name;
+	return &unknown_msg_desc;
+}
 
-	name = local_name[local];
-	snprintf(name, MSG_NAME_LEN, "msg-%d", msg);
-	*namep = name;
-	return desc;
+static const struct field_desc *lookup_field_desc(const struct msg_desc *msg_desc, unsigned int field_nr)
+{
+	// Certain field numbers have fixed meaning across all messages
+	switch (field_nr) {
+	case 250:
+		return &ANY_part_index_field_UINT32;
+	case 253:
+		return &ANY_timestamp_field_UINT32;
+	case 254:
+		return &ANY_message_index_field_UINT16;
+	default:
+		if (field_nr < msg_desc->maxfield)
+			return msg_desc->field[field_nr];
+		return NULL;
+	}
 }
 
 static int traverse_compressed(struct garmin_parser_t *garmin,
@@ -917,90 +1046,68 @@ static int traverse_regular(struct garmin_parser_t *garmin,
 	const unsigned char *data, unsigned int size,
 	unsigned char type, unsigned int *timep)
 {
-	unsigned int total_len = 0;
-	struct type_desc *desc = garmin->type_desc + type;
-	const struct msg_desc *msg_desc = desc->msg_desc;
-	const char *msg_name = desc->msg_name;
+	const struct type_desc *desc = garmin->types[type];
 
-	if (!msg_desc) {
+	if (!desc || !desc->msg_desc) {
 		ERROR(garmin->base.context, "Uninitialized type descriptor %d\n", type);
 		return -1;
 	}
 
-	for (int i = 0; i < desc->nrfields; i++) {
-		const unsigned char *field = desc->fields[i];
-		unsigned int field_nr = field[0];
-		unsigned int len = field[1];
-		unsigned int base_type = field[2] & 0x7f;
-		const struct field_desc *field_desc;
-		unsigned int base_size;
+	if (size < desc->size) {
+		ERROR(garmin->base.context, "Data traversal size bigger than remaining data (%d vs %d)\n", desc->size, size);
+		return -1;
+	}
 
-		if (!len) {
-			ERROR(garmin->base.context, "field with zero length\n");
-			return -1;
-		}
+	const char *msg_name = desc->msg_name;
 
-		if (size < len) {
-			ERROR(garmin->base.context, "Data traversal size bigger than remaining data (%d vs %d)\n", len, size);
-			return -1;
-		}
+	// The summary walk, or the sample types requested by the caller.
+	unsigned int want = FIELD_SUMMARY;
+	if (garmin->callback)
+		want = garmin->base.activemask & ~FIELD_SUMMARY;
+
+	if (!(desc->mask & want)) {
+		dc_parser_skipped(&garmin->base);
+		goto done;
+	}
+
+	for (int i = 0; i < desc->nrplan; i++) {
+		const struct field_plan *plan = desc->plan + i;
+		const unsigned char *field = data + plan->offset;
 
-		if (base_type > 16) {
-			ERROR(garmin->base.context, "Unknown base type %d\n", base_type);
-			data += size;
-			len -= size;
-			total_len += size;
-			continue;
-		}
-		base_size = base_type_info[base_type].type_size;
-		if (len % base_size) {
-			ERROR(garmin->base.context, "Data traversal size not a multiple of base size (%d vs %d)\n", len, base_size);
-			return -1;
-		}
 		// String
-		if (base_type == 7) {
-			int string_len = strnlen(data, size);
-			if (string_len >= size) {
+		if (plan->base_type == 7) {
+			unsigned int remaining = size - plan->offset;
+			unsigned int string_len = strnlen((const char *) field, remaining);
+			if (string_len >= remaining) {
 				ERROR(garmin->base.context, "Data traversal string bigger than remaining data\n");
 				return -1;
 			}
-			if (len <= string_len) {
-				ERROR(garmin->base.context, "field length %d, string length %d\n", len, string_len + 1);
+			if (plan->len <= string_len) {
+				ERROR(garmin->base.context, "field length %d, string length %d\n", plan->len, string_len + 1);
 				return -1;
 			}
 		}
 
+		if (!(plan->mask & want))
+			continue;
 
-
-		// Certain field numbers have fixed meaning across all messages
-		switch (field_nr) {
-		case 250:
-			field_desc = &ANY_part_index_field_UINT32;
-			break;
-		case 253:
-			field_desc = &ANY_timestamp_field_UINT32;
-			break;
-		case 254:
-			field_desc = &ANY_message_index_field_UINT16;
-			break;
-		default:
-			field_desc = NULL;
-			if (field_nr < msg_desc->maxfield)
-				field_desc = msg_desc->field[field_nr];
-		}
-
-		if (field_desc) {
-			field_desc->parse(garmin, base_type, data);
+		if (plan->desc) {
+			plan->desc->parse(garmin, plan->base_type, field);
 		} else {
-			unknown_field(garmin, data, msg_name, field_nr, base_type, len);
+			unknown_field(garmin, field, msg_name, plan->field_nr, plan->base_type, plan->len);
 		}
+	}
 
-		data += len;
-		total_len += len;
-		size -= len;
+done:
+	if (desc->error) {
+		ERROR(garmin->base.context, "%s\n", desc->error);
+		return -1;
 	}
 
-	return total_len;
+	if (desc->skiprest)
+		return size;
+
+	return desc->size;
 }
 
 /*
@@ -1024,6 +1131,72 @@ static int traverse_regular(struct garmin_parser_t *garmin,
  *	- 1x number of developer definitions
  *	- 3 bytes each
  */
+static unsigned int def_hash(const unsigned char *data, unsigned int length)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static const struct type_desc *def_lookup(unsigned int hash, const unsigned char *data, unsigned int length)
+{
+	for (struct def_entry *entry = g_def_cache[hash % DEF_BUCKETS]; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->length == length &&
+			memcmp(entry->text, data, length) == 0)
+			return &entry->desc;
+	}
+	return NULL;
+}
+
+static const struct type_desc *def_intern(struct garmin_parser_t *garmin, unsigned int hash, const unsigned char *data, unsigned int length, const struct type_desc *desc)
+{
+	const struct type_desc *result = NULL;
+	struct def_entry *entry = NULL;
+
+	// Allocate the entry, the plan steps and the definition bytes in
+	// one block.
+	size_t size = offsetof(struct def_entry, desc.plan) + desc->nrplan * sizeof(struct field_plan) + length;
+	if (dc_parser_reserve(&garmin->base, size) != DC_STATUS_SUCCESS)
+		return desc;
+	entry = (struct def_entry *) malloc(size);
+	if (!entry)
+		return desc;
+
+	memcpy(&entry->desc, desc, offsetof(struct type_desc, plan) + desc->nrplan * sizeof(struct field_plan));
+	if (desc->msg_name == desc->name)
+		entry->desc.msg_name = entry->desc.name;
+
+	unsigned char *text = (unsigned char *) (entry->desc.plan + desc->nrplan);
+	memcpy(text, data, length);
+	entry->text = text;
+	entry->hash = hash;
+	entry->length = length;
+
+	dc_global_lock();
+	result = def_lookup(hash, data, length);
+	if (result == NULL && g_def_count < DEF_MAXCACHE) {
+		struct def_entry **bucket = g_def_cache + hash % DEF_BUCKETS;
+		entry->next = *bucket;
+		*bucket = entry;
+		g_def_count++;
+		result = &entry->desc;
+		entry = NULL;
+	}
+	dc_global_unlock();
+
+	if (entry) {
+		// Another parser interned the same definition first, or the
+		// table is full.
+		free(entry);
+	}
+
+	return result ? result : desc;
+}
+
 static int traverse_definition(struct garmin_parser_t *garmin,
 	const unsigned char *data, unsigned int size,
 	unsigned char record)
@@ -1033,12 +1206,16 @@ static int traverse_definition(struct garmin_parser_t *garmin,
 	struct type_desc *desc = garmin->type_desc + type;
 	int fields, devfields, len;
 
+	if (size < 5) {
+		ERROR(garmin->base.context, "Definition record bigger than remaining data\n");
+		return -1;
+	}
+
 	msg = array_uint16_le(data+2);
-	desc->msg_desc = lookup_msg_desc(msg, type, &desc->msg_name);
 	fields = data[4];
 
-	DEBUG(garmin->base.context, "Define local type %d: %02x %02x %04x %02x %s",
-		type, data[0], data[1], msg, fields, desc->msg_name);
+	DEBUG(garmin->base.context, "Define local type %d: %02x %02x %04x %02x",
+		type, data[0], data[1], msg, fields);
 
 	if (data[1]) {
 		ERROR(garmin->base.context, "Only handling little-endian definitions\n");
@@ -1049,8 +1226,11 @@ static int traverse_definition(struct garmin_parser_t *garmin,
 		ERROR(garmin->base.context, "Too many fields in description: %d (max %d)\n", fields, MAXFIELDS);
 		return -1;
 	}
-	desc->nrfields = fields;
 	len = 5 + fields*3;
+	if (size < len) {
+		ERROR(garmin->base.context, "Definition record bigger than remaining data\n");
+		return -1;
+	}
 	devfields = 0;
 	if (record & 0x20) {
 		devfields = data[len];
@@ -1059,12 +1239,83 @@ static int traverse_definition(struct garmin_parser_t *garmin,
 		return -1;
 	}
 
+	// Use the shared plan if the definition is already known.
+	unsigned int hash = def_hash(data, len);
+	dc_global_lock();
+	garmin->types[type] = def_lookup(hash, data, len);
+	dc_global_unlock();
+	if (garmin->types[type])
+		return len;
+
+	desc->msg_desc = lookup_msg_desc(msg, desc);
+	desc->nrplan = 0;
+	desc->size = 0;
+	desc->mask = 0;
+	desc->error = NULL;
+	desc->skiprest = 0;
+
+	/*
+	 * Compile the field definitions into a decode plan. Everything
+	 * that doesn't depend on the record contents is checked here,
+	 * once, rather than for every data record.
+	 *
+	 * Unknown fields only matter for the debug output, so without
+	 * logging they are left out of the plan altogether and get
+	 * skipped over as part of the record size. Strings always stay,
+	 * because their termination still has to be verified, in every
+	 * walk. Unknown fields are only logged in the summary walk.
+	 */
 	for (int i = 0; i < fields; i++) {
-		unsigned char *field = desc->fields[i];
-		memcpy(field, data + (5+i*3), 3);
+		const unsigned char *field = data + (5+i*3);
+		unsigned int field_nr = field[0];
+		unsigned int field_len = field[1];
+		unsigned int base_type = field[2] & 0x7f;
+		const struct field_desc *field_desc;
+
 		DEBUG(garmin->base.context, "  %d: %02x %02x %02x", i, field[0], field[1], field[2]);
+
+		if (desc->error || desc->skiprest)
+			continue;
+
+		if (!field_len) {
+			desc->error = "field with zero length";
+			continue;
+		}
+
+		if (base_type > 16) {
+			ERROR(garmin->base.context, "Unknown base type %d\n", base_type);
+			desc->skiprest = 1;
+			continue;
+		}
+
+		if (field_len % base_type_info[base_type].type_size) {
+			desc->error = "Data traversal size not a multiple of base size";
+			continue;
+		}
+
+		field_desc = lookup_field_desc(desc->msg_desc, field_nr);
+#ifndef ENABLE_LOGGING
+		if (!field_desc && base_type != 7) {
+			desc->size += field_len;
+			continue;
+		}
+#endif
+
+		desc->plan[desc->nrplan].desc = field_desc;
+		desc->plan[desc->nrplan].mask = field_desc ? field_desc->mask : FIELD_SUMMARY;
+		desc->plan[desc->nrplan].offset = desc->size;
+		desc->plan[desc->nrplan].field_nr = field_nr;
+		desc->plan[desc->nrplan].len = field_len;
+		desc->plan[desc->nrplan].base_type = base_type;
+		desc->mask |= desc->plan[desc->nrplan].mask;
+		if (base_type == 7)
+			desc->mask = ~0u;
+		desc->nrplan++;
+		desc->size += field_len;
 	}
 
+	garmin->types[type] = def_intern(garmin, hash, data, len, desc);
+
 	return len;
 }
 
@@ -1079,7 +1330,7 @@ traverse_data(struct garmin_parser_t *garmin)
 
 	// Reset the time and type descriptors before walking
 	memset(&garmin->record_data, 0, sizeof(garmin->record_data));
-	memset(garmin->type_desc, 0, sizeof(garmin->type_desc));
+	memset(garmin->types, 0, sizeof(garmin->types));
 
 	// The data starts with our filename fingerprint. Skip it.
 	if (len < FIT_NAME_SIZE)
@@ -1113,6 +1364,10 @@ traverse_data(struct garmin_parser_t *garmin)
 		unsigned char record = data[0];
 		int len;
 
+		dc_status_t rc = dc_parser_check_limits(&garmin->base);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		data++;
 		datasize--;
 
@@ -1130,7 +1385,7 @@ traverse_data(struct garmin_parser_t *garmin)
 		} else if (record & 0x40) {	// Definition record?
 			len = traverse_definition(garmin, data, datasize, record);
 		} else {			// Normal data record
-			len = traverse_regular(garmin, data, datasize, record, &time);
+			len = traverse_regular(garmin, data, datasize, record & 0xf, &time);
 		}
 		if (len <= 0 || len > datasize)
 			return DC_STATUS_IO;
@@ -1181,6 +1436,98 @@ static void add_gps_string(garmin_parser_t *garmin, const char *desc, struct pos
 	}
 }
 
+/*
+ * Walk the first messages of a FIT file, looking for the SPORT message,
+ * without setting up a parser. Only the record layout is decoded: the
+ * size of each data record follows from its definition, and only the
+ * sport field of the SPORT message is looked at.
+ */
+int
+garmin_parser_probe (const unsigned char *data, unsigned int size)
+{
+	struct {
+		unsigned int msg;
+		unsigned int size;
+		int sport;
+	} types[MAXTYPE];
+	unsigned int hdrsize, datasize;
+
+	memset(types, 0, sizeof(types));
+
+	if (size < FIT_NAME_SIZE + 12)
+		return 1;
+
+	data += FIT_NAME_SIZE;
+	size -= FIT_NAME_SIZE;
+
+	hdrsize = data[0];
+	datasize = array_uint32_le(data+4);
+	if (hdrsize < 12 || hdrsize > size || memcmp(data+8, ".FIT", 4))
+		return 1;
+
+	// Only the records within the probed data can be walked.
+	data += hdrsize;
+	size -= hdrsize;
+	if (datasize < size)
+		size = datasize;
+
+	while (size > 0) {
+		unsigned char record = data[0];
+		unsigned int len = 0;
+
+		data++;
+		size--;
+
+		if (record & 0x40 && !(record & 0x80)) {	// Definition record?
+			if (size < 5)
+				return 1;
+
+			unsigned int type = record & 0xf;
+			unsigned int nfields = data[4];
+			len = 5 + nfields * 3;
+			if (len > size)
+				return 1;
+
+			types[type].msg = data[1] ? array_uint16_be(data+2) : array_uint16_le(data+2);
+			types[type].size = 0;
+			types[type].sport = -1;
+			for (unsigned int i = 0; i < nfields; i++) {
+				const unsigned char *field = data + 5 + i * 3;
+				if (field[0] == 0 && field[1] == 1)
+					types[type].sport = types[type].size;
+				types[type].size += field[1];
+			}
+
+			if (record & 0x20) {	// Developer fields
+				if (len + 1 > size)
+					return 1;
+				unsigned int ndevfields = data[len];
+				len += 1;
+				if (len + ndevfields * 3 > size)
+					return 1;
+				for (unsigned int i = 0; i < ndevfields; i++)
+					types[type].size += data[len + i * 3 + 1];
+				len += ndevfields * 3;
+			}
+		} else {			// Normal or compressed data record
+			unsigned int type = (record & 0x80) ? (record >> 5) & 3 : record & 0xf;
+			len = types[type].size;
+			if (len == 0 || len > size)
+				return 1;
+			if (types[type].msg == 12 && types[type].sport >= 0) {
+				unsigned char sport = data[types[type].sport];
+				// Generic, diving or invalid.
+				return sport == 0 || sport == 53 || sport == 255;
+			}
+		}
+
+		data += len;
+		size -= len;
+	}
+
+	return 1;
+}
+
 int
 garmin_parser_is_dive (dc_parser_t *abstract, const unsigned char *data, unsigned int size, dc_event_devinfo_t *devinfo_p)
 {
@@ -1221,7 +1568,7 @@ garmin_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsign
 	garmin->userdata = NULL;
 	memset(&garmin->gps, 0, sizeof(garmin->gps));
 	memset(&garmin->dive, 0, sizeof(garmin->dive));
-	memset(&garmin->cache, 0, sizeof(garmin->cache));
+	dc_field_cache_clear(&garmin->cache);
 
 	traverse_data(garmin);
 	// These seem to be the "real" GPS dive coordinates
@@ -1278,7 +1625,7 @@ garmin_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned i
 		type = DC_FIELD_GASMIX_COUNT;
 
 	/* This whole sequence should be standardized */
-	if (!(garmin->cache.initialized & (1 << type)))
+	if (type != DC_FIELD_SAMPLE_CAPACITY && !(garmin->cache.initialized & (1 << type)))
 		return DC_STATUS_UNSUPPORTED;
 
 	switch (type) {
@@ -1304,6 +1651,9 @@ garmin_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned i
 		return DC_STATUS_UNSUPPORTED;
 	case DC_FIELD_STRING:
 		return dc_field_get_string(&garmin->cache, flags, (dc_field_string_t *)value);
+	case DC_FIELD_SAMPLE_CAPACITY:
+		*((unsigned int *) value) = garmin->dive.ntimestamps;
+		return DC_STATUS_SUCCESS;
 	default:
 		return DC_STATUS_UNSUPPORTED;
 	}
@@ -0,0 +1,286 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "hash.h"
+#include "array.h"
+
+#define ROTL64(x,n) (((x) << (n)) | ((x) >> (64 - (n))))
+#define ROTR32(x,n) ((((x) >> (n)) | ((x) << (32 - (n)))) & 0xFFFFFFFF)
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static unsigned long long
+hash_xxh64_read64 (const unsigned char data[])
+{
+	return ((unsigned long long) array_uint32_le (data + 4) << 32) |
+		array_uint32_le (data);
+}
+
+static unsigned long long
+hash_xxh64_round (unsigned long long acc, unsigned long long value)
+{
+	acc += value * PRIME64_2;
+	acc = ROTL64 (acc, 31);
+	acc *= PRIME64_1;
+	return acc;
+}
+
+static unsigned long long
+hash_xxh64_merge (unsigned long long acc, unsigned long long value)
+{
+	acc ^= hash_xxh64_round (0, value);
+	acc = acc * PRIME64_1 + PRIME64_4;
+	return acc;
+}
+
+static void
+hash_xxh64_stripe (hash_xxh64_t *hash, const unsigned char data[])
+{
+	hash->v[0] = hash_xxh64_round (hash->v[0], hash_xxh64_read64 (data));
+	hash->v[1] = hash_xxh64_round (hash->v[1], hash_xxh64_read64 (data + 8));
+	hash->v[2] = hash_xxh64_round (hash->v[2], hash_xxh64_read64 (data + 16));
+	hash->v[3] = hash_xxh64_round (hash->v[3], hash_xxh64_read64 (data + 24));
+}
+
+void
+hash_xxh64_init (hash_xxh64_t *hash, unsigned long long seed)
+{
+	hash->v[0] = seed + PRIME64_1 + PRIME64_2;
+	hash->v[1] = seed + PRIME64_2;
+	hash->v[2] = seed;
+	hash->v[3] = seed - PRIME64_1;
+	hash->seed = seed;
+	hash->total = 0;
+	hash->count = 0;
+}
+
+void
+hash_xxh64_update (hash_xxh64_t *hash, const unsigned char data[], unsigned int size)
+{
+	hash->total += size;
+
+	// Complete the pending stripe first.
+	if (hash->count) {
+		unsigned int n = sizeof (hash->buffer) - hash->count;
+		if (n > size)
+			n = size;
+		memcpy (hash->buffer + hash->count, data, n);
+		hash->count += n;
+		data += n;
+		size -= n;
+
+		if (hash->count < sizeof (hash->buffer))
+			return;
+
+		hash_xxh64_stripe (hash, hash->buffer);
+		hash->count = 0;
+	}
+
+	while (size >= sizeof (hash->buffer)) {
+		hash_xxh64_stripe (hash, data);
+		data += sizeof (hash->buffer);
+		size -= sizeof (hash->buffer);
+	}
+
+	memcpy (hash->buffer, data, size);
+	hash->count = size;
+}
+
+unsigned long long
+hash_xxh64_final (const hash_xxh64_t *hash)
+{
+	unsigned long long h = 0;
+
+	if (hash->total >= sizeof (hash->buffer)) {
+		h = ROTL64 (hash->v[0], 1) + ROTL64 (hash->v[1], 7) +
+			ROTL64 (hash->v[2], 12) + ROTL64 (hash->v[3], 18);
+		h = hash_xxh64_merge (h, hash->v[0]);
+		h = hash_xxh64_merge (h, hash->v[1]);
+		h = hash_xxh64_merge (h, hash->v[2]);
+		h = hash_xxh64_merge (h, hash->v[3]);
+	} else {
+		h = hash->seed + PRIME64_5;
+	}
+
+	h += hash->total;
+
+	// Process the remaining bytes.
+	const unsigned char *p = hash->buffer;
+	unsigned int n = hash->count;
+	while (n >= 8) {
+		h ^= hash_xxh64_round (0, hash_xxh64_read64 (p));
+		h = ROTL64 (h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+		n -= 8;
+	}
+	if (n >= 4) {
+		h ^= (unsigned long long) array_uint32_le (p) * PRIME64_1;
+		h = ROTL64 (h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+		n -= 4;
+	}
+	while (n > 0) {
+		h ^= *p * PRIME64_5;
+		h = ROTL64 (h, 11) * PRIME64_1;
+		p++;
+		n--;
+	}
+
+	// Final avalanche.
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+static const unsigned int sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void
+hash_sha256_block (hash_sha256_t *hash, const unsigned char data[])
+{
+	unsigned int w[64];
+	for (unsigned int i = 0; i < 16; ++i)
+		w[i] = array_uint32_be (data + i * 4);
+	for (unsigned int i = 16; i < 64; ++i) {
+		unsigned int s0 = ROTR32 (w[i - 15], 7) ^ ROTR32 (w[i - 15], 18) ^ (w[i - 15] >> 3);
+		unsigned int s1 = ROTR32 (w[i - 2], 17) ^ ROTR32 (w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = (w[i - 16] + s0 + w[i - 7] + s1) & 0xFFFFFFFF;
+	}
+
+	unsigned int a = hash->state[0], b = hash->state[1];
+	unsigned int c = hash->state[2], d = hash->state[3];
+	unsigned int e = hash->state[4], f = hash->state[5];
+	unsigned int g = hash->state[6], h = hash->state[7];
+
+	for (unsigned int i = 0; i < 64; ++i) {
+		unsigned int s1 = ROTR32 (e, 6) ^ ROTR32 (e, 11) ^ ROTR32 (e, 25);
+		unsigned int ch = (e & f) ^ (~e & g);
+		unsigned int t1 = (h + s1 + ch + sha256_k[i] + w[i]) & 0xFFFFFFFF;
+		unsigned int s0 = ROTR32 (a, 2) ^ ROTR32 (a, 13) ^ ROTR32 (a, 22);
+		unsigned int maj = (a & b) ^ (a & c) ^ (b & c);
+		unsigned int t2 = (s0 + maj) & 0xFFFFFFFF;
+
+		h = g;
+		g = f;
+		f = e;
+		e = (d + t1) & 0xFFFFFFFF;
+		d = c;
+		c = b;
+		b = a;
+		a = (t1 + t2) & 0xFFFFFFFF;
+	}
+
+	hash->state[0] = (hash->state[0] + a) & 0xFFFFFFFF;
+	hash->state[1] = (hash->state[1] + b) & 0xFFFFFFFF;
+	hash->state[2] = (hash->state[2] + c) & 0xFFFFFFFF;
+	hash->state[3] = (hash->state[3] + d) & 0xFFFFFFFF;
+	hash->state[4] = (hash->state[4] + e) & 0xFFFFFFFF;
+	hash->state[5] = (hash->state[5] + f) & 0xFFFFFFFF;
+	hash->state[6] = (hash->state[6] + g) & 0xFFFFFFFF;
+	hash->state[7] = (hash->state[7] + h) & 0xFFFFFFFF;
+}
+
+void
+hash_sha256_init (hash_sha256_t *hash)
+{
+	hash->state[0] = 0x6a09e667;
+	hash->state[1] = 0xbb67ae85;
+	hash->state[2] = 0x3c6ef372;
+	hash->state[3] = 0xa54ff53a;
+	hash->state[4] = 0x510e527f;
+	hash->state[5] = 0x9b05688c;
+	hash->state[6] = 0x1f83d9ab;
+	hash->state[7] = 0x5be0cd19;
+	hash->total = 0;
+	hash->count = 0;
+}
+
+void
+hash_sha256_update (hash_sha256_t *hash, const unsigned char data[], unsigned int size)
+{
+	hash->total += size;
+
+	// Complete the pending block first.
+	if (hash->count) {
+		unsigned int n = sizeof (hash->buffer) - hash->count;
+		if (n > size)
+			n = size;
+		memcpy (hash->buffer + hash->count, data, n);
+		hash->count += n;
+		data += n;
+		size -= n;
+
+		if (hash->count < sizeof (hash->buffer))
+			return;
+
+		hash_sha256_block (hash, hash->buffer);
+		hash->count = 0;
+	}
+
+	while (size >= sizeof (hash->buffer)) {
+		hash_sha256_block (hash, data);
+		data += sizeof (hash->buffer);
+		size -= sizeof (hash->buffer);
+	}
+
+	memcpy (hash->buffer, data, size);
+	hash->count = size;
+}
+
+void
+hash_sha256_final (hash_sha256_t *hash, unsigned char digest[HASH_SHA256_SIZE])
+{
+	unsigned long long bits = hash->total * 8;
+
+	// Append the padding and the message length in bits.
+	hash->buffer[hash->count++] = 0x80;
+	if (hash->count > sizeof (hash->buffer) - 8) {
+		memset (hash->buffer + hash->count, 0, sizeof (hash->buffer) - hash->count);
+		hash_sha256_block (hash, hash->buffer);
+		hash->count = 0;
+	}
+	memset (hash->buffer + hash->count, 0, sizeof (hash->buffer) - 8 - hash->count);
+	array_uint32_be_set (hash->buffer + 56, bits >> 32);
+	array_uint32_be_set (hash->buffer + 60, bits & 0xFFFFFFFF);
+	hash_sha256_block (hash, hash->buffer);
+	hash->count = 0;
+
+	for (unsigned int i = 0; i < 8; ++i)
+		array_uint32_be_set (digest + i * 4, hash->state[i]);
+}
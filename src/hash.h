@@ -0,0 +1,77 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Incremental hash functions. The data can be passed in pieces of any
+ * size, and the result is the same as for the concatenated data.
+ *
+ * The fast hash is XXH64, a non-cryptographic hash suitable for
+ * detecting duplicates. SHA-256 is available for callers that need a
+ * collision resistant digest.
+ */
+
+#define HASH_SHA256_SIZE 32
+
+typedef struct hash_xxh64_t {
+	unsigned long long v[4];
+	unsigned long long seed;
+	unsigned long long total;
+	unsigned char buffer[32];
+	unsigned int count;
+} hash_xxh64_t;
+
+typedef struct hash_sha256_t {
+	unsigned int state[8];
+	unsigned long long total;
+	unsigned char buffer[64];
+	unsigned int count;
+} hash_sha256_t;
+
+void
+hash_xxh64_init (hash_xxh64_t *hash, unsigned long long seed);
+
+void
+hash_xxh64_update (hash_xxh64_t *hash, const unsigned char data[], unsigned int size);
+
+unsigned long long
+hash_xxh64_final (const hash_xxh64_t *hash);
+
+void
+hash_sha256_init (hash_sha256_t *hash);
+
+void
+hash_sha256_update (hash_sha256_t *hash, const unsigned char data[], unsigned int size);
+
+void
+hash_sha256_final (hash_sha256_t *hash, unsigned char digest[HASH_SHA256_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* HASH_H */
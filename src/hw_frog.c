@@ -20,7 +20,6 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
 
 #include "hw_frog.h"
 #include "context-private.h"
@@ -35,8 +34,9 @@
 #define SZ_CUSTOMTEXT 13
 #define SZ_VERSION    (SZ_CUSTOMTEXT + 4)
 
-#define RB_LOGBOOK_SIZE  256
-#define RB_LOGBOOK_COUNT 256
+#define RB_LOGBOOK_SIZE_COMPACT 16
+#define RB_LOGBOOK_SIZE_FULL    256
+#define RB_LOGBOOK_COUNT        256
 
 #define RB_PROFILE_BEGIN 0x000000
 #define RB_PROFILE_END   0x200000
@@ -48,6 +48,7 @@
 #define CUSTOMTEXT 0x63
 #define DIVE       0x66
 #define IDENTITY   0x69
+#define COMPACT    0x6D
 #define DISPLAY    0x6E
 #define INIT       0xBB
 #define EXIT       0xFF
@@ -58,6 +59,14 @@ typedef struct hw_frog_device_t {
 	unsigned char fingerprint[5];
 } hw_frog_device_t;
 
+typedef struct hw_frog_logbook_t {
+	unsigned int size;
+	unsigned int begin;
+	unsigned int end;
+	unsigned int fingerprint;
+	unsigned int number;
+} hw_frog_logbook_t;
+
 static dc_status_t hw_frog_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
 static dc_status_t hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
 static dc_status_t hw_frog_device_timesync (dc_device_t *abstract, const dc_datetime_t *datetime);
@@ -70,11 +79,29 @@ static const dc_device_vtable_t hw_frog_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	hw_frog_device_foreach, /* foreach */
+	NULL, /* extract */
 	hw_frog_device_timesync, /* timesync */
 	hw_frog_device_close /* close */
 };
 
+static const hw_frog_logbook_t hw_frog_logbook_compact = {
+	RB_LOGBOOK_SIZE_COMPACT, /* size */
+	0,  /* begin */
+	3,  /* end */
+	6,  /* fingerprint */
+	11, /* number */
+};
+
+static const hw_frog_logbook_t hw_frog_logbook_full = {
+	RB_LOGBOOK_SIZE_FULL, /* size */
+	2,  /* begin */
+	5,  /* end */
+	9,  /* fingerprint */
+	52, /* number */
+};
+
 
 static int
 hw_frog_strncpy (unsigned char *data, unsigned int size, const char *text)
@@ -130,6 +157,11 @@ hw_frog_transfer (hw_frog_device_t *device,
 
 		// Verify the echo.
 		if (memcmp (answer, command, sizeof (command)) != 0) {
+			if (answer[0] == READY) {
+				// Older firmware versions answer unknown commands
+				// with only the ready byte.
+				return DC_STATUS_UNSUPPORTED;
+			}
 			ERROR (abstract->context, "Unexpected echo.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -314,7 +346,7 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT) +
+	progress.maximum = (RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT) +
 		(RB_PROFILE_END - RB_PROFILE_BEGIN);
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
@@ -333,22 +365,51 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	devinfo.serial = array_uint16_le (id + 0);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory.
-	unsigned char *header = (unsigned char *) malloc (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT);
+	// Allocate memory for the compact logbook headers only. The full
+	// header of each new dive is already part of its profile data.
+	unsigned char *header = (unsigned char *) dc_context_malloc (abstract->context, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
 	if (header == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Download the logbook headers.
-	rc = hw_frog_transfer (device, &progress, HEADER,
-              NULL, 0, header, RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT);
+	device_progress_phase (abstract, DC_PROGRESS_LOGBOOK, 0, 0);
+
+	// Download the compact logbook headers. If the firmware doesn't support
+	// compact headers yet, fallback to downloading the full logbook headers.
+	// This is slower, but also works for older firmware versions.
+	unsigned int compact = 1;
+	rc = hw_frog_transfer (device, &progress, COMPACT,
+              NULL, 0, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
+	if (rc == DC_STATUS_UNSUPPORTED) {
+		compact = 0;
+
+		// Grow the buffer for the full logbook headers.
+		unsigned char *full = (unsigned char *) dc_context_realloc (abstract->context, header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+		if (full == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			dc_context_dealloc (abstract->context, header);
+			return DC_STATUS_NOMEMORY;
+		}
+		header = full;
+
+		rc = hw_frog_transfer (device, &progress, HEADER,
+		          NULL, 0, header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the header.");
-		free (header);
+		dc_context_dealloc (abstract->context, header);
 		return rc;
 	}
 
+	// Get the correct logbook layout.
+	const hw_frog_logbook_t *logbook = NULL;
+	if (compact) {
+		logbook = &hw_frog_logbook_compact;
+	} else {
+		logbook = &hw_frog_logbook_full;
+	}
+
 	// Locate the most recent dive.
 	// The device maintains an internal counter which is incremented for every
 	// dive, and the current value at the time of the dive is stored in the
@@ -357,14 +418,14 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	unsigned int latest = 0;
 	unsigned int maximum = 0;
 	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
-		unsigned int offset = i * RB_LOGBOOK_SIZE;
+		unsigned int offset = i * logbook->size;
 
 		// Ignore uninitialized header entries.
-		if (array_isequal (header + offset, RB_LOGBOOK_SIZE, 0xFF))
+		if (array_isequal (header + offset, logbook->size, 0xFF))
 			break;
 
 		// Get the internal dive number.
-		unsigned int current = array_uint16_le (header + offset + 52);
+		unsigned int current = array_uint16_le (header + offset + logbook->number);
 		if (current > maximum) {
 			maximum = current;
 			latest = i;
@@ -373,96 +434,104 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		count++;
 	}
 
-	// Calculate the total and maximum size.
+	// Walk the headers from newest to oldest, up to the fingerprint, and
+	// calculate the total and maximum size of the new dives.
 	unsigned int ndives = 0;
 	unsigned int size = 0;
 	unsigned int maxsize = 0;
+	unsigned char dive[RB_LOGBOOK_COUNT] = {0};
+	unsigned int length[RB_LOGBOOK_COUNT] = {0};
 	for (unsigned int i = 0; i < count; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
-		unsigned int offset = idx * RB_LOGBOOK_SIZE;
+		unsigned int offset = idx * logbook->size;
 
 		// Get the ringbuffer pointers.
-		unsigned int begin = array_uint24_le (header + offset + 2);
-		unsigned int end   = array_uint24_le (header + offset + 5);
+		unsigned int begin = array_uint24_le (header + offset + logbook->begin);
+		unsigned int end   = array_uint24_le (header + offset + logbook->end);
 		if (begin < RB_PROFILE_BEGIN ||
 			begin >= RB_PROFILE_END ||
 			end < RB_PROFILE_BEGIN ||
 			end >= RB_PROFILE_END)
 		{
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).", begin, end);
-			free (header);
+			dc_context_dealloc (abstract->context, header);
 			return DC_STATUS_DATAFORMAT;
 		}
 
-		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE + RB_PROFILE_DISTANCE (begin, end) - 6;
-
 		// Check the fingerprint data.
-		if (memcmp (header + offset + 9, device->fingerprint, sizeof (device->fingerprint)) == 0)
+		if (memcmp (header + offset + logbook->fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
 
-		if (length > maxsize)
-			maxsize = length;
-		size += length;
+		// Calculate the profile length.
+		length[ndives] = RB_LOGBOOK_SIZE_FULL + RB_PROFILE_DISTANCE (begin, end) - 6;
+
+		if (length[ndives] > maxsize)
+			maxsize = length[ndives];
+		size += length[ndives];
+		dive[ndives] = idx;
 		ndives++;
 	}
 
 	// Update and emit a progress event.
-	progress.maximum = (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT) + size;
+	progress.maximum = (logbook->size * RB_LOGBOOK_COUNT) + size;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Finish immediately if there are no dives available.
 	if (ndives == 0) {
-		free (header);
+		dc_context_dealloc (abstract->context, header);
 		return DC_STATUS_SUCCESS;
 	}
 
 	// Allocate enough memory for the largest dive.
-	unsigned char *profile = (unsigned char *) malloc (maxsize);
+	unsigned char *profile = (unsigned char *) dc_context_malloc (abstract->context, maxsize);
 	if (profile == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
-		free (header);
+		dc_context_dealloc (abstract->context, header);
 		return DC_STATUS_NOMEMORY;
 	}
 
 	// Download the dives.
 	for (unsigned int i = 0; i < ndives; ++i) {
-		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
-		unsigned int offset = idx * RB_LOGBOOK_SIZE;
-
-		// Get the ringbuffer pointers.
-		unsigned int begin = array_uint24_le (header + offset + 2);
-		unsigned int end   = array_uint24_le (header + offset + 5);
+		unsigned int idx = dive[i];
+		unsigned int offset = idx * logbook->size;
 
-		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE + RB_PROFILE_DISTANCE (begin, end) - 6;
+		device_progress_phase (abstract, DC_PROGRESS_PROFILE, i + 1, ndives);
 
 		// Download the dive.
 		unsigned char number[1] = {idx};
 		rc = hw_frog_transfer (device, &progress, DIVE,
-			number, sizeof (number), profile, length);
+			number, sizeof (number), profile, length[i]);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
-			free (profile);
-			free (header);
+			dc_context_dealloc (abstract->context, profile);
+			dc_context_dealloc (abstract->context, header);
 			return rc;
 		}
 
-		// Verify the header in the logbook and profile are identical.
-		if (memcmp (profile, header + offset, RB_LOGBOOK_SIZE) != 0) {
+		// Verify the header in the logbook and profile are identical. For
+		// the compact headers, only the fields they contain are compared.
+		int mismatch = 0;
+		if (compact) {
+			mismatch =
+				memcmp (profile + hw_frog_logbook_full.begin, header + offset + logbook->begin, 3) != 0 ||
+				memcmp (profile + hw_frog_logbook_full.end, header + offset + logbook->end, 3) != 0 ||
+				memcmp (profile + hw_frog_logbook_full.fingerprint, header + offset + logbook->fingerprint, sizeof (device->fingerprint)) != 0;
+		} else {
+			mismatch = memcmp (profile, header + offset, logbook->size) != 0;
+		}
+		if (mismatch) {
 			ERROR (abstract->context, "Unexpected profile header.");
-			free (profile);
-			free (header);
-			return rc;
-
+			dc_context_dealloc (abstract->context, profile);
+			dc_context_dealloc (abstract->context, header);
+			return DC_STATUS_DATAFORMAT;
 		}
 
-		if (callback && !callback (profile, length, profile + 9, sizeof (device->fingerprint), userdata))
+		if (callback && !callback (profile, length[i], profile + hw_frog_logbook_full.fingerprint, sizeof (device->fingerprint), userdata))
 			break;
 	}
 
-	free (profile);
-	free (header);
+	dc_context_dealloc (abstract->context, profile);
+	dc_context_dealloc (abstract->context, header);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -35,6 +35,9 @@ extern "C" {
 dc_status_t
 hw_frog_device_open (dc_device_t **device, dc_context_t *context, dc_iostream_t *iostream);
 
+unsigned int
+hw_frog_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -20,10 +20,10 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
 
 #include "hw_ostc.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -78,7 +78,9 @@ static const dc_device_vtable_t hw_ostc_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	hw_ostc_device_dump, /* dump */
+	NULL, /* dump_update */
 	hw_ostc_device_foreach, /* foreach */
+	NULL, /* extract */
 	hw_ostc_device_timesync, /* timesync */
 	NULL /* close */
 };
@@ -281,7 +283,7 @@ hw_ostc_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 hw_ostc_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -646,6 +648,19 @@ hw_ostc_extract_dives (dc_device_t *abstract, const unsigned char data[], unsign
 }
 
 
+static void
+hw_ostc_firmware_mark (unsigned int address, unsigned int length, void *userdata)
+{
+	hw_ostc_firmware_t *firmware = (hw_ostc_firmware_t *) userdata;
+
+	// Mark the corresponding blocks in the bitmap.
+	unsigned int begin = address / SZ_BLOCK;
+	unsigned int end = (address + length + SZ_BLOCK - 1) / SZ_BLOCK;
+	for (unsigned int i = begin; i < end; ++i) {
+		firmware->bitmap[i] = 1;
+	}
+}
+
 static dc_status_t
 hw_ostc_firmware_readfile (hw_ostc_firmware_t *firmware, dc_context_t *context, const char *filename)
 {
@@ -669,39 +684,8 @@ hw_ostc_firmware_readfile (hw_ostc_firmware_t *firmware, dc_context_t *context,
 	}
 
 	// Read the hex file.
-	unsigned int lba = 0;
-	dc_ihex_entry_t entry;
-	while ((rc = dc_ihex_file_read (file, &entry)) == DC_STATUS_SUCCESS) {
-		if (entry.type == 0) {
-			// Data record.
-			unsigned int address = (lba << 16) + entry.address;
-			if (address + entry.length > SZ_FIRMWARE) {
-				WARNING (context, "Ignoring out of range record (0x%08x,%u).", address, entry.length);
-				continue;
-			}
-
-			// Copy the record to the buffer.
-			memcpy (firmware->data + address, entry.data, entry.length);
-
-			// Mark the corresponding blocks in the bitmap.
-			unsigned int begin = address / SZ_BLOCK;
-			unsigned int end = (address + entry.length + SZ_BLOCK - 1) / SZ_BLOCK;
-			for (unsigned int i = begin; i < end; ++i) {
-				firmware->bitmap[i] = 1;
-			}
-		} else if (entry.type == 1) {
-			// End of file record.
-			break;
-		} else if (entry.type == 4) {
-			// Extended linear address record.
-			lba = array_uint16_be (entry.data);
-		} else {
-			ERROR (context, "Unexpected record type.");
-			dc_ihex_file_close (file);
-			return DC_STATUS_DATAFORMAT;
-		}
-	}
-	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_DONE) {
+	rc = dc_ihex_file_load (file, firmware->data, SZ_FIRMWARE, hw_ostc_firmware_mark, firmware);
+	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to read the record.");
 		dc_ihex_file_close (file);
 		return rc;
@@ -856,7 +840,7 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		return DC_STATUS_INVALIDARGS;
 
 	// Allocate memory for the firmware data.
-	hw_ostc_firmware_t *firmware = (hw_ostc_firmware_t *) malloc (sizeof (hw_ostc_firmware_t));
+	hw_ostc_firmware_t *firmware = (hw_ostc_firmware_t *) dc_context_malloc (context, sizeof (hw_ostc_firmware_t));
 	if (firmware == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -866,7 +850,7 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 	rc = hw_ostc_firmware_readfile (firmware, context, filename);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to read the firmware file.");
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
@@ -877,7 +861,7 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 	rc = dc_iostream_set_timeout (device->iostream, 300);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to set the timeout.");
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
@@ -888,7 +872,7 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		rc = dc_iostream_configure (device->iostream, baudrates[i], 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to set the terminal attributes.");
-			free (firmware);
+			dc_context_dealloc (context, firmware);
 			return rc;
 		}
 
@@ -900,7 +884,7 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to setup the bootloader.");
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
@@ -908,17 +892,29 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 	rc = dc_iostream_set_timeout (device->iostream, 1000);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to set the timeout.");
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
+	// Count the blocks present in the hex file. Only those blocks are
+	// uploaded, so the progress is based on them.
+	unsigned int nblocks = 0;
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(firmware->bitmap); ++i) {
+		if (firmware->bitmap[i])
+			nblocks++;
+	}
+
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = C_ARRAY_SIZE(firmware->bitmap);
+	progress.maximum = nblocks;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	for (unsigned int i = 0; i < C_ARRAY_SIZE(firmware->bitmap); ++i) {
-		// Skip empty blocks.
+		// Skip empty blocks. Blocks which are present in the hex file are
+		// always written, even if they contain only 0xFF bytes. The
+		// bootloader erases and programs each block it receives, and
+		// can't read back the current firmware. Thus there is no way to
+		// tell whether the flash memory already contains the same data.
 		if (firmware->bitmap[i] == 0)
 			continue;
 
@@ -937,16 +933,16 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		rc = hw_ostc_firmware_write (device, packet, sizeof (packet));
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to send the packet.");
-			free (firmware);
+			dc_context_dealloc (context, firmware);
 			return rc;
 		}
 
 		// Update and emit a progress event.
-		progress.current = i + 1;
+		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
-	free (firmware);
+	dc_context_dealloc (context, firmware);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -38,6 +38,9 @@ hw_ostc_device_open (dc_device_t **device, dc_context_t *context, dc_iostream_t
 dc_status_t
 hw_ostc_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int serial);
 
+unsigned int
+hw_ostc_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
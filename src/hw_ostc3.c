@@ -26,6 +26,7 @@
 
 #include "hw_ostc3.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 #include "aes.h"
@@ -39,13 +40,15 @@
 #define SZ_HARDWARE   1
 #define SZ_HARDWARE2  5
 #define SZ_MEMORY     0x400000
-#define SZ_CONFIG     4
+#define SZ_CONFIG     HW_OSTC3_CONFIG_SIZE
 #define SZ_FWINFO     4
 #define SZ_FIRMWARE   0x01E000        // 120KB
 #define SZ_FIRMWARE_BLOCK    0x1000   //   4KB
 #define SZ_FIRMWARE_BLOCK2   0x0100   //  256B
 #define FIRMWARE_AREA      0x3E0000
 
+#define DISPLAY_STEP 10 // Display update interval (percent)
+
 #define RB_LOGBOOK_SIZE_COMPACT  16
 #define RB_LOGBOOK_SIZE_FULL     256
 #define RB_LOGBOOK_COUNT 256
@@ -85,6 +88,9 @@
 #define NODELAY 0
 #define TIMEOUT 400
 
+// Maximum number of config commands sent without waiting for an answer.
+#define CONFIG_WINDOW 8
+
 typedef enum hw_ostc3_state_t {
 	OPEN,
 	DOWNLOAD,
@@ -144,7 +150,9 @@ static const dc_device_vtable_t hw_ostc3_device_vtable = {
 	hw_ostc3_device_read, /* read */
 	hw_ostc3_device_write, /* write */
 	hw_ostc3_device_dump, /* dump */
+	NULL, /* dump_update */
 	hw_ostc3_device_foreach, /* foreach */
+	NULL, /* extract */
 	hw_ostc3_device_timesync, /* timesync */
 	hw_ostc3_device_close /* close */
 };
@@ -268,14 +276,14 @@ hw_ostc3_write (hw_ostc3_device_t *device, dc_event_progress_t *progress, const
 }
 
 static dc_status_t
-hw_ostc3_transfer (hw_ostc3_device_t *device,
-                  dc_event_progress_t *progress,
-                  unsigned char cmd,
-                  const unsigned char input[],
-                  unsigned int isize,
-                  unsigned char output[],
-                  unsigned int osize,
-                  unsigned int delay)
+hw_ostc3_packet (hw_ostc3_device_t *device,
+                dc_event_progress_t *progress,
+                unsigned char cmd,
+                const unsigned char input[],
+                unsigned int isize,
+                unsigned char output[],
+                unsigned int osize,
+                unsigned int delay)
 {
 	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t status = DC_STATUS_SUCCESS;
@@ -354,6 +362,24 @@ hw_ostc3_transfer (hw_ostc3_device_t *device,
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+hw_ostc3_transfer (hw_ostc3_device_t *device,
+                  dc_event_progress_t *progress,
+                  unsigned char cmd,
+                  const unsigned char input[],
+                  unsigned int isize,
+                  unsigned char output[],
+                  unsigned int osize,
+                  unsigned int delay)
+{
+	dc_trace_span_t span;
+	TRACE_BEGIN (device->base.context, &span, cmd, isize, osize);
+	dc_status_t status = hw_ostc3_packet (device, progress, cmd, input, isize, output, osize, delay);
+	TRACE_END (device->base.context, &span, status);
+
+	return status;
+}
+
 
 dc_status_t
 hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_t *iostream)
@@ -675,13 +701,16 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory.
-	unsigned char *header = (unsigned char *) malloc (RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+	// Allocate memory for the compact logbook headers only. The full
+	// header of each new dive is already part of its profile data.
+	unsigned char *header = (unsigned char *) dc_context_malloc (abstract->context, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
 	if (header == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	device_progress_phase (abstract, DC_PROGRESS_LOGBOOK, 0, 0);
+
 	// Download the compact logbook headers. If the firmware doesn't support
 	// compact headers yet, fallback to downloading the full logbook headers.
 	// This is slower, but also works for older firmware versions.
@@ -690,12 +719,22 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
               NULL, 0, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT, NODELAY);
 	if (rc == DC_STATUS_UNSUPPORTED) {
 		compact = 0;
+
+		// Grow the buffer for the full logbook headers.
+		unsigned char *full = (unsigned char *) dc_context_realloc (abstract->context, header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+		if (full == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			dc_context_dealloc (abstract->context, header);
+			return DC_STATUS_NOMEMORY;
+		}
+		header = full;
+
 		rc = hw_ostc3_transfer (device, &progress, HEADER,
 		          NULL, 0, header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT, NODELAY);
 	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the header.");
-		free (header);
+		dc_context_dealloc (abstract->context, header);
 		return rc;
 	}
 
@@ -753,7 +792,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		}
 		if (length < RB_LOGBOOK_SIZE_FULL) {
 			ERROR (abstract->context, "Invalid profile length (%u bytes).", length);
-			free (header);
+			dc_context_dealloc (abstract->context, header);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -774,15 +813,15 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 
 	// Finish immediately if there are no dives available.
 	if (ndives == 0) {
-		free (header);
+		dc_context_dealloc (abstract->context, header);
 		return DC_STATUS_SUCCESS;
 	}
 
 	// Allocate enough memory for the largest dive.
-	unsigned char *profile = (unsigned char *) malloc (maxsize);
+	unsigned char *profile = (unsigned char *) dc_context_malloc (abstract->context, maxsize);
 	if (profile == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
-		free (header);
+		dc_context_dealloc (abstract->context, header);
 		return DC_STATUS_NOMEMORY;
 	}
 
@@ -800,22 +839,24 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 				length -= 3;
 		}
 
+		device_progress_phase (abstract, DC_PROGRESS_PROFILE, i + 1, ndives);
+
 		// Download the dive.
 		unsigned char number[1] = {idx};
 		rc = hw_ostc3_transfer (device, &progress, DIVE,
 			number, sizeof (number), profile, length, NODELAY);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
-			free (profile);
-			free (header);
+			dc_context_dealloc (abstract->context, profile);
+			dc_context_dealloc (abstract->context, header);
 			return rc;
 		}
 
 		// Verify the header in the logbook and profile are identical.
 		if (!compact && memcmp (profile, header + offset, logbook->size) != 0) {
 			ERROR (abstract->context, "Unexpected profile header.");
-			free (profile);
-			free (header);
+			dc_context_dealloc (abstract->context, profile);
+			dc_context_dealloc (abstract->context, header);
 			return rc;
 		}
 
@@ -843,8 +884,8 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 			break;
 	}
 
-	free (profile);
-	free (header);
+	dc_context_dealloc (abstract->context, profile);
+	dc_context_dealloc (abstract->context, header);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -984,6 +1025,149 @@ hw_ostc3_device_config_write (dc_device_t *abstract, unsigned int config, const
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+hw_ostc3_device_config_batch (hw_ostc3_device_t *device, unsigned char cmd, hw_ostc3_config_t configs[], unsigned int count)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char buffer[CONFIG_WINDOW * (2 + SZ_CONFIG)];
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (configs[i].id > 0xFF || (device->hardware == OSTC4 ? configs[i].size != SZ_CONFIG : configs[i].size > SZ_CONFIG)) {
+			ERROR (abstract->context, "Invalid parameter specified.");
+			return DC_STATUS_INVALIDARGS;
+		}
+	}
+
+	const unsigned char ready = (device->state == SERVICE ? S_READY : READY);
+
+	unsigned int offset = 0;
+	while (offset < count) {
+		if (device_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
+
+		unsigned int n = count - offset;
+		if (n > CONFIG_WINDOW)
+			n = CONFIG_WINDOW;
+
+		// Send all commands of the window back-to-back, without waiting
+		// for the echo and the ready byte of the previous command.
+		unsigned int len = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			const hw_ostc3_config_t *config = configs + offset + i;
+			buffer[len++] = cmd;
+			buffer[len++] = config->id;
+			if (cmd == WRITE) {
+				memcpy (buffer + len, config->data, config->size);
+				len += config->size;
+			}
+		}
+
+		dc_trace_span_t span;
+		TRACE_BEGIN (abstract->context, &span, cmd, len, n);
+
+		status = hw_ostc3_write (device, NULL, buffer, len);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the commands.");
+			goto error;
+		}
+
+		// Collect the answers in order.
+		for (unsigned int i = 0; i < n; ++i) {
+			hw_ostc3_config_t *config = configs + offset + i;
+
+			unsigned char echo[1] = {0};
+			status = hw_ostc3_read (device, NULL, echo, sizeof (echo));
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to receive the echo.");
+				goto error;
+			}
+
+			if (echo[0] != cmd) {
+				if (echo[0] == ready) {
+					ERROR (abstract->context, "Unsupported command.");
+					status = DC_STATUS_UNSUPPORTED;
+				} else {
+					ERROR (abstract->context, "Unexpected echo.");
+					status = DC_STATUS_PROTOCOL;
+				}
+				goto error;
+			}
+
+			if (cmd == READ) {
+				status = hw_ostc3_read (device, NULL, config->data, config->size);
+				if (status != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to receive the answer.");
+					goto error;
+				}
+			}
+
+			unsigned char answer[1] = {0};
+			status = hw_ostc3_read (device, NULL, answer, sizeof (answer));
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to receive the ready byte.");
+				goto error;
+			}
+
+			if (answer[0] != ready) {
+				ERROR (abstract->context, "Unexpected ready byte.");
+				status = DC_STATUS_PROTOCOL;
+				goto error;
+			}
+		}
+
+error:
+		TRACE_END (abstract->context, &span, status);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		offset += n;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+hw_ostc3_device_config_read_batch (dc_device_t *abstract, hw_ostc3_config_t configs[], unsigned int count)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (configs == NULL && count != 0) {
+		ERROR (abstract->context, "Invalid parameter specified.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	dc_status_t rc = hw_ostc3_device_init (device, DOWNLOAD);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return hw_ostc3_device_config_batch (device, READ, configs, count);
+}
+
+dc_status_t
+hw_ostc3_device_config_write_batch (dc_device_t *abstract, const hw_ostc3_config_t configs[], unsigned int count)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (configs == NULL && count != 0) {
+		ERROR (abstract->context, "Invalid parameter specified.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	dc_status_t rc = hw_ostc3_device_init (device, DOWNLOAD);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The configs are only read when writing.
+	return hw_ostc3_device_config_batch (device, WRITE, (hw_ostc3_config_t *) configs, count);
+}
+
 dc_status_t
 hw_ostc3_device_config_reset (dc_device_t *abstract)
 {
@@ -1085,8 +1269,6 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	FILE *fp = NULL;
 	unsigned char iv[16] = {0};
-	unsigned char tmpbuf[16] = {0};
-	unsigned char encrypted[16] = {0};
 	unsigned int bytes = 0, addr = 0;
 	unsigned char checksum[4];
 
@@ -1113,25 +1295,18 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 	}
 	bytes += 16;
 
-	// Load the iv for AES-FCB-mode
-	AES128_ECB_encrypt (iv, ostc3_key, tmpbuf);
-
 	for (addr = 0; addr < SZ_FIRMWARE; addr += 16, bytes += 16) {
-		rc = hw_ostc3_firmware_readline (fp, context, bytes, encrypted, sizeof(encrypted));
+		rc = hw_ostc3_firmware_readline (fp, context, bytes, firmware->data + addr, 16);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (context, "Failed to parse file data.");
 			fclose (fp);
 			return rc;
 		}
-
-		// Decrypt AES-FCB data
-		for (unsigned int i = 0; i < 16; i++)
-			firmware->data[addr + i] = encrypted[i] ^ tmpbuf[i];
-
-		// Run the next round of encryption
-		AES128_ECB_encrypt (encrypted, ostc3_key, tmpbuf);
 	}
 
+	// Decrypt the AES-CFB data in place.
+	AES128_CFB_decrypt_buffer (firmware->data, firmware->data, SZ_FIRMWARE, ostc3_key, iv);
+
 	// This file format contains a tail with the checksum in
 	rc = hw_ostc3_firmware_readline (fp, context, bytes, checksum, sizeof(checksum));
 	if (rc != DC_STATUS_SUCCESS) {
@@ -1332,7 +1507,7 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the firmware data.
-	hw_ostc3_firmware_t *firmware = (hw_ostc3_firmware_t *) malloc (sizeof (hw_ostc3_firmware_t));
+	hw_ostc3_firmware_t *firmware = (hw_ostc3_firmware_t *) dc_context_malloc (context, sizeof (hw_ostc3_firmware_t));
 	if (firmware == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -1341,7 +1516,7 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	// Read the hex file.
 	rc = hw_ostc3_firmware_readfile3 (firmware, context, filename);
 	if (rc != DC_STATUS_SUCCESS) {
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
@@ -1354,7 +1529,7 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA, SZ_FIRMWARE);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to erase old firmware");
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
@@ -1364,40 +1539,42 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 
 	hw_ostc3_device_display (abstract, " Uploading...");
 
+	// Every block is verified right after it has been written, instead
+	// of in a second pass over the entire image. The protocol doesn't
+	// allow overlapping commands, but this detects a failure early. The
+	// display is only updated in steps of a few percent, because every
+	// update is another round trip to the device.
+	unsigned int shown = 0;
 	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
-		char status[SZ_DISPLAY + 1]; // Status message on the display
-		snprintf (status, sizeof(status), " Uploading %2d%%", (100 * len) / SZ_FIRMWARE);
-		hw_ostc3_device_display (abstract, status);
+		unsigned char block[SZ_FIRMWARE_BLOCK];
+		unsigned int percent = (100 * len) / SZ_FIRMWARE;
+		if (percent >= shown + DISPLAY_STEP) {
+			char status[SZ_DISPLAY + 1]; // Status message on the display
+			snprintf (status, sizeof(status), " Uploading %2d%%", percent);
+			hw_ostc3_device_display (abstract, status);
+			shown = percent;
+		}
 
 		rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, firmware->data + len, SZ_FIRMWARE_BLOCK);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (context, "Failed to write block to device");
-			free(firmware);
+			dc_context_dealloc (context, firmware);
 			return rc;
 		}
 		// One block uploaded
 		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-	}
-
-	hw_ostc3_device_display (abstract, " Verifying...");
-
-	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
-		unsigned char block[SZ_FIRMWARE_BLOCK];
-		char status[SZ_DISPLAY + 1]; // Status message on the display
-		snprintf (status, sizeof(status), " Verifying %2d%%", (100 * len) / SZ_FIRMWARE);
-		hw_ostc3_device_display (abstract, status);
 
 		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (context, "Failed to read block.");
-			free (firmware);
+			dc_context_dealloc (context, firmware);
 			return rc;
 		}
 		if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
 			ERROR (context, "Failed verify.");
 			hw_ostc3_device_display (abstract, " Verify FAILED");
-			free (firmware);
+			dc_context_dealloc (context, firmware);
 			return DC_STATUS_PROTOCOL;
 		}
 		// One block verified
@@ -1410,7 +1587,7 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	rc = hw_ostc3_firmware_upgrade (abstract, firmware->checksum);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to start programing");
-		free (firmware);
+		dc_context_dealloc (context, firmware);
 		return rc;
 	}
 
@@ -1418,7 +1595,7 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	progress.current++;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	free (firmware);
+	dc_context_dealloc (context, firmware);
 
 	// Finished!
 	return DC_STATUS_SUCCESS;
@@ -1432,7 +1609,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
 	// Allocate memory for the firmware data.
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		status = DC_STATUS_NOMEMORY;
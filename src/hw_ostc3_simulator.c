@@ -0,0 +1,290 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h> // memcpy, memset
+
+#include "simulator-private.h"
+#include "context-private.h"
+#include "array.h"
+
+#define SZ_VERSION    64
+#define SZ_HARDWARE2  5
+#define SZ_CLOCK      6
+#define SZ_CUSTOMTEXT 60
+#define SZ_DISPLAY    16
+
+#define RB_LOGBOOK_SIZE_COMPACT  16
+#define RB_LOGBOOK_SIZE_FULL     256
+#define RB_LOGBOOK_COUNT         256
+
+#define KEY_HARDWARE 0x0000
+#define KEY_VERSION  0x0001
+#define KEY_DIVE     0x0100
+
+#define S_READY    0x4C
+#define READY      0x4D
+#define HARDWARE2  0x60
+#define HEADER     0x61
+#define CLOCK      0x62
+#define CUSTOMTEXT 0x63
+#define DIVE       0x66
+#define IDENTITY   0x69
+#define HARDWARE   0x6A
+#define DISPLAY    0x6E
+#define COMPACT    0x6D
+#define S_INIT     0xAA
+#define INIT       0xBB
+#define EXIT       0xFF
+
+typedef enum hw_ostc3_simulator_state_t {
+	OPEN,
+	DOWNLOAD,
+	SERVICE,
+} hw_ostc3_simulator_state_t;
+
+typedef struct hw_ostc3_simulator_t {
+	dc_simulator_protocol_t base;
+	hw_ostc3_simulator_state_t state;
+	unsigned char *data;
+	size_t size;
+	unsigned char hardware[SZ_HARDWARE2];
+	unsigned int have_hardware;
+	unsigned char version[SZ_VERSION];
+	unsigned char compact[RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT];
+	unsigned char full[RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT];
+	unsigned int pending;
+} hw_ostc3_simulator_t;
+
+static size_t hw_ostc3_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size);
+static void hw_ostc3_simulator_destroy (dc_simulator_protocol_t *abstract);
+
+static const dc_simulator_protocol_vtable_t hw_ostc3_simulator_vtable = {
+	sizeof(hw_ostc3_simulator_t),
+	hw_ostc3_simulator_process, /* process */
+	hw_ostc3_simulator_destroy, /* destroy */
+};
+
+dc_status_t
+hw_ostc3_simulator_create (dc_simulator_protocol_t **out, dc_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	hw_ostc3_simulator_t *protocol = NULL;
+
+	// Allocate memory.
+	protocol = (hw_ostc3_simulator_t *) dc_simulator_protocol_allocate (simulator, &hw_ostc3_simulator_vtable);
+	if (protocol == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	protocol->state = OPEN;
+	protocol->data = NULL;
+	protocol->size = size;
+	protocol->have_hardware = 0;
+	protocol->pending = 0;
+	memset (protocol->hardware, 0, sizeof (protocol->hardware));
+	memset (protocol->version, 0, sizeof (protocol->version));
+	memset (protocol->compact, 0xFF, sizeof (protocol->compact));
+	memset (protocol->full, 0xFF, sizeof (protocol->full));
+
+	// Build the logbook from the records.
+	size_t offset = 0;
+	dc_simulator_record_t record;
+	int rc = 0;
+	while ((rc = dc_simulator_record_next (data, size, &offset, &record)) > 0) {
+		if (record.key == KEY_HARDWARE && record.size == SZ_HARDWARE2) {
+			memcpy (protocol->hardware, record.data, SZ_HARDWARE2);
+			protocol->have_hardware = 1;
+		} else if (record.key == KEY_VERSION && record.size == SZ_VERSION) {
+			memcpy (protocol->version, record.data, SZ_VERSION);
+		} else if (record.key >= KEY_DIVE && record.key < KEY_DIVE + RB_LOGBOOK_COUNT &&
+			record.size >= RB_LOGBOOK_SIZE_FULL) {
+			unsigned int idx = record.key - KEY_DIVE;
+			unsigned char *full = protocol->full + idx * RB_LOGBOOK_SIZE_FULL;
+			unsigned char *compact = protocol->compact + idx * RB_LOGBOOK_SIZE_COMPACT;
+
+			// The compact header contains a subset of the full header:
+			// the profile length, the fingerprint and the dive number.
+			memcpy (full, record.data, RB_LOGBOOK_SIZE_FULL);
+			memset (compact, 0, RB_LOGBOOK_SIZE_COMPACT);
+			memcpy (compact + 0, full + 9, 3);
+			memcpy (compact + 3, full + 12, 5);
+			memcpy (compact + 13, full + 80, 2);
+		} else {
+			WARNING (protocol->base.context, "Ignored record %08x (%u bytes).", record.key, record.size);
+		}
+	}
+	if (rc < 0) {
+		ERROR (protocol->base.context, "Unexpected end of the records.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	protocol->data = (unsigned char *) dc_context_malloc (protocol->base.context, size ? size : 1);
+	if (protocol->data == NULL) {
+		ERROR (protocol->base.context, "Failed to allocate memory.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size)
+		memcpy (protocol->data, data, size);
+
+	*out = (dc_simulator_protocol_t *) protocol;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+hw_ostc3_simulator_destroy (dc_simulator_protocol_t *abstract)
+{
+	hw_ostc3_simulator_t *protocol = (hw_ostc3_simulator_t *) abstract;
+
+	dc_context_dealloc (protocol->base.context, protocol->data);
+}
+
+static void
+hw_ostc3_simulator_byte (hw_ostc3_simulator_t *protocol, unsigned char value)
+{
+	dc_simulator_reply (protocol->base.simulator, &value, 1);
+}
+
+static void
+hw_ostc3_simulator_ready (hw_ostc3_simulator_t *protocol)
+{
+	hw_ostc3_simulator_byte (protocol, protocol->state == SERVICE ? S_READY : READY);
+}
+
+/*
+ * Answer a command: the echo, the data and the ready byte.
+ */
+static void
+hw_ostc3_simulator_answer (hw_ostc3_simulator_t *protocol, unsigned char cmd, const unsigned char data[], size_t size)
+{
+	hw_ostc3_simulator_byte (protocol, cmd);
+	if (size)
+		dc_simulator_reply (protocol->base.simulator, data, size);
+	hw_ostc3_simulator_ready (protocol);
+}
+
+static unsigned int
+hw_ostc3_simulator_argument (unsigned char cmd)
+{
+	switch (cmd) {
+	case DIVE:
+		return 1;
+	case CLOCK:
+		return SZ_CLOCK;
+	case CUSTOMTEXT:
+		return SZ_CUSTOMTEXT;
+	case DISPLAY:
+		return SZ_DISPLAY;
+	default:
+		return 0;
+	}
+}
+
+static size_t
+hw_ostc3_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size)
+{
+	hw_ostc3_simulator_t *protocol = (hw_ostc3_simulator_t *) abstract;
+
+	if (protocol->pending) {
+		// Wait for the data packet of the previous command.
+		unsigned int length = hw_ostc3_simulator_argument (protocol->pending);
+		if (size < length)
+			return 0;
+
+		if (protocol->pending == DIVE) {
+			dc_simulator_record_t record;
+			if (dc_simulator_record_find (protocol->data, protocol->size, KEY_DIVE + data[0], &record))
+				dc_simulator_reply (abstract->simulator, record.data, record.size);
+		}
+
+		protocol->pending = 0;
+		hw_ostc3_simulator_ready (protocol);
+		return length;
+	}
+
+	unsigned char cmd = data[0];
+
+	if (protocol->state == OPEN) {
+		if (cmd == INIT) {
+			protocol->state = DOWNLOAD;
+			hw_ostc3_simulator_answer (protocol, cmd, NULL, 0);
+		} else if (cmd == S_INIT) {
+			// Wait for the service key.
+			if (size < 4)
+				return 0;
+
+			const unsigned char answer[] = {0x4B, 0xAB, 0xCD, 0xEF, S_READY};
+			if (data[1] == 0xAB && data[2] == 0xCD && data[3] == 0xEF) {
+				protocol->state = SERVICE;
+				dc_simulator_reply (abstract->simulator, answer, sizeof (answer));
+			}
+
+			return 4;
+		}
+
+		// Commands are ignored until the download mode is started.
+		return 1;
+	}
+
+	switch (cmd) {
+	case HARDWARE2:
+		if (protocol->have_hardware)
+			hw_ostc3_simulator_answer (protocol, cmd, protocol->hardware, SZ_HARDWARE2);
+		else
+			hw_ostc3_simulator_ready (protocol);
+		break;
+	case HARDWARE:
+		if (protocol->have_hardware)
+			hw_ostc3_simulator_answer (protocol, cmd, protocol->hardware + 1, 1);
+		else
+			hw_ostc3_simulator_ready (protocol);
+		break;
+	case IDENTITY:
+		hw_ostc3_simulator_answer (protocol, cmd, protocol->version, sizeof (protocol->version));
+		break;
+	case COMPACT:
+		hw_ostc3_simulator_answer (protocol, cmd, protocol->compact, sizeof (protocol->compact));
+		break;
+	case HEADER:
+		hw_ostc3_simulator_answer (protocol, cmd, protocol->full, sizeof (protocol->full));
+		break;
+	case DIVE:
+	case CLOCK:
+	case CUSTOMTEXT:
+	case DISPLAY:
+		protocol->pending = cmd;
+		hw_ostc3_simulator_byte (protocol, cmd);
+		break;
+	case EXIT:
+		protocol->state = OPEN;
+		hw_ostc3_simulator_byte (protocol, cmd);
+		break;
+	default:
+		// Unsupported commands are answered with the ready byte.
+		WARNING (abstract->context, "Unsupported command (%02x).", cmd);
+		hw_ostc3_simulator_ready (protocol);
+		break;
+	}
+
+	return 1;
+}
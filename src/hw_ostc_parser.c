@@ -31,6 +31,7 @@
 
 #include "hw_ostc.h"
 #include "hw_ostc3.h"
+#include "hw_frog.h"
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
@@ -38,6 +39,7 @@
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &hw_ostc_parser_vtable)
 
 #define MAXCONFIG 7
+#define MAXPERIOD 420
 #define NGASMIXES 15
 
 #define UNDEFINED 0xFFFFFFFF
@@ -99,6 +101,19 @@ typedef struct hw_ostc_sample_info_t {
 	unsigned int size;
 } hw_ostc_sample_info_t;
 
+/*
+ * The extended sample info repeats with a period equal to the least
+ * common multiple of all divisors. For each phase within that period,
+ * the decode plan contains the list of descriptors present in the
+ * sample. A period of zero indicates the divisors are too large to
+ * precompute, and the list has to be built for every sample.
+ */
+typedef struct hw_ostc_sample_plan_t {
+	unsigned int period;
+	unsigned char count[MAXPERIOD];
+	unsigned char index[MAXPERIOD][MAXCONFIG];
+} hw_ostc_sample_plan_t;
+
 typedef struct hw_ostc_layout_t {
 	unsigned int datetime;
 	unsigned int maxdepth;
@@ -117,18 +132,12 @@ typedef struct hw_ostc_layout_t {
 	unsigned int battery_percentage;
 } hw_ostc_layout_t;
 
-typedef struct hw_ostc_gasmix_t {
-	unsigned int oxygen;
-	unsigned int helium;
-} hw_ostc_gasmix_t;
-
 typedef struct hw_ostc_parser_t {
 	dc_parser_t base;
 	unsigned int hwos;
 	unsigned int model;
 	unsigned int serial;
 	// Cached fields.
-	unsigned int cached;
 	unsigned int version;
 	unsigned int header;
 	const hw_ostc_layout_t *layout;
@@ -137,7 +146,7 @@ typedef struct hw_ostc_parser_t {
 	unsigned int initial;
 	unsigned int initial_setpoint;
 	unsigned int initial_cns;
-	hw_ostc_gasmix_t gasmix[NGASMIXES];
+	dc_parser_gasmix_t gasmix[NGASMIXES];
 } hw_ostc_parser_t;
 
 static dc_status_t hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -220,14 +229,51 @@ hw_ostc_find_gasmix (hw_ostc_parser_t *parser, unsigned int o2, unsigned int he,
 		offset = parser->nfixed;
 	}
 
-	unsigned int i = offset;
-	while (i < count) {
-		if (o2 == parser->gasmix[i].oxygen && he == parser->gasmix[i].helium)
-			break;
-		i++;
+	return dc_parser_find_gasmix (parser->gasmix, offset, count, o2, he);
+}
+
+static unsigned int
+hw_ostc_sample_slot (unsigned char index[MAXCONFIG], const hw_ostc_sample_info_t info[], unsigned int nconfig, unsigned int nsamples)
+{
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < nconfig; ++i) {
+		if (info[i].divisor && (nsamples % info[i].divisor) == 0) {
+			index[count++] = i;
+		}
 	}
 
-	return i;
+	return count;
+}
+
+static void
+hw_ostc_sample_plan (hw_ostc_sample_plan_t *plan, const hw_ostc_sample_info_t info[], unsigned int nconfig)
+{
+	unsigned int period = 1;
+	for (unsigned int i = 0; i < nconfig; ++i) {
+		if (info[i].divisor == 0)
+			continue;
+
+		unsigned int a = period, b = info[i].divisor;
+		while (b) {
+			unsigned int t = a % b;
+			a = b;
+			b = t;
+		}
+
+		period = period / a * info[i].divisor;
+		if (period > MAXPERIOD) {
+			plan->period = 0;
+			return;
+		}
+	}
+
+	// Because every divisor is a factor of the period, the phase within
+	// the period selects the same descriptors as the sample number.
+	for (unsigned int i = 0; i < period; ++i) {
+		plan->count[i] = hw_ostc_sample_slot (plan->index[i], info, nconfig, i);
+	}
+
+	plan->period = period;
 }
 
 static dc_status_t
@@ -237,7 +283,7 @@ hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
-	if (parser->cached) {
+	if (parser->base.cached) {
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -285,7 +331,7 @@ hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 	unsigned int initial_setpoint = UNDEFINED;
 	unsigned int initial_cns = UNDEFINED;
 	unsigned int ngasmixes = 0;
-	hw_ostc_gasmix_t gasmix[NGASMIXES] = {{0}};
+	dc_parser_gasmix_t gasmix[NGASMIXES] = {{0}};
 	if (version == 0x22) {
 		ngasmixes = 3;
 		if (data[31] != 0xFF) {
@@ -343,7 +389,7 @@ hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->gasmix[i] = gasmix[i];
 	}
-	parser->cached = HEADER;
+	parser->base.cached = HEADER;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -366,7 +412,6 @@ hw_ostc_parser_create_internal (dc_parser_t **out, dc_context_t *context, unsign
 	// Set the default values.
 	parser->hwos = hwos;
 	parser->model = model;
-	parser->cached = 0;
 	parser->version = 0;
 	parser->header = 0;
 	parser->layout = NULL;
@@ -399,13 +444,62 @@ hw_ostc3_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int s
 	return hw_ostc_parser_create_internal (out, context, serial, 1, model);
 }
 
+static unsigned int
+hw_ostc_parser_probe_internal (const unsigned char data[], unsigned int size, unsigned int hwos, unsigned int minversion, unsigned int maxversion)
+{
+	unsigned int offset = hwos ? 8 : 2;
+	if (size < offset + 1)
+		return 0;
+
+	// Check the start of header marker and the logbook version.
+	unsigned int version = data[offset];
+	if (data[0] != 0xFA || data[1] != 0xFA ||
+		version < minversion || version > maxversion)
+		return 0;
+
+	unsigned int headersize = 0;
+	if (version == 0x20) {
+		headersize = 47;
+	} else if (version == 0x21) {
+		headersize = 57;
+	} else {
+		headersize = 256;
+	}
+
+	if (size < headersize + 2)
+		return 20;
+
+	// Check the end of profile marker.
+	if (data[size - 2] == 0xFD && data[size - 1] == 0xFD)
+		return 90;
+
+	return 50;
+}
+
+unsigned int
+hw_ostc_parser_probe (const unsigned char data[], unsigned int size)
+{
+	return hw_ostc_parser_probe_internal (data, size, 0, 0x20, 0x21);
+}
+
+unsigned int
+hw_frog_parser_probe (const unsigned char data[], unsigned int size)
+{
+	return hw_ostc_parser_probe_internal (data, size, 1, 0x22, 0x22);
+}
+
+unsigned int
+hw_ostc3_parser_probe (const unsigned char data[], unsigned int size)
+{
+	return hw_ostc_parser_probe_internal (data, size, 1, 0x23, 0x24);
+}
+
 static dc_status_t
 hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
 	hw_ostc_parser_t *parser = (hw_ostc_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
 	parser->version = 0;
 	parser->header = 0;
 	parser->layout = NULL;
@@ -498,11 +592,18 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
-		rc = hw_ostc_parser_samples_foreach (abstract, NULL, NULL);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+	// Cache the profile data. Only the gas mixes depend on the profile,
+	// because manually configured gas mixes are only stored in the
+	// samples. All other fields are available in the header.
+	if (parser->base.cached < PROFILE) {
+		if (dc_parser_is_summary (parser)) {
+			if (type == DC_FIELD_GASMIX_COUNT || type == DC_FIELD_GASMIX)
+				return DC_STATUS_FULLSCAN;
+		} else {
+			rc = dc_parser_samples_walk (abstract, NULL, NULL);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
 	}
 
 	unsigned int version = parser->version;
@@ -714,7 +815,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 	// Exit if no profile data available.
 	if (size == header || (size == header + 2 &&
 		data[header] == 0xFD && data[header + 1] == 0xFD)) {
-		parser->cached = PROFILE;
+		parser->base.cached = PROFILE;
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -793,6 +894,11 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		}
 	}
 
+	// Compile the extended sample configuration.
+	hw_ostc_sample_plan_t plan;
+	hw_ostc_sample_plan (&plan, info, nconfig);
+	unsigned int replan = 0;
+
 	// Get the firmware version.
 	unsigned int firmware = 0;
 	if (parser->model == OSTC4) {
@@ -985,93 +1091,109 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		}
 
 		// Extended sample info.
-		for (unsigned int i = 0; i < nconfig; ++i) {
-			if (info[i].divisor && (nsamples % info[i].divisor) == 0) {
-				if (length < info[i].size) {
-					// Due to a bug in the hwOS Tech firmware v3.03 to v3.08, and
-					// the hwOS Sport firmware v10.57 to v10.63, the ppO2 divisor
-					// is sometimes not correctly reset to zero when no ppO2
-					// samples are being recorded.
-					if (info[i].type == PPO2 && parser->hwos && parser->model != OSTC4 &&
-						((firmware >= OSTC3FW(3,3) && firmware <= OSTC3FW(3,8)) ||
-						(firmware >= OSTC3FW(10,57) && firmware <= OSTC3FW(10,63)))) {
-						WARNING (abstract->context, "Reset invalid ppO2 divisor to zero.");
-						info[i].divisor = 0;
-						continue;
-					}
-					ERROR (abstract->context, "Buffer overflow detected!");
-					return DC_STATUS_DATAFORMAT;
+		const unsigned char *slot = NULL;
+		unsigned char dynamic[MAXCONFIG];
+		unsigned int nslot = 0;
+		if (replan) {
+			hw_ostc_sample_plan (&plan, info, nconfig);
+			replan = 0;
+		}
+		if (plan.period) {
+			unsigned int phase = nsamples % plan.period;
+			slot = plan.index[phase];
+			nslot = plan.count[phase];
+		} else {
+			slot = dynamic;
+			nslot = hw_ostc_sample_slot (dynamic, info, nconfig, nsamples);
+		}
+		for (unsigned int k = 0; k < nslot; ++k) {
+			unsigned int i = slot[k];
+
+			if (length < info[i].size) {
+				// Due to a bug in the hwOS Tech firmware v3.03 to v3.08, and
+				// the hwOS Sport firmware v10.57 to v10.63, the ppO2 divisor
+				// is sometimes not correctly reset to zero when no ppO2
+				// samples are being recorded.
+				if (info[i].type == PPO2 && parser->hwos && parser->model != OSTC4 &&
+					((firmware >= OSTC3FW(3,3) && firmware <= OSTC3FW(3,8)) ||
+					(firmware >= OSTC3FW(10,57) && firmware <= OSTC3FW(10,63)))) {
+					WARNING (abstract->context, "Reset invalid ppO2 divisor to zero.");
+					info[i].divisor = 0;
+					replan = 1;
+					continue;
 				}
+				ERROR (abstract->context, "Buffer overflow detected!");
+				return DC_STATUS_DATAFORMAT;
+			}
 
-				unsigned int ppo2[3] = {0};
-				unsigned int count = 0;
-				unsigned int value = 0;
-				switch (info[i].type) {
-				case TEMPERATURE:
-					value = array_uint16_le (data + offset);
-					sample.temperature = value / 10.0;
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+			unsigned int ppo2[3] = {0};
+			unsigned int count = 0;
+			unsigned int value = 0;
+			switch (info[i].type) {
+			case TEMPERATURE:
+				value = array_uint16_le (data + offset);
+				sample.temperature = value / 10.0;
+				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+				break;
+			case DECO:
+				// Due to a firmware bug, the deco/ndl info is incorrect for
+				// all OSTC4 dives with a firmware older than version 1.0.8.
+				if (parser->model == OSTC4 && firmware < OSTC4FW(1,0,8,0))
 					break;
-				case DECO:
-					// Due to a firmware bug, the deco/ndl info is incorrect for
-					// all OSTC4 dives with a firmware older than version 1.0.8.
-					if (parser->model == OSTC4 && firmware < OSTC4FW(1,0,8,0))
-						break;
-					if (data[offset]) {
-						sample.deco.type = DC_DECO_DECOSTOP;
-						sample.deco.depth = data[offset];
+				if (data[offset]) {
+					sample.deco.type = DC_DECO_DECOSTOP;
+					sample.deco.depth = data[offset];
+				} else {
+					sample.deco.type = DC_DECO_NDL;
+					sample.deco.depth = 0.0;
+				}
+				sample.deco.time = data[offset + 1] * 60;
+				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+				break;
+			case PPO2:
+				for (unsigned int j = 0; j < 3; ++j) {
+					if (info[i].size == 3) {
+						ppo2[j] = data[offset + j];
 					} else {
-						sample.deco.type = DC_DECO_NDL;
-						sample.deco.depth = 0.0;
+						ppo2[j] = data[offset + j * 3];
 					}
-					sample.deco.time = data[offset + 1] * 60;
-					if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
-					break;
-				case PPO2:
+					if (ppo2[j] != 0)
+						count++;
+				}
+				if (count) {
 					for (unsigned int j = 0; j < 3; ++j) {
-						if (info[i].size == 3) {
-							ppo2[j] = data[offset + j];
-						} else {
-							ppo2[j] = data[offset + j * 3];
-						}
-						if (ppo2[j] != 0)
-							count++;
+						sample.ppo2 = ppo2[j] / 100.0;
+						if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
 					}
-					if (count) {
-						for (unsigned int j = 0; j < 3; ++j) {
-							sample.ppo2 = ppo2[j] / 100.0;
-							if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
-						}
-					}
-					break;
-				case CNS:
-					if (info[i].size == 2)
-						sample.cns = array_uint16_le (data + offset) / 100.0;
-					else
-						sample.cns = data[offset] / 100.0;
-					if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
-					break;
-				case TANK:
-					value = array_uint16_le (data + offset);
-					if (value != 0) {
-						sample.pressure.tank = tank;
-						sample.pressure.value = value;
-						// The hwOS Sport firmware used a resolution of
-						// 0.1 bar between versions 10.40 and 10.50.
-						if (parser->hwos && parser->model != OSTC4 &&
-							(firmware >= OSTC3FW(10,40) && firmware <= OSTC3FW(10,50))) {
-							sample.pressure.value /= 10.0;
-						}
-						if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+				}
+				break;
+			case CNS:
+				if (info[i].size == 2)
+					sample.cns = array_uint16_le (data + offset) / 100.0;
+				else
+					sample.cns = data[offset] / 100.0;
+				if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
+				break;
+			case TANK:
+				value = array_uint16_le (data + offset);
+				if (value != 0) {
+					sample.pressure.tank = tank;
+					sample.pressure.value = value;
+					// The hwOS Sport firmware used a resolution of
+					// 0.1 bar between versions 10.40 and 10.50.
+					if (parser->hwos && parser->model != OSTC4 &&
+						(firmware >= OSTC3FW(10,40) && firmware <= OSTC3FW(10,50))) {
+						sample.pressure.value /= 10.0;
 					}
-					break;
-				default: // Not yet used.
-					break;
+					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
 				}
-
-				offset += info[i].size;
-				length -= info[i].size;
+				break;
+			default: // Not yet used.
+				break;
 			}
+
+			offset += info[i].size;
+			length -= info[i].size;
 		}
 
 		if (version != 0x23 && version != 0x24) {
@@ -1117,6 +1239,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		// Skip remaining sample bytes (if any).
 		if (length) {
 			WARNING (abstract->context, "Remaining %u bytes skipped.", length);
+			dc_parser_skipped (abstract);
 		}
 		offset += length;
 	}
@@ -1126,7 +1249,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	parser->cached = PROFILE;
+	parser->base.cached = PROFILE;
 
 	return DC_STATUS_SUCCESS;
 }
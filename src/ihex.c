@@ -19,11 +19,24 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#define USE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "ihex.h"
 #include "context-private.h"
 #include "checksum.h"
@@ -31,12 +44,102 @@
 
 struct dc_ihex_file_t {
 	dc_context_t *context;
-	FILE *fp;
+	unsigned char *data;
+	size_t size;
+	size_t offset;
+	int mapped;
 };
 
+#ifdef USE_MMAP
+static dc_status_t
+dc_ihex_file_map (dc_ihex_file_t *file, const char *filename)
+{
+	struct stat st;
+	void *data = NULL;
+
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0) {
+		return DC_STATUS_IO;
+	}
+
+	if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode)) {
+		close (fd);
+		return DC_STATUS_IO;
+	}
+
+	if (st.st_size == 0) {
+		// An empty file can't be mapped, but is still valid.
+		close (fd);
+		file->data = NULL;
+		file->size = 0;
+		file->mapped = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) {
+		return DC_STATUS_IO;
+	}
+
+	file->data = (unsigned char *) data;
+	file->size = st.st_size;
+	file->mapped = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
+
+static dc_status_t
+dc_ihex_file_slurp (dc_ihex_file_t *file, const char *filename)
+{
+	unsigned char *data = NULL;
+	size_t size = 0, capacity = 0;
+
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		return DC_STATUS_IO;
+	}
+
+	// Read the entire file into memory.
+	while (1) {
+		if (size == capacity) {
+			size_t length = capacity ? capacity * 2 : 64 * 1024;
+			unsigned char *tmp = (unsigned char *) realloc (data, length);
+			if (tmp == NULL) {
+				free (data);
+				fclose (fp);
+				return DC_STATUS_NOMEMORY;
+			}
+			data = tmp;
+			capacity = length;
+		}
+
+		size_t n = fread (data + size, 1, capacity - size, fp);
+		size += n;
+		if (n == 0) {
+			if (ferror (fp)) {
+				free (data);
+				fclose (fp);
+				return DC_STATUS_IO;
+			}
+			break;
+		}
+	}
+
+	fclose (fp);
+
+	file->data = data;
+	file->size = size;
+	file->mapped = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *filename)
 {
+	dc_status_t status = DC_STATUS_IO;
 	dc_ihex_file_t *file = NULL;
 
 	if (result == NULL || filename == NULL) {
@@ -51,12 +154,23 @@ dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *f
 	}
 
 	file->context = context;
-
-	file->fp = fopen (filename, "rb");
-	if (file->fp == NULL) {
+	file->data = NULL;
+	file->size = 0;
+	file->offset = 0;
+	file->mapped = 0;
+
+	// Map the file into memory, and fall back to reading it if that's not
+	// possible.
+#ifdef USE_MMAP
+	status = dc_ihex_file_map (file, filename);
+#endif
+	if (status != DC_STATUS_SUCCESS) {
+		status = dc_ihex_file_slurp (file, filename);
+	}
+	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to open the file.");
 		free (file);
-		return DC_STATUS_IO;
+		return status;
 	}
 
 	*result = file;
@@ -64,71 +178,62 @@ dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *f
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
+static dc_status_t
+dc_ihex_file_next (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 {
-	unsigned char ascii[9 + 2 * 255 + 2] = {0};
-	unsigned char data[4 + 255 + 1] = {0};
+	const unsigned char *ascii = NULL;
+	unsigned char data[4 + 255 + 1];
 	unsigned int type, length, address;
 	unsigned char csum_a, csum_b;
-	size_t n;
 
-	if (file == NULL || entry == NULL) {
-		ERROR (file ? file->context : NULL, "Invalid arguments.");
-		return DC_STATUS_INVALIDARGS;
-	}
-
-	/* Read the start code. */
+	/* Skip to the start code. */
 	while (1) {
-		n = fread (ascii, 1, 1, file->fp);
-		if (n != 1) {
-			if (feof (file->fp)) {
-				return DC_STATUS_DONE;
-			} else {
-				ERROR (file->context, "Failed to read the start code.");
-				return DC_STATUS_IO;
-			}
+		if (file->offset >= file->size) {
+			return DC_STATUS_DONE;
 		}
 
-		if (ascii[0] == ':')
+		unsigned char c = file->data[file->offset];
+		if (c == ':')
 			break;
 
 		/* Ignore CR and LF characters. */
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (file->context, "Unexpected character (0x%02x).", ascii[0]);
+		if (c != '\n' && c != '\r') {
+			ERROR (file->context, "Unexpected character (0x%02x).", c);
 			return DC_STATUS_DATAFORMAT;
 		}
+
+		file->offset++;
 	}
 
-	/* Read the record length, address and type. */
-	n = fread (ascii + 1, 1, 8, file->fp);
-	if (n != 8) {
+	ascii = file->data + file->offset + 1;
+
+	/* Check the header is present. */
+	if (file->size - file->offset < 1 + 8) {
 		ERROR (file->context, "Failed to read the header.");
 		return DC_STATUS_IO;
 	}
 
-	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 1, 8, data, 4) != 0) {
+	/* Get the record length. */
+	if (array_convert_hex2bin (ascii, 2, data, 1) != 0) {
 		ERROR (file->context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
-
-	/* Get the record length. */
 	length = data[0];
 
-	/* Read the record payload. */
-	n = fread (ascii + 9, 1, 2 * length + 2, file->fp);
-	if (n != 2 * length + 2) {
+	/* Check the payload is present. */
+	if (file->size - file->offset < 1 + 8 + 2 * length + 2) {
 		ERROR (file->context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
-	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 9, 2 * length + 2, data + 4, length + 1) != 0) {
+	/* Convert the entire record to binary representation at once. */
+	if (array_convert_hex2bin (ascii, 2 * (4 + length + 1), data, 4 + length + 1) != 0) {
 		ERROR (file->context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	file->offset += 1 + 2 * (4 + length + 1);
+
 	/* Verify the checksum. */
 	csum_a = data[4 + length];
 	csum_b = ~checksum_add_uint8 (data, 4 + length, 0x00) + 1;
@@ -142,7 +247,7 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 
 	/* Get the record type. */
 	type = data[3];
-	if (type < 0 || type > 5) {
+	if (type > 5) {
 		ERROR (file->context, "Invalid record type (0x%02x).", type);
 		return DC_STATUS_DATAFORMAT;
 	}
@@ -175,12 +280,79 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 	entry->length = length;
 
 	/* Copy the record data. */
-	memcpy (entry->data, data + 4, entry->length);
+	memcpy (entry->data, data + 4, length);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (file == NULL || entry == NULL) {
+		ERROR (file ? file->context : NULL, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	status = dc_ihex_file_next (file, entry);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
 	memset (entry->data + entry->length, 0, sizeof (entry->data) - entry->length);
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_ihex_file_load (dc_ihex_file_t *file, unsigned char data[], unsigned int size, dc_ihex_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_ihex_entry_t entry;
+	unsigned int base = 0;
+
+	if (file == NULL || (data == NULL && size != 0)) {
+		ERROR (file ? file->context : NULL, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	file->offset = 0;
+
+	while ((status = dc_ihex_file_next (file, &entry)) == DC_STATUS_SUCCESS) {
+		if (entry.type == 0) {
+			/* Data record. */
+			unsigned int address = base + entry.address;
+			if (address > size || entry.length > size - address) {
+				WARNING (file->context, "Ignoring out of range record (0x%08x,%u).", address, entry.length);
+				continue;
+			}
+
+			memcpy (data + address, entry.data, entry.length);
+
+			if (callback) {
+				callback (address, entry.length, userdata);
+			}
+		} else if (entry.type == 1) {
+			/* End of file record. */
+			break;
+		} else if (entry.type == 2) {
+			/* Extended segment address record. */
+			base = array_uint16_be (entry.data) << 4;
+		} else if (entry.type == 4) {
+			/* Extended linear address record. */
+			base = array_uint16_be (entry.data) << 16;
+		}
+
+		/* The start address records carry no data. */
+	}
+
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_DONE) {
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_ihex_file_reset (dc_ihex_file_t *file)
 {
@@ -189,7 +361,7 @@ dc_ihex_file_reset (dc_ihex_file_t *file)
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	rewind (file->fp);
+	file->offset = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -198,7 +370,12 @@ dc_status_t
 dc_ihex_file_close (dc_ihex_file_t *file)
 {
 	if (file) {
-		fclose (file->fp);
+#ifdef USE_MMAP
+		if (file->mapped)
+			munmap (file->data, file->size);
+		else
+#endif
+			free (file->data);
 		free (file);
 	}
 
@@ -38,12 +38,27 @@ typedef struct dc_ihex_entry_t {
 	unsigned char data[255];
 } dc_ihex_entry_t;
 
+/*
+ * Callback function, called by dc_ihex_file_load for every data record
+ * that was stored in the image.
+ */
+typedef void (*dc_ihex_callback_t) (unsigned int address, unsigned int length, void *userdata);
+
 dc_status_t
 dc_ihex_file_open (dc_ihex_file_t **file, dc_context_t *context, const char *filename);
 
 dc_status_t
 dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry);
 
+/*
+ * Load all data records, starting from the beginning of the file, into
+ * an image of the given size. The extended address records are applied
+ * and records that don't fit in the image are ignored. Parsing stops at
+ * the end of file record.
+ */
+dc_status_t
+dc_ihex_file_load (dc_ihex_file_t *file, unsigned char data[], unsigned int size, dc_ihex_callback_t callback, void *userdata);
+
 dc_status_t
 dc_ihex_file_reset (dc_ihex_file_t *file);
 
@@ -26,16 +26,50 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/iostream.h>
 
+#include "timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
 typedef struct dc_iostream_vtable_t dc_iostream_vtable_t;
 
+/*
+ * Cooperative wait function. When installed, the blocking functions no
+ * longer block, but call this function instead, with the timeout in
+ * milliseconds (or negative for infinite), and whether the caller is
+ * waiting for incoming data or only for the timeout. The function
+ * returns once the caller should check again, or an error to abort the
+ * operation.
+ */
+typedef dc_status_t (*dc_iostream_wait_t) (dc_iostream_t *iostream, int input, int timeout, void *userdata);
+
+typedef struct dc_iostream_request_t {
+	unsigned char *data;
+	size_t size;
+	size_t actual;
+	dc_iostream_callback_t callback;
+	void *userdata;
+	unsigned int pending;
+} dc_iostream_request_t;
+
 struct dc_iostream_t {
 	const dc_iostream_vtable_t *vtable;
 	dc_context_t *context;
 	dc_transport_t transport;
+	// Asynchronous requests.
+	dc_iostream_request_t rx, tx;
+	// Transport statistics.
+	dc_iostream_stats_t stats;
+	dc_timer_t *timer;
+	dc_usecs_t polltime;
+	dc_usecs_t readtime;
+	dc_usecs_t request;
+	int haverequest;
+	// Current timeout, and the cooperative wait function.
+	int timeout;
+	dc_iostream_wait_t wait;
+	void *waitdata;
 };
 
 struct dc_iostream_vtable_t {
@@ -61,6 +95,8 @@ struct dc_iostream_vtable_t {
 
 	dc_status_t (*write) (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+	dc_status_t (*writev) (dc_iostream_t *iostream, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+
 	dc_status_t (*ioctl) (dc_iostream_t *iostream, unsigned int request, void *data, size_t size);
 
 	dc_status_t (*flush) (dc_iostream_t *iostream);
@@ -69,6 +105,8 @@ struct dc_iostream_vtable_t {
 
 	dc_status_t (*sleep) (dc_iostream_t *iostream, unsigned int milliseconds);
 
+	dc_status_t (*interrupt) (dc_iostream_t *iostream);
+
 	dc_status_t (*close) (dc_iostream_t *iostream);
 };
 
@@ -81,6 +119,21 @@ dc_iostream_deallocate (dc_iostream_t *iostream);
 int
 dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vtable);
 
+/*
+ * Install (or remove, with a NULL function) the cooperative wait
+ * function. Cooperative waiting requires a transport with support for
+ * polling, and returns DC_STATUS_UNSUPPORTED otherwise.
+ */
+dc_status_t
+dc_iostream_set_wait (dc_iostream_t *iostream, dc_iostream_wait_t wait, void *userdata);
+
+/*
+ * Count a packet that is sent again by the backend, for the transport
+ * statistics.
+ */
+void
+dc_iostream_stats_retry (dc_iostream_t *iostream);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -21,6 +21,7 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include <libdivecomputer/ioctl.h>
@@ -28,6 +29,7 @@
 #include "iostream-private.h"
 #include "context-private.h"
 #include "platform.h"
+#include "probes.h"
 
 dc_iostream_t *
 dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable, dc_transport_t transport)
@@ -38,7 +40,7 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable,
 	assert(vtable->size >= sizeof(dc_iostream_t));
 
 	// Allocate memory.
-	iostream = (dc_iostream_t *) malloc (vtable->size);
+	iostream = (dc_iostream_t *) dc_context_malloc (context, vtable->size);
 	if (iostream == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return iostream;
@@ -48,6 +50,23 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable,
 	iostream->vtable = vtable;
 	iostream->context = context;
 	iostream->transport = transport;
+	memset (&iostream->rx, 0, sizeof (iostream->rx));
+	memset (&iostream->tx, 0, sizeof (iostream->tx));
+
+	// Initialize the statistics. Without a timer, only the counters
+	// are available.
+	memset (&iostream->stats, 0, sizeof (iostream->stats));
+	iostream->polltime = 0;
+	iostream->readtime = 0;
+	iostream->request = 0;
+	iostream->haverequest = 0;
+	iostream->timeout = -1;
+	iostream->wait = NULL;
+	iostream->waitdata = NULL;
+	if (dc_timer_new (&iostream->timer) != DC_STATUS_SUCCESS) {
+		WARNING (context, "Failed to create a timer.");
+		iostream->timer = NULL;
+	}
 
 	return iostream;
 }
@@ -55,7 +74,12 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable,
 void
 dc_iostream_deallocate (dc_iostream_t *iostream)
 {
-	free (iostream);
+	if (iostream == NULL)
+		return;
+
+	dc_timer_free (iostream->timer);
+
+	dc_context_dealloc (iostream->context, iostream);
 }
 
 int
@@ -67,6 +91,113 @@ dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vta
 	return iostream->vtable == vtable;
 }
 
+static dc_usecs_t
+dc_iostream_now (dc_iostream_t *iostream)
+{
+	dc_usecs_t now = 0;
+
+	if (iostream->timer)
+		dc_timer_now (iostream->timer, &now);
+
+	return now;
+}
+
+dc_status_t
+dc_iostream_set_wait (dc_iostream_t *iostream, dc_iostream_wait_t wait, void *userdata)
+{
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Without polling, there is no way to know when a read would block,
+	// and without a timer, the timeouts can't be tracked.
+	if (wait && (iostream->vtable->poll == NULL || iostream->timer == NULL))
+		return DC_STATUS_UNSUPPORTED;
+
+	iostream->wait = wait;
+	iostream->waitdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Wait for incoming data with the cooperative wait function, until the
+ * data arrives or the timeout expires.
+ */
+static dc_status_t
+dc_iostream_wait_input (dc_iostream_t *iostream, int timeout)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usecs_t begin = dc_iostream_now (iostream);
+
+	while (1) {
+		status = iostream->vtable->poll (iostream, 0);
+		if (status != DC_STATUS_TIMEOUT)
+			return status;
+
+		int remaining = -1;
+		if (timeout >= 0) {
+			dc_usecs_t elapsed = (dc_iostream_now (iostream) - begin) / 1000;
+			if (elapsed >= (dc_usecs_t) timeout)
+				return DC_STATUS_TIMEOUT;
+			remaining = timeout - (int) elapsed;
+		}
+
+		status = iostream->wait (iostream, 1, remaining, iostream->waitdata);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+}
+
+static void
+dc_iostream_stats_read (dc_iostream_t *iostream, dc_status_t status, size_t nbytes, dc_usecs_t begin)
+{
+	dc_usecs_t now = dc_iostream_now (iostream);
+
+	iostream->stats.nreads++;
+	iostream->stats.nbytes_in += nbytes;
+	iostream->readtime += now - begin;
+	if (status == DC_STATUS_TIMEOUT)
+		iostream->stats.ntimeouts++;
+
+	// The first data after a write completes the turnaround.
+	if (nbytes && iostream->haverequest) {
+		unsigned int ms = (unsigned int) ((now - iostream->request) / 1000);
+		unsigned int bin = 0;
+		while (ms && bin < DC_IOSTREAM_LATENCY_BINS - 1) {
+			ms >>= 1;
+			bin++;
+		}
+		iostream->stats.latency[bin]++;
+		iostream->haverequest = 0;
+	}
+}
+
+static void
+dc_iostream_stats_write (dc_iostream_t *iostream, size_t nbytes)
+{
+	iostream->stats.nwrites++;
+	iostream->stats.nbytes_out += nbytes;
+	if (nbytes) {
+		iostream->request = dc_iostream_now (iostream);
+		iostream->haverequest = 1;
+	}
+}
+
+static void
+dc_iostream_stats_poll (dc_iostream_t *iostream, dc_usecs_t begin)
+{
+	iostream->polltime += dc_iostream_now (iostream) - begin;
+}
+
+void
+dc_iostream_stats_retry (dc_iostream_t *iostream)
+{
+	if (iostream == NULL)
+		return;
+
+	iostream->stats.nretries++;
+}
+
 dc_transport_t
 dc_iostream_get_transport (dc_iostream_t *iostream)
 {
@@ -84,7 +215,11 @@ dc_iostream_set_timeout (dc_iostream_t *iostream, int timeout)
 
 	INFO (iostream->context, "Timeout: value=%i", timeout);
 
-	return iostream->vtable->set_timeout (iostream, timeout);
+	dc_status_t status = iostream->vtable->set_timeout (iostream, timeout);
+	if (status == DC_STATUS_SUCCESS)
+		iostream->timeout = timeout;
+
+	return status;
 }
 
 dc_status_t
@@ -182,7 +317,16 @@ dc_iostream_poll (dc_iostream_t *iostream, int timeout)
 
 	INFO (iostream->context, "Poll: value=%i", timeout);
 
-	return iostream->vtable->poll (iostream, timeout);
+	dc_usecs_t begin = dc_iostream_now (iostream);
+	dc_status_t status = DC_STATUS_SUCCESS;
+	if (iostream->wait && timeout != 0) {
+		status = dc_iostream_wait_input (iostream, timeout);
+	} else {
+		status = iostream->vtable->poll (iostream, timeout);
+	}
+	dc_iostream_stats_poll (iostream, begin);
+
+	return status;
 }
 
 dc_status_t
@@ -197,8 +341,33 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 	while (size) {
 		dc_status_t status;
 		size_t nbytes = 0;
+		size_t length = size;
+
+		if (iostream->wait) {
+			// Wait for the data without blocking.
+			dc_usecs_t begin = dc_iostream_now (iostream);
+			status = dc_iostream_wait_input (iostream, iostream->timeout);
+			if (status == DC_STATUS_TIMEOUT)
+				dc_iostream_stats_read (iostream, status, 0, begin);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+
+			// Read no more than the data that is already available, to
+			// avoid blocking on the remainder. Partial results are
+			// passed as is, because the caller may expect them to
+			// correspond to a single packet.
+			size_t available = 0;
+			if (actual == NULL && iostream->vtable->get_available &&
+				iostream->vtable->get_available (iostream, &available) == DC_STATUS_SUCCESS &&
+				available && available < length)
+				length = available;
+		}
 
-		status = iostream->vtable->read (iostream, data, size, &nbytes);
+		PROBE3 (iostream__read__start, iostream, iostream->transport, length);
+		dc_usecs_t begin = dc_iostream_now (iostream);
+		status = iostream->vtable->read (iostream, data, length, &nbytes);
+		dc_iostream_stats_read (iostream, status, nbytes, begin);
+		PROBE3 (iostream__read__done, iostream, status, nbytes);
 		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
 
 		/*
@@ -249,7 +418,10 @@ dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_
 		dc_status_t status;
 		size_t nbytes = 0;
 
+		PROBE3 (iostream__write__start, iostream, iostream->transport, size);
 		status = iostream->vtable->write (iostream, data, size, &nbytes);
+		dc_iostream_stats_write (iostream, nbytes);
+		PROBE3 (iostream__write__done, iostream, status, nbytes);
 		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
 
 		if (actual) {
@@ -270,6 +442,242 @@ dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], unsigned int count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char buffer[256];
+
+	if (actual)
+		*actual = 0;
+
+	if (iostream == NULL || iostream->vtable->write == NULL)
+		return DC_STATUS_IO;
+
+	if (iov == NULL && count != 0)
+		return DC_STATUS_INVALIDARGS;
+
+	size_t size = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		size += iov[i].size;
+	}
+
+	if (size == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (iostream->vtable->writev) {
+		size_t nbytes = 0;
+
+		PROBE3 (iostream__write__start, iostream, iostream->transport, size);
+		status = iostream->vtable->writev (iostream, iov, count, &nbytes);
+		dc_iostream_stats_write (iostream, nbytes);
+		PROBE3 (iostream__write__done, iostream, status, nbytes);
+		for (size_t i = 0, n = nbytes; i < count && n; ++i) {
+			size_t length = iov[i].size < n ? iov[i].size : n;
+			HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) iov[i].data, length);
+			n -= length;
+		}
+
+		if (actual) {
+			*actual = nbytes;
+			return status;
+		}
+
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		if (!nbytes)
+			return DC_STATUS_IO;
+
+		if (nbytes == size)
+			return DC_STATUS_SUCCESS;
+
+		// Write the remaining data one buffer at a time.
+		unsigned int i = 0;
+		while (nbytes >= iov[i].size) {
+			nbytes -= iov[i].size;
+			i++;
+		}
+
+		status = dc_iostream_write (iostream, (const unsigned char *) iov[i].data + nbytes, iov[i].size - nbytes, NULL);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		for (i = i + 1; i < count; ++i) {
+			status = dc_iostream_write (iostream, iov[i].data, iov[i].size, NULL);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Combine small writes into a single packet.
+	if (size <= sizeof(buffer)) {
+		size_t offset = 0;
+		for (unsigned int i = 0; i < count; ++i) {
+			if (iov[i].size) {
+				memcpy (buffer + offset, iov[i].data, iov[i].size);
+				offset += iov[i].size;
+			}
+		}
+
+		return dc_iostream_write (iostream, buffer, size, actual);
+	}
+
+	// Write the data one buffer at a time.
+	size_t nbytes = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		size_t length = 0;
+
+		if (iov[i].size == 0)
+			continue;
+
+		status = dc_iostream_write (iostream, iov[i].data, iov[i].size, actual ? &length : NULL);
+		nbytes += length;
+		if (status != DC_STATUS_SUCCESS || (actual && length != iov[i].size))
+			break;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_iostream_submit (dc_iostream_t *iostream, dc_iostream_request_t *request, void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	if (request->pending) {
+		ERROR (iostream->context, "Another request is already pending.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	request->data = (unsigned char *) data;
+	request->size = size;
+	request->actual = 0;
+	request->callback = callback;
+	request->userdata = userdata;
+	request->pending = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_iostream_complete (dc_iostream_t *iostream, dc_iostream_request_t *request, dc_status_t status)
+{
+	// The request is finished before calling the callback, which may
+	// submit the next request.
+	request->pending = 0;
+
+	if (request->callback)
+		request->callback (iostream, status, request->actual, request->userdata);
+}
+
+dc_status_t
+dc_iostream_submit_read (dc_iostream_t *iostream, void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	if (iostream == NULL || iostream->vtable->read == NULL)
+		return DC_STATUS_IO;
+
+	return dc_iostream_submit (iostream, &iostream->rx, data, size, callback, userdata);
+}
+
+dc_status_t
+dc_iostream_submit_write (dc_iostream_t *iostream, const void *data, size_t size, dc_iostream_callback_t callback, void *userdata)
+{
+	if (iostream == NULL || iostream->vtable->write == NULL)
+		return DC_STATUS_IO;
+
+	return dc_iostream_submit (iostream, &iostream->tx, (void *) data, size, callback, userdata);
+}
+
+dc_status_t
+dc_iostream_process (dc_iostream_t *iostream, int timeout)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (!iostream->rx.pending && !iostream->tx.pending)
+		return DC_STATUS_DONE;
+
+	dc_iostream_request_t *tx = &iostream->tx;
+	unsigned int progress = 0;
+	if (tx->pending) {
+		status = dc_iostream_write (iostream, tx->data, tx->size, NULL);
+		tx->actual = (status == DC_STATUS_SUCCESS ? tx->size : 0);
+		dc_iostream_complete (iostream, tx, status);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+		progress = 1;
+	}
+
+	dc_iostream_request_t *rx = &iostream->rx;
+	if (!rx->pending)
+		return DC_STATUS_SUCCESS;
+
+	// Wait for incoming data.
+	size_t remaining = rx->size - rx->actual;
+	if (remaining) {
+		dc_usecs_t begin = dc_iostream_now (iostream);
+		status = iostream->vtable->poll ? iostream->vtable->poll (iostream, timeout) : DC_STATUS_UNSUPPORTED;
+		dc_iostream_stats_poll (iostream, begin);
+		if (status == DC_STATUS_TIMEOUT) {
+			return progress ? DC_STATUS_SUCCESS : status;
+		} else if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			dc_iostream_complete (iostream, rx, status);
+			return status;
+		}
+
+		// Limit the read to the data that is already available, to avoid
+		// blocking. Packet based transports return a single packet.
+		if (status == DC_STATUS_SUCCESS && iostream->vtable->get_available) {
+			size_t available = 0;
+			if (iostream->vtable->get_available (iostream, &available) == DC_STATUS_SUCCESS &&
+				available && available < remaining)
+			{
+				remaining = available;
+			}
+		}
+
+		size_t nbytes = 0;
+		begin = dc_iostream_now (iostream);
+		status = iostream->vtable->read (iostream, rx->data + rx->actual, remaining, &nbytes);
+		dc_iostream_stats_read (iostream, status, nbytes, begin);
+		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Read", rx->data + rx->actual, nbytes);
+		rx->actual += nbytes;
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_TIMEOUT) {
+			dc_iostream_complete (iostream, rx, status);
+			return status;
+		}
+
+		if (nbytes == 0 && rx->actual < rx->size)
+			return progress ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+	}
+
+	if (rx->actual >= rx->size)
+		dc_iostream_complete (iostream, rx, DC_STATUS_SUCCESS);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_cancel (dc_iostream_t *iostream)
+{
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->tx.pending)
+		dc_iostream_complete (iostream, &iostream->tx, DC_STATUS_CANCELLED);
+
+	if (iostream->rx.pending)
+		dc_iostream_complete (iostream, &iostream->rx, DC_STATUS_CANCELLED);
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_iostream_ioctl (dc_iostream_t *iostream, unsigned int request, void *data, size_t size)
 {
@@ -334,9 +742,62 @@ dc_iostream_sleep (dc_iostream_t *iostream, unsigned int milliseconds)
 
 	INFO (iostream->context, "Sleep: value=%u", milliseconds);
 
+	if (iostream->wait) {
+		// Wait for the timeout without blocking.
+		dc_usecs_t begin = dc_iostream_now (iostream);
+		while (1) {
+			dc_usecs_t elapsed = (dc_iostream_now (iostream) - begin) / 1000;
+			if (elapsed >= milliseconds)
+				return DC_STATUS_SUCCESS;
+
+			dc_status_t status = iostream->wait (iostream, 0, (int) (milliseconds - elapsed), iostream->waitdata);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+		}
+	}
+
 	return iostream->vtable->sleep (iostream, milliseconds);
 }
 
+dc_status_t
+dc_iostream_interrupt (dc_iostream_t *iostream)
+{
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (iostream->vtable->interrupt == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return iostream->vtable->interrupt (iostream);
+}
+
+dc_status_t
+dc_iostream_get_stats (dc_iostream_t *iostream, dc_iostream_stats_t *stats)
+{
+	if (iostream == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*stats = iostream->stats;
+	stats->polltime = (unsigned int) (iostream->polltime / 1000);
+	stats->readtime = (unsigned int) (iostream->readtime / 1000);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_iostream_reset_stats (dc_iostream_t *iostream)
+{
+	if (iostream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	memset (&iostream->stats, 0, sizeof (iostream->stats));
+	iostream->polltime = 0;
+	iostream->readtime = 0;
+	iostream->haverequest = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_iostream_close (dc_iostream_t *iostream)
 {
@@ -345,6 +806,8 @@ dc_iostream_close (dc_iostream_t *iostream)
 	if (iostream == NULL)
 		return DC_STATUS_SUCCESS;
 
+	dc_iostream_cancel (iostream);
+
 	if (iostream->vtable->close) {
 		status = iostream->vtable->close (iostream);
 	}
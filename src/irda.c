@@ -51,6 +51,7 @@
 #include "descriptor-private.h"
 #include "array.h"
 #include "platform.h"
+#include "thread.h"
 
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_irda_vtable)
 
@@ -73,6 +74,16 @@ struct dc_irda_device_t {
 };
 
 #ifdef IRDA
+/*
+ * The results of the last discovery, and the LSAP selector of the last
+ * successful connection to each device, stored on the context.
+ */
+typedef struct dc_irda_cache_t {
+	dc_irda_device_t items[DISCOVER_MAX_DEVICES];
+	unsigned int lsap[DISCOVER_MAX_DEVICES];
+	size_t count;
+} dc_irda_cache_t;
+
 static dc_status_t dc_irda_iterator_next (dc_iterator_t *iterator, void *item);
 
 typedef struct dc_irda_iterator_t {
@@ -100,10 +111,12 @@ static const dc_iostream_vtable_t dc_irda_vtable = {
 	dc_socket_poll, /* poll */
 	dc_socket_read, /* read */
 	dc_socket_write, /* write */
+	NULL, /* writev */
 	dc_socket_ioctl, /* ioctl */
 	NULL, /* flush */
 	NULL, /* purge */
 	dc_socket_sleep, /* sleep */
+	dc_socket_interrupt, /* interrupt */
 	dc_socket_close, /* close */
 };
 #endif
@@ -132,8 +145,58 @@ dc_irda_device_free (dc_irda_device_t *device)
 	free (device);
 }
 
+#ifdef IRDA
+static dc_irda_cache_t *
+dc_irda_cache_get (dc_context_t *context)
+{
+	dc_irda_cache_t *cache = (dc_irda_cache_t *) dc_context_get_cache (context, DC_CONTEXT_CACHE_IRDA);
+	if (cache == NULL) {
+		cache = (dc_irda_cache_t *) malloc (sizeof (dc_irda_cache_t));
+		if (cache == NULL)
+			return NULL;
+		cache->count = 0;
+		dc_context_set_cache (context, DC_CONTEXT_CACHE_IRDA, cache, free);
+	}
+
+	return cache;
+}
+
+static void
+dc_irda_cache_store (dc_context_t *context, const dc_irda_device_t items[], size_t count)
+{
+	dc_global_lock ();
+
+	dc_irda_cache_t *cache = dc_irda_cache_get (context);
+	if (cache) {
+		unsigned int lsap[DISCOVER_MAX_DEVICES] = {0};
+
+		// Keep the LSAP selector of the devices that are still present.
+		for (size_t i = 0; i < count; ++i) {
+			for (size_t j = 0; j < cache->count; ++j) {
+				if (cache->items[j].address == items[i].address) {
+					lsap[i] = cache->lsap[j];
+					break;
+				}
+			}
+		}
+
+		memcpy (cache->items, items, count * sizeof (dc_irda_device_t));
+		memcpy (cache->lsap, lsap, sizeof (lsap));
+		cache->count = count;
+	}
+
+	dc_global_unlock ();
+}
+#endif
+
 dc_status_t
 dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	return dc_irda_iterator_new2 (out, context, descriptor, DC_IRDA_SCAN_NONE);
+}
+
+dc_status_t
+dc_irda_iterator_new2 (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int flags)
 {
 #ifdef IRDA
 	dc_status_t status = DC_STATUS_SUCCESS;
@@ -148,6 +211,25 @@ dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_
 		return DC_STATUS_NOMEMORY;
 	}
 
+	dc_irda_device_t items[DISCOVER_MAX_DEVICES];
+	size_t nitems = 0;
+
+	// Use the results of the previous discovery, if available.
+	if (flags & DC_IRDA_SCAN_CACHED) {
+		dc_global_lock ();
+		dc_irda_cache_t *cache = (dc_irda_cache_t *) dc_context_get_cache (context, DC_CONTEXT_CACHE_IRDA);
+		if (cache) {
+			memcpy (items, cache->items, cache->count * sizeof (dc_irda_device_t));
+			nitems = cache->count;
+		}
+		dc_global_unlock ();
+
+		if (nitems) {
+			INFO (context, "Using %u cached devices.", (unsigned int) nitems);
+			goto done;
+		}
+	}
+
 	// Initialize the socket library.
 	status = dc_socket_init (context);
 	if (status != DC_STATUS_SUCCESS) {
@@ -212,7 +294,6 @@ dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_
 	S_CLOSE (fd);
 	dc_socket_exit (context);
 
-	unsigned int count = 0;
 #ifdef _WIN32
 	for (size_t i = 0; i < list->numDevice; ++i) {
 		const char *name = list->Device[i].irdaDeviceName;
@@ -231,16 +312,25 @@ dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_
 		INFO (context, "Discover: address=%08x, name=%s, charset=%02x, hints=%04x",
 			address, name, charset, hints);
 
-		if (!dc_descriptor_filter (descriptor, DC_TRANSPORT_IRDA, name, NULL)) {
+		strncpy(items[nitems].name, name, sizeof(items[nitems].name) - 1);
+		items[nitems].name[sizeof(items[nitems].name) - 1] = '\0';
+		items[nitems].address = address;
+		items[nitems].charset = charset;
+		items[nitems].hints = hints;
+		nitems++;
+	}
+
+	// Remember all devices, not only the ones matching the filter.
+	dc_irda_cache_store (context, items, nitems);
+
+done:;
+	unsigned int count = 0;
+	for (size_t i = 0; i < nitems; ++i) {
+		if (!dc_descriptor_filter (descriptor, DC_TRANSPORT_IRDA, items[i].name, NULL)) {
 			continue;
 		}
 
-		strncpy(iterator->items[count].name, name, sizeof(iterator->items[count].name) - 1);
-		iterator->items[count].name[sizeof(iterator->items[count].name) - 1] = '\0';
-		iterator->items[count].address = address;
-		iterator->items[count].charset = charset;
-		iterator->items[count].hints = hints;
-		count++;
+		iterator->items[count++] = items[i];
 	}
 
 	iterator->current = 0;
@@ -296,6 +386,24 @@ dc_irda_open (dc_iostream_t **out, dc_context_t *context, unsigned int address,
 	if (out == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	// Use the LSAP selector of the previous connection.
+	if (lsap == 0) {
+		dc_global_lock ();
+		dc_irda_cache_t *cache = (dc_irda_cache_t *) dc_context_get_cache (context, DC_CONTEXT_CACHE_IRDA);
+		for (size_t i = 0; cache && i < cache->count; ++i) {
+			if (cache->items[i].address == address) {
+				lsap = cache->lsap[i];
+				break;
+			}
+		}
+		dc_global_unlock ();
+
+		if (lsap == 0) {
+			ERROR (context, "No LSAP selector known for the device.");
+			return DC_STATUS_INVALIDARGS;
+		}
+	}
+
 	INFO (context, "Open: address=%08x, lsap=%u", address, lsap);
 
 	// Allocate memory.
@@ -332,6 +440,23 @@ dc_irda_open (dc_iostream_t **out, dc_context_t *context, unsigned int address,
 		goto error_close;
 	}
 
+	// Remember the LSAP selector for the next connection.
+	dc_global_lock ();
+	dc_irda_cache_t *cache = dc_irda_cache_get (context);
+	if (cache) {
+		size_t i = 0;
+		while (i < cache->count && cache->items[i].address != address)
+			i++;
+		if (i == cache->count && i < DISCOVER_MAX_DEVICES) {
+			memset (&cache->items[i], 0, sizeof (cache->items[i]));
+			cache->items[i].address = address;
+			cache->count++;
+		}
+		if (i < cache->count)
+			cache->lsap[i] = lsap;
+	}
+	dc_global_unlock ();
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
@@ -35,7 +35,7 @@ dc_iterator_allocate (dc_context_t *context, const dc_iterator_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_iterator_t));
 
 	// Allocate memory.
-	iterator = (dc_iterator_t *) malloc (vtable->size);
+	iterator = (dc_iterator_t *) dc_context_malloc (context, vtable->size);
 	if (iterator == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return iterator;
@@ -50,7 +50,7 @@ dc_iterator_allocate (dc_context_t *context, const dc_iterator_vtable_t *vtable)
 void
 dc_iterator_deallocate (dc_iterator_t *iterator)
 {
-	free (iterator);
+	dc_context_dealloc (iterator->context, iterator);
 }
 
 int
@@ -64,6 +64,9 @@
 #define PAGESIZE    0x1000
 #define MEMSIZE     0x200000
 
+#define WAKEUP_SIZE  6000
+#define WAKEUP_CHUNK 600
+
 #define RB_LOGBOOK_BEGIN         (1 * PAGESIZE)
 #define RB_LOGBOOK_END           (25 * PAGESIZE)
 #define RB_LOGBOOK_SIZE          (RB_LOGBOOK_END - RB_LOGBOOK_BEGIN)
@@ -97,7 +100,9 @@ static const dc_device_vtable_t liquivision_lynx_device_vtable = {
 	liquivision_lynx_device_read, /* read */
 	NULL, /* write */
 	liquivision_lynx_device_dump, /* dump */
+	NULL, /* dump_update */
 	liquivision_lynx_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	liquivision_lynx_device_close /* close */
 };
@@ -268,9 +273,13 @@ liquivision_lynx_device_open (dc_device_t **out, dc_context_t *context, dc_iostr
 	dc_iostream_sleep (device->iostream, 100);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
 
-	// Wakeup the device.
-	for (unsigned int i = 0; i < 6000; ++i) {
-		const unsigned char init[] = {0xAA};
+	// Wakeup the device. The wakeup bytes are sent in a few large writes
+	// instead of one byte at a time, which results in exactly the same
+	// data on the line, but avoids thousands of tiny transfers (e.g. with
+	// USB serial adapters).
+	unsigned char init[WAKEUP_CHUNK];
+	memset (init, 0xAA, sizeof (init));
+	for (unsigned int i = 0; i < WAKEUP_SIZE; i += sizeof (init)) {
 		dc_iostream_write (device->iostream, init, sizeof (init), NULL);
 	}
 
@@ -451,7 +460,7 @@ liquivision_lynx_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the logbook entries.
-	unsigned char *logbook = (unsigned char *) malloc (rb_logbook_size);
+	unsigned char *logbook = (unsigned char *) dc_context_malloc (abstract->context, rb_logbook_size);
 	if (logbook == NULL) {
 		status = DC_STATUS_NOMEMORY;
 		goto error_exit;
@@ -459,7 +468,7 @@ liquivision_lynx_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rblogbook = NULL;
-	status = dc_rbstream_new (&rblogbook, abstract, SEGMENTSIZE, SEGMENTSIZE, RB_LOGBOOK_BEGIN, RB_LOGBOOK_END, rb_logbook_end);
+	status = dc_rbstream_new (&rblogbook, abstract, SEGMENTSIZE, SEGMENTSIZE, RB_LOGBOOK_BEGIN, RB_LOGBOOK_END, rb_logbook_end, DC_RBSTREAM_BACKWARD);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		goto error_free_logbook;
@@ -582,7 +591,7 @@ liquivision_lynx_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the profile data.
-	unsigned char *profile = (unsigned char *) malloc (headersize + rb_profile_size);
+	unsigned char *profile = (unsigned char *) dc_context_malloc (abstract->context, headersize + rb_profile_size);
 	if (profile == NULL) {
 		status = DC_STATUS_NOMEMORY;
 		goto error_free_rblogbook;
@@ -590,7 +599,7 @@ liquivision_lynx_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbprofile = NULL;
-	status = dc_rbstream_new (&rbprofile, abstract, SEGMENTSIZE, SEGMENTSIZE, RB_PROFILE_BEGIN, RB_PROFILE_END, rb_profile_end);
+	status = dc_rbstream_new (&rbprofile, abstract, SEGMENTSIZE, SEGMENTSIZE, RB_PROFILE_BEGIN, RB_PROFILE_END, rb_profile_end, DC_RBSTREAM_BACKWARD);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		goto error_free_profile;
@@ -649,11 +658,11 @@ liquivision_lynx_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 error_free_rbprofile:
 	dc_rbstream_free (rbprofile);
 error_free_profile:
-	free (profile);
+	dc_context_dealloc (abstract->context, profile);
 error_free_rblogbook:
 	dc_rbstream_free (rblogbook);
 error_free_logbook:
-	free (logbook);
+	dc_context_dealloc (abstract->context, logbook);
 error_exit:
 	return status;
 }
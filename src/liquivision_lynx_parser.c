@@ -93,27 +93,15 @@
 
 typedef struct liquivision_lynx_parser_t liquivision_lynx_parser_t;
 
-typedef struct liquivision_lynx_gasmix_t {
-	unsigned int oxygen;
-	unsigned int helium;
-} liquivision_lynx_gasmix_t;
-
-typedef struct liquivision_lynx_tank_t {
-	unsigned int id;
-	unsigned int beginpressure;
-	unsigned int endpressure;
-} liquivision_lynx_tank_t;
-
 struct liquivision_lynx_parser_t {
 	dc_parser_t base;
 	unsigned int model;
 	unsigned int headersize;
 	// Cached fields.
-	unsigned int cached;
 	unsigned int ngasmixes;
 	unsigned int ntanks;
-	liquivision_lynx_gasmix_t gasmix[NGASMIXES];
-	liquivision_lynx_tank_t tank[NTANKS];
+	dc_parser_gasmix_t gasmix[NGASMIXES];
+	dc_parser_tank_t tank[NTANKS];
 };
 
 static dc_status_t liquivision_lynx_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -150,7 +138,6 @@ liquivision_lynx_parser_create (dc_parser_t **out, dc_context_t *context, unsign
 	// Set the default values.
 	parser->model = model;
 	parser->headersize = (model == XEN) ? SZ_HEADER_XEN : SZ_HEADER_OTHER;
-	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
@@ -175,7 +162,6 @@ liquivision_lynx_parser_set_data (dc_parser_t *abstract, const unsigned char *da
 	liquivision_lynx_parser_t *parser = (liquivision_lynx_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
@@ -224,8 +210,15 @@ liquivision_lynx_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 	if (abstract->size < parser->headersize)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		dc_status_t rc = liquivision_lynx_parser_samples_foreach (abstract, NULL, NULL);
+	// The gas mixes and tanks are only available in the profile.
+	if (!parser->base.cached && dc_parser_is_summary (parser)) {
+		if (type == DC_FIELD_GASMIX_COUNT ||
+			type == DC_FIELD_GASMIX ||
+			type == DC_FIELD_TANK_COUNT ||
+			type == DC_FIELD_TANK)
+			return DC_STATUS_FULLSCAN;
+	} else {
+		dc_status_t rc = dc_parser_cache_profile (abstract);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -345,8 +338,8 @@ liquivision_lynx_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 
 	unsigned int ngasmixes = 0;
 	unsigned int ntanks = 0;
-	liquivision_lynx_gasmix_t gasmix[NGASMIXES] = {0};
-	liquivision_lynx_tank_t tank[NTANKS] = {0};
+	dc_parser_gasmix_t gasmix[NGASMIXES] = {0};
+	dc_parser_tank_t tank[NTANKS] = {0};
 	unsigned int o2_previous = INVALID, he_previous = INVALID;
 	unsigned int gasmix_idx = INVALID;
 	unsigned int have_gasmix = 0;
@@ -436,12 +429,7 @@ liquivision_lynx_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 				he = data[offset + 1];
 				if (o2 != o2_previous || he != he_previous) {
 					// Find the gasmix in the list.
-					unsigned int i = 0;
-					while (i < ngasmixes) {
-						if (o2 == gasmix[i].oxygen && he == gasmix[i].helium)
-							break;
-						i++;
-					}
+					unsigned int i = dc_parser_find_gasmix (gasmix, 0, ngasmixes, o2, he);
 
 					// Add it to list if not found.
 					if (i >= ngasmixes) {
@@ -590,7 +578,7 @@ liquivision_lynx_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 	}
 	parser->ngasmixes = ngasmixes;
 	parser->ntanks = ntanks;
-	parser->cached = 1;
+	parser->base.cached = 1;
 
 	return DC_STATUS_SUCCESS;
 }
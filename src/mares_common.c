@@ -224,7 +224,7 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 	// Make the ringbuffer linear, to avoid having to deal
 	// with the wrap point. The buffer has extra space to
 	// store the profile data for the freedives.
-	unsigned char *buffer = (unsigned char *) malloc (
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (context,
 		layout->rb_profile_end - layout->rb_profile_begin +
 		layout->rb_freedives_end - layout->rb_freedives_begin);
 	if (buffer == NULL) {
@@ -305,7 +305,7 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		unsigned int length = array_uint16_le (buffer + offset);
 		if (length != nbytes) {
 			ERROR (context, "Calculated and stored size are not equal (%u %u).", length, nbytes);
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -333,7 +333,7 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 			// both values are different, the profile data is incomplete.
 			if (count != nsamples) {
 				ERROR (context, "Unexpected number of freedive sessions (%u %u).", count, nsamples);
-				free (buffer);
+				dc_context_dealloc (context, buffer);
 				return DC_STATUS_DATAFORMAT;
 			}
 
@@ -346,17 +346,17 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 
 		unsigned int fp_offset = offset + length - extra - FP_OFFSET;
 		if (fingerprint && memcmp (buffer + fp_offset, fingerprint, FP_SIZE) == 0) {
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return DC_STATUS_SUCCESS;
 		}
 
 		if (callback && !callback (buffer + offset, nbytes, buffer + fp_offset, FP_SIZE, userdata)) {
-			free (buffer);
+			dc_context_dealloc (context, buffer);
 			return DC_STATUS_SUCCESS;
 		}
 	}
 
-	free (buffer);
+	dc_context_dealloc (context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -28,6 +28,7 @@
 #include "mares_darwin.h"
 #include "mares_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 
@@ -68,7 +69,9 @@ static const dc_device_vtable_t mares_darwin_device_vtable = {
 	mares_common_device_read, /* read */
 	NULL, /* write */
 	mares_darwin_device_dump, /* dump */
+	NULL, /* dump_update */
 	mares_darwin_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -211,7 +214,7 @@ mares_darwin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 
 	assert (device->layout != NULL);
 
-	dc_buffer_t *buffer = dc_buffer_new (device->layout->memsize);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, device->layout->memsize);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -265,7 +268,7 @@ mares_darwin_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 	}
 
 	// Allocate memory for the largest possible dive.
-	unsigned char *buffer = (unsigned char *) malloc (layout->rb_logbook_size + layout->rb_profile_end - layout->rb_profile_begin);
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (abstract->context, layout->rb_logbook_size + layout->rb_profile_end - layout->rb_profile_begin);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -305,19 +308,19 @@ mares_darwin_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 		}
 
 		if (memcmp (buffer, device->fingerprint, sizeof (device->fingerprint)) == 0) {
-			free (buffer);
+			dc_context_dealloc (abstract->context, buffer);
 			return DC_STATUS_SUCCESS;
 		}
 
 		if (callback && !callback (buffer, layout->rb_logbook_size + length, buffer, 6, userdata)) {
-			free (buffer);
+			dc_context_dealloc (abstract->context, buffer);
 			return DC_STATUS_SUCCESS;
 		}
 
 		remaining -= length;
 	}
 
-	free (buffer);
+	dc_context_dealloc (abstract->context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
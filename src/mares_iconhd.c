@@ -25,9 +25,11 @@
 
 #include "mares_iconhd.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 #include "rbstream.h"
+#include "bleline.h"
 #include "platform.h"
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
@@ -52,6 +54,10 @@
 
 #define MAXRETRIES 4
 
+#define PIPELINE 2
+
+#define SZ_HEADER_MAX 0x84
+
 #define ACK 0xAA
 #define EOF 0xEA
 #define XOR 0xA5
@@ -94,16 +100,16 @@ typedef struct mares_iconhd_device_t {
 	unsigned char version[140];
 	unsigned int model;
 	unsigned int packetsize;
-	unsigned char cache[20];
-	unsigned int available;
-	unsigned int offset;
+	dc_bleline_t *bleline;
 	unsigned int splitcommand;
+	unsigned int pipeline;
 } mares_iconhd_device_t;
 
 static dc_status_t mares_iconhd_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
 static dc_status_t mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
 static dc_status_t mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
 static dc_status_t mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
+static dc_status_t mares_iconhd_device_close (dc_device_t *abstract);
 
 static const dc_device_vtable_t mares_iconhd_device_vtable = {
 	sizeof(mares_iconhd_device_t),
@@ -112,9 +118,11 @@ static const dc_device_vtable_t mares_iconhd_device_vtable = {
 	mares_iconhd_device_read, /* read */
 	NULL, /* write */
 	mares_iconhd_device_dump, /* dump */
+	NULL, /* dump_update */
 	mares_iconhd_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
-	NULL /* close */
+	mares_iconhd_device_close /* close */
 };
 
 static const mares_iconhd_layout_t mares_iconhd_layout = {
@@ -176,41 +184,19 @@ static dc_status_t
 mares_iconhd_read (mares_iconhd_device_t *device, unsigned char data[], size_t size)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_transport_t transport = dc_iostream_get_transport(device->iostream);
 
 	size_t nbytes = 0;
 	while (nbytes < size) {
-		if (transport == DC_TRANSPORT_BLE) {
-			if (device->available == 0) {
-				// Read a packet into the cache.
-				size_t len = 0;
-				rc = dc_iostream_read (device->iostream, device->cache, sizeof(device->cache), &len);
-				if (rc != DC_STATUS_SUCCESS)
-					return rc;
-
-				device->available = len;
-				device->offset = 0;
-			}
-		}
-
-		// Set the minimum packet size.
-		size_t length = (transport == DC_TRANSPORT_BLE) ? device->available : size - nbytes;
-
-		// Limit the packet size to the total size.
-		if (nbytes + length > size)
-			length = size - nbytes;
-
-		if (transport == DC_TRANSPORT_BLE) {
-			// Copy the data from the cached packet.
-			memcpy (data + nbytes, device->cache + device->offset, length);
-			device->available -= length;
-			device->offset += length;
+		size_t length = 0;
+		if (device->bleline) {
+			// Read the data from the (buffered) BLE packets.
+			rc = dc_bleline_read (device->bleline, data + nbytes, size - nbytes, &length);
 		} else {
 			// Read the packet.
-			rc = dc_iostream_read (device->iostream, data + nbytes, length, &length);
-			if (rc != DC_STATUS_SUCCESS)
-				return rc;
+			rc = dc_iostream_read (device->iostream, data + nbytes, size - nbytes, &length);
 		}
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
 
 		nbytes += length;
 	}
@@ -221,51 +207,19 @@ mares_iconhd_read (mares_iconhd_device_t *device, unsigned char data[], size_t s
 static dc_status_t
 mares_iconhd_write (mares_iconhd_device_t *device, const unsigned char data[], size_t size)
 {
-	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_transport_t transport = dc_iostream_get_transport(device->iostream);
-
-	size_t nbytes = 0;
-	while (nbytes < size) {
-		// Set the maximum packet size.
-		size_t length = (transport == DC_TRANSPORT_BLE) ? sizeof(device->cache) : size - nbytes;
-
-		// Limit the packet size to the total size.
-		if (nbytes + length > size)
-			length = size - nbytes;
-
-		// Write the packet.
-		rc = dc_iostream_write (device->iostream, data + nbytes, length, &length);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		nbytes += length;
+	if (device->bleline) {
+		// Split the data into packets no larger than the MTU.
+		return dc_bleline_write (device->bleline, data, size);
 	}
 
-	return rc;
+	return dc_iostream_write (device->iostream, data, size, NULL);
 }
 
 static dc_status_t
-mares_iconhd_packet (mares_iconhd_device_t *device,
-	const unsigned char command[], unsigned int csize,
-	unsigned char answer[], unsigned int asize)
+mares_iconhd_ack (mares_iconhd_device_t *device)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
-	unsigned int split_csize;
-
-	assert (csize >= 2);
-
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	split_csize = device->splitcommand ? 2 : csize;
-
-	// Send the command header to the dive computer.
-	status = mares_iconhd_write (device, command, split_csize);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
 
 	// Receive the header byte.
 	unsigned char header[1] = {0};
@@ -281,14 +235,14 @@ mares_iconhd_packet (mares_iconhd_device_t *device,
 		return DC_STATUS_PROTOCOL;
 	}
 
-	// Send any remaining command payload to the dive computer.
-	if (csize > split_csize) {
-		status = mares_iconhd_write (device, command + split_csize, csize - split_csize);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to send the command.");
-			return status;
-		}
-	}
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_iconhd_answer (mares_iconhd_device_t *device, unsigned char answer[], unsigned int asize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
 
 	// Read the packet.
 	status = mares_iconhd_read (device, answer, asize);
@@ -314,29 +268,70 @@ mares_iconhd_packet (mares_iconhd_device_t *device,
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+mares_iconhd_packet (mares_iconhd_device_t *device,
+	const unsigned char command[], unsigned int csize,
+	unsigned char answer[], unsigned int asize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned int split_csize;
+
+	assert (csize >= 2);
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	split_csize = device->splitcommand ? 2 : csize;
+
+	// Send the command header to the dive computer.
+	status = mares_iconhd_write (device, command, split_csize);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to send the command.");
+		return status;
+	}
+
+	// Receive the header byte.
+	status = mares_iconhd_ack (device);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// Send any remaining command payload to the dive computer.
+	if (csize > split_csize) {
+		status = mares_iconhd_write (device, command + split_csize, csize - split_csize);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the command.");
+			return status;
+		}
+	}
+
+	return mares_iconhd_answer (device, answer, asize);
+}
+
 static dc_status_t
 mares_iconhd_transfer (mares_iconhd_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
-	unsigned int nretries = 0;
+	dc_trace_span_t span;
+	TRACE_BEGIN (device->base.context, &span, command[0], csize, asize);
+
+	device_retry_t retry;
+	device_retry_init (&retry, (dc_device_t *) device, MAXRETRIES, 100);
+
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = mares_iconhd_packet (device, command, csize, answer, asize)) != DC_STATUS_SUCCESS) {
 		// Automatically discard a corrupted packet,
 		// and request a new one.
-		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
-			return rc;
-
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
-			return rc;
+		if (!device_retry_next (&retry, device->iostream, rc))
+			break;
 
 		// Discard any garbage bytes.
-		dc_iostream_sleep (device->iostream, 100);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
-		device->available = 0;
-		device->offset = 0;
+		dc_bleline_discard (device->bleline);
 	}
 
-	return DC_STATUS_SUCCESS;
+	TRACE_END (device->base.context, &span, rc);
+
+	return rc;
 }
 
 static dc_status_t
@@ -347,6 +342,9 @@ mares_iconhd_read_object(mares_iconhd_device_t *device, dc_event_progress_t *pro
 	dc_transport_t transport = dc_iostream_get_transport (device->iostream);
 	const unsigned int maxpacket = (transport == DC_TRANSPORT_BLE) ? 124 : 504;
 
+	// Remember the initial state, to be able to start again.
+	size_t offset = dc_buffer_get_size (buffer);
+
 	// Update and emit a progress event.
 	unsigned int initial = 0;
 	if (progress) {
@@ -406,7 +404,8 @@ mares_iconhd_read_object(mares_iconhd_device_t *device, dc_event_progress_t *pro
 		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 	}
 
-	unsigned int npackets = 0;
+	unsigned int npackets = 0, nsent = 0;
+	unsigned int total = (size - nbytes + maxpacket - 1) / maxpacket;
 	while (nbytes < size) {
 		// Get the command byte.
 		unsigned char toggle = npackets % 2;
@@ -421,10 +420,47 @@ mares_iconhd_read_object(mares_iconhd_device_t *device, dc_event_progress_t *pro
 		// Transfer the segment packet.
 		unsigned char rsp_segment[1 + 504];
 		unsigned char cmd_segment[] = {cmd, cmd ^ XOR};
-		status = mares_iconhd_transfer (device, cmd_segment, sizeof (cmd_segment), rsp_segment, len + 1);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to transfer the segment packet.");
-			return status;
+		if (device->pipeline > 1) {
+			// Keep the next segment requests queued behind the one being
+			// answered, to avoid the idle round trip between segments.
+			if (device_is_cancelled (abstract))
+				return DC_STATUS_CANCELLED;
+
+			while (status == DC_STATUS_SUCCESS && nsent < total && nsent < npackets + device->pipeline) {
+				unsigned char c = (nsent % 2) == 0 ? CMD_OBJ_EVEN : CMD_OBJ_ODD;
+				unsigned char c_segment[] = {c, c ^ XOR};
+				status = mares_iconhd_write (device, c_segment, sizeof (c_segment));
+				nsent++;
+			}
+			if (status == DC_STATUS_SUCCESS)
+				status = mares_iconhd_ack (device);
+			if (status == DC_STATUS_SUCCESS)
+				status = mares_iconhd_answer (device, rsp_segment, len + 1);
+			if (status == DC_STATUS_SUCCESS && (rsp_segment[0] & 0xF0) >> 4 != toggle)
+				status = DC_STATUS_PROTOCOL;
+			if (status != DC_STATUS_SUCCESS) {
+				if (status == DC_STATUS_CANCELLED)
+					return status;
+
+				// The state of the outstanding requests is unknown.
+				// Discard them, and start again without pipelining.
+				WARNING (abstract->context, "Pipelined segment request failed, disabling pipelining.");
+				device->pipeline = 1;
+				dc_iostream_sleep (device->iostream, 100);
+				dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+				dc_bleline_discard (device->bleline);
+				dc_buffer_resize (buffer, offset);
+				if (progress) {
+					progress->current = initial;
+				}
+				return mares_iconhd_read_object (device, progress, buffer, index, subindex);
+			}
+		} else {
+			status = mares_iconhd_transfer (device, cmd_segment, sizeof (cmd_segment), rsp_segment, len + 1);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to transfer the segment packet.");
+				return status;
+			}
 		}
 
 		// Verify the packet header.
@@ -476,9 +512,8 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 	memset (device->version, 0, sizeof (device->version));
 	device->model = 0;
 	device->packetsize = 0;
-	memset (device->cache, 0, sizeof (device->cache));
-	device->available = 0;
-	device->offset = 0;
+	device->bleline = NULL;
+	device->pipeline = 1;
 
 	/*
 	 * At least the Mares Matrix needs the command to be split into
@@ -489,6 +524,14 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 	 */
 	device->splitcommand = 1;
 
+	// The BLE packets are buffered, and sized to the negotiated MTU.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) {
+		status = dc_bleline_new (&device->bleline, context, device->iostream);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_free;
+		}
+	}
+
 	// Set the serial communication protocol (115200 8E1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_EVEN, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -576,6 +619,7 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 		device->layout = &mares_iconhdnet_layout;
 		device->packetsize = 256;
 		device->fingerprint_size = 4;
+		device->pipeline = PIPELINE;
 		break;
 	case ICONHDNET:
 		device->layout = &mares_iconhdnet_layout;
@@ -613,11 +657,23 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 	return DC_STATUS_SUCCESS;
 
 error_free:
+	dc_bleline_free (device->bleline);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
 
 
+static dc_status_t
+mares_iconhd_device_close (dc_device_t *abstract)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+
+	dc_bleline_free (device->bleline);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 mares_iconhd_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -688,8 +744,8 @@ mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), device->packetsize);
+	return device_dump_read_adaptive (abstract, dc_buffer_get_data (buffer),
+		dc_buffer_get_size (buffer), device->packetsize, 64);
 }
 
 static dc_status_t
@@ -749,39 +805,36 @@ mares_iconhd_device_foreach_raw (dc_device_t *abstract, dc_dive_callback_t callb
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, 1, device->packetsize, layout->rb_profile_begin, layout->rb_profile_end, eop);
+	rc = dc_rbstream_new (&rbstream, abstract, 1, device->packetsize, layout->rb_profile_begin, layout->rb_profile_end, eop, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
 	}
 
-	// Allocate memory for the dives.
-	unsigned char *buffer = (unsigned char *) malloc (layout->rb_profile_end - layout->rb_profile_begin);
-	if (buffer == NULL) {
-		ERROR (abstract->context, "Failed to allocate memory.");
-		dc_rbstream_free (rbstream);
-		return DC_STATUS_NOMEMORY;
-	}
+	// The dive header is read first, into a separate buffer. The memory for
+	// the dive itself is only allocated once its size is known, and reused
+	// for the next dives.
+	unsigned char data[SZ_HEADER_MAX] = {0};
+	unsigned char *buffer = NULL;
+	unsigned int capacity = 0;
 
 	unsigned int offset = layout->rb_profile_end - layout->rb_profile_begin;
 	while (offset >= header + 4) {
 		// Read the first part of the dive header.
-		rc = dc_rbstream_read (rbstream, &progress, buffer + offset - header, header);
+		rc = dc_rbstream_read (rbstream, &progress, data + sizeof(data) - header, header);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
-			dc_rbstream_free (rbstream);
-			free (buffer);
-			return rc;
+			break;
 		}
 
 		// Get the number of samples in the profile data.
 		unsigned int type = 0, nsamples = 0;
 		if (model == SMART || model == SMARTAPNEA || model == SMARTAIR) {
-			type     = array_uint16_le (buffer + offset - header + 2);
-			nsamples = array_uint16_le (buffer + offset - header + 0);
+			type     = array_uint16_le (data + sizeof(data) - header + 2);
+			nsamples = array_uint16_le (data + sizeof(data) - header + 0);
 		} else {
-			type     = array_uint16_le (buffer + offset - header + 0);
-			nsamples = array_uint16_le (buffer + offset - header + 2);
+			type     = array_uint16_le (data + sizeof(data) - header + 0);
+			nsamples = array_uint16_le (data + sizeof(data) - header + 2);
 		}
 		if (nsamples == 0xFFFF || type == 0xFFFF)
 			break;
@@ -822,12 +875,17 @@ mares_iconhd_device_foreach_raw (dc_device_t *abstract, dc_dive_callback_t callb
 			break;
 
 		// Read the second part of the dive header.
-		rc = dc_rbstream_read (rbstream, &progress, buffer + offset - headersize, headersize - header);
+		const unsigned char *dive_header = data + sizeof(data) - headersize;
+		rc = dc_rbstream_read (rbstream, &progress, data + sizeof(data) - headersize, headersize - header);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
-			dc_rbstream_free (rbstream);
-			free (buffer);
-			return rc;
+			break;
+		}
+
+		// The fingerprint is located in the dive header. Stop before
+		// downloading the profile data of a dive that is already known.
+		if (memcmp (dive_header + fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+			break;
 		}
 
 		// Calculate the total number of bytes for this dive.
@@ -838,8 +896,8 @@ mares_iconhd_device_foreach_raw (dc_device_t *abstract, dc_dive_callback_t callb
 		if (model == ICONHDNET || model == QUADAIR || model == SMARTAIR) {
 			nbytes += (nsamples / 4) * 8;
 		} else if (model == SMARTAPNEA) {
-			unsigned int settings = array_uint16_le (buffer + offset - headersize + 0x1C);
-			unsigned int divetime = array_uint32_le (buffer + offset - headersize + 0x24);
+			unsigned int settings = array_uint16_le (dive_header + 0x1C);
+			unsigned int divetime = array_uint32_le (dive_header + 0x24);
 			unsigned int samplerate = 1 << ((settings >> 9) & 0x03);
 
 			nbytes += divetime * samplerate * 2;
@@ -847,13 +905,24 @@ mares_iconhd_device_foreach_raw (dc_device_t *abstract, dc_dive_callback_t callb
 		if (offset < nbytes)
 			break;
 
+		// Allocate memory for the dive.
+		if (nbytes > capacity) {
+			unsigned char *tmp = (unsigned char *) dc_context_realloc (abstract->context, buffer, nbytes);
+			if (tmp == NULL) {
+				ERROR (abstract->context, "Failed to allocate memory.");
+				rc = DC_STATUS_NOMEMORY;
+				break;
+			}
+			buffer = tmp;
+			capacity = nbytes;
+		}
+
 		// Read the remainder of the dive.
-		rc = dc_rbstream_read (rbstream, &progress, buffer + offset - nbytes, nbytes - headersize);
+		memcpy (buffer + nbytes - headersize, dive_header, headersize);
+		rc = dc_rbstream_read (rbstream, &progress, buffer, nbytes - headersize);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
-			dc_rbstream_free (rbstream);
-			free (buffer);
-			return rc;
+			break;
 		}
 
 		// Move to the start of the dive.
@@ -862,22 +931,18 @@ mares_iconhd_device_foreach_raw (dc_device_t *abstract, dc_dive_callback_t callb
 		// Verify that the length that is stored in the profile data
 		// equals the calculated length. If both values are different,
 		// we assume we reached the last dive.
-		unsigned int length = array_uint32_le (buffer + offset);
+		unsigned int length = array_uint32_le (buffer);
 		if (length != nbytes)
 			break;
 
-		unsigned char *fp = buffer + offset + length - headersize + fingerprint;
-		if (memcmp (fp, device->fingerprint, sizeof (device->fingerprint)) == 0) {
-			break;
-		}
-
-		if (callback && !callback (buffer + offset, length, fp, sizeof (device->fingerprint), userdata)) {
+		unsigned char *fp = buffer + length - headersize + fingerprint;
+		if (callback && !callback (buffer, length, fp, sizeof (device->fingerprint), userdata)) {
 			break;
 		}
 	}
 
 	dc_rbstream_free (rbstream);
-	free (buffer);
+	dc_context_dealloc (abstract->context, buffer);
 
 	return rc;
 }
@@ -893,7 +958,7 @@ mares_iconhd_device_foreach_object (dc_device_t *abstract, dc_dive_callback_t ca
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the dives.
-	dc_buffer_t *buffer = dc_buffer_new (4096);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 4096);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
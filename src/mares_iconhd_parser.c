@@ -28,16 +28,26 @@
 #include "parser-private.h"
 #include "array.h"
 #include "checksum.h"
+#include "platform.h"
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &mares_iconhd_parser_vtable)
 
+#define MATRIX     0x0F
 #define SMART      0x000010
 #define SMARTAPNEA 0x010010
 #define ICONHD    0x14
 #define ICONHDNET 0x15
+#define PUCKPRO   0x18
+#define NEMOWIDE2 0x19
 #define GENIUS    0x1C
+#define PUCK2     0x1F
 #define QUADAIR   0x23
 #define SMARTAIR  0x24
+#define QUAD      0x29
+
+// Sample layouts
+#define LAYOUT_AIR    0x01 // Tank pressure record after every 4 samples
+#define LAYOUT_GENIUS 0x02 // Tagged records
 
 #define NGASMIXES_ICONHD 3
 #define NGASMIXES_GENIUS 5
@@ -157,7 +167,7 @@ static const dc_parser_vtable_t mares_iconhd_parser_vtable = {
 };
 
 static unsigned int
-mares_genius_isvalid (const unsigned char data[], size_t size, unsigned int type)
+mares_genius_isvalid (mares_iconhd_parser_t *parser, const unsigned char data[], size_t size, unsigned int type)
 {
 	if (size < 10) {
 		return 0;
@@ -169,6 +179,11 @@ mares_genius_isvalid (const unsigned char data[], size_t size, unsigned int type
 		return 0;
 	}
 
+	// The checksum was already verified when the data was downloaded.
+	if (dc_parser_is_trusted (parser)) {
+		return 1;
+	}
+
 	unsigned short crc = array_uint16_le(data + size - 6);
 	unsigned short ccrc = checksum_crc16_ccitt(data + 4, size - 10, 0x0000);
 	if (crc != ccrc) {
@@ -791,6 +806,28 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 				}
 			}
 			break;
+		case DC_FIELD_SAMPLE_COUNT:
+		case DC_FIELD_SAMPLE_CAPACITY:
+			if (parser->model == SMARTAPNEA) {
+				// Each record is followed by the depth samples of
+				// the dive, with the number of samples per second.
+				unsigned int count = 0;
+				unsigned int offset = 4;
+				for (unsigned int i = 0; i < parser->nsamples; ++i) {
+					if (offset + parser->samplesize > abstract->size)
+						return DC_STATUS_DATAFORMAT;
+					unsigned int divetime = array_uint16_le (abstract->data + offset + 2);
+					count += 1 + divetime;
+					offset += parser->samplesize + divetime * parser->samplerate * 2;
+				}
+				*((unsigned int *) value) = count;
+			} else if (parser->model != GENIUS && parser->mode == ICONHD_FREEDIVE) {
+				// A surface and a dive sample for each record.
+				*((unsigned int *) value) = parser->nsamples * 2;
+			} else {
+				*((unsigned int *) value) = parser->nsamples;
+			}
+			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
@@ -800,6 +837,169 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 }
 
 
+/*
+ * Decode the samples of a regular (non freedive) dive. This function is
+ * always inlined, and the layout is a constant for each of the
+ * specialized variants below, such that the compiler can eliminate all
+ * layout checks from the sample loop. Unknown models use the basic
+ * layout.
+ */
+static DC_ALWAYS_INLINE dc_status_t
+mares_iconhd_parser_samples_dive (mares_iconhd_parser_t *parser, unsigned int layout, const unsigned char *data, unsigned int *poffset, dc_sample_callback_t callback, void *userdata)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+
+	unsigned int genius = layout & LAYOUT_GENIUS;
+	unsigned int airintegrated = layout & LAYOUT_AIR;
+
+	// Size of the record type marker.
+	unsigned int marker = genius ? 4 : 0;
+
+	// Previous gas mix - initialize with impossible value
+	unsigned int gasmix_previous = 0xFFFFFFFF;
+
+	unsigned int offset = *poffset;
+	unsigned int time = 0;
+	unsigned int nsamples = 0;
+	while (nsamples < parser->nsamples) {
+		dc_sample_value_t sample = {0};
+
+		unsigned int depth = 0, temperature = 0;
+		unsigned int gasmix = 0, misc = 0, alarms = 0;
+		if (genius) {
+			if (!mares_genius_isvalid (parser, data + offset, DPRS_SIZE, DPRS_TYPE)) {
+				ERROR (abstract->context, "Invalid DPRS record.");
+				return DC_STATUS_DATAFORMAT;
+			}
+
+			depth = array_uint16_le (data + offset + marker + 0);
+			temperature = array_uint16_le (data + offset + marker + 4);
+			alarms = array_uint32_le (data + offset + marker + 0x0C);
+			misc = array_uint32_le (data + offset + marker + 0x14);
+			gasmix = (misc >> 6) & 0xF;
+		} else {
+			depth = array_uint16_le (data + offset + 0);
+			temperature = array_uint16_le (data + offset + 2) & 0x0FFF;
+			gasmix = (data[offset + 3] & 0xF0) >> 4;
+		}
+
+		// Time (seconds).
+		time += parser->interval;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Depth (1/10 m).
+		sample.depth = depth / 10.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		// Temperature (1/10 °C).
+		sample.temperature = temperature / 10.0;
+		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+
+		// Current gas mix
+		if (parser->ngasmixes > 0) {
+			if (gasmix >= parser->ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			if (gasmix != gasmix_previous) {
+				sample.gasmix = gasmix;
+				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				gasmix_previous = gasmix;
+			}
+		}
+
+		if (genius) {
+			// Deco stop / NDL.
+			unsigned int decostop  = (misc >> 18) & 0x01;
+			unsigned int decodepth = (misc >> 19) & 0x7F;
+			if (decostop) {
+				sample.deco.type = DC_DECO_DECOSTOP;
+				sample.deco.depth = decodepth;
+			} else {
+				sample.deco.type = DC_DECO_NDL;
+				sample.deco.depth = 0.0;
+			}
+			sample.deco.time = array_uint16_le (data + offset + marker + 0x0A) * 60;
+			if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+
+			// Alarms
+			for (unsigned int v = alarms, i = 0; v; v >>= 1, ++i) {
+				if ((v & 1) == 0) {
+					continue;
+				}
+
+				switch (i) {
+				case ALARM_FAST_ASCENT:
+				case ALARM_UNCONTROLLED_ASCENT:
+					sample.event.type = SAMPLE_EVENT_ASCENT;
+					break;
+				case ALARM_MISSED_DECO:
+				case ALARM_DIVE_VIOLATION_DECO:
+					sample.event.type = SAMPLE_EVENT_CEILING;
+					break;
+				default:
+					sample.event.type = SAMPLE_EVENT_NONE;
+					break;
+				}
+
+				if (sample.event.type != SAMPLE_EVENT_NONE) {
+					sample.event.time = 0;
+					sample.event.flags = 0;
+					sample.event.value = 0;
+					if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+				}
+			}
+		}
+
+		offset += parser->samplesize;
+		nsamples++;
+
+		// Some extra data.
+		if (airintegrated && (nsamples % 4) == 0) {
+			if (genius && !mares_genius_isvalid (parser, data + offset, AIRS_SIZE, AIRS_TYPE)) {
+				ERROR (abstract->context, "Invalid AIRS record.");
+				return DC_STATUS_DATAFORMAT;
+			}
+
+			// Pressure (1/100 bar).
+			unsigned int pressure = array_uint16_le(data + offset + marker + 0);
+			if (gasmix < parser->ntanks) {
+				sample.pressure.tank = gasmix;
+				sample.pressure.value = pressure / 100.0;
+				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+			} else if (pressure != 0) {
+				WARNING (abstract->context, "Invalid tank with non-zero pressure.");
+			}
+
+			offset += (genius) ? AIRS_SIZE : 8;
+		}
+	}
+
+	*poffset = offset;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_iconhd_parser_samples_basic (mares_iconhd_parser_t *parser, const unsigned char *data, unsigned int *offset, dc_sample_callback_t callback, void *userdata)
+{
+	return mares_iconhd_parser_samples_dive (parser, 0, data, offset, callback, userdata);
+}
+
+static dc_status_t
+mares_iconhd_parser_samples_air (mares_iconhd_parser_t *parser, const unsigned char *data, unsigned int *offset, dc_sample_callback_t callback, void *userdata)
+{
+	return mares_iconhd_parser_samples_dive (parser, LAYOUT_AIR, data, offset, callback, userdata);
+}
+
+static dc_status_t
+mares_iconhd_parser_samples_genius (mares_iconhd_parser_t *parser, const unsigned char *data, unsigned int *offset, dc_sample_callback_t callback, void *userdata)
+{
+	return mares_iconhd_parser_samples_dive (parser, LAYOUT_GENIUS | LAYOUT_AIR, data, offset, callback, userdata);
+}
+
+
 static dc_status_t
 mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
 {
@@ -820,13 +1020,7 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 		WARNING(abstract->context, "Multiple samples per second are not supported!");
 	}
 
-	// Previous gas mix - initialize with impossible value
-	unsigned int gasmix_previous = 0xFFFFFFFF;
-
-	unsigned int isairintegrated = (parser->model == ICONHDNET || parser->model == QUADAIR || parser->model == SMARTAIR || parser->model == GENIUS);
-
 	unsigned int offset = 4;
-	unsigned int marker = 0;
 	if (parser->model == GENIUS) {
 		// Skip the dive header.
 		data += parser->headersize;
@@ -842,29 +1036,26 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 		}
 
 		// Skip the DSTR record.
-		if (!mares_genius_isvalid (data + offset, DSTR_SIZE, DSTR_TYPE)) {
+		if (!mares_genius_isvalid (parser, data + offset, DSTR_SIZE, DSTR_TYPE)) {
 			ERROR (abstract->context, "Invalid DSTR record.");
 			return DC_STATUS_DATAFORMAT;
 		}
 		offset += DSTR_SIZE;
 
 		// Skip the TISS record.
-		if (!mares_genius_isvalid (data + offset, TISS_SIZE, TISS_TYPE)) {
+		if (!mares_genius_isvalid (parser, data + offset, TISS_SIZE, TISS_TYPE)) {
 			ERROR (abstract->context, "Invalid TISS record.");
 			return DC_STATUS_DATAFORMAT;
 		}
 		offset += TISS_SIZE;
-
-		// Size of the record type marker.
-		marker = 4;
 	}
 
 	unsigned int time = 0;
 	unsigned int nsamples = 0;
-	while (nsamples < parser->nsamples) {
-		dc_sample_value_t sample = {0};
+	if (parser->model == SMARTAPNEA) {
+		while (nsamples < parser->nsamples) {
+			dc_sample_value_t sample = {0};
 
-		if (parser->model == SMARTAPNEA) {
 			unsigned int maxdepth = array_uint16_le (data + offset + 0);
 			unsigned int divetime = array_uint16_le (data + offset + 2);
 			unsigned int surftime = array_uint16_le (data + offset + 4);
@@ -894,7 +1085,11 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 				offset += 2 * parser->samplerate;
 			}
-		} else if (parser->model != GENIUS && parser->mode == ICONHD_FREEDIVE) {
+		}
+	} else if (parser->model != GENIUS && parser->mode == ICONHD_FREEDIVE) {
+		while (nsamples < parser->nsamples) {
+			dc_sample_value_t sample = {0};
+
 			unsigned int maxdepth = array_uint16_le (data + offset + 0);
 			unsigned int divetime = array_uint16_le (data + offset + 2);
 			unsigned int surftime = array_uint16_le (data + offset + 4);
@@ -919,123 +1114,35 @@ mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 			offset += parser->samplesize;
 			nsamples++;
-		} else {
-			unsigned int depth = 0, temperature = 0;
-			unsigned int gasmix = 0, misc = 0, alarms = 0;
-			if (parser->model == GENIUS) {
-				if (!mares_genius_isvalid (data + offset, DPRS_SIZE, DPRS_TYPE)) {
-					ERROR (abstract->context, "Invalid DPRS record.");
-					return DC_STATUS_DATAFORMAT;
-				}
-
-				depth = array_uint16_le (data + offset + marker + 0);
-				temperature = array_uint16_le (data + offset + marker + 4);
-				alarms = array_uint32_le (data + offset + marker + 0x0C);
-				misc = array_uint32_le (data + offset + marker + 0x14);
-				gasmix = (misc >> 6) & 0xF;
-			} else {
-				depth = array_uint16_le (data + offset + 0);
-				temperature = array_uint16_le (data + offset + 2) & 0x0FFF;
-				gasmix = (data[offset + 3] & 0xF0) >> 4;
-			}
-
-			// Time (seconds).
-			time += parser->interval;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
-
-			// Depth (1/10 m).
-			sample.depth = depth / 10.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
-			// Temperature (1/10 °C).
-			sample.temperature = temperature / 10.0;
-			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-
-			// Current gas mix
-			if (parser->ngasmixes > 0) {
-				if (gasmix >= parser->ngasmixes) {
-					ERROR (abstract->context, "Invalid gas mix index.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				if (gasmix != gasmix_previous) {
-					sample.gasmix = gasmix;
-					if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-					gasmix_previous = gasmix;
-				}
-			}
-
-			if (parser->model == GENIUS) {
-				// Deco stop / NDL.
-				unsigned int decostop  = (misc >> 18) & 0x01;
-				unsigned int decodepth = (misc >> 19) & 0x7F;
-				if (decostop) {
-					sample.deco.type = DC_DECO_DECOSTOP;
-					sample.deco.depth = decodepth;
-				} else {
-					sample.deco.type = DC_DECO_NDL;
-					sample.deco.depth = 0.0;
-				}
-				sample.deco.time = array_uint16_le (data + offset + marker + 0x0A) * 60;
-				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
-
-				// Alarms
-				for (unsigned int v = alarms, i = 0; v; v >>= 1, ++i) {
-					if ((v & 1) == 0) {
-						continue;
-					}
-
-					switch (i) {
-					case ALARM_FAST_ASCENT:
-					case ALARM_UNCONTROLLED_ASCENT:
-						sample.event.type = SAMPLE_EVENT_ASCENT;
-						break;
-					case ALARM_MISSED_DECO:
-					case ALARM_DIVE_VIOLATION_DECO:
-						sample.event.type = SAMPLE_EVENT_CEILING;
-						break;
-					default:
-						sample.event.type = SAMPLE_EVENT_NONE;
-						break;
-					}
-
-					if (sample.event.type != SAMPLE_EVENT_NONE) {
-						sample.event.time = 0;
-						sample.event.flags = 0;
-						sample.event.value = 0;
-						if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
-					}
-				}
-			}
-
-			offset += parser->samplesize;
-			nsamples++;
-
-			// Some extra data.
-			if (isairintegrated && (nsamples % 4) == 0) {
-				if (parser->model == GENIUS && !mares_genius_isvalid (data + offset, AIRS_SIZE, AIRS_TYPE)) {
-					ERROR (abstract->context, "Invalid AIRS record.");
-					return DC_STATUS_DATAFORMAT;
-				}
-
-				// Pressure (1/100 bar).
-				unsigned int pressure = array_uint16_le(data + offset + marker + 0);
-				if (gasmix < parser->ntanks) {
-					sample.pressure.tank = gasmix;
-					sample.pressure.value = pressure / 100.0;
-					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
-				} else if (pressure != 0) {
-					WARNING (abstract->context, "Invalid tank with non-zero pressure.");
-				}
-
-				offset += (parser->model == GENIUS) ? AIRS_SIZE : 8;
-			}
 		}
+	} else {
+		switch (parser->model) {
+		case MATRIX:
+		case SMART:
+		case ICONHD:
+		case PUCKPRO:
+		case NEMOWIDE2:
+		case PUCK2:
+		case QUAD:
+		default:
+			rc = mares_iconhd_parser_samples_basic (parser, data, &offset, callback, userdata);
+			break;
+		case ICONHDNET:
+		case QUADAIR:
+		case SMARTAIR:
+			rc = mares_iconhd_parser_samples_air (parser, data, &offset, callback, userdata);
+			break;
+		case GENIUS:
+			rc = mares_iconhd_parser_samples_genius (parser, data, &offset, callback, userdata);
+			break;
+		}
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
 	}
 
 	if (parser->model == GENIUS) {
 		// Skip the DEND record.
-		if (!mares_genius_isvalid (data + offset, DEND_SIZE, DEND_TYPE)) {
+		if (!mares_genius_isvalid (parser, data + offset, DEND_SIZE, DEND_TYPE)) {
 			ERROR (abstract->context, "Invalid DEND record.");
 			return DC_STATUS_DATAFORMAT;
 		}
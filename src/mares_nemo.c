@@ -25,6 +25,7 @@
 #include "mares_nemo.h"
 #include "mares_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -59,7 +60,9 @@ static const dc_device_vtable_t mares_nemo_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	mares_nemo_device_dump, /* dump */
+	NULL, /* dump_update */
 	mares_nemo_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -254,7 +257,7 @@ mares_nemo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 {
 	mares_nemo_device_t *device = (mares_nemo_device_t *) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (MEMORYSIZE);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, MEMORYSIZE);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -26,6 +26,7 @@
 #include "mares_puck.h"
 #include "mares_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -54,7 +55,9 @@ static const dc_device_vtable_t mares_puck_device_vtable = {
 	mares_common_device_read, /* read */
 	NULL, /* write */
 	mares_puck_device_dump, /* dump */
+	NULL, /* dump_update */
 	mares_puck_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -214,7 +217,7 @@ mares_puck_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 
 	assert (device->layout != NULL);
 
-	dc_buffer_t *buffer = dc_buffer_new (device->layout->memsize);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, device->layout->memsize);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -24,6 +24,7 @@
 
 #include "mclean_extreme.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 
@@ -71,7 +72,9 @@ static const dc_device_vtable_t mclean_extreme_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	mclean_extreme_device_foreach, /* foreach */
+	NULL, /* extract */
 	mclean_extreme_device_timesync, /* timesync */
 	mclean_extreme_device_close, /* close */
 };
@@ -295,27 +298,17 @@ mclean_extreme_transfer(mclean_extreme_device_t *device, unsigned char cmd, cons
 }
 
 static dc_status_t
-mclean_extreme_readdive (dc_device_t *abstract, dc_event_progress_t *progress, unsigned int idx, dc_buffer_t *buffer)
+mclean_extreme_requestdive (dc_device_t *abstract, unsigned int idx)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	mclean_extreme_device_t *device = (mclean_extreme_device_t *) abstract;
 
-	// Erase the buffer.
-	dc_buffer_clear (buffer);
-
 	// Encode the logbook ID.
 	unsigned char id[] = {
 		(idx     ) & 0xFF,
 		(idx >> 8) & 0xFF,
 	};
 
-	// Update and emit a progress event.
-	unsigned int initial = 0;
-	if (progress) {
-		initial = progress->current;
-		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
-	}
-
 	// Request the dive.
 	status = mclean_extreme_send (device, CMD_DIVE, id, sizeof(id));
 	if (status != DC_STATUS_SUCCESS) {
@@ -323,6 +316,25 @@ mclean_extreme_readdive (dc_device_t *abstract, dc_event_progress_t *progress, u
 		return status;
 	}
 
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mclean_extreme_readdive (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *buffer)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	mclean_extreme_device_t *device = (mclean_extreme_device_t *) abstract;
+
+	// Erase the buffer.
+	dc_buffer_clear (buffer);
+
+	// Update and emit a progress event.
+	unsigned int initial = 0;
+	if (progress) {
+		initial = progress->current;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+	}
+
 	// Read the dive header.
 	unsigned char header[SZ_HEADER];
 	status = mclean_extreme_receive (device, CMD_DIVE, header, sizeof(header), NULL);
@@ -560,18 +572,23 @@ mclean_extreme_device_foreach(dc_device_t *abstract, dc_dive_callback_t callback
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate a memory buffer for a single dive.
-	dc_buffer_t *buffer = dc_buffer_new(0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL) {
 		status = DC_STATUS_NOMEMORY;
 		goto error_exit;
 	}
 
-	for (unsigned int i = 0; i < ndives; ++i) {
-		// Download in reverse order (newest first).
-		unsigned int idx = ndives - 1 - i;
+	// Request the newest dive.
+	if (ndives) {
+		status = mclean_extreme_requestdive (abstract, ndives - 1);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_buffer_free;
+		}
+	}
 
-		// Read the dive.
-		status = mclean_extreme_readdive (abstract, &progress, idx, buffer);
+	for (unsigned int i = 0; i < ndives; ++i) {
+		// Read the dive, which has already been requested.
+		status = mclean_extreme_readdive (abstract, &progress, buffer);
 		if (status != DC_STATUS_SUCCESS) {
 			goto error_buffer_free;
 		}
@@ -583,7 +600,27 @@ mclean_extreme_device_foreach(dc_device_t *abstract, dc_dive_callback_t callback
 		if (memcmp(data, device->fingerprint, sizeof(device->fingerprint)) == 0)
 			break;
 
+		// Request the next dive (in reverse order, newest first) before
+		// handing this one to the application. The dive computer needs
+		// several seconds before it starts answering, which now overlaps
+		// with the processing in the callback. The protocol doesn't allow
+		// more than one outstanding request, because the responses can't
+		// be told apart.
+		unsigned int pending = 0;
+		if (i + 1 < ndives) {
+			status = mclean_extreme_requestdive (abstract, ndives - 2 - i);
+			if (status != DC_STATUS_SUCCESS) {
+				goto error_buffer_free;
+			}
+			pending = 1;
+		}
+
 		if (callback && !callback (data, size, data, sizeof(device->fingerprint), userdata)) {
+			// Drain the pending response, to leave the dive computer in
+			// a consistent state for the close command.
+			if (pending) {
+				status = mclean_extreme_readdive (abstract, NULL, buffer);
+			}
 			break;
 		}
 	}
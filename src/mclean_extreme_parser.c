@@ -51,7 +51,6 @@ struct mclean_extreme_parser_t {
 	dc_parser_t base;
 
 	// Cached fields.
-	unsigned int cached;
 	unsigned int ngasmixes;
 	unsigned int gasmix[NGASMIXES];
 };
@@ -88,7 +87,6 @@ mclean_extreme_parser_create(dc_parser_t **out, dc_context_t *context)
 	}
 
 	// Set the default values.
-	parser->cached = 0;
 	parser->ngasmixes = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->gasmix[i] = INVALID;
@@ -105,7 +103,6 @@ mclean_extreme_parser_set_data(dc_parser_t *abstract, const unsigned char *data,
 	mclean_extreme_parser_t *parser = (mclean_extreme_parser_t *)abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
 	parser->ngasmixes = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->gasmix[i] = INVALID;
@@ -143,8 +140,13 @@ mclean_extreme_parser_get_field(dc_parser_t *abstract, dc_field_type_t type, uns
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	if (!parser->cached) {
-		dc_status_t rc = mclean_extreme_parser_samples_foreach (abstract, NULL, NULL);
+	// The gas mixes are only available in the profile.
+	if (!parser->base.cached && dc_parser_is_summary (parser)) {
+		if (type == DC_FIELD_GASMIX_COUNT ||
+			type == DC_FIELD_GASMIX)
+			return DC_STATUS_FULLSCAN;
+	} else {
+		dc_status_t rc = dc_parser_cache_profile (abstract);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -310,7 +312,7 @@ mclean_extreme_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback_
 		parser->gasmix[i] = gasmix[i];
 	}
 	parser->ngasmixes = ngasmixes;
-	parser->cached = 1;
+	parser->base.cached = 1;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -0,0 +1,422 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#ifdef HAVE_LIBUSB
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#endif
+#include <libusb.h>
+#if defined(LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000102)
+#define USE_HOTPLUG
+#endif
+#endif
+
+#include <libdivecomputer/monitor.h>
+#include <libdivecomputer/serial.h>
+#include <libdivecomputer/usb.h>
+#include <libdivecomputer/usbhid.h>
+
+#include "common-private.h"
+#include "context-private.h"
+#include "thread.h"
+#include "usbsession.h"
+
+#define TRANSPORTS (DC_TRANSPORT_SERIAL | DC_TRANSPORT_USB | DC_TRANSPORT_USBHID)
+
+#define MAXKEY 256
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+typedef struct dc_monitor_entry_t {
+	dc_transport_t transport;
+	char key[MAXKEY];
+	void *device;
+	dc_descriptor_t *descriptor;
+	unsigned int seen;
+} dc_monitor_entry_t;
+
+struct dc_monitor_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	unsigned int transports;
+	dc_monitor_callback_t callback;
+	void *userdata;
+	/* Cached list of devices. */
+	dc_monitor_entry_t *entries;
+	size_t count;
+	size_t capacity;
+	/* Transports with a pending change, and transports without change
+	 * notifications, which are scanned on every update. The pending
+	 * changes are protected by the mutex, because the hotplug events
+	 * are delivered on whatever thread handles the libusb events. */
+	unsigned int pending;
+	unsigned int polled;
+	dc_mutex_t *mutex;
+#ifdef HAVE_SYS_INOTIFY_H
+	int inotify;
+#endif
+#ifdef USE_HOTPLUG
+	libusb_context *usb;
+	libusb_hotplug_callback_handle hotplug;
+	int registered;
+#endif
+};
+
+static void
+dc_monitor_device_free (dc_transport_t transport, void *device)
+{
+	switch (transport) {
+	case DC_TRANSPORT_SERIAL:
+		dc_serial_device_free ((dc_serial_device_t *) device);
+		break;
+	case DC_TRANSPORT_USB:
+		dc_usb_device_free ((dc_usb_device_t *) device);
+		break;
+	case DC_TRANSPORT_USBHID:
+		dc_usbhid_device_free ((dc_usbhid_device_t *) device);
+		break;
+	default:
+		break;
+	}
+}
+
+#ifdef USE_HOTPLUG
+static int LIBUSB_CALL
+dc_monitor_hotplug_cb (libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *userdata)
+{
+	dc_monitor_t *monitor = (dc_monitor_t *) userdata;
+
+	dc_mutex_lock (monitor->mutex);
+	monitor->pending |= (DC_TRANSPORT_USB | DC_TRANSPORT_USBHID);
+	dc_mutex_unlock (monitor->mutex);
+
+	// Keep the callback registered.
+	return 0;
+}
+#endif
+
+static dc_status_t
+dc_monitor_append (dc_monitor_t *monitor, const dc_monitor_entry_t *entry)
+{
+	if (monitor->count >= monitor->capacity) {
+		size_t capacity = monitor->capacity ? monitor->capacity * 2 : 16;
+		dc_monitor_entry_t *entries = (dc_monitor_entry_t *) dc_context_realloc (monitor->context, monitor->entries, capacity * sizeof (*entries));
+		if (entries == NULL) {
+			ERROR (monitor->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		monitor->entries = entries;
+		monitor->capacity = capacity;
+	}
+
+	monitor->entries[monitor->count++] = *entry;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_monitor_scan (dc_monitor_t *monitor, dc_transport_t transport)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_iterator_t *iterator = NULL;
+
+	switch (transport) {
+	case DC_TRANSPORT_SERIAL:
+		status = dc_serial_iterator_new (&iterator, monitor->context, monitor->descriptor);
+		break;
+	case DC_TRANSPORT_USB:
+		status = dc_usb_iterator_new (&iterator, monitor->context, monitor->descriptor);
+		break;
+	case DC_TRANSPORT_USBHID:
+		status = dc_usbhid_iterator_new (&iterator, monitor->context, monitor->descriptor);
+		break;
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	for (size_t i = 0; i < monitor->count; ++i) {
+		if (monitor->entries[i].transport == transport)
+			monitor->entries[i].seen = 0;
+	}
+
+	void *device = NULL;
+	while ((status = dc_iterator_next (iterator, &device)) == DC_STATUS_SUCCESS) {
+		dc_monitor_entry_t entry;
+		memset (&entry, 0, sizeof (entry));
+		entry.transport = transport;
+		entry.device = device;
+		entry.descriptor = monitor->descriptor;
+		entry.seen = 1;
+
+		unsigned int vid = 0, pid = 0;
+		switch (transport) {
+		case DC_TRANSPORT_SERIAL:
+			strncpy (entry.key, dc_serial_device_get_name ((dc_serial_device_t *) device), sizeof (entry.key) - 1);
+			break;
+		case DC_TRANSPORT_USB:
+			dc_usb_device_get_key ((dc_usb_device_t *) device, entry.key, sizeof (entry.key));
+			vid = dc_usb_device_get_vid ((dc_usb_device_t *) device);
+			pid = dc_usb_device_get_pid ((dc_usb_device_t *) device);
+			break;
+		case DC_TRANSPORT_USBHID:
+			dc_usbhid_device_get_key ((dc_usbhid_device_t *) device, entry.key, sizeof (entry.key));
+			vid = dc_usbhid_device_get_vid ((dc_usbhid_device_t *) device);
+			pid = dc_usbhid_device_get_pid ((dc_usbhid_device_t *) device);
+			break;
+		default:
+			break;
+		}
+
+		// Keep the cached device, if it's already known.
+		size_t idx = 0;
+		while (idx < monitor->count &&
+			(monitor->entries[idx].transport != transport ||
+			strcmp (monitor->entries[idx].key, entry.key) != 0))
+			idx++;
+
+		if (idx < monitor->count) {
+			monitor->entries[idx].seen = 1;
+			dc_monitor_device_free (transport, device);
+			continue;
+		}
+
+		// Match a new device against the supported devices, once.
+		if (entry.descriptor == NULL && transport != DC_TRANSPORT_SERIAL) {
+			if (dc_descriptor_find_usb (&entry.descriptor, vid, pid) != DC_STATUS_SUCCESS) {
+				dc_monitor_device_free (transport, device);
+				continue;
+			}
+		}
+
+		status = dc_monitor_append (monitor, &entry);
+		if (status != DC_STATUS_SUCCESS) {
+			dc_monitor_device_free (transport, device);
+			break;
+		}
+
+		if (monitor->callback)
+			monitor->callback (DC_MONITOR_EVENT_ADDED, transport, entry.device, entry.descriptor, monitor->userdata);
+	}
+
+	dc_iterator_free (iterator);
+
+	if (status != DC_STATUS_DONE)
+		return status;
+
+	// Report and remove the devices that are gone.
+	size_t n = 0;
+	for (size_t i = 0; i < monitor->count; ++i) {
+		dc_monitor_entry_t *entry = monitor->entries + i;
+		if (entry->transport == transport && !entry->seen) {
+			if (monitor->callback)
+				monitor->callback (DC_MONITOR_EVENT_REMOVED, transport, entry->device, entry->descriptor, monitor->userdata);
+			dc_monitor_device_free (transport, entry->device);
+			if (entry->descriptor != monitor->descriptor)
+				dc_descriptor_free (entry->descriptor);
+			continue;
+		}
+		monitor->entries[n++] = *entry;
+	}
+	monitor->count = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_monitor_new (dc_monitor_t **out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int transports, dc_monitor_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_monitor_t *monitor = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	monitor = (dc_monitor_t *) dc_context_malloc (context, sizeof (dc_monitor_t));
+	if (monitor == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (monitor, 0, sizeof (*monitor));
+	monitor->context = context;
+	monitor->descriptor = descriptor;
+	monitor->transports = transports & TRANSPORTS & dc_context_get_transports (context);
+	monitor->callback = callback;
+	monitor->userdata = userdata;
+	monitor->pending = monitor->transports;
+	monitor->polled = monitor->transports;
+#ifdef HAVE_SYS_INOTIFY_H
+	monitor->inotify = -1;
+#endif
+
+	status = dc_mutex_new (&monitor->mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	// Watch the device directory for new and removed serial ports.
+	if (monitor->transports & DC_TRANSPORT_SERIAL) {
+		monitor->inotify = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+		if (monitor->inotify >= 0 &&
+			inotify_add_watch (monitor->inotify, "/dev", IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) >= 0) {
+			monitor->polled &= ~DC_TRANSPORT_SERIAL;
+		} else {
+			WARNING (context, "Failed to watch the device directory (%s).", strerror (errno));
+		}
+	}
+#endif
+
+#ifdef USE_HOTPLUG
+	// Register for libusb hotplug events.
+	if ((monitor->transports & (DC_TRANSPORT_USB | DC_TRANSPORT_USBHID)) &&
+		libusb_has_capability (LIBUSB_CAP_HAS_HOTPLUG) &&
+		dc_usbsession_ref (&monitor->usb, context) == DC_STATUS_SUCCESS) {
+		int rc = libusb_hotplug_register_callback (monitor->usb,
+			LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, 0,
+			LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+			dc_monitor_hotplug_cb, monitor, &monitor->hotplug);
+		if (rc == LIBUSB_SUCCESS) {
+			monitor->registered = 1;
+			monitor->polled &= ~(DC_TRANSPORT_USB | DC_TRANSPORT_USBHID);
+		} else {
+			WARNING (context, "Failed to register the hotplug callback (%s).",
+				libusb_error_name (rc));
+			dc_usbsession_unref ();
+			monitor->usb = NULL;
+		}
+	}
+#endif
+
+	*out = monitor;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_context_dealloc (context, monitor);
+	return status;
+}
+
+dc_status_t
+dc_monitor_update (dc_monitor_t *monitor)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (monitor == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (monitor->inotify >= 0) {
+		// Drain the queued events. Any change in the directory is
+		// enough to scan the serial ports again.
+		char buffer[4096];
+		ssize_t n = 0;
+		while ((n = read (monitor->inotify, buffer, sizeof (buffer))) > 0) {
+			dc_mutex_lock (monitor->mutex);
+			monitor->pending |= DC_TRANSPORT_SERIAL;
+			dc_mutex_unlock (monitor->mutex);
+		}
+	}
+#endif
+
+#ifdef USE_HOTPLUG
+	if (monitor->registered) {
+		// Deliver the hotplug events, without waiting.
+		struct timeval tv = {0, 0};
+		libusb_handle_events_timeout_completed (monitor->usb, &tv, NULL);
+	}
+#endif
+
+	dc_mutex_lock (monitor->mutex);
+	unsigned int pending = monitor->pending | monitor->polled;
+	monitor->pending = 0;
+	dc_mutex_unlock (monitor->mutex);
+
+	const dc_transport_t transports[] = {
+		DC_TRANSPORT_SERIAL,
+		DC_TRANSPORT_USB,
+		DC_TRANSPORT_USBHID,
+	};
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (transports); ++i) {
+		if (!(pending & transports[i]))
+			continue;
+
+		dc_status_t rc = dc_monitor_scan (monitor, transports[i]);
+		if (rc != DC_STATUS_SUCCESS) {
+			// Try again on the next update.
+			dc_mutex_lock (monitor->mutex);
+			monitor->pending |= transports[i];
+			dc_mutex_unlock (monitor->mutex);
+			dc_status_set_error (&status, rc);
+		}
+	}
+
+	return status;
+}
+
+dc_status_t
+dc_monitor_free (dc_monitor_t *monitor)
+{
+	if (monitor == NULL)
+		return DC_STATUS_SUCCESS;
+
+#ifdef USE_HOTPLUG
+	if (monitor->registered) {
+		libusb_hotplug_deregister_callback (monitor->usb, monitor->hotplug);
+		dc_usbsession_unref ();
+	}
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (monitor->inotify >= 0)
+		close (monitor->inotify);
+#endif
+
+	for (size_t i = 0; i < monitor->count; ++i) {
+		dc_monitor_entry_t *entry = monitor->entries + i;
+		dc_monitor_device_free (entry->transport, entry->device);
+		if (entry->descriptor != monitor->descriptor)
+			dc_descriptor_free (entry->descriptor);
+	}
+
+	dc_mutex_free (monitor->mutex);
+	dc_context_dealloc (monitor->context, monitor->entries);
+	dc_context_dealloc (monitor->context, monitor);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -41,7 +41,14 @@
 #define I770R      0x4651
 #define GEO40      0x4653
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define MAXPACKET  256
+
+// BLE packet size: the default payload size for the 23 byte ATT MTU,
+// and the maximum size with the one byte length field.
+#define BLE_DEFAULT 20
+#define BLE_MAXSIZE (4 + 255)
 #define MAXRETRIES 2
 #define MAXDELAY   16
 #define INVALID    0xFFFFFFFF
@@ -64,6 +71,7 @@ typedef struct oceanic_atom2_device_t {
 	oceanic_common_device_t base;
 	dc_iostream_t *iostream;
 	unsigned int sequence;
+	unsigned int mtu;
 	unsigned int delay;
 	unsigned int extra;
 	unsigned int bigpage;
@@ -84,7 +92,9 @@ static const oceanic_common_device_vtable_t oceanic_atom2_device_vtable = {
 		oceanic_atom2_device_read, /* read */
 		oceanic_atom2_device_write, /* write */
 		oceanic_common_device_dump, /* dump */
+		oceanic_common_device_dump_update, /* dump_update */
 		oceanic_common_device_foreach, /* foreach */
+		NULL, /* extract */
 		NULL, /* timesync */
 		oceanic_atom2_device_close /* close */
 	},
@@ -92,141 +102,6 @@ static const oceanic_common_device_vtable_t oceanic_atom2_device_vtable = {
 	oceanic_common_device_profile,
 };
 
-static const oceanic_common_version_t aeris_f10_version[] = {
-	{"FREEWAER \0\0 512K"},
-	{"OCEANF10 \0\0 512K"},
-	{"MUNDIAL R\0\0 512K"},
-};
-
-static const oceanic_common_version_t aeris_f11_version[] = {
-	{"AERISF11 \0\0 1024"},
-	{"OCEANF11 \0\0 1024"},
-};
-
-static const oceanic_common_version_t aeris_manta_version[] = {
-	{"MANTA  R\0\0  512K"},
-};
-
-static const oceanic_common_version_t oceanic_atom1_version[] = {
-	{"ATOM rev\0\0  256K"},
-};
-
-static const oceanic_common_version_t oceanic_atom2_version[] = {
-	{"2M ATOM r\0\0 512K"},
-};
-
-static const oceanic_common_version_t oceanic_atom2a_version[] = {
-	{"INSIGHT2 \0\0 512K"},
-	{"OCEVEO30 \0\0 512K"},
-	{"ATMOSAI R\0\0 512K"},
-	{"PROPLUS2 \0\0 512K"},
-	{"OCEGEO20 \0\0 512K"},
-	{"OCE GEO R\0\0 512K"},
-	{"AQUAI200 \0\0 512K"},
-	{"AQUA200C \0\0 512K"},
-};
-
-static const oceanic_common_version_t oceanic_atom2b_version[] = {
-	{"ELEMENT2 \0\0 512K"},
-	{"OCEVEO20 \0\0 512K"},
-	{"TUSAZEN \0\0  512K"},
-	{"AQUAI300 \0\0 512K"},
-	{"HOLLDG03 \0\0 512K"},
-	{"AQUAI100 \0\0 512K"},
-	{"AQUA300C \0\0 512K"},
-	{"OCEGEO40 \0\0 512K"},
-	{"VEOSMART \0\0 512K"},
-};
-
-static const oceanic_common_version_t oceanic_atom2c_version[] = {
-	{"2M EPIC r\0\0 512K"},
-	{"EPIC1  R\0\0  512K"},
-	{"AERIA300 \0\0 512K"},
-};
-
-static const oceanic_common_version_t oceanic_default_version[] = {
-	{"OCE VT3 R\0\0 512K"},
-	{"ELITET3 R\0\0 512K"},
-	{"ELITET31 \0\0 512K"},
-	{"DATAMASK \0\0 512K"},
-	{"COMPMASK \0\0 512K"},
-};
-
-static const oceanic_common_version_t sherwood_wisdom_version[] = {
-	{"WISDOM R\0\0  512K"},
-};
-
-static const oceanic_common_version_t oceanic_proplus3_version[] = {
-	{"PROPLUS3 \0\0 512K"},
-	{"PROPLUS4 \0\0 512K"},
-};
-
-static const oceanic_common_version_t tusa_zenair_version[] = {
-	{"TUZENAIR \0\0 512K"},
-	{"AMPHOSSW \0\0 512K"},
-	{"AMPHOAIR \0\0 512K"},
-	{"VOYAGE2G \0\0 512K"},
-	{"TUSTALIS \0\0 512K"},
-};
-
-static const oceanic_common_version_t oceanic_oc1_version[] = {
-	{"OCWATCH R\0\0 1024"},
-	{"OC1WATCH \0\0 1024"},
-	{"OCSWATCH \0\0 1024"},
-	{"AQUAI550 \0\0 1024"},
-	{"AQUA550C \0\0 1024"},
-	{"WISDOM04 \0\0 1024"},
-	{"AQUA470C \0\0 1024"},
-};
-
-static const oceanic_common_version_t oceanic_oci_version[] = {
-	{"OCEANOCI \0\0 1024"},
-};
-
-static const oceanic_common_version_t oceanic_atom3_version[] = {
-	{"OCEATOM3 \0\0 1024"},
-	{"ATOM31  \0\0  1024"},
-};
-
-static const oceanic_common_version_t oceanic_vt4_version[] = {
-	{"OCEANVT4 \0\0 1024"},
-	{"OCEAVT41 \0\0 1024"},
-	{"AERISAIR \0\0 1024"},
-	{"SWVISION \0\0 1024"},
-	{"XPSUBAIR \0\0 1024"},
-};
-
-static const oceanic_common_version_t hollis_tx1_version[] = {
-	{"HOLLDG04 \0\0 2048"},
-};
-
-static const oceanic_common_version_t oceanic_veo1_version[] = {
-	{"OCEVEO10 \0\0   8K"},
-	{"AERIS XR1 NX R\0\0"},
-};
-
-static const oceanic_common_version_t oceanic_reactpro_version[] = {
-	{"REACPRO2 \0\0 512K"},
-};
-
-static const oceanic_common_version_t oceanic_proplusx_version[] = {
-	{"OCEANOCX \0\0 \0\0\0\0"},
-};
-
-static const oceanic_common_version_t aqualung_i770r_version[] = {
-	{"AQUA770R \0\0 \0\0\0\0"},
-};
-
-static const oceanic_common_version_t aeris_a300cs_version[] = {
-	{"AER300CS \0\0 2048"},
-	{"OCEANVTX \0\0 2048"},
-	{"AQUAI750 \0\0 2048"},
-};
-
-static const oceanic_common_version_t aqualung_i450t_version[] = {
-	{"AQUAI450 \0\0 2048"},
-};
-
 static const oceanic_common_layout_t aeris_f10_layout = {
 	0x10000, /* memsize */
 	0, /* highmem */
@@ -543,7 +418,81 @@ static const oceanic_common_layout_t aqualung_i450t_layout = {
 };
 
 /*
- * The BLE GATT packet size is up to 20 bytes and the format is:
+ * All known version strings, in order of precedence. The first
+ * matching pattern determines the memory layout.
+ */
+static const oceanic_common_model_t oceanic_atom2_models[] = {
+	{"FREEWAER \0\0 512K", &aeris_f10_layout},
+	{"OCEANF10 \0\0 512K", &aeris_f10_layout},
+	{"MUNDIAL R\0\0 512K", &aeris_f10_layout},
+	{"AERISF11 \0\0 1024", &aeris_f11_layout},
+	{"OCEANF11 \0\0 1024", &aeris_f11_layout},
+	{"MANTA  R\0\0  512K", &oceanic_atom2a_layout, 0x08, 0x3242, &oceanic_atom2c_layout},
+	{"ATOM rev\0\0  256K", &oceanic_atom1_layout},
+	{"2M ATOM r\0\0 512K", &oceanic_atom2a_layout, 0x09, 0x3349, &oceanic_atom2c_layout},
+	{"INSIGHT2 \0\0 512K", &oceanic_atom2a_layout},
+	{"OCEVEO30 \0\0 512K", &oceanic_atom2a_layout},
+	{"ATMOSAI R\0\0 512K", &oceanic_atom2a_layout},
+	{"PROPLUS2 \0\0 512K", &oceanic_atom2a_layout},
+	{"OCEGEO20 \0\0 512K", &oceanic_atom2a_layout},
+	{"OCE GEO R\0\0 512K", &oceanic_atom2a_layout},
+	{"AQUAI200 \0\0 512K", &oceanic_atom2a_layout},
+	{"AQUA200C \0\0 512K", &oceanic_atom2a_layout},
+	{"ELEMENT2 \0\0 512K", &oceanic_atom2b_layout},
+	{"OCEVEO20 \0\0 512K", &oceanic_atom2b_layout},
+	{"TUSAZEN \0\0  512K", &oceanic_atom2b_layout},
+	{"AQUAI300 \0\0 512K", &oceanic_atom2b_layout},
+	{"HOLLDG03 \0\0 512K", &oceanic_atom2b_layout},
+	{"AQUAI100 \0\0 512K", &oceanic_atom2b_layout},
+	{"AQUA300C \0\0 512K", &oceanic_atom2b_layout},
+	{"OCEGEO40 \0\0 512K", &oceanic_atom2b_layout},
+	{"VEOSMART \0\0 512K", &oceanic_atom2b_layout},
+	{"2M EPIC r\0\0 512K", &oceanic_atom2c_layout},
+	{"EPIC1  R\0\0  512K", &oceanic_atom2c_layout},
+	{"AERIA300 \0\0 512K", &oceanic_atom2c_layout},
+	{"WISDOM R\0\0  512K", &sherwood_wisdom_layout},
+	{"PROPLUS3 \0\0 512K", &oceanic_proplus3_layout},
+	{"PROPLUS4 \0\0 512K", &oceanic_proplus3_layout},
+	{"TUZENAIR \0\0 512K", &tusa_zenair_layout},
+	{"AMPHOSSW \0\0 512K", &tusa_zenair_layout},
+	{"AMPHOAIR \0\0 512K", &tusa_zenair_layout},
+	{"VOYAGE2G \0\0 512K", &tusa_zenair_layout},
+	{"TUSTALIS \0\0 512K", &tusa_zenair_layout},
+	{"OCWATCH R\0\0 1024", &oceanic_oc1_layout},
+	{"OC1WATCH \0\0 1024", &oceanic_oc1_layout},
+	{"OCSWATCH \0\0 1024", &oceanic_oc1_layout},
+	{"AQUAI550 \0\0 1024", &oceanic_oc1_layout},
+	{"AQUA550C \0\0 1024", &oceanic_oc1_layout},
+	{"WISDOM04 \0\0 1024", &oceanic_oc1_layout},
+	{"AQUA470C \0\0 1024", &oceanic_oc1_layout},
+	{"OCEANOCI \0\0 1024", &oceanic_oci_layout},
+	{"OCEATOM3 \0\0 1024", &oceanic_atom3_layout},
+	{"ATOM31  \0\0  1024", &oceanic_atom3_layout},
+	{"OCEANVT4 \0\0 1024", &oceanic_vt4_layout},
+	{"OCEAVT41 \0\0 1024", &oceanic_vt4_layout},
+	{"AERISAIR \0\0 1024", &oceanic_vt4_layout},
+	{"SWVISION \0\0 1024", &oceanic_vt4_layout},
+	{"XPSUBAIR \0\0 1024", &oceanic_vt4_layout},
+	{"HOLLDG04 \0\0 2048", &hollis_tx1_layout},
+	{"OCEVEO10 \0\0   8K", &oceanic_veo1_layout},
+	{"AERIS XR1 NX R\0\0", &oceanic_veo1_layout},
+	{"REACPRO2 \0\0 512K", &oceanic_reactpro_layout},
+	{"OCEANOCX \0\0 \0\0\0\0", &oceanic_proplusx_layout},
+	{"AQUA770R \0\0 \0\0\0\0", &aqualung_i770r_layout},
+	{"AER300CS \0\0 2048", &aeris_a300cs_layout},
+	{"OCEANVTX \0\0 2048", &aeris_a300cs_layout},
+	{"AQUAI750 \0\0 2048", &aeris_a300cs_layout},
+	{"AQUAI450 \0\0 2048", &aqualung_i450t_layout},
+	{"OCE VT3 R\0\0 512K", &oceanic_default_layout},
+	{"ELITET3 R\0\0 512K", &oceanic_default_layout},
+	{"ELITET31 \0\0 512K", &oceanic_default_layout},
+	{"DATAMASK \0\0 512K", &oceanic_default_layout},
+	{"COMPMASK \0\0 512K", &oceanic_default_layout},
+};
+
+/*
+ * The BLE GATT packet size is up to the negotiated MTU (20 bytes by
+ * default) and the format is:
  *
  * byte 0: <0xCD>
  *         Seems to always have this value. Don't ask what it means
@@ -555,14 +504,18 @@ static const oceanic_common_layout_t aqualung_i450t_layout = {
  * byte 2: <cmd seq>
  *          starts at 0 for the connection, incremented for each command
  * byte 3: <length of data>
- *          1-16 bytes of data per packet.
+ *          1-16 bytes of data per packet with the default MTU, up to
+ *          255 bytes with a larger MTU.
  * byte 4..n: <data>
+ *
+ * With a larger MTU, a page command, and the response with a full page,
+ * fit in a single packet instead of being split into 16 byte fragments.
  */
 static dc_status_t
 oceanic_atom2_ble_write (oceanic_atom2_device_t *device, const unsigned char data[], unsigned int size)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	unsigned char buf[20];
+	unsigned char header[4];
 	unsigned char cmd_seq = device->sequence;
 	unsigned char pkt_seq = 0;
 
@@ -570,17 +523,21 @@ oceanic_atom2_ble_write (oceanic_atom2_device_t *device, const unsigned char dat
 	while (nbytes < size) {
 		unsigned char status = 0x40;
 		unsigned int length = size - nbytes;
-		if (length > sizeof(buf) - 4) {
-			length = sizeof(buf) - 4;
+		if (length > device->mtu - sizeof(header)) {
+			length = device->mtu - sizeof(header);
 			status |= 0x20;
 		}
-		buf[0] = 0xcd;
-		buf[1] = status | (pkt_seq & 0x1F);
-		buf[2] = cmd_seq;
-		buf[3] = length;
-		memcpy (buf + 4, data, length);
-
-		rc = dc_iostream_write (device->iostream, buf, 4 + length, NULL);
+		header[0] = 0xcd;
+		header[1] = status | (pkt_seq & 0x1F);
+		header[2] = cmd_seq;
+		header[3] = length;
+
+		// Send the header and the payload as a single packet.
+		const dc_iovec_t iov[] = {
+			{header, sizeof(header)},
+			{data + nbytes, length},
+		};
+		rc = dc_iostream_writev (device->iostream, iov, C_ARRAY_SIZE(iov), NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -596,7 +553,7 @@ oceanic_atom2_ble_read (oceanic_atom2_device_t *device, unsigned char data[], un
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
-	unsigned char buf[20];
+	unsigned char buf[BLE_MAXSIZE];
 	unsigned char cmd_seq = device->sequence;
 	unsigned char pkt_seq = 0;
 
@@ -771,15 +728,18 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 	// a NAK byte, we try to resend the command a number of times before
 	// returning an error.
 
+	dc_trace_span_t span;
+	TRACE_BEGIN (device->base.base.context, &span, command[0], csize, asize);
+
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = oceanic_atom2_packet (device, command, csize, ack, answer, asize, crc_size)) != DC_STATUS_SUCCESS) {
 		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
-			return rc;
+			break;
 
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
-			return rc;
+			break;
 
 		// Increase the inter packet delay.
 		if (device->delay < MAXDELAY)
@@ -790,7 +750,9 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
 	}
 
-	return DC_STATUS_SUCCESS;
+	TRACE_END (device->base.base.context, &span, rc);
+
+	return rc;
 }
 
 /*
@@ -877,6 +839,7 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 	device->delay = 0;
 	device->extra = model == PROPLUSX || model == I770R;
 	device->sequence = 0;
+	device->mtu = BLE_DEFAULT;
 	device->bigpage = 1; // no big pages
 	device->cached_page = INVALID;
 	device->cached_highmem = INVALID;
@@ -902,6 +865,16 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 		goto error_free;
 	}
 
+	// Get the BLE packet size.
+	if (dc_iostream_get_transport (device->iostream) == DC_TRANSPORT_BLE) {
+		unsigned int mtu = 0;
+		status = dc_iostream_ioctl (device->iostream, DC_IOCTL_BLE_GET_MTU, &mtu, sizeof(mtu));
+		if (status == DC_STATUS_SUCCESS && mtu > BLE_DEFAULT) {
+			device->mtu = mtu < BLE_MAXSIZE ? mtu : BLE_MAXSIZE;
+		}
+		DEBUG (context, "BLE packet size: %u", device->mtu);
+	}
+
 	// Set the DTR line.
 	status = dc_iostream_set_dtr (device->iostream, 1);
 	if (status != DC_STATUS_SUCCESS) {
@@ -953,65 +926,16 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 	}
 
 	// Override the base class values.
-	if (OCEANIC_COMMON_MATCH (device->base.version, aeris_f10_version)) {
-		device->base.layout = &aeris_f10_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, aeris_f11_version)) {
-		device->base.layout = &aeris_f11_layout;
+	device->base.layout = OCEANIC_COMMON_IDENTIFY (device->base.version, oceanic_atom2_models);
+	if (device->base.layout == &aeris_f11_layout) {
 		device->bigpage = 8;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, aeris_manta_version)) {
-		if (array_uint16_be (device->base.version + 0x08) >= 0x3242) {
-			device->base.layout = &oceanic_atom2a_layout;
-		} else {
-			device->base.layout = &oceanic_atom2c_layout;
-		}
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom1_version)) {
-		device->base.layout = &oceanic_atom1_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom2_version)) {
-		if (array_uint16_be (device->base.version + 0x09) >= 0x3349) {
-			device->base.layout = &oceanic_atom2a_layout;
-		} else {
-			device->base.layout = &oceanic_atom2c_layout;
-		}
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom2a_version)) {
-		device->base.layout = &oceanic_atom2a_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom2b_version)) {
-		device->base.layout = &oceanic_atom2b_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom2c_version)) {
-		device->base.layout = &oceanic_atom2c_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, sherwood_wisdom_version)) {
-		device->base.layout = &sherwood_wisdom_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_proplus3_version)) {
-		device->base.layout = &oceanic_proplus3_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, tusa_zenair_version)) {
-		device->base.layout = &tusa_zenair_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_oc1_version)) {
-		device->base.layout = &oceanic_oc1_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_oci_version)) {
-		device->base.layout = &oceanic_oci_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom3_version)) {
-		device->base.layout = &oceanic_atom3_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_vt4_version)) {
-		device->base.layout = &oceanic_vt4_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, hollis_tx1_version)) {
-		device->base.layout = &hollis_tx1_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_veo1_version)) {
-		device->base.layout = &oceanic_veo1_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_reactpro_version)) {
-		device->base.layout = &oceanic_reactpro_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_proplusx_version)) {
-		device->base.layout = &oceanic_proplusx_layout;
-		device->bigpage = 16;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, aqualung_i770r_version)) {
-		device->base.layout = &aqualung_i770r_layout;
-		device->bigpage = 16;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, aeris_a300cs_version)) {
-		device->base.layout = &aeris_a300cs_layout;
+	} else if (device->base.layout == &oceanic_proplusx_layout ||
+		device->base.layout == &aqualung_i770r_layout ||
+		device->base.layout == &aeris_a300cs_layout) {
 		device->bigpage = 16;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, aqualung_i450t_version)) {
-		device->base.layout = &aqualung_i450t_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_default_version)) {
-		device->base.layout = &oceanic_default_layout;
-	} else {
+	}
+
+	if (device->base.layout == NULL) {
 		WARNING (context, "Unsupported device detected (%s)!", device->base.version);
 		device->base.layout = &oceanic_default_layout;
 		if (memcmp(device->base.version + 12, "256K", 4) == 0) {
@@ -1073,6 +997,119 @@ oceanic_atom2_device_keepalive (dc_device_t *abstract)
 }
 
 
+static dc_status_t
+oceanic_atom2_read_command (unsigned int bigpage, unsigned char *read_cmd, unsigned int *crc_size)
+{
+	// Pick the correct read command and number of checksum bytes.
+	switch (bigpage) {
+	case 1:
+		*read_cmd = CMD_READ1;
+		*crc_size = 1;
+		break;
+	case 8:
+		*read_cmd = CMD_READ8;
+		*crc_size = 1;
+		break;
+	case 16:
+		*read_cmd = CMD_READ16;
+		*crc_size = 2;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+oceanic_atom2_set_bigpage (oceanic_atom2_device_t *device, unsigned int bigpage)
+{
+	device->bigpage = bigpage;
+
+	// The cached page depends on the page size.
+	device->cached_page = INVALID;
+	device->cached_highmem = INVALID;
+}
+
+dc_status_t
+oceanic_atom2_device_get_bigpage (dc_device_t *abstract, unsigned int *value)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+
+	if (!ISINSTANCE (abstract) || value == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*value = device->bigpage;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+oceanic_atom2_device_set_bigpage (dc_device_t *abstract, unsigned int value)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (value != 1 && value != 8 && value != 16)
+		return DC_STATUS_INVALIDARGS;
+
+	oceanic_atom2_set_bigpage (device, value);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+oceanic_atom2_device_probe_bigpage (dc_device_t *abstract)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	// Read the first page with the single page command, as the reference
+	// for the larger reads.
+	unsigned char reference[PAGESIZE];
+	unsigned char command[] = {CMD_READ1, 0x00, 0x00};
+	rc = oceanic_atom2_transfer (device, command, sizeof (command), ACK, reference, sizeof (reference), 1);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Try the larger reads, from large to small. A single attempt is made
+	// without retries, because models that don't support the command
+	// either reject it, or don't respond at all.
+	const unsigned int candidates[] = {16, 8};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (candidates); ++i) {
+		unsigned int bigpage = candidates[i];
+		unsigned char read_cmd = 0;
+		unsigned int crc_size = 0;
+		oceanic_atom2_read_command (bigpage, &read_cmd, &crc_size);
+
+		unsigned char probe[] = {read_cmd, 0x00, 0x00};
+		rc = oceanic_atom2_packet (device, probe, sizeof (probe), ACK, device->cache, bigpage * PAGESIZE, crc_size);
+		if (rc == DC_STATUS_SUCCESS && memcmp (device->cache, reference, sizeof (reference)) == 0) {
+			INFO (abstract->context, "Using %u pages per read.", bigpage);
+			oceanic_atom2_set_bigpage (device, bigpage);
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (rc == DC_STATUS_CANCELLED)
+			return rc;
+
+		dc_iostream_sleep (device->iostream, 100);
+		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+	}
+
+	oceanic_atom2_set_bigpage (device, 1);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 oceanic_atom2_device_version (dc_device_t *abstract, unsigned char data[], unsigned int size)
 {
@@ -1098,6 +1135,7 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 {
 	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
 	const oceanic_common_layout_t *layout = device->base.layout;
+	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	if ((address % PAGESIZE != 0) ||
 		(size    % PAGESIZE != 0))
@@ -1106,22 +1144,9 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 	// Pick the correct read command and number of checksum bytes.
 	unsigned char read_cmd = 0x00;
 	unsigned int crc_size = 0;
-	switch (device->bigpage) {
-	case 1:
-		read_cmd = CMD_READ1;
-		crc_size = 1;
-		break;
-	case 8:
-		read_cmd = CMD_READ8;
-		crc_size = 1;
-		break;
-	case 16:
-		read_cmd = CMD_READ16;
-		crc_size = 2;
-		break;
-	default:
-		return DC_STATUS_INVALIDARGS;
-	}
+	rc = oceanic_atom2_read_command (device->bigpage, &read_cmd, &crc_size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	// Pick the best pagesize to use.
 	unsigned int pagesize = device->bigpage * PAGESIZE;
@@ -1150,7 +1175,21 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 					(number >> 8) & 0xFF, // high
 					(number     ) & 0xFF, // low
 				};
-			dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), ACK, device->cache, pagesize, crc_size);
+			rc = oceanic_atom2_transfer (device, command, sizeof (command), ACK, device->cache, pagesize, crc_size);
+			if ((rc == DC_STATUS_PROTOCOL || rc == DC_STATUS_TIMEOUT) &&
+				!highmem && device->bigpage > 1) {
+				// Fall back to a smaller page size, and retry the same
+				// address. The new size stays in effect for the rest of
+				// the session.
+				unsigned int bigpage = (device->bigpage > 8 ? 8 : 1);
+				WARNING (abstract->context, "Reading %u pages failed, falling back to %u pages.",
+					device->bigpage, bigpage);
+				oceanic_atom2_set_bigpage (device, bigpage);
+				oceanic_atom2_read_command (bigpage, &read_cmd, &crc_size);
+				pagesize = bigpage * PAGESIZE;
+				dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+				continue;
+			}
 			if (rc != DC_STATUS_SUCCESS)
 				return rc;
 
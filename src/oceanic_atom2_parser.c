@@ -109,14 +109,70 @@
 #define HEADER  1
 #define PROFILE 2
 
+#define TEMPERATURE_NONE   0
+#define TEMPERATURE_BYTE   1 // Absolute value
+#define TEMPERATURE_PACKED 2 // Absolute value, spread over several bytes
+#define TEMPERATURE_DELTA  3 // Change relative to the previous value
+
+#define PRESSURE_NONE  0
+#define PRESSURE_DELTA 1 // Change relative to the previous value
+#define PRESSURE_12BIT 2 // 12 bit value (1 psi)
+#define PRESSURE_10BIT 3 // 10 bit value (5 psi)
+#define PRESSURE_16BIT 4 // 16 bit value (1 psi)
+
+#define TANK_2PSI   0 // Tank number and pressure (2 psi)
+#define TANK_ATOM2  1 // Tank number and pressure (2 psi), at a different offset
+#define TANK_1PSI   2 // Tank number and pressure (1 psi)
+#define TANK_SINGLE 3 // Pressure only (1 psi)
+
+#define DEPTH_12BIT 0
+#define DEPTH_BYTE  1
+#define DEPTH_16BIT 2
+
 typedef struct oceanic_atom2_parser_t oceanic_atom2_parser_t;
 
+/*
+ * Per-model description of the profile samples. The plan is resolved
+ * once when the parser is created, so the sample loop does not need to
+ * compare the model number against the long lists of models for every
+ * sample. A zero remaining bottom time offset indicates the value is
+ * not present.
+ */
+typedef struct oceanic_atom2_plan_t {
+	unsigned int interval;
+	unsigned int samplerate;
+	unsigned int samplesize;
+	unsigned int samplesize_freedive;
+	unsigned int temperature;
+	unsigned int temperature_offset;
+	unsigned int sign_offset;
+	unsigned int sign_mask;
+	unsigned int sign_invert;
+	unsigned int pressure;
+	unsigned int pressure_initial;
+	unsigned int tankswitch;
+	unsigned int depth;
+	unsigned int depth_offset;
+	unsigned int timestamp;
+	unsigned int gasmix;
+	unsigned int deco;
+	unsigned int decostop_offset;
+	unsigned int decostop_mask;
+	unsigned int decostop_shift;
+	unsigned int decotime_offset;
+	unsigned int decotime_mask;
+	unsigned int rbt_offset;
+	unsigned int rbt_mask;
+	unsigned int bookmark;
+} oceanic_atom2_plan_t;
+
 struct oceanic_atom2_parser_t {
 	dc_parser_t base;
 	unsigned int model;
 	unsigned int headersize;
 	unsigned int footersize;
 	unsigned int serial;
+	oceanic_atom2_plan_t plan;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int header;
@@ -145,6 +201,243 @@ static const dc_parser_vtable_t oceanic_atom2_parser_vtable = {
 };
 
 
+static void
+oceanic_atom2_parser_plan (oceanic_atom2_plan_t *plan, unsigned int model)
+{
+	// Sample interval.
+	plan->interval = 0x17;
+	if (model == A300CS || model == VTX ||
+		model == I450T || model == I750TC ||
+		model == PROPLUSX || model == I770R)
+		plan->interval = 0x1f;
+	plan->samplerate = (model == F11A || model == F11B);
+
+	// Sample size.
+	plan->samplesize = PAGESIZE / 2;
+	if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == TX1 || model == A300CS ||
+		model == VTX || model == I450T ||
+		model == I750TC || model == PROPLUSX ||
+		model == I770R || model == I470TC) {
+		plan->samplesize = PAGESIZE;
+	}
+	if (model == F10A || model == F10B ||
+		model == F11A || model == F11B ||
+		model == MUNDIAL2 || model == MUNDIAL3) {
+		plan->samplesize_freedive = 2;
+	} else {
+		plan->samplesize_freedive = 4;
+	}
+
+	// Temperature (°F)
+	plan->temperature = TEMPERATURE_BYTE;
+	plan->temperature_offset = 0;
+	plan->sign_offset = 0;
+	plan->sign_mask = 0;
+	plan->sign_invert = 0;
+	if (model == GEO || model == ATOM1 ||
+		model == ELEMENT2 || model == MANTA ||
+		model == ZEN) {
+		plan->temperature_offset = 6;
+	} else if (model == TALIS) {
+		plan->temperature_offset = 7;
+	} else if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300 ||
+		model == I200 || model == I100 ||
+		model == I300C || model == I200C ||
+		model == GEO40 || model == VEO40 ||
+		model == I470TC) {
+		plan->temperature_offset = 3;
+	} else if (model == OCS || model == TX1) {
+		plan->temperature_offset = 1;
+	} else if (model == VT4 || model == VT41 ||
+		model == ATOM3 || model == ATOM31 ||
+		model == A300AI || model == VISION ||
+		model == XPAIR) {
+		plan->temperature = TEMPERATURE_PACKED;
+	} else if (model == A300CS || model == VTX ||
+		model == I750TC || model == PROPLUSX ||
+		model == I770R) {
+		plan->temperature_offset = 11;
+	} else {
+		plan->temperature = TEMPERATURE_DELTA;
+		if (model == DG03 || model == PROPLUS3 ||
+			model == I550 || model == I550C ||
+			model == PROPLUS4 || model == WISDOM4) {
+			plan->sign_offset = 5;
+			plan->sign_mask = 0x04;
+			plan->sign_invert = 1;
+		} else if (model == VOYAGER2G || model == AMPHOS ||
+			model == AMPHOSAIR || model == ZENAIR) {
+			plan->sign_offset = 5;
+			plan->sign_mask = 0x04;
+			plan->sign_invert = 0;
+		} else if (model == ATOM2 || model == PROPLUS21 ||
+			model == EPICA || model == EPICB ||
+			model == ATMOSAI2 ||
+			model == WISDOM2 || model == WISDOM3) {
+			plan->sign_offset = 0;
+			plan->sign_mask = 0x80;
+			plan->sign_invert = 0;
+		} else {
+			plan->sign_offset = 0;
+			plan->sign_mask = 0x80;
+			plan->sign_invert = 1;
+		}
+	}
+
+	// Tank Pressure (psi)
+	if (model == VEO30 || model == OCS ||
+		model == ELEMENT2 || model == VEO20 ||
+		model == A300 || model == ZEN ||
+		model == GEO || model == GEO20 ||
+		model == MANTA || model == I300 ||
+		model == I200 || model == I100 ||
+		model == I300C || model == TALIS ||
+		model == I200C || model == GEO40 ||
+		model == VEO40) {
+		plan->pressure = PRESSURE_NONE;
+	} else if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == I450T || model == I470TC) {
+		plan->pressure = PRESSURE_12BIT;
+	} else if (model == VT4 || model == VT41||
+		model == ATOM3 || model == ATOM31 ||
+		model == ZENAIR ||model == A300AI ||
+		model == DG03 || model == PROPLUS3 ||
+		model == AMPHOSAIR || model == I550 ||
+		model == VISION || model == XPAIR ||
+		model == I550C || model == PROPLUS4 ||
+		model == WISDOM4) {
+		plan->pressure = PRESSURE_10BIT;
+	} else if (model == TX1 || model == A300CS ||
+		model == VTX || model == I750TC ||
+		model == PROPLUSX || model == I770R) {
+		plan->pressure = PRESSURE_16BIT;
+	} else {
+		plan->pressure = PRESSURE_DELTA;
+	}
+	plan->pressure_initial = 2;
+	if (model == A300CS || model == VTX ||
+		model == I750TC || model == I770R)
+		plan->pressure_initial = 16;
+
+	// Tank switch.
+	if (model == DATAMASK || model == COMPUMASK) {
+		plan->tankswitch = TANK_SINGLE;
+	} else if (model == A300CS || model == VTX ||
+		model == I750TC || model == I770R) {
+		plan->tankswitch = TANK_1PSI;
+	} else if (model == ATOM2 || model == EPICA || model == EPICB) {
+		plan->tankswitch = TANK_ATOM2;
+	} else {
+		plan->tankswitch = TANK_2PSI;
+	}
+
+	// Depth (1/16 ft)
+	if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300 ||
+		model == I200 || model == I100 ||
+		model == I300C || model == I200C ||
+		model == GEO40 || model == VEO40 ||
+		model == I470TC) {
+		plan->depth = DEPTH_12BIT;
+		plan->depth_offset = 4;
+	} else if (model == ATOM1) {
+		plan->depth = DEPTH_BYTE;
+		plan->depth_offset = 3;
+	} else {
+		plan->depth = DEPTH_12BIT;
+		plan->depth_offset = 2;
+	}
+
+	// Time and gas mix.
+	plan->timestamp = (model == I450T || model == I470TC);
+	plan->gasmix = (model == TX1);
+
+	// NDL / Deco
+	plan->deco = 1;
+	plan->decostop_offset = 0;
+	plan->decostop_mask = 0;
+	plan->decostop_shift = 0;
+	plan->decotime_offset = 0;
+	plan->decotime_mask = 0;
+	if (model == A300CS || model == VTX ||
+		model == I750TC ||
+		model == PROPLUSX || model == I770R) {
+		plan->decostop_offset = 15;
+		plan->decostop_mask = 0x70;
+		plan->decostop_shift = 4;
+		plan->decotime_offset = 6;
+		plan->decotime_mask = 0x03FF;
+	} else if (model == ZEN || model == DG03) {
+		plan->decostop_offset = 5;
+		plan->decostop_mask = 0xF0;
+		plan->decostop_shift = 4;
+		plan->decotime_offset = 4;
+		plan->decotime_mask = 0x0FFF;
+	} else if (model == TX1) {
+		plan->decostop_offset = 10;
+		plan->decostop_mask = 0xFF;
+		plan->decostop_shift = 0;
+		plan->decotime_offset = 6;
+		plan->decotime_mask = 0xFFFF;
+	} else if (model == ATOM31 || model == VISION ||
+		model == XPAIR || model == I550 ||
+		model == I550C || model == WISDOM4) {
+		plan->decostop_offset = 5;
+		plan->decostop_mask = 0xF0;
+		plan->decostop_shift = 4;
+		plan->decotime_offset = 4;
+		plan->decotime_mask = 0x03FF;
+	} else if (model == I200 || model == I300 ||
+		model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == I100 || model == I300C ||
+		model == I450T || model == I200C ||
+		model == GEO40 || model == VEO40 ||
+		model == I470TC) {
+		plan->decostop_offset = 7;
+		plan->decostop_mask = 0xF0;
+		plan->decostop_shift = 4;
+		plan->decotime_offset = 6;
+		plan->decotime_mask = 0x0FFF;
+	} else {
+		plan->deco = 0;
+	}
+
+	// Remaining bottom time.
+	plan->rbt_offset = 0;
+	plan->rbt_mask = 0;
+	if (model == ATOM31) {
+		plan->rbt_offset = 6;
+		plan->rbt_mask = 0x01FF;
+	} else if (model == I450T || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == PROPLUSX ||
+		model == I770R || model == I470TC) {
+		plan->rbt_offset = 8;
+		plan->rbt_mask = 0x01FF;
+	} else if (model == VISION || model == XPAIR ||
+		model == I550 || model == I550C ||
+		model == WISDOM4) {
+		plan->rbt_offset = 6;
+		plan->rbt_mask = 0x03FF;
+	}
+
+	// Bookmarks
+	plan->bookmark = (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI);
+}
+
+
 dc_status_t
 oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial)
 {
@@ -200,6 +493,7 @@ oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 	}
 
 	parser->serial = serial;
+	oceanic_atom2_parser_plan (&parser->plan, model);
 	parser->cached = 0;
 	parser->header = 0;
 	parser->footer = 0;
@@ -539,10 +833,19 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
+	// The freedive models store the dive time in the header, all other
+	// models need the profile.
+	unsigned int freedive = (parser->model == F10A || parser->model == F10B ||
+		parser->model == F11A || parser->model == F11B ||
+		parser->model == MUNDIAL2 || parser->model == MUNDIAL3);
+
 	// Cache the profile data.
-	if (parser->cached < PROFILE) {
+	if (parser->cached < PROFILE && dc_parser_is_summary (parser)) {
+		if (type == DC_FIELD_DIVETIME && !freedive)
+			return DC_STATUS_FULLSCAN;
+	} else if (parser->cached < PROFILE) {
 		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		status = oceanic_atom2_parser_samples_foreach (
+		status = dc_parser_samples_walk (
 			abstract, sample_statistics_cb, &statistics);
 		if (status != DC_STATUS_SUCCESS)
 			return status;
@@ -561,17 +864,13 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (value) {
 		switch (type) {
 		case DC_FIELD_DIVETIME:
-			if (parser->model == F10A || parser->model == F10B ||
-				parser->model == F11A || parser->model == F11B ||
-				parser->model == MUNDIAL2 || parser->model == MUNDIAL3)
+			if (freedive)
 				*((unsigned int *) value) = bcd2dec (data[2]) + bcd2dec (data[3]) * 60;
 			else
 				*((unsigned int *) value) = parser->divetime;
 			break;
 		case DC_FIELD_MAXDEPTH:
-			if (parser->model == F10A || parser->model == F10B ||
-				parser->model == F11A || parser->model == F11B ||
-				parser->model == MUNDIAL2 || parser->model == MUNDIAL3)
+			if (freedive)
 				*((double *) value) = array_uint16_le (data + 4) / 16.0 * FEET;
 			else
 				*((double *) value) = (array_uint16_le (data + parser->footer + 4) & 0x0FFF) / 16.0 * FEET;
@@ -681,17 +980,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
+	const oceanic_atom2_plan_t *plan = &parser->plan;
+
 	unsigned int extratime = 0;
 	unsigned int time = 0;
 	unsigned int interval = 1;
 	unsigned int samplerate = 1;
 	if (parser->mode != FREEDIVE) {
-		unsigned int idx = 0x17;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I450T || parser->model == I750TC ||
-			parser->model == PROPLUSX || parser->model == I770R)
-			idx = 0x1f;
-		switch (data[idx] & 0x03) {
+		switch (data[plan->interval] & 0x03) {
 		case 0:
 			interval = 2;
 			break;
@@ -705,7 +1001,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			interval = 60;
 			break;
 		}
-	} else if (parser->model == F11A || parser->model == F11B) {
+	} else if (plan->samplerate) {
 		unsigned int idx = 0x29;
 		switch (data[idx] & 0x03) {
 		case 0:
@@ -731,38 +1027,18 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		}
 	}
 
-	unsigned int samplesize = PAGESIZE / 2;
-	if (parser->mode == FREEDIVE) {
-		if (parser->model == F10A || parser->model == F10B ||
-			parser->model == F11A || parser->model == F11B ||
-			parser->model == MUNDIAL2 || parser->model == MUNDIAL3) {
-			samplesize = 2;
-		} else {
-			samplesize = 4;
-		}
-	} else if (parser->model == OC1A || parser->model == OC1B ||
-		parser->model == OC1C || parser->model == OCI ||
-		parser->model == TX1 || parser->model == A300CS ||
-		parser->model == VTX || parser->model == I450T ||
-		parser->model == I750TC || parser->model == PROPLUSX ||
-		parser->model == I770R || parser->model == I470TC) {
-		samplesize = PAGESIZE;
-	}
-
-	unsigned int have_temperature = 1, have_pressure = 1;
+	// Freedive samples contain only the depth.
+	unsigned int samplesize = plan->samplesize;
+	unsigned int have_temperature = plan->temperature;
+	unsigned int have_pressure = plan->pressure;
+	unsigned int depthmode = plan->depth;
+	unsigned int depthoffset = plan->depth_offset;
 	if (parser->mode == FREEDIVE) {
-		have_temperature = 0;
-		have_pressure = 0;
-	} else if (parser->model == VEO30 || parser->model == OCS ||
-		parser->model == ELEMENT2 || parser->model == VEO20 ||
-		parser->model == A300 || parser->model == ZEN ||
-		parser->model == GEO || parser->model == GEO20 ||
-		parser->model == MANTA || parser->model == I300 ||
-		parser->model == I200 || parser->model == I100 ||
-		parser->model == I300C || parser->model == TALIS ||
-		parser->model == I200C || parser->model == GEO40 ||
-		parser->model == VEO40) {
-		have_pressure = 0;
+		samplesize = plan->samplesize_freedive;
+		have_temperature = TEMPERATURE_NONE;
+		have_pressure = PRESSURE_NONE;
+		depthmode = DEPTH_16BIT;
+		depthoffset = 0;
 	}
 
 	// Initial temperature.
@@ -775,13 +1051,9 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	unsigned int tank = 0;
 	unsigned int pressure = 0;
 	if (have_pressure) {
-		unsigned int idx = 2;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I750TC || parser->model == I770R)
-			idx = 16;
-		pressure = array_uint16_le(data + parser->header + idx);
+		pressure = array_uint16_le(data + parser->header + plan->pressure_initial);
 		if (pressure == 10000)
-			have_pressure = 0;
+			have_pressure = PRESSURE_NONE;
 	}
 
 	// Initial gas mix.
@@ -825,22 +1097,27 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 		// Check for a tank switch sample.
 		if (sampletype == 0xAA) {
-			if (parser->model == DATAMASK || parser->model == COMPUMASK) {
+			switch (plan->tankswitch) {
+			case TANK_SINGLE:
 				// Tank pressure (1 psi) and number
 				tank = 0;
 				pressure = (((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF);
-			} else if (parser->model == A300CS || parser->model == VTX ||
-				parser->model == I750TC || parser->model == I770R) {
+				break;
+			case TANK_1PSI:
 				// Tank pressure (1 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
 				pressure = ((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF;
-			} else {
+				break;
+			case TANK_ATOM2:
 				// Tank pressure (2 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
-				if (parser->model == ATOM2 || parser->model == EPICA || parser->model == EPICB)
-					pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
-				else
-					pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
+				break;
+			default:
+				// Tank pressure (2 psi) and number (one based index)
+				tank = (data[offset + 1] & 0x03) - 1;
+				pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				break;
 			}
 		} else if (sampletype == 0xBB) {
 			// The surface time is not always a nice multiple of the samplerate.
@@ -856,7 +1133,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 				// Vendor specific data
-				if (i == 0) {
+				if (i == 0 && dc_parser_wants (parser, DC_SAMPLE_VENDOR)) {
 					oceanic_atom2_parser_vendor (parser,
 						data + previous,
 						(offset - previous) + length,
@@ -879,7 +1156,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			}
 
 			// Time.
-			if (parser->model == I450T || parser->model == I470TC) {
+			if (plan->timestamp) {
 				unsigned int minute = bcd2dec(data[offset + 0]);
 				unsigned int hour   = bcd2dec(data[offset + 1] & 0x0F);
 				unsigned int second = bcd2dec(data[offset + 2]);
@@ -900,56 +1177,21 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 			// Vendor specific data
-			oceanic_atom2_parser_vendor (parser,
-				data + previous,
-				(offset - previous) + length,
-				samplesize, callback, userdata);
+			if (dc_parser_wants (parser, DC_SAMPLE_VENDOR)) {
+				oceanic_atom2_parser_vendor (parser,
+					data + previous,
+					(offset - previous) + length,
+					samplesize, callback, userdata);
+			}
 
 			// Temperature (°F)
 			if (have_temperature) {
-				if (parser->model == GEO || parser->model == ATOM1 ||
-					parser->model == ELEMENT2 || parser->model == MANTA ||
-					parser->model == ZEN) {
-					temperature = data[offset + 6];
-				} else if (parser->model == TALIS) {
-					temperature = data[offset + 7];
-				} else if (parser->model == GEO20 || parser->model == VEO20 ||
-					parser->model == VEO30 || parser->model == OC1A ||
-					parser->model == OC1B || parser->model == OC1C ||
-					parser->model == OCI || parser->model == A300 ||
-					parser->model == I450T || parser->model == I300 ||
-					parser->model == I200 || parser->model == I100 ||
-					parser->model == I300C || parser->model == I200C ||
-					parser->model == GEO40 || parser->model == VEO40 ||
-					parser->model == I470TC) {
-					temperature = data[offset + 3];
-				} else if (parser->model == OCS || parser->model == TX1) {
-					temperature = data[offset + 1];
-				} else if (parser->model == VT4 || parser->model == VT41 ||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == A300AI || parser->model == VISION ||
-					parser->model == XPAIR) {
+				if (have_temperature == TEMPERATURE_BYTE) {
+					temperature = data[offset + plan->temperature_offset];
+				} else if (have_temperature == TEMPERATURE_PACKED) {
 					temperature = ((data[offset + 7] & 0xF0) >> 4) | ((data[offset + 7] & 0x0C) << 2) | ((data[offset + 5] & 0x0C) << 4);
-				} else if (parser->model == A300CS || parser->model == VTX ||
-					parser->model == I750TC || parser->model == PROPLUSX ||
-					parser->model == I770R) {
-					temperature = data[offset + 11];
 				} else {
-					unsigned int sign;
-					if (parser->model == DG03 || parser->model == PROPLUS3 ||
-						parser->model == I550 || parser->model == I550C ||
-						parser->model == PROPLUS4 || parser->model == WISDOM4)
-						sign = (~data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == VOYAGER2G || parser->model == AMPHOS ||
-						parser->model == AMPHOSAIR || parser->model == ZENAIR)
-						sign = (data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == ATOM2 || parser->model == PROPLUS21 ||
-						parser->model == EPICA || parser->model == EPICB ||
-						parser->model == ATMOSAI2 ||
-						parser->model == WISDOM2 || parser->model == WISDOM3)
-						sign = (data[offset + 0] & 0x80) >> 7;
-					else
-						sign = (~data[offset + 0] & 0x80) >> 7;
+					unsigned int sign = ((data[offset + plan->sign_offset] & plan->sign_mask) != 0) ^ plan->sign_invert;
 					if (sign)
 						temperature -= (data[offset + 7] & 0x0C) >> 2;
 					else
@@ -961,22 +1203,11 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Tank Pressure (psi)
 			if (have_pressure) {
-				if (parser->model == OC1A || parser->model == OC1B ||
-					parser->model == OC1C || parser->model == OCI ||
-					parser->model == I450T || parser->model == I470TC)
+				if (have_pressure == PRESSURE_12BIT)
 					pressure = (data[offset + 10] + (data[offset + 11] << 8)) & 0x0FFF;
-				else if (parser->model == VT4 || parser->model == VT41||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == ZENAIR ||parser->model == A300AI ||
-					parser->model == DG03 || parser->model == PROPLUS3 ||
-					parser->model == AMPHOSAIR || parser->model == I550 ||
-					parser->model == VISION || parser->model == XPAIR ||
-					parser->model == I550C || parser->model == PROPLUS4 ||
-					parser->model == WISDOM4)
+				else if (have_pressure == PRESSURE_10BIT)
 					pressure = (((data[offset + 0] & 0x03) << 8) + data[offset + 1]) * 5;
-				else if (parser->model == TX1 || parser->model == A300CS ||
-					parser->model == VTX || parser->model == I750TC ||
-					parser->model == PROPLUSX || parser->model == I770R)
+				else if (have_pressure == PRESSURE_16BIT)
 					pressure = array_uint16_le (data + offset + 4);
 				else
 					pressure -= data[offset + 1];
@@ -987,77 +1218,33 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Depth (1/16 ft)
 			unsigned int depth;
-			if (parser->mode == FREEDIVE)
-				depth = array_uint16_le (data + offset);
-			else if (parser->model == GEO20 || parser->model == VEO20 ||
-				parser->model == VEO30 || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI || parser->model == A300 ||
-				parser->model == I450T || parser->model == I300 ||
-				parser->model == I200 || parser->model == I100 ||
-				parser->model == I300C || parser->model == I200C ||
-				parser->model == GEO40 || parser->model == VEO40 ||
-				parser->model == I470TC)
-				depth = (data[offset + 4] + (data[offset + 5] << 8)) & 0x0FFF;
-			else if (parser->model == ATOM1)
-				depth = data[offset + 3] * 16;
+			if (depthmode == DEPTH_16BIT)
+				depth = array_uint16_le (data + offset + depthoffset);
+			else if (depthmode == DEPTH_BYTE)
+				depth = data[offset + depthoffset] * 16;
 			else
-				depth = (data[offset + 2] + (data[offset + 3] << 8)) & 0x0FFF;
+				depth = array_uint16_le (data + offset + depthoffset) & 0x0FFF;
 			sample.depth = depth / 16.0 * FEET;
 			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
 			// Gas mix
-			unsigned int have_gasmix = 0;
-			unsigned int gasmix = 0;
-			if (parser->model == TX1) {
-				gasmix = data[offset] & 0x07;
-				have_gasmix = 1;
-			}
-			if (have_gasmix && gasmix != gasmix_previous) {
-				if (gasmix < 1 || gasmix > parser->ngasmixes) {
-					ERROR (abstract->context, "Invalid gas mix index (%u).", gasmix);
-					return DC_STATUS_DATAFORMAT;
+			if (plan->gasmix) {
+				unsigned int gasmix = data[offset] & 0x07;
+				if (gasmix != gasmix_previous) {
+					if (gasmix < 1 || gasmix > parser->ngasmixes) {
+						ERROR (abstract->context, "Invalid gas mix index (%u).", gasmix);
+						return DC_STATUS_DATAFORMAT;
+					}
+					sample.gasmix = gasmix - 1;
+					if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+					gasmix_previous = gasmix;
 				}
-				sample.gasmix = gasmix - 1;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-				gasmix_previous = gasmix;
 			}
 
 			// NDL / Deco
-			unsigned int have_deco = 0;
-			unsigned int decostop = 0, decotime = 0;
-			if (parser->model == A300CS || parser->model == VTX ||
-				parser->model == I750TC ||
-				parser->model == PROPLUSX || parser->model == I770R) {
-				decostop = (data[offset + 15] & 0x70) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == ZEN || parser->model == DG03) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x0FFF;
-				have_deco = 1;
-			} else if (parser->model == TX1) {
-				decostop = data[offset + 10];
-				decotime = array_uint16_le(data + offset + 6);
-				have_deco = 1;
-			} else if (parser->model == ATOM31 || parser->model == VISION ||
-				parser->model == XPAIR || parser->model == I550 ||
-				parser->model == I550C || parser->model == WISDOM4) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == I200 || parser->model == I300 ||
-				parser->model == OC1A || parser->model == OC1B ||
-				parser->model == OC1C || parser->model == OCI ||
-				parser->model == I100 || parser->model == I300C ||
-				parser->model == I450T || parser->model == I200C ||
-				parser->model == GEO40 || parser->model == VEO40 ||
-				parser->model == I470TC) {
-				decostop = (data[offset + 7] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x0FFF;
-				have_deco = 1;
-			}
-			if (have_deco) {
+			if (plan->deco) {
+				unsigned int decostop = (data[offset + plan->decostop_offset] & plan->decostop_mask) >> plan->decostop_shift;
+				unsigned int decotime = array_uint16_le(data + offset + plan->decotime_offset) & plan->decotime_mask;
 				if (decostop) {
 					sample.deco.type = DC_DECO_DECOSTOP;
 					sample.deco.depth = decostop * 10 * FEET;
@@ -1069,35 +1256,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
 			}
 
-			unsigned int have_rbt = 0;
-			unsigned int rbt = 0;
-			if (parser->model == ATOM31) {
-				rbt = array_uint16_le(data + offset + 6) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == I450T || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI || parser->model == PROPLUSX ||
-				parser->model == I770R || parser->model == I470TC) {
-				rbt = array_uint16_le(data + offset + 8) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == VISION || parser->model == XPAIR ||
-				parser->model == I550 || parser->model == I550C ||
-				parser->model == WISDOM4) {
-				rbt = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_rbt = 1;
-			}
-			if (have_rbt) {
-				sample.rbt = rbt;
+			// Remaining bottom time
+			if (plan->rbt_offset) {
+				sample.rbt = array_uint16_le(data + offset + plan->rbt_offset) & plan->rbt_mask;
 				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
 			}
 
 			// Bookmarks
-			unsigned int have_bookmark = 0;
-			if (parser->model == OC1A || parser->model == OC1B ||
-				parser->model == OC1C || parser->model == OCI) {
-				have_bookmark = data[offset + 12] & 0x80;
-			}
-			if (have_bookmark) {
+			if (plan->bookmark && (data[offset + 12] & 0x80)) {
 				sample.event.type = SAMPLE_EVENT_BOOKMARK;
 				sample.event.time = 0;
 				sample.event.flags = 0;
@@ -0,0 +1,218 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h> // memcpy, memset
+
+#include "simulator-private.h"
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+#include "platform.h"
+
+#define PAGESIZE 0x10
+
+#define CMD_VERSION   0x84
+#define CMD_READ1     0xB1
+#define CMD_READ8     0xB4
+#define CMD_READ16    0xB8
+#define CMD_WRITE     0xB2
+#define CMD_KEEPALIVE 0x91
+#define CMD_QUIT      0x6A
+
+#define ACK 0x5A
+#define NAK 0xA5
+
+typedef struct oceanic_atom2_simulator_t {
+	dc_simulator_protocol_t base;
+	unsigned char version[PAGESIZE];
+	unsigned char *memory;
+	unsigned int size;
+	unsigned int writing;
+	unsigned int page;
+} oceanic_atom2_simulator_t;
+
+static size_t oceanic_atom2_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size);
+static void oceanic_atom2_simulator_destroy (dc_simulator_protocol_t *abstract);
+
+static const dc_simulator_protocol_vtable_t oceanic_atom2_simulator_vtable = {
+	sizeof(oceanic_atom2_simulator_t),
+	oceanic_atom2_simulator_process, /* process */
+	oceanic_atom2_simulator_destroy, /* destroy */
+};
+
+dc_status_t
+oceanic_atom2_simulator_create (dc_simulator_protocol_t **out, dc_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	oceanic_atom2_simulator_t *protocol = NULL;
+
+	// Allocate memory.
+	protocol = (oceanic_atom2_simulator_t *) dc_simulator_protocol_allocate (simulator, &oceanic_atom2_simulator_vtable);
+	if (protocol == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size < PAGESIZE || (size - PAGESIZE) % PAGESIZE != 0 || size - PAGESIZE > 0x10000 * PAGESIZE) {
+		ERROR (protocol->base.context, "Unexpected memory size (" DC_PRINTF_SIZE " bytes).", size);
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	protocol->size = size - PAGESIZE;
+	protocol->writing = 0;
+	protocol->page = 0;
+	memcpy (protocol->version, data, PAGESIZE);
+
+	protocol->memory = (unsigned char *) dc_context_malloc (protocol->base.context, protocol->size ? protocol->size : 1);
+	if (protocol->memory == NULL) {
+		ERROR (protocol->base.context, "Failed to allocate memory.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memcpy (protocol->memory, data + PAGESIZE, protocol->size);
+
+	*out = (dc_simulator_protocol_t *) protocol;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+oceanic_atom2_simulator_destroy (dc_simulator_protocol_t *abstract)
+{
+	oceanic_atom2_simulator_t *protocol = (oceanic_atom2_simulator_t *) abstract;
+
+	dc_context_dealloc (protocol->base.context, protocol->memory);
+}
+
+static void
+oceanic_atom2_simulator_answer (oceanic_atom2_simulator_t *protocol, const unsigned char data[], unsigned int size, unsigned int crc_size)
+{
+	unsigned char answer[1 + 16 * PAGESIZE + 2];
+
+	answer[0] = ACK;
+	memcpy (answer + 1, data, size);
+	if (crc_size == 2) {
+		array_uint16_le_set (answer + 1 + size, checksum_add_uint16 (data, size, 0x0000));
+	} else {
+		answer[1 + size] = checksum_add_uint8 (data, size, 0x00);
+	}
+
+	dc_simulator_reply (protocol->base.simulator, answer, 1 + size + crc_size);
+}
+
+static void
+oceanic_atom2_simulator_read (oceanic_atom2_simulator_t *protocol, unsigned int number, unsigned int npages, unsigned int crc_size)
+{
+	unsigned char data[16 * PAGESIZE];
+	unsigned int address = number * PAGESIZE;
+	unsigned int length = npages * PAGESIZE;
+
+	// Pages beyond the end of the memory read as erased.
+	memset (data, 0xFF, length);
+	if (address < protocol->size) {
+		unsigned int available = protocol->size - address;
+		memcpy (data, protocol->memory + address, available < length ? available : length);
+	}
+
+	oceanic_atom2_simulator_answer (protocol, data, length, crc_size);
+}
+
+static size_t
+oceanic_atom2_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size)
+{
+	oceanic_atom2_simulator_t *protocol = (oceanic_atom2_simulator_t *) abstract;
+	const unsigned char ack[] = {ACK}, nak[] = {NAK};
+
+	if (protocol->writing) {
+		// Wait for the page data and its checksum.
+		if (size < PAGESIZE + 1)
+			return 0;
+
+		protocol->writing = 0;
+
+		if (data[PAGESIZE] != checksum_add_uint8 (data, PAGESIZE, 0x00)) {
+			WARNING (abstract->context, "Unexpected page checksum.");
+			dc_simulator_reply (abstract->simulator, nak, sizeof (nak));
+			return PAGESIZE + 1;
+		}
+
+		unsigned int address = protocol->page * PAGESIZE;
+		if (address + PAGESIZE <= protocol->size)
+			memcpy (protocol->memory + address, data, PAGESIZE);
+
+		dc_simulator_reply (abstract->simulator, ack, sizeof (ack));
+		return PAGESIZE + 1;
+	}
+
+	// Get the length of the command.
+	unsigned int csize = 1;
+	switch (data[0]) {
+	case CMD_READ1:
+	case CMD_READ8:
+	case CMD_READ16:
+	case CMD_WRITE:
+	case CMD_KEEPALIVE:
+		csize = 3;
+		break;
+	case CMD_QUIT:
+		csize = 4;
+		break;
+	default:
+		break;
+	}
+
+	if (size < csize)
+		return 0;
+
+	unsigned int number = csize >= 3 ? array_uint16_be (data + 1) : 0;
+
+	switch (data[0]) {
+	case CMD_VERSION:
+		oceanic_atom2_simulator_answer (protocol, protocol->version, sizeof (protocol->version), 1);
+		break;
+	case CMD_READ1:
+		oceanic_atom2_simulator_read (protocol, number, 1, 1);
+		break;
+	case CMD_READ8:
+		oceanic_atom2_simulator_read (protocol, number, 8, 1);
+		break;
+	case CMD_READ16:
+		oceanic_atom2_simulator_read (protocol, number, 16, 2);
+		break;
+	case CMD_WRITE:
+		protocol->writing = 1;
+		protocol->page = number;
+		dc_simulator_reply (abstract->simulator, ack, sizeof (ack));
+		break;
+	case CMD_KEEPALIVE:
+		dc_simulator_reply (abstract->simulator, ack, sizeof (ack));
+		break;
+	case CMD_QUIT:
+		dc_simulator_reply (abstract->simulator, nak, sizeof (nak));
+		break;
+	default:
+		// Unsupported commands are not answered.
+		WARNING (abstract->context, "Unsupported command (%02x).", data[0]);
+		break;
+	}
+
+	return csize;
+}
@@ -20,11 +20,11 @@
  */
 
 #include <string.h> // memcpy, memmove
-#include <stdlib.h> // malloc, free
 #include <assert.h> // assert
 
 #include "oceanic_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "ringbuffer.h"
 #include "rbstream.h"
@@ -40,6 +40,8 @@
 
 #define INVALID 0
 
+#define PREFETCH 4
+
 static unsigned int
 get_profile_first (const unsigned char data[], const oceanic_common_layout_t *layout, unsigned int pagesize)
 {
@@ -110,15 +112,25 @@ oceanic_common_match_pattern (const unsigned char *string, const unsigned char *
 }
 
 
-int
-oceanic_common_match (const unsigned char *version, const oceanic_common_version_t patterns[], unsigned int n)
+const oceanic_common_layout_t *
+oceanic_common_identify (const unsigned char *version, const oceanic_common_model_t models[], unsigned int n)
 {
 	for (unsigned int i = 0; i < n; ++i) {
-		if (oceanic_common_match_pattern (version, patterns[i]))
-			return 1;
+		// Reject on the first character, before the full pattern match.
+		if (models[i].pattern[0] != '\0' && models[i].pattern[0] != version[0])
+			continue;
+
+		if (!oceanic_common_match_pattern (version, models[i].pattern))
+			continue;
+
+		if (models[i].fw_layout &&
+			array_uint16_be (version + models[i].fw_offset) < models[i].fw_minimum)
+			return models[i].fw_layout;
+
+		return models[i].layout;
 	}
 
-	return 0;
+	return NULL;
 }
 
 
@@ -183,22 +195,213 @@ oceanic_common_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 }
 
 
-dc_status_t
-oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook)
+static dc_status_t
+oceanic_common_device_dump_range (dc_device_t *abstract, dc_event_progress_t *progress, unsigned char data[], unsigned int begin, unsigned int end)
 {
 	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
+	// Align the range to page boundaries.
+	begin -= begin % PAGESIZE;
+	if (end % PAGESIZE)
+		end += PAGESIZE - end % PAGESIZE;
+	if (end > device->layout->memsize)
+		end = device->layout->memsize;
+
+	if (begin >= end)
+		return DC_STATUS_SUCCESS;
+
+	progress->maximum += end - begin;
+
+	device_read_t read = {begin, end - begin, data + begin};
+	rc = device_read_batch (abstract, progress, &read, 1, PAGESIZE * device->multipage);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory.");
+		return rc;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+oceanic_common_device_dump_ring (dc_device_t *abstract, dc_event_progress_t *progress, unsigned char data[], unsigned int begin, unsigned int end, unsigned int rb_begin, unsigned int rb_end)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (begin < end)
+		return oceanic_common_device_dump_range (abstract, progress, data, begin, end);
+
+	// The range wraps around the end of the ringbuffer. Identical begin
+	// and end pointers cover the entire ringbuffer.
+	rc = oceanic_common_device_dump_range (abstract, progress, data, begin, rb_end);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_device_dump_range (abstract, progress, data, rb_begin, end);
+}
+
+
+dc_status_t
+oceanic_common_device_dump_update (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
 	assert (device != NULL);
 	assert (device->layout != NULL);
-	assert (device->layout->rb_logbook_entry_size <= sizeof (device->fingerprint));
-	assert (progress != NULL);
 
 	const oceanic_common_layout_t *layout = device->layout;
 
-	// Erase the buffer.
-	if (!dc_buffer_clear (logbook))
+	// Without a previous memory dump of the right size, or a logbook
+	// ringbuffer to locate the changes, fall back to a full dump.
+	if (dc_buffer_get_size (buffer) != layout->memsize ||
+		layout->rb_logbook_begin == layout->rb_logbook_end ||
+		layout->rb_profile_begin == layout->rb_profile_end)
+	{
+		dc_buffer_clear (buffer);
+		return oceanic_common_device_dump (abstract, buffer);
+	}
+
+	unsigned char *previous = dc_buffer_get_data (buffer);
+
+	// Update a copy, to leave the previous memory dump untouched when
+	// the update fails halfway.
+	unsigned char *data = (unsigned char *) dc_context_malloc (abstract->context, layout->memsize);
+	if (data == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
+	}
+
+	memcpy (data, previous, layout->memsize);
+
+	// Emit a vendor event.
+	dc_event_vendor_t vendor;
+	vendor.data = device->version;
+	vendor.size = sizeof (device->version);
+	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
+
+	// The amount of data becomes known step by step.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = 0;
+
+	// Re-read all memory outside the ringbuffers, which contains the
+	// settings and the ringbuffer pointers.
+	unsigned int lo_begin = layout->rb_logbook_begin, lo_end = layout->rb_logbook_end;
+	unsigned int hi_begin = layout->rb_profile_begin, hi_end = layout->rb_profile_end;
+	if (hi_begin < lo_begin) {
+		lo_begin = layout->rb_profile_begin;
+		lo_end   = layout->rb_profile_end;
+		hi_begin = layout->rb_logbook_begin;
+		hi_end   = layout->rb_logbook_end;
+	}
+
+	status = oceanic_common_device_dump_range (abstract, &progress, data, 0, lo_begin);
+	if (status == DC_STATUS_SUCCESS && lo_end < hi_begin)
+		status = oceanic_common_device_dump_range (abstract, &progress, data, lo_end, hi_begin);
+	if (status == DC_STATUS_SUCCESS)
+		status = oceanic_common_device_dump_range (abstract, &progress, data, hi_end, layout->memsize);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	// Get the old and new logbook pointers.
+	unsigned int pagesize = layout->highmem ? 16 * PAGESIZE : PAGESIZE;
+	unsigned int entrysize = layout->rb_logbook_entry_size;
+	unsigned int rb_old_last = array_uint16_le (previous + layout->cf_pointers + 6);
+	unsigned int rb_new_last = array_uint16_le (data + layout->cf_pointers + 6);
+
+	int full = 0;
+	if (rb_old_last < layout->rb_logbook_begin || rb_old_last >= layout->rb_logbook_end ||
+		rb_new_last < layout->rb_logbook_begin || rb_new_last >= layout->rb_logbook_end)
+	{
+		WARNING (abstract->context, "Invalid logbook end pointer detected (0x%04x 0x%04x).",
+			rb_old_last, rb_new_last);
+		full = 1;
+	}
+
+	if (!full) {
+		unsigned int rb_old_end = rb_old_last, rb_new_end = rb_new_last;
+		if (layout->pt_mode_global == 0) {
+			rb_old_end = RB_LOGBOOK_INCR (rb_old_last, entrysize, layout);
+			rb_new_end = RB_LOGBOOK_INCR (rb_new_last, entrysize, layout);
+		}
+
+		unsigned int rb_old_entry = ringbuffer_decrement (rb_old_end, entrysize, layout->rb_logbook_begin, layout->rb_logbook_end);
+		unsigned int rb_new_entry = ringbuffer_decrement (rb_new_end, entrysize, layout->rb_logbook_begin, layout->rb_logbook_end);
+
+		// Read the new logbook entries, and always the most recent one.
+		if (rb_old_end != rb_new_end) {
+			status = oceanic_common_device_dump_ring (abstract, &progress, data,
+				rb_old_end, rb_new_end, layout->rb_logbook_begin, layout->rb_logbook_end);
+		} else {
+			status = oceanic_common_device_dump_range (abstract, &progress, data,
+				rb_new_entry, rb_new_entry + entrysize);
+		}
+		if (status != DC_STATUS_SUCCESS)
+			goto error_free;
+
+		const unsigned char *old_entry = previous + rb_old_entry;
+		const unsigned char *new_entry = data + rb_new_entry;
+
+		if (rb_old_end == rb_new_end) {
+			// Unchanged pointers with a different most recent entry means
+			// the logbook ringbuffer wrapped around completely.
+			if (memcmp (old_entry, new_entry, entrysize) != 0)
+				full = 1;
+		} else if (array_isequal (new_entry, entrysize, 0xFF)) {
+			full = 1;
+		} else if (array_isequal (old_entry, entrysize, 0xFF)) {
+			// No dives in the previous memory dump.
+			status = oceanic_common_device_dump_ring (abstract, &progress, data,
+				layout->rb_profile_begin, layout->rb_profile_begin, layout->rb_profile_begin, layout->rb_profile_end);
+		} else {
+			unsigned int rb_old_profile = get_profile_last (old_entry, layout, pagesize);
+			unsigned int rb_new_profile = get_profile_last (new_entry, layout, pagesize);
+			if (rb_old_profile < layout->rb_profile_begin || rb_old_profile >= layout->rb_profile_end ||
+				rb_new_profile < layout->rb_profile_begin || rb_new_profile >= layout->rb_profile_end ||
+				rb_old_profile == rb_new_profile)
+			{
+				full = 1;
+			} else {
+				status = oceanic_common_device_dump_ring (abstract, &progress, data,
+					RB_PROFILE_INCR (rb_old_profile, pagesize, layout),
+					RB_PROFILE_INCR (rb_new_profile, pagesize, layout),
+					layout->rb_profile_begin, layout->rb_profile_end);
+			}
+		}
+		if (status != DC_STATUS_SUCCESS)
+			goto error_free;
+	}
+
+	// Re-read both ringbuffers entirely when the changes can't be located.
+	if (full) {
+		WARNING (abstract->context, "Unable to locate the changes, reading the ringbuffers entirely.");
+		status = oceanic_common_device_dump_ring (abstract, &progress, data,
+			layout->rb_logbook_begin, layout->rb_logbook_begin, layout->rb_logbook_begin, layout->rb_logbook_end);
+		if (status == DC_STATUS_SUCCESS)
+			status = oceanic_common_device_dump_ring (abstract, &progress, data,
+				layout->rb_profile_begin, layout->rb_profile_begin, layout->rb_profile_begin, layout->rb_profile_end);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_free;
+	}
+
+	memcpy (previous, data, layout->memsize);
+
+error_free:
+	dc_context_dealloc (abstract->context, data);
+	return status;
+}
+
+static dc_status_t
+oceanic_common_device_pointers (dc_device_t *abstract, dc_event_progress_t *progress, unsigned int *end, unsigned int *size)
+{
+	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	const oceanic_common_layout_t *layout = device->layout;
+
+	*end = 0;
+	*size = 0;
 
 	// For devices without a logbook ringbuffer, downloading dives isn't
 	// possible. This is not considered a fatal error, but handled as if there
@@ -257,6 +460,35 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 	progress->maximum -= (layout->rb_logbook_end - layout->rb_logbook_begin) - rb_logbook_size;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 
+	*end = rb_logbook_end;
+	*size = rb_logbook_size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook)
+{
+	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	assert (device != NULL);
+	assert (device->layout != NULL);
+	assert (device->layout->rb_logbook_entry_size <= sizeof (device->fingerprint));
+	assert (progress != NULL);
+
+	const oceanic_common_layout_t *layout = device->layout;
+
+	// Erase the buffer.
+	if (!dc_buffer_clear (logbook))
+		return DC_STATUS_NOMEMORY;
+
+	// Get the logbook end pointer and the number of bytes.
+	unsigned int rb_logbook_end = 0, rb_logbook_size = 0;
+	rc = oceanic_common_device_pointers (abstract, progress, &rb_logbook_end, &rb_logbook_size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	// Exit if there are no dives.
 	if (rb_logbook_size == 0) {
 		return DC_STATUS_SUCCESS;
@@ -271,7 +503,7 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_logbook_begin, layout->rb_logbook_end, rb_logbook_end);
+	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_logbook_begin, layout->rb_logbook_end, rb_logbook_end, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
@@ -433,14 +665,22 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_profile_end);
+	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_profile_end, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
 	}
 
+	// Read ahead, limited to the exact amount of profile data.
+	rc = dc_rbstream_set_prefetch (rbstream, PREFETCH, rb_profile_size);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to enable the read-ahead.");
+		dc_rbstream_free (rbstream);
+		return rc;
+	}
+
 	// Memory buffer for the profile data.
-	unsigned char *profiles = (unsigned char *) malloc (rb_profile_size + rb_logbook_size);
+	unsigned char *profiles = (unsigned char *) dc_context_malloc (abstract->context, rb_profile_size + rb_logbook_size);
 	if (profiles == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		dc_rbstream_free (rbstream);
@@ -478,7 +718,7 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
 				rb_entry_first, rb_entry_last);
 			dc_rbstream_free (rbstream);
-			free (profiles);
+			dc_context_dealloc (abstract->context, profiles);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -507,7 +747,7 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
 			dc_rbstream_free (rbstream);
-			free (profiles);
+			dc_context_dealloc (abstract->context, profiles);
 			return rc;
 		}
 
@@ -541,12 +781,201 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 	}
 
 	dc_rbstream_free (rbstream);
-	free (profiles);
+	dc_context_dealloc (abstract->context, profiles);
 
 	return DC_STATUS_SUCCESS;
 }
 
 
+/*
+ * Download the logbook and profile ringbuffers together. Each dive is
+ * passed to the application as soon as its logbook entry and profile
+ * have been read, instead of downloading all the logbook entries first.
+ */
+static dc_status_t
+oceanic_common_device_pipeline (dc_device_t *abstract, dc_event_progress_t *progress, dc_dive_callback_t callback, void *userdata)
+{
+	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_rbstream_t *rblogbook = NULL, *rbprofile = NULL;
+	dc_buffer_t *buffer = NULL;
+
+	assert (device != NULL);
+	assert (device->layout != NULL);
+	assert (device->layout->rb_logbook_entry_size <= sizeof (device->fingerprint));
+	assert (progress != NULL);
+
+	const oceanic_common_layout_t *layout = device->layout;
+	unsigned int entrysize = layout->rb_logbook_entry_size;
+
+	// Get the pagesize
+	unsigned int pagesize = layout->highmem ? 16 * PAGESIZE : PAGESIZE;
+
+	// Get the logbook end pointer and the number of bytes.
+	unsigned int rb_logbook_end = 0, rb_logbook_size = 0;
+	rc = oceanic_common_device_pointers (abstract, progress, &rb_logbook_end, &rb_logbook_size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Exit if there are no dives.
+	if (rb_logbook_size == 0) {
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Create the ringbuffer stream.
+	rc = dc_rbstream_new (&rblogbook, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_logbook_begin, layout->rb_logbook_end, rb_logbook_end, DC_RBSTREAM_BACKWARD);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+		return rc;
+	}
+
+	// Memory buffer for the dive data.
+	buffer = dc_buffer_allocate (abstract->context, 0);
+	if (buffer == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	// The logbook ringbuffer is read backwards to retrieve the most recent
+	// entries first. If an already downloaded entry is identified (by means
+	// of its fingerprint), the transfer is aborted immediately to reduce
+	// the transfer time. The profile ringbuffer is read backwards too,
+	// right after every logbook entry.
+	unsigned char logbook[sizeof (device->fingerprint)];
+	unsigned int remaining = layout->rb_profile_end - layout->rb_profile_begin;
+	unsigned int previous = INVALID;
+	unsigned int nbytes = 0;
+	while (nbytes < rb_logbook_size) {
+		// Read the logbook entry.
+		rc = dc_rbstream_read (rblogbook, progress, logbook, entrysize);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the memory.");
+			status = rc;
+			goto error_free;
+		}
+
+		nbytes += entrysize;
+
+		// Check for uninitialized entries. Normally, such entries are
+		// never present, except when the ringbuffer is actually empty,
+		// but the ringbuffer pointers are not set to their empty values.
+		if (array_isequal (logbook, entrysize, 0xFF)) {
+			WARNING (abstract->context, "Uninitialized logbook entries detected!");
+			continue;
+		}
+
+		// Compare the fingerprint to identify previously downloaded entries.
+		if (memcmp (logbook, device->fingerprint, entrysize) == 0) {
+			break;
+		}
+
+		// Get the profile pointers.
+		unsigned int rb_entry_first = get_profile_first (logbook, layout, pagesize);
+		unsigned int rb_entry_last  = get_profile_last (logbook, layout, pagesize);
+		if (rb_entry_first < layout->rb_profile_begin ||
+			rb_entry_first >= layout->rb_profile_end ||
+			rb_entry_last < layout->rb_profile_begin ||
+			rb_entry_last >= layout->rb_profile_end)
+		{
+			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
+				rb_entry_first, rb_entry_last);
+			status = DC_STATUS_DATAFORMAT;
+			goto error_free;
+		}
+
+		// Calculate the end pointer and the number of bytes.
+		unsigned int rb_entry_end   = RB_PROFILE_INCR (rb_entry_last, pagesize, layout);
+		unsigned int rb_entry_size  = RB_PROFILE_DISTANCE (rb_entry_first, rb_entry_last, layout) + pagesize;
+
+		// Take the end pointer of the most recent logbook entry as the
+		// end of profile pointer.
+		if (rbprofile == NULL) {
+			rc = dc_rbstream_new (&rbprofile, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_entry_end, DC_RBSTREAM_BACKWARD);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+				status = rc;
+				goto error_free;
+			}
+			previous = rb_entry_end;
+		}
+
+		// Skip gaps between the profiles.
+		unsigned int gap = 0;
+		if (rb_entry_end != previous) {
+			WARNING (abstract->context, "Profiles are not continuous.");
+			gap = RB_PROFILE_DISTANCE (rb_entry_end, previous, layout);
+		}
+
+		// Make sure the profile size is valid.
+		if (rb_entry_size + gap > remaining) {
+			WARNING (abstract->context, "Unexpected profile size.");
+			break;
+		}
+
+		// Read ahead, limited to the profile of the current dive, because
+		// the size of the next one isn't known yet.
+		rc = dc_rbstream_set_prefetch (rbprofile, PREFETCH, rb_entry_size + gap);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to enable the read-ahead.");
+			status = rc;
+			goto error_free;
+		}
+
+		if (!dc_buffer_resize (buffer, entrysize + rb_entry_size + gap)) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+
+		// Prepend the logbook entry to the profile data.
+		unsigned char *p = dc_buffer_get_data (buffer);
+		memcpy (p, logbook, entrysize);
+
+		// Read the dive.
+		rc = dc_rbstream_read (rbprofile, progress, p + entrysize, rb_entry_size + gap);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the dive.");
+			status = rc;
+			goto error_free;
+		}
+
+		remaining -= rb_entry_size + gap;
+		previous = rb_entry_first;
+
+		// Remove padding from the profile.
+		if (layout->highmem) {
+			// The logbook entry contains the total number of pages containing
+			// profile data, excluding the footer page. Limit the profile size
+			// to this size.
+			unsigned int value = array_uint16_le (p + 12);
+			unsigned int value_hi = value & 0xE000;
+			unsigned int value_lo = value & 0x0FFF;
+			unsigned int npages = ((value_hi >> 1) | value_lo) + 1;
+			unsigned int length = npages * PAGESIZE;
+			if (rb_entry_size > length) {
+				rb_entry_size = length;
+			}
+		}
+
+		if (callback && !callback (p, rb_entry_size + entrysize, p, entrysize, userdata)) {
+			break;
+		}
+	}
+
+	// Update and emit a progress event.
+	progress->maximum -= (rb_logbook_size - nbytes) + remaining;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+
+error_free:
+	dc_buffer_free (buffer);
+	dc_rbstream_free (rbprofile);
+	dc_rbstream_free (rblogbook);
+	return status;
+}
+
+
 dc_status_t
 oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -597,8 +1026,15 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 			(id[13] & 0x0F) * 10     + ((id[13] & 0xF0) >> 4) * 1;
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	// Download the logbook and profile ringbuffers in a single pass,
+	// unless the backend provides its own implementation.
+	if (VTABLE(abstract)->logbook == oceanic_common_device_logbook &&
+		VTABLE(abstract)->profile == oceanic_common_device_profile) {
+		return oceanic_common_device_pipeline (abstract, &progress, callback, userdata);
+	}
+
 	// Memory buffer for the logbook data.
-	dc_buffer_t *logbook = dc_buffer_new (0);
+	dc_buffer_t *logbook = dc_buffer_allocate (abstract->context, 0);
 	if (logbook == NULL) {
 		return DC_STATUS_NOMEMORY;
 	}
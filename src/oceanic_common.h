@@ -31,9 +31,9 @@ extern "C" {
 #define PAGESIZE 0x10
 #define FPMAXSIZE 0x20
 
-#define OCEANIC_COMMON_MATCH(version,patterns) \
-	oceanic_common_match ((version), (patterns), \
-	sizeof (patterns) / sizeof *(patterns))
+#define OCEANIC_COMMON_IDENTIFY(version,models) \
+	oceanic_common_identify ((version), (models), \
+	sizeof (models) / sizeof *(models))
 
 typedef struct oceanic_common_layout_t {
 	// Memory size.
@@ -75,8 +75,18 @@ typedef struct oceanic_common_device_vtable_t {
 
 typedef unsigned char oceanic_common_version_t[PAGESIZE + 1];
 
-int
-oceanic_common_match (const unsigned char *version, const oceanic_common_version_t patterns[], unsigned int n);
+typedef struct oceanic_common_model_t {
+	oceanic_common_version_t pattern;
+	const oceanic_common_layout_t *layout;
+	// Firmware versions older than the big endian value at the
+	// given offset of the version string use the alternative layout.
+	unsigned int fw_offset;
+	unsigned int fw_minimum;
+	const oceanic_common_layout_t *fw_layout;
+} oceanic_common_model_t;
+
+const oceanic_common_layout_t *
+oceanic_common_identify (const unsigned char *version, const oceanic_common_model_t models[], unsigned int n);
 
 void
 oceanic_common_device_init (oceanic_common_device_t *device);
@@ -93,6 +103,9 @@ oceanic_common_device_set_fingerprint (dc_device_t *device, const unsigned char
 dc_status_t
 oceanic_common_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
 
+dc_status_t
+oceanic_common_device_dump_update (dc_device_t *abstract, dc_buffer_t *buffer);
+
 dc_status_t
 oceanic_common_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
 
@@ -54,7 +54,9 @@ static const oceanic_common_device_vtable_t oceanic_veo250_device_vtable = {
 		oceanic_veo250_device_read, /* read */
 		NULL, /* write */
 		oceanic_common_device_dump, /* dump */
+		oceanic_common_device_dump_update, /* dump_update */
 		oceanic_common_device_foreach, /* foreach */
+		NULL, /* extract */
 		NULL, /* timesync */
 		oceanic_veo250_device_close /* close */
 	},
@@ -62,17 +64,6 @@ static const oceanic_common_device_vtable_t oceanic_veo250_device_vtable = {
 	oceanic_common_device_profile,
 };
 
-static const oceanic_common_version_t oceanic_veo250_version[] = {
-	{"GENREACT \0\0 256K"},
-	{"VEO 200 R\0\0 256K"},
-	{"VEO 250 R\0\0 256K"},
-	{"SEEMANN R\0\0 256K"},
-	{"VEO 180 R\0\0 256K"},
-	{"AERISXR2 \0\0 256K"},
-	{"INSIGHT R\0\0 256K"},
-	{"HO DGO2 R\0\0 256K"},
-};
-
 static const oceanic_common_layout_t oceanic_veo250_layout = {
 	0x8000, /* memsize */
 	0, /* highmem */
@@ -88,6 +79,17 @@ static const oceanic_common_layout_t oceanic_veo250_layout = {
 	1, /* pt_mode_serial */
 };
 
+static const oceanic_common_model_t oceanic_veo250_models[] = {
+	{"GENREACT \0\0 256K", &oceanic_veo250_layout},
+	{"VEO 200 R\0\0 256K", &oceanic_veo250_layout},
+	{"VEO 250 R\0\0 256K", &oceanic_veo250_layout},
+	{"SEEMANN R\0\0 256K", &oceanic_veo250_layout},
+	{"VEO 180 R\0\0 256K", &oceanic_veo250_layout},
+	{"AERISXR2 \0\0 256K", &oceanic_veo250_layout},
+	{"INSIGHT R\0\0 256K", &oceanic_veo250_layout},
+	{"HO DGO2 R\0\0 256K", &oceanic_veo250_layout},
+};
+
 
 static dc_status_t
 oceanic_veo250_send (oceanic_veo250_device_t *device, const unsigned char command[], unsigned int csize)
@@ -317,9 +319,8 @@ oceanic_veo250_device_open (dc_device_t **out, dc_context_t *context, dc_iostrea
 	}
 
 	// Override the base class values.
-	if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_veo250_version)) {
-		device->base.layout = &oceanic_veo250_layout;
-	} else {
+	device->base.layout = OCEANIC_COMMON_IDENTIFY (device->base.version, oceanic_veo250_models);
+	if (device->base.layout == NULL) {
 		WARNING (context, "Unsupported device detected!");
 		device->base.layout = &oceanic_veo250_layout;
 	}
@@ -409,6 +410,48 @@ oceanic_veo250_device_version (dc_device_t *abstract, unsigned char data[], unsi
 }
 
 
+static unsigned int
+oceanic_veo250_page_command (dc_device_t *abstract, unsigned char command[], unsigned int address, unsigned int npages)
+{
+	oceanic_veo250_device_t *device = (oceanic_veo250_device_t*) abstract;
+
+	unsigned int first = address / PAGESIZE;
+	unsigned int last  = first + npages - 1;
+
+	command[0] = 0x20;
+	command[1] = (first     ) & 0xFF; // low
+	command[2] = (first >> 8) & 0xFF; // high
+	command[3] = (last     ) & 0xFF; // low
+	command[4] = (last >> 8) & 0xFF; // high
+	command[5] = 0;
+
+	// The keepalive command repeats the last page number.
+	device->last = last;
+
+	return 6;
+}
+
+
+static dc_status_t
+oceanic_veo250_page_transfer (dc_device_t *abstract, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+{
+	return oceanic_veo250_transfer ((oceanic_veo250_device_t *) abstract, command, csize, answer, asize);
+}
+
+
+static const device_page_protocol_t oceanic_veo250_page_protocol = {
+	PAGESIZE, /* pagesize */
+	MULTIPAGE, /* maxpages */
+	0, /* header */
+	1, /* trailer */
+	DEVICE_PAGE_CHECKSUM_ADD8, /* checksum */
+	MAXRETRIES, /* maxretries */
+	100, /* delay */
+	oceanic_veo250_page_command, /* command */
+	oceanic_veo250_page_transfer, /* transfer */
+};
+
+
 static dc_status_t
 oceanic_veo250_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -418,47 +461,5 @@ oceanic_veo250_device_read (dc_device_t *abstract, unsigned int address, unsigne
 		(size    % PAGESIZE != 0))
 		return DC_STATUS_INVALIDARGS;
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the number of packages.
-		unsigned int npackets = (size - nbytes) / PAGESIZE;
-		if (npackets > MULTIPAGE)
-			npackets = MULTIPAGE;
-
-		// Read the package.
-		unsigned int first =  address / PAGESIZE;
-		unsigned int last  = first + npackets - 1;
-		unsigned char answer[(PAGESIZE + 1) * MULTIPAGE + 1] = {0};
-		unsigned char command[6] = {0x20,
-				(first     ) & 0xFF, // low
-				(first >> 8) & 0xFF, // high
-				(last     ) & 0xFF, // low
-				(last >> 8) & 0xFF, // high
-				0};
-		dc_status_t rc = oceanic_veo250_transfer (device, command, sizeof (command), answer, (PAGESIZE + 1) * npackets + 1);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		device->last = last;
-
-		unsigned int offset = 0;
-		for (unsigned int i = 0; i < npackets; ++i) {
-			// Verify the checksum of the answer.
-			unsigned char crc = answer[offset + PAGESIZE];
-			unsigned char ccrc = checksum_add_uint8 (answer + offset, PAGESIZE, 0x00);
-			if (crc != ccrc) {
-				ERROR (abstract->context, "Unexpected answer checksum.");
-				return DC_STATUS_PROTOCOL;
-			}
-
-			memcpy (data, answer + offset, PAGESIZE);
-
-			offset += PAGESIZE + 1;
-			nbytes += PAGESIZE;
-			address += PAGESIZE;
-			data += PAGESIZE;
-		}
-	}
-
-	return DC_STATUS_SUCCESS;
+	return device_page_read (abstract, device->iostream, &oceanic_veo250_page_protocol, address, data, size);
 }
@@ -66,7 +66,9 @@ static const oceanic_common_device_vtable_t oceanic_vtpro_device_vtable = {
 		oceanic_vtpro_device_read, /* read */
 		NULL, /* write */
 		oceanic_common_device_dump, /* dump */
+		oceanic_common_device_dump_update, /* dump_update */
 		oceanic_common_device_foreach, /* foreach */
+		NULL, /* extract */
 		NULL, /* timesync */
 		oceanic_vtpro_device_close /* close */
 	},
@@ -74,19 +76,6 @@ static const oceanic_common_device_vtable_t oceanic_vtpro_device_vtable = {
 	oceanic_common_device_profile,
 };
 
-static const oceanic_common_version_t oceanic_vtpro_version[] = {
-	{"VERSAPRO \0\0 256K"},
-	{"ATMOSTWO \0\0 256K"},
-	{"PROPLUS2 \0\0 256K"},
-	{"ATMOSAIR \0\0 256K"},
-	{"VTPRO  r\0\0  256K"},
-	{"ELITE  r\0\0  256K"},
-};
-
-static const oceanic_common_version_t oceanic_wisdom_version[] = {
-	{"WISDOM r\0\0  256K"},
-};
-
 static const oceanic_common_layout_t oceanic_vtpro_layout = {
 	0x8000, /* memsize */
 	0, /* highmem */
@@ -132,6 +121,16 @@ static const oceanic_common_layout_t aeris_500ai_layout = {
 	2, /* pt_mode_serial */
 };
 
+static const oceanic_common_model_t oceanic_vtpro_models[] = {
+	{"WISDOM r\0\0  256K", &oceanic_wisdom_layout},
+	{"VERSAPRO \0\0 256K", &oceanic_vtpro_layout},
+	{"ATMOSTWO \0\0 256K", &oceanic_vtpro_layout},
+	{"PROPLUS2 \0\0 256K", &oceanic_vtpro_layout},
+	{"ATMOSAIR \0\0 256K", &oceanic_vtpro_layout},
+	{"VTPRO  r\0\0  256K", &oceanic_vtpro_layout},
+	{"ELITE  r\0\0  256K", &oceanic_vtpro_layout},
+};
+
 static dc_status_t
 oceanic_vtpro_send (oceanic_vtpro_device_t *device, const unsigned char command[], unsigned int csize)
 {
@@ -494,13 +493,12 @@ oceanic_vtpro_device_open (dc_device_t **out, dc_context_t *context, dc_iostream
 	// Override the base class values.
 	if (model == AERIS500AI) {
 		device->base.layout = &aeris_500ai_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_wisdom_version)) {
-		device->base.layout = &oceanic_wisdom_layout;
-	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_vtpro_version)) {
-		device->base.layout = &oceanic_vtpro_layout;
 	} else {
-		WARNING (context, "Unsupported device detected!");
-		device->base.layout = &oceanic_vtpro_layout;
+		device->base.layout = OCEANIC_COMMON_IDENTIFY (device->base.version, oceanic_vtpro_models);
+		if (device->base.layout == NULL) {
+			WARNING (context, "Unsupported device detected!");
+			device->base.layout = &oceanic_vtpro_layout;
+		}
 	}
 
 	*out = (dc_device_t*) device;
@@ -620,6 +618,43 @@ oceanic_vtpro_device_version (dc_device_t *abstract, unsigned char data[], unsig
 }
 
 
+static unsigned int
+oceanic_vtpro_page_command (dc_device_t *abstract, unsigned char command[], unsigned int address, unsigned int npages)
+{
+	unsigned int first = address / PAGESIZE;
+	unsigned int last  = first + npages - 1;
+
+	command[0] = 0x34;
+	command[1] = (first >> 8) & 0xFF; // high
+	command[2] = (first     ) & 0xFF; // low
+	command[3] = (last >> 8) & 0xFF; // high
+	command[4] = (last     ) & 0xFF; // low
+	command[5] = 0x00;
+
+	return 6;
+}
+
+
+static dc_status_t
+oceanic_vtpro_page_transfer (dc_device_t *abstract, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+{
+	return oceanic_vtpro_transfer ((oceanic_vtpro_device_t *) abstract, command, csize, answer, asize);
+}
+
+
+static const device_page_protocol_t oceanic_vtpro_page_protocol = {
+	PAGESIZE, /* pagesize */
+	MULTIPAGE, /* maxpages */
+	0, /* header */
+	0, /* trailer */
+	DEVICE_PAGE_CHECKSUM_ADD8, /* checksum */
+	MAXRETRIES, /* maxretries */
+	100, /* delay */
+	oceanic_vtpro_page_command, /* command */
+	oceanic_vtpro_page_transfer, /* transfer */
+};
+
+
 static dc_status_t
 oceanic_vtpro_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -629,45 +664,5 @@ oceanic_vtpro_device_read (dc_device_t *abstract, unsigned int address, unsigned
 		(size    % PAGESIZE != 0))
 		return DC_STATUS_INVALIDARGS;
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the number of packages.
-		unsigned int npackets = (size - nbytes) / PAGESIZE;
-		if (npackets > MULTIPAGE)
-			npackets = MULTIPAGE;
-
-		// Read the package.
-		unsigned int first =  address / PAGESIZE;
-		unsigned int last  = first + npackets - 1;
-		unsigned char answer[(PAGESIZE + 1) * MULTIPAGE] = {0};
-		unsigned char command[6] = {0x34,
-				(first >> 8) & 0xFF, // high
-				(first     ) & 0xFF, // low
-				(last >> 8) & 0xFF, // high
-				(last     ) & 0xFF, // low
-				0x00};
-		dc_status_t rc = oceanic_vtpro_transfer (device, command, sizeof (command), answer, (PAGESIZE + 1) * npackets);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		unsigned int offset = 0;
-		for (unsigned int i = 0; i < npackets; ++i) {
-			// Verify the checksum of the answer.
-			unsigned char crc = answer[offset + PAGESIZE];
-			unsigned char ccrc = checksum_add_uint8 (answer + offset, PAGESIZE, 0x00);
-			if (crc != ccrc) {
-				ERROR (abstract->context, "Unexpected answer checksum.");
-				return DC_STATUS_PROTOCOL;
-			}
-
-			memcpy (data, answer + offset, PAGESIZE);
-
-			offset += PAGESIZE + 1;
-			nbytes += PAGESIZE;
-			address += PAGESIZE;
-			data += PAGESIZE;
-		}
-	}
-
-	return DC_STATUS_SUCCESS;
+	return device_page_read (abstract, device->iostream, &oceanic_vtpro_page_protocol, address, data, size);
 }
@@ -158,9 +158,13 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
+	// The dive time is only available in the profile.
+	if (!parser->cached && dc_parser_is_summary (parser)) {
+		if (type == DC_FIELD_DIVETIME)
+			return DC_STATUS_FULLSCAN;
+	} else if (!parser->cached) {
 		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = oceanic_vtpro_parser_samples_foreach (
+		dc_status_t rc = dc_parser_samples_walk (
 			abstract, sample_statistics_cb, &statistics);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -334,10 +338,12 @@ oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 		// Vendor specific data
-		sample.vendor.type = SAMPLE_VENDOR_OCEANIC_VTPRO;
-		sample.vendor.size = PAGESIZE / 2;
-		sample.vendor.data = data + offset;
-		if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
+		if (dc_parser_wants (abstract, DC_SAMPLE_VENDOR)) {
+			sample.vendor.type = SAMPLE_VENDOR_OCEANIC_VTPRO;
+			sample.vendor.size = PAGESIZE / 2;
+			sample.vendor.data = data + offset;
+			if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
+		}
 
 		// Depth (ft)
 		unsigned int depth = 0;
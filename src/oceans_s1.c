@@ -10,14 +10,17 @@
 
 #include "oceans_s1.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
+#include "bleline.h"
 
 #define S1_FINGERPRINT 32
 
 typedef struct oceans_s1_device_t {
 	dc_device_t base;
 	dc_iostream_t* iostream;
+	dc_bleline_t *bleline;
 	unsigned char fingerprint[S1_FINGERPRINT];
 } oceans_s1_device_t;
 
@@ -33,7 +36,9 @@ static const dc_device_vtable_t oceans_s1_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	oceans_s1_device_foreach, /* foreach */
+	NULL, /* extract */
 	oceans_s1_device_timesync, /* timesync */
 	oceans_s1_device_close, /* close */
 };
@@ -41,7 +46,7 @@ static const dc_device_vtable_t oceans_s1_device_vtable = {
 static dc_status_t
 oceans_s1_write(oceans_s1_device_t *s1, const char *msg)
 {
-	return dc_iostream_write(s1->iostream, msg, strlen(msg), NULL);
+	return dc_bleline_write(s1->bleline, msg, strlen(msg));
 }
 
 static dc_status_t
@@ -50,7 +55,7 @@ oceans_s1_read(oceans_s1_device_t *s1, char *buf, size_t bufsz)
 	size_t nbytes;
 	dc_status_t status;
 
-	status = dc_iostream_read(s1->iostream, buf, bufsz, &nbytes);
+	status = dc_bleline_read(s1->bleline, buf, bufsz, &nbytes);
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 	if (nbytes < bufsz)
@@ -131,7 +136,7 @@ static dc_status_t oceans_s1_get_sequence(oceans_s1_device_t *s1, unsigned char
 	dc_status_t status;
 	size_t nbytes;
 
-	status = dc_iostream_read(s1->iostream, buffer, BLOB_BUFSZ, &nbytes);
+	status = dc_bleline_read(s1->bleline, buffer, BLOB_BUFSZ, &nbytes);
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 	if (!nbytes)
@@ -149,21 +154,25 @@ static dc_status_t oceans_s1_get_sequence(oceans_s1_device_t *s1, unsigned char
 	nbytes -= 3;
 	dc_buffer_append(res, buffer+3, nbytes);
 	while (nbytes < 512) {
-		size_t got;
+		size_t got, want = 512 - nbytes;
 
-		status = dc_iostream_read(s1->iostream, buffer, BLOB_BUFSZ, &got);
+		if (want > BLOB_BUFSZ)
+			want = BLOB_BUFSZ;
+
+		status = dc_bleline_read(s1->bleline, buffer, want, &got);
 		if (status != DC_STATUS_SUCCESS)
 			return status;
 
 		if (!got)
 			return DC_STATUS_IO;
 
-		// We should check the checksum if it is that?
-		if (got + nbytes > 512)
-			got = 512-nbytes;
 		dc_buffer_append(res, buffer, got);
 		nbytes += got;
 	}
+
+	// We should check the checksum if it is that? For now, drop
+	// the trailer. The next sequence starts at a packet boundary.
+	dc_bleline_discard(s1->bleline);
 	return DC_STATUS_SUCCESS;
 }
 
@@ -175,7 +184,7 @@ static dc_status_t oceans_s1_get_blob(oceans_s1_device_t *s1, const unsigned cha
 	size_t size;
 	unsigned char seq;
 
-	res = dc_buffer_new(0);
+	res = dc_buffer_allocate (s1->base.context, 0);
 	if (!res)
 		return DC_STATUS_NOMEMORY;
 
@@ -184,7 +193,7 @@ static dc_status_t oceans_s1_get_blob(oceans_s1_device_t *s1, const unsigned cha
 	// The Oceans Android app uses a "Write Command" rather than
 	// a "Write Request" for this, but it seems to not matter
 
-	status = dc_iostream_write(s1->iostream, "C", 1, NULL);
+	status = dc_bleline_write(s1->bleline, "C", 1);
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
@@ -200,7 +209,7 @@ static dc_status_t oceans_s1_get_blob(oceans_s1_device_t *s1, const unsigned cha
 		}
 
 		// Ack the packet sequence, and go look for the next one
-		status = dc_iostream_write(s1->iostream, "\006", 1, NULL);
+		status = dc_bleline_write(s1->bleline, "\006", 1);
 		if (status != DC_STATUS_SUCCESS)
 			return status;
 		seq++;
@@ -209,7 +218,7 @@ static dc_status_t oceans_s1_get_blob(oceans_s1_device_t *s1, const unsigned cha
 
 
 	// Tell the Oceans S1 to exit block mode (??)
-	status = dc_iostream_write(s1->iostream, "\006", 1, NULL);
+	status = dc_bleline_write(s1->bleline, "\006", 1);
 	if (status != DC_STATUS_SUCCESS) {
 		dc_buffer_free(res);
 		return status;
@@ -398,6 +407,12 @@ oceans_s1_device_open(dc_device_t **out, dc_context_t *context, dc_iostream_t *i
 	s1->iostream = iostream;
 	memset(s1->fingerprint, 0, sizeof(s1->fingerprint));
 
+	status = dc_bleline_new(&s1->bleline, context, iostream);
+	if (status != DC_STATUS_SUCCESS) {
+		dc_device_deallocate((dc_device_t *) s1);
+		return status;
+	}
+
 	*out = (dc_device_t*)s1;
 
 	// Do minimal verification that we can talk to it
@@ -421,7 +436,7 @@ oceans_s1_device_close(dc_device_t *abstract)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	oceans_s1_device_t *s1 = (oceans_s1_device_t*)abstract;
 
-	// Fill in
+	dc_bleline_free(s1->bleline);
 
 	return DC_STATUS_SUCCESS;
 }
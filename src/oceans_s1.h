@@ -19,6 +19,9 @@ oceans_s1_device_open (dc_device_t **device, dc_context_t *context, dc_iostream_
 dc_status_t
 oceans_s1_parser_create (dc_parser_t **parser, dc_context_t *context);
 
+unsigned int
+oceans_s1_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -27,6 +27,7 @@ static dc_status_t oceans_s1_parser_set_data(dc_parser_t *abstract, const unsign
 static dc_status_t oceans_s1_parser_get_datetime(dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t oceans_s1_parser_get_field(dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t oceans_s1_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t oceans_s1_parser_clone(dc_parser_t *clone, const dc_parser_t *abstract);
 
 static const dc_parser_vtable_t oceans_s1_parser_vtable = {
 	sizeof(oceans_s1_parser_t),
@@ -35,7 +36,8 @@ static const dc_parser_vtable_t oceans_s1_parser_vtable = {
 	oceans_s1_parser_get_datetime, /* datetime */
 	oceans_s1_parser_get_field, /* fields */
 	oceans_s1_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	NULL, /* destroy */
+	oceans_s1_parser_clone /* clone */
 };
 
 dc_status_t
@@ -53,11 +55,33 @@ oceans_s1_parser_create(dc_parser_t **out, dc_context_t *context)
 		return DC_STATUS_NOMEMORY;
 	}
 
+	dc_field_cache_init(&parser->cache);
+
 	*out = (dc_parser_t*)parser;
 
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+oceans_s1_parser_clone(dc_parser_t *clone, const dc_parser_t *abstract)
+{
+	oceans_s1_parser_t *parser = (oceans_s1_parser_t *) clone;
+
+	dc_field_cache_rebase(&parser->cache, abstract, clone, abstract->vtable->size);
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+oceans_s1_parser_probe(const unsigned char data[], unsigned int size)
+{
+	// The dive is a text file starting with the divelog line.
+	if (size < 8 || memcmp(data, "divelog ", 8) != 0)
+		return 0;
+
+	return 90;
+}
+
 static const unsigned char *get_string_line(const unsigned char *in, const unsigned char **next)
 {
 	const unsigned char *line;
@@ -93,7 +117,7 @@ oceans_s1_parse_dive(struct oceans_s1_parser_t *s1, const unsigned char *data, d
 	unsigned int sample_interval = 10;
 	unsigned int sample_time = 0;
 
-	memset(&s1->cache, 0, sizeof(s1->cache));
+	dc_field_cache_clear(&s1->cache);
 
 	while ((line = get_string_line(data, &data)) != NULL) {
 		dc_sample_value_t sample = {0};
@@ -0,0 +1,250 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdio.h>  // fopen, fread, fwrite, fclose
+#include <stdlib.h> // malloc, free
+
+#include <libdivecomputer/pacing.h>
+
+#include "context-private.h"
+#include "array.h"
+
+#define MAGIC   0x43504344 // "DCPC"
+#define FORMAT  1
+
+#define MINENTRIES 8
+
+typedef struct dc_pacing_entry_t {
+	dc_family_t family;
+	unsigned int model;
+	unsigned int id;
+	unsigned int delay;
+} dc_pacing_entry_t;
+
+struct dc_pacing_t {
+	dc_context_t *context;
+	dc_pacing_entry_t *entries;
+	unsigned int capacity;
+	unsigned int count;
+};
+
+static dc_pacing_entry_t *
+dc_pacing_find (dc_pacing_t *pacing, dc_family_t family, unsigned int model, unsigned int id)
+{
+	// A cache holds only a handful of entries, so a linear
+	// search is good enough.
+	for (unsigned int i = 0; i < pacing->count; ++i) {
+		dc_pacing_entry_t *entry = pacing->entries + i;
+		if (entry->family == family &&
+			entry->model == model &&
+			entry->id == id)
+			return entry;
+	}
+
+	return NULL;
+}
+
+dc_status_t
+dc_pacing_new (dc_pacing_t **out, dc_context_t *context)
+{
+	dc_pacing_t *pacing = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	pacing = (dc_pacing_t *) dc_context_malloc (context, sizeof (dc_pacing_t));
+	if (pacing == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	pacing->context = context;
+	pacing->entries = NULL;
+	pacing->capacity = 0;
+	pacing->count = 0;
+
+	*out = pacing;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pacing_free (dc_pacing_t *pacing)
+{
+	if (pacing == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_context_dealloc (pacing->context, pacing->entries);
+	dc_context_dealloc (pacing->context, pacing);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pacing_set (dc_pacing_t *pacing, dc_family_t family, unsigned int model, unsigned int id, unsigned int delay)
+{
+	if (pacing == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_pacing_entry_t *entry = dc_pacing_find (pacing, family, model, id);
+	if (entry) {
+		entry->delay = delay;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (pacing->count >= pacing->capacity) {
+		unsigned int capacity = pacing->capacity ? pacing->capacity * 2 : MINENTRIES;
+		dc_pacing_entry_t *entries = (dc_pacing_entry_t *) dc_context_realloc (pacing->context, pacing->entries, capacity * sizeof (*entries));
+		if (entries == NULL) {
+			ERROR (pacing->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		pacing->entries = entries;
+		pacing->capacity = capacity;
+	}
+
+	entry = pacing->entries + pacing->count++;
+	entry->family = family;
+	entry->model = model;
+	entry->id = id;
+	entry->delay = delay;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pacing_get (dc_pacing_t *pacing, dc_family_t family, unsigned int model, unsigned int id, unsigned int *delay)
+{
+	if (pacing == NULL || delay == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_pacing_entry_t *entry = dc_pacing_find (pacing, family, model, id);
+	if (entry == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	*delay = entry->delay;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pacing_load (dc_pacing_t *pacing, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+
+	if (pacing == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (pacing->context, "Failed to open the file '%s'.", filename);
+		return DC_STATUS_IO;
+	}
+
+	unsigned char header[12];
+	if (fread (header, sizeof (header), 1, fp) != 1) {
+		ERROR (pacing->context, "Failed to read the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	if (array_uint32_le (header) != MAGIC ||
+		array_uint32_le (header + 4) != FORMAT) {
+		ERROR (pacing->context, "Unexpected file header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_fclose;
+	}
+
+	unsigned int count = array_uint32_le (header + 8);
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned char entry[16];
+		if (fread (entry, sizeof (entry), 1, fp) != 1) {
+			ERROR (pacing->context, "Failed to read the entry.");
+			status = DC_STATUS_IO;
+			goto error_fclose;
+		}
+
+		status = dc_pacing_set (pacing,
+			(dc_family_t) array_uint32_le (entry),
+			array_uint32_le (entry + 4),
+			array_uint32_le (entry + 8),
+			array_uint32_le (entry + 12));
+		if (status != DC_STATUS_SUCCESS)
+			goto error_fclose;
+	}
+
+error_fclose:
+	fclose (fp);
+	return status;
+}
+
+dc_status_t
+dc_pacing_save (dc_pacing_t *pacing, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+
+	if (pacing == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	fp = fopen (filename, "wb");
+	if (fp == NULL) {
+		ERROR (pacing->context, "Failed to open the file '%s'.", filename);
+		return DC_STATUS_IO;
+	}
+
+	unsigned char header[12];
+	array_uint32_le_set (header, MAGIC);
+	array_uint32_le_set (header + 4, FORMAT);
+	array_uint32_le_set (header + 8, pacing->count);
+	if (fwrite (header, sizeof (header), 1, fp) != 1) {
+		ERROR (pacing->context, "Failed to write the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	for (unsigned int i = 0; i < pacing->count; ++i) {
+		const dc_pacing_entry_t *entry = pacing->entries + i;
+		unsigned char data[16];
+		array_uint32_le_set (data, entry->family);
+		array_uint32_le_set (data + 4, entry->model);
+		array_uint32_le_set (data + 8, entry->id);
+		array_uint32_le_set (data + 12, entry->delay);
+		if (fwrite (data, sizeof (data), 1, fp) != 1) {
+			ERROR (pacing->context, "Failed to write the entry.");
+			status = DC_STATUS_IO;
+			goto error_fclose;
+		}
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (pacing->context, "Failed to close the file.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	fclose (fp);
+	return status;
+}
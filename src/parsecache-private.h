@@ -0,0 +1,101 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PARSECACHE_PRIVATE_H
+#define DC_PARSECACHE_PRIVATE_H
+
+#include <libdivecomputer/parsecache.h>
+#include <libdivecomputer/buffer.h>
+
+#include "parser-private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The parsed result of a dive, as replayed from the cache. It owns the
+ * serialized data, which also holds the strings and the vendor data
+ * the fields and samples point to.
+ */
+typedef struct dc_parser_replay_t dc_parser_replay_t;
+
+/*
+ * The key of a dive also covers the clock reference of the parser,
+ * because the date and time can depend on it, and whether the vendor
+ * samples are included.
+ */
+unsigned long long
+dc_parsecache_key (dc_parser_t *parser, const unsigned char data[], unsigned int size);
+
+/*
+ * Look up an entry, and copy its serialized data into the buffer.
+ * Returns non-zero if the entry is present.
+ */
+int
+dc_parsecache_lookup (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key, dc_buffer_t *buffer);
+
+/*
+ * Store an entry, replacing any existing entry with the same key.
+ * Failures are not fatal, because the entry can always be recreated.
+ */
+void
+dc_parsecache_store (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key, const unsigned char data[], unsigned int size);
+
+/*
+ * Serialize the parsed result of the current dive. The samples are
+ * taken from the decoded sample cache, which must be valid. The header
+ * fields are obtained from the backend.
+ */
+dc_status_t
+dc_parsecache_encode (dc_parser_t *parser, unsigned int model, unsigned long long key, dc_buffer_t *buffer);
+
+/*
+ * Restore the parsed result of the current dive. The samples are
+ * loaded into the decoded sample cache, which must be empty.
+ */
+dc_status_t
+dc_parsecache_decode (dc_parser_t *parser, unsigned int model, unsigned long long key, const unsigned char data[], unsigned int size, dc_parser_replay_t **replay);
+
+void
+dc_parsecache_replay_free (dc_context_t *context, dc_parser_replay_t *replay);
+
+/*
+ * Copy the parsed result of a dive, for a clone of the parser. The
+ * pointers into the serialized data of the original, for example in
+ * the decoded sample cache, are translated with the rebase function.
+ */
+dc_status_t
+dc_parsecache_replay_clone (dc_context_t *context, const dc_parser_replay_t *replay, dc_parser_replay_t **clone);
+
+const void *
+dc_parsecache_replay_rebase (const dc_parser_replay_t *replay, const dc_parser_replay_t *clone, const void *pointer);
+
+dc_status_t
+dc_parsecache_replay_datetime (const dc_parser_replay_t *replay, dc_datetime_t *datetime);
+
+dc_status_t
+dc_parsecache_replay_field (const dc_parser_replay_t *replay, dc_field_type_t type, unsigned int flags, void *value);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PARSECACHE_PRIVATE_H */
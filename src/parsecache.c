@@ -0,0 +1,1234 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdio.h>  // fopen, fread, fwrite, fclose, rename, remove
+#include <stdlib.h>
+#include <string.h>
+
+#include "parsecache-private.h"
+#include "context-private.h"
+#include "buffer-private.h"
+#include "platform.h"
+#include "thread.h"
+#include "array.h"
+#include "hash.h"
+
+#define MAGIC   0x43504344 // "DCPC"
+#define FORMAT  2
+
+#define SZ_HEADER  24
+#define MINBUCKETS 64
+#define MAXINDEX   256
+
+typedef struct dc_parsecache_entry_t {
+	struct dc_parsecache_entry_t *chain;
+	// Least recently used list.
+	struct dc_parsecache_entry_t *prev;
+	struct dc_parsecache_entry_t *next;
+	dc_family_t family;
+	unsigned int model;
+	unsigned long long key;
+	unsigned int size;
+	unsigned char data[1];
+} dc_parsecache_entry_t;
+
+struct dc_parsecache_t {
+	dc_context_t *context;
+	dc_mutex_t *mutex;
+	// Directory on disk, or NULL for the cache in memory.
+	char *dirname;
+	size_t capacity;
+	size_t size;
+	dc_parsecache_entry_t **buckets;
+	unsigned int nbuckets;
+	unsigned int count;
+	// Most and least recently used entries.
+	dc_parsecache_entry_t *head;
+	dc_parsecache_entry_t *tail;
+};
+
+typedef struct dc_parser_replay_field_t {
+	dc_field_type_t type;
+	unsigned int flags;
+	dc_status_t status;
+	union {
+		unsigned int number;
+		double real;
+		dc_gasmix_t gasmix;
+		dc_salinity_t salinity;
+		dc_tank_t tank;
+		dc_field_string_t string;
+	} value;
+} dc_parser_replay_field_t;
+
+struct dc_parser_replay_t {
+	dc_status_t dtstatus;
+	dc_datetime_t datetime;
+	unsigned int nfields;
+	dc_parser_replay_field_t *fields;
+	unsigned int size;
+	unsigned char data[1];
+};
+
+typedef struct dc_parsecache_writer_t {
+	dc_buffer_t *buffer;
+	int failed;
+} dc_parsecache_writer_t;
+
+typedef struct dc_parsecache_reader_t {
+	const unsigned char *data;
+	const unsigned char *end;
+	int failed;
+} dc_parsecache_reader_t;
+
+static dc_parsecache_t *
+dc_parsecache_allocate (dc_context_t *context)
+{
+	dc_parsecache_t *cache = (dc_parsecache_t *) dc_context_malloc (context, sizeof (dc_parsecache_t));
+	if (cache == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	cache->context = context;
+	cache->mutex = NULL;
+	cache->dirname = NULL;
+	cache->capacity = 0;
+	cache->size = 0;
+	cache->buckets = NULL;
+	cache->nbuckets = 0;
+	cache->count = 0;
+	cache->head = NULL;
+	cache->tail = NULL;
+
+	if (dc_mutex_new (&cache->mutex) != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the mutex.");
+		dc_context_dealloc (context, cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+dc_status_t
+dc_parsecache_new (dc_parsecache_t **out, dc_context_t *context, size_t capacity)
+{
+	dc_parsecache_t *cache = NULL;
+
+	if (out == NULL || capacity == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	cache = dc_parsecache_allocate (context);
+	if (cache == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	cache->capacity = capacity;
+	cache->nbuckets = MINBUCKETS;
+	cache->buckets = (dc_parsecache_entry_t **) dc_context_malloc (context, cache->nbuckets * sizeof (*cache->buckets));
+	if (cache->buckets == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_parsecache_free (cache);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (cache->buckets, 0, cache->nbuckets * sizeof (*cache->buckets));
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parsecache_open (dc_parsecache_t **out, dc_context_t *context, const char *dirname)
+{
+	dc_parsecache_t *cache = NULL;
+
+	if (out == NULL || dirname == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	cache = dc_parsecache_allocate (context);
+	if (cache == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	size_t length = strlen (dirname) + 1;
+	cache->dirname = (char *) dc_context_malloc (context, length);
+	if (cache->dirname == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_parsecache_free (cache);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memcpy (cache->dirname, dirname, length);
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parsecache_free (dc_parsecache_t *cache)
+{
+	if (cache == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_parsecache_entry_t *entry = cache->head;
+	while (entry) {
+		dc_parsecache_entry_t *next = entry->next;
+		dc_context_dealloc (cache->context, entry);
+		entry = next;
+	}
+
+	dc_mutex_free (cache->mutex);
+	dc_context_dealloc (cache->context, cache->buckets);
+	dc_context_dealloc (cache->context, cache->dirname);
+	dc_context_dealloc (cache->context, cache);
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned long long
+dc_parsecache_key (dc_parser_t *parser, const unsigned char data[], unsigned int size)
+{
+	unsigned long long systime = (unsigned long long) parser->systime;
+
+	unsigned char clock[20];
+	array_uint32_le_set (clock, parser->devtime);
+	array_uint32_le_set (clock + 4, systime & 0xFFFFFFFF);
+	array_uint32_le_set (clock + 8, systime >> 32);
+	array_uint32_le_set (clock + 12, size);
+	array_uint32_le_set (clock + 16, parser->flags & DC_PARSER_FLAG_NOVENDOR);
+
+	hash_xxh64_t hash;
+	hash_xxh64_init (&hash, 0);
+	hash_xxh64_update (&hash, data, size);
+	hash_xxh64_update (&hash, clock, sizeof (clock));
+
+	return hash_xxh64_final (&hash);
+}
+
+static unsigned int
+dc_parsecache_bucket (const dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key)
+{
+	unsigned int hash = (unsigned int) (key ^ (key >> 32)) ^ family ^ (model * 16777619u);
+
+	return hash & (cache->nbuckets - 1);
+}
+
+static dc_parsecache_entry_t *
+dc_parsecache_find (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key)
+{
+	dc_parsecache_entry_t *entry = cache->buckets[dc_parsecache_bucket (cache, family, model, key)];
+	while (entry) {
+		if (entry->key == key &&
+			entry->family == family &&
+			entry->model == model)
+			return entry;
+		entry = entry->chain;
+	}
+
+	return NULL;
+}
+
+static void
+dc_parsecache_unlink (dc_parsecache_t *cache, dc_parsecache_entry_t *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+
+	entry->prev = entry->next = NULL;
+}
+
+static void
+dc_parsecache_link (dc_parsecache_t *cache, dc_parsecache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+	cache->head = entry;
+}
+
+static void
+dc_parsecache_remove (dc_parsecache_t *cache, dc_parsecache_entry_t *entry)
+{
+	dc_parsecache_entry_t **link = cache->buckets + dc_parsecache_bucket (cache, entry->family, entry->model, entry->key);
+	while (*link != entry)
+		link = &(*link)->chain;
+	*link = entry->chain;
+
+	dc_parsecache_unlink (cache, entry);
+
+	cache->size -= sizeof (dc_parsecache_entry_t) + entry->size;
+	cache->count--;
+
+	dc_context_dealloc (cache->context, entry);
+}
+
+static void
+dc_parsecache_grow (dc_parsecache_t *cache)
+{
+	unsigned int nbuckets = cache->nbuckets * 2;
+
+	dc_parsecache_entry_t **buckets = (dc_parsecache_entry_t **) dc_context_malloc (cache->context, nbuckets * sizeof (*buckets));
+	if (buckets == NULL)
+		return;
+
+	memset (buckets, 0, nbuckets * sizeof (*buckets));
+
+	dc_context_dealloc (cache->context, cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = nbuckets;
+
+	for (dc_parsecache_entry_t *entry = cache->head; entry; entry = entry->next) {
+		unsigned int idx = dc_parsecache_bucket (cache, entry->family, entry->model, entry->key);
+		entry->chain = buckets[idx];
+		buckets[idx] = entry;
+	}
+}
+
+static char *
+dc_parsecache_filename (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key, const char *suffix)
+{
+	size_t length = strlen (cache->dirname) + 48;
+	char *filename = (char *) dc_context_malloc (cache->context, length);
+	if (filename == NULL) {
+		ERROR (cache->context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	snprintf (filename, length, "%s/%08x-%08x-%08x%08x.%s",
+		cache->dirname, family, model,
+		(unsigned int) (key >> 32), (unsigned int) (key & 0xFFFFFFFF),
+		suffix);
+
+	return filename;
+}
+
+static int
+dc_parsecache_read (dc_parsecache_t *cache, const char *filename, dc_buffer_t *buffer)
+{
+	int found = 0;
+
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL)
+		return 0;
+
+	long size = 0;
+	if (fseek (fp, 0, SEEK_END) != 0 ||
+		(size = ftell (fp)) < 0 ||
+		fseek (fp, 0, SEEK_SET) != 0) {
+		WARNING (cache->context, "Failed to read the file '%s'.", filename);
+		goto error_fclose;
+	}
+
+	if (!dc_buffer_resize (buffer, size)) {
+		ERROR (cache->context, "Insufficient buffer space available.");
+		goto error_fclose;
+	}
+
+	if (size && fread (dc_buffer_get_data (buffer), size, 1, fp) != 1) {
+		WARNING (cache->context, "Failed to read the file '%s'.", filename);
+		goto error_fclose;
+	}
+
+	found = 1;
+
+error_fclose:
+	fclose (fp);
+	return found;
+}
+
+static void
+dc_parsecache_write (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key, const unsigned char data[], unsigned int size)
+{
+	char *filename = dc_parsecache_filename (cache, family, model, key, "dcpc");
+	char *tmpname = dc_parsecache_filename (cache, family, model, key, "tmp");
+	if (filename == NULL || tmpname == NULL)
+		goto error_free;
+
+	// Write to a temporary file first, such that a partial entry is
+	// never visible under the final name.
+	FILE *fp = fopen (tmpname, "wb");
+	if (fp == NULL) {
+		WARNING (cache->context, "Failed to open the file '%s'.", tmpname);
+		goto error_free;
+	}
+
+	int failed = fwrite (data, size, 1, fp) != 1;
+	if (fclose (fp) != 0)
+		failed = 1;
+	if (failed) {
+		WARNING (cache->context, "Failed to write the file '%s'.", tmpname);
+		remove (tmpname);
+		goto error_free;
+	}
+
+	// Renaming over an existing file fails on some platforms.
+	if (rename (tmpname, filename) != 0) {
+		remove (filename);
+		if (rename (tmpname, filename) != 0) {
+			WARNING (cache->context, "Failed to rename the file '%s'.", tmpname);
+			remove (tmpname);
+		}
+	}
+
+error_free:
+	dc_context_dealloc (cache->context, tmpname);
+	dc_context_dealloc (cache->context, filename);
+}
+
+int
+dc_parsecache_lookup (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key, dc_buffer_t *buffer)
+{
+	int found = 0;
+
+	if (cache == NULL || buffer == NULL)
+		return 0;
+
+	if (cache->dirname) {
+		char *filename = dc_parsecache_filename (cache, family, model, key, "dcpc");
+		if (filename == NULL)
+			return 0;
+
+		found = dc_parsecache_read (cache, filename, buffer);
+
+		dc_context_dealloc (cache->context, filename);
+
+		return found;
+	}
+
+	dc_mutex_lock (cache->mutex);
+
+	dc_parsecache_entry_t *entry = dc_parsecache_find (cache, family, model, key);
+	if (entry) {
+		// Move the entry to the front of the list.
+		dc_parsecache_unlink (cache, entry);
+		dc_parsecache_link (cache, entry);
+
+		dc_buffer_clear (buffer);
+		found = dc_buffer_append (buffer, entry->data, entry->size);
+	}
+
+	dc_mutex_unlock (cache->mutex);
+
+	return found;
+}
+
+void
+dc_parsecache_store (dc_parsecache_t *cache, dc_family_t family, unsigned int model, unsigned long long key, const unsigned char data[], unsigned int size)
+{
+	if (cache == NULL || data == NULL || size == 0)
+		return;
+
+	if (cache->dirname) {
+		dc_mutex_lock (cache->mutex);
+		dc_parsecache_write (cache, family, model, key, data, size);
+		dc_mutex_unlock (cache->mutex);
+		return;
+	}
+
+	// Entries larger than the entire cache are never stored.
+	size_t required = sizeof (dc_parsecache_entry_t) + size;
+	if (required > cache->capacity)
+		return;
+
+	dc_parsecache_entry_t *entry = (dc_parsecache_entry_t *) dc_context_malloc (cache->context, sizeof (dc_parsecache_entry_t) + size - 1);
+	if (entry == NULL) {
+		ERROR (cache->context, "Failed to allocate memory.");
+		return;
+	}
+
+	entry->family = family;
+	entry->model = model;
+	entry->key = key;
+	entry->size = size;
+	memcpy (entry->data, data, size);
+
+	dc_mutex_lock (cache->mutex);
+
+	dc_parsecache_entry_t *existing = dc_parsecache_find (cache, family, model, key);
+	if (existing)
+		dc_parsecache_remove (cache, existing);
+
+	// Evict the least recently used entries.
+	while (cache->tail && cache->size + required > cache->capacity)
+		dc_parsecache_remove (cache, cache->tail);
+
+	// Keep the load factor below one.
+	if (cache->count >= cache->nbuckets)
+		dc_parsecache_grow (cache);
+
+	unsigned int idx = dc_parsecache_bucket (cache, family, model, key);
+	entry->chain = cache->buckets[idx];
+	cache->buckets[idx] = entry;
+	dc_parsecache_link (cache, entry);
+	cache->size += required;
+	cache->count++;
+
+	dc_mutex_unlock (cache->mutex);
+}
+
+static void
+dc_parsecache_put_bytes (dc_parsecache_writer_t *writer, const unsigned char data[], unsigned int size)
+{
+	if (!writer->failed && size && !dc_buffer_append (writer->buffer, data, size))
+		writer->failed = 1;
+}
+
+static void
+dc_parsecache_put_uint (dc_parsecache_writer_t *writer, unsigned int value)
+{
+	// Variable length encoding, with 7 bits per byte.
+	unsigned char data[5];
+	unsigned int n = 0;
+	while (value >= 0x80) {
+		data[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+
+	dc_parsecache_put_bytes (writer, data, n);
+}
+
+static void
+dc_parsecache_put_int (dc_parsecache_writer_t *writer, int value)
+{
+	// Map the small negative values to small positive values.
+	unsigned int u = (unsigned int) value;
+	dc_parsecache_put_uint (writer, (u << 1) ^ (value < 0 ? 0xFFFFFFFF : 0));
+}
+
+static void
+dc_parsecache_put_real (dc_parsecache_writer_t *writer, double value)
+{
+	unsigned long long u = 0;
+	memcpy (&u, &value, sizeof (u));
+
+	unsigned char data[8];
+	array_uint32_le_set (data, u & 0xFFFFFFFF);
+	array_uint32_le_set (data + 4, u >> 32);
+
+	dc_parsecache_put_bytes (writer, data, sizeof (data));
+}
+
+static void
+dc_parsecache_put_string (dc_parsecache_writer_t *writer, const char *value)
+{
+	// The length includes the terminating null character, and a zero
+	// length indicates a NULL pointer.
+	if (value == NULL) {
+		dc_parsecache_put_uint (writer, 0);
+		return;
+	}
+
+	unsigned int length = strlen (value) + 1;
+	dc_parsecache_put_uint (writer, length);
+	dc_parsecache_put_bytes (writer, (const unsigned char *) value, length);
+}
+
+static const unsigned char *
+dc_parsecache_get_bytes (dc_parsecache_reader_t *reader, unsigned int size)
+{
+	if (reader->failed || (size_t) (reader->end - reader->data) < size) {
+		reader->failed = 1;
+		return NULL;
+	}
+
+	const unsigned char *data = reader->data;
+	reader->data += size;
+
+	return data;
+}
+
+static unsigned int
+dc_parsecache_get_uint (dc_parsecache_reader_t *reader)
+{
+	unsigned int value = 0;
+	for (unsigned int shift = 0; shift < 35; shift += 7) {
+		const unsigned char *p = dc_parsecache_get_bytes (reader, 1);
+		if (p == NULL)
+			return 0;
+		value |= (unsigned int) (*p & 0x7F) << shift;
+		if (!(*p & 0x80))
+			return value;
+	}
+
+	reader->failed = 1;
+	return 0;
+}
+
+static int
+dc_parsecache_get_int (dc_parsecache_reader_t *reader)
+{
+	unsigned int u = dc_parsecache_get_uint (reader);
+	return (int) ((u >> 1) ^ (0 - (u & 1)));
+}
+
+static double
+dc_parsecache_get_real (dc_parsecache_reader_t *reader)
+{
+	const unsigned char *p = dc_parsecache_get_bytes (reader, 8);
+	if (p == NULL)
+		return 0.0;
+
+	unsigned long long u = ((unsigned long long) array_uint32_le (p + 4) << 32) | array_uint32_le (p);
+
+	double value = 0.0;
+	memcpy (&value, &u, sizeof (value));
+
+	return value;
+}
+
+static const char *
+dc_parsecache_get_string (dc_parsecache_reader_t *reader)
+{
+	unsigned int length = dc_parsecache_get_uint (reader);
+	if (length == 0)
+		return NULL;
+
+	const unsigned char *p = dc_parsecache_get_bytes (reader, length);
+	if (p == NULL || p[length - 1] != 0) {
+		reader->failed = 1;
+		return NULL;
+	}
+
+	return (const char *) p;
+}
+
+static unsigned int
+dc_parsecache_encode_field (dc_parser_t *parser, dc_parsecache_writer_t *writer, dc_field_type_t type, unsigned int flags, dc_parser_replay_field_t *field)
+{
+	memset (field, 0, sizeof (*field));
+	field->type = type;
+	field->flags = flags;
+	field->status = parser->vtable->field (parser, type, flags, &field->value);
+
+	dc_parsecache_put_uint (writer, type);
+	dc_parsecache_put_uint (writer, flags);
+	dc_parsecache_put_int (writer, field->status);
+	if (field->status != DC_STATUS_SUCCESS)
+		return 1;
+
+	switch (type) {
+	case DC_FIELD_DIVETIME:
+	case DC_FIELD_GASMIX_COUNT:
+	case DC_FIELD_TANK_COUNT:
+	case DC_FIELD_DIVEMODE:
+		if (type == DC_FIELD_DIVEMODE)
+			field->value.number = *((dc_divemode_t *) &field->value);
+		dc_parsecache_put_uint (writer, field->value.number);
+		break;
+	case DC_FIELD_MAXDEPTH:
+	case DC_FIELD_AVGDEPTH:
+	case DC_FIELD_ATMOSPHERIC:
+	case DC_FIELD_TEMPERATURE_SURFACE:
+	case DC_FIELD_TEMPERATURE_MINIMUM:
+	case DC_FIELD_TEMPERATURE_MAXIMUM:
+		dc_parsecache_put_real (writer, field->value.real);
+		break;
+	case DC_FIELD_GASMIX:
+		dc_parsecache_put_real (writer, field->value.gasmix.helium);
+		dc_parsecache_put_real (writer, field->value.gasmix.oxygen);
+		dc_parsecache_put_real (writer, field->value.gasmix.nitrogen);
+		break;
+	case DC_FIELD_SALINITY:
+		dc_parsecache_put_uint (writer, field->value.salinity.type);
+		dc_parsecache_put_real (writer, field->value.salinity.density);
+		break;
+	case DC_FIELD_TANK:
+		dc_parsecache_put_uint (writer, field->value.tank.gasmix);
+		dc_parsecache_put_uint (writer, field->value.tank.type);
+		dc_parsecache_put_real (writer, field->value.tank.volume);
+		dc_parsecache_put_real (writer, field->value.tank.workpressure);
+		dc_parsecache_put_real (writer, field->value.tank.beginpressure);
+		dc_parsecache_put_real (writer, field->value.tank.endpressure);
+		break;
+	case DC_FIELD_STRING:
+		dc_parsecache_put_string (writer, field->value.string.desc);
+		dc_parsecache_put_string (writer, field->value.string.value);
+		break;
+	default:
+		writer->failed = 1;
+		break;
+	}
+
+	return 1;
+}
+
+static void
+dc_parsecache_encode_sample (dc_parser_t *parser, dc_parsecache_writer_t *writer, const dc_parser_sample_t *sample)
+{
+	const dc_sample_value_t *value = &sample->value;
+
+	dc_parsecache_put_uint (writer, sample->type);
+
+	switch (sample->type) {
+	case DC_SAMPLE_TIME:
+	case DC_SAMPLE_TTS:
+		dc_parsecache_put_uint (writer, value->time);
+		break;
+	case DC_SAMPLE_RBT:
+		dc_parsecache_put_uint (writer, value->rbt);
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		dc_parsecache_put_uint (writer, value->heartbeat);
+		break;
+	case DC_SAMPLE_BEARING:
+		dc_parsecache_put_uint (writer, value->bearing);
+		break;
+	case DC_SAMPLE_GASMIX:
+		dc_parsecache_put_uint (writer, value->gasmix);
+		break;
+	case DC_SAMPLE_DEPTH:
+		dc_parsecache_put_real (writer, value->depth);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		dc_parsecache_put_real (writer, value->temperature);
+		break;
+	case DC_SAMPLE_SETPOINT:
+		dc_parsecache_put_real (writer, value->setpoint);
+		break;
+	case DC_SAMPLE_PPO2:
+		dc_parsecache_put_real (writer, value->ppo2);
+		break;
+	case DC_SAMPLE_CNS:
+		dc_parsecache_put_real (writer, value->cns);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		dc_parsecache_put_uint (writer, value->pressure.tank);
+		dc_parsecache_put_real (writer, value->pressure.value);
+		break;
+	case DC_SAMPLE_EVENT:
+		dc_parsecache_put_uint (writer, value->event.type);
+		dc_parsecache_put_uint (writer, value->event.time);
+		dc_parsecache_put_uint (writer, value->event.flags);
+		dc_parsecache_put_uint (writer, value->event.value);
+		dc_parsecache_put_string (writer, value->event.name);
+		break;
+	case DC_SAMPLE_VENDOR:
+		// The vendor data is stored as an offset into the dive data,
+		// so the replayed samples point into the original buffer.
+		dc_parsecache_put_uint (writer, value->vendor.type);
+		dc_parsecache_put_uint (writer, value->vendor.data ? value->vendor.size : 0);
+		if (value->vendor.data) {
+			const unsigned char *data = (const unsigned char *) value->vendor.data;
+			if (parser->data && data >= parser->data &&
+				data + value->vendor.size <= parser->data + parser->size) {
+				dc_parsecache_put_uint (writer, data - parser->data + 1);
+			} else {
+				dc_parsecache_put_uint (writer, 0);
+				dc_parsecache_put_bytes (writer, data, value->vendor.size);
+			}
+		}
+		break;
+	case DC_SAMPLE_DECO:
+		dc_parsecache_put_uint (writer, value->deco.type);
+		dc_parsecache_put_uint (writer, value->deco.time);
+		dc_parsecache_put_real (writer, value->deco.depth);
+		break;
+	default:
+		writer->failed = 1;
+		break;
+	}
+}
+
+dc_status_t
+dc_parsecache_encode (dc_parser_t *parser, unsigned int model, unsigned long long key, dc_buffer_t *buffer)
+{
+	static const dc_field_type_t scalars[] = {
+		DC_FIELD_DIVETIME,
+		DC_FIELD_MAXDEPTH,
+		DC_FIELD_AVGDEPTH,
+		DC_FIELD_GASMIX_COUNT,
+		DC_FIELD_SALINITY,
+		DC_FIELD_ATMOSPHERIC,
+		DC_FIELD_TEMPERATURE_SURFACE,
+		DC_FIELD_TEMPERATURE_MINIMUM,
+		DC_FIELD_TEMPERATURE_MAXIMUM,
+		DC_FIELD_TANK_COUNT,
+		DC_FIELD_DIVEMODE,
+	};
+
+	dc_parsecache_writer_t writer = {buffer, 0};
+	dc_parser_replay_field_t field;
+
+	if (!parser->cache.valid)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned char header[SZ_HEADER];
+	array_uint32_le_set (header, MAGIC);
+	array_uint32_le_set (header + 4, FORMAT);
+	array_uint32_le_set (header + 8, parser->vtable->type);
+	array_uint32_le_set (header + 12, model);
+	array_uint32_le_set (header + 16, key & 0xFFFFFFFF);
+	array_uint32_le_set (header + 20, key >> 32);
+
+	dc_buffer_clear (buffer);
+	dc_parsecache_put_bytes (&writer, header, sizeof (header));
+
+	// Date and time.
+	dc_datetime_t datetime = {0};
+	dc_status_t status = DC_STATUS_UNSUPPORTED;
+	if (parser->vtable->datetime)
+		status = parser->vtable->datetime (parser, &datetime);
+	dc_parsecache_put_int (&writer, status);
+	if (status == DC_STATUS_SUCCESS) {
+		dc_parsecache_put_int (&writer, datetime.year);
+		dc_parsecache_put_int (&writer, datetime.month);
+		dc_parsecache_put_int (&writer, datetime.day);
+		dc_parsecache_put_int (&writer, datetime.hour);
+		dc_parsecache_put_int (&writer, datetime.minute);
+		dc_parsecache_put_int (&writer, datetime.second);
+		dc_parsecache_put_int (&writer, datetime.timezone);
+	}
+
+	// Header fields. The number of fields is only known at the end.
+	size_t offset = dc_buffer_get_size (buffer);
+	dc_parsecache_put_bytes (&writer, header, 4);
+
+	unsigned int nfields = 0;
+	if (parser->vtable->field) {
+		unsigned int ngasmixes = 0, ntanks = 0;
+		for (unsigned int i = 0; i < sizeof (scalars) / sizeof (scalars[0]); ++i) {
+			nfields += dc_parsecache_encode_field (parser, &writer, scalars[i], 0, &field);
+			if (field.status == DC_STATUS_SUCCESS && scalars[i] == DC_FIELD_GASMIX_COUNT)
+				ngasmixes = field.value.number;
+			if (field.status == DC_STATUS_SUCCESS && scalars[i] == DC_FIELD_TANK_COUNT)
+				ntanks = field.value.number;
+		}
+
+		for (unsigned int i = 0; i < ngasmixes && i < MAXINDEX; ++i)
+			nfields += dc_parsecache_encode_field (parser, &writer, DC_FIELD_GASMIX, i, &field);
+
+		for (unsigned int i = 0; i < ntanks && i < MAXINDEX; ++i)
+			nfields += dc_parsecache_encode_field (parser, &writer, DC_FIELD_TANK, i, &field);
+
+		for (unsigned int i = 0; i < MAXINDEX; ++i) {
+			nfields += dc_parsecache_encode_field (parser, &writer, DC_FIELD_STRING, i, &field);
+			if (field.status != DC_STATUS_SUCCESS)
+				break;
+		}
+	}
+
+	if (!writer.failed)
+		array_uint32_le_set (dc_buffer_get_data (buffer) + offset, nfields);
+
+	// Samples.
+	dc_parsecache_put_uint (&writer, parser->cache.count);
+	for (unsigned int i = 0; i < parser->cache.count; ++i)
+		dc_parsecache_encode_sample (parser, &writer, parser->cache.samples + i);
+
+	if (writer.failed) {
+		WARNING (parser->context, "Failed to serialize the dive.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_parsecache_decode_field (dc_parsecache_reader_t *reader, dc_parser_replay_field_t *field)
+{
+	memset (field, 0, sizeof (*field));
+	field->type = dc_parsecache_get_uint (reader);
+	field->flags = dc_parsecache_get_uint (reader);
+	field->status = dc_parsecache_get_int (reader);
+	if (field->status != DC_STATUS_SUCCESS)
+		return;
+
+	switch (field->type) {
+	case DC_FIELD_DIVETIME:
+	case DC_FIELD_GASMIX_COUNT:
+	case DC_FIELD_TANK_COUNT:
+	case DC_FIELD_DIVEMODE:
+		field->value.number = dc_parsecache_get_uint (reader);
+		break;
+	case DC_FIELD_MAXDEPTH:
+	case DC_FIELD_AVGDEPTH:
+	case DC_FIELD_ATMOSPHERIC:
+	case DC_FIELD_TEMPERATURE_SURFACE:
+	case DC_FIELD_TEMPERATURE_MINIMUM:
+	case DC_FIELD_TEMPERATURE_MAXIMUM:
+		field->value.real = dc_parsecache_get_real (reader);
+		break;
+	case DC_FIELD_GASMIX:
+		field->value.gasmix.helium = dc_parsecache_get_real (reader);
+		field->value.gasmix.oxygen = dc_parsecache_get_real (reader);
+		field->value.gasmix.nitrogen = dc_parsecache_get_real (reader);
+		break;
+	case DC_FIELD_SALINITY:
+		field->value.salinity.type = (dc_water_t) dc_parsecache_get_uint (reader);
+		field->value.salinity.density = dc_parsecache_get_real (reader);
+		break;
+	case DC_FIELD_TANK:
+		field->value.tank.gasmix = dc_parsecache_get_uint (reader);
+		field->value.tank.type = dc_parsecache_get_uint (reader);
+		field->value.tank.volume = dc_parsecache_get_real (reader);
+		field->value.tank.workpressure = dc_parsecache_get_real (reader);
+		field->value.tank.beginpressure = dc_parsecache_get_real (reader);
+		field->value.tank.endpressure = dc_parsecache_get_real (reader);
+		break;
+	case DC_FIELD_STRING:
+		field->value.string.desc = dc_parsecache_get_string (reader);
+		field->value.string.value = dc_parsecache_get_string (reader);
+		break;
+	default:
+		reader->failed = 1;
+		break;
+	}
+}
+
+static void
+dc_parsecache_decode_sample (dc_parser_t *parser, dc_parsecache_reader_t *reader, dc_parser_sample_t *sample)
+{
+	dc_sample_value_t *value = &sample->value;
+
+	memset (sample, 0, sizeof (*sample));
+	sample->type = (dc_sample_type_t) dc_parsecache_get_uint (reader);
+
+	switch (sample->type) {
+	case DC_SAMPLE_TIME:
+	case DC_SAMPLE_TTS:
+		value->time = dc_parsecache_get_uint (reader);
+		break;
+	case DC_SAMPLE_RBT:
+		value->rbt = dc_parsecache_get_uint (reader);
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		value->heartbeat = dc_parsecache_get_uint (reader);
+		break;
+	case DC_SAMPLE_BEARING:
+		value->bearing = dc_parsecache_get_uint (reader);
+		break;
+	case DC_SAMPLE_GASMIX:
+		value->gasmix = dc_parsecache_get_uint (reader);
+		break;
+	case DC_SAMPLE_DEPTH:
+		value->depth = dc_parsecache_get_real (reader);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		value->temperature = dc_parsecache_get_real (reader);
+		break;
+	case DC_SAMPLE_SETPOINT:
+		value->setpoint = dc_parsecache_get_real (reader);
+		break;
+	case DC_SAMPLE_PPO2:
+		value->ppo2 = dc_parsecache_get_real (reader);
+		break;
+	case DC_SAMPLE_CNS:
+		value->cns = dc_parsecache_get_real (reader);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		value->pressure.tank = dc_parsecache_get_uint (reader);
+		value->pressure.value = dc_parsecache_get_real (reader);
+		break;
+	case DC_SAMPLE_EVENT:
+		value->event.type = dc_parsecache_get_uint (reader);
+		value->event.time = dc_parsecache_get_uint (reader);
+		value->event.flags = dc_parsecache_get_uint (reader);
+		value->event.value = dc_parsecache_get_uint (reader);
+		value->event.name = dc_parsecache_get_string (reader);
+		// The event names are owned by the sample cache.
+		if (value->event.name) {
+			size_t length = strlen (value->event.name) + 1;
+			char *name = (char *) dc_context_malloc (parser->context, length);
+			if (name == NULL) {
+				reader->failed = 1;
+				value->event.name = NULL;
+				break;
+			}
+			memcpy (name, value->event.name, length);
+			value->event.name = name;
+		}
+		break;
+	case DC_SAMPLE_VENDOR:
+		value->vendor.type = dc_parsecache_get_uint (reader);
+		value->vendor.size = dc_parsecache_get_uint (reader);
+		value->vendor.data = NULL;
+		if (value->vendor.size) {
+			unsigned int offset = dc_parsecache_get_uint (reader);
+			if (offset == 0) {
+				value->vendor.data = dc_parsecache_get_bytes (reader, value->vendor.size);
+			} else if (offset - 1 <= parser->size && value->vendor.size <= parser->size - (offset - 1)) {
+				value->vendor.data = parser->data + offset - 1;
+			} else {
+				reader->failed = 1;
+			}
+		}
+		break;
+	case DC_SAMPLE_DECO:
+		value->deco.type = dc_parsecache_get_uint (reader);
+		value->deco.time = dc_parsecache_get_uint (reader);
+		value->deco.depth = dc_parsecache_get_real (reader);
+		break;
+	default:
+		reader->failed = 1;
+		break;
+	}
+}
+
+dc_status_t
+dc_parsecache_decode (dc_parser_t *parser, unsigned int model, unsigned long long key, const unsigned char data[], unsigned int size, dc_parser_replay_t **out)
+{
+	dc_parser_cache_t *cache = &parser->cache;
+
+	if (size < SZ_HEADER ||
+		array_uint32_le (data) != MAGIC ||
+		array_uint32_le (data + 4) != FORMAT ||
+		array_uint32_le (data + 8) != parser->vtable->type ||
+		array_uint32_le (data + 12) != model ||
+		array_uint32_le (data + 16) != (key & 0xFFFFFFFF) ||
+		array_uint32_le (data + 20) != (key >> 32)) {
+		WARNING (parser->context, "Unexpected cache entry header.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Keep a copy of the serialized data, because the strings and the
+	// vendor data point into it.
+	dc_parser_replay_t *replay = (dc_parser_replay_t *) dc_context_malloc (parser->context, sizeof (dc_parser_replay_t) + size - 1);
+	if (replay == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	replay->nfields = 0;
+	replay->fields = NULL;
+	replay->size = size;
+	memcpy (replay->data, data, size);
+
+	dc_parsecache_reader_t reader = {replay->data + SZ_HEADER, replay->data + size, 0};
+
+	// Date and time.
+	memset (&replay->datetime, 0, sizeof (replay->datetime));
+	replay->dtstatus = dc_parsecache_get_int (&reader);
+	if (replay->dtstatus == DC_STATUS_SUCCESS) {
+		replay->datetime.year = dc_parsecache_get_int (&reader);
+		replay->datetime.month = dc_parsecache_get_int (&reader);
+		replay->datetime.day = dc_parsecache_get_int (&reader);
+		replay->datetime.hour = dc_parsecache_get_int (&reader);
+		replay->datetime.minute = dc_parsecache_get_int (&reader);
+		replay->datetime.second = dc_parsecache_get_int (&reader);
+		replay->datetime.timezone = dc_parsecache_get_int (&reader);
+	}
+
+	// Header fields.
+	const unsigned char *p = dc_parsecache_get_bytes (&reader, 4);
+	unsigned int nfields = p ? array_uint32_le (p) : 0;
+	if (nfields > (size_t) (reader.end - reader.data) / 3) {
+		reader.failed = 1;
+		goto error;
+	}
+
+	if (nfields) {
+		replay->fields = (dc_parser_replay_field_t *) dc_context_malloc (parser->context, nfields * sizeof (dc_parser_replay_field_t));
+		if (replay->fields == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			dc_parsecache_replay_free (parser->context, replay);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	for (unsigned int i = 0; i < nfields && !reader.failed; ++i) {
+		dc_parsecache_decode_field (&reader, replay->fields + i);
+		replay->nfields++;
+	}
+
+	// Samples.
+	unsigned int count = dc_parsecache_get_uint (&reader);
+	if (reader.failed || count > (size_t) (reader.end - reader.data) / 2) {
+		reader.failed = 1;
+		goto error;
+	}
+
+	if (count > cache->capacity) {
+		dc_parser_sample_t *samples = (dc_parser_sample_t *) dc_context_realloc (parser->context, cache->samples, count * sizeof (dc_parser_sample_t));
+		if (samples == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			dc_parsecache_replay_free (parser->context, replay);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		cache->samples = samples;
+		cache->capacity = count;
+	}
+
+	for (unsigned int i = 0; i < count && !reader.failed; ++i) {
+		dc_parsecache_decode_sample (parser, &reader, cache->samples + cache->count);
+		cache->count++;
+	}
+
+	if (reader.failed || reader.data != reader.end)
+		goto error;
+
+	cache->valid = 1;
+
+	*out = replay;
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	// The samples decoded so far are released with the sample cache.
+	WARNING (parser->context, "Invalid cache entry.");
+	dc_parsecache_replay_free (parser->context, replay);
+	return DC_STATUS_DATAFORMAT;
+}
+
+void
+dc_parsecache_replay_free (dc_context_t *context, dc_parser_replay_t *replay)
+{
+	if (replay == NULL)
+		return;
+
+	dc_context_dealloc (context, replay->fields);
+	dc_context_dealloc (context, replay);
+}
+
+dc_status_t
+dc_parsecache_replay_clone (dc_context_t *context, const dc_parser_replay_t *replay, dc_parser_replay_t **out)
+{
+	dc_parser_replay_t *clone = (dc_parser_replay_t *) dc_context_malloc (context, sizeof (dc_parser_replay_t) + replay->size - 1);
+	if (clone == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	clone->dtstatus = replay->dtstatus;
+	clone->datetime = replay->datetime;
+	clone->nfields = 0;
+	clone->fields = NULL;
+	clone->size = replay->size;
+	memcpy (clone->data, replay->data, replay->size);
+
+	if (replay->nfields) {
+		clone->fields = (dc_parser_replay_field_t *) dc_context_malloc (context, replay->nfields * sizeof (dc_parser_replay_field_t));
+		if (clone->fields == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			dc_context_dealloc (context, clone);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		memcpy (clone->fields, replay->fields, replay->nfields * sizeof (dc_parser_replay_field_t));
+		clone->nfields = replay->nfields;
+	}
+
+	// The strings point into the serialized data of the original.
+	for (unsigned int i = 0; i < clone->nfields; ++i) {
+		dc_parser_replay_field_t *field = clone->fields + i;
+		if (field->status == DC_STATUS_SUCCESS && field->type == DC_FIELD_STRING) {
+			field->value.string.desc = (const char *) dc_parsecache_replay_rebase (replay, clone, field->value.string.desc);
+			field->value.string.value = (const char *) dc_parsecache_replay_rebase (replay, clone, field->value.string.value);
+		}
+	}
+
+	*out = clone;
+
+	return DC_STATUS_SUCCESS;
+}
+
+const void *
+dc_parsecache_replay_rebase (const dc_parser_replay_t *replay, const dc_parser_replay_t *clone, const void *pointer)
+{
+	const unsigned char *p = (const unsigned char *) pointer;
+
+	if (p == NULL || p < replay->data || p >= replay->data + replay->size)
+		return pointer;
+
+	return clone->data + (p - replay->data);
+}
+
+dc_status_t
+dc_parsecache_replay_datetime (const dc_parser_replay_t *replay, dc_datetime_t *datetime)
+{
+	if (replay->dtstatus != DC_STATUS_SUCCESS)
+		return replay->dtstatus;
+
+	if (datetime == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*datetime = replay->datetime;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parsecache_replay_field (const dc_parser_replay_t *replay, dc_field_type_t type, unsigned int flags, void *value)
+{
+	const dc_parser_replay_field_t *field = NULL;
+	for (unsigned int i = 0; i < replay->nfields; ++i) {
+		if (replay->fields[i].type == type && replay->fields[i].flags == flags) {
+			field = replay->fields + i;
+			break;
+		}
+	}
+
+	if (field == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (field->status != DC_STATUS_SUCCESS)
+		return field->status;
+
+	if (value == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	switch (type) {
+	case DC_FIELD_DIVETIME:
+	case DC_FIELD_GASMIX_COUNT:
+	case DC_FIELD_TANK_COUNT:
+		*((unsigned int *) value) = field->value.number;
+		break;
+	case DC_FIELD_DIVEMODE:
+		*((dc_divemode_t *) value) = (dc_divemode_t) field->value.number;
+		break;
+	case DC_FIELD_MAXDEPTH:
+	case DC_FIELD_AVGDEPTH:
+	case DC_FIELD_ATMOSPHERIC:
+	case DC_FIELD_TEMPERATURE_SURFACE:
+	case DC_FIELD_TEMPERATURE_MINIMUM:
+	case DC_FIELD_TEMPERATURE_MAXIMUM:
+		*((double *) value) = field->value.real;
+		break;
+	case DC_FIELD_GASMIX:
+		*((dc_gasmix_t *) value) = field->value.gasmix;
+		break;
+	case DC_FIELD_SALINITY:
+		*((dc_salinity_t *) value) = field->value.salinity;
+		break;
+	case DC_FIELD_TANK:
+		*((dc_tank_t *) value) = field->value.tank;
+		break;
+	case DC_FIELD_STRING:
+		*((dc_field_string_t *) value) = field->value.string;
+		break;
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -24,6 +24,9 @@
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/parsecache.h>
+
+#include "timer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,11 +37,103 @@ struct dc_parser_vtable_t;
 
 typedef struct dc_parser_vtable_t dc_parser_vtable_t;
 
+typedef struct dc_parser_sample_t {
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} dc_parser_sample_t;
+
+typedef struct dc_parser_cache_t {
+	unsigned int valid;
+	unsigned int count;
+	unsigned int capacity;
+	dc_parser_sample_t *samples;
+	// Sparse index with the position of every n-th time sample.
+	unsigned int indexed;
+	unsigned int monotonic;
+	unsigned int nindex;
+	unsigned int *index;
+} dc_parser_cache_t;
+
+#define STATISTICS_MAXDEPTH 200
+#define STATISTICS_MAXTANKS 8
+#define STATISTICS_WINDOW 10
+
+typedef struct sample_statistics_tank_t {
+	unsigned int count;
+	unsigned int tbegin, tend;
+	double pbegin, pend;
+	double dbegin, dend;
+} sample_statistics_tank_t;
+
+typedef struct sample_statistics_t {
+	unsigned int divetime;
+	double maxdepth;
+	// Derived metrics.
+	unsigned int ndepth;
+	unsigned int depthtime;
+	double depth;
+	double depthsum;
+	unsigned int anchortime;
+	double anchordepth;
+	double maxascent, maxdescent;
+	unsigned int ntemperature;
+	double temperaturesum;
+	unsigned int histogram[STATISTICS_MAXDEPTH];
+	sample_statistics_tank_t tank[STATISTICS_MAXTANKS];
+} sample_statistics_t;
+
+#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0}
+
 struct dc_parser_t {
 	const dc_parser_vtable_t *vtable;
 	dc_context_t *context;
 	const unsigned char *data;
 	unsigned int size;
+	unsigned int flags;
+	// Clock reference, for converting device timestamps.
+	unsigned int devtime;
+	dc_ticks_t systime;
+	// Sample type mask, as configured by the application, and the
+	// mask which is in effect for the current samples_foreach call.
+	unsigned int samplemask;
+	unsigned int activemask;
+	// Sample types which are only reported when changed.
+	unsigned int changemask;
+	// Sample decimation.
+	unsigned int interval;
+	unsigned int maxpoints;
+	// Derived dive statistics.
+	unsigned int statistics_valid;
+	sample_statistics_t statistics;
+	// Decoded sample cache.
+	dc_parser_cache_t cache;
+	// Cache of parsed dives, and the result replayed from it.
+	unsigned int model;
+	dc_parsecache_t *parsecache;
+	struct dc_parser_replay_t *replay;
+	// Decoded data, for compressed dive blobs.
+	dc_buffer_t *decoded;
+	// Level of the header data cached by the backend.
+	unsigned int cached;
+	// Dive data assembled with dc_parser_append_data, and the number
+	// of samples already passed to the application.
+	dc_buffer_t *appended;
+	unsigned int appending;
+	unsigned int emitted;
+	// Resource limits, and the usage for the current dive. Once a
+	// limit is exceeded, the status remains set until new data is set.
+	unsigned int maxsamples;
+	unsigned int maxmemory;
+	unsigned int timeout;
+	dc_timer_t *timer;
+	dc_usecs_t deadline;
+	unsigned int nsamples;
+	unsigned int memory;
+	unsigned int nchecks;
+	dc_status_t exceeded;
+	// Statistics, and the nesting level of the calls into the backend.
+	dc_parser_stats_t stats;
+	unsigned int measuring;
 };
 
 struct dc_parser_vtable_t {
@@ -55,23 +150,170 @@ struct dc_parser_vtable_t {
 	dc_status_t (*samples_foreach) (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
 	dc_status_t (*destroy) (dc_parser_t *parser);
+
+	// Copy the memory owned by the backend into a clone, which starts
+	// as a shallow copy of the parser. It's required for a backend with
+	// a destroy function. On failure, the clone must not reference the
+	// memory of the original anymore.
+	dc_status_t (*clone) (dc_parser_t *clone, const dc_parser_t *parser);
 };
 
 dc_parser_t *
 dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable);
 
+/*
+ * Check the resource limits for the current dive. Backends call this
+ * function regularly from their loops, and abort with the returned
+ * status if a limit is exceeded.
+ */
+dc_status_t
+dc_parser_check_limits (dc_parser_t *parser);
+
+/*
+ * Account for memory allocated by the backend for the current dive,
+ * and check it against the memory limit.
+ */
+dc_status_t
+dc_parser_reserve (dc_parser_t *parser, size_t size);
+
 void
 dc_parser_deallocate (dc_parser_t *parser);
 
 int
 dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable);
 
-typedef struct sample_statistics_t {
-	unsigned int divetime;
-	double maxdepth;
-} sample_statistics_t;
+/*
+ * Shared parser environment.
+ *
+ * Read-only state which doesn't depend on the dive data, such as the
+ * lookup tables derived from the static tables of a backend, is built
+ * only once, and then shared by all parser instances of the family,
+ * from any thread. A backend embeds this structure at the start of its
+ * own environment, defines a single static instance initialized with
+ * DC_PARSER_ENV_INIT, and calls dc_parser_env_get from its constructor.
+ *
+ * The init function runs exactly once, on first use, with the global
+ * lock held. It must be short, and must not take the global lock
+ * itself. Once dc_parser_env_get returns successfully, the environment
+ * is never modified again, and can be read without any locking.
+ */
+typedef struct dc_parser_env_t dc_parser_env_t;
 
-#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0}
+struct dc_parser_env_t {
+	dc_status_t (*init) (dc_parser_env_t *env);
+	unsigned int initialized;
+	dc_status_t status;
+};
+
+#define DC_PARSER_ENV_INIT(init) {(init), 0, DC_STATUS_SUCCESS}
+
+dc_status_t
+dc_parser_env_get (dc_parser_env_t *env);
+
+/*
+ * Walk over all the samples, using the decoded sample cache if it is
+ * enabled. Backends should use this function to scan the profile from
+ * their get_field implementation, instead of calling their own
+ * samples_foreach function directly.
+ */
+dc_status_t
+dc_parser_samples_walk (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+
+/*
+ * Cached header data.
+ *
+ * Backends which derive some of their header fields (e.g. the gas mixes
+ * and tanks) in a separate pass over the dive data keep track of that
+ * pass in the cached field of the base class. It is reset on every call
+ * to dc_parser_set_data, so backends only need to clear their own data.
+ * The meaning of a non-zero level is up to the backend.
+ */
+typedef struct dc_parser_gasmix_t {
+	unsigned int oxygen;
+	unsigned int helium;
+} dc_parser_gasmix_t;
+
+typedef struct dc_parser_tank_t {
+	unsigned int id;
+	unsigned int beginpressure;
+	unsigned int endpressure;
+} dc_parser_tank_t;
+
+/*
+ * Find the gas mix in the range [begin, end) of the table. If the gas mix
+ * is not present, end is returned.
+ */
+unsigned int
+dc_parser_find_gasmix (const dc_parser_gasmix_t gasmix[], unsigned int begin, unsigned int end, unsigned int oxygen, unsigned int helium);
+
+/*
+ * Walk over the profile once, for backends which collect their cached
+ * header data while parsing the samples. Subsequent calls return
+ * immediately, until the next dc_parser_set_data call.
+ */
+dc_status_t
+dc_parser_cache_profile (dc_parser_t *parser);
+
+#define dc_parser_is_summary(parser) (((dc_parser_t *) (parser))->flags & DC_PARSER_FLAG_SUMMARY)
+
+/*
+ * Check whether the data was already verified by the caller. Backends
+ * can skip recomputing checksums, but never the bounds checks.
+ */
+#define dc_parser_is_trusted(parser) (((dc_parser_t *) (parser))->flags & DC_PARSER_FLAG_TRUSTED)
+
+/*
+ * Count an unknown record, or data which is skipped by the backend, in
+ * the parser statistics.
+ */
+#define dc_parser_skipped(parser) (((dc_parser_t *) (parser))->stats.nskipped++)
+
+/*
+ * Check whether the samples of the given type are requested by the
+ * caller. Backends can use this to skip decoding expensive sample
+ * types. Internal walks over the profile always see all samples.
+ */
+#define dc_parser_wants(parser, type) (((dc_parser_t *) (parser))->activemask & DC_SAMPLE_MASK(type))
+
+/*
+ * Fixed-stride sample arrays.
+ *
+ * Several of the older formats store the profile as an array of fixed
+ * size records, where the depth and temperature are linear functions
+ * of a (masked and shifted) 8 or 16 bit integer. Such a field is
+ * described once, and decoded for the entire array in a single pass,
+ * instead of one sample at a time. A field with a zero size is not
+ * present.
+ */
+typedef struct dc_sample_field_t {
+	unsigned int offset;
+	unsigned int size;
+	unsigned int bigendian;
+	unsigned int mask;
+	unsigned int shift;
+	double scale;
+	double bias;
+} dc_sample_field_t;
+
+typedef struct dc_sample_layout_t {
+	unsigned int stride;
+	unsigned int interval;
+	dc_sample_field_t depth;
+	dc_sample_field_t temperature;
+} dc_sample_layout_t;
+
+void
+dc_sample_decode (const unsigned char data[], unsigned int count, unsigned int stride, const dc_sample_field_t *field, double output[]);
+
+/*
+ * Emit the time, temperature and depth samples of a fixed-stride array.
+ * The time of the first sample is one interval after the specified
+ * start time. When the samples are collected with
+ * dc_parser_samples_columns, they are decoded directly into the
+ * columns.
+ */
+dc_status_t
+dc_parser_samples_fixed (dc_parser_t *parser, const dc_sample_layout_t *layout, const unsigned char data[], unsigned int count, unsigned int time, dc_sample_callback_t callback, void *userdata);
 
 void
 sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
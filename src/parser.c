@@ -19,9 +19,17 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
 
+#include <libdivecomputer/codec.h>
+
 #include "suunto_d9.h"
 #include "suunto_eon.h"
 #include "suunto_eonsteel.h"
@@ -69,9 +77,24 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "device-private.h"
+#include "parsecache-private.h"
+#include "buffer-private.h"
+#include "thread.h"
+#include "probes.h"
 
 #define REACTPROWHITE 0x4354
 
+// The sample types which can be reported on change only.
+#define CHANGE_MASK (DC_SAMPLE_MASK_ALL & \
+	~DC_SAMPLE_MASK(DC_SAMPLE_TIME) & \
+	~DC_SAMPLE_MASK(DC_SAMPLE_EVENT) & \
+	~DC_SAMPLE_MASK(DC_SAMPLE_VENDOR))
+
+// The number of values per sample type to keep track of.
+#define DEDUP_SLOTS 8
+
+static dc_status_t dc_parser_cache_fill (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+
 static dc_status_t
 dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
 {
@@ -82,6 +105,7 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 		return DC_STATUS_INVALIDARGS;
 
 	switch (family) {
+#ifdef ENABLE_BACKEND_SUUNTO
 	case DC_FAMILY_SUUNTO_SOLUTION:
 		rc = suunto_solution_parser_create (&parser, context);
 		break;
@@ -101,6 +125,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_SUUNTO_EONSTEEL:
 		rc = suunto_eonsteel_parser_create(&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
 	case DC_FAMILY_UWATEC_ALADIN:
 	case DC_FAMILY_UWATEC_MEMOMOUSE:
 		rc = uwatec_memomouse_parser_create (&parser, context, devtime, systime);
@@ -108,6 +134,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_UWATEC_SMART:
 		rc = uwatec_smart_parser_create (&parser, context, model, devtime, systime);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
 	case DC_FAMILY_REEFNET_SENSUS:
 		rc = reefnet_sensus_parser_create (&parser, context, devtime, systime);
 		break;
@@ -117,6 +145,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_REEFNET_SENSUSULTRA:
 		rc = reefnet_sensusultra_parser_create (&parser, context, devtime, systime);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 	case DC_FAMILY_OCEANIC_VTPRO:
 		rc = oceanic_vtpro_parser_create (&parser, context, model);
 		break;
@@ -129,6 +159,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 		else
 			rc = oceanic_atom2_parser_create (&parser, context, model, serial);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_MARES
 	case DC_FAMILY_MARES_NEMO:
 	case DC_FAMILY_MARES_PUCK:
 		rc = mares_nemo_parser_create (&parser, context, model);
@@ -139,6 +171,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_MARES_ICONHD:
 		rc = mares_iconhd_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_parser_create (&parser, context, serial);
 		break;
@@ -146,8 +180,9 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_parser_create (&parser, context, serial, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
 	case DC_FAMILY_CRESSI_EDY:
-	case DC_FAMILY_ZEAGLE_N2ITION3:
 		rc = cressi_edy_parser_create (&parser, context, model);
 		break;
 	case DC_FAMILY_CRESSI_LEONARDO:
@@ -156,52 +191,90 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_CRESSI_GOA:
 		rc = cressi_goa_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_ZEAGLE
+	case DC_FAMILY_ZEAGLE_N2ITION3:
+		rc = cressi_edy_parser_create (&parser, context, model);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 	case DC_FAMILY_ATOMICS_COBALT:
 		rc = atomics_cobalt_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_parser_create (&parser, context, model, serial);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_parser_create (&parser, context, model, serial);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
 	case DC_FAMILY_DIVERITE_NITEKQ:
 		rc = diverite_nitekq_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CITIZEN
 	case DC_FAMILY_CITIZEN_AQUALAND:
 		rc = citizen_aqualand_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 	case DC_FAMILY_DIVESYSTEM_IDIVE:
 		rc = divesystem_idive_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_COCHRAN
 	case DC_FAMILY_COCHRAN_COMMANDER:
 		rc = cochran_commander_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_TECDIVING
 	case DC_FAMILY_TECDIVING_DIVECOMPUTEREU:
 		rc = tecdiving_divecomputereu_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_MCLEAN
 	case DC_FAMILY_MCLEAN_EXTREME:
 		rc = mclean_extreme_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_LIQUIVISION
 	case DC_FAMILY_LIQUIVISION_LYNX:
 		rc = liquivision_lynx_parser_create (&parser, context, model);
 		break;
+#endif
 	default:
 		return DC_STATUS_INVALIDARGS;
 
 	// Not merged upstream yet
+#ifdef ENABLE_BACKEND_GARMIN
 	case DC_FAMILY_GARMIN:
 		rc = garmin_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DEEPBLU
 	case DC_FAMILY_DEEPBLU:
 		rc = deepblu_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANS
 	case DC_FAMILY_OCEANS_S1:
 		rc = oceans_s1_parser_create(&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DEEPSIX
     case  DC_FAMILY_DEEPSIX:
         rc = deepsix_parser_create (&parser, context);
         break;
+#endif
+	}
+
+	if (rc == DC_STATUS_SUCCESS) {
+		parser->devtime = devtime;
+		parser->systime = systime;
+		parser->model = model;
 	}
 
 	*out = parser;
@@ -232,6 +305,76 @@ dc_parser_new2 (dc_parser_t **out, dc_context_t *context, dc_descriptor_t *descr
 		devtime, systime);
 }
 
+static const struct {
+	dc_family_t family;
+	unsigned int (*probe) (const unsigned char data[], unsigned int size);
+} g_parser_probes[] = {
+#ifdef ENABLE_BACKEND_SUUNTO
+	{DC_FAMILY_SUUNTO_EONSTEEL,      suunto_eonsteel_parser_probe},
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
+	{DC_FAMILY_REEFNET_SENSUSPRO,    reefnet_sensuspro_parser_probe},
+	{DC_FAMILY_REEFNET_SENSUSULTRA,  reefnet_sensusultra_parser_probe},
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
+	{DC_FAMILY_UWATEC_SMART,         uwatec_smart_parser_probe},
+#endif
+#ifdef ENABLE_BACKEND_HW
+	{DC_FAMILY_HW_OSTC,              hw_ostc_parser_probe},
+	{DC_FAMILY_HW_FROG,              hw_frog_parser_probe},
+	{DC_FAMILY_HW_OSTC3,             hw_ostc3_parser_probe},
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
+	{DC_FAMILY_SHEARWATER_PREDATOR,  shearwater_predator_parser_probe},
+	{DC_FAMILY_SHEARWATER_PETREL,    shearwater_petrel_parser_probe},
+#endif
+#ifdef ENABLE_BACKEND_GARMIN
+	{DC_FAMILY_GARMIN,               garmin_parser_probe_format},
+#endif
+#ifdef ENABLE_BACKEND_OCEANS
+	{DC_FAMILY_OCEANS_S1,            oceans_s1_parser_probe},
+#endif
+	{DC_FAMILY_NULL,                 NULL},
+};
+
+dc_status_t
+dc_parser_probe (const unsigned char data[], unsigned int size, dc_parser_candidate_t candidates[], unsigned int *count)
+{
+	if (count == NULL || (candidates == NULL && *count != 0))
+		return DC_STATUS_INVALIDARGS;
+
+	if (data == NULL)
+		size = 0;
+
+	unsigned int capacity = *count;
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; g_parser_probes[i].probe != NULL; ++i) {
+		unsigned int score = size ? g_parser_probes[i].probe (data, size) : 0;
+		if (score == 0)
+			continue;
+
+		// Insert the candidate, sorted by decreasing score. The
+		// candidates with the lowest score are dropped when there is
+		// no room left.
+		unsigned int j = n < capacity ? n++ : capacity;
+		while (j > 0 && candidates[j - 1].score < score) {
+			if (j < capacity)
+				candidates[j] = candidates[j - 1];
+			j--;
+		}
+
+		if (j < capacity) {
+			candidates[j].family = g_parser_probes[i].family;
+			candidates[j].score = score;
+		}
+	}
+
+	*count = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_parser_t *
 dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 {
@@ -241,7 +384,7 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_parser_t));
 
 	// Allocate memory.
-	parser = (dc_parser_t *) malloc (vtable->size);
+	parser = (dc_parser_t *) dc_context_malloc (context, vtable->size);
 	if (parser == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return parser;
@@ -252,14 +395,76 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	parser->context = context;
 	parser->data = NULL;
 	parser->size = 0;
+	parser->flags = 0;
+	parser->devtime = 0;
+	parser->systime = 0;
+	parser->samplemask = DC_SAMPLE_MASK_ALL;
+	parser->activemask = DC_SAMPLE_MASK_ALL;
+	parser->changemask = 0;
+	parser->interval = 0;
+	parser->maxpoints = 0;
+	parser->statistics_valid = 0;
+	parser->cache.valid = 0;
+	parser->cache.count = 0;
+	parser->cache.capacity = 0;
+	parser->cache.samples = NULL;
+	parser->cache.indexed = 0;
+	parser->cache.monotonic = 0;
+	parser->cache.nindex = 0;
+	parser->cache.index = NULL;
+	parser->model = 0;
+	parser->parsecache = NULL;
+	parser->replay = NULL;
+	parser->decoded = NULL;
+	parser->cached = 0;
+	parser->appended = NULL;
+	parser->appending = 0;
+	parser->emitted = 0;
+	parser->maxsamples = 0;
+	parser->maxmemory = 0;
+	parser->timeout = 0;
+	parser->timer = NULL;
+	parser->deadline = 0;
+	parser->nsamples = 0;
+	parser->memory = 0;
+	parser->nchecks = 0;
+	parser->exceeded = DC_STATUS_SUCCESS;
+	memset (&parser->stats, 0, sizeof (parser->stats));
+	parser->measuring = 0;
 
 	return parser;
 }
 
+static void
+dc_parser_cache_reset (dc_parser_t *parser)
+{
+	dc_parser_cache_t *cache = &parser->cache;
+
+	// The event names are owned by the cache.
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (cache->samples[i].type == DC_SAMPLE_EVENT)
+			dc_context_dealloc (parser->context, (char *) cache->samples[i].value.event.name);
+	}
+
+	cache->valid = 0;
+	cache->count = 0;
+	cache->indexed = 0;
+}
+
 void
 dc_parser_deallocate (dc_parser_t *parser)
 {
-	free (parser);
+	if (parser == NULL)
+		return;
+
+	dc_parser_cache_reset (parser);
+	dc_parsecache_replay_free (parser->context, parser->replay);
+	dc_buffer_free (parser->decoded);
+	dc_buffer_free (parser->appended);
+	dc_context_dealloc (parser->context, parser->cache.samples);
+	dc_context_dealloc (parser->context, parser->cache.index);
+	dc_timer_free (parser->timer);
+	dc_context_dealloc (parser->context, parser);
 }
 
 int
@@ -272,6 +477,149 @@ dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable)
 }
 
 
+dc_status_t
+dc_parser_env_get (dc_parser_env_t *env)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// The lock also guarantees the initialized environment is visible
+	// to the other threads.
+	dc_global_lock ();
+	if (!env->initialized) {
+		env->status = env->init (env);
+		env->initialized = 1;
+	}
+	status = env->status;
+	dc_global_unlock ();
+
+	return status;
+}
+
+
+static dc_status_t
+dc_parser_cache_clone (dc_parser_t *clone, const dc_parser_t *parser)
+{
+	const dc_parser_cache_t *cache = &parser->cache;
+
+	if (cache->count) {
+		clone->cache.samples = (dc_parser_sample_t *) dc_context_malloc (parser->context, cache->count * sizeof (dc_parser_sample_t));
+		if (clone->cache.samples == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		clone->cache.capacity = cache->count;
+	}
+
+	if (cache->indexed && cache->nindex) {
+		clone->cache.index = (unsigned int *) dc_context_malloc (parser->context, cache->nindex * sizeof (unsigned int));
+		if (clone->cache.index == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		memcpy (clone->cache.index, cache->index, cache->nindex * sizeof (unsigned int));
+		clone->cache.nindex = cache->nindex;
+	}
+
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		dc_parser_sample_t sample = cache->samples[i];
+
+		// The event names are owned by the cache, and the vendor data of a
+		// replayed dive by the replay.
+		if (sample.type == DC_SAMPLE_EVENT && sample.value.event.name) {
+			size_t length = strlen (sample.value.event.name) + 1;
+			char *name = (char *) dc_context_malloc (parser->context, length);
+			if (name == NULL) {
+				ERROR (parser->context, "Failed to allocate memory.");
+				return DC_STATUS_NOMEMORY;
+			}
+			memcpy (name, sample.value.event.name, length);
+			sample.value.event.name = name;
+		} else if (sample.type == DC_SAMPLE_VENDOR && parser->replay) {
+			sample.value.vendor.data = dc_parsecache_replay_rebase (parser->replay, clone->replay, sample.value.vendor.data);
+		}
+
+		clone->cache.samples[clone->cache.count++] = sample;
+	}
+
+	clone->cache.valid = cache->valid;
+	clone->cache.indexed = cache->indexed;
+	clone->cache.monotonic = cache->monotonic;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_clone (dc_parser_t **out, dc_parser_t *parser)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_t *clone = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// A backend which owns memory needs to copy it for the clone.
+	if (parser->vtable->destroy && parser->vtable->clone == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	clone = (dc_parser_t *) dc_context_malloc (parser->context, parser->vtable->size);
+	if (clone == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Copy the header data cached by the backend, and reset the memory
+	// owned by the original parser. The dive data itself is shared.
+	memcpy (clone, parser, parser->vtable->size);
+	memset (&clone->cache, 0, sizeof (clone->cache));
+	clone->replay = NULL;
+	clone->decoded = NULL;
+	clone->appended = NULL;
+	clone->appending = 0;
+	clone->emitted = 0;
+	clone->timer = NULL;
+	memset (&clone->stats, 0, sizeof (clone->stats));
+	clone->measuring = 0;
+
+	if (parser->vtable->clone) {
+		status = parser->vtable->clone (clone, parser);
+		if (status != DC_STATUS_SUCCESS) {
+			dc_parser_deallocate (clone);
+			return status;
+		}
+	}
+
+	if (parser->timer) {
+		status = dc_timer_new (&clone->timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (parser->context, "Failed to create a timer.");
+			goto error_free;
+		}
+	}
+
+	if (parser->replay) {
+		status = dc_parsecache_replay_clone (parser->context, parser->replay, &clone->replay);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_free;
+	}
+
+	status = dc_parser_cache_clone (clone, parser);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	*out = clone;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_parser_destroy (clone);
+	return status;
+}
+
+
 dc_family_t
 dc_parser_get_type (dc_parser_t *parser)
 {
@@ -282,83 +630,1984 @@ dc_parser_get_type (dc_parser_t *parser)
 }
 
 
+/*
+ * The sample types the backends decode when there is no sample mask in
+ * effect.
+ */
+static unsigned int
+dc_parser_basemask (dc_parser_t *parser)
+{
+	if (parser->flags & DC_PARSER_FLAG_NOVENDOR)
+		return DC_SAMPLE_MASK_ALL & ~DC_SAMPLE_MASK(DC_SAMPLE_VENDOR);
+
+	return DC_SAMPLE_MASK_ALL;
+}
+
+
 dc_status_t
-dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size)
+dc_parser_set_flags (dc_parser_t *parser, unsigned int flags)
 {
 	if (parser == NULL)
-		return DC_STATUS_UNSUPPORTED;
+		return DC_STATUS_INVALIDARGS;
 
-	if (parser->vtable->set_data == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	// The time counter needs a clock.
+	if ((flags & DC_PARSER_FLAG_COUNTERS) && parser->timer == NULL) {
+		dc_status_t status = dc_timer_new (&parser->timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (parser->context, "Failed to create a high resolution timer.");
+			return status;
+		}
+	}
 
-	parser->data = data;
-	parser->size = size;
+	parser->flags = flags;
+	parser->activemask = dc_parser_basemask (parser);
 
-	return parser->vtable->set_data (parser, data, size);
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime)
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask)
 {
 	if (parser == NULL)
-		return DC_STATUS_UNSUPPORTED;
+		return DC_STATUS_INVALIDARGS;
 
-	if (parser->vtable->datetime == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	parser->samplemask = mask | DC_SAMPLE_MASK(DC_SAMPLE_TIME);
 
-	return parser->vtable->datetime (parser, datetime);
+	return DC_STATUS_SUCCESS;
 }
 
+
 dc_status_t
-dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
+dc_parser_set_change_mask (dc_parser_t *parser, unsigned int mask)
+{
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	parser->changemask = mask & CHANGE_MASK;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_decimation (dc_parser_t *parser, unsigned int interval, unsigned int maxpoints)
+{
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Each bucket reports up to two samples.
+	if (maxpoints == 1)
+		return DC_STATUS_INVALIDARGS;
+
+	parser->interval = interval;
+	parser->maxpoints = maxpoints;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_limits (dc_parser_t *parser, unsigned int maxsamples, unsigned int maxmemory, unsigned int timeout)
+{
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The deadline needs a clock.
+	if (timeout && parser->timer == NULL) {
+		dc_status_t status = dc_timer_new (&parser->timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (parser->context, "Failed to create a high resolution timer.");
+			return status;
+		}
+	}
+
+	parser->maxsamples = maxsamples;
+	parser->maxmemory = maxmemory;
+	parser->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+typedef struct dc_parser_meter_t {
+	unsigned int active;
+	dc_usecs_t start;
+	dc_context_memstats_t memstats;
+} dc_parser_meter_t;
+
+/*
+ * Measure the cost of a call into the backend. Nested calls, like a
+ * walk over the profile from within the backend, are included in the
+ * outermost call only.
+ */
+static void
+dc_parser_meter_begin (dc_parser_t *parser, dc_parser_meter_t *meter)
+{
+	meter->active = (parser->flags & DC_PARSER_FLAG_COUNTERS) && !parser->measuring;
+	if (!meter->active)
+		return;
+
+	parser->measuring = 1;
+
+	meter->start = 0;
+	dc_timer_now (parser->timer, &meter->start);
+
+	memset (&meter->memstats, 0, sizeof (meter->memstats));
+	if (parser->context)
+		dc_context_get_memstats (parser->context, &meter->memstats);
+}
+
+static void
+dc_parser_meter_end (dc_parser_t *parser, dc_parser_meter_t *meter)
+{
+	if (!meter->active)
+		return;
+
+	parser->measuring = 0;
+
+	dc_usecs_t now = 0;
+	if (dc_timer_now (parser->timer, &now) == DC_STATUS_SUCCESS && now > meter->start)
+		parser->stats.time += now - meter->start;
+
+	dc_context_memstats_t memstats;
+	if (parser->context && dc_context_get_memstats (parser->context, &memstats) == DC_STATUS_SUCCESS) {
+		parser->stats.nallocs += memstats.count - meter->memstats.count;
+		parser->stats.allocated += memstats.total - meter->memstats.total;
+	}
+}
+
+
+// Reading the clock is relatively expensive compared to a single
+// iteration of a backend loop, so the deadline is only checked once
+// every few calls.
+#define LIMIT_INTERVAL 64
+
+static void
+dc_parser_limits_reset (dc_parser_t *parser)
+{
+	parser->nsamples = 0;
+	parser->memory = 0;
+	parser->nchecks = 0;
+	parser->exceeded = DC_STATUS_SUCCESS;
+
+	if (parser->timeout) {
+		dc_usecs_t now = 0;
+		dc_timer_now (parser->timer, &now);
+		parser->deadline = now + parser->timeout * 1000ULL;
+	}
+}
+
+
+dc_status_t
+dc_parser_check_limits (dc_parser_t *parser)
+{
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		return parser->exceeded;
+
+	if (parser->timeout == 0 || ++parser->nchecks % LIMIT_INTERVAL != 0)
+		return DC_STATUS_SUCCESS;
+
+	dc_usecs_t now = 0;
+	if (dc_timer_now (parser->timer, &now) == DC_STATUS_SUCCESS && now >= parser->deadline) {
+		ERROR (parser->context, "Parser deadline exceeded.");
+		parser->exceeded = DC_STATUS_LIMIT;
+	}
+
+	return parser->exceeded;
+}
+
+
+dc_status_t
+dc_parser_reserve (dc_parser_t *parser, size_t size)
+{
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		return parser->exceeded;
+
+	if (parser->maxmemory == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (size > parser->maxmemory - parser->memory) {
+		ERROR (parser->context, "Parser memory limit exceeded.");
+		parser->exceeded = DC_STATUS_LIMIT;
+		return parser->exceeded;
+	}
+
+	parser->memory += size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_cache (dc_parser_t *parser, dc_parsecache_t *cache)
+{
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	parser->parsecache = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+dc_parser_capture (dc_parser_t *parser, unsigned long long key)
+{
+	if (parser->vtable->samples_foreach == NULL)
+		return;
+
+	// Parse the dive completely, regardless of the flags.
+	unsigned int flags = parser->flags;
+	parser->flags &= ~DC_PARSER_FLAG_SUMMARY;
+
+	dc_buffer_t *buffer = NULL;
+	dc_status_t status = dc_parser_cache_fill (parser, NULL, NULL);
+	if (status != DC_STATUS_SUCCESS || !parser->cache.valid)
+		goto error_restore;
+
+	buffer = dc_buffer_allocate (parser->context, 1024);
+	if (buffer == NULL)
+		goto error_restore;
+
+	status = dc_parsecache_encode (parser, parser->model, key, buffer);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_restore;
+
+	dc_parsecache_store (parser->parsecache, parser->vtable->type, parser->model, key,
+		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
+error_restore:
+	dc_buffer_free (buffer);
+	parser->flags = flags;
+}
+
+
+static int
+dc_parser_replay (dc_parser_t *parser, unsigned long long key)
+{
+	dc_buffer_t *buffer = dc_buffer_allocate (parser->context, 0);
+	if (buffer == NULL)
+		return 0;
+
+	int found = dc_parsecache_lookup (parser->parsecache, parser->vtable->type, parser->model, key, buffer);
+	if (found) {
+		dc_status_t status = dc_parsecache_decode (parser, parser->model, key,
+			dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), &parser->replay);
+		if (status != DC_STATUS_SUCCESS) {
+			dc_parser_cache_reset (parser);
+			found = 0;
+		}
+	}
+
+	dc_buffer_free (buffer);
+
+	return found;
+}
+
+
+dc_status_t
+dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size)
 {
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->field == NULL)
+	if (parser->vtable->set_data == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return parser->vtable->field (parser, type, flags, value);
+	dc_parser_cache_reset (parser);
+	dc_parsecache_replay_free (parser->context, parser->replay);
+	parser->replay = NULL;
+	parser->statistics_valid = 0;
+	parser->cached = 0;
+	parser->appending = 0;
+	parser->emitted = 0;
+	dc_parser_limits_reset (parser);
+
+	parser->data = data;
+	parser->size = size;
+
+	if (data && size) {
+		parser->stats.ndives++;
+		parser->stats.nbytes += size;
+	}
+
+	// Replay the dive from the cache, without the backend decoder.
+	unsigned long long key = 0;
+	if (parser->parsecache && data && size) {
+		key = dc_parsecache_key (parser, data, size);
+		if (dc_parser_replay (parser, key))
+			return DC_STATUS_SUCCESS;
+	}
+
+	PROBE3 (parser__set_data__start, parser, parser->vtable->type, size);
+	dc_parser_meter_t meter;
+	dc_parser_meter_begin (parser, &meter);
+	dc_status_t status = parser->vtable->set_data (parser, data, size);
+	dc_parser_meter_end (parser, &meter);
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		status = parser->exceeded;
+	PROBE2 (parser__set_data__done, parser, status);
+
+	if (status == DC_STATUS_SUCCESS && parser->parsecache && data && size)
+		dc_parser_capture (parser, key);
+
+	return status;
 }
 
 
 dc_status_t
-dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+dc_parser_set_data_compressed (dc_parser_t *parser, const unsigned char *data, unsigned int size)
 {
+	dc_status_t status = DC_STATUS_SUCCESS;
+
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->samples_foreach == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (parser->decoded == NULL) {
+		parser->decoded = dc_buffer_allocate (parser->context, 0);
+		if (parser->decoded == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	dc_buffer_clear (parser->decoded);
 
-	return parser->vtable->samples_foreach (parser, callback, userdata);
+	status = dc_codec_decompress (parser->context, data, size, parser->decoded);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	return dc_parser_set_data (parser,
+		dc_buffer_get_data (parser->decoded),
+		dc_buffer_get_size (parser->decoded));
 }
 
 
 dc_status_t
-dc_parser_destroy (dc_parser_t *parser)
+dc_parser_append_data (dc_parser_t *parser, const unsigned char *data, unsigned int size)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 
 	if (parser == NULL)
-		return DC_STATUS_SUCCESS;
+		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->destroy) {
-		status = parser->vtable->destroy (parser);
+	if (data == NULL && size)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->appended == NULL) {
+		parser->appended = dc_buffer_allocate (parser->context, 0);
+		if (parser->appended == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
 	}
 
-	dc_parser_deallocate (parser);
+	// Start a new dive, unless the previous data was appended too.
+	if (!parser->appending) {
+		dc_buffer_clear (parser->appended);
+	}
+
+	if (size && !dc_buffer_append (parser->appended, data, size)) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// A partial dive is never stored in the parse cache.
+	unsigned int emitted = parser->emitted;
+	dc_parsecache_t *parsecache = parser->parsecache;
+	parser->parsecache = NULL;
+
+	status = dc_parser_set_data (parser,
+		dc_buffer_get_data (parser->appended),
+		dc_buffer_get_size (parser->appended));
+
+	parser->parsecache = parsecache;
+	parser->appending = 1;
+	parser->emitted = emitted;
 
 	return status;
 }
 
 
-void
-sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+dc_status_t
+dc_parser_reset (dc_parser_t *parser, unsigned int devtime, dc_ticks_t systime, const unsigned char *data, unsigned int size)
 {
-	sample_statistics_t *statistics  = (sample_statistics_t *) userdata;
-
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	parser->devtime = devtime;
+	parser->systime = systime;
+
+	return dc_parser_set_data (parser, data, size);
+}
+
+
+dc_status_t
+dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->replay)
+		return dc_parsecache_replay_datetime (parser->replay, datetime);
+
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		return parser->exceeded;
+
+	if (parser->vtable->datetime == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return parser->vtable->datetime (parser, datetime);
+}
+
+static dc_status_t
+dc_parser_get_statistics (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
+{
+	const sample_statistics_t *statistics = &parser->statistics;
+
+	if (!parser->statistics_valid) {
+		sample_statistics_t tmp = SAMPLE_STATISTICS_INITIALIZER;
+
+		if (parser->cache.valid) {
+			for (unsigned int i = 0; i < parser->cache.count; ++i) {
+				sample_statistics_cb (parser->cache.samples[i].type, parser->cache.samples[i].value, &tmp);
+			}
+		} else {
+			if (dc_parser_is_summary (parser))
+				return DC_STATUS_FULLSCAN;
+
+			dc_status_t status = dc_parser_samples_walk (parser, sample_statistics_cb, &tmp);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+		}
+
+		parser->statistics = tmp;
+		parser->statistics_valid = 1;
+	}
+
+	if (value == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const sample_statistics_tank_t *tank = NULL;
+	unsigned int seconds = 0;
+	switch (type) {
+	case DC_FIELD_ASCENT_RATE:
+		if (statistics->ndepth < 2)
+			return DC_STATUS_UNSUPPORTED;
+		*((double *) value) = statistics->maxascent;
+		break;
+	case DC_FIELD_DESCENT_RATE:
+		if (statistics->ndepth < 2)
+			return DC_STATUS_UNSUPPORTED;
+		*((double *) value) = statistics->maxdescent;
+		break;
+	case DC_FIELD_TEMPERATURE_AVERAGE:
+		if (statistics->ntemperature == 0)
+			return DC_STATUS_UNSUPPORTED;
+		*((double *) value) = statistics->temperaturesum / statistics->ntemperature;
+		break;
+	case DC_FIELD_TIME_BELOW:
+		if (statistics->ndepth == 0)
+			return DC_STATUS_UNSUPPORTED;
+		for (unsigned int i = flags; i < STATISTICS_MAXDEPTH; ++i) {
+			seconds += statistics->histogram[i];
+		}
+		*((unsigned int *) value) = seconds;
+		break;
+	case DC_FIELD_CONSUMPTION:
+		if (flags >= STATISTICS_MAXTANKS)
+			return DC_STATUS_UNSUPPORTED;
+		tank = statistics->tank + flags;
+		if (tank->count < 2 || tank->tend <= tank->tbegin)
+			return DC_STATUS_UNSUPPORTED;
+		seconds = tank->tend - tank->tbegin;
+		// Convert to the surface rate, using the average ambient
+		// pressure over the time the tank was in use.
+		*((double *) value) = (tank->pbegin - tank->pend) * 60.0 / seconds /
+			(1.0 + (tank->dend - tank->dbegin) / seconds / 10.0);
+		break;
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_parser_count_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	unsigned int *count = (unsigned int *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		(*count)++;
+}
+
+static dc_status_t
+dc_parser_get_samplecount (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
+{
+	unsigned int count = 0;
+
+	if (parser->cache.valid) {
+		// The cached samples, also from the parse cache, are exact.
+		for (unsigned int i = 0; i < parser->cache.count; ++i) {
+			if (parser->cache.samples[i].type == DC_SAMPLE_TIME)
+				count++;
+		}
+	} else {
+		if (parser->exceeded != DC_STATUS_SUCCESS)
+			return parser->exceeded;
+
+		// Ask the backend, which can usually obtain the count without
+		// decoding the samples. The exact count is a valid capacity.
+		if (parser->vtable->field) {
+			dc_status_t rc = parser->vtable->field (parser, type, flags, value);
+			if (rc == DC_STATUS_UNSUPPORTED && type == DC_FIELD_SAMPLE_CAPACITY)
+				rc = parser->vtable->field (parser, DC_FIELD_SAMPLE_COUNT, flags, value);
+			if (rc != DC_STATUS_UNSUPPORTED)
+				return rc;
+		}
+
+		if (dc_parser_is_summary (parser))
+			return DC_STATUS_FULLSCAN;
+
+		dc_status_t status = dc_parser_samples_walk (parser, dc_parser_count_cb, &count);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	if (value == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*((unsigned int *) value) = count;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	switch (type) {
+	case DC_FIELD_ASCENT_RATE:
+	case DC_FIELD_DESCENT_RATE:
+	case DC_FIELD_TEMPERATURE_AVERAGE:
+	case DC_FIELD_TIME_BELOW:
+	case DC_FIELD_CONSUMPTION:
+		return dc_parser_get_statistics (parser, type, flags, value);
+	case DC_FIELD_SAMPLE_COUNT:
+	case DC_FIELD_SAMPLE_CAPACITY:
+		return dc_parser_get_samplecount (parser, type, flags, value);
+	default:
+		break;
+	}
+
+	if (parser->replay)
+		return dc_parsecache_replay_field (parser->replay, type, flags, value);
+
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		return parser->exceeded;
+
+	if (parser->vtable->field == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return parser->vtable->field (parser, type, flags, value);
+}
+
+
+typedef struct dc_parser_limit_t {
+	dc_parser_t *parser;
+	dc_sample_callback_t callback;
+	void *userdata;
+} dc_parser_limit_t;
+
+static void
+dc_parser_limit_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_parser_limit_t *limit = (dc_parser_limit_t *) userdata;
+	dc_parser_t *parser = limit->parser;
+
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		return;
+
+	if (type == DC_SAMPLE_TIME && ++parser->nsamples > parser->maxsamples) {
+		ERROR (parser->context, "Maximum number of samples exceeded.");
+		parser->exceeded = DC_STATUS_LIMIT;
+		return;
+	}
+
+	if (limit->callback)
+		limit->callback (type, value, limit->userdata);
+}
+
+typedef struct dc_parser_counter_t {
+	dc_parser_t *parser;
+	dc_sample_callback_t callback;
+	void *userdata;
+} dc_parser_counter_t;
+
+static void
+dc_parser_counter_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_parser_counter_t *counter = (dc_parser_counter_t *) userdata;
+
+	if ((unsigned int) type < DC_PARSER_STATS_TYPES)
+		counter->parser->stats.nsamples[type]++;
+
+	counter->callback (type, value, counter->userdata);
+}
+
+/*
+ * Run the backend over the samples. The samples are counted here,
+ * and the remaining samples are dropped once a limit is exceeded,
+ * also for backends which don't check the limits themselves.
+ */
+static dc_status_t
+dc_parser_backend_samples (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		return parser->exceeded;
+
+	parser->stats.nwalks++;
+
+	dc_parser_meter_t meter;
+	dc_parser_meter_begin (parser, &meter);
+
+	dc_parser_counter_t counter = {parser, callback, userdata};
+	if ((parser->flags & DC_PARSER_FLAG_COUNTERS) && callback) {
+		callback = dc_parser_counter_cb;
+		userdata = &counter;
+	}
+
+	if (parser->maxsamples) {
+		dc_parser_limit_t limit = {parser, callback, userdata};
+		parser->nsamples = 0;
+		status = parser->vtable->samples_foreach (parser, dc_parser_limit_cb, &limit);
+	} else {
+		status = parser->vtable->samples_foreach (parser, callback, userdata);
+	}
+
+	dc_parser_meter_end (parser, &meter);
+
+	if (parser->exceeded != DC_STATUS_SUCCESS)
+		status = parser->exceeded;
+
+	return status;
+}
+
+typedef struct dc_parser_record_t {
+	dc_parser_t *parser;
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int failed;
+} dc_parser_record_t;
+
+static void
+dc_parser_record_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_parser_record_t *record = (dc_parser_record_t *) userdata;
+	dc_parser_cache_t *cache = &record->parser->cache;
+
+	if (record->callback)
+		record->callback (type, value, record->userdata);
+
+	if (record->failed)
+		return;
+
+	// Grow the cache.
+	if (cache->count >= cache->capacity) {
+		unsigned int capacity = cache->capacity ? cache->capacity * 2 : 1024;
+		if (dc_parser_reserve (record->parser, (capacity - cache->capacity) * sizeof (dc_parser_sample_t)) != DC_STATUS_SUCCESS) {
+			record->failed = 1;
+			return;
+		}
+		dc_parser_sample_t *samples = (dc_parser_sample_t *) dc_context_realloc (record->parser->context, cache->samples, capacity * sizeof (dc_parser_sample_t));
+		if (samples == NULL) {
+			record->failed = 1;
+			return;
+		}
+
+		cache->samples = samples;
+		cache->capacity = capacity;
+	}
+
+	// The event names are not guaranteed to outlive the callback.
+	if (type == DC_SAMPLE_EVENT && value.event.name) {
+		size_t length = strlen (value.event.name) + 1;
+		char *name = (char *) dc_context_malloc (record->parser->context, length);
+		if (name == NULL) {
+			record->failed = 1;
+			return;
+		}
+		memcpy (name, value.event.name, length);
+		value.event.name = name;
+	} else if (type == DC_SAMPLE_EVENT) {
+		value.event.name = NULL;
+	}
+
+	cache->samples[cache->count].type = type;
+	cache->samples[cache->count].value = value;
+	cache->count++;
+}
+
+typedef struct dc_parser_tee_t {
+	dc_sample_callback_t callback;
+	void *userdata;
+	sample_statistics_t statistics;
+} dc_parser_tee_t;
+
+static void
+dc_parser_tee_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_parser_tee_t *tee = (dc_parser_tee_t *) userdata;
+
+	sample_statistics_cb (type, value, &tee->statistics);
+
+	if (tee->callback)
+		tee->callback (type, value, tee->userdata);
+}
+
+static dc_status_t
+dc_parser_cache_fill (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Decode the samples, and record them in the cache.
+	dc_parser_record_t record = {parser, callback, userdata, 0};
+	dc_parser_cache_reset (parser);
+	status = dc_parser_backend_samples (parser, dc_parser_record_cb, &record);
+	if (status != DC_STATUS_SUCCESS || record.failed) {
+		if (record.failed)
+			WARNING (parser->context, "Failed to cache the samples.");
+		dc_parser_cache_reset (parser);
+		return status;
+	}
+
+	parser->cache.valid = 1;
+
+	return status;
+}
+
+dc_status_t
+dc_parser_samples_walk (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (!(parser->flags & DC_PARSER_FLAG_CACHE) && !parser->cache.valid) {
+		// Accumulate the statistics along with a complete walk.
+		if ((parser->flags & DC_PARSER_FLAG_STATISTICS) &&
+			!parser->statistics_valid && parser->activemask == dc_parser_basemask (parser)) {
+			dc_parser_tee_t tee = {callback, userdata, SAMPLE_STATISTICS_INITIALIZER};
+			status = dc_parser_backend_samples (parser, dc_parser_tee_cb, &tee);
+			if (status == DC_STATUS_SUCCESS) {
+				parser->statistics = tee.statistics;
+				parser->statistics_valid = 1;
+			}
+			return status;
+		}
+
+		return dc_parser_backend_samples (parser, callback, userdata);
+	}
+
+	// Replay the cached samples.
+	if (parser->cache.valid) {
+		if (callback) {
+			for (unsigned int i = 0; i < parser->cache.count; ++i) {
+				callback (parser->cache.samples[i].type, parser->cache.samples[i].value, userdata);
+			}
+		}
+		return DC_STATUS_SUCCESS;
+	}
+
+	return dc_parser_cache_fill (parser, callback, userdata);
+}
+
+dc_status_t
+dc_parser_cache_profile (dc_parser_t *parser)
+{
+	if (parser->cached)
+		return DC_STATUS_SUCCESS;
+
+	return dc_parser_samples_walk (parser, NULL, NULL);
+}
+
+unsigned int
+dc_parser_find_gasmix (const dc_parser_gasmix_t gasmix[], unsigned int begin, unsigned int end, unsigned int oxygen, unsigned int helium)
+{
+	unsigned int i = begin;
+	while (i < end) {
+		if (oxygen == gasmix[i].oxygen && helium == gasmix[i].helium)
+			break;
+		i++;
+	}
+
+	return i;
+}
+
+static int
+dc_sample_fixed_round (double value, double scale)
+{
+	return (int) lround (value * scale);
+}
+
+static void
+dc_sample_fixed_convert (dc_sample_type_t type, const dc_sample_value_t *value, dc_sample_fixed_t *fixed)
+{
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		fixed->depth = dc_sample_fixed_round (value->depth, 1000.0);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		fixed->pressure.tank = value->pressure.tank;
+		fixed->pressure.value = dc_sample_fixed_round (value->pressure.value, 1000.0);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		fixed->temperature = dc_sample_fixed_round (value->temperature, 100.0);
+		break;
+	case DC_SAMPLE_EVENT:
+		fixed->event.type = value->event.type;
+		fixed->event.time = value->event.time;
+		fixed->event.flags = value->event.flags;
+		fixed->event.value = value->event.value;
+		fixed->event.name = value->event.name;
+		break;
+	case DC_SAMPLE_VENDOR:
+		fixed->vendor.type = value->vendor.type;
+		fixed->vendor.size = value->vendor.size;
+		fixed->vendor.data = value->vendor.data;
+		break;
+	case DC_SAMPLE_SETPOINT:
+		fixed->setpoint = dc_sample_fixed_round (value->setpoint, 1000.0);
+		break;
+	case DC_SAMPLE_PPO2:
+		fixed->ppo2 = dc_sample_fixed_round (value->ppo2, 1000.0);
+		break;
+	case DC_SAMPLE_CNS:
+		fixed->cns = dc_sample_fixed_round (value->cns, 10000.0);
+		break;
+	case DC_SAMPLE_DECO:
+		fixed->deco.type = value->deco.type;
+		fixed->deco.time = value->deco.time;
+		fixed->deco.depth = dc_sample_fixed_round (value->deco.depth, 1000.0);
+		break;
+	case DC_SAMPLE_RBT:
+		fixed->rbt = value->rbt;
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		fixed->heartbeat = value->heartbeat;
+		break;
+	case DC_SAMPLE_BEARING:
+		fixed->bearing = value->bearing;
+		break;
+	case DC_SAMPLE_GASMIX:
+		fixed->gasmix = value->gasmix;
+		break;
+	default:
+		fixed->time = value->time;
+		break;
+	}
+}
+
+/*
+ * The last value of every sample type in the change mask, per tank for
+ * the pressures, and per position within the sample for the others.
+ */
+typedef struct dc_parser_dedup_t {
+	unsigned int position[DC_SAMPLE_TTS + 1];
+	unsigned int valid[DC_SAMPLE_TTS + 1];
+	unsigned int pending[DC_SAMPLE_TTS + 1];
+	dc_sample_value_t last[DC_SAMPLE_TTS + 1][DEDUP_SLOTS];
+} dc_parser_dedup_t;
+
+static int
+dc_parser_dedup_equal (dc_sample_type_t type, const dc_sample_value_t *a, const dc_sample_value_t *b)
+{
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		return a->depth == b->depth;
+	case DC_SAMPLE_PRESSURE:
+		return a->pressure.value == b->pressure.value;
+	case DC_SAMPLE_TEMPERATURE:
+		return a->temperature == b->temperature;
+	case DC_SAMPLE_RBT:
+		return a->rbt == b->rbt;
+	case DC_SAMPLE_HEARTBEAT:
+		return a->heartbeat == b->heartbeat;
+	case DC_SAMPLE_BEARING:
+		return a->bearing == b->bearing;
+	case DC_SAMPLE_SETPOINT:
+		return a->setpoint == b->setpoint;
+	case DC_SAMPLE_PPO2:
+		return a->ppo2 == b->ppo2;
+	case DC_SAMPLE_CNS:
+		return a->cns == b->cns;
+	case DC_SAMPLE_DECO:
+		return a->deco.type == b->deco.type &&
+			a->deco.time == b->deco.time &&
+			a->deco.depth == b->deco.depth;
+	case DC_SAMPLE_GASMIX:
+		return a->gasmix == b->gasmix;
+	case DC_SAMPLE_TTS:
+		return a->time == b->time;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Check whether a sample is a repeated value, which is suppressed. The
+ * last suppressed value is marked as pending, for reporting the final
+ * value at the end of the profile.
+ */
+static int
+dc_parser_dedup_check (dc_parser_dedup_t *dedup, unsigned int mask, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	if (type == DC_SAMPLE_TIME) {
+		memset (dedup->position, 0, sizeof (dedup->position));
+		return 0;
+	}
+
+	if (!(mask & DC_SAMPLE_MASK(type)) || type > DC_SAMPLE_TTS)
+		return 0;
+
+	unsigned int slot = 0;
+	if (type == DC_SAMPLE_PRESSURE)
+		slot = value->pressure.tank;
+	else
+		slot = dedup->position[type]++;
+
+	// Too many values to keep track of.
+	if (slot >= DEDUP_SLOTS)
+		return 0;
+
+	unsigned int bit = 1u << slot;
+	if ((dedup->valid[type] & bit) &&
+		dc_parser_dedup_equal (type, &dedup->last[type][slot], value)) {
+		dedup->pending[type] |= bit;
+		return 1;
+	}
+
+	dedup->last[type][slot] = *value;
+	dedup->valid[type] |= bit;
+	dedup->pending[type] &= ~bit;
+
+	return 0;
+}
+
+typedef struct dc_parser_filter_t {
+	unsigned int mask;
+	dc_sample_callback_t callback;
+	dc_sample_callback2_t callback2;
+	dc_sample_fixed_callback_t callback3;
+	void *userdata;
+	// Number of samples to skip, and the number of samples seen.
+	unsigned int skip;
+	unsigned int count;
+	// Filters of the individual consumers, which receive a copy of every
+	// sample. The mask of the parent is the union of their masks.
+	struct dc_parser_filter_t *fanout;
+	unsigned int nfanout;
+	// Sample types which are only reported when changed.
+	unsigned int changemask;
+	dc_parser_dedup_t *dedup;
+} dc_parser_filter_t;
+
+static void
+dc_parser_filter_emit (dc_parser_filter_t *filter, dc_sample_type_t type, const dc_sample_value_t *value);
+
+static void
+dc_parser_filter_deliver (dc_parser_filter_t *filter, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	if (filter->fanout) {
+		for (unsigned int i = 0; i < filter->nfanout; ++i)
+			dc_parser_filter_emit (filter->fanout + i, type, value);
+		return;
+	}
+
+	if (filter->count++ < filter->skip)
+		return;
+
+	if (filter->callback3) {
+		dc_sample_fixed_t fixed;
+		dc_sample_fixed_convert (type, value, &fixed);
+		filter->callback3 (type, &fixed, filter->userdata);
+	} else if (filter->callback2) {
+		filter->callback2 (type, value, filter->userdata);
+	} else {
+		filter->callback (type, *value, filter->userdata);
+	}
+}
+
+static void
+dc_parser_filter_emit (dc_parser_filter_t *filter, dc_sample_type_t type, const dc_sample_value_t *value)
+{
+	if (!(filter->mask & DC_SAMPLE_MASK(type)))
+		return;
+
+	if (filter->dedup && dc_parser_dedup_check (filter->dedup, filter->changemask, type, value))
+		return;
+
+	dc_parser_filter_deliver (filter, type, value);
+}
+
+/*
+ * Report the final values which were suppressed as repeated values. They
+ * belong to the last sample, and are not counted as new samples.
+ */
+static void
+dc_parser_filter_finish (dc_parser_filter_t *filter)
+{
+	dc_parser_dedup_t *dedup = filter->dedup;
+	unsigned int skip = filter->skip;
+	unsigned int count = filter->count;
+
+	filter->dedup = NULL;
+	filter->skip = 0;
+
+	for (unsigned int type = 0; type <= DC_SAMPLE_TTS; ++type) {
+		for (unsigned int slot = 0; slot < DEDUP_SLOTS; ++slot) {
+			if (dedup->pending[type] & (1u << slot))
+				dc_parser_filter_deliver (filter, (dc_sample_type_t) type, &dedup->last[type][slot]);
+		}
+	}
+
+	filter->skip = skip;
+	filter->count = count;
+}
+
+static void
+dc_parser_filter_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_parser_filter_emit ((dc_parser_filter_t *) userdata, type, &value);
+}
+
+static unsigned int
+dc_parser_cache_time (const dc_parser_sample_t *samples, unsigned int count, unsigned int row, unsigned int *next)
+{
+	unsigned int i = row + 1;
+
+	// Find the start of the next row.
+	while (i < count && samples[i].type != DC_SAMPLE_TIME)
+		i++;
+
+	*next = i;
+
+	return samples[row].value.time;
+}
+
+static void
+dc_parser_cache_emit (const dc_parser_sample_t *samples, unsigned int begin, unsigned int end, unsigned int sticky, dc_parser_filter_t *filter)
+{
+	for (unsigned int i = begin; i < end; ++i) {
+		dc_sample_type_t type = samples[i].type;
+		if (sticky && type != DC_SAMPLE_EVENT && type != DC_SAMPLE_GASMIX)
+			continue;
+		dc_parser_filter_emit (filter, type, &samples[i].value);
+	}
+}
+
+static dc_status_t
+dc_parser_cache_load (dc_parser_t *parser)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->cache.valid)
+		return DC_STATUS_SUCCESS;
+
+	status = dc_parser_cache_fill (parser, NULL, NULL);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (!parser->cache.valid)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_parser_samples_decimate (dc_parser_t *parser, dc_parser_filter_t *filter)
+{
+	// The decimation works on the decoded sample cache.
+	dc_status_t status = dc_parser_cache_load (parser);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	const dc_parser_sample_t *samples = parser->cache.samples;
+	unsigned int count = parser->cache.count;
+
+	// Samples before the first time sample are passed unchanged.
+	unsigned int first = 0;
+	while (first < count && samples[first].type != DC_SAMPLE_TIME)
+		first++;
+	dc_parser_cache_emit (samples, 0, first, 0, filter);
+	if (first == count)
+		return DC_STATUS_SUCCESS;
+
+	// Get the duration of the profile.
+	unsigned int last = count - 1;
+	while (samples[last].type != DC_SAMPLE_TIME)
+		last--;
+	unsigned int t0 = samples[first].value.time;
+	unsigned int duration = samples[last].value.time > t0 ? samples[last].value.time - t0 : 0;
+
+	// Get the bucket width.
+	unsigned int interval = parser->interval;
+	if (parser->maxpoints) {
+		unsigned int width = duration / (parser->maxpoints / 2) + 1;
+		if (interval < width)
+			interval = width;
+	}
+	if (interval == 0)
+		interval = 1;
+
+	unsigned int row = first;
+	while (row < count) {
+		unsigned int next = 0;
+		unsigned int time = dc_parser_cache_time (samples, count, row, &next);
+		unsigned int bucket = (time > t0 ? time - t0 : 0) / interval;
+		unsigned int begin = row;
+		unsigned int rmin = row, rmax = row;
+		double dmin = INFINITY, dmax = -INFINITY;
+
+		// Find the rows with the minimum and maximum depth.
+		while (row < count) {
+			time = dc_parser_cache_time (samples, count, row, &next);
+			if ((time > t0 ? time - t0 : 0) / interval != bucket)
+				break;
+
+			for (unsigned int i = row + 1; i < next; ++i) {
+				if (samples[i].type != DC_SAMPLE_DEPTH)
+					continue;
+				if (samples[i].value.depth < dmin) {
+					dmin = samples[i].value.depth;
+					rmin = row;
+				}
+				if (samples[i].value.depth > dmax) {
+					dmax = samples[i].value.depth;
+					rmax = row;
+				}
+			}
+
+			row = next;
+		}
+
+		unsigned int a = rmin < rmax ? rmin : rmax;
+		unsigned int b = rmin < rmax ? rmax : rmin;
+
+		// Report the selected rows, with the events of all the other
+		// rows attached to the first one.
+		dc_parser_cache_time (samples, count, a, &next);
+		dc_parser_cache_emit (samples, a, next, 0, filter);
+		for (unsigned int i = begin; i < row; i = next) {
+			dc_parser_cache_time (samples, count, i, &next);
+			if (i != a && i != b)
+				dc_parser_cache_emit (samples, i, next, 1, filter);
+		}
+		if (b != a) {
+			dc_parser_cache_time (samples, count, b, &next);
+			dc_parser_cache_emit (samples, b, next, 0, filter);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_parser_samples_dispatch (dc_parser_t *parser, dc_parser_filter_t *filter)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser->interval || parser->maxpoints)
+		return dc_parser_samples_decimate (parser, filter);
+
+	// The sample cache needs all samples, so the backend can't skip
+	// anything. The samples are only filtered on the way out.
+	if ((parser->flags & DC_PARSER_FLAG_CACHE) || parser->cache.valid) {
+		if (parser->cache.valid) {
+			dc_parser_cache_emit (parser->cache.samples, 0, parser->cache.count, 0, filter);
+			return DC_STATUS_SUCCESS;
+		}
+		return dc_parser_samples_walk (parser, dc_parser_filter_cb, filter);
+	}
+
+	// Filter the samples which are not handled by the backend itself.
+	parser->activemask = parser->samplemask & dc_parser_basemask (parser);
+	status = dc_parser_samples_walk (parser, dc_parser_filter_cb, filter);
+	parser->activemask = dc_parser_basemask (parser);
+
+	return status;
+}
+
+static dc_status_t
+dc_parser_samples_filter (dc_parser_t *parser, dc_parser_filter_t *filter)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_dedup_t dedup;
+
+	if (parser->changemask == 0)
+		return dc_parser_samples_dispatch (parser, filter);
+
+	memset (&dedup, 0, sizeof (dedup));
+	filter->changemask = parser->changemask;
+	filter->dedup = &dedup;
+
+	status = dc_parser_samples_dispatch (parser, filter);
+	if (status == DC_STATUS_SUCCESS)
+		dc_parser_filter_finish (filter);
+
+	filter->dedup = NULL;
+
+	return status;
+}
+
+dc_status_t
+dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	PROBE2 (parser__samples__start, parser, parser ? parser->vtable->type : DC_FAMILY_NULL);
+
+	if (parser == NULL || callback == NULL ||
+		(parser->samplemask == DC_SAMPLE_MASK_ALL && !parser->changemask && !parser->interval && !parser->maxpoints && !parser->appending)) {
+		status = dc_parser_samples_walk (parser, callback, userdata);
+	} else {
+		dc_parser_filter_t filter = {parser->samplemask, callback, NULL, NULL, userdata, parser->emitted, 0, NULL, 0, 0, NULL};
+		status = dc_parser_samples_filter (parser, &filter);
+		if (parser->appending && filter.count > parser->emitted)
+			parser->emitted = filter.count;
+	}
+
+	PROBE2 (parser__samples__done, parser, status);
+
+	return status;
+}
+
+dc_status_t
+dc_parser_samples_foreach2 (dc_parser_t *parser, dc_sample_callback2_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	PROBE2 (parser__samples__start, parser, parser ? parser->vtable->type : DC_FAMILY_NULL);
+
+	if (parser == NULL || callback == NULL) {
+		status = dc_parser_samples_walk (parser, NULL, NULL);
+	} else {
+		dc_parser_filter_t filter = {parser->samplemask, NULL, callback, NULL, userdata, parser->emitted, 0, NULL, 0, 0, NULL};
+		status = dc_parser_samples_filter (parser, &filter);
+		if (parser->appending && filter.count > parser->emitted)
+			parser->emitted = filter.count;
+	}
+
+	PROBE2 (parser__samples__done, parser, status);
+
+	return status;
+}
+
+dc_status_t
+dc_parser_samples_foreach_fixed (dc_parser_t *parser, dc_sample_fixed_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	PROBE2 (parser__samples__start, parser, parser ? parser->vtable->type : DC_FAMILY_NULL);
+
+	if (parser == NULL || callback == NULL) {
+		status = dc_parser_samples_walk (parser, NULL, NULL);
+	} else {
+		dc_parser_filter_t filter = {parser->samplemask, NULL, NULL, callback, userdata, parser->emitted, 0, NULL, 0, 0, NULL};
+		status = dc_parser_samples_filter (parser, &filter);
+		if (parser->appending && filter.count > parser->emitted)
+			parser->emitted = filter.count;
+	}
+
+	PROBE2 (parser__samples__done, parser, status);
+
+	return status;
+}
+
+typedef struct dc_parser_chunk_t {
+	dc_sample_record_t *records;
+	unsigned int capacity;
+	unsigned int count;
+	unsigned int start;
+	dc_sample_chunk_callback_t callback;
+	void *userdata;
+} dc_parser_chunk_t;
+
+static void
+dc_parser_chunk_cb (dc_sample_type_t type, const dc_sample_value_t *value, void *userdata)
+{
+	dc_parser_chunk_t *chunk = (dc_parser_chunk_t *) userdata;
+
+	if (chunk->count == chunk->capacity) {
+		if (chunk->start == 0) {
+			// A single sample doesn't fit, and is split.
+			chunk->callback (chunk->records, chunk->count, chunk->userdata);
+			chunk->count = 0;
+		} else if (type == DC_SAMPLE_TIME) {
+			chunk->callback (chunk->records, chunk->count, chunk->userdata);
+			chunk->count = 0;
+			chunk->start = 0;
+		} else {
+			// Report the complete samples, and move the incomplete
+			// sample to the start of the chunk.
+			unsigned int n = chunk->count - chunk->start;
+			chunk->callback (chunk->records, chunk->start, chunk->userdata);
+			memmove (chunk->records, chunk->records + chunk->start, n * sizeof (dc_sample_record_t));
+			chunk->count = n;
+			chunk->start = 0;
+		}
+	}
+
+	if (type == DC_SAMPLE_TIME)
+		chunk->start = chunk->count;
+
+	chunk->records[chunk->count].type = type;
+	chunk->records[chunk->count].value = *value;
+	chunk->count++;
+}
+
+dc_status_t
+dc_parser_samples_foreach_chunk (dc_parser_t *parser, dc_sample_record_t records[], unsigned int capacity, dc_sample_chunk_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (records == NULL || capacity == 0 || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_chunk_t chunk = {records, capacity, 0, 0, callback, userdata};
+	dc_status_t status = dc_parser_samples_foreach2 (parser, dc_parser_chunk_cb, &chunk);
+	if (status == DC_STATUS_SUCCESS && chunk.count)
+		callback (records, chunk.count, userdata);
+
+	return status;
+}
+
+dc_status_t
+dc_parser_samples_fanout (dc_parser_t *parser, const dc_sample_consumer_t consumers[], unsigned int count)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (consumers == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (consumers[i].callback == NULL)
+			return DC_STATUS_INVALIDARGS;
+	}
+
+	dc_parser_filter_t *filters = (dc_parser_filter_t *) dc_context_malloc (parser->context, (count ? count : 1) * sizeof (dc_parser_filter_t));
+	if (filters == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// The backend only decodes the sample types requested by at least
+	// one of the consumers.
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_parser_filter_t filter = {consumers[i].mask | DC_SAMPLE_MASK(DC_SAMPLE_TIME),
+			NULL, consumers[i].callback, NULL, consumers[i].userdata, 0, 0, NULL, 0, 0, NULL};
+		filters[i] = filter;
+		mask |= filter.mask;
+	}
+
+	PROBE2 (parser__samples__start, parser, parser->vtable->type);
+
+	dc_parser_filter_t fanout = {mask, NULL, NULL, NULL, NULL, 0, 0, filters, count, 0, NULL};
+	status = dc_parser_samples_filter (parser, &fanout);
+
+	PROBE2 (parser__samples__done, parser, status);
+
+	dc_context_dealloc (parser->context, filters);
+
+	return status;
+}
+
+#define INDEX_STRIDE 16
+
+static dc_status_t
+dc_parser_cache_index (dc_parser_t *parser)
+{
+	dc_parser_cache_t *cache = &parser->cache;
+	unsigned int nrows = 0, previous = 0;
+
+	if (cache->indexed)
+		return DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (cache->samples[i].type == DC_SAMPLE_TIME)
+			nrows++;
+	}
+
+	// Grow the index.
+	unsigned int nindex = (nrows + INDEX_STRIDE - 1) / INDEX_STRIDE;
+	if (nindex > cache->nindex) {
+		unsigned int *index = (unsigned int *) dc_context_realloc (parser->context, cache->index, nindex * sizeof (unsigned int));
+		if (index == NULL)
+			return DC_STATUS_NOMEMORY;
+
+		cache->index = index;
+		cache->nindex = nindex;
+	}
+
+	// Record every n-th row, and check whether the time is
+	// increasing, which is required for the binary search.
+	cache->monotonic = 1;
+	nrows = 0;
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (cache->samples[i].type != DC_SAMPLE_TIME)
+			continue;
+		if (nrows % INDEX_STRIDE == 0)
+			cache->index[nrows / INDEX_STRIDE] = i;
+		if (nrows && cache->samples[i].value.time < previous)
+			cache->monotonic = 0;
+		previous = cache->samples[i].value.time;
+		nrows++;
+	}
+	cache->nindex = (nrows + INDEX_STRIDE - 1) / INDEX_STRIDE;
+	cache->indexed = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_samples_foreach_range (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (callback == NULL || begin > end)
+		return DC_STATUS_INVALIDARGS;
+
+	// The range works on the decoded sample cache.
+	status = dc_parser_cache_load (parser);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	status = dc_parser_cache_index (parser);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	const dc_parser_cache_t *cache = &parser->cache;
+	const dc_parser_sample_t *samples = cache->samples;
+	dc_parser_filter_t filter = {parser->samplemask, callback, NULL, NULL, userdata, 0, 0, NULL, 0, 0, NULL};
+	dc_parser_dedup_t dedup;
+
+	if (cache->nindex == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (parser->changemask) {
+		memset (&dedup, 0, sizeof (dedup));
+		filter.changemask = parser->changemask;
+		filter.dedup = &dedup;
+	}
+
+	// Find the last index entry at or before the start of the range.
+	unsigned int lo = 0, hi = cache->nindex;
+	if (cache->monotonic) {
+		while (hi - lo > 1) {
+			unsigned int mid = lo + (hi - lo) / 2;
+			if (samples[cache->index[mid]].value.time <= begin)
+				lo = mid;
+			else
+				hi = mid;
+		}
+	}
+
+	unsigned int row = cache->index[lo];
+	while (row < cache->count) {
+		unsigned int next = 0;
+		unsigned int time = dc_parser_cache_time (samples, cache->count, row, &next);
+		if (time > end && cache->monotonic)
+			break;
+		if (time >= begin && time <= end)
+			dc_parser_cache_emit (samples, row, next, 0, &filter);
+		row = next;
+	}
+
+	if (filter.dedup)
+		dc_parser_filter_finish (&filter);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+dc_parser_columns_clear (dc_sample_columns_t *columns, unsigned int row)
+{
+	if (columns->depth)
+		columns->depth[row] = NAN;
+	if (columns->temperature)
+		columns->temperature[row] = NAN;
+	if (columns->ppo2)
+		columns->ppo2[row] = NAN;
+	if (columns->pressure) {
+		for (unsigned int i = 0; i < columns->ntanks; ++i) {
+			columns->pressure[i * columns->capacity + row] = NAN;
+		}
+	}
+}
+
+static void
+dc_parser_columns_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_sample_columns_t *columns = (dc_sample_columns_t *) userdata;
+
+	if (type == DC_SAMPLE_TIME) {
+		unsigned int row = columns->count++;
+		if (row < columns->capacity) {
+			if (columns->time)
+				columns->time[row] = value.time;
+			dc_parser_columns_clear (columns, row);
+		}
+		return;
+	}
+
+	// Ignore values before the first time sample.
+	if (columns->count == 0)
+		return;
+
+	unsigned int row = columns->count - 1;
+
+	if (type == DC_SAMPLE_EVENT) {
+		unsigned int n = columns->nevents++;
+		if (columns->events && n < columns->events_capacity) {
+			columns->events[n].row = row;
+			columns->events[n].type = value.event.type;
+			columns->events[n].time = value.event.time;
+			columns->events[n].flags = value.event.flags;
+			columns->events[n].value = value.event.value;
+		}
+		return;
+	}
+
+	if (row >= columns->capacity)
+		return;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		if (columns->depth)
+			columns->depth[row] = value.depth;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (columns->temperature)
+			columns->temperature[row] = value.temperature;
+		break;
+	case DC_SAMPLE_PPO2:
+		if (columns->ppo2)
+			columns->ppo2[row] = value.ppo2;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (columns->pressure && value.pressure.tank < columns->ntanks)
+			columns->pressure[value.pressure.tank * columns->capacity + row] = value.pressure.value;
+		break;
+	default:
+		break;
+	}
+}
+
+dc_status_t
+dc_parser_samples_columns (dc_parser_t *parser, dc_sample_columns_t *columns)
+{
+	if (columns == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	columns->count = 0;
+	columns->nevents = 0;
+
+	return dc_parser_samples_foreach (parser, dc_parser_columns_cb, columns);
+}
+
+
+void
+dc_sample_decode (const unsigned char data[], unsigned int count, unsigned int stride, const dc_sample_field_t *field, double output[])
+{
+	const unsigned char *p = data + field->offset;
+
+	if (field->size == 1) {
+		for (unsigned int i = 0; i < count; ++i) {
+			unsigned int raw = (p[0] & field->mask) >> field->shift;
+			output[i] = raw * field->scale + field->bias;
+			p += stride;
+		}
+	} else if (field->bigendian) {
+		for (unsigned int i = 0; i < count; ++i) {
+			unsigned int raw = ((((unsigned int) p[0] << 8) | p[1]) & field->mask) >> field->shift;
+			output[i] = raw * field->scale + field->bias;
+			p += stride;
+		}
+	} else {
+		for (unsigned int i = 0; i < count; ++i) {
+			unsigned int raw = ((p[0] | ((unsigned int) p[1] << 8)) & field->mask) >> field->shift;
+			output[i] = raw * field->scale + field->bias;
+			p += stride;
+		}
+	}
+}
+
+#define FIXED_BLOCK 64
+
+static void
+dc_parser_samples_fixed_columns (const dc_sample_layout_t *layout, const unsigned char data[], unsigned int count, unsigned int time, dc_sample_columns_t *columns)
+{
+	unsigned int row = columns->count;
+	columns->count += count;
+
+	// Samples beyond the capacity are counted, but not stored.
+	if (row >= columns->capacity)
+		return;
+	if (count > columns->capacity - row)
+		count = columns->capacity - row;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		time += layout->interval;
+		if (columns->time)
+			columns->time[row + i] = time;
+		dc_parser_columns_clear (columns, row + i);
+	}
+
+	if (columns->depth && layout->depth.size)
+		dc_sample_decode (data, count, layout->stride, &layout->depth, columns->depth + row);
+	if (columns->temperature && layout->temperature.size)
+		dc_sample_decode (data, count, layout->stride, &layout->temperature, columns->temperature + row);
+}
+
+dc_status_t
+dc_parser_samples_fixed (dc_parser_t *parser, const dc_sample_layout_t *layout, const unsigned char data[], unsigned int count, unsigned int time, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL || layout == NULL || (data == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	if (callback == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (callback == dc_parser_columns_cb) {
+		dc_parser_samples_fixed_columns (layout, data, count, time, (dc_sample_columns_t *) userdata);
+		return DC_STATUS_SUCCESS;
+	}
+
+	unsigned int wants_depth = layout->depth.size && dc_parser_wants (parser, DC_SAMPLE_DEPTH);
+	unsigned int wants_temperature = layout->temperature.size && dc_parser_wants (parser, DC_SAMPLE_TEMPERATURE);
+
+	// Decode the samples in blocks, which are small enough to stay in
+	// the cache, and then emit them.
+	double depth[FIXED_BLOCK], temperature[FIXED_BLOCK];
+	while (count) {
+		unsigned int n = count < FIXED_BLOCK ? count : FIXED_BLOCK;
+
+		if (wants_depth)
+			dc_sample_decode (data, n, layout->stride, &layout->depth, depth);
+		if (wants_temperature)
+			dc_sample_decode (data, n, layout->stride, &layout->temperature, temperature);
+
+		for (unsigned int i = 0; i < n; ++i) {
+			dc_sample_value_t sample = {0};
+
+			time += layout->interval;
+			sample.time = time;
+			callback (DC_SAMPLE_TIME, sample, userdata);
+
+			if (wants_temperature) {
+				sample.temperature = temperature[i];
+				callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+			}
+
+			if (wants_depth) {
+				sample.depth = depth[i];
+				callback (DC_SAMPLE_DEPTH, sample, userdata);
+			}
+		}
+
+		data += n * layout->stride;
+		count -= n;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_get_stats (dc_parser_t *parser, dc_parser_stats_t *stats)
+{
+	if (parser == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*stats = parser->stats;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_reset_stats (dc_parser_t *parser)
+{
+	if (parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	memset (&parser->stats, 0, sizeof (parser->stats));
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_destroy (dc_parser_t *parser)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (parser->vtable->destroy) {
+		status = parser->vtable->destroy (parser);
+	}
+
+	dc_parser_deallocate (parser);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_parse_batch (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, const dc_parser_blob_t blobs[], unsigned int count, dc_parser_batch_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+
+	if (descriptor == NULL || (blobs == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	// Create a single parser, which is re-used for all dives. The
+	// backends reset their cached state in the set_data function.
+	status = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the parser.");
+		return status;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_status_t rc = dc_parser_set_data (parser, blobs[i].data, blobs[i].size);
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (context, "Failed to assign the data of dive %u.", i);
+		}
+
+		if (callback && !callback (parser, i, rc, userdata))
+			break;
+	}
+
+	dc_parser_destroy (parser);
+
+	return status;
+}
+
+
+// Number of worker threads, if the caller doesn't specify it.
+#define NWORKERS 4
+
+typedef struct dc_parser_job_t {
+	dc_parser_t *parser;
+	dc_status_t status;
+	int done;
+} dc_parser_job_t;
+
+typedef struct dc_parser_pool_t {
+	const dc_parser_blob_t *blobs;
+	dc_parser_job_t *jobs;
+	unsigned int count;
+	unsigned int next;
+	unsigned int delivered;
+	int stop;
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+} dc_parser_pool_t;
+
+typedef struct dc_parser_worker_t {
+	dc_parser_pool_t *pool;
+	dc_parser_t *parser;
+	void *task;
+} dc_parser_worker_t;
+
+static void
+dc_parser_pool_worker (void *userdata)
+{
+	dc_parser_worker_t *worker = (dc_parser_worker_t *) userdata;
+	dc_parser_pool_t *pool = worker->pool;
+	dc_parser_t *parser = worker->parser;
+
+	dc_mutex_lock (pool->mutex);
+	while (!pool->stop && pool->next < pool->count) {
+		unsigned int i = pool->next++;
+		dc_mutex_unlock (pool->mutex);
+
+		// Decode the samples into the cache, such that the callback
+		// only has to replay them. A failure is ignored here, and
+		// reported again when the callback asks for the samples.
+		dc_status_t rc = dc_parser_set_data (parser, pool->blobs[i].data, pool->blobs[i].size);
+		if (rc == DC_STATUS_SUCCESS) {
+			dc_parser_samples_walk (parser, NULL, NULL);
+		} else {
+			WARNING (parser->context, "Failed to assign the data of dive %u.", i);
+		}
+
+		// The parser is lent to the callback, and can't be re-used
+		// before the dive has been delivered.
+		dc_mutex_lock (pool->mutex);
+		pool->jobs[i].parser = parser;
+		pool->jobs[i].status = rc;
+		pool->jobs[i].done = 1;
+		dc_cond_broadcast (pool->cond);
+		while (!pool->stop && pool->delivered <= i)
+			dc_cond_wait (pool->cond, pool->mutex);
+	}
+	dc_mutex_unlock (pool->mutex);
+}
+
+
+dc_status_t
+dc_parser_parse_parallel (dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, const dc_parser_blob_t blobs[], unsigned int count, unsigned int nthreads, dc_parser_batch_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_worker_t *workers = NULL;
+	unsigned int nworkers = 0, nparsers = 0;
+	dc_parser_pool_t pool;
+
+	if (descriptor == NULL || (blobs == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	if (nthreads == 0)
+		nthreads = NWORKERS;
+	if (nthreads > count)
+		nthreads = count;
+
+	// Without any concurrency, the threads are pure overhead.
+	if (nthreads <= 1)
+		return dc_parser_parse_batch (context, descriptor, devtime, systime, blobs, count, callback, userdata);
+
+	pool.blobs = blobs;
+	pool.count = count;
+	pool.next = 0;
+	pool.delivered = 0;
+	pool.stop = 0;
+	pool.mutex = NULL;
+	pool.cond = NULL;
+
+	pool.jobs = (dc_parser_job_t *) dc_context_malloc (context, count * sizeof (dc_parser_job_t));
+	workers = (dc_parser_worker_t *) dc_context_malloc (context, nthreads * sizeof (dc_parser_worker_t));
+	if (pool.jobs == NULL || workers == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	memset (pool.jobs, 0, count * sizeof (dc_parser_job_t));
+	memset (workers, 0, nthreads * sizeof (dc_parser_worker_t));
+
+	// Every worker needs its own parser. They are created upfront, such
+	// that a failure is reported before anything is delivered.
+	for (nparsers = 0; nparsers < nthreads; ++nparsers) {
+		status = dc_parser_new2 (&workers[nparsers].parser, context, descriptor, devtime, systime);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to create the parser.");
+			goto error_free;
+		}
+
+		dc_parser_set_flags (workers[nparsers].parser, DC_PARSER_FLAG_CACHE);
+		workers[nparsers].pool = &pool;
+	}
+
+	status = dc_mutex_new (&pool.mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&pool.cond);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	while (nworkers < nthreads) {
+		status = dc_context_submit (context, &workers[nworkers].task, dc_parser_pool_worker, &workers[nworkers]);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+		nworkers++;
+	}
+
+	// Fall back to parsing on the calling thread.
+	if (nworkers == 0) {
+		WARNING (context, "Failed to start the worker threads.");
+		status = dc_parser_parse_batch (context, descriptor, devtime, systime, blobs, count, callback, userdata);
+		goto error_free;
+	}
+
+	status = DC_STATUS_SUCCESS;
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_parser_job_t *job = pool.jobs + i;
+
+		dc_mutex_lock (pool.mutex);
+		while (!job->done)
+			dc_cond_wait (pool.cond, pool.mutex);
+		dc_mutex_unlock (pool.mutex);
+
+		int more = callback == NULL || callback (job->parser, i, job->status, userdata);
+
+		// Return the parser to its worker.
+		dc_mutex_lock (pool.mutex);
+		pool.delivered = i + 1;
+		dc_cond_broadcast (pool.cond);
+		dc_mutex_unlock (pool.mutex);
+
+		if (!more)
+			break;
+	}
+
+	// Stop the workers.
+	dc_mutex_lock (pool.mutex);
+	pool.stop = 1;
+	dc_cond_broadcast (pool.cond);
+	dc_mutex_unlock (pool.mutex);
+
+	for (unsigned int i = 0; i < nworkers; ++i) {
+		dc_context_wait (context, workers[i].task);
+	}
+
+error_free:
+	for (unsigned int i = 0; i < nparsers; ++i) {
+		dc_parser_destroy (workers[i].parser);
+	}
+	dc_cond_free (pool.cond);
+	dc_mutex_free (pool.mutex);
+	dc_context_dealloc (context, workers);
+	dc_context_dealloc (context, pool.jobs);
+	return status;
+}
+
+
+void
+sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_statistics_t *statistics  = (sample_statistics_t *) userdata;
+
+	unsigned int time = statistics->divetime;
+	unsigned int dt = 0, bin = 0;
+	double rate = 0.0;
+
 	switch (type) {
 	case DC_SAMPLE_TIME:
 		statistics->divetime = value.time;
@@ -366,6 +2615,58 @@ sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *user
 	case DC_SAMPLE_DEPTH:
 		if (statistics->maxdepth < value.depth)
 			statistics->maxdepth = value.depth;
+
+		// Credit the time since the previous depth to that depth.
+		if (statistics->ndepth) {
+			if (time > statistics->depthtime)
+				dt = time - statistics->depthtime;
+			if (statistics->depth > 0.0)
+				bin = (unsigned int) statistics->depth;
+			if (bin >= STATISTICS_MAXDEPTH)
+				bin = STATISTICS_MAXDEPTH - 1;
+			statistics->histogram[bin] += dt;
+			statistics->depthsum += statistics->depth * dt;
+		} else {
+			statistics->anchortime = time;
+			statistics->anchordepth = value.depth;
+		}
+
+		// The vertical rates are measured over a minimum time
+		// window, to suppress the noise of the individual samples.
+		if (time >= statistics->anchortime + STATISTICS_WINDOW) {
+			rate = (value.depth - statistics->anchordepth) * 60.0 / (time - statistics->anchortime);
+			if (statistics->maxdescent < rate)
+				statistics->maxdescent = rate;
+			if (statistics->maxascent < -rate)
+				statistics->maxascent = -rate;
+			statistics->anchortime = time;
+			statistics->anchordepth = value.depth;
+		}
+
+		statistics->depth = value.depth;
+		statistics->depthtime = time;
+		statistics->ndepth++;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		statistics->temperaturesum += value.temperature;
+		statistics->ntemperature++;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (value.pressure.tank < STATISTICS_MAXTANKS) {
+			sample_statistics_tank_t *tank = statistics->tank + value.pressure.tank;
+			double depthsum = statistics->depthsum;
+			if (statistics->ndepth && time > statistics->depthtime)
+				depthsum += statistics->depth * (time - statistics->depthtime);
+			if (tank->count == 0) {
+				tank->tbegin = time;
+				tank->pbegin = value.pressure.value;
+				tank->dbegin = depthsum;
+			}
+			tank->tend = time;
+			tank->pend = value.pressure.value;
+			tank->dend = depthsum;
+			tank->count++;
+		}
 		break;
 	default:
 		break;
@@ -32,6 +32,16 @@ extern "C" {
 #define DC_PRINTF_SIZE "%zu"
 #endif
 
+// Force inlining of a function, for example to obtain specialized
+// copies of a function called with constant arguments.
+#if defined(__GNUC__)
+#define DC_ALWAYS_INLINE __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define DC_ALWAYS_INLINE __forceinline
+#else
+#define DC_ALWAYS_INLINE
+#endif
+
 #ifdef _MSC_VER
 #define snprintf _snprintf
 #define strcasecmp _stricmp
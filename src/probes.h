@@ -0,0 +1,45 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PROBES_H
+#define DC_PROBES_H
+
+/*
+ * Static tracepoints (USDT) for external tracing tools like bpftrace,
+ * perf or systemtap. The probes are only compiled in when configured
+ * with --enable-probes, and are a single nop instruction until a tool
+ * attaches to them. All probes are in the "libdivecomputer" provider.
+ */
+
+#ifdef ENABLE_PROBES
+#include <sys/sdt.h>
+#define PROBE1(name, a) DTRACE_PROBE1 (libdivecomputer, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2 (libdivecomputer, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3 (libdivecomputer, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4 (libdivecomputer, name, a, b, c, d)
+#else
+#define PROBE1(name, a)
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#define PROBE4(name, a, b, c, d)
+#endif
+
+#endif /* DC_PROBES_H */
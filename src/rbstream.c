@@ -25,6 +25,7 @@
 #include "rbstream.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "probes.h"
 
 struct dc_rbstream_t {
 	dc_device_t *device;
@@ -33,9 +34,19 @@ struct dc_rbstream_t {
 	unsigned int begin;
 	unsigned int end;
 	unsigned int address;
+	dc_rbstream_direction_t direction;
+	// Cached data that has not been returned yet. In the forward
+	// direction, it starts at the offset in the cache. In the backward
+	// direction, it always starts at the begin of the cache.
+	unsigned int offset;
 	unsigned int available;
 	unsigned int skip;
-	unsigned char cache[];
+	// Read-ahead window (in packets), and the number of bytes the caller
+	// still expects to read (if known).
+	unsigned int window;
+	unsigned int limited;
+	unsigned int remaining;
+	unsigned char *cache;
 };
 
 static unsigned int
@@ -53,7 +64,7 @@ iceil (unsigned int x, unsigned int n)
 }
 
 dc_status_t
-dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address)
+dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address, dc_rbstream_direction_t direction)
 {
 	dc_rbstream_t *rbstream = NULL;
 
@@ -84,21 +95,43 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	if (direction != DC_RBSTREAM_FORWARD && direction != DC_RBSTREAM_BACKWARD) {
+		ERROR (device->context, "Invalid stream direction!");
+		return DC_STATUS_INVALIDARGS;
+	}
+
 	// Allocate memory.
-	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream) + packetsize);
+	rbstream = (dc_rbstream_t *) dc_context_malloc (device->context, sizeof(*rbstream));
 	if (rbstream == NULL) {
 		ERROR (device->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	rbstream->cache = (unsigned char *) dc_context_malloc (device->context, packetsize);
+	if (rbstream->cache == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		dc_context_dealloc (device->context, rbstream);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	rbstream->device = device;
 	rbstream->pagesize = pagesize;
 	rbstream->packetsize = packetsize;
 	rbstream->begin = begin;
 	rbstream->end = end;
-	rbstream->address = iceil(address, pagesize);
+	rbstream->direction = direction;
+	if (direction == DC_RBSTREAM_FORWARD) {
+		rbstream->address = ifloor(address, pagesize);
+		rbstream->skip = address - rbstream->address;
+	} else {
+		rbstream->address = iceil(address, pagesize);
+		rbstream->skip = rbstream->address - address;
+	}
+	rbstream->offset = 0;
 	rbstream->available = 0;
-	rbstream->skip = rbstream->address - address;
+	rbstream->window = 1;
+	rbstream->limited = 0;
+	rbstream->remaining = 0;
 
 	*out = rbstream;
 
@@ -106,16 +139,48 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 }
 
 dc_status_t
-dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+dc_rbstream_set_prefetch (dc_rbstream_t *rbstream, unsigned int count, unsigned int total)
 {
-	dc_status_t rc = DC_STATUS_SUCCESS;
-
-	if (rbstream == NULL)
+	if (rbstream == NULL || count == 0)
 		return DC_STATUS_INVALIDARGS;
 
+	if (count != rbstream->window) {
+		// Move the cached data to the start of the cache, where it is
+		// preserved by the reallocation.
+		if (rbstream->offset) {
+			memmove (rbstream->cache, rbstream->cache + rbstream->offset, rbstream->available);
+			rbstream->offset = 0;
+		}
+
+		unsigned int size = count * rbstream->packetsize;
+		if (size < rbstream->available)
+			return DC_STATUS_INVALIDARGS;
+
+		unsigned char *cache = (unsigned char *) dc_context_realloc (rbstream->device->context, rbstream->cache, size);
+		if (cache == NULL) {
+			ERROR (rbstream->device->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		rbstream->cache = cache;
+		rbstream->window = count;
+	}
+
+	rbstream->limited = (total != 0);
+	rbstream->remaining = total;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_rbstream_read_backward (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
 	unsigned int address = rbstream->address;
 	unsigned int available = rbstream->available;
 	unsigned int skip = rbstream->skip;
+	unsigned int remaining = rbstream->remaining;
 
 	unsigned int nbytes = 0;
 	unsigned int offset = size;
@@ -125,16 +190,31 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 			if (address == rbstream->begin)
 				address = rbstream->end;
 
+			// Calculate the number of packets to read ahead. Without a
+			// hint, the entire window is used. Otherwise, the read-ahead
+			// is limited to the data that will actually be read.
+			unsigned int npackets = rbstream->window;
+			if (rbstream->limited) {
+				unsigned int wanted = remaining > size - nbytes ?
+					remaining : size - nbytes;
+				unsigned int n = iceil (wanted + skip, rbstream->packetsize) / rbstream->packetsize;
+				if (npackets > n)
+					npackets = n;
+			}
+
 			// Calculate the packet size.
-			unsigned int len = rbstream->packetsize;
+			unsigned int len = npackets * rbstream->packetsize;
 			if (rbstream->begin + len > address)
 				len = address - rbstream->begin;
 
 			// Move to the begin of the current packet.
 			address -= len;
 
-			// Read the packet into the cache.
-			rc = dc_device_read (rbstream->device, address, rbstream->cache, rbstream->packetsize);
+			// Read the packets into the cache. The read size is always
+			// rounded up to a whole number of packets.
+			PROBE3 (rbstream__refill__start, rbstream, address, len);
+			rc = dc_device_read (rbstream->device, address, rbstream->cache, iceil (len, rbstream->packetsize));
+			PROBE2 (rbstream__refill__done, rbstream, rc);
 			if (rc != DC_STATUS_SUCCESS)
 				return rc;
 
@@ -158,19 +238,117 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 		}
 
 		nbytes += length;
+		remaining = (remaining > length ? remaining - length : 0);
 	}
 
 	rbstream->address = address;
 	rbstream->available = available;
 	rbstream->skip = skip;
+	rbstream->remaining = remaining;
+
+	return rc;
+}
+
+static dc_status_t
+dc_rbstream_read_forward (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	unsigned int address = rbstream->address;
+	unsigned int offset = rbstream->offset;
+	unsigned int available = rbstream->available;
+	unsigned int skip = rbstream->skip;
+	unsigned int remaining = rbstream->remaining;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		if (available == 0) {
+			// Handle the ringbuffer wrap point.
+			if (address == rbstream->end)
+				address = rbstream->begin;
+
+			// Calculate the number of packets to read ahead. Without a
+			// hint, the entire window is used. Otherwise, the read-ahead
+			// is limited to the data that will actually be read.
+			unsigned int npackets = rbstream->window;
+			if (rbstream->limited) {
+				unsigned int wanted = remaining > size - nbytes ?
+					remaining : size - nbytes;
+				unsigned int n = iceil (wanted + skip, rbstream->packetsize) / rbstream->packetsize;
+				if (npackets > n)
+					npackets = n;
+			}
+
+			// Calculate the packet size. The read is truncated at the
+			// end of the ringbuffer, because the memory past the end is
+			// not necessarily valid.
+			unsigned int len = npackets * rbstream->packetsize;
+			if (address + len > rbstream->end)
+				len = rbstream->end - address;
+
+			// Read the packets into the cache.
+			PROBE3 (rbstream__refill__start, rbstream, address, len);
+			rc = dc_device_read (rbstream->device, address, rbstream->cache, len);
+			PROBE2 (rbstream__refill__done, rbstream, rc);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
+			// Move to the end of the current packet.
+			address += len;
+
+			offset = skip;
+			available = len - skip;
+			skip = 0;
+		}
+
+		unsigned int length = available;
+		if (nbytes + length > size)
+			length = size - nbytes;
+
+		memcpy (data + nbytes, rbstream->cache + offset, length);
+
+		offset += length;
+		available -= length;
+
+		// Update and emit a progress event.
+		if (progress) {
+			progress->current += length;
+			device_event_emit (rbstream->device, DC_EVENT_PROGRESS, progress);
+		}
+
+		nbytes += length;
+		remaining = (remaining > length ? remaining - length : 0);
+	}
+
+	rbstream->address = address;
+	rbstream->offset = offset;
+	rbstream->available = available;
+	rbstream->skip = skip;
+	rbstream->remaining = remaining;
 
 	return rc;
 }
 
+dc_status_t
+dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	if (rbstream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (rbstream->direction == DC_RBSTREAM_FORWARD)
+		return dc_rbstream_read_forward (rbstream, progress, data, size);
+	else
+		return dc_rbstream_read_backward (rbstream, progress, data, size);
+}
+
 dc_status_t
 dc_rbstream_free (dc_rbstream_t *rbstream)
 {
-	free (rbstream);
+	if (rbstream == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_context_dealloc (rbstream->device->context, rbstream->cache);
+	dc_context_dealloc (rbstream->device->context, rbstream);
 
 	return DC_STATUS_SUCCESS;
 }
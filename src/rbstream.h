@@ -33,6 +33,14 @@ extern "C" {
  */
 typedef struct dc_rbstream_t dc_rbstream_t;
 
+/**
+ * Ringbuffer stream direction.
+ */
+typedef enum dc_rbstream_direction_t {
+	DC_RBSTREAM_FORWARD,
+	DC_RBSTREAM_BACKWARD
+} dc_rbstream_direction_t;
+
 /**
  * Create a new ringbuffer stream.
  *
@@ -43,15 +51,41 @@ typedef struct dc_rbstream_t dc_rbstream_t;
  * @param[in]   begin       The ringbuffer begin address.
  * @param[in]   end         The ringbuffer end address.
  * @param[in]   address     The stream start address.
+ * @param[in]   direction   The stream direction.
  * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
  * on failure.
  */
 dc_status_t
-dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address);
+dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address, dc_rbstream_direction_t direction);
+
+/**
+ * Enable read-ahead on the ringbuffer stream.
+ *
+ * Each refill reads up to the specified number of packets with a single
+ * read request, instead of a single packet. If the total number of bytes
+ * the caller will read is known, the read-ahead is limited to that amount,
+ * to avoid transferring data that is never used.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  count     The size of the read-ahead window in packets.
+ * @param[in]  total     The total number of bytes that will be read, or
+ *                       zero if unknown.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_set_prefetch (dc_rbstream_t *rbstream, unsigned int count, unsigned int total);
 
 /**
  * Read data from the ringbuffer stream.
  *
+ * In the backward direction, the data ends at the current position of
+ * the stream, and the position moves towards the begin of the
+ * ringbuffer. In the forward direction, the data starts at the current
+ * position, and the position moves towards the end of the ringbuffer.
+ * In both cases, the data is returned in its natural (increasing
+ * address) order, and the ringbuffer wrap point is taken care of.
+ *
  * @param[in]  rbstream  A valid ringbuffer stream.
  * @param[in]  progress  An (optional) progress event structure.
  * @param[out] data      The memory buffer to read the data into.
@@ -24,6 +24,7 @@
 
 #include "reefnet_sensus.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -55,7 +56,9 @@ static const dc_device_vtable_t reefnet_sensus_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	reefnet_sensus_device_dump, /* dump */
+	NULL, /* dump_update */
 	reefnet_sensus_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	reefnet_sensus_device_close /* close */
 };
@@ -335,7 +338,7 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 reefnet_sensus_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
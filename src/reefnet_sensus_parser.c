@@ -40,8 +40,6 @@ struct reefnet_sensus_parser_t {
 	double atmospheric;
 	double hydrostatic;
 	// Clock synchronization.
-	unsigned int devtime;
-	dc_ticks_t systime;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int divetime;
@@ -82,8 +80,8 @@ reefnet_sensus_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 	// Set the default values.
 	parser->atmospheric = ATM;
 	parser->hydrostatic = 1025.0 * GRAVITY;
-	parser->devtime = devtime;
-	parser->systime = systime;
+	parser->base.devtime = devtime;
+	parser->base.systime = systime;
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
@@ -133,7 +131,7 @@ reefnet_sensus_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *dateti
 
 	unsigned int timestamp = array_uint32_le (abstract->data + 2);
 
-	dc_ticks_t ticks = parser->systime - (parser->devtime - timestamp);
+	dc_ticks_t ticks = parser->base.systime - (parser->base.devtime - timestamp);
 
 	if (!dc_datetime_localtime (datetime, ticks))
 		return DC_STATUS_DATAFORMAT;
@@ -38,6 +38,9 @@ reefnet_sensuspro_device_open (dc_device_t **device, dc_context_t *context, dc_i
 dc_status_t
 reefnet_sensuspro_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int devtime, dc_ticks_t systime);
 
+unsigned int
+reefnet_sensuspro_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -39,8 +39,6 @@ struct reefnet_sensuspro_parser_t {
 	double atmospheric;
 	double hydrostatic;
 	// Clock synchronization.
-	unsigned int devtime;
-	dc_ticks_t systime;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int divetime;
@@ -81,8 +79,8 @@ reefnet_sensuspro_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 	// Set the default values.
 	parser->atmospheric = ATM;
 	parser->hydrostatic = 1025.0 * GRAVITY;
-	parser->devtime = devtime;
-	parser->systime = systime;
+	parser->base.devtime = devtime;
+	parser->base.systime = systime;
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
@@ -93,6 +91,25 @@ reefnet_sensuspro_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 }
 
 
+unsigned int
+reefnet_sensuspro_parser_probe (const unsigned char data[], unsigned int size)
+{
+	static const unsigned char header[4] = {0x00, 0x00, 0x00, 0x00};
+	static const unsigned char footer[2] = {0xFF, 0xFF};
+
+	if (size < 12 ||
+		memcmp (data, header, sizeof (header)) != 0 ||
+		memcmp (data + size - sizeof (footer), footer, sizeof (footer)) != 0)
+		return 0;
+
+	// The samples are 2 bytes each.
+	if ((size - 12) % 2 == 0)
+		return 50;
+
+	return 20;
+}
+
+
 static dc_status_t
 reefnet_sensuspro_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
@@ -132,7 +149,7 @@ reefnet_sensuspro_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *dat
 
 	unsigned int timestamp = array_uint32_le (abstract->data + 6);
 
-	dc_ticks_t ticks = parser->systime - (parser->devtime - timestamp);
+	dc_ticks_t ticks = parser->base.systime - (parser->base.devtime - timestamp);
 
 	if (!dc_datetime_localtime (datetime, ticks))
 		return DC_STATUS_DATAFORMAT;
@@ -218,35 +235,25 @@ reefnet_sensuspro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callb
 			if (offset + 10 > size)
 				return DC_STATUS_DATAFORMAT;
 
-			unsigned int time = 0;
 			unsigned int interval = array_uint16_le (data + offset + 4);
 
 			offset += 10;
-			while (offset + sizeof (footer) <= size &&
-				memcmp (data + offset, footer, sizeof (footer)) != 0)
-			{
-				unsigned int value = array_uint16_le (data + offset);
-				unsigned int depth = (value & 0x01FF);
-				unsigned int temperature = (value & 0xFE00) >> 9;
-
-				dc_sample_value_t sample = {0};
 
-				// Time (seconds)
-				time += interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
-
-				// Temperature (°F)
-				sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+			// Count the samples up to the footer.
+			unsigned int count = 0;
+			while (offset + (count + 1) * 2 <= size &&
+				memcmp (data + offset + count * 2, footer, sizeof (footer)) != 0)
+			{
+				count++;
+			}
 
-				// Depth (absolute pressure in fsw)
-				sample.depth = (depth * FSW - parser->atmospheric) / parser->hydrostatic;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+			// Temperature (°F) in the upper 7 bits and depth (absolute
+			// pressure in fsw) in the lower 9 bits.
+			dc_sample_layout_t layout = {2, interval,
+				{0, 2, 0, 0x01FF, 0, FSW / parser->hydrostatic, -parser->atmospheric / parser->hydrostatic},
+				{0, 2, 0, 0xFE00, 9, 5.0 / 9.0, -32.0 * 5.0 / 9.0}};
 
-				offset += 2;
-			}
-			break;
+			return dc_parser_samples_fixed (abstract, &layout, data + offset, count, 0, callback, userdata);
 		} else {
 			offset++;
 		}
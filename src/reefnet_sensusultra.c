@@ -25,6 +25,7 @@
 
 #include "reefnet_sensusultra.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -33,6 +34,7 @@
 
 #define SZ_PACKET    512
 #define SZ_MEMORY    2080768
+#define SZ_WINDOW    (32 * SZ_PACKET)
 #define SZ_USER      16384
 #define SZ_HANDSHAKE 24
 #define SZ_SENSE     6
@@ -62,7 +64,9 @@ static const dc_device_vtable_t reefnet_sensusultra_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	reefnet_sensusultra_device_dump, /* dump */
+	NULL, /* dump_update */
 	reefnet_sensusultra_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -351,8 +355,9 @@ reefnet_sensusultra_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 {
 	reefnet_sensusultra_device_t *device = (reefnet_sensusultra_device_t*) abstract;
 
-	// Pre-allocate the required amount of memory.
-	if (!dc_buffer_reserve (buffer, SZ_MEMORY)) {
+	// Pre-allocate the required amount of memory. The packets are received
+	// in reverse order, so the buffer is filled from the end.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve_prepend (buffer, SZ_MEMORY)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -644,7 +649,11 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 {
 	reefnet_sensusultra_device_t *device = (reefnet_sensusultra_device_t*) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	// Only a sliding window of the memory is kept in the buffer. The data
+	// of the dives that are already passed to the application is discarded
+	// after each packet, so the buffer only needs to hold the dive that is
+	// currently being received.
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_WINDOW);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -707,6 +716,14 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 		if (aborted)
 			break;
 
+		// Discard the dives that are already processed. The parser never
+		// looks beyond the start of the previous dive again.
+		if (!dc_buffer_resize (buffer, previous)) {
+			dc_buffer_free (buffer);
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+
 		// Accept the packet.
 		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
 		if (rc != DC_STATUS_SUCCESS) {
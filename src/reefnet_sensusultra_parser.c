@@ -39,8 +39,6 @@ struct reefnet_sensusultra_parser_t {
 	double atmospheric;
 	double hydrostatic;
 	// Clock synchronization.
-	unsigned int devtime;
-	dc_ticks_t systime;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int divetime;
@@ -81,8 +79,8 @@ reefnet_sensusultra_parser_create (dc_parser_t **out, dc_context_t *context, uns
 	// Set the default values.
 	parser->atmospheric = ATM;
 	parser->hydrostatic = 1025.0 * GRAVITY;
-	parser->devtime = devtime;
-	parser->systime = systime;
+	parser->base.devtime = devtime;
+	parser->base.systime = systime;
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
@@ -93,6 +91,25 @@ reefnet_sensusultra_parser_create (dc_parser_t **out, dc_context_t *context, uns
 }
 
 
+unsigned int
+reefnet_sensusultra_parser_probe (const unsigned char data[], unsigned int size)
+{
+	static const unsigned char header[4] = {0x00, 0x00, 0x00, 0x00};
+	static const unsigned char footer[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+
+	if (size < 20 ||
+		memcmp (data, header, sizeof (header)) != 0 ||
+		memcmp (data + size - sizeof (footer), footer, sizeof (footer)) != 0)
+		return 0;
+
+	// The samples are 4 bytes each.
+	if ((size - 20) % 4 == 0)
+		return 60;
+
+	return 20;
+}
+
+
 static dc_status_t
 reefnet_sensusultra_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
@@ -132,7 +149,7 @@ reefnet_sensusultra_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *d
 
 	unsigned int timestamp = array_uint32_le (abstract->data + 4);
 
-	dc_ticks_t ticks = parser->systime - (parser->devtime - timestamp);
+	dc_ticks_t ticks = parser->base.systime - (parser->base.devtime - timestamp);
 
 	if (!dc_datetime_localtime (datetime, ticks))
 		return DC_STATUS_DATAFORMAT;
@@ -219,33 +236,25 @@ reefnet_sensusultra_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 			if (offset + 16 > size)
 				return DC_STATUS_DATAFORMAT;
 
-			unsigned int time = 0;
 			unsigned int interval = array_uint16_le (data + offset + 8);
 
 			offset += 16;
-			while (offset + sizeof (footer) <= size &&
-				memcmp (data + offset, footer, sizeof (footer)) != 0)
-			{
-				dc_sample_value_t sample = {0};
-
-				// Time (seconds)
-				time += interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-				// Temperature (0.01 °K)
-				unsigned int temperature = array_uint16_le (data + offset);
-				sample.temperature = temperature / 100.0 - 273.15;
-				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+			// Count the samples up to the footer.
+			unsigned int count = 0;
+			while (offset + (count + 1) * 4 <= size &&
+				memcmp (data + offset + count * 4, footer, sizeof (footer)) != 0)
+			{
+				count++;
+			}
 
-				// Depth (absolute pressure in millibar)
-				unsigned int depth = array_uint16_le (data + offset + 2);
-				sample.depth = (depth * BAR / 1000.0 - parser->atmospheric) / parser->hydrostatic;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+			// Temperature (0.01 °K) and depth (absolute pressure in
+			// millibar), with a sample every interval seconds.
+			dc_sample_layout_t layout = {4, interval,
+				{2, 2, 0, 0xFFFF, 0, BAR / 1000.0 / parser->hydrostatic, -parser->atmospheric / parser->hydrostatic},
+				{0, 2, 0, 0xFFFF, 0, 1.0 / 100.0, -273.15}};
 
-				offset += 4;
-			}
-			break;
+			return dc_parser_samples_fixed (abstract, &layout, data + offset, count, 0, callback, userdata);
 		} else {
 			offset++;
 		}
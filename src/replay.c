@@ -0,0 +1,807 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>  // fopen, fread, fwrite, fclose
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcmp, memcpy
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#include <windows.h>
+#else
+#include <time.h>   // nanosleep
+#include <errno.h>
+#endif
+
+#include <libdivecomputer/replay.h>
+#include <libdivecomputer/ioctl.h>
+#include <libdivecomputer/buffer.h>
+
+#include "iostream-private.h"
+#include "common-private.h"
+#include "context-private.h"
+#include "buffer-private.h"
+#include "array.h"
+#include "timer.h"
+#include "platform.h"
+
+/*
+ * File format:
+ *
+ * The file starts with a 12 byte header, containing the magic bytes,
+ * the format version and the transport type. Each operation is stored
+ * as a 14 byte record header, followed by a variable sized payload:
+ *
+ *   type    1 byte   operation (see the REC_* constants)
+ *   status  1 byte   return value (dc_status_t, signed)
+ *   delay   4 bytes  time since the previous operation, in microseconds
+ *   value   4 bytes  operation specific parameter or result
+ *   size    4 bytes  size of the payload
+ *
+ * All multibyte values are little endian.
+ */
+
+#define MAGIC      "DCIO"
+#define FORMAT     1
+#define SZ_HEADER  12
+#define SZ_RECORD  14
+
+#define REC_SET_TIMEOUT   0x01 // value = timeout
+#define REC_SET_BREAK     0x02 // value = level
+#define REC_SET_DTR       0x03 // value = level
+#define REC_SET_RTS       0x04 // value = level
+#define REC_GET_LINES     0x05 // value = lines
+#define REC_GET_AVAILABLE 0x06 // value = available bytes
+#define REC_CONFIGURE     0x07 // payload = 5 x 4 bytes settings
+#define REC_POLL          0x08 // value = timeout
+#define REC_READ          0x09 // value = requested size, payload = data
+#define REC_WRITE         0x0A // value = actual size, payload = data
+#define REC_IOCTL         0x0B // value = request, payload = data
+#define REC_FLUSH         0x0C
+#define REC_PURGE         0x0D // value = direction
+#define REC_SLEEP         0x0E // value = milliseconds
+#define REC_CLOSE         0x0F
+
+static dc_status_t dc_record_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_record_set_break (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_record_set_dtr (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_record_set_rts (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_record_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_record_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_record_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_record_poll (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_record_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_record_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_record_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size_t size);
+static dc_status_t dc_record_flush (dc_iostream_t *abstract);
+static dc_status_t dc_record_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_record_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_record_interrupt (dc_iostream_t *abstract);
+static dc_status_t dc_record_close (dc_iostream_t *abstract);
+
+static dc_status_t dc_replay_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_replay_set_break (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_set_dtr (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_set_rts (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_replay_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_replay_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_replay_poll (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_replay_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_replay_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_replay_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size_t size);
+static dc_status_t dc_replay_flush (dc_iostream_t *abstract);
+static dc_status_t dc_replay_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_replay_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_replay_close (dc_iostream_t *abstract);
+
+typedef struct dc_record_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_iostream_t *iostream;
+	FILE *fp;
+	dc_timer_t *timer;
+	dc_usecs_t timestamp;
+} dc_record_t;
+
+typedef struct dc_replay_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_buffer_t *buffer;
+	const unsigned char *data;
+	size_t size;
+	size_t offset;
+	unsigned int realtime;
+	dc_timer_t *timer;
+	dc_usecs_t timestamp;
+} dc_replay_t;
+
+typedef struct dc_replay_record_t {
+	unsigned int type;
+	dc_status_t status;
+	unsigned int delay;
+	unsigned int value;
+	const unsigned char *data;
+	unsigned int size;
+} dc_replay_record_t;
+
+static const dc_iostream_vtable_t dc_record_vtable = {
+	sizeof(dc_record_t),
+	dc_record_set_timeout, /* set_timeout */
+	dc_record_set_break, /* set_break */
+	dc_record_set_dtr, /* set_dtr */
+	dc_record_set_rts, /* set_rts */
+	dc_record_get_lines, /* get_lines */
+	dc_record_get_available, /* get_available */
+	dc_record_configure, /* configure */
+	dc_record_poll, /* poll */
+	dc_record_read, /* read */
+	dc_record_write, /* write */
+	NULL, /* writev */
+	dc_record_ioctl, /* ioctl */
+	dc_record_flush, /* flush */
+	dc_record_purge, /* purge */
+	dc_record_sleep, /* sleep */
+	dc_record_interrupt, /* interrupt */
+	dc_record_close, /* close */
+};
+
+static const dc_iostream_vtable_t dc_replay_vtable = {
+	sizeof(dc_replay_t),
+	dc_replay_set_timeout, /* set_timeout */
+	dc_replay_set_break, /* set_break */
+	dc_replay_set_dtr, /* set_dtr */
+	dc_replay_set_rts, /* set_rts */
+	dc_replay_get_lines, /* get_lines */
+	dc_replay_get_available, /* get_available */
+	dc_replay_configure, /* configure */
+	dc_replay_poll, /* poll */
+	dc_replay_read, /* read */
+	dc_replay_write, /* write */
+	NULL, /* writev */
+	dc_replay_ioctl, /* ioctl */
+	dc_replay_flush, /* flush */
+	dc_replay_purge, /* purge */
+	dc_replay_sleep, /* sleep */
+	NULL, /* interrupt */
+	dc_replay_close, /* close */
+};
+
+dc_status_t
+dc_record_open (dc_iostream_t **out, dc_context_t *context, dc_iostream_t *base, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_record_t *record = NULL;
+
+	if (out == NULL || base == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Record: file=%s", filename);
+
+	// Allocate memory.
+	record = (dc_record_t *) dc_iostream_allocate (context, &dc_record_vtable, dc_iostream_get_transport (base));
+	if (record == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	record->iostream = base;
+	record->fp = NULL;
+	record->timer = NULL;
+	record->timestamp = 0;
+
+	status = dc_timer_new (&record->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	record->fp = fopen (filename, "wb");
+	if (record->fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_timer_free;
+	}
+
+	// Write the file header.
+	unsigned char header[SZ_HEADER] = {0};
+	memcpy (header, MAGIC, 4);
+	array_uint32_le_set (header + 4, FORMAT);
+	array_uint32_le_set (header + 8, dc_iostream_get_transport (base));
+	if (fwrite (header, sizeof (header), 1, record->fp) != 1) {
+		ERROR (context, "Failed to write the file header.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	*out = (dc_iostream_t *) record;
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	fclose (record->fp);
+error_timer_free:
+	dc_timer_free (record->timer);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) record);
+	return status;
+}
+
+static dc_status_t
+dc_record_log (dc_record_t *record, unsigned int type, dc_status_t status, unsigned int value, const void *data, size_t size)
+{
+	dc_usecs_t now = 0;
+	dc_timer_now (record->timer, &now);
+
+	dc_usecs_t delay = now - record->timestamp;
+	if (delay > 0xFFFFFFFF)
+		delay = 0xFFFFFFFF;
+	record->timestamp = now;
+
+	unsigned char header[SZ_RECORD] = {0};
+	header[0] = type;
+	header[1] = (signed char) status;
+	array_uint32_le_set (header + 2, delay);
+	array_uint32_le_set (header + 6, value);
+	array_uint32_le_set (header + 10, size);
+
+	if (fwrite (header, sizeof (header), 1, record->fp) != 1 ||
+		(size && fwrite (data, size, 1, record->fp) != 1)) {
+		ERROR (record->base.context, "Failed to write the record.");
+		return DC_STATUS_IO;
+	}
+
+	return status;
+}
+
+static dc_status_t
+dc_record_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_timeout (record->iostream, timeout);
+
+	return dc_record_log (record, REC_SET_TIMEOUT, status, timeout, NULL, 0);
+}
+
+static dc_status_t
+dc_record_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_break (record->iostream, value);
+
+	return dc_record_log (record, REC_SET_BREAK, status, value, NULL, 0);
+}
+
+static dc_status_t
+dc_record_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_dtr (record->iostream, value);
+
+	return dc_record_log (record, REC_SET_DTR, status, value, NULL, 0);
+}
+
+static dc_status_t
+dc_record_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_set_rts (record->iostream, value);
+
+	return dc_record_log (record, REC_SET_RTS, status, value, NULL, 0);
+}
+
+static dc_status_t
+dc_record_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_get_lines (record->iostream, value);
+
+	return dc_record_log (record, REC_GET_LINES, status, *value, NULL, 0);
+}
+
+static dc_status_t
+dc_record_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_get_available (record->iostream, value);
+
+	return dc_record_log (record, REC_GET_AVAILABLE, status, *value, NULL, 0);
+}
+
+static dc_status_t
+dc_record_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_configure (record->iostream, baudrate, databits, parity, stopbits, flowcontrol);
+
+	unsigned char settings[5 * 4] = {0};
+	array_uint32_le_set (settings +  0, baudrate);
+	array_uint32_le_set (settings +  4, databits);
+	array_uint32_le_set (settings +  8, parity);
+	array_uint32_le_set (settings + 12, stopbits);
+	array_uint32_le_set (settings + 16, flowcontrol);
+
+	return dc_record_log (record, REC_CONFIGURE, status, 0, settings, sizeof (settings));
+}
+
+static dc_status_t
+dc_record_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_poll (record->iostream, timeout);
+
+	return dc_record_log (record, REC_POLL, status, timeout, NULL, 0);
+}
+
+static dc_status_t
+dc_record_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_read (record->iostream, data, size, actual);
+
+	return dc_record_log (record, REC_READ, status, size, data, *actual);
+}
+
+static dc_status_t
+dc_record_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_write (record->iostream, data, size, actual);
+
+	return dc_record_log (record, REC_WRITE, status, *actual, data, size);
+}
+
+static dc_status_t
+dc_record_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size_t size)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_ioctl (record->iostream, request, data, size);
+
+	return dc_record_log (record, REC_IOCTL, status, request, data, size);
+}
+
+static dc_status_t
+dc_record_flush (dc_iostream_t *abstract)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_flush (record->iostream);
+
+	return dc_record_log (record, REC_FLUSH, status, 0, NULL, 0);
+}
+
+static dc_status_t
+dc_record_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_purge (record->iostream, direction);
+
+	return dc_record_log (record, REC_PURGE, status, direction, NULL, 0);
+}
+
+static dc_status_t
+dc_record_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t status = dc_iostream_sleep (record->iostream, milliseconds);
+
+	return dc_record_log (record, REC_SLEEP, status, milliseconds, NULL, 0);
+}
+
+static dc_status_t
+dc_record_interrupt (dc_iostream_t *abstract)
+{
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	// Not recorded, because it can be called from another thread. The
+	// cancelled operation itself is recorded with its status.
+	return dc_iostream_interrupt (record->iostream);
+}
+
+static dc_status_t
+dc_record_close (dc_iostream_t *abstract)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_record_t *record = (dc_record_t *) abstract;
+
+	dc_status_t rc = dc_iostream_close (record->iostream);
+
+	status = dc_record_log (record, REC_CLOSE, rc, 0, NULL, 0);
+
+	if (fclose (record->fp) != 0) {
+		ERROR (abstract->context, "Failed to close the file.");
+		if (status == DC_STATUS_SUCCESS)
+			status = DC_STATUS_IO;
+	}
+
+	dc_timer_free (record->timer);
+
+	return status;
+}
+
+dc_status_t
+dc_replay_open (dc_iostream_t **out, dc_context_t *context, const char *filename, unsigned int realtime)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_replay_t *replay = NULL;
+	dc_buffer_t *buffer = NULL;
+	FILE *fp = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Replay: file=%s, realtime=%u", filename, realtime);
+
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	buffer = dc_buffer_allocate (context, 0);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_fclose;
+	}
+
+	// Load the entire file in memory.
+	size_t n = 0;
+	unsigned char block[4096];
+	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (buffer, block, n)) {
+			ERROR (context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_buffer_free;
+		}
+	}
+
+	if (ferror (fp)) {
+		ERROR (context, "Failed to read the file.");
+		status = DC_STATUS_IO;
+		goto error_buffer_free;
+	}
+
+	const unsigned char *data = dc_buffer_get_data (buffer);
+	size_t size = dc_buffer_get_size (buffer);
+	if (size < SZ_HEADER || memcmp (data, MAGIC, 4) != 0 ||
+		array_uint32_le (data + 4) != FORMAT) {
+		ERROR (context, "Unexpected file header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_buffer_free;
+	}
+
+	// Allocate memory.
+	replay = (dc_replay_t *) dc_iostream_allocate (context, &dc_replay_vtable, array_uint32_le (data + 8));
+	if (replay == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_buffer_free;
+	}
+
+	replay->buffer = buffer;
+	replay->data = data;
+	replay->size = size;
+	replay->offset = SZ_HEADER;
+	replay->realtime = realtime;
+	replay->timer = NULL;
+	replay->timestamp = 0;
+
+	status = dc_timer_new (&replay->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	fclose (fp);
+
+	*out = (dc_iostream_t *) replay;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) replay);
+error_buffer_free:
+	dc_buffer_free (buffer);
+error_fclose:
+	fclose (fp);
+	return status;
+}
+
+static void
+dc_replay_wait (dc_replay_t *replay, unsigned int delay)
+{
+	dc_usecs_t now = 0;
+	dc_timer_now (replay->timer, &now);
+
+	if (now - replay->timestamp < delay) {
+		dc_usecs_t remaining = delay - (now - replay->timestamp);
+#ifdef _WIN32
+		Sleep ((DWORD) ((remaining + 999) / 1000));
+#else
+		struct timespec ts;
+		ts.tv_sec  = (remaining / 1000000);
+		ts.tv_nsec = (remaining % 1000000) * 1000;
+		while (nanosleep (&ts, &ts) != 0) {
+			if (errno != EINTR)
+				break;
+		}
+#endif
+		dc_timer_now (replay->timer, &now);
+	}
+
+	replay->timestamp = now;
+}
+
+static dc_status_t
+dc_replay_next (dc_replay_t *replay, unsigned int type, dc_replay_record_t *record)
+{
+	if (replay->offset + SZ_RECORD > replay->size) {
+		ERROR (replay->base.context, "Unexpected end of the recording.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	const unsigned char *p = replay->data + replay->offset;
+	unsigned int size = array_uint32_le (p + 10);
+	if (size > replay->size - replay->offset - SZ_RECORD) {
+		ERROR (replay->base.context, "Unexpected end of the recording.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	if (p[0] != type) {
+		ERROR (replay->base.context, "Unexpected operation (%02x, expected %02x) at offset " DC_PRINTF_SIZE ".",
+			p[0], type, replay->offset);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	record->type = p[0];
+	record->status = (signed char) p[1];
+	record->delay = array_uint32_le (p + 2);
+	record->value = array_uint32_le (p + 6);
+	record->data = p + SZ_RECORD;
+	record->size = size;
+
+	replay->offset += SZ_RECORD + size;
+
+	if (replay->realtime)
+		dc_replay_wait (replay, record->delay);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_simple (dc_iostream_t *abstract, unsigned int type, unsigned int value)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, type, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (record.value != value) {
+		WARNING (abstract->context, "Unexpected parameter (%u, expected %u).",
+			value, record.value);
+	}
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	return dc_replay_simple (abstract, REC_SET_TIMEOUT, timeout);
+}
+
+static dc_status_t
+dc_replay_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_SET_BREAK, value);
+}
+
+static dc_status_t
+dc_replay_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_SET_DTR, value);
+}
+
+static dc_status_t
+dc_replay_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	return dc_replay_simple (abstract, REC_SET_RTS, value);
+}
+
+static dc_status_t
+dc_replay_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, REC_GET_LINES, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	*value = record.value;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, REC_GET_AVAILABLE, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	*value = record.value;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, REC_CONFIGURE, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (record.size != 5 * 4 ||
+		array_uint32_le (record.data +  0) != baudrate ||
+		array_uint32_le (record.data +  4) != databits ||
+		array_uint32_le (record.data +  8) != (unsigned int) parity ||
+		array_uint32_le (record.data + 12) != (unsigned int) stopbits ||
+		array_uint32_le (record.data + 16) != (unsigned int) flowcontrol) {
+		WARNING (abstract->context, "Unexpected line settings.");
+	}
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_poll (dc_iostream_t *abstract, int timeout)
+{
+	return dc_replay_simple (abstract, REC_POLL, timeout);
+}
+
+static dc_status_t
+dc_replay_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, REC_READ, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (record.size > size) {
+		ERROR (abstract->context, "Unexpected read size (" DC_PRINTF_SIZE ", expected %u).",
+			size, record.value);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	memcpy (data, record.data, record.size);
+	*actual = record.size;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, REC_WRITE, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (record.size != size || memcmp (record.data, data, size) != 0) {
+		WARNING (abstract->context, "Unexpected write data.");
+	}
+
+	*actual = record.value <= size ? record.value : size;
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size_t size)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	dc_replay_record_t record;
+
+	dc_status_t rc = dc_replay_next (replay, REC_IOCTL, &record);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (record.value != request || record.size != size) {
+		ERROR (abstract->context, "Unexpected ioctl request (%08x, expected %08x).",
+			request, record.value);
+		return DC_STATUS_PROTOCOL;
+	}
+
+	if (DC_IOCTL_DIR (request) & DC_IOCTL_DIR_READ) {
+		memcpy (data, record.data, size);
+	}
+
+	return record.status;
+}
+
+static dc_status_t
+dc_replay_flush (dc_iostream_t *abstract)
+{
+	return dc_replay_simple (abstract, REC_FLUSH, 0);
+}
+
+static dc_status_t
+dc_replay_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	return dc_replay_simple (abstract, REC_PURGE, direction);
+}
+
+static dc_status_t
+dc_replay_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	// The recorded delay already includes the time spent sleeping.
+	return dc_replay_simple (abstract, REC_SLEEP, milliseconds);
+}
+
+static dc_status_t
+dc_replay_close (dc_iostream_t *abstract)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	// A recording of an aborted session has no close record.
+	if (replay->offset < replay->size)
+		status = dc_replay_simple (abstract, REC_CLOSE, 0);
+
+	dc_timer_free (replay->timer);
+	dc_buffer_free (replay->buffer);
+
+	return status;
+}
@@ -19,6 +19,7 @@
  * MA 02110-1301 USA
  */
 
+#include <string.h>
 #include <assert.h>
 
 #include "ringbuffer.h"
@@ -100,3 +101,98 @@ ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, un
 
 	return decrement (a - begin, delta, end - begin) + begin;
 }
+
+
+// All ones if the condition is true, zero otherwise.
+#define MASK(cond) (0U - (unsigned int) (cond))
+
+void
+dc_ringbuffer_init (dc_ringbuffer_t *ringbuffer, unsigned int begin, unsigned int end)
+{
+	assert (end > begin);
+
+	ringbuffer->begin = begin;
+	ringbuffer->end = end;
+	ringbuffer->size = end - begin;
+}
+
+
+unsigned int
+dc_ringbuffer_distance (const dc_ringbuffer_t *ringbuffer, unsigned int a, unsigned int b, int mode)
+{
+	assert (a >= ringbuffer->begin && a <= ringbuffer->end);
+	assert (b >= ringbuffer->begin && b <= ringbuffer->end);
+
+	// Map the end address to the begin address.
+	a -= ringbuffer->size & MASK (a == ringbuffer->end);
+	b -= ringbuffer->size & MASK (b == ringbuffer->end);
+
+	return b - a + (ringbuffer->size & MASK (a > b || (a == b && mode != 0)));
+}
+
+
+unsigned int
+dc_ringbuffer_increment (const dc_ringbuffer_t *ringbuffer, unsigned int a, unsigned int delta)
+{
+	assert (a >= ringbuffer->begin && a <= ringbuffer->end);
+	assert (delta <= ringbuffer->size);
+
+	a -= ringbuffer->size & MASK (a == ringbuffer->end);
+
+	unsigned int result = a + delta;
+	return result - (ringbuffer->size & MASK (result >= ringbuffer->end));
+}
+
+
+unsigned int
+dc_ringbuffer_decrement (const dc_ringbuffer_t *ringbuffer, unsigned int a, unsigned int delta)
+{
+	assert (a >= ringbuffer->begin && a <= ringbuffer->end);
+	assert (delta <= ringbuffer->size);
+
+	a -= ringbuffer->size & MASK (a == ringbuffer->end);
+
+	return a - delta + (ringbuffer->size & MASK (a - ringbuffer->begin < delta));
+}
+
+
+unsigned int
+dc_ringbuffer_spans (const dc_ringbuffer_t *ringbuffer, unsigned int address, unsigned int length, dc_ringbuffer_span_t span[2])
+{
+	assert (address >= ringbuffer->begin && address <= ringbuffer->end);
+	assert (length <= ringbuffer->size);
+
+	if (length == 0)
+		return 0;
+
+	// Map the end address to the begin address.
+	address -= ringbuffer->size & MASK (address == ringbuffer->end);
+
+	unsigned int available = ringbuffer->end - address;
+	if (length <= available) {
+		span[0].address = address;
+		span[0].length = length;
+		return 1;
+	}
+
+	span[0].address = address;
+	span[0].length = available;
+	span[1].address = ringbuffer->begin;
+	span[1].length = length - available;
+
+	return 2;
+}
+
+
+void
+dc_ringbuffer_copy (const dc_ringbuffer_t *ringbuffer, unsigned char output[], const unsigned char memory[], unsigned int address, unsigned int length)
+{
+	dc_ringbuffer_span_t span[2];
+
+	unsigned int offset = 0;
+	unsigned int count = dc_ringbuffer_spans (ringbuffer, address, length, span);
+	for (unsigned int i = 0; i < count; ++i) {
+		memcpy (output + offset, memory + span[i].address, span[i].length);
+		offset += span[i].length;
+	}
+}
@@ -38,6 +38,55 @@ ringbuffer_increment (unsigned int a, unsigned int delta, unsigned int begin, un
 unsigned int
 ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, unsigned int end);
 
+/*
+ * Ringbuffer view.
+ *
+ * A view stores the boundaries of a ringbuffer once, instead of passing
+ * them with every call. All addresses must be in the range [begin,end],
+ * where the end address is equivalent with the begin address, and all
+ * offsets should not exceed the size of the ringbuffer. With those
+ * restrictions, the arithmetic doesn't need any division or branches.
+ */
+
+typedef struct dc_ringbuffer_t {
+	unsigned int begin;
+	unsigned int end;
+	unsigned int size;
+} dc_ringbuffer_t;
+
+typedef struct dc_ringbuffer_span_t {
+	unsigned int address;
+	unsigned int length;
+} dc_ringbuffer_span_t;
+
+void
+dc_ringbuffer_init (dc_ringbuffer_t *ringbuffer, unsigned int begin, unsigned int end);
+
+unsigned int
+dc_ringbuffer_distance (const dc_ringbuffer_t *ringbuffer, unsigned int a, unsigned int b, int mode);
+
+unsigned int
+dc_ringbuffer_increment (const dc_ringbuffer_t *ringbuffer, unsigned int a, unsigned int delta);
+
+unsigned int
+dc_ringbuffer_decrement (const dc_ringbuffer_t *ringbuffer, unsigned int a, unsigned int delta);
+
+/*
+ * Split the range of the specified length, starting at the specified
+ * address, into at most two contiguous spans. The second span, if any,
+ * always starts at the begin of the ringbuffer. Returns the number of
+ * spans.
+ */
+unsigned int
+dc_ringbuffer_spans (const dc_ringbuffer_t *ringbuffer, unsigned int address, unsigned int length, dc_ringbuffer_span_t span[2]);
+
+/*
+ * Copy the range of the specified length, starting at the specified
+ * address, from a memory image into a contiguous buffer.
+ */
+void
+dc_ringbuffer_copy (const dc_ringbuffer_t *ringbuffer, unsigned char output[], const unsigned char memory[], unsigned int address, unsigned int length);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -24,12 +24,13 @@
 #endif
 
 #include <stdlib.h> // malloc, free
-#include <string.h>	// strerror
+#include <string.h>	// strerror, memcpy
 #include <errno.h>	// errno
 #include <unistd.h>	// open, close, read, write
 #include <fcntl.h>	// fcntl
 #include <termios.h>	// tcgetattr, tcsetattr, cfsetispeed, cfsetospeed, tcflush, tcsendbreak
 #include <sys/ioctl.h>	// ioctl
+#include <sys/uio.h>	// writev
 #include <time.h>	// nanosleep
 #ifdef HAVE_LINUX_SERIAL_H
 #include <linux/serial.h>
@@ -41,6 +42,7 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#include <limits.h>	// PATH_MAX
 
 #ifndef TIOCINQ
 #define TIOCINQ FIONREAD
@@ -63,6 +65,14 @@
 
 #define DIRNAME "/dev"
 
+// The lowest latency timer value of FTDI adapters, in milliseconds,
+// that is still reliable.
+#define FTDI_LATENCY 1
+
+// Size of the read-ahead buffer. Reads of at least this size bypass
+// the buffer and go directly into the caller's buffer.
+#define RBUFSIZE 256
+
 static dc_status_t dc_serial_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_serial_iterator_free (dc_iterator_t *iterator);
 
@@ -76,11 +86,14 @@ static dc_status_t dc_serial_configure (dc_iostream_t *iostream, unsigned int ba
 static dc_status_t dc_serial_poll (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_serial_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 static dc_status_t dc_serial_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], unsigned int count, size_t *actual);
 static dc_status_t dc_serial_ioctl (dc_iostream_t *iostream, unsigned int request, void *data, size_t size);
 static dc_status_t dc_serial_flush (dc_iostream_t *iostream);
 static dc_status_t dc_serial_purge (dc_iostream_t *iostream, dc_direction_t direction);
 static dc_status_t dc_serial_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
+static dc_status_t dc_serial_interrupt (dc_iostream_t *iostream);
 static dc_status_t dc_serial_close (dc_iostream_t *iostream);
+static dc_status_t dc_serial_set_low_latency (dc_iostream_t *iostream, unsigned int value);
 
 struct dc_serial_device_t {
 	char name[256];
@@ -100,12 +113,33 @@ typedef struct dc_serial_t {
 	int fd;
 	int timeout;
 	dc_timer_t *timer;
+	/*
+	 * Self-pipe to wake up a blocking operation from another thread.
+	 */
+	int wakeup[2];
 	/*
 	 * Serial port settings are saved into this variable immediately
 	 * after the port is opened. These settings are restored when the
 	 * serial port is closed.
 	 */
 	struct termios tty;
+	/*
+	 * Read-ahead buffer, with data that has already been received from
+	 * the kernel, but not yet returned to the caller.
+	 */
+	unsigned char rbuf[RBUFSIZE];
+	size_t roffset;
+	size_t rcount;
+	/*
+	 * Low latency mode. The original settings are saved when the mode
+	 * is enabled, and restored when it is disabled again or when the
+	 * serial port is closed. The latency timer is -1 if the adapter
+	 * doesn't have one, or if it couldn't be changed.
+	 */
+	unsigned int lowlatency;
+	unsigned int lowlatency_flag;
+	int latency_timer;
+	char latency_path[PATH_MAX];
 } dc_serial_t;
 
 static const dc_iterator_vtable_t dc_serial_iterator_vtable = {
@@ -126,10 +160,12 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_poll, /* poll */
 	dc_serial_read, /* read */
 	dc_serial_write, /* write */
+	dc_serial_writev, /* writev */
 	dc_serial_ioctl, /* ioctl */
 	dc_serial_flush, /* flush */
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
+	dc_serial_interrupt, /* interrupt */
 	dc_serial_close, /* close */
 };
 
@@ -281,6 +317,12 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 
 	// Default to blocking reads.
 	device->timeout = -1;
+	device->roffset = 0;
+	device->rcount = 0;
+	device->lowlatency = 0;
+	device->lowlatency_flag = 0;
+	device->latency_timer = -1;
+	device->latency_path[0] = '\0';
 
 	// Create a high resolution timer.
 	status = dc_timer_new (&device->timer);
@@ -299,13 +341,32 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		goto error_timer_free;
 	}
 
+	// Create the wakeup pipe.
+	if (pipe (device->wakeup) != 0) {
+		int errcode = errno;
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_close;
+	}
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		int flags = fcntl (device->wakeup[i], F_GETFL);
+		if (flags == -1 || fcntl (device->wakeup[i], F_SETFL, flags | O_NONBLOCK) != 0 ||
+			fcntl (device->wakeup[i], F_SETFD, FD_CLOEXEC) != 0) {
+			int errcode = errno;
+			SYSERROR (context, errcode);
+			status = syserror (errcode);
+			goto error_pipe_close;
+		}
+	}
+
 #ifndef ENABLE_PTY
 	// Enable exclusive access mode.
 	if (ioctl (device->fd, TIOCEXCL, NULL) != 0) {
 		int errcode = errno;
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_close;
+		goto error_pipe_close;
 	}
 #endif
 
@@ -317,13 +378,16 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		int errcode = errno;
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_close;
+		goto error_pipe_close;
 	}
 
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
+error_pipe_close:
+	close (device->wakeup[0]);
+	close (device->wakeup[1]);
 error_close:
 	close (device->fd);
 error_timer_free:
@@ -339,6 +403,9 @@ dc_serial_close (dc_iostream_t *abstract)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	// Restore the original latency settings.
+	dc_status_set_error(&status, dc_serial_set_low_latency (abstract, 0));
+
 	// Restore the initial terminal attributes.
 	if (tcsetattr (device->fd, TCSANOW, &device->tty) != 0) {
 		int errcode = errno;
@@ -362,6 +429,9 @@ dc_serial_close (dc_iostream_t *abstract)
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
+	close (device->wakeup[0]);
+	close (device->wakeup[1]);
+
 	dc_timer_free (device->timer);
 
 	return status;
@@ -665,16 +735,170 @@ dc_serial_set_latency (dc_iostream_t *abstract, unsigned int milliseconds)
 	return DC_STATUS_SUCCESS;
 }
 
+#ifdef __linux__
+/*
+ * Locate the latency timer in sysfs. Only the FTDI driver provides one.
+ * The CP210x and PL2303 adapters don't have a configurable latency.
+ */
+static int
+dc_serial_latency_path (dc_serial_t *device, char *path, size_t size)
+{
+	char link[PATH_MAX], name[PATH_MAX], driver[PATH_MAX];
+
+	// Resolve the tty name from the file descriptor, which also works
+	// for symlinks (e.g. /dev/serial/by-id).
+	snprintf (link, sizeof (link), "/proc/self/fd/%d", device->fd);
+	ssize_t n = readlink (link, name, sizeof (name) - 1);
+	if (n <= 0)
+		return 0;
+	name[n] = '\0';
+
+	const char *tty = strrchr (name, '/');
+	tty = tty ? tty + 1 : name;
+
+	if (snprintf (link, sizeof (link), "/sys/class/tty/%s/device/driver", tty) >= (int) sizeof (link))
+		return 0;
+	n = readlink (link, driver, sizeof (driver) - 1);
+	if (n <= 0)
+		return 0;
+	driver[n] = '\0';
+
+	const char *module = strrchr (driver, '/');
+	module = module ? module + 1 : driver;
+
+	INFO (device->base.context, "Adapter: tty=%s, driver=%s", tty, module);
+
+	if (strcmp (module, "ftdi_sio") != 0)
+		return 0;
+
+	if (snprintf (path, size, "/sys/class/tty/%s/device/latency_timer", tty) >= (int) size)
+		return 0;
+
+	return 1;
+}
+
+static int
+dc_serial_latency_timer (const char *path, int value)
+{
+	FILE *fp = fopen (path, value < 0 ? "r" : "w");
+	if (fp == NULL)
+		return -1;
+
+	int rc = 0;
+	if (value < 0) {
+		if (fscanf (fp, "%d", &rc) != 1)
+			rc = -1;
+	} else {
+		if (fprintf (fp, "%d", value) < 0)
+			rc = -1;
+	}
+
+	if (fclose (fp) != 0)
+		rc = -1;
+
+	return rc;
+}
+#endif
+
+static dc_status_t
+dc_serial_set_low_latency (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (!value == !device->lowlatency)
+		return DC_STATUS_SUCCESS;
+
+#if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && !defined(__ANDROID__)
+	struct serial_struct ss;
+	if (ioctl (device->fd, TIOCGSERIAL, &ss) != 0 && NOPTY) {
+		int errcode = errno;
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
+
+	// Save or restore the low latency flag.
+	if (value) {
+		device->lowlatency_flag = (ss.flags & ASYNC_LOW_LATENCY) != 0;
+		ss.flags |= ASYNC_LOW_LATENCY;
+	} else if (!device->lowlatency_flag) {
+		ss.flags &= ~ASYNC_LOW_LATENCY;
+	}
+
+	if (ioctl (device->fd, TIOCSSERIAL, &ss) != 0 && NOPTY) {
+		int errcode = errno;
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
+#elif defined(IOSSDATALAT)
+	// The lowest receive latency, or the default value.
+	unsigned long usec = (value ? 1 : 0);
+	if (ioctl (device->fd, IOSSDATALAT, &usec) != 0 && NOPTY) {
+		int errcode = errno;
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
+#endif
+
+#ifdef __linux__
+	// Writing to sysfs usually requires extra permissions. The low
+	// latency flag is still useful without it, so a failure here is
+	// only reported as a warning.
+	if (value) {
+		device->latency_timer = -1;
+		if (dc_serial_latency_path (device, device->latency_path, sizeof (device->latency_path))) {
+			int timer = dc_serial_latency_timer (device->latency_path, -1);
+			if (timer > FTDI_LATENCY) {
+				if (dc_serial_latency_timer (device->latency_path, FTDI_LATENCY) == 0) {
+					device->latency_timer = timer;
+				} else {
+					WARNING (abstract->context, "Failed to change the latency timer (%d ms).", timer);
+				}
+			}
+		}
+	} else if (device->latency_timer >= 0) {
+		if (dc_serial_latency_timer (device->latency_path, device->latency_timer) != 0) {
+			WARNING (abstract->context, "Failed to restore the latency timer (%d ms).", device->latency_timer);
+		}
+		device->latency_timer = -1;
+	}
+#endif
+
+	device->lowlatency = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_serial_nfds (dc_serial_t *device)
+{
+	return (device->fd > device->wakeup[0] ? device->fd : device->wakeup[0]) + 1;
+}
+
+static dc_status_t
+dc_serial_interrupted (dc_serial_t *device)
+{
+	// Drain the wakeup pipe.
+	char buffer[16];
+	while (read (device->wakeup[0], buffer, sizeof (buffer)) > 0)
+		;
+
+	return DC_STATUS_CANCELLED;
+}
+
 static dc_status_t
 dc_serial_poll (dc_iostream_t *abstract, int timeout)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	int rc = 0;
 
+	if (device->rcount)
+		return DC_STATUS_SUCCESS;
+
+	fd_set fds;
 	do {
-		fd_set fds;
 		FD_ZERO (&fds);
 		FD_SET (device->fd, &fds);
+		FD_SET (device->wakeup[0], &fds);
 
 		struct timeval tv, *ptv = NULL;
 		if (timeout > 0) {
@@ -687,7 +911,7 @@ dc_serial_poll (dc_iostream_t *abstract, int timeout)
 			ptv = &tv;
 		}
 
-		rc = select (device->fd + 1, &fds, NULL, NULL, ptv);
+		rc = select (dc_serial_nfds (device), &fds, NULL, NULL, ptv);
 	} while (rc < 0 && errno == EINTR);
 
 	if (rc < 0) {
@@ -696,6 +920,8 @@ dc_serial_poll (dc_iostream_t *abstract, int timeout)
 		return syserror (errcode);
 	} else if (rc == 0) {
 		return DC_STATUS_TIMEOUT;
+	} else if (FD_ISSET (device->wakeup[0], &fds)) {
+		return dc_serial_interrupted (device);
 	} else {
 		return DC_STATUS_SUCCESS;
 	}
@@ -708,14 +934,56 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	size_t nbytes = 0;
 
+	// Serve as much as possible from the read-ahead buffer.
+	if (device->rcount) {
+		size_t n = device->rcount < size ? device->rcount : size;
+		memcpy (data, device->rbuf + device->roffset, n);
+		device->roffset += n;
+		device->rcount -= n;
+		nbytes += n;
+	}
+
 	// The absolute target time.
 	dc_usecs_t target = 0;
 
 	int init = 1;
 	while (nbytes < size) {
+		// The descriptor is non-blocking, so try to read before waiting.
+		// Small reads drain everything the kernel has available into the
+		// read-ahead buffer, such that the next reads need no syscall.
+		size_t remaining = size - nbytes;
+		ssize_t n = 0;
+		if (remaining < RBUFSIZE) {
+			n = read (device->fd, device->rbuf, RBUFSIZE);
+			if (n > 0) {
+				size_t count = (size_t) n < remaining ? (size_t) n : remaining;
+				memcpy ((char *) data + nbytes, device->rbuf, count);
+				device->roffset = count;
+				device->rcount = n - count;
+				n = count;
+			}
+		} else {
+			n = read (device->fd, (char *) data + nbytes, remaining);
+		}
+
+		if (n > 0) {
+			nbytes += n;
+			continue;
+		} else if (n == 0) {
+			break; // EOF.
+		} else {
+			int errcode = errno;
+			if (errcode != EINTR && errcode != EAGAIN) {
+				SYSERROR (abstract->context, errcode);
+				status = syserror (errcode);
+				goto out;
+			}
+		}
+
 		fd_set fds;
 		FD_ZERO (&fds);
 		FD_SET (device->fd, &fds);
+		FD_SET (device->wakeup[0], &fds);
 
 		struct timeval tv, *ptv = NULL;
 		if (device->timeout > 0) {
@@ -750,7 +1018,7 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			ptv = &tv;
 		}
 
-		int rc = select (device->fd + 1, &fds, NULL, NULL, ptv);
+		int rc = select (dc_serial_nfds (device), &fds, NULL, NULL, ptv);
 		if (rc < 0) {
 			int errcode = errno;
 			if (errcode == EINTR)
@@ -760,21 +1028,10 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			goto out;
 		} else if (rc == 0) {
 			break; // Timeout.
-		}
-
-		ssize_t n = read (device->fd, (char *) data + nbytes, size - nbytes);
-		if (n < 0) {
-			int errcode = errno;
-			if (errcode == EINTR || errcode == EAGAIN)
-				continue; // Retry.
-			SYSERROR (abstract->context, errcode);
-			status = syserror (errcode);
+		} else if (FD_ISSET (device->wakeup[0], &fds)) {
+			status = dc_serial_interrupted (device);
 			goto out;
-		} else if (n == 0) {
-			 break; // EOF.
 		}
-
-		nbytes += n;
 	}
 
 	if (nbytes != size) {
@@ -788,6 +1045,25 @@ out:
 	return status;
 }
 
+static dc_status_t
+dc_serial_drain (dc_serial_t *device)
+{
+#ifdef __ANDROID__
+	/* Android is missing tcdrain, so use ioctl version instead */
+	while (ioctl (device->fd, TCSBRK, 1) != 0) {
+#else
+	while (tcdrain (device->fd) != 0) {
+#endif
+		int errcode = errno;
+		if (errcode != EINTR ) {
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
 {
@@ -796,11 +1072,13 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	size_t nbytes = 0;
 
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (device->fd, &fds);
+		fd_set rfds, wfds;
+		FD_ZERO (&rfds);
+		FD_SET (device->wakeup[0], &rfds);
+		FD_ZERO (&wfds);
+		FD_SET (device->fd, &wfds);
 
-		int rc = select (device->fd + 1, NULL, &fds, NULL, NULL);
+		int rc = select (dc_serial_nfds (device), &rfds, &wfds, NULL, NULL);
 		if (rc < 0) {
 			int errcode = errno;
 			if (errcode == EINTR)
@@ -810,6 +1088,9 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 			goto out;
 		} else if (rc == 0) {
 			break; // Timeout.
+		} else if (FD_ISSET (device->wakeup[0], &rfds)) {
+			status = dc_serial_interrupted (device);
+			goto out;
 		}
 
 		ssize_t n = write (device->fd, (const char *) data + nbytes, size - nbytes);
@@ -828,20 +1109,98 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	}
 
 	// Wait until all data has been transmitted.
-#ifdef __ANDROID__
-	/* Android is missing tcdrain, so use ioctl version instead */
-	while (ioctl (device->fd, TCSBRK, 1) != 0) {
-#else
-	while (tcdrain (device->fd) != 0) {
-#endif
-		int errcode = errno;
-		if (errcode != EINTR ) {
+	status = dc_serial_drain (device);
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], unsigned int count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_t *device = (dc_serial_t *) abstract;
+	struct iovec vec[16];
+	size_t nbytes = 0;
+
+	// Current position in the memory buffers.
+	unsigned int index = 0;
+	size_t offset = 0;
+
+	while (index < count) {
+		if (offset == iov[index].size) {
+			index++;
+			offset = 0;
+			continue;
+		}
+
+		fd_set rfds, wfds;
+		FD_ZERO (&rfds);
+		FD_SET (device->wakeup[0], &rfds);
+		FD_ZERO (&wfds);
+		FD_SET (device->fd, &wfds);
+
+		int rc = select (dc_serial_nfds (device), &rfds, &wfds, NULL, NULL);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
 			SYSERROR (abstract->context, errcode);
 			status = syserror (errcode);
 			goto out;
+		} else if (rc == 0) {
+			break; // Timeout.
+		} else if (FD_ISSET (device->wakeup[0], &rfds)) {
+			status = dc_serial_interrupted (device);
+			goto out;
+		}
+
+		// Gather the remaining data, starting at the current position.
+		int n = 0;
+		vec[n].iov_base = (char *) iov[index].data + offset;
+		vec[n].iov_len = iov[index].size - offset;
+		n++;
+		for (unsigned int i = index + 1; i < count && n < (int) (sizeof (vec) / sizeof (vec[0])); ++i) {
+			vec[n].iov_base = (void *) iov[i].data;
+			vec[n].iov_len = iov[i].size;
+			n++;
+		}
+
+		ssize_t len = writev (device->fd, vec, n);
+		if (len < 0) {
+			int errcode = errno;
+			if (errcode == EINTR || errcode == EAGAIN)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+			goto out;
+		} else if (len == 0) {
+			 break; // EOF.
+		}
+
+		nbytes += len;
+
+		// Advance the current position.
+		size_t remaining = len;
+		while (remaining) {
+			size_t available = iov[index].size - offset;
+			if (remaining < available) {
+				offset += remaining;
+				remaining = 0;
+			} else {
+				remaining -= available;
+				index++;
+				offset = 0;
+			}
 		}
 	}
 
+	// Wait until all data has been transmitted.
+	status = dc_serial_drain (device);
+
 out:
 	if (actual)
 		*actual = nbytes;
@@ -855,6 +1214,8 @@ dc_serial_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size
 	switch (request) {
 	case DC_IOCTL_SERIAL_SET_LATENCY:
 		return dc_serial_set_latency (abstract, *(unsigned int *) data);
+	case DC_IOCTL_SERIAL_SET_LOW_LATENCY:
+		return dc_serial_set_low_latency (abstract, *(unsigned int *) data);
 	default:
 		return DC_STATUS_UNSUPPORTED;
 	}
@@ -881,6 +1242,12 @@ dc_serial_purge (dc_iostream_t *abstract, dc_direction_t direction)
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	// Discard the buffered input as well.
+	if (direction & DC_DIRECTION_INPUT) {
+		device->roffset = 0;
+		device->rcount = 0;
+	}
+
 	if (tcflush (device->fd, flags) != 0) {
 		int errcode = errno;
 		SYSERROR (abstract->context, errcode);
@@ -959,7 +1326,7 @@ dc_serial_get_available (dc_iostream_t *abstract, size_t *value)
 	}
 
 	if (value)
-		*value = bytes;
+		*value = bytes + device->rcount;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -992,6 +1359,21 @@ dc_serial_get_lines (dc_iostream_t *abstract, unsigned int *value)
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+dc_serial_interrupt (dc_iostream_t *abstract)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	// Only a single byte is needed. If the pipe is already full, a
+	// wakeup is pending anyway.
+	ssize_t n = 0;
+	do {
+		n = write (device->wakeup[1], "", 1);
+	} while (n < 0 && errno == EINTR);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_sleep (dc_iostream_t *abstract, unsigned int timeout)
 {
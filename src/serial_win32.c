@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #define WIN32_LEAN_AND_MEAN
 #define NOGDI
@@ -33,6 +34,10 @@
 #include "iterator-private.h"
 #include "descriptor-private.h"
 
+// Size of the read-ahead buffer. Reads of at least this size bypass
+// the buffer and go directly into the caller's buffer.
+#define RBUFSIZE 256
+
 static dc_status_t dc_serial_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_serial_iterator_free (dc_iterator_t *iterator);
 
@@ -82,6 +87,13 @@ typedef struct dc_serial_t {
 	OVERLAPPED overlapped;
 	DWORD events;
 	BOOL pending;
+	/*
+	 * Read-ahead buffer, with data that has already been received from
+	 * the driver, but not yet returned to the caller.
+	 */
+	unsigned char rbuf[RBUFSIZE];
+	size_t roffset;
+	size_t rcount;
 } dc_serial_t;
 
 static const dc_iterator_vtable_t dc_serial_iterator_vtable = {
@@ -102,10 +114,12 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_poll, /* poll */
 	dc_serial_read, /* read */
 	dc_serial_write, /* write */
+	NULL, /* writev */
 	dc_serial_ioctl, /* ioctl */
 	dc_serial_flush, /* flush */
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
+	NULL, /* interrupt */
 	dc_serial_close, /* close */
 };
 
@@ -294,6 +308,8 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 	memset(&device->overlapped, 0, sizeof(device->overlapped));
 	device->events = 0;
 	device->pending = FALSE;
+	device->roffset = 0;
+	device->rcount = 0;
 
 	// Create a manual reset event for I/O.
 	device->hReadWrite = CreateEvent (NULL, TRUE, FALSE, NULL);
@@ -550,6 +566,9 @@ dc_serial_poll (dc_iostream_t *abstract, int timeout)
 {
 	dc_serial_t *device = (dc_serial_t *) abstract;
 
+	if (device->rcount)
+		return DC_STATUS_SUCCESS;
+
 	while (1) {
 		COMSTAT stats;
 		if (!ClearCommError (device->hFile, NULL, &stats)) {
@@ -604,38 +623,88 @@ dc_serial_poll (dc_iostream_t *abstract, int timeout)
 }
 
 static dc_status_t
-dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+dc_serial_readfile (dc_serial_t *device, void *data, DWORD size, DWORD *actual)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_serial_t *device = (dc_serial_t *) abstract;
-	DWORD dwRead = 0;
+	dc_iostream_t *abstract = (dc_iostream_t *) device;
 
 	OVERLAPPED overlapped = {0};
 	overlapped.hEvent = device->hReadWrite;
 
+	*actual = 0;
+
 	if (!ReadFile (device->hFile, data, size, NULL, &overlapped)) {
 		DWORD errcode = GetLastError ();
 		if (errcode != ERROR_IO_PENDING) {
 			SYSERROR (abstract->context, errcode);
-			status = syserror (errcode);
-			goto out;
+			return syserror (errcode);
 		}
 	}
 
-	if (!GetOverlappedResult (device->hFile, &overlapped, &dwRead, TRUE)) {
+	if (!GetOverlappedResult (device->hFile, &overlapped, actual, TRUE)) {
 		DWORD errcode = GetLastError ();
 		SYSERROR (abstract->context, errcode);
-		status = syserror (errcode);
+		return syserror (errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_t *device = (dc_serial_t *) abstract;
+	size_t nbytes = 0;
+	DWORD dwRead = 0;
+
+	// Serve as much as possible from the read-ahead buffer.
+	if (device->rcount) {
+		size_t n = device->rcount < size ? device->rcount : size;
+		memcpy (data, device->rbuf + device->roffset, n);
+		device->roffset += n;
+		device->rcount -= n;
+		nbytes += n;
+	}
+
+	if (nbytes == size)
 		goto out;
+
+	// Small reads drain everything the driver has already received into
+	// the read-ahead buffer, such that the next reads need no system
+	// call. Such a read completes immediately, without waiting for the
+	// timeout.
+	size_t remaining = size - nbytes;
+	if (remaining < RBUFSIZE) {
+		COMSTAT stats;
+		if (ClearCommError (device->hFile, NULL, &stats) && stats.cbInQue > remaining) {
+			DWORD count = stats.cbInQue < RBUFSIZE ? stats.cbInQue : RBUFSIZE;
+			status = dc_serial_readfile (device, device->rbuf, count, &dwRead);
+			if (status != DC_STATUS_SUCCESS)
+				goto out;
+
+			size_t n = dwRead < remaining ? dwRead : remaining;
+			memcpy ((char *) data + nbytes, device->rbuf, n);
+			device->roffset = n;
+			device->rcount = dwRead - n;
+			nbytes += n;
+		}
 	}
 
-	if (dwRead != size) {
-		status = DC_STATUS_TIMEOUT;
+	// Wait for the remaining data, with the configured timeout.
+	if (nbytes < size) {
+		status = dc_serial_readfile (device, (char *) data + nbytes, size - nbytes, &dwRead);
+		if (status != DC_STATUS_SUCCESS)
+			goto out;
+
+		nbytes += dwRead;
+		if (nbytes != size) {
+			status = DC_STATUS_TIMEOUT;
+		}
 	}
 
 out:
 	if (actual)
-		*actual = dwRead;
+		*actual = nbytes;
 
 	return status;
 }
@@ -683,6 +752,10 @@ dc_serial_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size
 	switch (request) {
 	case DC_IOCTL_SERIAL_SET_LATENCY:
 		return DC_STATUS_SUCCESS;
+	case DC_IOCTL_SERIAL_SET_LOW_LATENCY:
+		// The FTDI latency timer is only configurable through the
+		// registry, and requires administrator rights and a replug.
+		return DC_STATUS_UNSUPPORTED;
 	default:
 		return DC_STATUS_UNSUPPORTED;
 	}
@@ -709,6 +782,12 @@ dc_serial_purge (dc_iostream_t *abstract, dc_direction_t direction)
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	// Discard the buffered input as well.
+	if (direction & DC_DIRECTION_INPUT) {
+		device->roffset = 0;
+		device->rcount = 0;
+	}
+
 	if (!PurgeComm (device->hFile, flags)) {
 		DWORD errcode = GetLastError ();
 		SYSERROR (abstract->context, errcode);
@@ -800,7 +879,7 @@ dc_serial_get_available (dc_iostream_t *abstract, size_t *value)
 	}
 
 	if (value)
-		*value = stats.cbInQue;
+		*value = stats.cbInQue + device->rcount;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -42,6 +42,7 @@ shearwater_common_setup (shearwater_common_device_t *device, dc_context_t *conte
 	dc_status_t status = DC_STATUS_SUCCESS;
 
 	device->iostream = iostream;
+	device->roffset = device->rsize = 0;
 
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
@@ -60,6 +61,7 @@ shearwater_common_setup (shearwater_common_device_t *device, dc_context_t *conte
 	// Make sure everything is in a sane state.
 	dc_iostream_sleep (device->iostream, 300);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+	device->roffset = device->rsize = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -112,11 +114,13 @@ shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buf
 
 
 static int
-shearwater_common_decompress_xor (unsigned char *data, unsigned int size)
+shearwater_common_decompress_xor (unsigned char *data, unsigned int offset, unsigned int size)
 {
 	// Each block of 32 bytes is XOR'ed (in-place) with the previous block,
-	// except for the first block, which is passed through unchanged.
-	for (unsigned int i = 32; i < size; ++i) {
+	// except for the first block, which is passed through unchanged. The
+	// bytes before the offset are already decompressed, which allows to
+	// decompress the data incrementally, as it arrives.
+	for (unsigned int i = (offset > 32 ? offset : 32); i < size; ++i) {
 		data[i] ^= data[i - 32];
 	}
 
@@ -128,9 +132,13 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_transport_t transport = dc_iostream_get_transport(device->iostream);
-	unsigned char buffer[32];
+	unsigned char buffer[2 * (SZ_PACKET + 4) + 1];
 	unsigned int nbytes = 0;
 
+	// BLE packets are limited to 32 bytes. Other transports receive the
+	// entire SLIP frame with a single write.
+	size_t framesize = (transport == DC_TRANSPORT_BLE) ? 32 : sizeof(buffer);
+
 	if (transport == DC_TRANSPORT_BLE) {
 		// Calculate the total number of bytes.
 		unsigned int count = 1;
@@ -144,7 +152,7 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 		}
 
 		// Calculate the total number of frames.
-		unsigned int nframes = (count + sizeof(buffer) - 1) / sizeof(buffer);
+		unsigned int nframes = (count + framesize - 1) / framesize;
 
 		buffer[0] = nframes;
 		buffer[1] = 0;
@@ -159,7 +167,7 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 			buffer[nbytes++] = ESC;
 
 			// Flush the buffer if necessary.
-			if (nbytes >= sizeof(buffer)) {
+			if (nbytes >= framesize) {
 				status = dc_iostream_write (device->iostream, buffer, nbytes, NULL);
 				if (status != DC_STATUS_SUCCESS) {
 					ERROR (device->base.context, "Failed to send the packet.");
@@ -186,7 +194,7 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 		buffer[nbytes++] = c;
 
 		// Flush the buffer if necessary.
-		if (nbytes >= sizeof(buffer)) {
+		if (nbytes >= framesize) {
 			status = dc_iostream_write (device->iostream, buffer, nbytes, NULL);
 			if (status != DC_STATUS_SUCCESS) {
 				ERROR (device->base.context, "Failed to send the packet.");
@@ -216,42 +224,82 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 }
 
 
+/*
+ * Length of the run of ordinary bytes (not END or ESC) at the start of
+ * the data.
+ */
+static size_t
+shearwater_common_slip_span (const unsigned char data[], size_t size)
+{
+	size_t n = 0;
+	while (n < size && data[n] != END && data[n] != ESC)
+		n++;
+	return n;
+}
+
+
 static dc_status_t
 shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char data[], unsigned int size, unsigned int *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_transport_t transport = dc_iostream_get_transport(device->iostream);
-	unsigned char buffer[256];
+	unsigned char *buffer = device->rbuffer;
 	unsigned int escaped = 0;
 	unsigned int nbytes = 0;
 
-	// Get the packet size.
-	size_t packetsize = (transport == DC_TRANSPORT_BLE) ? sizeof(buffer) : 1;
-
 	// Read bytes until a complete packet has been received. If the
 	// buffer runs out of space, bytes are dropped. The caller can
 	// detect this condition because the return value will be larger
 	// than the supplied buffer size.
 	while (1) {
-		size_t transferred = 0;
-		status = dc_iostream_read (device->iostream, buffer, packetsize, &transferred);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (device->base.context, "Failed to receive the packet.");
-			return status;
-		}
+		if (device->roffset >= device->rsize) {
+			// Get the packet size. BLE packets are always read as a whole.
+			// For the other transports, read everything that is already
+			// available, but never block for more than a single byte.
+			size_t packetsize = sizeof(device->rbuffer);
+			if (transport != DC_TRANSPORT_BLE) {
+				size_t available = 0;
+				status = dc_iostream_get_available (device->iostream, &available);
+				if (status != DC_STATUS_SUCCESS || available == 0)
+					packetsize = 1;
+				else if (available < packetsize)
+					packetsize = available;
+			}
 
-		size_t offset = 0;
-		if (transport == DC_TRANSPORT_BLE) {
-			if (transferred < 2) {
-				ERROR (device->base.context, "Invalid packet length (" DC_PRINTF_SIZE ").", transferred);
-				return DC_STATUS_PROTOCOL;
+			size_t transferred = 0;
+			status = dc_iostream_read (device->iostream, buffer, packetsize, &transferred);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (device->base.context, "Failed to receive the packet.");
+				return status;
 			}
 
-			offset = 2;
+			size_t offset = 0;
+			if (transport == DC_TRANSPORT_BLE) {
+				if (transferred < 2) {
+					ERROR (device->base.context, "Invalid packet length (" DC_PRINTF_SIZE ").", transferred);
+					return DC_STATUS_PROTOCOL;
+				}
+
+				offset = 2;
+			}
+
+			device->roffset = offset;
+			device->rsize = transferred;
 		}
 
-		for (size_t i = offset; i < transferred; ++i) {
-			unsigned char c = buffer[i];
+		while (device->roffset < device->rsize) {
+			if (!escaped) {
+				// Copy the ordinary bytes in bulk.
+				size_t n = shearwater_common_slip_span (buffer + device->roffset, device->rsize - device->roffset);
+				if (nbytes < size)
+					memcpy (data + nbytes, buffer + device->roffset, (n < size - nbytes) ? n : size - nbytes);
+				nbytes += n;
+				device->roffset += n;
+				if (device->roffset >= device->rsize)
+					break;
+			}
+
+			unsigned char c = buffer[device->roffset++];
 
 			if (c == END || c == ESC) {
 				if (escaped) {
@@ -268,6 +316,10 @@ shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char d
 					// packets generated by the duplicate END characters which
 					// are sent to try to detect line noise.
 					if (nbytes) {
+						// The remainder of a BLE packet is discarded, while
+						// the next frame on a byte stream is kept.
+						if (transport == DC_TRANSPORT_BLE)
+							device->roffset = device->rsize;
 						goto done;
 					}
 				} else {
@@ -313,12 +365,12 @@ done:
 	if (actual)
 		*actual = nbytes;
 
-	return status;
+	return DC_STATUS_SUCCESS;
 }
 
 
-dc_status_t
-shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+static dc_status_t
+shearwater_common_packet (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -379,6 +431,17 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_trace_span_t span;
+	TRACE_BEGIN (device->base.context, &span, isize ? input[0] : 0, isize, osize);
+	dc_status_t status = shearwater_common_packet (device, input, isize, output, osize, actual);
+	TRACE_END (device->base.context, &span, status);
+
+	return status;
+}
+
 
 dc_status_t
 shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress)
@@ -402,8 +465,9 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 	unsigned char req_quit[] = {0x37};
 	unsigned char response[SZ_PACKET];
 
-	// Erase the current contents of the buffer.
-	if (!dc_buffer_clear (buffer)) {
+	// Erase the current contents of the buffer, and reserve space for
+	// the expected amount of data.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve (buffer, size)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -437,6 +501,7 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 	unsigned int done = 0;
 	unsigned char block = 1;
 	unsigned int nbytes = 0;
+	unsigned int decoded = 0;
 	while (nbytes < size && !done) {
 		// Transfer the block request.
 		req_block[1] = block;
@@ -470,6 +535,20 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 				ERROR (abstract->context, "Decompression error (LRE phase).");
 				return DC_STATUS_PROTOCOL;
 			}
+
+			// Undo the XOR phase for the newly decompressed data, while
+			// the next block is still in transit.
+			unsigned int total = dc_buffer_get_size (buffer);
+			if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), decoded, total) != 0) {
+				ERROR (abstract->context, "Decompression error (XOR phase).");
+				return DC_STATUS_PROTOCOL;
+			}
+			decoded = total;
+
+			// Only the dives are compressed. Pass the decoded
+			// part of the dive to the application.
+			dc_event_partial_t partial = {dc_buffer_get_data (buffer), decoded};
+			device_event_emit (abstract, DC_EVENT_PARTIAL, &partial);
 		} else {
 			if (!dc_buffer_append (buffer, response + 2, length)) {
 				ERROR (abstract->context, "Insufficient buffer space available.");
@@ -481,13 +560,6 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		block++;
 	}
 
-	if (compression) {
-		if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer)) != 0) {
-			ERROR (abstract->context, "Decompression error (XOR phase).");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
 	// Transfer the quit request.
 	rc = shearwater_common_transfer (device, req_quit, sizeof (req_quit), response, 2, &n);
 	if (rc != DC_STATUS_SUCCESS) {
@@ -50,6 +50,8 @@ extern "C" {
 typedef struct shearwater_common_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	unsigned char rbuffer[256];
+	unsigned int roffset, rsize;
 } shearwater_common_device_t;
 
 dc_status_t
@@ -25,6 +25,7 @@
 #include "shearwater_petrel.h"
 #include "shearwater_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "platform.h"
 #include "array.h"
@@ -42,6 +43,9 @@
 typedef struct shearwater_petrel_device_t {
 	shearwater_common_device_t base;
 	unsigned char fingerprint[4];
+	dc_buffer_t *manifests;
+	unsigned int base_addr;
+	unsigned int cached;
 } shearwater_petrel_device_t;
 
 static dc_status_t shearwater_petrel_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -55,7 +59,9 @@ static const dc_device_vtable_t shearwater_petrel_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	shearwater_petrel_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	shearwater_petrel_device_close /* close */
 };
@@ -94,17 +100,29 @@ shearwater_petrel_device_open (dc_device_t **out, dc_context_t *context, dc_iost
 
 	// Set the default values.
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
+	device->base_addr = 0;
+	device->cached = 0;
+
+	// Allocate the buffer for the manifests.
+	device->manifests = dc_buffer_allocate (context, MANIFEST_SIZE);
+	if (device->manifests == NULL) {
+		ERROR (context, "Insufficient buffer space available.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
 
 	// Setup the device.
 	status = shearwater_common_setup (&device->base, context, iostream);
 	if (status != DC_STATUS_SUCCESS) {
-		goto error_free;
+		goto error_free_manifests;
 	}
 
 	*out = (dc_device_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
+error_free_manifests:
+	dc_buffer_free (device->manifests);
 error_free:
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
@@ -115,16 +133,18 @@ static dc_status_t
 shearwater_petrel_device_close (dc_device_t *abstract)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	shearwater_common_device_t *device = (shearwater_common_device_t *) abstract;
+	shearwater_petrel_device_t *device = (shearwater_petrel_device_t *) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	// Shutdown the device.
 	unsigned char request[] = {0x2E, 0x90, 0x20, 0x00};
-	rc = shearwater_common_transfer (device, request, sizeof (request), NULL, 0, NULL);
+	rc = shearwater_common_transfer (&device->base, request, sizeof (request), NULL, 0, NULL);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_status_set_error(&status, rc);
 	}
 
+	dc_buffer_free (device->manifests);
+
 	return status;
 }
 
@@ -142,37 +162,23 @@ shearwater_petrel_device_set_fingerprint (dc_device_t *abstract, const unsigned
 	else
 		memset (device->fingerprint, 0, sizeof (device->fingerprint));
 
+	// The cached manifest depends on the fingerprint.
+	device->cached = 0;
+
 	return DC_STATUS_SUCCESS;
 }
 
 
 static dc_status_t
-shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
+shearwater_petrel_device_identify (shearwater_petrel_device_t *device, dc_buffer_t *buffer)
 {
-	shearwater_petrel_device_t *device = (shearwater_petrel_device_t *) abstract;
+	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
-	// Allocate memory buffers for the manifests.
-	dc_buffer_t *buffer = dc_buffer_new (MANIFEST_SIZE);
-	dc_buffer_t *manifests = dc_buffer_new (MANIFEST_SIZE);
-	if (buffer == NULL || manifests == NULL) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return DC_STATUS_NOMEMORY;
-	}
-
-	// Enable progress notifications.
-	unsigned int current = 0, maximum = 0;
-	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
 	// Read the serial number.
 	rc = shearwater_common_identifier (&device->base, buffer, ID_SERIAL);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the serial number.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return rc;
 	}
 
@@ -181,8 +187,6 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	if (array_convert_hex2bin (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer),
 		serial, sizeof (serial)) != 0 ) {
 		ERROR (abstract->context, "Failed to convert the serial number.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return DC_STATUS_DATAFORMAT;
 
 	}
@@ -191,8 +195,6 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	rc = shearwater_common_identifier (&device->base, buffer, ID_FIRMWARE);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the firmware version.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return rc;
 	}
 
@@ -203,8 +205,6 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	rc = shearwater_common_identifier (&device->base, buffer, ID_HARDWARE);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the hardware type.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return rc;
 	}
 
@@ -263,15 +263,11 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	rc = shearwater_common_identifier (&device->base, buffer, ID_LOGUPLOAD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the logbook type.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return rc;
 	}
 
 	if (dc_buffer_get_size (buffer) != 9) {
 		ERROR (abstract->context, "Unexpected packet size (" DC_PRINTF_SIZE " bytes).", dc_buffer_get_size(buffer));
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return DC_STATUS_DATAFORMAT;
 	}
 
@@ -288,27 +284,45 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		break;
 	default: // unknown format
 		ERROR (abstract->context, "Unknown logbook format %08x", base_addr);
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	// Read the manifest pages
+	device->base_addr = base_addr;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+shearwater_petrel_device_manifest (shearwater_petrel_device_t *device, dc_buffer_t *buffer, dc_event_progress_t *progress, unsigned int *current, unsigned int *maximum)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	device->cached = 0;
+
+	if (!dc_buffer_clear (device->manifests)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Read the manifest pages, until the page containing the most
+	// recent dive that was already downloaded.
 	while (1) {
 		// Update the progress state.
 		// Assume the worst case scenario of a full manifest, and adjust the
 		// value with the actual number of dives after the manifest has been
 		// processed.
-		maximum += 1 + RECORD_COUNT;
+		*maximum += 1 + RECORD_COUNT;
 
 		// Download a manifest.
-		progress.current = NSTEPS * current;
-		progress.maximum = NSTEPS * maximum;
-		rc = shearwater_common_download (&device->base, buffer, MANIFEST_ADDR, MANIFEST_SIZE, 0, &progress);
+		if (progress) {
+			progress->current = NSTEPS * *current;
+			progress->maximum = NSTEPS * *maximum;
+		}
+		rc = shearwater_common_download (&device->base, buffer, MANIFEST_ADDR, MANIFEST_SIZE, 0, progress);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to download the manifest.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
 			return rc;
 		}
 
@@ -340,14 +354,13 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		}
 
 		// Update the progress state.
-		current += 1;
-		maximum -= RECORD_COUNT - count - deleted;
+		*current += 1;
+		*maximum -= RECORD_COUNT - count - deleted;
 
-		// Append the manifest records to the main buffer.
-		if (!dc_buffer_append (manifests, data, count * RECORD_SIZE)) {
+		// Append the manifest records to the main buffer. The deleted
+		// records are kept, and skipped when downloading the dives.
+		if (!dc_buffer_append (device->manifests, data, offset)) {
 			ERROR (abstract->context, "Insufficient buffer space available.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
 			return DC_STATUS_NOMEMORY;
 		}
 
@@ -356,34 +369,142 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 			break;
 	}
 
+	device->cached = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static int
+shearwater_petrel_device_isnew (shearwater_petrel_device_t *device, const unsigned char record[])
+{
+	// Skip deleted dives.
+	if (array_uint16_be (record) == 0x5A23)
+		return 0;
+
+	// Skip dives that were already downloaded in an earlier session.
+	if (device_is_known ((dc_device_t *) device, record + 4, sizeof (device->fingerprint)))
+		return 0;
+
+	return 1;
+}
+
+
+dc_status_t
+shearwater_petrel_device_count (dc_device_t *abstract, unsigned int *count)
+{
+	shearwater_petrel_device_t *device = (shearwater_petrel_device_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (count == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, MANIFEST_SIZE);
+	if (buffer == NULL) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rc = shearwater_petrel_device_identify (device, buffer);
+	if (rc != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	unsigned int current = 0, maximum = 0;
+	rc = shearwater_petrel_device_manifest (device, buffer, NULL, &current, &maximum);
+	if (rc != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	const unsigned char *data = dc_buffer_get_data (device->manifests);
+	unsigned int size = dc_buffer_get_size (device->manifests);
+
+	unsigned int n = 0;
+	for (unsigned int offset = 0; offset < size; offset += RECORD_SIZE) {
+		if (shearwater_petrel_device_isnew (device, data + offset))
+			n++;
+	}
+
+	*count = n;
+
+error_free:
+	dc_buffer_free (buffer);
+	return rc;
+}
+
+
+static dc_status_t
+shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
+{
+	shearwater_petrel_device_t *device = (shearwater_petrel_device_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// Allocate memory buffers for the dives.
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, MANIFEST_SIZE);
+	if (buffer == NULL) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Enable progress notifications.
+	unsigned int current = 0, maximum = 0;
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	if (device->cached) {
+		// The manifest was already read by shearwater_petrel_device_count.
+		device_event_emit (abstract, DC_EVENT_DEVINFO, &abstract->devinfo);
+		current += 1;
+	} else {
+		rc = shearwater_petrel_device_identify (device, buffer);
+		if (rc != DC_STATUS_SUCCESS) {
+			goto error_free;
+		}
+
+		rc = shearwater_petrel_device_manifest (device, buffer, &progress, &current, &maximum);
+		if (rc != DC_STATUS_SUCCESS) {
+			goto error_free;
+		}
+	}
+
+	// The manifest is only valid for a single download.
+	device->cached = 0;
+
+	// Cache the buffer pointer and size.
+	unsigned char *data = dc_buffer_get_data (device->manifests);
+	unsigned int size = dc_buffer_get_size (device->manifests);
+
+	// Count the dives to download, to get an exact progress range
+	// before the dives are downloaded back-to-back.
+	unsigned int ndives = 0;
+	for (unsigned int offset = 0; offset < size; offset += RECORD_SIZE) {
+		if (shearwater_petrel_device_isnew (device, data + offset))
+			ndives++;
+	}
+	maximum = current + ndives;
+
 	// Update and emit a progress event.
 	progress.current = NSTEPS * current;
 	progress.maximum = NSTEPS * maximum;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Cache the buffer pointer and size.
-	unsigned char *data = dc_buffer_get_data (manifests);
-	unsigned int size = dc_buffer_get_size (manifests);
-
-	unsigned int offset = 0;
-	while (offset < size) {
-		// skip deleted dives
-		if (array_uint16_be(data + offset) == 0x5A23) {
-			offset += RECORD_SIZE;
+	for (unsigned int offset = 0; offset < size; offset += RECORD_SIZE) {
+		if (!shearwater_petrel_device_isnew (device, data + offset))
 			continue;
-		}
+
 		// Get the address of the dive.
 		unsigned int address = array_uint32_be (data + offset + 20);
 
 		// Download the dive.
 		progress.current = NSTEPS * current;
 		progress.maximum = NSTEPS * maximum;
-		rc = shearwater_common_download (&device->base, buffer, base_addr + address, DIVE_SIZE, 1, &progress);
+		rc = shearwater_common_download (&device->base, buffer, device->base_addr + address, DIVE_SIZE, 1, &progress);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to download the dive.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return rc;
+			goto error_free;
 		}
 
 		// Update the progress state.
@@ -393,8 +514,6 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		unsigned int len = dc_buffer_get_size (buffer);
 		if (callback && !callback (buf, len, buf + 12, sizeof (device->fingerprint), userdata))
 			break;
-
-		offset += RECORD_SIZE;
 	}
 
 	// Update and emit a progress event.
@@ -402,8 +521,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	progress.maximum = NSTEPS * maximum;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	dc_buffer_free (manifests);
+error_free:
 	dc_buffer_free (buffer);
-
 	return rc;
 }
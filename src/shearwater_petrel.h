@@ -26,6 +26,7 @@
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/device.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/shearwater_petrel.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,9 @@ shearwater_petrel_device_open (dc_device_t **device, dc_context_t *context, dc_i
 dc_status_t
 shearwater_petrel_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int model, unsigned int serial);
 
+unsigned int
+shearwater_petrel_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -20,11 +20,11 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
 
 #include "shearwater_predator.h"
 #include "shearwater_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 
@@ -52,7 +52,9 @@ static const dc_device_vtable_t shearwater_predator_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	shearwater_predator_device_dump, /* dump */
+	NULL, /* dump_update */
 	shearwater_predator_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -135,7 +137,7 @@ shearwater_predator_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 shearwater_predator_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -226,7 +228,7 @@ shearwater_predator_extract_predator (dc_device_t *abstract, const unsigned char
 	}
 
 	// Allocate memory for the profiles.
-	unsigned char *buffer = (unsigned char *) malloc (RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_BLOCK);
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (context, RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_BLOCK);
 	if (buffer == NULL) {
 		return DC_STATUS_NOMEMORY;
 	}
@@ -264,7 +266,7 @@ shearwater_predator_extract_predator (dc_device_t *abstract, const unsigned char
 		}
 	}
 
-	free (buffer);
+	dc_context_dealloc (context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -277,7 +279,7 @@ shearwater_predator_extract_petrel (dc_device_t *abstract, const unsigned char d
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
 	// Allocate memory for the profiles.
-	unsigned char *buffer = (unsigned char *) malloc (RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_BLOCK);
+	unsigned char *buffer = (unsigned char *) dc_context_malloc (context, RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_BLOCK);
 	if (buffer == NULL) {
 		return DC_STATUS_NOMEMORY;
 	}
@@ -303,7 +305,7 @@ shearwater_predator_extract_petrel (dc_device_t *abstract, const unsigned char d
 			// The dive number in the header and footer should be identical.
 			if (memcmp (data + header + 2, data + offset + 2, 2) != 0) {
 				ERROR (context, "Unexpected dive number.");
-				free (buffer);
+				dc_context_dealloc (context, buffer);
 				return DC_STATUS_DATAFORMAT;
 			}
 
@@ -326,7 +328,7 @@ shearwater_predator_extract_petrel (dc_device_t *abstract, const unsigned char d
 		offset += SZ_BLOCK;
 	}
 
-	free (buffer);
+	dc_context_dealloc (context, buffer);
 
 	return DC_STATUS_SUCCESS;
 }
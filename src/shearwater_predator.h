@@ -37,6 +37,9 @@ shearwater_predator_device_open (dc_device_t **device, dc_context_t *context, dc
 dc_status_t
 shearwater_predator_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int model, unsigned int serial);
 
+unsigned int
+shearwater_predator_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
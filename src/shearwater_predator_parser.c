@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 
 #include <libdivecomputer/units.h>
 
@@ -28,7 +29,9 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "cursor.h"
 #include "field-cache.h"
+#include "platform.h"
 
 #define ISINSTANCE(parser)	( \
 	dc_parser_isinstance((parser), &shearwater_predator_parser_vtable) || \
@@ -83,11 +86,6 @@
 
 typedef struct shearwater_predator_parser_t shearwater_predator_parser_t;
 
-typedef struct shearwater_predator_gasmix_t {
-	unsigned int oxygen;
-	unsigned int helium;
-} shearwater_predator_gasmix_t;
-
 typedef struct shearwater_predator_tank_t {
 	unsigned int enabled;
 	unsigned int beginpressure;
@@ -95,13 +93,26 @@ typedef struct shearwater_predator_tank_t {
 	unsigned int battery;
 } shearwater_predator_tank_t;
 
+/*
+ * A run of consecutive sample records of the same type. The index is
+ * built while caching the header data, and contains only the records
+ * that produce samples (dive samples, freedive samples and info events)
+ * up to the end block, so that the sample iteration doesn't need to
+ * look at the empty, opening and closing records again.
+ */
+typedef struct shearwater_predator_run_t {
+	unsigned int type;
+	unsigned int offset;
+	unsigned int count;
+} shearwater_predator_run_t;
+
 struct shearwater_predator_parser_t {
 	dc_parser_t base;
 	unsigned int model;
 	unsigned int petrel;
 	unsigned int samplesize;
 	// Cached fields.
-	unsigned int cached;
+	unsigned int summary;
 	unsigned int pnf;
 	unsigned int logversion;
 	unsigned int headersize;
@@ -109,9 +120,12 @@ struct shearwater_predator_parser_t {
 	unsigned int opening[NRECORDS];
 	unsigned int closing[NRECORDS];
 	unsigned int final;
+	shearwater_predator_run_t *runs;
+	unsigned int nruns;
+	unsigned int maxruns;
 	unsigned int ngasmixes;
 	unsigned int ntanks;
-	shearwater_predator_gasmix_t gasmix[NGASMIXES];
+	dc_parser_gasmix_t gasmix[NGASMIXES];
 	shearwater_predator_tank_t tank[NTANKS];
 	unsigned int tankidx[NTANKS];
 	unsigned int calibrated;
@@ -129,8 +143,11 @@ static dc_status_t shearwater_predator_parser_set_data (dc_parser_t *abstract, c
 static dc_status_t shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t shearwater_predator_parser_destroy (dc_parser_t *abstract);
+static dc_status_t shearwater_predator_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract);
 
 static dc_status_t shearwater_predator_parser_cache (shearwater_predator_parser_t *parser);
+static dc_status_t shearwater_predator_parser_cache_summary (shearwater_predator_parser_t *parser);
 
 static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	sizeof(shearwater_predator_parser_t),
@@ -139,7 +156,8 @@ static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	shearwater_predator_parser_destroy, /* destroy */
+	shearwater_predator_parser_clone /* clone */
 };
 
 static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
@@ -149,21 +167,15 @@ static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	shearwater_predator_parser_destroy, /* destroy */
+	shearwater_predator_parser_clone /* clone */
 };
 
 
 static unsigned int
 shearwater_predator_find_gasmix (shearwater_predator_parser_t *parser, unsigned int o2, unsigned int he)
 {
-	unsigned int i = 0;
-	while (i < parser->ngasmixes) {
-		if (o2 == parser->gasmix[i].oxygen && he == parser->gasmix[i].helium)
-			break;
-		i++;
-	}
-
-	return i;
+	return dc_parser_find_gasmix (parser->gasmix, 0, parser->ngasmixes, o2, he);
 }
 
 
@@ -199,7 +211,7 @@ shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 	parser->serial = serial;
 
 	// Set the default values.
-	parser->cached = 0;
+	parser->summary = 0;
 	parser->pnf = 0;
 	parser->logversion = 0;
 	parser->headersize = 0;
@@ -209,6 +221,9 @@ shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 		parser->closing[i] = UNDEFINED;
 	}
 	parser->final = UNDEFINED;
+	parser->runs = NULL;
+	parser->nruns = 0;
+	parser->maxruns = 0;
 	parser->ngasmixes = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->gasmix[i].oxygen = 0;
@@ -230,6 +245,7 @@ shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 	parser->density = 1025;
 	parser->atmospheric = ATM / (BAR / 1000);
 
+	dc_field_cache_init(&parser->cache);
 	DC_ASSIGN_FIELD(parser->cache, DIVEMODE, DC_DIVEMODE_OC);
 
 	*out = (dc_parser_t *) parser;
@@ -252,13 +268,103 @@ shearwater_petrel_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 }
 
 
+static dc_status_t
+shearwater_predator_parser_destroy (dc_parser_t *abstract)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+
+	dc_context_dealloc (abstract->context, parser->runs);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+shearwater_predator_parser_clone (dc_parser_t *clone, const dc_parser_t *abstract)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) clone;
+	const shearwater_predator_parser_t *original = (const shearwater_predator_parser_t *) abstract;
+
+	parser->runs = NULL;
+	parser->nruns = 0;
+	parser->maxruns = 0;
+
+	if (original->nruns) {
+		parser->runs = (shearwater_predator_run_t *) dc_context_malloc (abstract->context, original->nruns * sizeof (shearwater_predator_run_t));
+		if (parser->runs == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		memcpy (parser->runs, original->runs, original->nruns * sizeof (shearwater_predator_run_t));
+		parser->nruns = original->nruns;
+		parser->maxruns = original->nruns;
+	}
+
+	dc_field_cache_rebase (&parser->cache, abstract, clone, abstract->vtable->size);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static unsigned int
+shearwater_common_parser_probe (const unsigned char data[], unsigned int size, unsigned int petrel)
+{
+	if (size >= 2 && data[0] == LOG_RECORD_OPENING_0) {
+		// Petrel Native Format (PNF).
+		if (!petrel || size % SZ_SAMPLE_PETREL != 0)
+			return 0;
+
+		if (data[size - SZ_SAMPLE_PETREL] == LOG_RECORD_FINAL)
+			return 90;
+
+		return 50;
+	}
+
+	// Predator Native Format.
+	if (size < 2 * SZ_BLOCK || array_uint16_be (data) != 0xFFFF)
+		return 0;
+
+	// The Petrel has an extra final block.
+	unsigned int final = array_uint16_be (data + size - SZ_BLOCK) == 0xFFFD;
+	unsigned int footer = size - SZ_BLOCK;
+	if (final) {
+		if (size < 3 * SZ_BLOCK)
+			return 0;
+		footer -= SZ_BLOCK;
+	}
+
+	if (array_uint16_be (data + footer) != 0xFFFE)
+		return 20;
+
+	if (final == (petrel != 0))
+		return 80;
+
+	return 70;
+}
+
+
+unsigned int
+shearwater_predator_parser_probe (const unsigned char data[], unsigned int size)
+{
+	return shearwater_common_parser_probe (data, size, 0);
+}
+
+
+unsigned int
+shearwater_petrel_parser_probe (const unsigned char data[], unsigned int size)
+{
+	return shearwater_common_parser_probe (data, size, 1);
+}
+
+
 static dc_status_t
 shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
 	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
+	parser->summary = 0;
 	parser->pnf = 0;
 	parser->logversion = 0;
 	parser->headersize = 0;
@@ -268,6 +374,7 @@ shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char
 		parser->closing[i] = UNDEFINED;
 	}
 	parser->final = UNDEFINED;
+	parser->nruns = 0;
 	parser->ngasmixes = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->gasmix[i].oxygen = 0;
@@ -301,7 +408,9 @@ shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *d
 	const unsigned char *data = abstract->data;
 
 	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	dc_status_t rc = dc_parser_is_summary (parser) ?
+		shearwater_predator_parser_cache_summary (parser) :
+		shearwater_predator_parser_cache (parser);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -344,27 +453,66 @@ add_battery_info(shearwater_predator_parser_t *parser, const char *desc, unsigne
 	}
 }
 
+// The string fields are only formatted when requested.
 static void
-add_deco_model(shearwater_predator_parser_t *parser, const unsigned char *data)
+format_deco_model(char *buffer, size_t size, const void *userdata, unsigned int arg)
 {
+	const shearwater_predator_parser_t *parser = (const shearwater_predator_parser_t *) userdata;
+	const unsigned char *data = parser->base.data;
 	unsigned int idx_deco_model = parser->pnf ? parser->opening[2] + 18 : 67;
 	unsigned int idx_gfs = parser->pnf ? parser->opening[3] + 5 : 85;
 
 	switch	(data[idx_deco_model]) {
 	case 0:
-		dc_field_add_string_fmt(&parser->cache, "Deco model", "GF %u/%u", data[4], data[5]);
+		snprintf(buffer, size, "GF %u/%u", data[4], data[5]);
 		break;
 	case 1:
-		dc_field_add_string_fmt(&parser->cache, "Deco model", "VPM-B +%u", data[idx_deco_model + 1]);
+		snprintf(buffer, size, "VPM-B +%u", data[idx_deco_model + 1]);
 		break;
 	case 2:
-		dc_field_add_string_fmt(&parser->cache, "Deco model", "VPM-B/GFS +%u %u%%", data[idx_deco_model + 1], data[idx_gfs]);
+		snprintf(buffer, size, "VPM-B/GFS +%u %u%%", data[idx_deco_model + 1], data[idx_gfs]);
 		break;
 	default:
-		dc_field_add_string_fmt(&parser->cache, "Deco model", "Unknown model %d", data[idx_deco_model]);
+		snprintf(buffer, size, "Unknown model %d", data[idx_deco_model]);
 	}
 }
 
+static void
+format_logversion(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "%d%s", arg >> 1, (arg & 1) ? "(PNF)" : "");
+}
+
+static void
+format_serial(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "%08x", arg);
+}
+
+static void
+format_firmware(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "%2x", arg);
+}
+
+static void
+format_battery_type(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "unknown type %d", arg);
+}
+
+static void
+format_battery_voltage(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "%.1f V", arg / 10.0);
+}
+
+static void
+add_deco_model(shearwater_predator_parser_t *parser, const unsigned char *data)
+{
+	dc_field_add_string_lazy(&parser->cache, "Deco model", format_deco_model, parser, 0);
+}
+
 static void
 add_battery_type(shearwater_predator_parser_t *parser, const unsigned char *data)
 {
@@ -389,11 +537,44 @@ add_battery_type(shearwater_predator_parser_t *parser, const unsigned char *data
 		dc_field_add_string(&parser->cache, "Battery type", "3.7V Li-Ion");
 		break;
 	default:
-		dc_field_add_string_fmt(&parser->cache, "Battery type", "unknown type %d", data[idx_battery_type]);
+		dc_field_add_string_lazy(&parser->cache, "Battery type", format_battery_type, NULL, data[idx_battery_type]);
 		break;
 	}
 }
 
+static dc_status_t
+shearwater_predator_parser_index (shearwater_predator_parser_t *parser, unsigned int type, unsigned int offset)
+{
+	// Extend the last run if the record directly follows it.
+	if (parser->nruns) {
+		shearwater_predator_run_t *run = parser->runs + parser->nruns - 1;
+		if (run->type == type && run->offset + run->count * parser->samplesize == offset) {
+			run->count++;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	if (parser->nruns >= parser->maxruns) {
+		unsigned int maxruns = parser->maxruns ? parser->maxruns * 2 : 16;
+		shearwater_predator_run_t *runs = (shearwater_predator_run_t *) dc_context_realloc (parser->base.context, parser->runs, maxruns * sizeof (*runs));
+		if (runs == NULL) {
+			ERROR (parser->base.context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		parser->runs = runs;
+		parser->maxruns = maxruns;
+	}
+
+	parser->runs[parser->nruns].type = type;
+	parser->runs[parser->nruns].offset = offset;
+	parser->runs[parser->nruns].count = 1;
+	parser->nruns++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 {
@@ -401,10 +582,11 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	const unsigned char *data = parser->base.data;
 	unsigned int size = parser->base.size;
 
-	if (parser->cached) {
+	if (parser->base.cached) {
 		return DC_STATUS_SUCCESS;
 	}
-	memset(&parser->cache, 0, sizeof(parser->cache));
+	dc_field_cache_clear(&parser->cache);
+	parser->nruns = 0;
 
 	// Log versions before 6 weren't reliably stored in the data, but
 	// 6 is also the oldest version that we assume in our code
@@ -462,10 +644,13 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 
 	// Get the gas mixes.
 	unsigned int ngasmixes = 0;
-	shearwater_predator_gasmix_t gasmix[NGASMIXES] = {0};
+	dc_parser_gasmix_t gasmix[NGASMIXES] = {0};
 	shearwater_predator_tank_t tank[NTANKS] = {0};
 	unsigned int o2_previous = 0, he_previous = 0;
 
+	// The sample index stops at the end block.
+	unsigned int end = 0;
+
 	unsigned int offset = headersize;
 	unsigned int length = size - footersize;
 	while (offset + parser->samplesize <= length) {
@@ -478,6 +663,19 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		// Get the record type.
 		unsigned int type = pnf ? data[offset] : LOG_RECORD_DIVE_SAMPLE;
 
+		// Add the sample records to the index.
+		if (!end) {
+			if (type == LOG_RECORD_FINAL && data[offset + 1] == 0xFD) {
+				end = 1;
+			} else if (type == LOG_RECORD_DIVE_SAMPLE ||
+				type == LOG_RECORD_FREEDIVE_SAMPLE ||
+				type == LOG_RECORD_INFO_EVENT) {
+				dc_status_t rc = shearwater_predator_parser_index (parser, type, offset);
+				if (rc != DC_STATUS_SUCCESS)
+					return rc;
+			}
+		}
+
 		if (type == LOG_RECORD_DIVE_SAMPLE) {
 			// Status flags.
 			unsigned int status = data[offset + 11 + pnf];
@@ -572,7 +770,7 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		}
 	}
 
-	dc_field_add_string_fmt(&parser->cache, "Logversion", "%d%s", logversion, pnf ? "(PNF)" : "");
+	dc_field_add_string_lazy(&parser->cache, "Logversion", format_logversion, NULL, (logversion << 1) | (pnf ? 1 : 0));
 
 	// Cache sensor calibration for later use
 	unsigned int nsensors = 0, ndefaults = 0;
@@ -632,22 +830,171 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	parser->units = data[parser->opening[0] + 8];
 	parser->atmospheric = array_uint16_be (data + parser->opening[1] + (parser->pnf ? 16 : 47));
 	parser->density = array_uint16_be (data + parser->opening[3] + (parser->pnf ? 3 : 83));
-	parser->cached = 1;
+	parser->base.cached = 1;
 
 	DC_ASSIGN_FIELD(parser->cache, DIVEMODE, mode);
 
-	dc_field_add_string_fmt(&parser->cache, "Serial", "%08x", parser->serial);
+	dc_field_add_string_lazy(&parser->cache, "Serial", format_serial, NULL, parser->serial);
 	// bytes 1-31 are identical in all formats
-	dc_field_add_string_fmt(&parser->cache, "FW Version", "%2x", data[19]);
+	dc_field_add_string_lazy(&parser->cache, "FW Version", format_firmware, NULL, data[19]);
 	add_deco_model(parser, data);
 	add_battery_type(parser, data);
-	dc_field_add_string_fmt(&parser->cache, "Battery at end", "%.1f V", data[9] / 10.0);
+	dc_field_add_string_lazy(&parser->cache, "Battery at end", format_battery_voltage, NULL, data[9]);
 	add_battery_info(parser, "T1 battery", tank[0].battery);
 	add_battery_info(parser, "T2 battery", tank[1].battery);
 
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Locate the opening and closing records without decoding the samples.
+ *
+ * In the PNF format, the opening records are stored before the first
+ * sample, and the closing records after the last sample. Therefore only
+ * the head and the tail of the data need to be scanned. The gas mixes,
+ * tanks and dive mode are only available in the samples, and still
+ * require the full scan.
+ */
+static dc_status_t
+shearwater_predator_parser_cache_summary (shearwater_predator_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	if (parser->base.cached || parser->summary) {
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (size < 2) {
+		ERROR (abstract->context, "Invalid data length.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	unsigned int pnf = parser->petrel ? array_uint16_be (data) != 0xFFFF : 0;
+	unsigned int logversion = 0;
+	unsigned int headersize = 0;
+	unsigned int footersize = 0;
+	unsigned int opening[NRECORDS], closing[NRECORDS];
+	unsigned int final = UNDEFINED;
+	for (unsigned int i = 0; i < NRECORDS; ++i) {
+		opening[i] = UNDEFINED;
+		closing[i] = UNDEFINED;
+	}
+
+	if (!pnf) {
+		headersize = SZ_BLOCK;
+		footersize = SZ_BLOCK;
+		if (size < headersize + footersize) {
+			ERROR (abstract->context, "Invalid data length.");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		if (parser->petrel || array_uint16_be (data + size - footersize) == 0xFFFD) {
+			footersize += SZ_BLOCK;
+			if (size < headersize + footersize) {
+				ERROR (abstract->context, "Invalid data length.");
+				return DC_STATUS_DATAFORMAT;
+			}
+
+			final = size - SZ_BLOCK;
+		}
+
+		for (unsigned int i = 0; i < NRECORDS; ++i) {
+			opening[i] = 0;
+			closing[i] = size - footersize;
+		}
+
+		logversion = data[127];
+	} else {
+		unsigned int nrecords = size / parser->samplesize;
+
+		// Scan forwards until the first sample, and backwards until the
+		// last sample.
+		for (unsigned int pass = 0; pass < 2; ++pass) {
+			for (unsigned int n = 0; n < nrecords; ++n) {
+				unsigned int idx = pass ? nrecords - 1 - n : n;
+				unsigned int offset = idx * parser->samplesize;
+
+				if (array_isequal (data + offset, parser->samplesize, 0x00))
+					continue;
+
+				unsigned int type = data[offset];
+				if (type == LOG_RECORD_DIVE_SAMPLE || type == LOG_RECORD_FREEDIVE_SAMPLE) {
+					break;
+				} else if (type >= LOG_RECORD_OPENING_0 && type <= LOG_RECORD_OPENING_7) {
+					opening[type - LOG_RECORD_OPENING_0] = offset;
+					if (type == LOG_RECORD_OPENING_4) {
+						logversion = data[offset + 16];
+					}
+				} else if (type >= LOG_RECORD_CLOSING_0 && type <= LOG_RECORD_CLOSING_7) {
+					closing[type - LOG_RECORD_CLOSING_0] = offset;
+				} else if (type == LOG_RECORD_FINAL) {
+					final = offset;
+				}
+			}
+		}
+	}
+
+	// If the records are not in the expected location, the full scan
+	// is required.
+	for (unsigned int i = 0; i <= 4; ++i) {
+		if (opening[i] == UNDEFINED || closing[i] == UNDEFINED) {
+			return DC_STATUS_FULLSCAN;
+		}
+	}
+
+	// Cache the data for later use.
+	parser->pnf = pnf;
+	parser->logversion = logversion;
+	parser->headersize = headersize;
+	parser->footersize = footersize;
+	for (unsigned int i = 0; i < NRECORDS; ++i) {
+		parser->opening[i] = opening[i];
+		parser->closing[i] = closing[i];
+	}
+	parser->final = final;
+	parser->units = data[parser->opening[0] + 8];
+	parser->atmospheric = array_uint16_be (data + parser->opening[1] + (parser->pnf ? 16 : 47));
+	parser->density = array_uint16_be (data + parser->opening[3] + (parser->pnf ? 3 : 83));
+	parser->summary = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static unsigned int
+shearwater_predator_parser_samplecount (shearwater_predator_parser_t *parser, dc_field_type_t type)
+{
+	const unsigned char *data = parser->base.data;
+
+	unsigned int count = 0;
+	for (unsigned int n = 0; n < parser->nruns; ++n) {
+		const shearwater_predator_run_t *run = parser->runs + n;
+
+		if (run->type == LOG_RECORD_DIVE_SAMPLE) {
+			count += run->count;
+		} else if (run->type == LOG_RECORD_FREEDIVE_SAMPLE) {
+			if (type == DC_FIELD_SAMPLE_CAPACITY) {
+				count += run->count * 4;
+				continue;
+			}
+
+			// A freedive record packs up to 4 samples, and the unused
+			// samples at the end of a dive are zero padded.
+			for (unsigned int i = 0; i < run->count; ++i) {
+				const unsigned char *record = data + run->offset + i * parser->samplesize;
+				for (unsigned int j = 0; j < 4; ++j) {
+					if (array_isequal (record + j * SZ_SAMPLE_FREEDIVE, SZ_SAMPLE_FREEDIVE, 0x00))
+						break;
+					count++;
+				}
+			}
+		}
+	}
+
+	return count;
+}
+
 static dc_status_t
 shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
@@ -656,7 +1003,21 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 	const unsigned char *data = abstract->data;
 
 	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	if (dc_parser_is_summary (parser) && !parser->base.cached) {
+		switch (type) {
+		case DC_FIELD_DIVETIME:
+		case DC_FIELD_MAXDEPTH:
+		case DC_FIELD_SALINITY:
+		case DC_FIELD_ATMOSPHERIC:
+			rc = shearwater_predator_parser_cache_summary (parser);
+			break;
+		default:
+			return DC_STATUS_FULLSCAN;
+		}
+	} else {
+		rc = shearwater_predator_parser_cache (parser);
+	}
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -714,6 +1075,10 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 			return DC_FIELD_VALUE(parser->cache, value, DIVEMODE);
 		case DC_FIELD_STRING:
 			return dc_field_get_string(&parser->cache, flags, string);
+		case DC_FIELD_SAMPLE_COUNT:
+		case DC_FIELD_SAMPLE_CAPACITY:
+			*((unsigned int *) value) = shearwater_predator_parser_samplecount (parser, type);
+			break;
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
@@ -729,7 +1094,6 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
 
 	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
 
 	// Cache the parser data.
 	dc_status_t rc = shearwater_predator_parser_cache (parser);
@@ -752,210 +1116,210 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 	}
 
 	unsigned int pnf = parser->pnf;
-	unsigned int offset = parser->headersize;
-	unsigned int length = size - parser->footersize;
-	while (offset + parser->samplesize <= length) {
-		dc_sample_value_t sample = {0};
+	for (unsigned int n = 0; n < parser->nruns; ++n) {
+		const shearwater_predator_run_t *run = parser->runs + n;
 
-		// Ignore empty samples.
-		if (array_isequal (data + offset, parser->samplesize, 0x00)) {
-			offset += parser->samplesize;
-			continue;
-		}
+		// The records of a run are always complete, so the size of each
+		// record is checked only once, and the fields are read unchecked.
+		dc_cursor_t stream, record;
+		dc_cursor_init (&stream, data + run->offset, run->count * parser->samplesize);
 
-		// Get the record type.
-		unsigned int type = pnf ? data[offset] : LOG_RECORD_DIVE_SAMPLE;
+		if (run->type == LOG_RECORD_DIVE_SAMPLE) {
+			while (dc_cursor_record (&stream, &record, parser->samplesize)) {
+				dc_sample_value_t sample = {0};
 
-		// stop parsing if we see the end block
-		if (type == LOG_RECORD_FINAL && data[offset + 1] == 0xFD)
-			break;
+				// Time (seconds).
+				time += interval;
+				sample.time = time;
+				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-		if (type == LOG_RECORD_DIVE_SAMPLE) {
-			// Time (seconds).
-			time += interval;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+				// Depth (1/10 m or ft).
+				unsigned int depth = dc_cursor_u16be_at (&record, pnf);
+				if (parser->units == IMPERIAL)
+					sample.depth = depth * FEET / 10.0;
+				else
+					sample.depth = depth / 10.0;
+				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
-			// Depth (1/10 m or ft).
-			unsigned int depth = array_uint16_be (data + pnf + offset);
-			if (parser->units == IMPERIAL)
-				sample.depth = depth * FEET / 10.0;
-			else
-				sample.depth = depth / 10.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
-			// Temperature (°C or °F).
-			int temperature = (signed char) data[offset + pnf + 13];
-			if (temperature < 0) {
-				// Fix negative temperatures.
-				temperature += 102;
-				if (temperature > 0) {
-					temperature = 0;
+				// Temperature (°C or °F).
+				int temperature = (signed char) dc_cursor_u8_at (&record, pnf + 13);
+				if (temperature < 0) {
+					// Fix negative temperatures.
+					temperature += 102;
+					if (temperature > 0) {
+						temperature = 0;
+					}
 				}
-			}
-			if (parser->units == IMPERIAL)
-				sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-			else
-				sample.temperature = temperature;
-			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+				if (parser->units == IMPERIAL)
+					sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
+				else
+					sample.temperature = temperature;
+				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 
-			// Status flags.
-			unsigned int status = data[offset + pnf + 11];
+				// Status flags.
+				unsigned int status = dc_cursor_u8_at (&record, pnf + 11);
 
-			if ((status & OC) == 0) {
-				// PPO2
-				if ((status & PPO2_EXTERNAL) == 0) {
-					if (!parser->calibrated) {
-						sample.ppo2 = data[offset + pnf + 6] / 100.0;
-						if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
-					} else {
-						sample.ppo2 = data[offset + pnf + 12] * parser->calibration[0];
-						if (callback && (parser->calibrated & 0x01)) callback (DC_SAMPLE_PPO2, sample, userdata);
+				if ((status & OC) == 0) {
+					// PPO2
+					if ((status & PPO2_EXTERNAL) == 0) {
+						if (!parser->calibrated) {
+							sample.ppo2 = dc_cursor_u8_at (&record, pnf + 6) / 100.0;
+							if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+						} else {
+							sample.ppo2 = dc_cursor_u8_at (&record, pnf + 12) * parser->calibration[0];
+							if (callback && (parser->calibrated & 0x01)) callback (DC_SAMPLE_PPO2, sample, userdata);
 
-						sample.ppo2 = data[offset + pnf + 14] * parser->calibration[1];
-						if (callback && (parser->calibrated & 0x02)) callback (DC_SAMPLE_PPO2, sample, userdata);
+							sample.ppo2 = dc_cursor_u8_at (&record, pnf + 14) * parser->calibration[1];
+							if (callback && (parser->calibrated & 0x02)) callback (DC_SAMPLE_PPO2, sample, userdata);
 
-						sample.ppo2 = data[offset + pnf + 15] * parser->calibration[2];
-						if (callback && (parser->calibrated & 0x04)) callback (DC_SAMPLE_PPO2, sample, userdata);
+							sample.ppo2 = dc_cursor_u8_at (&record, pnf + 15) * parser->calibration[2];
+							if (callback && (parser->calibrated & 0x04)) callback (DC_SAMPLE_PPO2, sample, userdata);
+						}
 					}
-				}
 
-				// Setpoint
-				if (parser->petrel) {
-					sample.setpoint = data[offset + pnf + 18] / 100.0;
-				} else {
-					// this will only ever be called for the actual Predator, so no adjustment needed for PNF
-					if (status & SETPOINT_HIGH) {
-						sample.setpoint = data[18] / 100.0;
+					// Setpoint
+					if (parser->petrel) {
+						sample.setpoint = dc_cursor_u8_at (&record, pnf + 18) / 100.0;
 					} else {
-						sample.setpoint = data[17] / 100.0;
+						// this will only ever be called for the actual Predator, so no adjustment needed for PNF
+						if (status & SETPOINT_HIGH) {
+							sample.setpoint = data[18] / 100.0;
+						} else {
+							sample.setpoint = data[17] / 100.0;
+						}
 					}
+					if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
 				}
-				if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
-			}
-
-			// CNS
-			if (parser->petrel) {
-				sample.cns = data[offset + pnf + 22] / 100.0;
-				if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
-			}
 
-			// Gaschange.
-			unsigned int o2 = data[offset + pnf + 7];
-			unsigned int he = data[offset + pnf + 8];
-			if (o2 != o2_previous || he != he_previous) {
-				unsigned int idx = shearwater_predator_find_gasmix (parser, o2, he);
-				if (idx >= parser->ngasmixes) {
-					ERROR (abstract->context, "Invalid gas mix.");
-					return DC_STATUS_DATAFORMAT;
+				// CNS
+				if (parser->petrel) {
+					sample.cns = dc_cursor_u8_at (&record, pnf + 22) / 100.0;
+					if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
 				}
 
-				sample.gasmix = idx;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-				o2_previous = o2;
-				he_previous = he;
-			}
+				// Gaschange.
+				unsigned int o2 = dc_cursor_u8_at (&record, pnf + 7);
+				unsigned int he = dc_cursor_u8_at (&record, pnf + 8);
+				if (o2 != o2_previous || he != he_previous) {
+					unsigned int idx = shearwater_predator_find_gasmix (parser, o2, he);
+					if (idx >= parser->ngasmixes) {
+						ERROR (abstract->context, "Invalid gas mix.");
+						return DC_STATUS_DATAFORMAT;
+					}
 
-			// Deco stop / NDL.
-			unsigned int decostop = array_uint16_be (data + offset + pnf + 2);
-			if (decostop) {
-				sample.deco.type = DC_DECO_DECOSTOP;
-				if (parser->units == IMPERIAL)
-					sample.deco.depth = decostop * FEET;
-				else
-					sample.deco.depth = decostop;
-			} else {
-				sample.deco.type = DC_DECO_NDL;
-				sample.deco.depth = 0.0;
-			}
-			sample.deco.time = data[offset + pnf + 9] * 60;
-			if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+					sample.gasmix = idx;
+					if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+					o2_previous = o2;
+					he_previous = he;
+				}
 
-			// for logversion 7 and newer (introduced for Perdix AI)
-			// detect tank pressure
-			if (parser->logversion >= 7) {
-				const unsigned int idx[NTANKS] = {27, 19};
-				for (unsigned int i = 0; i < NTANKS; ++i) {
-					// Tank pressure
-					// Values above 0xFFF0 are special codes:
-					//    0xFFFF AI is off
-					//    0xFFFE No comms for 90 seconds+
-					//    0xFFFD No comms for 30 seconds
-					//    0xFFFC Transmitter not paired
-					// For regular values, the top 4 bits contain the battery
-					// level (0=normal, 1=critical, 2=warning), and the lower 12
-					// bits the tank pressure in units of 2 psi.
-					unsigned int pressure = array_uint16_be (data + offset + pnf + idx[i]);
-					if (pressure < 0xFFF0) {
-						pressure &= 0x0FFF;
-						sample.pressure.tank = parser->tankidx[i];
-						sample.pressure.value = pressure * 2 * PSI / BAR;
-						if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
-					}
+				// Deco stop / NDL.
+				unsigned int decostop = dc_cursor_u16be_at (&record, pnf + 2);
+				if (decostop) {
+					sample.deco.type = DC_DECO_DECOSTOP;
+					if (parser->units == IMPERIAL)
+						sample.deco.depth = decostop * FEET;
+					else
+						sample.deco.depth = decostop;
+				} else {
+					sample.deco.type = DC_DECO_NDL;
+					sample.deco.depth = 0.0;
 				}
+				sample.deco.time = dc_cursor_u8_at (&record, pnf + 9) * 60;
+				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+
+				// for logversion 7 and newer (introduced for Perdix AI)
+				// detect tank pressure
+				if (parser->logversion >= 7) {
+					const unsigned int idx[NTANKS] = {27, 19};
+					for (unsigned int i = 0; i < NTANKS; ++i) {
+						// Tank pressure
+						// Values above 0xFFF0 are special codes:
+						//    0xFFFF AI is off
+						//    0xFFFE No comms for 90 seconds+
+						//    0xFFFD No comms for 30 seconds
+						//    0xFFFC Transmitter not paired
+						// For regular values, the top 4 bits contain the battery
+						// level (0=normal, 1=critical, 2=warning), and the lower 12
+						// bits the tank pressure in units of 2 psi.
+						unsigned int pressure = dc_cursor_u16be_at (&record, pnf + idx[i]);
+						if (pressure < 0xFFF0) {
+							pressure &= 0x0FFF;
+							sample.pressure.tank = parser->tankidx[i];
+							sample.pressure.value = pressure * 2 * PSI / BAR;
+							if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+						}
+					}
 
-				// Gas time remaining in minutes
-				// Values above 0xF0 are special codes:
-				//    0xFF Not paired
-				//    0xFE No communication
-				//    0xFD Not available in current mode
-				//    0xFC Not available because of DECO
-				//    0xFB Tank size or max pressure haven’t been set up
-				if (data[offset + pnf + 21] < 0xF0) {
-					sample.rbt = data[offset + pnf + 21];
-					if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
+					// Gas time remaining in minutes
+					// Values above 0xF0 are special codes:
+					//    0xFF Not paired
+					//    0xFE No communication
+					//    0xFD Not available in current mode
+					//    0xFC Not available because of DECO
+					//    0xFB Tank size or max pressure haven’t been set up
+					if (dc_cursor_u8_at (&record, pnf + 21) < 0xF0) {
+						sample.rbt = dc_cursor_u8_at (&record, pnf + 21);
+						if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
+					}
 				}
 			}
-		} else if (type == LOG_RECORD_FREEDIVE_SAMPLE) {
-			// A freedive record is actually 4 samples, each 8-bytes,
-			// packed into a standard 32-byte sized record. At the end
-			// of a dive, unused partial records will be 0 padded.
-			for (unsigned int i = 0; i < 4; ++i) {
-				unsigned int idx = offset + i * SZ_SAMPLE_FREEDIVE;
-
-				// Ignore empty samples.
-				if (array_isequal (data + idx, SZ_SAMPLE_FREEDIVE, 0x00)) {
-					break;
-				}
+		} else if (run->type == LOG_RECORD_FREEDIVE_SAMPLE) {
+			while (dc_cursor_record (&stream, &record, parser->samplesize)) {
+				dc_sample_value_t sample = {0};
+
+				// A freedive record is actually 4 samples, each 8-bytes,
+				// packed into a standard 32-byte sized record. At the end
+				// of a dive, unused partial records will be 0 padded.
+				for (unsigned int i = 0; i < 4; ++i) {
+					unsigned int idx = i * SZ_SAMPLE_FREEDIVE;
+
+					// Ignore empty samples.
+					if (array_isequal (record.data + idx, SZ_SAMPLE_FREEDIVE, 0x00)) {
+						break;
+					}
 
-				// Time (seconds).
-				time += interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+					// Time (seconds).
+					time += interval;
+					sample.time = time;
+					if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-				// Depth (absolute pressure in millibar)
-				unsigned int depth = array_uint16_be (data + idx + 1);
-				sample.depth = (depth - parser->atmospheric) * (BAR / 1000.0) / (parser->density * GRAVITY);
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+					// Depth (absolute pressure in millibar)
+					unsigned int depth = dc_cursor_u16be_at (&record, idx + 1);
+					sample.depth = (depth - parser->atmospheric) * (BAR / 1000.0) / (parser->density * GRAVITY);
+					if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
-				// Temperature (1/10 °C).
-				int temperature = (signed short) array_uint16_be (data + idx + 3);
-				sample.temperature = temperature / 10.0;
-				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-			}
-		} else if (type == LOG_RECORD_INFO_EVENT) {
-			unsigned int event = data[offset + 1];
-			unsigned int timestamp = array_uint32_be (data + offset + 4);
-			unsigned int w1 = array_uint32_be (data + offset + 8);
-			unsigned int w2 = array_uint32_be (data + offset + 12);
-
-			if (event == INFO_EVENT_TAG_LOG) {
-				// Compass heading
-				if (w1 != 0xFFFFFFFF) {
-					sample.bearing = w1;
-					if (callback) callback (DC_SAMPLE_BEARING, sample, userdata);
+					// Temperature (1/10 °C).
+					int temperature = (signed short) dc_cursor_u16be_at (&record, idx + 3);
+					sample.temperature = temperature / 10.0;
+					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 				}
+			}
+		} else if (run->type == LOG_RECORD_INFO_EVENT) {
+			while (dc_cursor_record (&stream, &record, parser->samplesize)) {
+				dc_sample_value_t sample = {0};
+
+				unsigned int event = dc_cursor_u8_at (&record, 1);
+				unsigned int timestamp = dc_cursor_u32be_at (&record, 4);
+				unsigned int w1 = dc_cursor_u32be_at (&record, 8);
+				unsigned int w2 = dc_cursor_u32be_at (&record, 12);
+
+				if (event == INFO_EVENT_TAG_LOG) {
+					// Compass heading
+					if (w1 != 0xFFFFFFFF) {
+						sample.bearing = w1;
+						if (callback) callback (DC_SAMPLE_BEARING, sample, userdata);
+					}
 
-				// Tag
-				sample.event.type = SAMPLE_EVENT_BOOKMARK;
-				sample.event.time = 0;
-				sample.event.flags = 0;
-				sample.event.value = w2;
-				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+					// Tag
+					sample.event.type = SAMPLE_EVENT_BOOKMARK;
+					sample.event.time = 0;
+					sample.event.flags = 0;
+					sample.event.value = w2;
+					if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+				}
 			}
 		}
-
-		offset += parser->samplesize;
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -0,0 +1,409 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h> // memcpy, memset
+
+#include <libdivecomputer/buffer.h>
+
+#include "simulator-private.h"
+#include "context-private.h"
+#include "buffer-private.h"
+#include "array.h"
+
+#define SZ_PACKET  254
+#define SZ_BLOCK   252 // Multiple of 9 bytes.
+
+#define MANIFEST_ADDR 0xE0000000
+
+#define END       0xC0
+#define ESC       0xDB
+#define ESC_END   0xDC
+#define ESC_ESC   0xDD
+
+#define RDBI    0x22
+#define WDBI    0x2E
+#define INIT    0x35
+#define BLOCK   0x36
+#define QUIT    0x37
+#define NEGATIVE 0x7F
+
+typedef struct shearwater_simulator_t {
+	dc_simulator_protocol_t base;
+	unsigned char *data;
+	size_t size;
+	dc_buffer_t *stream;
+	size_t offset;
+	unsigned int manifest;
+} shearwater_simulator_t;
+
+static size_t shearwater_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size);
+static void shearwater_simulator_destroy (dc_simulator_protocol_t *abstract);
+
+static const dc_simulator_protocol_vtable_t shearwater_simulator_vtable = {
+	sizeof(shearwater_simulator_t),
+	shearwater_simulator_process, /* process */
+	shearwater_simulator_destroy, /* destroy */
+};
+
+dc_status_t
+shearwater_simulator_create (dc_simulator_protocol_t **out, dc_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	shearwater_simulator_t *protocol = NULL;
+
+	// Allocate memory.
+	protocol = (shearwater_simulator_t *) dc_simulator_protocol_allocate (simulator, &shearwater_simulator_vtable);
+	if (protocol == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	protocol->data = NULL;
+	protocol->size = size;
+	protocol->stream = NULL;
+	protocol->offset = 0;
+	protocol->manifest = 0;
+
+	// Validate the records.
+	size_t offset = 0;
+	dc_simulator_record_t record;
+	int rc = 0;
+	while ((rc = dc_simulator_record_next (data, size, &offset, &record)) > 0)
+		;
+	if (rc < 0) {
+		ERROR (protocol->base.context, "Unexpected end of the records.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	protocol->data = (unsigned char *) dc_context_malloc (protocol->base.context, size ? size : 1);
+	protocol->stream = dc_buffer_allocate (protocol->base.context, 0);
+	if (protocol->data == NULL || protocol->stream == NULL) {
+		ERROR (protocol->base.context, "Failed to allocate memory.");
+		dc_buffer_free (protocol->stream);
+		dc_context_dealloc (protocol->base.context, protocol->data);
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size)
+		memcpy (protocol->data, data, size);
+
+	*out = (dc_simulator_protocol_t *) protocol;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+shearwater_simulator_destroy (dc_simulator_protocol_t *abstract)
+{
+	shearwater_simulator_t *protocol = (shearwater_simulator_t *) abstract;
+
+	dc_buffer_free (protocol->stream);
+	dc_context_dealloc (protocol->base.context, protocol->data);
+}
+
+static void
+shearwater_simulator_answer (shearwater_simulator_t *protocol, const unsigned char data[], unsigned int size)
+{
+	unsigned char packet[2 * (SZ_PACKET + 4) + 2];
+	unsigned int nbytes = 0;
+
+	unsigned char header[4] = {0x01, 0xFF, size + 1, 0x00};
+
+	packet[nbytes++] = END;
+	for (unsigned int i = 0; i < sizeof (header) + size; ++i) {
+		unsigned char c = i < sizeof (header) ? header[i] : data[i - sizeof (header)];
+		if (c == END) {
+			packet[nbytes++] = ESC;
+			packet[nbytes++] = ESC_END;
+		} else if (c == ESC) {
+			packet[nbytes++] = ESC;
+			packet[nbytes++] = ESC_ESC;
+		} else {
+			packet[nbytes++] = c;
+		}
+	}
+	packet[nbytes++] = END;
+
+	dc_simulator_reply (protocol->base.simulator, packet, nbytes);
+}
+
+static void
+shearwater_simulator_negative (shearwater_simulator_t *protocol, unsigned char cmd, unsigned char code)
+{
+	const unsigned char answer[] = {NEGATIVE, cmd, code};
+	shearwater_simulator_answer (protocol, answer, sizeof (answer));
+}
+
+/*
+ * Append a 9 bit value to the bit stream.
+ */
+static int
+shearwater_simulator_bits (dc_buffer_t *buffer, unsigned int *nbits, unsigned int value)
+{
+	for (unsigned int i = 0; i < 9; ++i) {
+		unsigned int bit = (value >> (8 - i)) & 1;
+		if (*nbits % 8 == 0) {
+			unsigned char zero = 0;
+			if (!dc_buffer_append (buffer, &zero, 1))
+				return -1;
+		}
+		if (bit) {
+			unsigned char *data = dc_buffer_get_data (buffer);
+			data[*nbits / 8] |= 0x80 >> (*nbits % 8);
+		}
+		(*nbits)++;
+	}
+
+	return 0;
+}
+
+/*
+ * Compress the data in the same way as the Petrel native format. The
+ * first phase XOR's each 32 byte block with the previous one, and the
+ * second phase replaces the runs of zero bytes with their length, in a
+ * stream of 9 bit values. A zero length run marks the end.
+ */
+static int
+shearwater_simulator_compress (dc_buffer_t *buffer, const unsigned char data[], size_t size)
+{
+	unsigned int nbits = 0;
+	unsigned int run = 0;
+
+	dc_buffer_clear (buffer);
+
+	for (size_t i = 0; i < size; ++i) {
+		unsigned char c = data[i];
+		if (i >= 32)
+			c ^= data[i - 32];
+
+		if (c == 0) {
+			run++;
+			if (run == 0xFF) {
+				if (shearwater_simulator_bits (buffer, &nbits, run) != 0)
+					return -1;
+				run = 0;
+			}
+			continue;
+		}
+
+		if (run) {
+			if (shearwater_simulator_bits (buffer, &nbits, run) != 0)
+				return -1;
+			run = 0;
+		}
+
+		if (shearwater_simulator_bits (buffer, &nbits, 0x100 | c) != 0)
+			return -1;
+	}
+
+	if (run) {
+		if (shearwater_simulator_bits (buffer, &nbits, run) != 0)
+			return -1;
+	}
+
+	// End of the compressed stream.
+	if (shearwater_simulator_bits (buffer, &nbits, 0) != 0)
+		return -1;
+
+	// Each block contains a whole number of 9 bit values. Pad the
+	// stream with zero bytes to a multiple of 9 bytes.
+	size_t length = dc_buffer_get_size (buffer);
+	if (length % 9 != 0) {
+		if (!dc_buffer_resize (buffer, length + 9 - length % 9))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+shearwater_simulator_find (shearwater_simulator_t *protocol, unsigned int address, dc_simulator_record_t *record)
+{
+	size_t offset = 0;
+	while (dc_simulator_record_next (protocol->data, protocol->size, &offset, record) > 0) {
+		if (record->key >= 0x10000 && address >= record->key && address - record->key < record->size)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void
+shearwater_simulator_init (shearwater_simulator_t *protocol, const unsigned char data[], unsigned int size)
+{
+	if (size != 10) {
+		shearwater_simulator_negative (protocol, INIT, 0x13);
+		return;
+	}
+
+	unsigned int compression = data[1] & 0x10;
+	unsigned int address = array_uint32_be (data + 3);
+	unsigned int length = array_uint24_be (data + 7);
+
+	// Every manifest download continues with the next manifest page.
+	unsigned int skip = 0;
+	if (address == MANIFEST_ADDR) {
+		skip = protocol->manifest;
+		protocol->manifest += length;
+	}
+
+	dc_simulator_record_t record;
+	if (!shearwater_simulator_find (protocol, address, &record)) {
+		WARNING (protocol->base.context, "Unknown memory area (%08x).", address);
+		shearwater_simulator_negative (protocol, INIT, 0x31);
+		return;
+	}
+
+	unsigned int offset = address - record.key + skip;
+	unsigned int available = offset < record.size ? record.size - offset : 0;
+
+	protocol->offset = 0;
+	if (compression) {
+		// A compressed download ends with the end of the area.
+		if (shearwater_simulator_compress (protocol->stream, record.data + offset, available) != 0) {
+			ERROR (protocol->base.context, "Failed to allocate memory.");
+			return;
+		}
+	} else {
+		// Bytes beyond the end of the area read as erased.
+		if (!dc_buffer_clear (protocol->stream) ||
+			!dc_buffer_append (protocol->stream, record.data + offset, available < length ? available : length) ||
+			!dc_buffer_reserve (protocol->stream, length)) {
+			ERROR (protocol->base.context, "Failed to allocate memory.");
+			return;
+		}
+		while (dc_buffer_get_size (protocol->stream) < length) {
+			unsigned char erased = 0xFF;
+			dc_buffer_append (protocol->stream, &erased, 1);
+		}
+	}
+
+	const unsigned char answer[] = {INIT + 0x40, 0x10, SZ_BLOCK + 2};
+	shearwater_simulator_answer (protocol, answer, sizeof (answer));
+}
+
+static void
+shearwater_simulator_block (shearwater_simulator_t *protocol, const unsigned char data[], unsigned int size)
+{
+	unsigned char answer[2 + SZ_BLOCK];
+
+	if (size != 2) {
+		shearwater_simulator_negative (protocol, BLOCK, 0x13);
+		return;
+	}
+
+	size_t available = dc_buffer_get_size (protocol->stream) - protocol->offset;
+	size_t length = available < SZ_BLOCK ? available : SZ_BLOCK;
+
+	answer[0] = BLOCK + 0x40;
+	answer[1] = data[1];
+	memcpy (answer + 2, dc_buffer_get_data (protocol->stream) + protocol->offset, length);
+	protocol->offset += length;
+
+	shearwater_simulator_answer (protocol, answer, 2 + length);
+}
+
+static void
+shearwater_simulator_request (shearwater_simulator_t *protocol, const unsigned char data[], unsigned int size)
+{
+	dc_simulator_record_t record;
+
+	switch (data[0]) {
+	case RDBI:
+		if (size != 3 || !dc_simulator_record_find (protocol->data, protocol->size, array_uint16_be (data + 1), &record) ||
+			record.size > SZ_PACKET - 3) {
+			shearwater_simulator_negative (protocol, RDBI, 0x31);
+		} else {
+			unsigned char answer[SZ_PACKET];
+			answer[0] = RDBI + 0x40;
+			answer[1] = data[1];
+			answer[2] = data[2];
+			memcpy (answer + 3, record.data, record.size);
+			shearwater_simulator_answer (protocol, answer, 3 + record.size);
+		}
+		break;
+	case WDBI:
+		// Only used to shutdown the device, which doesn't answer.
+		break;
+	case INIT:
+		shearwater_simulator_init (protocol, data, size);
+		break;
+	case BLOCK:
+		shearwater_simulator_block (protocol, data, size);
+		break;
+	case QUIT:
+		{
+			const unsigned char answer[] = {QUIT + 0x40, 0x00};
+			shearwater_simulator_answer (protocol, answer, sizeof (answer));
+		}
+		break;
+	default:
+		WARNING (protocol->base.context, "Unsupported command (%02x).", data[0]);
+		shearwater_simulator_negative (protocol, data[0], 0x11);
+		break;
+	}
+}
+
+static size_t
+shearwater_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size)
+{
+	shearwater_simulator_t *protocol = (shearwater_simulator_t *) abstract;
+	unsigned char packet[SZ_PACKET + 4];
+	unsigned int escaped = 0;
+	unsigned int nbytes = 0;
+
+	// Wait for the end of the frame.
+	size_t end = 0;
+	while (end < size && data[end] != END)
+		end++;
+	if (end == size)
+		return 0;
+
+	for (size_t i = 0; i < end; ++i) {
+		unsigned char c = data[i];
+		if (escaped) {
+			c = (c == ESC_END) ? END : (c == ESC_ESC) ? ESC : c;
+			escaped = 0;
+		} else if (c == ESC) {
+			escaped = 1;
+			continue;
+		}
+
+		if (nbytes < sizeof (packet))
+			packet[nbytes] = c;
+		nbytes++;
+	}
+
+	// Empty frames are ignored.
+	if (nbytes == 0)
+		return end + 1;
+
+	if (nbytes > sizeof (packet) || nbytes < 5 ||
+		packet[0] != 0xFF || packet[1] != 0x01 || packet[3] != 0x00 ||
+		packet[2] != nbytes - 4 + 1) {
+		WARNING (abstract->context, "Invalid request packet.");
+		return end + 1;
+	}
+
+	shearwater_simulator_request (protocol, packet + 4, nbytes - 4);
+
+	return end + 1;
+}
@@ -0,0 +1,104 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SIMULATOR_PRIVATE_H
+#define DC_SIMULATOR_PRIVATE_H
+
+#include <libdivecomputer/simulator.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_simulator_t dc_simulator_t;
+typedef struct dc_simulator_protocol_t dc_simulator_protocol_t;
+typedef struct dc_simulator_protocol_vtable_t dc_simulator_protocol_vtable_t;
+
+struct dc_simulator_protocol_t {
+	const dc_simulator_protocol_vtable_t *vtable;
+	dc_simulator_t *simulator;
+	dc_context_t *context;
+	dc_transport_t transport;
+};
+
+struct dc_simulator_protocol_vtable_t {
+	size_t size;
+
+	/*
+	 * Process the data sent by the host. Returns the number of bytes
+	 * consumed, or zero if a complete request is not available yet.
+	 */
+	size_t (*process) (dc_simulator_protocol_t *protocol, const unsigned char data[], size_t size);
+
+	void (*destroy) (dc_simulator_protocol_t *protocol);
+};
+
+typedef struct dc_simulator_record_t {
+	unsigned int key;
+	const unsigned char *data;
+	unsigned int size;
+} dc_simulator_record_t;
+
+dc_simulator_protocol_t *
+dc_simulator_protocol_allocate (dc_simulator_t *simulator, const dc_simulator_protocol_vtable_t *vtable);
+
+void
+dc_simulator_protocol_deallocate (dc_simulator_protocol_t *protocol);
+
+/*
+ * Send a single packet to the host.
+ */
+dc_status_t
+dc_simulator_reply (dc_simulator_t *simulator, const unsigned char data[], size_t size);
+
+/*
+ * Get the next record from a list of records. Returns one if a record
+ * is available, zero at the end, and a negative value for a truncated
+ * record.
+ */
+int
+dc_simulator_record_next (const unsigned char data[], size_t size, size_t *offset, dc_simulator_record_t *record);
+
+/*
+ * Find the record with the key. Returns zero if not found.
+ */
+int
+dc_simulator_record_find (const unsigned char data[], size_t size, unsigned int key, dc_simulator_record_t *record);
+
+dc_status_t
+suunto_common2_simulator_create (dc_simulator_protocol_t **protocol, dc_simulator_t *simulator, unsigned int echo, const unsigned char data[], size_t size);
+
+dc_status_t
+oceanic_atom2_simulator_create (dc_simulator_protocol_t **protocol, dc_simulator_t *simulator, const unsigned char data[], size_t size);
+
+dc_status_t
+shearwater_simulator_create (dc_simulator_protocol_t **protocol, dc_simulator_t *simulator, const unsigned char data[], size_t size);
+
+dc_status_t
+hw_ostc3_simulator_create (dc_simulator_protocol_t **protocol, dc_simulator_t *simulator, const unsigned char data[], size_t size);
+
+dc_status_t
+suunto_eonsteel_simulator_create (dc_simulator_protocol_t **protocol, dc_simulator_t *simulator, const unsigned char data[], size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SIMULATOR_PRIVATE_H */
@@ -0,0 +1,585 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <string.h> // memcpy
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#include <windows.h>
+#else
+#include <time.h>   // nanosleep
+#include <errno.h>
+#endif
+
+#include <libdivecomputer/buffer.h>
+
+#include "simulator-private.h"
+#include "iostream-private.h"
+#include "common-private.h"
+#include "context-private.h"
+#include "buffer-private.h"
+#include "array.h"
+#include "timer.h"
+#include "platform.h"
+
+#define NEVER ((dc_usecs_t) -1)
+
+static dc_status_t dc_simulator_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_simulator_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_simulator_poll (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_simulator_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_simulator_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_simulator_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_simulator_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_simulator_close (dc_iostream_t *abstract);
+
+typedef struct dc_simulator_packet_t {
+	struct dc_simulator_packet_t *next;
+	dc_usecs_t ready;
+	size_t size;
+	size_t offset;
+	unsigned char data[1];
+} dc_simulator_packet_t;
+
+struct dc_simulator_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_simulator_protocol_t *protocol;
+	dc_simulator_link_t link;
+	unsigned int datagram;
+	int timeout;
+	unsigned int random;
+	dc_buffer_t *input;
+	dc_simulator_packet_t *head, *tail;
+	dc_timer_t *timer;
+	dc_usecs_t uplink;
+	dc_usecs_t downlink;
+	dc_usecs_t arrival;
+};
+
+static const dc_iostream_vtable_t dc_simulator_vtable = {
+	sizeof(dc_simulator_t),
+	dc_simulator_set_timeout, /* set_timeout */
+	NULL, /* set_break */
+	NULL, /* set_dtr */
+	NULL, /* set_rts */
+	NULL, /* get_lines */
+	dc_simulator_get_available, /* get_available */
+	NULL, /* configure */
+	dc_simulator_poll, /* poll */
+	dc_simulator_read, /* read */
+	dc_simulator_write, /* write */
+	NULL, /* writev */
+	NULL, /* ioctl */
+	NULL, /* flush */
+	dc_simulator_purge, /* purge */
+	dc_simulator_sleep, /* sleep */
+	NULL, /* interrupt */
+	dc_simulator_close, /* close */
+};
+
+dc_status_t
+dc_simulator_open (dc_iostream_t **out, dc_context_t *context, dc_family_t family, const unsigned char data[], size_t size, const dc_simulator_link_t *link)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_simulator_t *simulator = NULL;
+
+	if (out == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	// Get the supported and the default transport.
+	unsigned int transports = DC_TRANSPORT_SERIAL;
+	dc_transport_t transport = DC_TRANSPORT_SERIAL;
+	if (family == DC_FAMILY_SUUNTO_EONSTEEL) {
+		transports = DC_TRANSPORT_USBHID | DC_TRANSPORT_BLE;
+		transport = DC_TRANSPORT_USBHID;
+	}
+
+	if (link && link->transport != DC_TRANSPORT_NONE)
+		transport = link->transport;
+
+	if ((transports & transport) == 0) {
+		ERROR (context, "Unsupported transport type (%u).", transport);
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	INFO (context, "Simulator: family=%08x, transport=%u, latency=%u, bandwidth=%u, loss=%u",
+		family, transport,
+		link ? link->latency : 0,
+		link ? link->bandwidth : 0,
+		link ? link->loss : 0);
+
+	// Allocate memory.
+	simulator = (dc_simulator_t *) dc_iostream_allocate (context, &dc_simulator_vtable, transport);
+	if (simulator == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	simulator->protocol = NULL;
+	memset (&simulator->link, 0, sizeof (simulator->link));
+	if (link)
+		simulator->link = *link;
+	simulator->link.transport = transport;
+	simulator->datagram = (transport == DC_TRANSPORT_USBHID || transport == DC_TRANSPORT_BLE);
+	simulator->timeout = -1;
+	simulator->random = simulator->link.seed ? simulator->link.seed : 1;
+	simulator->input = NULL;
+	simulator->head = NULL;
+	simulator->tail = NULL;
+	simulator->timer = NULL;
+	simulator->uplink = 0;
+	simulator->downlink = 0;
+	simulator->arrival = 0;
+
+	status = dc_timer_new (&simulator->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	simulator->input = dc_buffer_allocate (context, 0);
+	if (simulator->input == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_timer_free;
+	}
+
+	switch (family) {
+#ifdef ENABLE_BACKEND_SUUNTO
+	case DC_FAMILY_SUUNTO_VYPER2:
+		status = suunto_common2_simulator_create (&simulator->protocol, simulator, 0, data, size);
+		break;
+	case DC_FAMILY_SUUNTO_D9:
+		status = suunto_common2_simulator_create (&simulator->protocol, simulator, 1, data, size);
+		break;
+	case DC_FAMILY_SUUNTO_EONSTEEL:
+		status = suunto_eonsteel_simulator_create (&simulator->protocol, simulator, data, size);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
+	case DC_FAMILY_OCEANIC_ATOM2:
+		status = oceanic_atom2_simulator_create (&simulator->protocol, simulator, data, size);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
+	case DC_FAMILY_SHEARWATER_PREDATOR:
+	case DC_FAMILY_SHEARWATER_PETREL:
+		status = shearwater_simulator_create (&simulator->protocol, simulator, data, size);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_HW
+	case DC_FAMILY_HW_OSTC3:
+		status = hw_ostc3_simulator_create (&simulator->protocol, simulator, data, size);
+		break;
+#endif
+	default:
+		ERROR (context, "Unsupported device family (%08x).", family);
+		status = DC_STATUS_UNSUPPORTED;
+		break;
+	}
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_buffer_free;
+	}
+
+	*out = (dc_iostream_t *) simulator;
+
+	return DC_STATUS_SUCCESS;
+
+error_buffer_free:
+	dc_buffer_free (simulator->input);
+error_timer_free:
+	dc_timer_free (simulator->timer);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) simulator);
+	return status;
+}
+
+dc_simulator_protocol_t *
+dc_simulator_protocol_allocate (dc_simulator_t *simulator, const dc_simulator_protocol_vtable_t *vtable)
+{
+	dc_simulator_protocol_t *protocol = NULL;
+
+	assert(vtable != NULL);
+	assert(vtable->size >= sizeof(dc_simulator_protocol_t));
+
+	// Allocate memory.
+	protocol = (dc_simulator_protocol_t *) dc_context_malloc (simulator->base.context, vtable->size);
+	if (protocol == NULL) {
+		ERROR (simulator->base.context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	protocol->vtable = vtable;
+	protocol->simulator = simulator;
+	protocol->context = simulator->base.context;
+	protocol->transport = simulator->base.transport;
+
+	return protocol;
+}
+
+void
+dc_simulator_protocol_deallocate (dc_simulator_protocol_t *protocol)
+{
+	dc_context_dealloc (protocol->context, protocol);
+}
+
+int
+dc_simulator_record_next (const unsigned char data[], size_t size, size_t *offset, dc_simulator_record_t *record)
+{
+	if (*offset >= size)
+		return 0;
+
+	if (size - *offset < 8)
+		return -1;
+
+	unsigned int length = array_uint32_le (data + *offset + 4);
+	if (length > size - *offset - 8)
+		return -1;
+
+	record->key = array_uint32_le (data + *offset);
+	record->data = data + *offset + 8;
+	record->size = length;
+
+	*offset += 8 + length;
+
+	return 1;
+}
+
+int
+dc_simulator_record_find (const unsigned char data[], size_t size, unsigned int key, dc_simulator_record_t *record)
+{
+	size_t offset = 0;
+	while (dc_simulator_record_next (data, size, &offset, record) > 0) {
+		if (record->key == key)
+			return 1;
+	}
+
+	return 0;
+}
+
+static dc_usecs_t
+dc_simulator_now (dc_simulator_t *simulator)
+{
+	dc_usecs_t now = 0;
+	dc_timer_now (simulator->timer, &now);
+	return now;
+}
+
+static void
+dc_simulator_wait (dc_simulator_t *simulator, dc_usecs_t target)
+{
+	dc_usecs_t now = dc_simulator_now (simulator);
+	if (now >= target)
+		return;
+
+	dc_usecs_t remaining = target - now;
+#ifdef _WIN32
+	Sleep ((DWORD) ((remaining + 999) / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec  = (remaining / 1000000);
+	ts.tv_nsec = (remaining % 1000000) * 1000;
+	while (nanosleep (&ts, &ts) != 0) {
+		if (errno != EINTR)
+			break;
+	}
+#endif
+}
+
+static dc_usecs_t
+dc_simulator_deadline (dc_simulator_t *simulator, int timeout)
+{
+	if (timeout < 0)
+		return NEVER;
+
+	return dc_simulator_now (simulator) + (dc_usecs_t) timeout * 1000;
+}
+
+/*
+ * Time needed to transmit the data over the link.
+ */
+static dc_usecs_t
+dc_simulator_transmit (dc_simulator_t *simulator, size_t size)
+{
+	if (simulator->link.bandwidth == 0)
+		return 0;
+
+	return (dc_usecs_t) size * 1000000 / simulator->link.bandwidth;
+}
+
+static unsigned int
+dc_simulator_lost (dc_simulator_t *simulator)
+{
+	if (simulator->link.loss == 0)
+		return 0;
+
+	// Xorshift pseudo random generator, which produces the same
+	// sequence of lost packets for the same seed on every platform.
+	unsigned int x = simulator->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	simulator->random = x;
+
+	return (x % 1000000) < simulator->link.loss;
+}
+
+dc_status_t
+dc_simulator_reply (dc_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	// The packet is sent after the request arrived, and once the
+	// previous packets have left the device.
+	dc_usecs_t start = simulator->arrival > simulator->downlink ? simulator->arrival : simulator->downlink;
+	simulator->downlink = start + dc_simulator_transmit (simulator, size);
+
+	if (dc_simulator_lost (simulator)) {
+		WARNING (simulator->base.context, "Simulated loss of a packet (" DC_PRINTF_SIZE " bytes).", size);
+		return DC_STATUS_SUCCESS;
+	}
+
+	dc_simulator_packet_t *packet = (dc_simulator_packet_t *) dc_context_malloc (simulator->base.context, sizeof (dc_simulator_packet_t) + size);
+	if (packet == NULL) {
+		ERROR (simulator->base.context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	packet->next = NULL;
+	packet->ready = simulator->downlink + simulator->link.latency;
+	packet->size = size;
+	packet->offset = 0;
+	if (size)
+		memcpy (packet->data, data, size);
+
+	if (simulator->tail)
+		simulator->tail->next = packet;
+	else
+		simulator->head = packet;
+	simulator->tail = packet;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_simulator_pop (dc_simulator_t *simulator)
+{
+	dc_simulator_packet_t *packet = simulator->head;
+
+	simulator->head = packet->next;
+	if (simulator->head == NULL)
+		simulator->tail = NULL;
+
+	dc_context_dealloc (simulator->base.context, packet);
+}
+
+/*
+ * Wait until the first packet has arrived, or the deadline expires.
+ */
+static dc_status_t
+dc_simulator_receive (dc_simulator_t *simulator, dc_usecs_t deadline)
+{
+	dc_usecs_t now = dc_simulator_now (simulator);
+
+	while (simulator->head == NULL || simulator->head->ready > now) {
+		if (now >= deadline)
+			return DC_STATUS_TIMEOUT;
+
+		// Nothing is in transit, and nothing will arrive before the deadline.
+		if (simulator->head == NULL && deadline == NEVER)
+			return DC_STATUS_TIMEOUT;
+
+		dc_usecs_t target = deadline;
+		if (simulator->head && simulator->head->ready < target)
+			target = simulator->head->ready;
+
+		dc_simulator_wait (simulator, target);
+		now = dc_simulator_now (simulator);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_simulator_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+
+	simulator->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_simulator_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+	dc_usecs_t now = dc_simulator_now (simulator);
+	size_t available = 0;
+
+	for (dc_simulator_packet_t *packet = simulator->head; packet && packet->ready <= now; packet = packet->next) {
+		available += packet->size - packet->offset;
+		if (simulator->datagram)
+			break;
+	}
+
+	*value = available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_simulator_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+
+	return dc_simulator_receive (simulator, dc_simulator_deadline (simulator, timeout));
+}
+
+static dc_status_t
+dc_simulator_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+	dc_usecs_t deadline = dc_simulator_deadline (simulator, simulator->timeout);
+	unsigned char *p = (unsigned char *) data;
+	size_t nbytes = 0;
+
+	while (nbytes < size) {
+		status = dc_simulator_receive (simulator, deadline);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+
+		dc_simulator_packet_t *packet = simulator->head;
+
+		size_t length = packet->size - packet->offset;
+		if (length > size - nbytes)
+			length = size - nbytes;
+
+		memcpy (p + nbytes, packet->data + packet->offset, length);
+		packet->offset += length;
+		nbytes += length;
+
+		// A datagram is received as a whole, and the excess bytes are
+		// discarded. On a byte stream, the remainder is kept.
+		if (simulator->datagram || packet->offset == packet->size)
+			dc_simulator_pop (simulator);
+
+		if (simulator->datagram)
+			break;
+	}
+
+	*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_simulator_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+	dc_simulator_protocol_t *protocol = simulator->protocol;
+	dc_usecs_t now = dc_simulator_now (simulator);
+
+	// The request arrives at the device once all bytes are transmitted.
+	dc_usecs_t start = now > simulator->uplink ? now : simulator->uplink;
+	simulator->uplink = start + dc_simulator_transmit (simulator, size);
+	simulator->arrival = simulator->uplink + simulator->link.latency;
+
+	if (!dc_buffer_append (simulator->input, (const unsigned char *) data, size)) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Process all complete requests.
+	while (dc_buffer_get_size (simulator->input)) {
+		const unsigned char *input = dc_buffer_get_data (simulator->input);
+		size_t length = dc_buffer_get_size (simulator->input);
+
+		size_t n = protocol->vtable->process (protocol, input, length);
+		if (n == 0)
+			break;
+
+		if (n > length)
+			n = length;
+
+		dc_buffer_slice (simulator->input, n, length - n);
+	}
+
+	*actual = size;
+
+	return status;
+}
+
+static dc_status_t
+dc_simulator_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+
+	if (direction & DC_DIRECTION_INPUT) {
+		// Packets still in transit are not affected.
+		dc_usecs_t now = dc_simulator_now (simulator);
+		while (simulator->head && simulator->head->ready <= now)
+			dc_simulator_pop (simulator);
+	}
+
+	if (direction & DC_DIRECTION_OUTPUT) {
+		dc_buffer_clear (simulator->input);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_simulator_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+
+	dc_simulator_wait (simulator, dc_simulator_now (simulator) + (dc_usecs_t) milliseconds * 1000);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_simulator_close (dc_iostream_t *abstract)
+{
+	dc_simulator_t *simulator = (dc_simulator_t *) abstract;
+	dc_simulator_protocol_t *protocol = simulator->protocol;
+
+	if (protocol->vtable->destroy)
+		protocol->vtable->destroy (protocol);
+	dc_simulator_protocol_deallocate (protocol);
+
+	while (simulator->head)
+		dc_simulator_pop (simulator);
+
+	dc_buffer_free (simulator->input);
+	dc_timer_free (simulator->timer);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -19,11 +19,16 @@
  * MA 02110-1301 USA
  */
 
+#include <string.h>
+
 #include "socket.h"
 
 #include "common-private.h"
 #include "context-private.h"
 
+// The size of the kernel receive buffer.
+#define RCVBUF 65536
+
 dc_status_t
 dc_socket_syserror (s_errcode_t errcode)
 {
@@ -91,6 +96,10 @@ dc_socket_open (dc_iostream_t *abstract, int family, int type, int protocol)
 	// Default to blocking reads.
 	device->timeout = -1;
 
+	// Empty receive buffer.
+	device->offset = 0;
+	device->available = 0;
+
 	// Initialize the socket library.
 	status = dc_socket_init (abstract->context);
 	if (status != DC_STATUS_SUCCESS) {
@@ -106,8 +115,45 @@ dc_socket_open (dc_iostream_t *abstract, int family, int type, int protocol)
 		goto error;
 	}
 
+	// Enlarge the receive buffer, to avoid losing data when the
+	// application can't keep up. This is only a hint, and failure is
+	// not fatal.
+	int rcvbuf = RCVBUF;
+	if (setsockopt (device->fd, SOL_SOCKET, SO_RCVBUF, (const char *) &rcvbuf, sizeof (rcvbuf)) != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		WARNING (abstract->context, "Failed to set the receive buffer size (%d).", (int) errcode);
+	}
+
+#ifndef _WIN32
+	// Create the wakeup pipe.
+	if (pipe (device->wakeup) != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (abstract->context, errcode);
+		status = dc_socket_syserror(errcode);
+		goto error_close;
+	}
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		int flags = fcntl (device->wakeup[i], F_GETFL);
+		if (flags == -1 || fcntl (device->wakeup[i], F_SETFL, flags | O_NONBLOCK) != 0 ||
+			fcntl (device->wakeup[i], F_SETFD, FD_CLOEXEC) != 0) {
+			s_errcode_t errcode = S_ERRNO;
+			SYSERROR (abstract->context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto error_pipe_close;
+		}
+	}
+#endif
+
 	return DC_STATUS_SUCCESS;
 
+#ifndef _WIN32
+error_pipe_close:
+	close (device->wakeup[0]);
+	close (device->wakeup[1]);
+error_close:
+	S_CLOSE (device->fd);
+#endif
 error:
 	dc_socket_exit (abstract->context);
 	return status;
@@ -130,6 +176,11 @@ dc_socket_close (dc_iostream_t *abstract)
 		dc_status_set_error(&status, dc_socket_syserror(errcode));
 	}
 
+#ifndef _WIN32
+	close (socket->wakeup[0]);
+	close (socket->wakeup[1]);
+#endif
+
 	// Terminate the socket library.
 	rc = dc_socket_exit (abstract->context);
 	if (rc != DC_STATUS_SUCCESS) {
@@ -181,21 +232,67 @@ dc_socket_get_available (dc_iostream_t *abstract, size_t *value)
 	}
 
 	if (value)
-		*value = bytes;
+		*value = socket->available + bytes;
 
 	return DC_STATUS_SUCCESS;
 }
 
+static int
+dc_socket_nfds (dc_socket_t *socket)
+{
+#ifdef _WIN32
+	// The first argument of select is ignored on Windows.
+	return 0;
+#else
+	return (socket->fd > socket->wakeup[0] ? socket->fd : socket->wakeup[0]) + 1;
+#endif
+}
+
+#ifndef _WIN32
+static dc_status_t
+dc_socket_interrupted (dc_socket_t *socket)
+{
+	// Drain the wakeup pipe.
+	char buffer[16];
+	while (read (socket->wakeup[0], buffer, sizeof (buffer)) > 0)
+		;
+
+	return DC_STATUS_CANCELLED;
+}
+
+dc_status_t
+dc_socket_interrupt (dc_iostream_t *abstract)
+{
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	// Only a single byte is needed. If the pipe is already full, a
+	// wakeup is pending anyway.
+	ssize_t n = 0;
+	do {
+		n = write (socket->wakeup[1], "", 1);
+	} while (n < 0 && errno == EINTR);
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
+
 dc_status_t
 dc_socket_poll (dc_iostream_t *abstract, int timeout)
 {
 	dc_socket_t *socket = (dc_socket_t *) abstract;
 	int rc = 0;
 
+	// Data in the receive buffer is available immediately.
+	if (socket->available)
+		return DC_STATUS_SUCCESS;
+
+	fd_set fds;
 	do {
-		fd_set fds;
 		FD_ZERO (&fds);
 		FD_SET (socket->fd, &fds);
+#ifndef _WIN32
+		FD_SET (socket->wakeup[0], &fds);
+#endif
 
 		struct timeval tv, *ptv = NULL;
 		if (timeout > 0) {
@@ -208,7 +305,7 @@ dc_socket_poll (dc_iostream_t *abstract, int timeout)
 			ptv = &tv;
 		}
 
-		rc = select (socket->fd + 1, &fds, NULL, NULL, ptv);
+		rc = select (dc_socket_nfds (socket), &fds, NULL, NULL, ptv);
 	} while (rc < 0 && S_ERRNO == S_EINTR);
 
 	if (rc < 0) {
@@ -217,6 +314,10 @@ dc_socket_poll (dc_iostream_t *abstract, int timeout)
 		return dc_socket_syserror(errcode);
 	} else if (rc == 0) {
 		return DC_STATUS_TIMEOUT;
+#ifndef _WIN32
+	} else if (FD_ISSET (socket->wakeup[0], &fds)) {
+		return dc_socket_interrupted (socket);
+#endif
 	} else {
 		return DC_STATUS_SUCCESS;
 	}
@@ -230,9 +331,26 @@ dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	size_t nbytes = 0;
 
 	while (nbytes < size) {
+		// Serve the data from the receive buffer first.
+		if (socket->available) {
+			size_t length = size - nbytes;
+			if (length > socket->available)
+				length = socket->available;
+
+			memcpy ((char *) data + nbytes, socket->buffer + socket->offset, length);
+
+			socket->offset += length;
+			socket->available -= length;
+			nbytes += length;
+			continue;
+		}
+
 		fd_set fds;
 		FD_ZERO (&fds);
 		FD_SET (socket->fd, &fds);
+#ifndef _WIN32
+		FD_SET (socket->wakeup[0], &fds);
+#endif
 
 		struct timeval tvt;
 		if (socket->timeout > 0) {
@@ -242,7 +360,7 @@ dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			timerclear (&tvt);
 		}
 
-		int rc = select (socket->fd + 1, &fds, NULL, NULL, socket->timeout >= 0 ? &tvt : NULL);
+		int rc = select (dc_socket_nfds (socket), &fds, NULL, NULL, socket->timeout >= 0 ? &tvt : NULL);
 		if (rc < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR)
@@ -254,7 +372,24 @@ dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			break; // Timeout.
 		}
 
-		s_ssize_t n = recv (socket->fd, (char *) data + nbytes, size - nbytes, 0);
+#ifndef _WIN32
+		if (FD_ISSET (socket->wakeup[0], &fds)) {
+			status = dc_socket_interrupted (socket);
+			goto out;
+		}
+#endif
+
+		// Large reads are received directly into the caller's buffer.
+		// Small reads are received into the receive buffer, in order to
+		// receive as much data as possible with a single system call.
+		int direct = (size - nbytes >= sizeof (socket->buffer));
+
+		s_ssize_t n = 0;
+		if (direct) {
+			n = recv (socket->fd, (char *) data + nbytes, size - nbytes, 0);
+		} else {
+			n = recv (socket->fd, (char *) socket->buffer, sizeof (socket->buffer), 0);
+		}
 		if (n < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR || errcode == S_EAGAIN)
@@ -266,7 +401,12 @@ dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			break; // EOF reached.
 		}
 
-		nbytes += n;
+		if (direct) {
+			nbytes += n;
+		} else {
+			socket->offset = 0;
+			socket->available = n;
+		}
 	}
 
 	if (nbytes != size) {
@@ -288,11 +428,15 @@ dc_socket_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	size_t nbytes = 0;
 
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (socket->fd, &fds);
+		fd_set rfds, wfds;
+		FD_ZERO (&rfds);
+		FD_ZERO (&wfds);
+		FD_SET (socket->fd, &wfds);
+#ifndef _WIN32
+		FD_SET (socket->wakeup[0], &rfds);
+#endif
 
-		int rc = select (socket->fd + 1, NULL, &fds, NULL, NULL);
+		int rc = select (dc_socket_nfds (socket), &rfds, &wfds, NULL, NULL);
 		if (rc < 0) {
 			s_errcode_t errcode = S_ERRNO;
 			if (errcode == S_EINTR)
@@ -304,6 +448,13 @@ dc_socket_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 			break; // Timeout.
 		}
 
+#ifndef _WIN32
+		if (FD_ISSET (socket->wakeup[0], &rfds)) {
+			status = dc_socket_interrupted (socket);
+			goto out;
+		}
+#endif
+
 		s_ssize_t n = send (socket->fd, (const char *) data + nbytes, size - nbytes, 0);
 		if (n < 0) {
 			s_errcode_t errcode = S_ERRNO;
@@ -29,7 +29,8 @@
 #include <windows.h>
 #else
 #include <errno.h>      // errno
-#include <unistd.h>     // close
+#include <unistd.h>     // close, pipe
+#include <fcntl.h>      // fcntl
 #include <sys/types.h>  // socket, getsockopt
 #include <sys/socket.h> // socket, getsockopt
 #include <sys/select.h> // select
@@ -79,10 +80,20 @@ typedef socklen_t s_socklen_t;
 extern "C" {
 #endif /* __cplusplus */
 
+#define DC_SOCKET_BUFSIZE 1024
+
 typedef struct dc_socket_t {
 	dc_iostream_t base;
 	s_socket_t fd;
 	int timeout;
+#ifndef _WIN32
+	int wakeup[2];
+#endif
+	// Receive buffer. Small reads are served from this buffer, to avoid
+	// a system call for every few bytes.
+	unsigned char buffer[DC_SOCKET_BUFSIZE];
+	size_t offset;
+	size_t available;
 } dc_socket_t;
 
 dc_status_t
@@ -124,6 +135,13 @@ dc_socket_ioctl (dc_iostream_t *iostream, unsigned int request, void *data, size
 dc_status_t
 dc_socket_sleep (dc_iostream_t *abstract, unsigned int timeout);
 
+#ifdef _WIN32
+#define dc_socket_interrupt NULL
+#else
+dc_status_t
+dc_socket_interrupt (dc_iostream_t *abstract);
+#endif
+
 dc_status_t
 dc_socket_close (dc_iostream_t *iostream);
 
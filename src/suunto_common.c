@@ -19,11 +19,11 @@
  * MA 02110-1301 USA
  */
 
-#include <stdlib.h> // malloc
 #include <string.h> // memcpy, memcmp
 #include <assert.h> // assert
 
 #include "suunto_common.h"
+#include "context-private.h"
 #include "ringbuffer.h"
 #include "array.h"
 
@@ -62,6 +62,8 @@ suunto_common_device_set_fingerprint (dc_device_t *abstract, const unsigned char
 dc_status_t
 suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common_layout_t *layout, const unsigned char data[], dc_dive_callback_t callback, void *userdata)
 {
+	dc_context_t *context = (device ? device->base.context : NULL);
+
 	assert (layout != NULL);
 
 	unsigned int eop;
@@ -87,11 +89,15 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	// Memory buffer for the profile ringbuffer.
+	// Memory buffer for the profile ringbuffer. Views don't need a copy.
 	unsigned int length = layout->rb_profile_end - layout->rb_profile_begin;
-	unsigned char *buffer = (unsigned char *) malloc (length);
-	if (buffer == NULL)
-		return DC_STATUS_NOMEMORY;
+	unsigned int view = (device && device_has_view (&device->base));
+	unsigned char *buffer = NULL;
+	if (!view) {
+		buffer = (unsigned char *) dc_context_malloc (context, length);
+		if (buffer == NULL)
+			return DC_STATUS_NOMEMORY;
+	}
 
 	unsigned int current = eop;
 	unsigned int previous = eop;
@@ -110,6 +116,37 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		unsigned int idx = RB_PROFILE_PEEK (current, layout);
 		if (data[idx] == 0x80) {
 			unsigned int len = RB_PROFILE_DISTANCE (current, previous, layout);
+
+			// Deliver the dive as a view into the ringbuffer, without
+			// copying the data.
+			if (view) {
+				unsigned int a = len, b = 0;
+				if (current + len > layout->rb_profile_end) {
+					a = layout->rb_profile_end - current;
+					b = len - a;
+				}
+
+				// The fingerprint may be split by the wrap point.
+				unsigned char fingerprint[sizeof (device->fingerprint)];
+				for (unsigned int j = 0; j < sizeof (fingerprint); ++j) {
+					unsigned int k = layout->fp_offset + j;
+					fingerprint[j] = (k < a ? data[current + k] : data[layout->rb_profile_begin + k - a]);
+				}
+
+				if (memcmp (fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+					dc_context_dealloc (context, buffer);
+					return DC_STATUS_SUCCESS;
+				}
+
+				if (!device_dive_view_emit (&device->base, data + current, a, data + layout->rb_profile_begin, b, fingerprint, sizeof (fingerprint))) {
+					dc_context_dealloc (context, buffer);
+					return DC_STATUS_SUCCESS;
+				}
+
+				previous = current;
+				continue;
+			}
+
 			if (current + len > layout->rb_profile_end) {
 				unsigned int a = layout->rb_profile_end - current;
 				unsigned int b = (current + len) - layout->rb_profile_end;
@@ -120,12 +157,12 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 			}
 
 			if (device && memcmp (buffer + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
-				free (buffer);
+				dc_context_dealloc (context, buffer);
 				return DC_STATUS_SUCCESS;
 			}
 
 			if (callback && !callback (buffer, len, buffer + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
-				free (buffer);
+				dc_context_dealloc (context, buffer);
 				return DC_STATUS_SUCCESS;
 			}
 
@@ -133,7 +170,7 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		}
 	}
 
-	free (buffer);
+	dc_context_dealloc (context, buffer);
 
 	if (data[current] != 0x82)
 		return DC_STATUS_DATAFORMAT;
@@ -19,7 +19,6 @@
  * MA 02110-1301 USA
  */
 
-#include <stdlib.h> // malloc
 #include <string.h> // memcmp, memcpy
 #include <assert.h> // assert
 
@@ -35,6 +34,9 @@
 #define SZ_VERSION    0x04
 #define SZ_PACKET     0x78
 #define SZ_MINIMUM    8
+#define SZ_STATE      (4 + sizeof (((suunto_common2_device_t *) NULL)->fingerprint))
+
+#define PREFETCH 4
 
 #define RB_PROFILE_DISTANCE(l,a,b,m)  ringbuffer_distance (a, b, m, l->rb_profile_begin, l->rb_profile_end)
 
@@ -65,19 +67,22 @@ suunto_common2_transfer (dc_device_t *abstract, const unsigned char command[], u
 	// returning an error. Usually the dive computer will respond
 	// again during one of the retries.
 
-	unsigned int nretries = 0;
+	device_retry_t retry;
+	device_retry_init (&retry, abstract, MAXRETRIES, 0);
+
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = VTABLE (abstract)->packet (abstract, command, csize, answer, asize, size)) != DC_STATUS_SUCCESS) {
+		// Report the outcome to the pacing of the packet function.
+		device_pacing_update (abstract, 0, rc);
+
 		// Automatically discard a corrupted packet,
 		// and request a new one.
-		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
-			return rc;
-
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		if (!device_retry_next (&retry, NULL, rc))
 			return rc;
 	}
 
+	device_pacing_update (abstract, 0, rc);
+
 	return rc;
 }
 
@@ -218,8 +223,58 @@ suunto_common2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), SZ_PACKET);
+	return device_dump_read_adaptive (abstract, dc_buffer_get_data (buffer),
+		dc_buffer_get_size (buffer), SZ_PACKET, 8);
+}
+
+
+static dc_status_t
+suunto_common2_device_check_state (dc_device_t *abstract, const unsigned char state[], unsigned int last, unsigned int end, unsigned int remaining)
+{
+	suunto_common2_device_t *device = (suunto_common2_device_t*) abstract;
+	const suunto_common2_layout_t *layout = device->layout;
+
+	unsigned int cached_end  = array_uint16_le (state + 0);
+	unsigned int cached_last = array_uint16_le (state + 2);
+	if (cached_last < layout->rb_profile_begin ||
+		cached_last >= layout->rb_profile_end ||
+		cached_end < layout->rb_profile_begin ||
+		cached_end >= layout->rb_profile_end)
+		return DC_STATUS_DATAFORMAT;
+
+	// Without new dives, both pointers should be unchanged.
+	if (cached_end == end && cached_last != last)
+		return DC_STATUS_DATAFORMAT;
+
+	// The cached dive should not be overwritten (partially) by the
+	// new dives.
+	if (RB_PROFILE_DISTANCE (layout, cached_last, end, 1) > remaining ||
+		RB_PROFILE_DISTANCE (layout, cached_last, cached_end, 1) > RB_PROFILE_DISTANCE (layout, cached_last, end, 1))
+		return DC_STATUS_DATAFORMAT;
+
+	// Read the fingerprint of the cached dive, which may cross the
+	// ringbuffer wrap point.
+	dc_ringbuffer_t rb_profile;
+	dc_ringbuffer_init (&rb_profile, layout->rb_profile_begin, layout->rb_profile_end);
+
+	dc_ringbuffer_span_t span[2];
+	unsigned char fingerprint[sizeof (device->fingerprint)] = {0};
+	unsigned int address = dc_ringbuffer_increment (&rb_profile, cached_last, layout->fingerprint + 4);
+	unsigned int count = dc_ringbuffer_spans (&rb_profile, address, sizeof (fingerprint), span);
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_status_t rc = suunto_common2_device_read (abstract, span[i].address, fingerprint + offset, span[i].length);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+		offset += span[i].length;
+	}
+
+	if (memcmp (fingerprint, state + 4, sizeof (fingerprint)) != 0) {
+		WARNING (abstract->context, "The cached dive is no longer present.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return DC_STATUS_SUCCESS;
 }
 
 
@@ -304,21 +359,48 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		remaining = RB_PROFILE_DISTANCE (layout, begin, end, count != 0);
 	}
 
+	// Load the state of the previous download. It contains the end and
+	// last pointers, and the fingerprint of the most recent dive at that
+	// time. If that dive is still present, all older dives have already
+	// been processed, and only the new profile data needs to be read.
+	unsigned char state[SZ_STATE] = {0};
+	if (callback != NULL && device_state_load (abstract, state, sizeof (state))) {
+		rc = suunto_common2_device_check_state (abstract, state, last, end, remaining);
+		if (rc == DC_STATUS_SUCCESS) {
+			remaining = RB_PROFILE_DISTANCE (layout, array_uint16_le (state + 0), end, 0);
+		} else if (rc != DC_STATUS_DATAFORMAT) {
+			ERROR (abstract->context, "Failed to read the dive header.");
+			return rc;
+		}
+	}
+
 	// Update and emit a progress event.
 	progress.maximum -= (layout->rb_profile_end - layout->rb_profile_begin) - remaining;
 	progress.current += sizeof (header);
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	// Without any new profile data, the state remains unchanged.
+	if (remaining == 0)
+		return DC_STATUS_SUCCESS;
+
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, end);
+	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, end, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
 	}
 
+	// Read ahead, limited to the exact amount of profile data.
+	rc = dc_rbstream_set_prefetch (rbstream, PREFETCH, remaining);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to enable the read-ahead.");
+		dc_rbstream_free (rbstream);
+		return rc;
+	}
+
 	// Memory buffer to store all the dives.
-	unsigned char *data = (unsigned char *) malloc (layout->rb_profile_end - layout->rb_profile_begin);
+	unsigned char *data = (unsigned char *) dc_context_malloc (abstract->context, layout->rb_profile_end - layout->rb_profile_begin);
 	if (data == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		dc_rbstream_free (rbstream);
@@ -337,7 +419,7 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		if (size < 4 || size > offset) {
 			ERROR (abstract->context, "Unexpected profile size (%u %u).", size, offset);
 			dc_rbstream_free (rbstream);
-			free (data);
+			dc_context_dealloc (abstract->context, data);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -349,7 +431,7 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
 			dc_rbstream_free (rbstream);
-			free (data);
+			dc_context_dealloc (abstract->context, data);
 			return rc;
 		}
 
@@ -363,27 +445,35 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		{
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", prev, next);
 			dc_rbstream_free (rbstream);
-			free (data);
+			dc_context_dealloc (abstract->context, data);
 			return DC_STATUS_DATAFORMAT;
 		}
 		if (next != previous && next != current) {
 			ERROR (abstract->context, "Profiles are not continuous (0x%04x 0x%04x 0x%04x).", current, next, previous);
 			dc_rbstream_free (rbstream);
-			free (data);
+			dc_context_dealloc (abstract->context, data);
 			return DC_STATUS_DATAFORMAT;
 		}
 
 		if (next != current) {
 			unsigned int fp_offset = layout->fingerprint + 4;
+
+			// Remember the most recent dive for the next download.
+			if (current == last) {
+				array_uint16_le_set (state + 0, end);
+				array_uint16_le_set (state + 2, last);
+				memcpy (state + 4, p + fp_offset, sizeof (device->fingerprint));
+			}
+
 			if (memcmp (p + fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
 				dc_rbstream_free (rbstream);
-				free (data);
+				dc_context_dealloc (abstract->context, data);
 				return DC_STATUS_SUCCESS;
 			}
 
 			if (callback && !callback (p + 4, size - 4, p + fp_offset, sizeof (device->fingerprint), userdata)) {
 				dc_rbstream_free (rbstream);
-				free (data);
+				dc_context_dealloc (abstract->context, data);
 				return DC_STATUS_SUCCESS;
 			}
 		} else {
@@ -397,7 +487,14 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	}
 
 	dc_rbstream_free (rbstream);
-	free (data);
+	dc_context_dealloc (abstract->context, data);
+
+	// Once all dives have been processed, the next download can resume
+	// from here. An incomplete dive is not cached, because it will be
+	// downloaded again.
+	if (status == DC_STATUS_SUCCESS && callback != NULL) {
+		device_state_store (abstract, state, sizeof (state));
+	}
 
 	return status;
 }
@@ -0,0 +1,185 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h> // memcpy
+
+#include "simulator-private.h"
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+#include "platform.h"
+
+#define SZ_VERSION 4
+#define SZ_PACKET  0xFF
+
+typedef struct suunto_common2_simulator_t {
+	dc_simulator_protocol_t base;
+	unsigned int echo;
+	unsigned char version[SZ_VERSION];
+	unsigned char *memory;
+	unsigned int size;
+} suunto_common2_simulator_t;
+
+static size_t suunto_common2_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size);
+static void suunto_common2_simulator_destroy (dc_simulator_protocol_t *abstract);
+
+static const dc_simulator_protocol_vtable_t suunto_common2_simulator_vtable = {
+	sizeof(suunto_common2_simulator_t),
+	suunto_common2_simulator_process, /* process */
+	suunto_common2_simulator_destroy, /* destroy */
+};
+
+dc_status_t
+suunto_common2_simulator_create (dc_simulator_protocol_t **out, dc_simulator_t *simulator, unsigned int echo, const unsigned char data[], size_t size)
+{
+	suunto_common2_simulator_t *protocol = NULL;
+
+	// Allocate memory.
+	protocol = (suunto_common2_simulator_t *) dc_simulator_protocol_allocate (simulator, &suunto_common2_simulator_vtable);
+	if (protocol == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size < SZ_VERSION || size - SZ_VERSION > 0x10000) {
+		ERROR (protocol->base.context, "Unexpected memory size (" DC_PRINTF_SIZE " bytes).", size);
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	protocol->echo = echo;
+	protocol->size = size - SZ_VERSION;
+	memcpy (protocol->version, data, SZ_VERSION);
+
+	protocol->memory = (unsigned char *) dc_context_malloc (protocol->base.context, protocol->size ? protocol->size : 1);
+	if (protocol->memory == NULL) {
+		ERROR (protocol->base.context, "Failed to allocate memory.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memcpy (protocol->memory, data + SZ_VERSION, protocol->size);
+
+	*out = (dc_simulator_protocol_t *) protocol;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+suunto_common2_simulator_destroy (dc_simulator_protocol_t *abstract)
+{
+	suunto_common2_simulator_t *protocol = (suunto_common2_simulator_t *) abstract;
+
+	dc_context_dealloc (protocol->base.context, protocol->memory);
+}
+
+static void
+suunto_common2_simulator_echo (suunto_common2_simulator_t *protocol, const unsigned char command[], unsigned int csize)
+{
+	// Without an answer, only the echo of the interface is received.
+	if (protocol->echo)
+		dc_simulator_reply (protocol->base.simulator, command, csize);
+}
+
+static void
+suunto_common2_simulator_answer (suunto_common2_simulator_t *protocol, const unsigned char command[], unsigned int csize, unsigned int nparams, const unsigned char data[], unsigned int size)
+{
+	unsigned char buffer[2 * (3 + 3 + SZ_PACKET + 1)];
+	unsigned int length = nparams + size;
+	unsigned int offset = 0;
+
+	// The D9 interface echoes the command. The echo travels in the
+	// same packet as the answer, because it is produced locally by
+	// the interface and can't get lost on its own.
+	if (protocol->echo) {
+		memcpy (buffer, command, csize);
+		offset = csize;
+	}
+
+	unsigned char *answer = buffer + offset;
+
+	// The header and the parameters are identical to the command.
+	answer[0] = command[0];
+	answer[1] = (length >> 8) & 0xFF;
+	answer[2] = (length     ) & 0xFF;
+	memcpy (answer + 3, command + 3, nparams);
+	if (size)
+		memcpy (answer + 3 + nparams, data, size);
+	answer[3 + length] = checksum_xor_uint8 (answer, 3 + length, 0x00);
+
+	dc_simulator_reply (protocol->base.simulator, buffer, offset + 3 + length + 1);
+}
+
+static size_t
+suunto_common2_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size)
+{
+	suunto_common2_simulator_t *protocol = (suunto_common2_simulator_t *) abstract;
+
+	// Wait for the entire command.
+	if (size < 4)
+		return 0;
+
+	unsigned int length = array_uint16_be (data + 1);
+	if (size < 3 + length + 1)
+		return 0;
+
+	unsigned int csize = 3 + length + 1;
+
+	// Commands with an invalid checksum are ignored.
+	if (data[csize - 1] != checksum_xor_uint8 (data, csize - 1, 0x00)) {
+		WARNING (abstract->context, "Unexpected command checksum.");
+		return csize;
+	}
+
+	unsigned int address = length >= 3 ? array_uint16_be (data + 3) : 0;
+	unsigned int count = length >= 3 ? data[5] : 0;
+
+	switch (data[0]) {
+	case 0x0F: // Version
+		suunto_common2_simulator_answer (protocol, data, csize, 0, protocol->version, sizeof (protocol->version));
+		break;
+	case 0x05: // Read
+		if (length != 3 || address + count > protocol->size) {
+			WARNING (abstract->context, "Invalid read request (%04x, %u bytes).", address, count);
+			suunto_common2_simulator_echo (protocol, data, csize);
+			break;
+		}
+		suunto_common2_simulator_answer (protocol, data, csize, 3, protocol->memory + address, count);
+		break;
+	case 0x06: // Write
+		if (length != count + 3 || address + count > protocol->size) {
+			WARNING (abstract->context, "Invalid write request (%04x, %u bytes).", address, count);
+			suunto_common2_simulator_echo (protocol, data, csize);
+			break;
+		}
+		memcpy (protocol->memory + address, data + 6, count);
+		suunto_common2_simulator_answer (protocol, data, csize, 3, NULL, 0);
+		break;
+	case 0x20: // Reset the maximum depth
+		suunto_common2_simulator_answer (protocol, data, csize, 0, NULL, 0);
+		break;
+	default:
+		WARNING (abstract->context, "Unsupported command (%02x).", data[0]);
+		suunto_common2_simulator_echo (protocol, data, csize);
+		break;
+	}
+
+	return csize;
+}
@@ -56,7 +56,9 @@ static const suunto_common2_device_vtable_t suunto_d9_device_vtable = {
 		suunto_common2_device_read, /* read */
 		suunto_common2_device_write, /* write */
 		suunto_common2_device_dump, /* dump */
+		NULL, /* dump_update */
 		suunto_common2_device_foreach, /* foreach */
+		NULL, /* extract */
 		NULL, /* timesync */
 		NULL /* close */
 	},
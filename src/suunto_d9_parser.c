@@ -30,6 +30,8 @@
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &suunto_d9_parser_vtable)
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define MAXPARAMS 3
 #define NGASMIXES 11
 
@@ -70,13 +72,44 @@
 
 typedef struct suunto_d9_parser_t suunto_d9_parser_t;
 
+/*
+ * Header layout of the dives. Some models changed the layout in a later
+ * firmware version, which is identified by the logbook id tag. The
+ * fields with two values contain the value for the first and second
+ * version of the layout.
+ */
+typedef struct suunto_d9_layout_t {
+	unsigned int datetime;
+	unsigned int datefirst;
+	unsigned int divetime;
+	unsigned int divetime_scale;
+	unsigned int gasmode;
+	unsigned int id_v2;
+	unsigned int gasmix[2];
+	unsigned int gasmix_count[2];
+	unsigned int gasmix_size;
+	unsigned int ccr_count;
+	unsigned int config;     // Zero if stored after the gas mixes
+	unsigned int initial[2]; // Zero if there is no initial gas mix
+	unsigned int gaschange[2];
+	unsigned int interval;
+	unsigned int extra;      // Additional data block before the profile
+} suunto_d9_layout_t;
+
+typedef struct suunto_d9_model_t {
+	unsigned int model;
+	const suunto_d9_layout_t *layout;
+} suunto_d9_model_t;
+
 struct suunto_d9_parser_t {
 	dc_parser_t base;
 	unsigned int model;
 	unsigned int serial;
+	const suunto_d9_layout_t *layout;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int id;
+	unsigned int version;
 	unsigned int mode;
 	unsigned int ngasmixes;
 	unsigned int nccr;
@@ -108,6 +141,175 @@ static const dc_parser_vtable_t suunto_d9_parser_vtable = {
 	NULL /* destroy */
 };
 
+static const suunto_d9_layout_t suunto_d9_layout_d9 = {
+	0x11, /* datetime */
+	0, /* datefirst */
+	0x0B, /* divetime */
+	60, /* divetime_scale */
+	0x19, /* gasmode */
+	0, /* id_v2 */
+	{0x21, 0x21}, /* gasmix */
+	{3, 3}, /* gasmix_count */
+	1, /* gasmix_size */
+	0, /* ccr_count */
+	0x3A, /* config */
+	{0, 0}, /* initial */
+	{4, 4}, /* gaschange */
+	0x18, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_d4 = {
+	0x11, /* datetime */
+	0, /* datefirst */
+	0x0B, /* divetime */
+	1, /* divetime_scale */
+	0x19, /* gasmode */
+	0, /* id_v2 */
+	{0x21, 0x21}, /* gasmix */
+	{3, 3}, /* gasmix_count */
+	1, /* gasmix_size */
+	0, /* ccr_count */
+	0x3B, /* config */
+	{0, 0}, /* initial */
+	{4, 4}, /* gaschange */
+	0x18, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_helo2 = {
+	0x17, /* datetime */
+	0, /* datefirst */
+	0x0D, /* divetime */
+	60, /* divetime_scale */
+	0x1F, /* gasmode */
+	0, /* id_v2 */
+	{0x54, 0x54}, /* gasmix */
+	{8, 8}, /* gasmix_count */
+	6, /* gasmix_size */
+	0, /* ccr_count */
+	0, /* config */
+	{0x26, 0x26}, /* initial */
+	{4, 4}, /* gaschange */
+	0x1E, /* interval */
+	1, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_d4i = {
+	0x13, /* datetime */
+	1, /* datefirst */
+	0x0D, /* divetime */
+	1, /* divetime_scale */
+	0x1D, /* gasmode */
+	ID_D4I_V2, /* id_v2 */
+	{0x5F, 0x67}, /* gasmix */
+	{1, 1}, /* gasmix_count */
+	6, /* gasmix_size */
+	0, /* ccr_count */
+	0, /* config */
+	{0x28, 0x2D}, /* initial */
+	{4, 4}, /* gaschange */
+	0x1E, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_d6i = {
+	0x13, /* datetime */
+	1, /* datefirst */
+	0x0D, /* divetime */
+	1, /* divetime_scale */
+	0x1D, /* gasmode */
+	ID_D6I_V2, /* id_v2 */
+	{0x5F, 0x67}, /* gasmix */
+	{2, 3}, /* gasmix_count */
+	6, /* gasmix_size */
+	0, /* ccr_count */
+	0, /* config */
+	{0x28, 0x2D}, /* initial */
+	{4, 5}, /* gaschange */
+	0x1E, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_vypernovo = {
+	0x13, /* datetime */
+	1, /* datefirst */
+	0x0D, /* divetime */
+	1, /* divetime_scale */
+	0x1D, /* gasmode */
+	ID_D6I_V2, /* id_v2 */
+	{0x5F, 0x67}, /* gasmix */
+	{2, 3}, /* gasmix_count */
+	6, /* gasmix_size */
+	0, /* ccr_count */
+	0, /* config */
+	{0x28, 0x2D}, /* initial */
+	{5, 5}, /* gaschange */
+	0x1E, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_d9tx = {
+	0x13, /* datetime */
+	1, /* datefirst */
+	0x0D, /* divetime */
+	1, /* divetime_scale */
+	0x1D, /* gasmode */
+	ID_D6I_V2, /* id_v2 */
+	{0x87, 0x87}, /* gasmix */
+	{8, 8}, /* gasmix_count */
+	6, /* gasmix_size */
+	0, /* ccr_count */
+	0, /* config */
+	{0x28, 0x2D}, /* initial */
+	{4, 4}, /* gaschange */
+	0x1E, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_layout_t suunto_d9_layout_dx = {
+	0x17, /* datetime */
+	1, /* datefirst */
+	0x0D, /* divetime */
+	1, /* divetime_scale */
+	0x21, /* gasmode */
+	ID_DX_V2, /* id_v2 */
+	{0xC1, 0xC3}, /* gasmix */
+	{11, 11}, /* gasmix_count */
+	6, /* gasmix_size */
+	3, /* ccr_count */
+	0, /* config */
+	{0x31, 0x31}, /* initial */
+	{5, 5}, /* gaschange */
+	0x22, /* interval */
+	0, /* extra */
+};
+
+static const suunto_d9_model_t suunto_d9_models[] = {
+	{D4,        &suunto_d9_layout_d4},
+	{HELO2,     &suunto_d9_layout_helo2},
+	{D4i,       &suunto_d9_layout_d4i},
+	{ZOOPNOVO,  &suunto_d9_layout_d4i},
+	{D4F,       &suunto_d9_layout_d4i},
+	{D6i,       &suunto_d9_layout_d6i},
+	{VYPERNOVO, &suunto_d9_layout_vypernovo},
+	{D9tx,      &suunto_d9_layout_d9tx},
+	{DX,        &suunto_d9_layout_dx},
+};
+
+static const suunto_d9_layout_t *
+suunto_d9_parser_layout (unsigned int model)
+{
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(suunto_d9_models); ++i) {
+		if (suunto_d9_models[i].model == model)
+			return suunto_d9_models[i].layout;
+	}
+
+	// The D9, D6, Vyper 2, Cobra 2, Vyper Air and Cobra 3 share the
+	// original layout.
+	return &suunto_d9_layout_d9;
+}
+
 static unsigned int
 suunto_d9_parser_find_gasmix (suunto_d9_parser_t *parser, unsigned int o2, unsigned int he)
 {
@@ -135,56 +337,25 @@ suunto_d9_parser_cache (suunto_d9_parser_t *parser)
 	// Get the logbook id tag.
 	unsigned int id = array_uint32_le (data + 1);
 
+	// Select the layout version.
+	const suunto_d9_layout_t *layout = parser->layout;
+	unsigned int version = (layout->id_v2 != 0 && id == layout->id_v2);
+
 	// Gasmix information.
-	unsigned int gasmode_offset = 0x19;
-	unsigned int gasmix_offset = 0x21;
-	unsigned int gasmix_count = 3;
-	unsigned int ccr_count = 0;
-	if (parser->model == HELO2) {
-		gasmode_offset = 0x1F;
-		gasmix_offset = 0x54;
-		gasmix_count = 8;
-	} else if (parser->model == D4i || parser->model == ZOOPNOVO ||
-		parser->model == D4F) {
-		gasmode_offset = 0x1D;
-		if (id == ID_D4I_V2)
-			gasmix_offset = 0x67;
-		else
-			gasmix_offset = 0x5F;
-		gasmix_count = 1;
-	} else if (parser->model == D6i || parser->model == VYPERNOVO) {
-		gasmode_offset = 0x1D;
-		if (id == ID_D6I_V2)
-			gasmix_offset = 0x67;
-		else
-			gasmix_offset = 0x5F;
-		if (id == ID_D6I_V1_MIX3 || id == ID_D6I_V2)
-			gasmix_count = 3;
-		else
-			gasmix_count = 2;
-	} else if (parser->model == D9tx) {
-		gasmode_offset = 0x1D;
-		gasmix_offset = 0x87;
-		gasmix_count = 8;
-	} else if (parser->model == DX) {
-		gasmode_offset = 0x21;
-		if (id == ID_DX_V2)
-			gasmix_offset = 0xC3;
-		else
-			gasmix_offset = 0xC1;
-		gasmix_count = 11;
-		ccr_count = 3;
+	unsigned int gasmode_offset = layout->gasmode;
+	unsigned int gasmix_offset = layout->gasmix[version];
+	unsigned int gasmix_count = layout->gasmix_count[version];
+	unsigned int ccr_count = layout->ccr_count;
+	if (id == ID_D6I_V1_MIX3) {
+		// The first D6i firmware also has a variant with three gas
+		// mixes, equal to the number of gas mixes in the second version.
+		gasmix_count = layout->gasmix_count[1];
 	}
 
 	// Offset to the configuration data.
-	unsigned int config = 0x3A;
-	if (parser->model == D4) {
-		config += 1;
-	} else if (parser->model == HELO2 || parser->model == D4i ||
-		parser->model == D6i || parser->model == D9tx ||
-		parser->model == DX || parser->model == ZOOPNOVO ||
-		parser->model == VYPERNOVO || parser->model == D4F) {
-		config = gasmix_offset + gasmix_count * 6;
+	unsigned int config = layout->config;
+	if (config == 0) {
+		config = gasmix_offset + gasmix_count * layout->gasmix_size;
 	}
 	if (config + 1 > size)
 		return DC_STATUS_DATAFORMAT;
@@ -204,10 +375,7 @@ suunto_d9_parser_cache (suunto_d9_parser_t *parser)
 		parser->ngasmixes = 0;
 		parser->nccr = ccr_count;
 		for (unsigned int i = 0; i < gasmix_count; ++i) {
-			if (parser->model == HELO2 || parser->model == D4i ||
-				parser->model == D6i || parser->model == D9tx ||
-				parser->model == DX || parser->model == ZOOPNOVO ||
-				parser->model == VYPERNOVO || parser->model == D4F) {
+			if (layout->gasmix_size == 6) {
 				parser->oxygen[i] = data[gasmix_offset + 6 * i + 1];
 				parser->helium[i] = data[gasmix_offset + 6 * i + 2];
 			} else {
@@ -221,25 +389,19 @@ suunto_d9_parser_cache (suunto_d9_parser_t *parser)
 		}
 
 		// Initial gasmix.
-		if (parser->model == HELO2) {
-			parser->gasmix = data[0x26];
-		} else if (parser->model == D4i || parser->model == D6i ||
-			parser->model == D9tx || parser->model == ZOOPNOVO ||
-			parser->model == VYPERNOVO || parser->model == D4F) {
-			if (id == ID_D4I_V2 || id == ID_D6I_V2) {
-				parser->gasmix = data[0x2D];
-			} else {
-				parser->gasmix = data[0x28];
-			}
-		} else if (parser->model == DX) {
-			parser->gasmix = data[0x31] & 0x7F;
-			if ((data[0x31] & 0x80) == 0) {
+		unsigned int initial = layout->initial[version];
+		if (initial && ccr_count) {
+			parser->gasmix = data[initial] & 0x7F;
+			if ((data[initial] & 0x80) == 0) {
 				parser->gasmix += parser->nccr;
 			}
+		} else if (initial) {
+			parser->gasmix = data[initial];
 		}
 	}
 	parser->config = config;
 	parser->id = id;
+	parser->version = version;
 	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
@@ -263,8 +425,10 @@ suunto_d9_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 	// Set the default values.
 	parser->model = model;
 	parser->serial = serial;
+	parser->layout = suunto_d9_parser_layout (model);
 	parser->cached = 0;
 	parser->id = 0;
+	parser->version = 0;
 	parser->mode = AIR;
 	parser->ngasmixes = 0;
 	parser->nccr = 0;
@@ -289,6 +453,7 @@ suunto_d9_parser_set_data (dc_parser_t *abstract, const unsigned char *data, uns
 	// Reset the cache.
 	parser->cached = 0;
 	parser->id = 0;
+	parser->version = 0;
 	parser->mode = AIR;
 	parser->ngasmixes = 0;
 	parser->nccr = 0;
@@ -308,13 +473,8 @@ suunto_d9_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 {
 	suunto_d9_parser_t *parser = (suunto_d9_parser_t*) abstract;
 
-	unsigned int offset = 0x11;
-	if (parser->model == HELO2 || parser->model == DX)
-		offset = 0x17;
-	else if (parser->model == D4i || parser->model == D6i ||
-		parser->model == D9tx || parser->model == ZOOPNOVO ||
-		parser->model == VYPERNOVO || parser->model == D4F)
-		offset = 0x13;
+	const suunto_d9_layout_t *layout = parser->layout;
+	unsigned int offset = layout->datetime;
 
 	if (abstract->size < offset + 7)
 		return DC_STATUS_DATAFORMAT;
@@ -322,10 +482,7 @@ suunto_d9_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 	const unsigned char *p = abstract->data + offset;
 
 	if (datetime) {
-		if (parser->model == D4i || parser->model == D6i ||
-			parser->model == D9tx || parser->model == DX ||
-			parser->model == ZOOPNOVO || parser->model == VYPERNOVO ||
-			parser->model == D4F) {
+		if (layout->datefirst) {
 			datetime->year   = p[0] + (p[1] << 8);
 			datetime->month  = p[2];
 			datetime->day    = p[3];
@@ -369,17 +526,7 @@ suunto_d9_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigne
 	if (value) {
 		switch (type) {
 		case DC_FIELD_DIVETIME:
-			if (parser->model == D4)
-				*((unsigned int *) value) = array_uint16_le (data + 0x0B);
-			else if (parser->model == D4i || parser->model == D6i ||
-				parser->model == D9tx || parser->model == DX ||
-				parser->model == ZOOPNOVO || parser->model == VYPERNOVO ||
-				parser->model == D4F)
-				*((unsigned int *) value) = array_uint16_le (data + 0x0D);
-			else if (parser->model == HELO2)
-				*((unsigned int *) value) = array_uint16_le (data + 0x0D) * 60;
-			else
-				*((unsigned int *) value) = array_uint16_le (data + 0x0B) * 60;
+			*((unsigned int *) value) = array_uint16_le (data + parser->layout->divetime) * parser->layout->divetime_scale;
 			break;
 		case DC_FIELD_MAXDEPTH:
 			*((double *) value) = array_uint16_le (data + 0x09) / 100.0;
@@ -485,7 +632,7 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 
 	// HelO2 dives can have an additional data block.
 	const unsigned char sequence[] = {0x01, 0x00, 0x00};
-	if (parser->model == HELO2 && memcmp (data + profile, sequence, sizeof (sequence)) != 0)
+	if (parser->layout->extra && memcmp (data + profile, sequence, sizeof (sequence)) != 0)
 		profile += 12;
 	if (profile + 5 > size) {
 		ERROR (abstract->context, "Buffer overflow detected!");
@@ -493,20 +640,15 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 	}
 
 	// Sample recording interval.
-	unsigned int interval_sample_offset = 0x18;
-	if (parser->model == HELO2 || parser->model == D4i ||
-		parser->model == D6i || parser->model == D9tx ||
-		parser->model == ZOOPNOVO || parser->model == VYPERNOVO ||
-		parser->model == D4F)
-		interval_sample_offset = 0x1E;
-	else if (parser->model == DX)
-		interval_sample_offset = 0x22;
-	unsigned int interval_sample = data[interval_sample_offset];
+	unsigned int interval_sample = data[parser->layout->interval];
 	if (interval_sample == 0) {
 		ERROR (abstract->context, "Invalid sample interval.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	// Length of the gas change event.
+	unsigned int gaschange = parser->layout->gaschange[parser->version];
+
 	// Offset to the first marker position.
 	unsigned int marker = array_uint16_le (data + profile + 3);
 
@@ -702,6 +844,7 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 						break;
 					default: // Unknown
 						WARNING (abstract->context, "Unknown event type 0x%02x.", type);
+						dc_parser_skipped (abstract);
 						break;
 					}
 					if (type & 0x80)
@@ -750,12 +893,7 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 					offset += 2;
 					break;
 				case 0x06: // Gas Change
-					if (parser->model == DX || parser->model == VYPERNOVO ||
-						(parser->model == D6i && parser->id == ID_D6I_V2)) {
-						length = 5;
-					} else {
-						length = 4;
-					}
+					length = gaschange;
 					if (offset + length > size) {
 						ERROR (abstract->context, "Buffer overflow detected!");
 						return DC_STATUS_DATAFORMAT;
@@ -763,8 +901,7 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 					type = data[offset + 0];
 					he = data[offset + 1];
 					o2 = data[offset + 2];
-					if (parser->model == DX || parser->model == VYPERNOVO ||
-						(parser->model == D6i && parser->id == ID_D6I_V2)) {
+					if (length == 5) {
 						ppo2 = data[offset + 3];
 						seconds = data[offset + 4];
 					} else {
@@ -789,6 +926,7 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 					break;
 				default:
 					WARNING (abstract->context, "Unknown event 0x%02x.", event);
+					dc_parser_skipped (abstract);
 					break;
 				}
 
@@ -25,6 +25,7 @@
 #include "suunto_eon.h"
 #include "suunto_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -40,6 +41,7 @@ typedef struct suunto_eon_device_t {
 
 static dc_status_t suunto_eon_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
 static dc_status_t suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
+static dc_status_t suunto_eon_device_extract (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
 
 static const dc_device_vtable_t suunto_eon_device_vtable = {
 	sizeof(suunto_eon_device_t),
@@ -48,7 +50,9 @@ static const dc_device_vtable_t suunto_eon_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	suunto_eon_device_dump, /* dump */
+	NULL, /* dump_update */
 	suunto_eon_device_foreach, /* foreach */
+	suunto_eon_device_extract, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -190,7 +194,7 @@ suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 {
 	suunto_common_device_t *device = (suunto_common_device_t *) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -220,6 +224,20 @@ suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 }
 
 
+static dc_status_t
+suunto_eon_device_extract (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	suunto_common_device_t *device = (suunto_common_device_t*) abstract;
+
+	if (size != SZ_MEMORY) {
+		ERROR (abstract->context, "Unexpected memory dump size (%u).", size);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return suunto_common_extract_dives (device, &suunto_eon_layout, data, callback, userdata);
+}
+
+
 dc_status_t
 suunto_eon_device_write_name (dc_device_t *abstract, unsigned char data[], unsigned int size)
 {
@@ -25,6 +25,7 @@
 
 #include "suunto_eonsteel.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 #include "platform.h"
@@ -33,14 +34,22 @@
 #define EONSTEEL 0
 #define EONCORE  1
 
+// The maximum length of a GATT attribute value.
+#define MAXPACKET_SIZE 512
+
 typedef struct suunto_eonsteel_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
 	unsigned int model;
 	unsigned int magic;
 	unsigned short seq;
+	unsigned int pipeline;
 	unsigned char version[0x30];
 	unsigned char fingerprint[4];
+	// Received BLE data, which is not consumed yet.
+	unsigned char packet[MAXPACKET_SIZE];
+	size_t offset;
+	size_t count;
 } suunto_eonsteel_device_t;
 
 // The EON Steel implements a small filesystem
@@ -80,6 +89,9 @@ struct directory_entry {
 #define MAXDATA_SIZE 2048
 #define CRC_SIZE    4
 
+// Maximum number of file read requests in flight
+#define MAXPIPELINE 4
+
 // HDLC special characters
 #define END     0x7E
 #define ESC     0x7D
@@ -96,7 +108,9 @@ static const dc_device_vtable_t suunto_eonsteel_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	suunto_eonsteel_device_foreach, /* foreach */
+	NULL, /* extract */
 	suunto_eonsteel_device_timesync, /* timesync */
 	NULL /* close */
 };
@@ -205,67 +219,110 @@ suunto_eonsteel_hdlc_write (suunto_eonsteel_device_t *device, const unsigned cha
 
 }
 
+/*
+ * Length of the run of ordinary characters, up to the next special
+ * character.
+ */
+static size_t
+suunto_eonsteel_hdlc_span (const unsigned char data[], size_t size)
+{
+	const unsigned char *esc = (const unsigned char *) memchr (data, ESC, size);
+	if (esc)
+		return esc - data;
+
+	return size;
+}
+
 static dc_status_t
 suunto_eonsteel_hdlc_read (suunto_eonsteel_device_t *device, unsigned char data[], size_t size, size_t *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	unsigned char buffer[20];
 	unsigned int initialized = 0;
 	unsigned int escaped = 0;
 	size_t nbytes = 0;
 
 	while (1) {
-		// Read a single data packet.
-		size_t transferred = 0;
-		status = dc_iostream_read(device->iostream, buffer, sizeof(buffer), &transferred);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR(device->base.context, "Failed to receive the packet.");
-			return status;
-		}
-
-		for (size_t i = 0; i < transferred; ++i) {
-			unsigned char c = buffer[i];
+		// Read a single data packet. The packet can contain the
+		// start of the next frame, which is kept for the next call.
+		if (device->count == 0) {
+			size_t transferred = 0;
+			status = dc_iostream_read(device->iostream, device->packet, sizeof(device->packet), &transferred);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR(device->base.context, "Failed to receive the packet.");
+				return status;
+			}
 
-			if (c == END) {
-				if (escaped) {
-					ERROR (device->base.context, "HDLC frame escaped the special character %02x.", c);
-					return DC_STATUS_PROTOCOL;
-				}
+			device->offset = 0;
+			device->count = transferred;
+		}
 
-				if (initialized) {
-					goto done;
-				}
+		const unsigned char *p = device->packet + device->offset;
+		size_t n = device->count;
+		size_t i = 0;
 
-				initialized = 1;
+		if (!initialized) {
+			const unsigned char *end = (const unsigned char *) memchr (p, END, n);
+			if (end == NULL) {
+				device->count = 0;
 				continue;
 			}
 
-			if (!initialized) {
-				continue;
-			}
+			i = end - p + 1;
+			initialized = 1;
+		}
 
-			if (c == ESC) {
-				if (escaped) {
+		// Locate the end of the frame.
+		const unsigned char *end = (const unsigned char *) memchr (p + i, END, n - i);
+		size_t stop = end ? (size_t) (end - p) : n;
+
+		while (i < stop) {
+			unsigned char c = p[i];
+
+			if (escaped) {
+				if (c == ESC) {
 					ERROR (device->base.context, "HDLC frame escaped the special character %02x.", c);
+					device->count = 0;
 					return DC_STATUS_PROTOCOL;
 				}
-				escaped = 1;
+
+				if (nbytes < size)
+					data[nbytes] = c ^ ESC_BIT;
+				nbytes++;
+				escaped = 0;
+				i++;
 				continue;
 			}
 
-			if (escaped) {
-				c ^= ESC_BIT;
-				escaped = 0;
+			if (c == ESC) {
+				escaped = 1;
+				i++;
+				continue;
 			}
 
+			// Copy the unescaped run at once.
+			size_t len = suunto_eonsteel_hdlc_span (p + i, stop - i);
 			if (nbytes < size)
-				data[nbytes] = c;
-			nbytes++;
+				memcpy (data + nbytes, p + i, len < size - nbytes ? len : size - nbytes);
+			nbytes += len;
+			i += len;
+		}
 
+		if (end == NULL) {
+			device->count = 0;
+			continue;
 		}
+
+		if (escaped) {
+			ERROR (device->base.context, "HDLC frame escaped the special character %02x.", END);
+			device->count = 0;
+			return DC_STATUS_PROTOCOL;
+		}
+
+		device->offset += stop + 1;
+		device->count -= stop + 1;
+		break;
 	}
 
-done:
 	if (nbytes > size) {
 		ERROR(device->base.context, "Insufficient buffer space available.");
 		return DC_STATUS_PROTOCOL;
@@ -375,7 +432,7 @@ suunto_eonsteel_receive_ble(suunto_eonsteel_device_t *device, unsigned char data
 
 static dc_status_t
 suunto_eonsteel_send(suunto_eonsteel_device_t *device,
-	unsigned short cmd,
+	unsigned short cmd, unsigned short seq,
 	const unsigned char data[],
 	unsigned int size)
 {
@@ -400,7 +457,7 @@ suunto_eonsteel_send(suunto_eonsteel_device_t *device,
 	put_le32(device->magic, buf + 4);
 
 	// 2-byte LE sequence number;
-	put_le16(device->seq, buf + 8);
+	put_le16(seq, buf + 8);
 
 	// 4-byte LE length
 	put_le32(size, buf + 10);
@@ -430,7 +487,7 @@ suunto_eonsteel_send(suunto_eonsteel_device_t *device,
 }
 
 /*
- * Send a command, receive a reply
+ * Receive the reply to a command
  *
  * This carefully checks the data fields in the reply for a match
  * against the command, and then only returns the actual reply
@@ -443,9 +500,8 @@ suunto_eonsteel_send(suunto_eonsteel_device_t *device,
  * send() side. The offsets are the same in the actual raw packet.
  */
 static dc_status_t
-suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
-	unsigned short cmd,
-	const unsigned char data[], unsigned int size,
+suunto_eonsteel_receive(suunto_eonsteel_device_t *device,
+	unsigned short cmd, unsigned short expected,
 	unsigned char answer[], unsigned int asize,
 	unsigned int *actual)
 {
@@ -453,11 +509,6 @@ suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
 	unsigned char header[HEADER_SIZE + MAXDATA_SIZE];
 	unsigned int len = 0;
 
-	// Send the command.
-	rc = suunto_eonsteel_send(device, cmd, data, size);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-
 	if (dc_iostream_get_transport(device->iostream) == DC_TRANSPORT_BLE) {
 		// Receive the entire data packet.
 		rc = suunto_eonsteel_receive_ble(device, header, sizeof(header), &len);
@@ -495,8 +546,8 @@ suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
 	}
 
 	// Verify the sequence number.
-	if (seq != device->seq) {
-		ERROR(device->base.context, "Unexpected sequence number (received %04x, expected %04x).", seq, device->seq);
+	if (seq != expected) {
+		ERROR(device->base.context, "Unexpected sequence number (received %04x, expected %04x).", seq, expected);
 		return DC_STATUS_PROTOCOL;
 	}
 
@@ -541,17 +592,57 @@ suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
 		device->magic = (magic & 0xffff0000) | 0x0005;
 	}
 
-	// Increment the sequence number.
-	device->seq++;
-
 	if (actual)
 		*actual = nbytes;
 
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Send a command, receive a reply
+ */
 static dc_status_t
-read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
+suunto_eonsteel_transfer(suunto_eonsteel_device_t *device,
+	unsigned short cmd,
+	const unsigned char data[], unsigned int size,
+	unsigned char answer[], unsigned int asize,
+	unsigned int *actual)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_trace_span_t span;
+
+	TRACE_BEGIN(device->base.context, &span, cmd, size, asize);
+
+	// Send the command.
+	rc = suunto_eonsteel_send(device, cmd, device->seq, data, size);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error;
+
+	// Receive the reply.
+	rc = suunto_eonsteel_receive(device, cmd, device->seq, answer, asize, actual);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error;
+
+	// Increment the sequence number.
+	device->seq++;
+
+error:
+	TRACE_END(device->base.context, &span, rc);
+	return rc;
+}
+
+/*
+ * Read the contents of a file.
+ *
+ * The file read requests don't carry a file offset, the device simply
+ * returns the next chunk of the file for each request. Thus, several
+ * requests can be kept in flight, and each reply is matched to its
+ * request by the sequence number. This hides the round trip latency,
+ * and lets the device transfer the next chunk while the previous one
+ * is being decoded.
+ */
+static dc_status_t
+read_file_pipelined(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf, unsigned int depth)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	unsigned char result[2560];
@@ -585,20 +676,50 @@ read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
 	size = array_uint32_le(result+4);
 	offset = 0;
 
-	while (size > 0) {
+	// Requests in flight, in the order they were sent.
+	unsigned int asks[MAXPIPELINE];
+	unsigned int head = 0, pending = 0, requested = 0;
+	unsigned short seq = eon->seq;
+
+	if (depth < 1)
+		depth = 1;
+	if (depth > MAXPIPELINE)
+		depth = MAXPIPELINE;
+
+	while (size > 0 || pending) {
 		unsigned int ask, got, at;
 
-		ask = size;
-		if (ask > 1024)
-			ask = 1024;
-		put_le32(1234, cmdbuf+0);	// Not file offset, after all
-		put_le32(ask, cmdbuf+4);	// Size of read
-		rc = suunto_eonsteel_transfer(eon, CMD_FILE_READ,
-			cmdbuf, 8, result, sizeof(result), &n);
+		// Keep the pipeline filled.
+		while (pending < depth && requested < size) {
+			ask = size - requested;
+			if (ask > 1024)
+				ask = 1024;
+			put_le32(1234, cmdbuf+0);	// Not file offset, after all
+			put_le32(ask, cmdbuf+4);	// Size of read
+			rc = suunto_eonsteel_send(eon, CMD_FILE_READ, eon->seq, cmdbuf, 8);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR(eon->base.context, "unable to read %s", filename);
+				return rc;
+			}
+			eon->seq++;
+
+			asks[(head + pending) % MAXPIPELINE] = ask;
+			requested += ask;
+			pending++;
+		}
+
+		// Receive the oldest reply.
+		rc = suunto_eonsteel_receive(eon, CMD_FILE_READ, seq,
+			result, sizeof(result), &n);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR(eon->base.context, "unable to read %s", filename);
 			return rc;
 		}
+		requested -= asks[head];
+		head = (head + 1) % MAXPIPELINE;
+		pending--;
+		seq++;
+
 		if (n < 8) {
 			ERROR(eon->base.context, "got short read reply for %s", filename);
 			return DC_STATUS_PROTOCOL;
@@ -613,8 +734,11 @@ read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
 
 		// Number of bytes actually read
 		got = array_uint32_le(result+4);
-		if (!got)
-			break;
+		if (!got) {
+			// End of file. Drain the remaining replies.
+			size = 0;
+			continue;
+		}
 		if (n < 8 + got) {
 			ERROR(eon->base.context, "odd read size reply for offset %d of file %s", offset, filename);
 			return DC_STATUS_PROTOCOL;
@@ -628,6 +752,10 @@ read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
 		}
 		offset += got;
 		size -= got;
+
+		// Pass the part of the dive received so far to the application.
+		dc_event_partial_t partial = {dc_buffer_get_data (buf), dc_buffer_get_size (buf)};
+		device_event_emit (&eon->base, DC_EVENT_PARTIAL, &partial);
 	}
 
 	rc = suunto_eonsteel_transfer(eon, CMD_FILE_CLOSE,
@@ -641,33 +769,107 @@ read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	size_t previous = dc_buffer_get_size (buf);
+
+	rc = read_file_pipelined(eon, filename, buf, eon->pipeline);
+	if ((rc == DC_STATUS_TIMEOUT || rc == DC_STATUS_PROTOCOL) && eon->pipeline > 1) {
+		// Not every firmware accepts several requests in flight. Drop the
+		// stale replies, close the file and read it again, one request at
+		// a time for the rest of the session.
+		WARNING(eon->base.context, "Pipelined read of %s failed, retrying without pipelining.", filename);
+		eon->pipeline = 1;
+
+		unsigned char result[64];
+		dc_iostream_sleep (eon->iostream, 100);
+		dc_iostream_purge (eon->iostream, DC_DIRECTION_INPUT);
+		suunto_eonsteel_transfer(eon, CMD_FILE_CLOSE, NULL, 0, result, sizeof(result), NULL);
+		dc_iostream_purge (eon->iostream, DC_DIRECTION_INPUT);
+
+		dc_buffer_resize (buf, previous);
+		rc = read_file_pipelined(eon, filename, buf, eon->pipeline);
+	}
+
+	return rc;
+}
+
 /*
- * Insert a directory entry in the sorted list, most recent entry
- * first.
+ * Sort the directory entries, most recent entry first, with a merge
+ * sort of the linked list.
  *
  * The directory entry names are the timestamps as hex, so ordering
  * in alphabetical order ends up also ordering in date order!
  */
-static struct directory_entry *insert_dirent(struct directory_entry *entry, struct directory_entry *list)
+static struct directory_entry *sort_dirent(struct directory_entry *list)
 {
-	struct directory_entry **pos = &list, *next;
+	struct directory_entry *a = NULL, *b = NULL, **tail;
+
+	if (list == NULL || list->next == NULL)
+		return list;
 
-	while ((next = *pos) != NULL) {
-		/* Is this bigger (more recent) than the next entry? We're good! */
-		if (strcmp(entry->name, next->name) > 0)
+	// Split the list in two halves.
+	while (list) {
+		struct directory_entry *next = list->next;
+		list->next = a;
+		a = list;
+		list = next;
+		if (list == NULL)
 			break;
-		pos = &next->next;
+		next = list->next;
+		list->next = b;
+		b = list;
+		list = next;
 	}
-	entry->next = next;
-	*pos = entry;
+
+	a = sort_dirent(a);
+	b = sort_dirent(b);
+
+	// Merge the sorted halves.
+	tail = &list;
+	while (a && b) {
+		/* Is this bigger (more recent) than the other entry? We're good! */
+		if (strcmp(a->name, b->name) >= 0) {
+			*tail = a;
+			a = a->next;
+		} else {
+			*tail = b;
+			b = b->next;
+		}
+		tail = &(*tail)->next;
+	}
+	*tail = a ? a : b;
 
 	return list;
 }
 
 /*
- * NOTE! This will create the list of dirent's in reverse order,
- * with the last dirent first. That's intentional: for dives,
- * we will want to look up the last dive first.
+ * Dive files which are not more recent than the fingerprint are not
+ * downloaded, so they are dropped from the list immediately. The
+ * subdirectories are ignored too.
+ */
+static int skip_dirent(suunto_eonsteel_device_t *eon, unsigned int type, const char *name)
+{
+	unsigned int fingerprint = array_uint32_le(eon->fingerprint);
+	unsigned int time = 0;
+
+	if (type == DIRTYPE_DIR)
+		return 1;
+
+	if (type != DIRTYPE_FILE || fingerprint == 0)
+		return 0;
+
+	if (sscanf(name, "%x.LOG", &time) != 1)
+		return 0;
+
+	return time <= fingerprint;
+}
+
+/*
+ * The list is created unsorted, and sorted once all entries are
+ * received.
  */
 static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int nr, const unsigned char *p, unsigned int len, struct directory_entry *list)
 {
@@ -685,12 +887,15 @@ static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int n
 
 		p += 8 + namelen + 1;
 		len -= 8 + namelen + 1;
+		if (skip_dirent(eon, type, (const char *) name))
+			continue;
 		entry = alloc_dirent(type, namelen, (const char *) name);
 		if (!entry) {
 			ERROR(eon->base.context, "out of memory");
 			break;
 		}
-		list = insert_dirent(entry, list);
+		entry->next = list;
+		list = entry;
 	}
 	return list;
 }
@@ -748,7 +953,7 @@ get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
 		return rc;
 	}
 
-	*res = de;
+	*res = sort_dirent(de);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -784,8 +989,11 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, dc_iostrea
 	eon->model = model;
 	eon->magic = INIT_MAGIC;
 	eon->seq = INIT_SEQ;
+	eon->pipeline = MAXPIPELINE;
 	memset (eon->version, 0, sizeof (eon->version));
 	memset (eon->fingerprint, 0, sizeof (eon->fingerprint));
+	eon->offset = 0;
+	eon->count = 0;
 
 	status = dc_iostream_set_timeout(eon->iostream, 5000);
 	if (status != DC_STATUS_SUCCESS) {
@@ -854,7 +1062,7 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 		return DC_STATUS_SUCCESS;
 	}
 
-	file = dc_buffer_new (16384);
+	file = dc_buffer_allocate (abstract->context, 16384);
 	if (file == NULL) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		file_list_free(de);
@@ -897,6 +1105,10 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 				break;
 			}
 
+			// Already downloaded before, no need to read it again.
+			if (device_is_known(abstract, buf, sizeof(eon->fingerprint)))
+				break;
+
 			len = snprintf(pathname, sizeof(pathname), "%s/%s", dive_directory, de->name);
 			if (len < 0 || (unsigned int) len >= sizeof(pathname)) {
 				dc_status_set_error(&status, DC_STATUS_PROTOCOL);
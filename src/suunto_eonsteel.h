@@ -37,6 +37,9 @@ suunto_eonsteel_device_open(dc_device_t **device, dc_context_t *context, dc_iost
 dc_status_t
 suunto_eonsteel_parser_create(dc_parser_t **parser, dc_context_t *context, unsigned int model);
 
+unsigned int
+suunto_eonsteel_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
@@ -30,6 +31,7 @@
 #include "array.h"
 #include "platform.h"
 #include "field-cache.h"
+#include "thread.h"
 
 #define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
@@ -68,54 +70,103 @@ struct type_desc {
 	char *desc, *format, *mod;
 	unsigned int size;
 	enum eon_sample type[EON_MAX_GROUP];
+	// Enumeration labels from the format string, indexed by value.
+	const char **enums;
+	unsigned int nenums;
 };
 
 #define MAXTYPE 512
 
+/*
+ * Interned type descriptor.
+ *
+ * Consecutive dives from the same device carry identical descriptors,
+ * so the parsed descriptors are shared in a process wide table, keyed
+ * by the raw descriptor text. The entries are immutable once they are
+ * published, and never freed. The number of shared entries is limited,
+ * once the table is full new entries are owned by the parser instance.
+ */
+struct desc_entry {
+	struct desc_entry *next;
+	unsigned int hash;
+	unsigned int length;
+	const char *text;
+	struct type_desc desc;
+};
+
+#define DESC_BUCKETS  256
+#define DESC_MAXCACHE 4096
+
+static struct desc_entry *g_desc_cache[DESC_BUCKETS];
+static unsigned int g_desc_count;
+
+/*
+ * Sample entry.
+ *
+ * The walk over the data for the header fields records the location of
+ * the sample entries, so the samples can be decoded without parsing the
+ * entire data again. The data points into the buffer of the parser.
+ */
+struct sample_entry {
+	const struct type_desc *desc;
+	const unsigned char *data;
+	unsigned int len;
+};
+
 typedef struct suunto_eonsteel_parser_t {
 	dc_parser_t base;
-	struct type_desc type_desc[MAXTYPE];
+	const struct type_desc *type_desc[MAXTYPE];
+	struct desc_entry *desc_private;
 	struct dc_field_cache cache;
+	struct sample_entry *entries;
+	unsigned int nentries, maxentries;
+	unsigned int entries_valid;
 } suunto_eonsteel_parser_t;
 
 typedef int (*eon_data_cb_t)(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user);
 
+/*
+ * Sample type names, relative to "sml.DeviceLog.Samples.Sample.".
+ *
+ * Keep the table sorted by name (in strcmp order), the lookup uses a
+ * binary search.
+ */
 static const struct {
 	const char *name;
 	enum eon_sample type;
 } type_translation[] = {
 	{ "+Time",				ES_dtime },
-	{ "Depth",				ES_depth },
-	{ "Temperature",			ES_temp },
-	{ "NoDecTime",				ES_ndl },
 	{ "Ceiling",				ES_ceiling },
-	{ "TimeToSurface",			ES_tts },
-	{ "Heading",				ES_heading },
-	{ "DeviceInternalAbsPressure",		ES_abspressure },
-	{ "GasTime",				ES_gastime },
-	{ "Ventilation",			ES_ventilation },
 	{ "Cylinders+Cylinder.GasNumber",	ES_gasnr },
 	{ "Cylinders.Cylinder.Pressure",	ES_pressure },
-	{ "Events+State.Type",			ES_state },
-	{ "Events.State.Active",		ES_state_active },
+	{ "Depth",				ES_depth },
+	{ "DeviceInternalAbsPressure",		ES_abspressure },
+	{ "Events+Alarm.Type",			ES_alarm },
 	{ "Events+Notify.Type",			ES_notify },
-	{ "Events.Notify.Active",		ES_notify_active },
+	{ "Events+State.Type",			ES_state },
 	{ "Events+Warning.Type",		ES_warning },
-	{ "Events.Warning.Active",		ES_warning_active },
-	{ "Events+Alarm.Type",			ES_alarm },
 	{ "Events.Alarm.Active",		ES_alarm_active },
 	{ "Events.Bookmark.Name",		ES_bookmark },
-	{ "Events.GasSwitch.GasNumber",		ES_gasswitch },
-	{ "Events.SetPoint.Type",		ES_setpoint_type },
-	{ "Events.Events.SetPoint.PO2",		ES_setpoint_po2 },
-	{ "Events.SetPoint.Automatic",		ES_setpoint_automatic },
 	{ "Events.DiveTimer.Active",		ES_none },
 	{ "Events.DiveTimer.Time",		ES_none },
+	{ "Events.Events.SetPoint.PO2",		ES_setpoint_po2 },
+	{ "Events.GasSwitch.GasNumber",		ES_gasswitch },
+	{ "Events.Notify.Active",		ES_notify_active },
+	{ "Events.SetPoint.Automatic",		ES_setpoint_automatic },
+	{ "Events.SetPoint.Type",		ES_setpoint_type },
+	{ "Events.State.Active",		ES_state_active },
+	{ "Events.Warning.Active",		ES_warning_active },
+	{ "GasTime",				ES_gastime },
+	{ "Heading",				ES_heading },
+	{ "NoDecTime",				ES_ndl },
+	{ "Temperature",			ES_temp },
+	{ "TimeToSurface",			ES_tts },
+	{ "Ventilation",			ES_ventilation },
 };
 
 static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
 {
-	int i;
+	size_t lo = 0, hi = C_ARRAY_SIZE(type_translation);
 	const char *name = desc->desc;
 
 	// Not a sample type? Skip it
@@ -138,9 +189,15 @@ static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, str
 	name += 8;
 
 	// .. and look it up in the table of sample type strings
-	for (i = 0; i < C_ARRAY_SIZE(type_translation); i++) {
-		if (!strcmp(name, type_translation[i].name))
-			return type_translation[i].type;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(name, type_translation[mid].name);
+		if (cmp == 0)
+			return type_translation[mid].type;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
 	}
 	return ES_none;
 }
@@ -185,7 +242,7 @@ static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc
 	const char *grp = desc->desc;
 
 	for (;;) {
-		struct type_desc *base;
+		const struct type_desc *base;
 		char *end;
 		long index;
 
@@ -194,8 +251,8 @@ static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc
 			ERROR(eon->base.context, "Group type descriptor '%s' does not parse", desc->desc);
 			break;
 		}
-		base = eon->type_desc + index;
-		if (!base->desc) {
+		base = eon->type_desc[index];
+		if (!base) {
 			ERROR(eon->base.context, "Group type descriptor '%s' has undescribed index %ld", desc->desc, index);
 			break;
 		}
@@ -264,7 +321,7 @@ desc_free (struct type_desc desc[], unsigned int count)
 	}
 }
 
-static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+static int parse_type(suunto_eonsteel_parser_t *eon, struct type_desc *result, const char *name)
 {
 	struct type_desc desc;
 	const char *next;
@@ -317,23 +374,250 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 		}
 	} while ((name = next) != NULL);
 
+	fill_in_desc_details(eon, &desc);
+
+	*result = desc;
+	return 0;
+}
+
+static unsigned int desc_hash(const char *text, unsigned int length)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < length; ++i) {
+		hash ^= (unsigned char) text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+ * Non-group descriptors are fully determined by their text. Group
+ * descriptors refer to other types by index, so the resolved details
+ * have to match as well.
+ */
+static const struct type_desc *desc_lookup(struct desc_entry *list, unsigned int hash, const char *text, unsigned int length, const struct type_desc *desc)
+{
+	for (struct desc_entry *entry = list; entry; entry = entry->next) {
+		if (entry->hash != hash || entry->length != length ||
+			memcmp(entry->text, text, length) != 0)
+			continue;
+		if (desc && (entry->desc.size != desc->size ||
+			memcmp(entry->desc.type, desc->type, sizeof(desc->type)) != 0))
+			continue;
+		return &entry->desc;
+	}
+	return NULL;
+}
+
+/*
+ * Enumerations have the enum values in the "format" string,
+ * and all start with "enum:" followed by a comma-separated list
+ * of enumeration values and strings. Example:
+ *
+ * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
+ *
+ * Without a labels array, only the size of the array is returned. The
+ * text buffer needs at most the length of the format string.
+ */
+static unsigned int enum_parse(const char *str, const char **labels, char *text)
+{
+	unsigned int count = 0;
+	unsigned char c;
+
+	if (!str)
+		return 0;
+	if (strncmp(str, "enum:", 5))
+		return 0;
+	str += 5;
+
+	while ((c = *str) != 0) {
+		unsigned char n;
+		const char *begin, *end;
+
+		str++;
+		if (!isdigit(c))
+			continue;
+		n = c - '0';
+
+		// We only handle one or two digits
+		if (isdigit(*str)) {
+			n = n*10 + *str - '0';
+			str++;
+		}
+
+		begin = end = str;
+		while ((c = *str) != 0) {
+			str++;
+			if (c == ',')
+				break;
+			end = str;
+		}
+
+		// Verify that it has the 'n=string' format and skip the equals sign
+		if (*begin != '=')
+			continue;
+		begin++;
+
+		if (n >= count)
+			count = n + 1;
+
+		// The first label for a value wins.
+		if (!labels || labels[n])
+			continue;
+
+		memcpy(text, begin, end-begin);
+		text[end-begin] = 0;
+		labels[n] = text;
+		text += end-begin+1;
+	}
+	return count;
+}
+
+static char *desc_copy(char **p, const char *string)
+{
+	if (!string)
+		return NULL;
+
+	size_t n = strlen(string) + 1;
+	char *copy = *p;
+	memcpy(copy, string, n);
+	*p += n;
+	return copy;
+}
+
+static const struct type_desc *desc_intern(suunto_eonsteel_parser_t *eon, unsigned int hash, const char *text, unsigned int length, const struct type_desc *desc)
+{
+	const struct type_desc *result = NULL;
+	struct desc_entry *entry = NULL;
+
+	// Allocate the entry, the enumeration labels, the descriptor text and
+	// strings in one block.
+	unsigned int nenums = enum_parse(desc->format, NULL, NULL);
+	size_t size = sizeof(struct desc_entry) + nenums * sizeof(const char *) + length + 1;
+	size += desc->desc ? strlen(desc->desc) + 1 : 0;
+	size += desc->format ? strlen(desc->format) + 1 : 0;
+	size += desc->mod ? strlen(desc->mod) + 1 : 0;
+	size += nenums ? strlen(desc->format) + 1 : 0;
+	if (dc_parser_reserve(&eon->base, size) != DC_STATUS_SUCCESS)
+		return NULL;
+	entry = (struct desc_entry *) malloc(size);
+	if (!entry) {
+		ERROR(eon->base.context, "out of memory");
+		return NULL;
+	}
+
+	const char **enums = (const char **) (entry + 1);
+	for (unsigned int i = 0; i < nenums; ++i)
+		enums[i] = NULL;
+
+	char *p = (char *) (enums + nenums);
+	memcpy(p, text, length);
+	p[length] = 0;
+	entry->text = p;
+	p += length + 1;
+
+	entry->hash = hash;
+	entry->length = length;
+	entry->desc = *desc;
+	entry->desc.desc = desc_copy(&p, desc->desc);
+	entry->desc.format = desc_copy(&p, desc->format);
+	entry->desc.mod = desc_copy(&p, desc->mod);
+	entry->desc.enums = enums;
+	entry->desc.nenums = enum_parse(desc->format, enums, p);
+
+	dc_global_lock();
+	struct desc_entry **bucket = g_desc_cache + hash % DESC_BUCKETS;
+	result = desc_lookup(*bucket, hash, text, length, isdigit(desc->desc[0]) ? desc : NULL);
+	if (result == NULL && g_desc_count < DESC_MAXCACHE) {
+		entry->next = *bucket;
+		*bucket = entry;
+		g_desc_count++;
+		result = &entry->desc;
+		entry = NULL;
+	}
+	dc_global_unlock();
+
+	if (entry) {
+		if (result) {
+			// Another parser interned the same descriptor first.
+			free(entry);
+		} else {
+			entry->next = eon->desc_private;
+			eon->desc_private = entry;
+			result = &entry->desc;
+		}
+	}
+
+	return result;
+}
+
+static void desc_private_free(suunto_eonsteel_parser_t *eon)
+{
+	struct desc_entry *entry = eon->desc_private;
+	while (entry) {
+		struct desc_entry *next = entry->next;
+		free(entry);
+		entry = next;
+	}
+	eon->desc_private = NULL;
+}
+
+static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+{
+	const struct type_desc *result = NULL;
+	struct type_desc desc;
+
+	const char *nul = namelen > 0 ? (const char *) memchr(name, 0, namelen) : name;
+	unsigned int length = nul ? nul - name : namelen;
+
 	if (type >= MAXTYPE) {
-		ERROR(eon->base.context, "Type out of range (%04x: '%s' '%s' '%s')",
-			type,
-			desc.desc ? desc.desc : "",
-			desc.format ? desc.format : "",
-			desc.mod ? desc.mod : "");
-		desc_free(&desc, 1);
+		ERROR(eon->base.context, "Type out of range (%04x: '%.*s')", type, length, name);
 		return -1;
 	}
 
-	fill_in_desc_details(eon, &desc);
+	unsigned int hash = desc_hash(name, length);
+	unsigned int group = length >= 5 && !memcmp(name, "<GRP>", 5);
+
+	// Use the shared descriptor if it's already known.
+	if (!group) {
+		dc_global_lock();
+		result = desc_lookup(g_desc_cache[hash % DESC_BUCKETS], hash, name, length, NULL);
+		dc_global_unlock();
+		if (!result)
+			result = desc_lookup(eon->desc_private, hash, name, length, NULL);
+		if (result) {
+			eon->type_desc[type] = result;
+			return 0;
+		}
+	}
 
-	desc_free(eon->type_desc + type, 1);
-	eon->type_desc[type] = desc;
+	if (parse_type(eon, &desc, name) < 0)
+		return -1;
+
+	if (desc.desc) {
+		if (group) {
+			dc_global_lock();
+			result = desc_lookup(g_desc_cache[hash % DESC_BUCKETS], hash, name, length, &desc);
+			dc_global_unlock();
+			if (!result)
+				result = desc_lookup(eon->desc_private, hash, name, length, &desc);
+		}
+		if (!result)
+			result = desc_intern(eon, hash, name, length, &desc);
+		if (!result) {
+			desc_free(&desc, 1);
+			return -1;
+		}
+	}
+
+	desc_free(&desc, 1);
+
+	eon->type_desc[type] = result;
 	return 0;
 }
 
+
 static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p, int len, eon_data_cb_t callback, void *user)
 {
 	const unsigned char *name, *data, *end, *last, *one_past_end = p + len;
@@ -386,11 +670,11 @@ static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p,
 			end += 4;
 		}
 
-		if (type >= MAXTYPE || !eon->type_desc[type].desc) {
+		if (type >= MAXTYPE || !eon->type_desc[type]) {
 			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "last", last, 16);
 			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "this", begin, 16);
 		} else {
-			rc = callback(type, eon->type_desc+type, end, len, user);
+			rc = callback(type, eon->type_desc[type], end, len, user);
 			if (rc < 0)
 				return rc;
 		}
@@ -417,6 +701,9 @@ static int traverse_data(suunto_eonsteel_parser_t *eon, eon_data_cb_t callback,
 	len -= 12;
 
 	while (len > 4) {
+		if (dc_parser_check_limits(&eon->base) != DC_STATUS_SUCCESS)
+			return 1;
+
 		int i = traverse_entry(eon, data, len, callback, user);
 		if (i < 0)
 			return 1;
@@ -431,13 +718,22 @@ struct sample_data {
 	dc_sample_callback_t callback;
 	void *userdata;
 	unsigned int time;
-	char *state_type, *notify_type;
-	char *warning_type, *alarm_type;
+	const char *state_type, *notify_type;
+	const char *warning_type, *alarm_type;
 
 	/* We gather up deco and cylinder pressure information */
 	int gasnr;
 };
 
+/*
+ * Sample types the caller didn't ask for are not decoded at all. The
+ * event types in particular need an enum string lookup.
+ */
+static int sample_wanted(struct sample_data *info, dc_sample_type_t type)
+{
+	return dc_parser_wants(info->eon, type);
+}
+
 static void sample_time(struct sample_data *info, unsigned short time_delta)
 {
 	dc_sample_value_t sample = {0};
@@ -510,6 +806,9 @@ static void sample_heading(struct sample_data *info, unsigned short heading)
 {
 	dc_sample_value_t sample = {0};
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	if (heading == 0xffff)
 		return;
 
@@ -564,6 +863,9 @@ static void sample_bookmark_event(struct sample_data *info, unsigned short idx)
 {
 	dc_sample_value_t sample = {0};
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	sample.event.type = SAMPLE_EVENT_BOOKMARK;
 	sample.event.value = idx;
 
@@ -575,6 +877,9 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
 	suunto_eonsteel_parser_t *eon = info->eon;
 	dc_sample_value_t sample = {0};
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	if (idx < 1 || idx > eon->cache.GASMIX_COUNT)
 		return;
 
@@ -583,67 +888,15 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
 }
 
 /*
- * Look up the string from an enumeration.
- *
- * Enumerations have the enum values in the "format" string,
- * and all start with "enum:" followed by a comma-separated list
- * of enumeration values and strings. Example:
- *
- * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
+ * Look up the string from an enumeration. The labels are parsed
+ * once, when the descriptor is interned.
  */
-static char *lookup_enum(const struct type_desc *desc, unsigned char value)
+static const char *lookup_enum(const struct type_desc *desc, unsigned char value)
 {
-	const char *str = desc->format;
-	unsigned char c;
-
-	if (!str)
-		return NULL;
-	if (strncmp(str, "enum:", 5))
+	if (value >= desc->nenums)
 		return NULL;
-	str += 5;
-
-	while ((c = *str) != 0) {
-		unsigned char n;
-		const char *begin, *end;
-		char *ret;
-
-		str++;
-		if (!isdigit(c))
-			continue;
-		n = c - '0';
-
-		// We only handle one or two digits
-		if (isdigit(*str)) {
-			n = n*10 + *str - '0';
-			str++;
-		}
-
-		begin = end = str;
-		while ((c = *str) != 0) {
-			str++;
-			if (c == ',')
-				break;
-			end = str;
-		}
-
-		// Verify that it has the 'n=string' format and skip the equals sign
-		if (*begin != '=')
-			continue;
-		begin++;
-
-		// Is it the value we're looking for?
-		if (n != value)
-			continue;
-
-		ret = (char *)malloc(end - begin + 1);
-		if (!ret)
-			break;
 
-		memcpy(ret, begin, end-begin);
-		ret[end-begin] = 0;
-		return ret;
-	}
-	return NULL;
+	return desc->enums[value];
 }
 
 /*
@@ -652,7 +905,11 @@ static char *lookup_enum(const struct type_desc *desc, unsigned char value)
  */
 static void sample_event_state_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->state_type);
+	info->state_type = NULL;
+
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	info->state_type = lookup_enum(desc, type);
 }
 
@@ -661,6 +918,9 @@ static void sample_event_state_value(const struct type_desc *desc, struct sample
 	dc_sample_value_t sample = {0};
 	const char *name;
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	name = info->state_type;
 	if (!name)
 		return;
@@ -675,7 +935,11 @@ static void sample_event_state_value(const struct type_desc *desc, struct sample
 
 static void sample_event_notify_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->notify_type);
+	info->notify_type = NULL;
+
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	info->notify_type = lookup_enum(desc, type);
 }
 
@@ -684,6 +948,9 @@ static void sample_event_notify_value(const struct type_desc *desc, struct sampl
 	dc_sample_value_t sample = {0};
 	const char *name;
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	name = info->notify_type;
 	if (!name)
 		return;
@@ -699,7 +966,11 @@ static void sample_event_notify_value(const struct type_desc *desc, struct sampl
 
 static void sample_event_warning_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->warning_type);
+	info->warning_type = NULL;
+
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	info->warning_type = lookup_enum(desc, type);
 }
 
@@ -708,6 +979,9 @@ static void sample_event_warning_value(const struct type_desc *desc, struct samp
 	dc_sample_value_t sample = {0};
 	const char *name;
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	name = info->warning_type;
 	if (!name)
 		return;
@@ -722,7 +996,11 @@ static void sample_event_warning_value(const struct type_desc *desc, struct samp
 
 static void sample_event_alarm_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	free(info->alarm_type);
+	info->alarm_type = NULL;
+
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	info->alarm_type = lookup_enum(desc, type);
 }
 
@@ -732,6 +1010,9 @@ static void sample_event_alarm_value(const struct type_desc *desc, struct sample
 	const char *name;
 	dc_sample_value_t sample = {0};
 
+	if (!sample_wanted(info, DC_SAMPLE_EVENT))
+		return;
+
 	name = info->alarm_type;
 	if (!name)
 		return;
@@ -748,7 +1029,12 @@ static void sample_event_alarm_value(const struct type_desc *desc, struct sample
 static void sample_setpoint_type(const struct type_desc *desc, struct sample_data *info, unsigned char value)
 {
 	dc_sample_value_t sample = {0};
-	char *type = lookup_enum(desc, value);
+	const char *type = NULL;
+
+	if (!sample_wanted(info, DC_SAMPLE_SETPOINT))
+		return;
+
+	type = lookup_enum(desc, value);
 
 	if (!type) {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) did not match anything in %s", value, desc->format);
@@ -763,12 +1049,10 @@ static void sample_setpoint_type(const struct type_desc *desc, struct sample_dat
 		sample.ppo2 = info->eon->cache.customsetpoint;
 	else {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) unknown type '%s'", value, type);
-		free(type);
 		return;
 	}
 
 	if (info->callback) info->callback(DC_SAMPLE_SETPOINT, sample, info->userdata);
-	free(type);
 }
 
 // uint32
@@ -928,14 +1212,19 @@ suunto_eonsteel_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
 	struct sample_data data = { eon, callback, userdata, 0 };
 
-	traverse_data(eon, traverse_samples, &data);
-
-	free(data.state_type);
-	free(data.notify_type);
-	free(data.warning_type);
-	free(data.alarm_type);
+	if (eon->entries_valid) {
+		for (unsigned int i = 0; i < eon->nentries; ++i) {
+			const struct sample_entry *entry = eon->entries + i;
+			dc_status_t rc = dc_parser_check_limits(abstract);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+			traverse_samples(0, entry->desc, entry->data, entry->len, &data);
+		}
+	} else {
+		traverse_data(eon, traverse_samples, &data);
+	}
 
-	return DC_STATUS_SUCCESS;
+	return dc_parser_check_limits(abstract);
 }
 
 static dc_status_t
@@ -1061,7 +1350,7 @@ static dc_status_t add_gas_type(suunto_eonsteel_parser_t *eon, const struct type
 {
 	int idx = eon->cache.GASMIX_COUNT;
 	dc_tankinfo_t tankinfo = DC_TANKINFO_METRIC;
-	char *name;
+	const char *name;
 
 	if (idx >= MAXGASES)
 		return DC_STATUS_SUCCESS;
@@ -1083,7 +1372,6 @@ static dc_status_t add_gas_type(suunto_eonsteel_parser_t *eon, const struct type
 
 	eon->cache.initialized |= 1 << DC_FIELD_GASMIX_COUNT;
 	eon->cache.initialized |= 1 << DC_FIELD_TANK_COUNT;
-	free(name);
 	return DC_STATUS_SUCCESS;
 }
 
@@ -1137,6 +1425,22 @@ static float get_le32_float(const unsigned char *src)
 	return u.result;
 }
 
+// The formatted string fields are only generated when requested.
+static void format_percentage(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "%d %%", arg);
+}
+
+static void format_conservatism(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "P%d", (int) arg);
+}
+
+static void format_time(char *buffer, size_t size, const void *userdata, unsigned int arg)
+{
+	snprintf(buffer, size, "%d:%02d", arg / 60, arg % 60);
+}
+
 // "Device" fields are all utf8:
 //   Info.BatteryAtEnd
 //   Info.BatteryAtStart
@@ -1210,10 +1514,10 @@ static dc_status_t traverse_gas_fields(suunto_eonsteel_parser_t *eon,
 		return 0;
 
 	if (!strcmp(name, ".Gas.TransmitterStartBatteryCharge"))
-		return dc_field_add_string_fmt(&eon->cache, "Transmitter Battery at start", "%d %%", data[0]);
+		return dc_field_add_string_lazy(&eon->cache, "Transmitter Battery at start", format_percentage, NULL, data[0]);
 
 	if (!strcmp(name, ".Gas.TransmitterEndBatteryCharge"))
-		return dc_field_add_string_fmt(&eon->cache, "Transmitter Battery at end", "%d %%", data[0]);
+		return dc_field_add_string_lazy(&eon->cache, "Transmitter Battery at end", format_percentage, NULL, data[0]);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1285,7 +1589,7 @@ static dc_status_t traverse_diving_fields(suunto_eonsteel_parser_t *eon,
 	if (!strcmp(name, "Conservatism")) {
 		int val = *(signed char *)data;
 
-		return dc_field_add_string_fmt(&eon->cache, "Personal Adjustment", "P%d", val);
+		return dc_field_add_string_lazy(&eon->cache, "Personal Adjustment", format_conservatism, NULL, (unsigned int) val);
 	}
 
 	if (!strcmp(name, "LowSetPoint")) {
@@ -1304,12 +1608,12 @@ static dc_status_t traverse_diving_fields(suunto_eonsteel_parser_t *eon,
 	// Let's just agree to ignore seconds
 	if (!strcmp(name, "DesaturationTime")) {
 		unsigned int time = array_uint32_le(data) / 60;
-		return dc_field_add_string_fmt(&eon->cache, "Desaturation Time", "%d:%02d", time / 60, time % 60);
+		return dc_field_add_string_lazy(&eon->cache, "Desaturation Time", format_time, NULL, time);
 	}
 
 	if (!strcmp(name, "SurfaceTime")) {
 		unsigned int time = array_uint32_le(data) / 60;
-		return dc_field_add_string_fmt(&eon->cache, "Surface Time", "%d:%02d", time / 60, time % 60);
+		return dc_field_add_string_lazy(&eon->cache, "Surface Time", format_time, NULL, time);
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -1392,14 +1696,43 @@ static int traverse_sample_fields(suunto_eonsteel_parser_t *eon, const struct ty
 	return 0;
 }
 
+static void record_sample_entry(suunto_eonsteel_parser_t *eon, const struct type_desc *desc, const unsigned char *data, int len)
+{
+	if (!eon->entries_valid)
+		return;
+
+	if (eon->nentries == eon->maxentries) {
+		unsigned int maxentries = eon->maxentries ? eon->maxentries * 2 : 256;
+		if (dc_parser_reserve(&eon->base, (maxentries - eon->maxentries) * sizeof(struct sample_entry)) != DC_STATUS_SUCCESS) {
+			eon->entries_valid = 0;
+			return;
+		}
+		struct sample_entry *entries = (struct sample_entry *) realloc(eon->entries, maxentries * sizeof(struct sample_entry));
+		if (!entries) {
+			// Fall back to parsing the data again for the samples.
+			WARNING(eon->base.context, "out of memory");
+			eon->entries_valid = 0;
+			return;
+		}
+		eon->entries = entries;
+		eon->maxentries = maxentries;
+	}
+
+	eon->entries[eon->nentries].desc = desc;
+	eon->entries[eon->nentries].data = data;
+	eon->entries[eon->nentries].len = len;
+	eon->nentries++;
+}
+
 static int traverse_fields(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) user;
 
 	// Sample type? Do basic maxdepth and time parsing
-	if (desc->type[0])
+	if (desc->type[0]) {
+		record_sample_entry(eon, desc, data, len);
 		traverse_sample_fields(eon, desc, data, len);
-	else
+	} else
 		traverse_dynamic_fields(eon, desc, data, len);
 
 	return 0;
@@ -1408,9 +1741,11 @@ static int traverse_fields(unsigned short type, const struct type_desc *desc, co
 
 static void initialize_field_caches(suunto_eonsteel_parser_t *eon)
 {
-	memset(&eon->cache, 0, sizeof(eon->cache));
+	dc_field_cache_clear(&eon->cache);
 	eon->cache.initialized = 1 << DC_FIELD_DIVETIME;
 
+	eon->nentries = 0;
+	eon->entries_valid = 1;
 	traverse_data(eon, traverse_fields, eon);
 
 	// The internal time fields are in ms and have to be added up
@@ -1418,11 +1753,11 @@ static void initialize_field_caches(suunto_eonsteel_parser_t *eon)
 	eon->cache.DIVETIME /= 1000;
 }
 
-static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, struct type_desc *desc)
+static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, const struct type_desc *desc)
 {
 	int i;
 
-	if (!desc->desc)
+	if (!desc)
 		return;
 	DEBUG(eon->base.context, "Descriptor %d: '%s', size %d bytes", nr, desc->desc, desc->size);
 	if (desc->format)
@@ -1440,7 +1775,7 @@ static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, struct type_d
 static void show_all_descriptors(suunto_eonsteel_parser_t *eon)
 {
 	for (unsigned int i = 0; i < MAXTYPE; ++i)
-		show_descriptor(eon, i, eon->type_desc+i);
+		show_descriptor(eon, i, eon->type_desc[i]);
 }
 
 static dc_status_t
@@ -1448,8 +1783,8 @@ suunto_eonsteel_parser_set_data(dc_parser_t *parser, const unsigned char *data,
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
 	memset(eon->type_desc, 0, sizeof(eon->type_desc));
+	desc_private_free(eon);
 	initialize_field_caches(eon);
 	show_all_descriptors(eon);
 	return DC_STATUS_SUCCESS;
@@ -1460,7 +1795,8 @@ suunto_eonsteel_parser_destroy(dc_parser_t *parser)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
+	desc_private_free(eon);
+	free(eon->entries);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1490,9 +1826,29 @@ suunto_eonsteel_parser_create(dc_parser_t **out, dc_context_t *context, unsigned
 	}
 
 	memset(&parser->type_desc, 0, sizeof(parser->type_desc));
-	memset(&parser->cache, 0, sizeof(parser->cache));
+	parser->desc_private = NULL;
+	dc_field_cache_init(&parser->cache);
+	parser->entries = NULL;
+	parser->nentries = 0;
+	parser->maxentries = 0;
+	parser->entries_valid = 0;
 
 	*out = (dc_parser_t *) parser;
 
 	return DC_STATUS_SUCCESS;
 }
+
+unsigned int
+suunto_eonsteel_parser_probe(const unsigned char data[], unsigned int size)
+{
+	static const unsigned char zero[4] = {0};
+
+	// The dive starts with the fingerprint, followed by the SBEM header.
+	if (size < 12 || memcmp(data + 4, "SBEM", 4) != 0)
+		return 0;
+
+	if (memcmp(data + 8, zero, sizeof(zero)) == 0)
+		return 100;
+
+	return 50;
+}
@@ -0,0 +1,403 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdio.h>  // snprintf
+#include <string.h> // memcpy, memset
+
+#include "simulator-private.h"
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+
+#define CMD_INIT        0x0000
+#define CMD_FILE_OPEN   0x0010
+#define CMD_FILE_READ   0x0110
+#define CMD_FILE_STAT   0x0710
+#define CMD_FILE_CLOSE  0x0510
+#define CMD_DIR_OPEN    0x0810
+#define CMD_DIR_READDIR 0x0910
+#define CMD_DIR_CLOSE   0x0a10
+
+#define DIRTYPE_FILE 0x0001
+
+#define PACKET_SIZE  64
+#define HEADER_SIZE  12
+#define MAXDATA_SIZE 2048
+#define CRC_SIZE     4
+#define BLE_SIZE     20
+
+#define SZ_VERSION   0x30
+#define SZ_NAME      12 // XXXXXXXX.LOG
+#define DIRENTS      64
+#define MAGIC        0x12340000
+
+#define KEY_VERSION  0
+
+// HDLC special characters
+#define END     0x7E
+#define ESC     0x7D
+#define ESC_BIT 0x20
+
+typedef struct suunto_eonsteel_simulator_t {
+	dc_simulator_protocol_t base;
+	unsigned char *data;
+	size_t size;
+	unsigned char version[SZ_VERSION];
+	dc_simulator_record_t file;
+	unsigned int fileoffset;
+	size_t diroffset;
+} suunto_eonsteel_simulator_t;
+
+static size_t suunto_eonsteel_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size);
+static void suunto_eonsteel_simulator_destroy (dc_simulator_protocol_t *abstract);
+
+static const dc_simulator_protocol_vtable_t suunto_eonsteel_simulator_vtable = {
+	sizeof(suunto_eonsteel_simulator_t),
+	suunto_eonsteel_simulator_process, /* process */
+	suunto_eonsteel_simulator_destroy, /* destroy */
+};
+
+dc_status_t
+suunto_eonsteel_simulator_create (dc_simulator_protocol_t **out, dc_simulator_t *simulator, const unsigned char data[], size_t size)
+{
+	suunto_eonsteel_simulator_t *protocol = NULL;
+
+	// Allocate memory.
+	protocol = (suunto_eonsteel_simulator_t *) dc_simulator_protocol_allocate (simulator, &suunto_eonsteel_simulator_vtable);
+	if (protocol == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	protocol->data = NULL;
+	protocol->size = size;
+	protocol->fileoffset = 0;
+	protocol->diroffset = 0;
+	memset (&protocol->file, 0, sizeof (protocol->file));
+	memset (protocol->version, 0, sizeof (protocol->version));
+
+	// Validate the records.
+	size_t offset = 0;
+	dc_simulator_record_t record;
+	int rc = 0;
+	while ((rc = dc_simulator_record_next (data, size, &offset, &record)) > 0) {
+		if (record.key == KEY_VERSION) {
+			memcpy (protocol->version, record.data, record.size < SZ_VERSION ? record.size : SZ_VERSION);
+		}
+	}
+	if (rc < 0) {
+		ERROR (protocol->base.context, "Unexpected end of the records.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	protocol->data = (unsigned char *) dc_context_malloc (protocol->base.context, size ? size : 1);
+	if (protocol->data == NULL) {
+		ERROR (protocol->base.context, "Failed to allocate memory.");
+		dc_simulator_protocol_deallocate ((dc_simulator_protocol_t *) protocol);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size)
+		memcpy (protocol->data, data, size);
+
+	*out = (dc_simulator_protocol_t *) protocol;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+suunto_eonsteel_simulator_destroy (dc_simulator_protocol_t *abstract)
+{
+	suunto_eonsteel_simulator_t *protocol = (suunto_eonsteel_simulator_t *) abstract;
+
+	dc_context_dealloc (protocol->base.context, protocol->data);
+}
+
+/*
+ * Send the answer as a series of HID reports. The first report
+ * contains the header and the first part of the data.
+ */
+static void
+suunto_eonsteel_simulator_send_usb (suunto_eonsteel_simulator_t *protocol, const unsigned char data[], unsigned int size)
+{
+	unsigned int offset = 0;
+
+	do {
+		unsigned char packet[PACKET_SIZE] = {0};
+		unsigned int length = size - offset;
+		if (length > PACKET_SIZE - 2)
+			length = PACKET_SIZE - 2;
+
+		packet[0] = 0x3f;
+		packet[1] = length;
+		memcpy (packet + 2, data + offset, length);
+		dc_simulator_reply (protocol->base.simulator, packet, sizeof (packet));
+
+		offset += length;
+	} while (offset < size);
+}
+
+/*
+ * Send the answer as a HDLC frame, split into BLE packets.
+ */
+static void
+suunto_eonsteel_simulator_send_ble (suunto_eonsteel_simulator_t *protocol, const unsigned char data[], unsigned int size)
+{
+	unsigned char packet[BLE_SIZE];
+	unsigned int nbytes = 0;
+	unsigned char crc[CRC_SIZE];
+
+	array_uint32_le_set (crc, checksum_crc32 (data, size));
+
+	packet[nbytes++] = END;
+	for (unsigned int i = 0; i < size + CRC_SIZE; ++i) {
+		unsigned char c = i < size ? data[i] : crc[i - size];
+
+		if (c == END || c == ESC) {
+			packet[nbytes++] = ESC;
+			if (nbytes == sizeof (packet)) {
+				dc_simulator_reply (protocol->base.simulator, packet, nbytes);
+				nbytes = 0;
+			}
+			c ^= ESC_BIT;
+		}
+
+		packet[nbytes++] = c;
+		if (nbytes == sizeof (packet)) {
+			dc_simulator_reply (protocol->base.simulator, packet, nbytes);
+			nbytes = 0;
+		}
+	}
+	packet[nbytes++] = END;
+
+	dc_simulator_reply (protocol->base.simulator, packet, nbytes);
+}
+
+static void
+suunto_eonsteel_simulator_answer (suunto_eonsteel_simulator_t *protocol, unsigned int cmd, unsigned int magic, unsigned int seq, const unsigned char data[], unsigned int size)
+{
+	unsigned char answer[HEADER_SIZE + MAXDATA_SIZE];
+
+	array_uint16_le_set (answer + 0, cmd);
+	array_uint32_le_set (answer + 2, magic);
+	array_uint16_le_set (answer + 6, seq);
+	array_uint32_le_set (answer + 8, size);
+	if (size)
+		memcpy (answer + HEADER_SIZE, data, size);
+
+	if (protocol->base.transport == DC_TRANSPORT_BLE) {
+		suunto_eonsteel_simulator_send_ble (protocol, answer, HEADER_SIZE + size);
+	} else {
+		suunto_eonsteel_simulator_send_usb (protocol, answer, HEADER_SIZE + size);
+	}
+}
+
+/*
+ * Get the next dive file for the directory listing.
+ */
+static int
+suunto_eonsteel_simulator_readdir (suunto_eonsteel_simulator_t *protocol, dc_simulator_record_t *record)
+{
+	while (dc_simulator_record_next (protocol->data, protocol->size, &protocol->diroffset, record) > 0) {
+		if (record->key != KEY_VERSION)
+			return 1;
+	}
+
+	return 0;
+}
+
+static unsigned int
+suunto_eonsteel_simulator_request (suunto_eonsteel_simulator_t *protocol, unsigned int cmd, const unsigned char data[], unsigned int size, unsigned char answer[])
+{
+	unsigned int nbytes = 0;
+
+	switch (cmd) {
+	case CMD_INIT:
+		memcpy (answer, protocol->version, SZ_VERSION);
+		nbytes = SZ_VERSION;
+		break;
+	case CMD_FILE_OPEN:
+		{
+			// The dive files are named after their timestamp.
+			unsigned int timestamp = 0;
+			const char *name = (const char *) data + 4;
+			const char *filename = NULL;
+			memset (&protocol->file, 0, sizeof (protocol->file));
+			protocol->fileoffset = 0;
+			if (size > 4 && memchr (name, 0, size - 4) != NULL &&
+				(filename = strrchr (name, '/')) != NULL &&
+				sscanf (filename + 1, "%x.LOG", &timestamp) == 1 &&
+				timestamp != KEY_VERSION) {
+				dc_simulator_record_find (protocol->data, protocol->size, timestamp, &protocol->file);
+			}
+			memset (answer, 0, 4);
+			nbytes = 4;
+		}
+		break;
+	case CMD_FILE_STAT:
+		array_uint32_le_set (answer + 0, 0);
+		array_uint32_le_set (answer + 4, protocol->file.size);
+		nbytes = 8;
+		break;
+	case CMD_FILE_READ:
+		if (size >= 8) {
+			unsigned int ask = array_uint32_le (data + 4);
+			unsigned int got = protocol->file.size - protocol->fileoffset;
+			if (got > ask)
+				got = ask;
+			if (got > MAXDATA_SIZE - 8)
+				got = MAXDATA_SIZE - 8;
+
+			memcpy (answer, data, 4);
+			array_uint32_le_set (answer + 4, got);
+			if (got)
+				memcpy (answer + 8, protocol->file.data + protocol->fileoffset, got);
+			protocol->fileoffset += got;
+			nbytes = 8 + got;
+		}
+		break;
+	case CMD_DIR_OPEN:
+		protocol->diroffset = 0;
+		memset (answer, 0, 4);
+		nbytes = 4;
+		break;
+	case CMD_DIR_READDIR:
+		{
+			unsigned int count = 0, last = 1;
+			nbytes = 8;
+			dc_simulator_record_t record;
+			while (suunto_eonsteel_simulator_readdir (protocol, &record)) {
+				char name[SZ_NAME + 1];
+				snprintf (name, sizeof (name), "%08X.LOG", record.key);
+				array_uint32_le_set (answer + nbytes + 0, DIRTYPE_FILE);
+				array_uint32_le_set (answer + nbytes + 4, SZ_NAME);
+				memcpy (answer + nbytes + 8, name, SZ_NAME + 1);
+				nbytes += 8 + SZ_NAME + 1;
+				count++;
+
+				if (count == DIRENTS) {
+					// Check for more entries, without consuming them.
+					size_t offset = protocol->diroffset;
+					last = !suunto_eonsteel_simulator_readdir (protocol, &record);
+					protocol->diroffset = offset;
+					break;
+				}
+			}
+			array_uint32_le_set (answer + 0, count);
+			array_uint32_le_set (answer + 4, last);
+		}
+		break;
+	case CMD_FILE_CLOSE:
+	case CMD_DIR_CLOSE:
+		memset (answer, 0, 4);
+		nbytes = 4;
+		break;
+	default:
+		// Other commands (e.g. the time and date) are accepted without data.
+		break;
+	}
+
+	return nbytes;
+}
+
+static size_t
+suunto_eonsteel_simulator_process (dc_simulator_protocol_t *abstract, const unsigned char data[], size_t size)
+{
+	suunto_eonsteel_simulator_t *protocol = (suunto_eonsteel_simulator_t *) abstract;
+	unsigned char packet[HEADER_SIZE + MAXDATA_SIZE + CRC_SIZE];
+	unsigned int nbytes = 0;
+	size_t consumed = 0;
+
+	if (abstract->transport == DC_TRANSPORT_BLE) {
+		// Skip the start of the frame.
+		size_t begin = 0;
+		while (begin < size && data[begin] == END)
+			begin++;
+		if (begin == size)
+			return size;
+
+		// Wait for the end of the frame.
+		size_t end = begin;
+		while (end < size && data[end] != END)
+			end++;
+		if (end == size)
+			return 0;
+
+		unsigned int escaped = 0;
+		for (size_t i = begin; i < end; ++i) {
+			unsigned char c = data[i];
+			if (c == ESC) {
+				escaped = 1;
+				continue;
+			}
+			if (escaped) {
+				c ^= ESC_BIT;
+				escaped = 0;
+			}
+			if (nbytes < sizeof (packet))
+				packet[nbytes] = c;
+			nbytes++;
+		}
+
+		consumed = end + 1;
+
+		if (nbytes > sizeof (packet) || nbytes < HEADER_SIZE + CRC_SIZE ||
+			array_uint32_le (packet + nbytes - CRC_SIZE) != checksum_crc32 (packet, nbytes - CRC_SIZE)) {
+			WARNING (abstract->context, "Invalid request packet.");
+			return consumed;
+		}
+
+		nbytes -= CRC_SIZE;
+	} else {
+		// Wait for the entire report.
+		if (size < PACKET_SIZE)
+			return 0;
+
+		consumed = PACKET_SIZE;
+
+		nbytes = data[1];
+		if (data[0] != 0x3f || nbytes < HEADER_SIZE || nbytes > PACKET_SIZE - 2) {
+			WARNING (abstract->context, "Invalid request packet.");
+			return consumed;
+		}
+
+		memcpy (packet, data + 2, nbytes);
+	}
+
+	unsigned int cmd = array_uint16_le (packet + 0);
+	unsigned int magic = array_uint32_le (packet + 2);
+	unsigned int seq = array_uint16_le (packet + 6);
+	unsigned int length = array_uint32_le (packet + 8);
+	if (length != nbytes - HEADER_SIZE) {
+		WARNING (abstract->context, "Invalid request length.");
+		return consumed;
+	}
+
+	unsigned char answer[MAXDATA_SIZE];
+	unsigned int n = suunto_eonsteel_simulator_request (protocol, cmd, packet + HEADER_SIZE, length, answer);
+
+	// The init answer provides the magic value of the session, and the
+	// other answers contain that value plus five.
+	suunto_eonsteel_simulator_answer (protocol, cmd,
+		cmd == CMD_INIT ? MAGIC | 0x0001 : magic + 5, seq, answer, n);
+
+	return consumed;
+}
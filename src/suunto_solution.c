@@ -25,6 +25,7 @@
 
 #include "suunto_solution.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "ringbuffer.h"
 #include "array.h"
@@ -51,7 +52,9 @@ static const dc_device_vtable_t suunto_solution_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	suunto_solution_device_dump, /* dump */
+	NULL, /* dump_update */
 	suunto_solution_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -228,7 +231,7 @@ suunto_solution_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 suunto_solution_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
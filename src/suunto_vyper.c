@@ -26,6 +26,7 @@
 #include "suunto_vyper.h"
 #include "suunto_common.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -38,11 +39,15 @@
 #define SZ_MEMORY 0x2000
 #define SZ_PACKET 32
 
+#define MAXRETRIES 2
+
 #define HDR_DEVINFO_VYPER   0x24
 #define HDR_DEVINFO_SPYDER  0x16
 #define HDR_DEVINFO_BEGIN   (HDR_DEVINFO_SPYDER)
 #define HDR_DEVINFO_END     (HDR_DEVINFO_VYPER + 6)
 
+#define PACING_SEND 0
+
 typedef struct suunto_vyper_device_t {
 	suunto_common_device_t base;
 	dc_iostream_t *iostream;
@@ -60,7 +65,9 @@ static const dc_device_vtable_t suunto_vyper_device_vtable = {
 	suunto_vyper_device_read, /* read */
 	suunto_vyper_device_write, /* write */
 	suunto_vyper_device_dump, /* dump */
+	NULL, /* dump_update */
 	suunto_vyper_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -147,7 +154,7 @@ suunto_vyper_send (suunto_vyper_device_t *device, const unsigned char command[],
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
-	dc_iostream_sleep (device->iostream, 500);
+	dc_iostream_sleep (device->iostream, device_pacing_delay (abstract, PACING_SEND, 500));
 
 	// Set RTS to send the command.
 	status = dc_iostream_set_rts (device->iostream, 1);
@@ -231,36 +238,48 @@ suunto_vyper_transfer (suunto_vyper_device_t *device, const unsigned char comman
 }
 
 
+static unsigned int
+suunto_vyper_page_command (dc_device_t *abstract, unsigned char command[], unsigned int address, unsigned int npages)
+{
+	command[0] = 0x05;
+	command[1] = (address >> 8) & 0xFF; // high
+	command[2] = (address     ) & 0xFF; // low
+	command[3] = npages; // count
+	command[4] = checksum_xor_uint8 (command, 4, 0x00); // CRC
+
+	return 5;
+}
+
+
 static dc_status_t
-suunto_vyper_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
+suunto_vyper_page_transfer (dc_device_t *abstract, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
-	suunto_vyper_device_t *device = (suunto_vyper_device_t*) abstract;
+	dc_status_t rc = suunto_vyper_transfer ((suunto_vyper_device_t *) abstract, command, csize, answer, asize, asize - 5);
+	device_pacing_update (abstract, PACING_SEND, rc);
+	return rc;
+}
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the package size.
-		unsigned int len = MIN (size - nbytes, SZ_PACKET);
 
-		// Read the package.
-		unsigned char answer[SZ_PACKET + 5] = {0};
-		unsigned char command[5] = {0x05,
-				(address >> 8) & 0xFF, // high
-				(address     ) & 0xFF, // low
-				len, // count
-				0};  // CRC
-		command[4] = checksum_xor_uint8 (command, 4, 0x00);
-		dc_status_t rc = suunto_vyper_transfer (device, command, sizeof (command), answer, len + 5, len);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+// The pages are single bytes, and the answer repeats the command.
+static const device_page_protocol_t suunto_vyper_page_protocol = {
+	1, /* pagesize */
+	SZ_PACKET, /* maxpages */
+	4, /* header */
+	1, /* trailer */
+	DEVICE_PAGE_CHECKSUM_NONE, /* checksum */
+	MAXRETRIES, /* maxretries */
+	100, /* delay */
+	suunto_vyper_page_command, /* command */
+	suunto_vyper_page_transfer, /* transfer */
+};
 
-		memcpy (data, answer + 4, len);
 
-		nbytes += len;
-		address += len;
-		data += len;
-	}
+static dc_status_t
+suunto_vyper_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
+{
+	suunto_vyper_device_t *device = (suunto_vyper_device_t*) abstract;
 
-	return DC_STATUS_SUCCESS;
+	return device_page_read (abstract, device->iostream, &suunto_vyper_page_protocol, address, data, size);
 }
 
 
@@ -484,13 +503,15 @@ suunto_vyper_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Allocate a memory buffer.
-	dc_buffer_t *buffer = dc_buffer_new (layout->rb_profile_end - layout->rb_profile_begin);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, layout->rb_profile_end - layout->rb_profile_begin);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
 	unsigned int ndives = 0;
 	unsigned int remaining = layout->rb_profile_end - layout->rb_profile_begin;
 	while ((rc = suunto_vyper_read_dive (abstract, buffer, (ndives == 0), &progress)) == DC_STATUS_SUCCESS) {
+		device_pacing_update (abstract, PACING_SEND, rc);
+
 		unsigned char *data = dc_buffer_get_data (buffer);
 		unsigned int size = dc_buffer_get_size (buffer);
 
@@ -519,6 +540,8 @@ suunto_vyper_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 		ndives++;
 	}
 
+	device_pacing_update (abstract, PACING_SEND, rc);
+
 	dc_buffer_free (buffer);
 
 	return rc;
@@ -33,6 +33,8 @@
 
 #define HELO2    0x15
 
+#define PACING_PACKET 0
+
 typedef struct suunto_vyper2_device_t {
 	suunto_common2_device_t base;
 	dc_iostream_t *iostream;
@@ -50,7 +52,9 @@ static const suunto_common2_device_vtable_t suunto_vyper2_device_vtable = {
 		suunto_common2_device_read, /* read */
 		suunto_common2_device_write, /* write */
 		suunto_common2_device_dump, /* dump */
+		NULL, /* dump_update */
 		suunto_common2_device_foreach, /* foreach */
+		NULL, /* extract */
 		NULL, /* timesync */
 		suunto_vyper2_device_close /* close */
 	},
@@ -180,7 +184,7 @@ suunto_vyper2_device_packet (dc_device_t *abstract, const unsigned char command[
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
-	dc_iostream_sleep (device->iostream, 600);
+	dc_iostream_sleep (device->iostream, device_pacing_delay (abstract, PACING_PACKET, 600));
 
 	// Set RTS to send the command.
 	status = dc_iostream_set_rts (device->iostream, 1);
@@ -20,10 +20,10 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
 
 #include "tecdiving_divecomputereu.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "array.h"
 
@@ -48,6 +48,7 @@
 #define SZ_SAMPLE   8
 #define SZ_INIT     56
 #define SZ_LIST     (2 + 0x10000 * SZ_SUMMARY)
+#define SZ_CHUNK    (140 * SZ_SUMMARY)
 #define SZ_HEADER   100
 #define SZ_PROFILE  (1000 * SZ_SAMPLE)
 
@@ -72,7 +73,9 @@ static const dc_device_vtable_t tecdiving_divecomputereu_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	NULL, /* dump */
+	NULL, /* dump_update */
 	tecdiving_divecomputereu_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	tecdiving_divecomputereu_device_close, /* close */
 };
@@ -139,8 +142,14 @@ tecdiving_divecomputereu_send (tecdiving_divecomputereu_device_t *device, unsign
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Receive the start of a packet. On success, the length of the payload
+ * and the checksum of the header are returned. The payload and the
+ * checksum are read afterwards, with tecdiving_divecomputereu_payload
+ * and tecdiving_divecomputereu_checksum.
+ */
 static dc_status_t
-tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, unsigned char rsp, unsigned char data[], size_t size, size_t *actual)
+tecdiving_divecomputereu_header (tecdiving_divecomputereu_device_t *device, unsigned char rsp, size_t size, size_t *length, unsigned short *crc)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -196,9 +205,9 @@ tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, uns
 	}
 
 	// Verify the length.
-	unsigned int length = array_uint32_le (header + 2);
-	if (length > size) {
-		ERROR (abstract->context, "Unexpected packet length (%u).", length);
+	unsigned int len = array_uint32_le (header + 2);
+	if (len > size) {
+		ERROR (abstract->context, "Unexpected packet length (%u).", len);
 		return DC_STATUS_PROTOCOL;
 	}
 
@@ -209,14 +218,26 @@ tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, uns
 		return DC_STATUS_PROTOCOL;
 	}
 
+	*length = len;
+	*crc = checksum_crc (header + 1, sizeof(header) - 1, 0);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+tecdiving_divecomputereu_payload (tecdiving_divecomputereu_device_t *device, unsigned char data[], size_t size, unsigned short *crc)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
 	size_t nbytes = 0;
-	while (nbytes < length) {
+	while (nbytes < size) {
 		// Set the maximum packet size.
 		size_t len = 1000;
 
 		// Limit the packet size to the total size.
-		if (nbytes + len > length)
-			len = length - nbytes;
+		if (nbytes + len > size)
+			len = size - nbytes;
 
 		// Read the packet payload.
 		status = dc_iostream_read (device->iostream, data + nbytes, len, NULL);
@@ -228,6 +249,17 @@ tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, uns
 		nbytes += len;
 	}
 
+	*crc = checksum_crc (data, size, *crc);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+tecdiving_divecomputereu_checksum (tecdiving_divecomputereu_device_t *device, unsigned short ccrc)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
 	// Read the packet checksum.
 	unsigned char checksum[4];
 	status = dc_iostream_read (device->iostream, checksum, sizeof(checksum), NULL);
@@ -238,23 +270,38 @@ tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, uns
 
 	// Verify the checksum.
 	unsigned short crc = array_uint16_be (checksum);
-	unsigned short ccrc = 0;
-	ccrc = checksum_crc (header + 1, sizeof(header) - 1, ccrc);
-	ccrc = checksum_crc (data, length, ccrc);
 	if (crc != ccrc || checksum[2] != 0x00 || checksum[3] != 0) {
 		ERROR (abstract->context, "Unexpected packet checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
 
-	if (actual == NULL) {
-		// Verify the actual length.
-		if (length != size) {
-			ERROR (abstract->context, "Unexpected packet length (%u).", length);
-			return DC_STATUS_PROTOCOL;
-		}
-	} else {
-		// Return the actual length.
-		*actual = length;
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+tecdiving_divecomputereu_receive (tecdiving_divecomputereu_device_t *device, unsigned char rsp, unsigned char data[], size_t size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned short crc = 0;
+	size_t length = 0;
+
+	status = tecdiving_divecomputereu_header (device, rsp, size, &length, &crc);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	status = tecdiving_divecomputereu_payload (device, data, length, &crc);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	status = tecdiving_divecomputereu_checksum (device, crc);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// Verify the actual length.
+	if (length != size) {
+		ERROR (abstract->context, "Unexpected packet length (%u).", (unsigned int) length);
+		return DC_STATUS_PROTOCOL;
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -285,7 +332,7 @@ tecdiving_divecomputereu_readdive (dc_device_t *abstract, dc_event_progress_t *p
 
 	// Read the dive header.
 	unsigned char header[SZ_HEADER];
-	status = tecdiving_divecomputereu_receive (device, RSP_HEADER, header, sizeof(header), NULL);
+	status = tecdiving_divecomputereu_receive (device, RSP_HEADER, header, sizeof(header));
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the dive header.");
 		return status;
@@ -324,7 +371,7 @@ tecdiving_divecomputereu_readdive (dc_device_t *abstract, dc_event_progress_t *p
 			len = SZ_PROFILE;
 
 		// Read the dive samples.
-		status = tecdiving_divecomputereu_receive (device, RSP_PROFILE, data + nbytes, len, NULL);
+		status = tecdiving_divecomputereu_receive (device, RSP_PROFILE, data + nbytes, len);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the dive samples.");
 			return status;
@@ -388,7 +435,7 @@ tecdiving_divecomputereu_device_open (dc_device_t **out, dc_context_t *context,
 	}
 
 	// Read the device info.
-	status = tecdiving_divecomputereu_receive (device, RSP_INIT, device->version, sizeof(device->version), NULL);
+	status = tecdiving_divecomputereu_receive (device, RSP_INIT, device->version, sizeof(device->version));
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to receive the device info.");
 		goto error_free;
@@ -457,9 +504,8 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 	vendor.size = sizeof(device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	// Allocate memory for the dive list.
-	size_t length = SZ_LIST;
-	unsigned char *logbook = (unsigned char *) malloc (length);
+	// Allocate memory for the new entries of the dive list.
+	dc_buffer_t *logbook = dc_buffer_allocate (abstract->context, 0);
 	if (logbook == NULL) {
 		status = DC_STATUS_NOMEMORY;
 		goto error_exit;
@@ -472,8 +518,12 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 		goto error_logbook_free;
 	}
 
-	// Read the dive list.
-	status = tecdiving_divecomputereu_receive (device, RSP_LIST, logbook, length, &length);
+	// Read the dive list. The list is decoded while it arrives, and only
+	// the entries up to the fingerprint are kept, instead of receiving
+	// the entire list in a buffer for the largest possible list first.
+	unsigned short crc = 0;
+	size_t length = 0;
+	status = tecdiving_divecomputereu_header (device, RSP_LIST, SZ_LIST, &length, &crc);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the logbook.");
 		goto error_logbook_free;
@@ -486,7 +536,14 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 	}
 
 	// Get the number of logbook entries.
-	unsigned int nlogbooks = array_uint16_be (logbook);
+	unsigned char count[2];
+	status = tecdiving_divecomputereu_payload (device, count, sizeof(count), &crc);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to receive the logbook.");
+		goto error_logbook_free;
+	}
+
+	unsigned int nlogbooks = array_uint16_be (count);
 	if (length != 2 + nlogbooks * SZ_SUMMARY) {
 		status = DC_STATUS_DATAFORMAT;
 		goto error_logbook_free;
@@ -494,13 +551,46 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 
 	// Count the number of dives to download.
 	unsigned int ndives = 0;
-	for (unsigned int i = 0; i < nlogbooks; ++i) {
-		unsigned int offset = 2 + i * SZ_SUMMARY;
+	unsigned int found = 0;
+	unsigned int nentries = 0;
+	while (nentries < nlogbooks) {
+		unsigned char chunk[SZ_CHUNK];
+		unsigned int n = nlogbooks - nentries;
+		if (n > sizeof(chunk) / SZ_SUMMARY)
+			n = sizeof(chunk) / SZ_SUMMARY;
+
+		status = tecdiving_divecomputereu_payload (device, chunk, n * SZ_SUMMARY, &crc);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the logbook.");
+			goto error_logbook_free;
+		}
 
-		if (memcmp(logbook + offset, device->fingerprint, sizeof(device->fingerprint)) == 0)
-			break;
+		// The remainder of the list, after the fingerprint, is only
+		// received for the checksum.
+		for (unsigned int i = 0; i < n && !found; ++i) {
+			unsigned int offset = i * SZ_SUMMARY;
+
+			if (memcmp(chunk + offset, device->fingerprint, sizeof(device->fingerprint)) == 0) {
+				found = 1;
+				break;
+			}
+
+			if (!dc_buffer_append (logbook, chunk + offset, SZ_SUMMARY)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				status = DC_STATUS_NOMEMORY;
+				goto error_logbook_free;
+			}
 
-		ndives++;
+			ndives++;
+		}
+
+		nentries += n;
+	}
+
+	status = tecdiving_divecomputereu_checksum (device, crc);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to receive the logbook.");
+		goto error_logbook_free;
 	}
 
 	// Update and emit a progress event.
@@ -509,14 +599,14 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate a memory buffer for a single dive.
-	dc_buffer_t *buffer = dc_buffer_new(0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL) {
 		status = DC_STATUS_NOMEMORY;
 		goto error_logbook_free;
 	}
 
 	for (unsigned int i = 0; i < ndives; ++i) {
-		unsigned int offset = 2 + i * SZ_SUMMARY;
+		unsigned int offset = i * SZ_SUMMARY;
 
 		// Read the dive.
 		status = tecdiving_divecomputereu_readdive (abstract, &progress, i, buffer);
@@ -529,7 +619,7 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 		unsigned int size = dc_buffer_get_size(buffer);
 
 		// Verify the logbook entry.
-		if (memcmp (data, logbook + offset, SZ_SUMMARY) != 0) {
+		if (memcmp (data, dc_buffer_get_data (logbook) + offset, SZ_SUMMARY) != 0) {
 			ERROR (abstract->context, "Dive header doesn't match logbook entry.");
 			status = DC_STATUS_DATAFORMAT;
 			goto error_buffer_free;
@@ -543,7 +633,7 @@ tecdiving_divecomputereu_device_foreach (dc_device_t *abstract, dc_dive_callback
 error_buffer_free:
 	dc_buffer_free (buffer);
 error_logbook_free:
-	free (logbook);
+	dc_buffer_free (logbook);
 error_exit:
 	return status;
 }
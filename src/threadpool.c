@@ -0,0 +1,254 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+#include "threadpool.h"
+#include "thread.h"
+
+typedef enum dc_threadpool_state_t {
+	TASK_QUEUED,
+	TASK_RUNNING,
+	TASK_DONE
+} dc_threadpool_state_t;
+
+struct dc_threadpool_task_t {
+	dc_taskfunc_t func;
+	void *data;
+	dc_threadpool_state_t state;
+	dc_threadpool_task_t *next;
+};
+
+struct dc_threadpool_t {
+	dc_mutex_t *mutex;
+	dc_cond_t *queued;
+	dc_cond_t *finished;
+	dc_thread_t **threads;
+	unsigned int nthreads;
+	unsigned int nidle;
+	unsigned int nqueued;
+	dc_threadpool_task_t *head, *tail;
+	int stop;
+};
+
+static void
+dc_threadpool_worker (void *userdata)
+{
+	dc_threadpool_t *pool = (dc_threadpool_t *) userdata;
+
+	dc_mutex_lock (pool->mutex);
+	for (;;) {
+		while (pool->head == NULL && !pool->stop) {
+			pool->nidle++;
+			dc_cond_wait (pool->queued, pool->mutex);
+			pool->nidle--;
+		}
+
+		if (pool->head == NULL)
+			break;
+
+		dc_threadpool_task_t *task = pool->head;
+		pool->head = task->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+		pool->nqueued--;
+		task->state = TASK_RUNNING;
+		dc_mutex_unlock (pool->mutex);
+
+		task->func (task->data);
+
+		dc_mutex_lock (pool->mutex);
+		task->state = TASK_DONE;
+		dc_cond_broadcast (pool->finished);
+	}
+	dc_mutex_unlock (pool->mutex);
+}
+
+dc_status_t
+dc_threadpool_new (dc_threadpool_t **out)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_threadpool_t *pool = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	pool = (dc_threadpool_t *) malloc (sizeof (dc_threadpool_t));
+	if (pool == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	pool->mutex = NULL;
+	pool->queued = NULL;
+	pool->finished = NULL;
+	pool->threads = NULL;
+	pool->nthreads = 0;
+	pool->nidle = 0;
+	pool->nqueued = 0;
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->stop = 0;
+
+	status = dc_mutex_new (&pool->mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&pool->queued);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&pool->finished);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	*out = pool;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_cond_free (pool->finished);
+	dc_cond_free (pool->queued);
+	dc_mutex_free (pool->mutex);
+	free (pool);
+	return status;
+}
+
+dc_status_t
+dc_threadpool_submit (dc_threadpool_t *pool, dc_threadpool_task_t **out, dc_taskfunc_t func, void *data)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_threadpool_task_t *task = NULL;
+
+	if (pool == NULL || out == NULL || func == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	task = (dc_threadpool_task_t *) malloc (sizeof (dc_threadpool_task_t));
+	if (task == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	task->func = func;
+	task->data = data;
+	task->state = TASK_QUEUED;
+	task->next = NULL;
+
+	dc_mutex_lock (pool->mutex);
+
+	// Start another thread, unless an idle one can pick up the task.
+	if (pool->nqueued >= pool->nidle) {
+		dc_thread_t **threads = (dc_thread_t **) realloc (pool->threads, (pool->nthreads + 1) * sizeof (dc_thread_t *));
+		if (threads == NULL) {
+			status = DC_STATUS_NOMEMORY;
+		} else {
+			pool->threads = threads;
+			status = dc_thread_new (&pool->threads[pool->nthreads], dc_threadpool_worker, pool);
+			if (status == DC_STATUS_SUCCESS)
+				pool->nthreads++;
+		}
+
+		// Without any thread at all, the task would only run when it's
+		// waited for, which isn't what the caller asked for.
+		if (status != DC_STATUS_SUCCESS && pool->nthreads == 0) {
+			dc_mutex_unlock (pool->mutex);
+			free (task);
+			return status;
+		}
+	}
+
+	if (pool->tail)
+		pool->tail->next = task;
+	else
+		pool->head = task;
+	pool->tail = task;
+	pool->nqueued++;
+	dc_cond_signal (pool->queued);
+
+	dc_mutex_unlock (pool->mutex);
+
+	*out = task;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_threadpool_wait (dc_threadpool_t *pool, dc_threadpool_task_t *task)
+{
+	if (pool == NULL || task == NULL)
+		return;
+
+	dc_mutex_lock (pool->mutex);
+
+	// Run a task that is still queued on the waiting thread.
+	if (task->state == TASK_QUEUED) {
+		dc_threadpool_task_t *previous = NULL, *current = pool->head;
+		while (current != task) {
+			previous = current;
+			current = current->next;
+		}
+
+		if (previous)
+			previous->next = task->next;
+		else
+			pool->head = task->next;
+		if (pool->tail == task)
+			pool->tail = previous;
+		pool->nqueued--;
+		dc_mutex_unlock (pool->mutex);
+
+		task->func (task->data);
+
+		free (task);
+		return;
+	}
+
+	while (task->state != TASK_DONE)
+		dc_cond_wait (pool->finished, pool->mutex);
+
+	dc_mutex_unlock (pool->mutex);
+
+	free (task);
+}
+
+dc_status_t
+dc_threadpool_free (dc_threadpool_t *pool)
+{
+	if (pool == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_mutex_lock (pool->mutex);
+	pool->stop = 1;
+	dc_cond_broadcast (pool->queued);
+	dc_mutex_unlock (pool->mutex);
+
+	for (unsigned int i = 0; i < pool->nthreads; ++i) {
+		dc_thread_join (pool->threads[i]);
+	}
+
+	dc_cond_free (pool->finished);
+	dc_cond_free (pool->queued);
+	dc_mutex_free (pool->mutex);
+	free (pool->threads);
+	free (pool);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,57 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_THREADPOOL_H
+#define DC_THREADPOOL_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_threadpool_t dc_threadpool_t;
+typedef struct dc_threadpool_task_t dc_threadpool_task_t;
+
+/*
+ * A pool of worker threads, which are started on demand and kept alive
+ * for the next tasks until the pool is destroyed. A task never waits for
+ * a free thread, because the tasks of the library may block on each
+ * other. A task that hasn't started yet when it's waited for, is taken
+ * back from the queue and runs on the waiting thread instead.
+ */
+dc_status_t
+dc_threadpool_new (dc_threadpool_t **pool);
+
+dc_status_t
+dc_threadpool_submit (dc_threadpool_t *pool, dc_threadpool_task_t **task, dc_taskfunc_t func, void *data);
+
+void
+dc_threadpool_wait (dc_threadpool_t *pool, dc_threadpool_task_t *task);
+
+dc_status_t
+dc_threadpool_free (dc_threadpool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_THREADPOOL_H */
@@ -23,6 +23,7 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -42,9 +43,18 @@
 #include "descriptor-private.h"
 #include "iterator-private.h"
 #include "platform.h"
+#include "usbsession.h"
 
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_usb_vtable)
 
+// The interval to handle the usb events while waiting (ms).
+#define SLICE 100
+
+// The maximum number of queued asynchronous transfers, and the size of
+// the buffer of each transfer.
+#define MAXTRANSFERS 8
+#define TRANSFERSIZE (8 * 1024)
+
 typedef struct dc_usb_session_t {
 	size_t refcount;
 #ifdef HAVE_LIBUSB
@@ -93,6 +103,17 @@ typedef struct dc_usb_t {
 	unsigned char endpoint_in;
 	unsigned char endpoint_out;
 	unsigned int timeout;
+	/* Asynchronous transfers queued on the IN endpoint. */
+	struct libusb_transfer *transfers[MAXTRANSFERS];
+	unsigned int submitted[MAXTRANSFERS];
+	unsigned int ntransfers;
+	unsigned int npending;
+	int error;
+	/* Ring buffer with the completed transfers, in order of arrival. */
+	unsigned int queue[MAXTRANSFERS];
+	unsigned int head;
+	unsigned int count;
+	unsigned int offset;
 } dc_usb_t;
 
 static const dc_iterator_vtable_t dc_usb_iterator_vtable = {
@@ -113,10 +134,12 @@ static const dc_iostream_vtable_t dc_usb_vtable = {
 	dc_usb_poll, /* poll */
 	dc_usb_read, /* read */
 	dc_usb_write, /* write */
+	NULL, /* writev */
 	dc_usb_ioctl, /* ioctl */
 	NULL, /* flush */
 	NULL, /* purge */
 	NULL, /* sleep */
+	NULL, /* interrupt */
 	dc_usb_close, /* close */
 };
 
@@ -159,11 +182,9 @@ dc_usb_session_new (dc_usb_session_t **out, dc_context_t *context)
 
 	session->refcount = 1;
 
-	int rc = libusb_init (&session->handle);
-	if (rc != LIBUSB_SUCCESS) {
-		ERROR (context, "Failed to initialize usb support (%s).",
-			libusb_error_name (rc));
-		status = syserror (rc);
+	// The libusb context is shared with all other sessions.
+	status = dc_usbsession_ref (&session->handle, context);
+	if (status != DC_STATUS_SUCCESS) {
 		goto error_free;
 	}
 
@@ -195,7 +216,7 @@ dc_usb_session_unref (dc_usb_session_t *session)
 		return DC_STATUS_SUCCESS;
 
 	if (--session->refcount == 0) {
-		libusb_exit (session->handle);
+		dc_usbsession_unref ();
 		free (session);
 	}
 
@@ -221,6 +242,24 @@ dc_usb_device_get_pid (dc_usb_device_t *device)
 	return device->pid;
 }
 
+void
+dc_usb_device_get_key (dc_usb_device_t *device, char *key, size_t size)
+{
+	if (size == 0)
+		return;
+
+	key[0] = '\0';
+
+#ifdef HAVE_LIBUSB
+	if (device == NULL)
+		return;
+
+	snprintf (key, size, "%04x:%04x@%u.%u", device->vid, device->pid,
+		libusb_get_bus_number (device->handle),
+		libusb_get_device_address (device->handle));
+#endif
+}
+
 void
 dc_usb_device_free(dc_usb_device_t *device)
 {
@@ -453,6 +492,12 @@ dc_usb_open (dc_iostream_t **out, dc_context_t *context, dc_usb_device_t *device
 	usb->endpoint_in = device->endpoint_in;
 	usb->endpoint_out = device->endpoint_out;
 	usb->timeout = 0;
+	usb->ntransfers = 0;
+	usb->npending = 0;
+	usb->error = LIBUSB_SUCCESS;
+	usb->head = 0;
+	usb->count = 0;
+	usb->offset = 0;
 
 	*out = (dc_iostream_t *) usb;
 
@@ -471,12 +516,228 @@ error_free:
 }
 
 #ifdef HAVE_LIBUSB
+static void LIBUSB_CALL dc_usb_transfer_cb (struct libusb_transfer *transfer);
+
+static dc_status_t
+dc_usb_submit (dc_usb_t *usb, unsigned int i)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) usb;
+
+	if (usb->error != LIBUSB_SUCCESS)
+		return DC_STATUS_SUCCESS;
+
+	int rc = libusb_submit_transfer (usb->transfers[i]);
+	if (rc != LIBUSB_SUCCESS) {
+		ERROR (abstract->context, "Failed to submit the transfer (%s).",
+			libusb_error_name (rc));
+		usb->error = rc;
+		return syserror (rc);
+	}
+
+	usb->submitted[i] = 1;
+	usb->npending++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void LIBUSB_CALL
+dc_usb_transfer_cb (struct libusb_transfer *transfer)
+{
+	dc_usb_t *usb = (dc_usb_t *) transfer->user_data;
+
+	unsigned int idx = 0;
+	for (unsigned int i = 0; i < usb->ntransfers; ++i) {
+		if (usb->transfers[i] == transfer)
+			idx = i;
+	}
+	usb->submitted[idx] = 0;
+	usb->npending--;
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		// A zero length packet is queued as well, because it marks the
+		// end of a bulk transfer.
+		usb->queue[(usb->head + usb->count) % MAXTRANSFERS] = idx;
+		usb->count++;
+		return;
+	case LIBUSB_TRANSFER_CANCELLED:
+		return;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		usb->error = LIBUSB_ERROR_TIMEOUT;
+		break;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		usb->error = LIBUSB_ERROR_NO_DEVICE;
+		break;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		usb->error = LIBUSB_ERROR_OVERFLOW;
+		break;
+	case LIBUSB_TRANSFER_STALL:
+		usb->error = LIBUSB_ERROR_PIPE;
+		break;
+	default:
+		usb->error = LIBUSB_ERROR_IO;
+		break;
+	}
+}
+
+/*
+ * Cancel and release the queued transfers. Unlike the usbhid queue, the
+ * data is received directly in the buffers of the transfers, so any
+ * data that is still buffered is discarded as well.
+ */
+static void
+dc_usb_queue_free (dc_usb_t *usb)
+{
+	usb->error = LIBUSB_ERROR_INTERRUPTED;
+
+	for (unsigned int i = 0; i < usb->ntransfers; ++i) {
+		if (usb->submitted[i])
+			libusb_cancel_transfer (usb->transfers[i]);
+	}
+
+	// Wait for the cancelled transfers to complete.
+	dc_usbsession_drain (usb->session->handle, &usb->npending);
+
+	for (unsigned int i = 0; i < usb->ntransfers; ++i) {
+		free (usb->transfers[i]->buffer);
+		libusb_free_transfer (usb->transfers[i]);
+		usb->transfers[i] = NULL;
+	}
+
+	usb->ntransfers = 0;
+	usb->npending = 0;
+	usb->error = LIBUSB_SUCCESS;
+	usb->head = 0;
+	usb->count = 0;
+	usb->offset = 0;
+}
+
+static dc_status_t
+dc_usb_queue_new (dc_usb_t *usb, unsigned int ntransfers)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) usb;
+
+	if (ntransfers > MAXTRANSFERS)
+		ntransfers = MAXTRANSFERS;
+
+	dc_usb_queue_free (usb);
+
+	for (unsigned int i = 0; i < ntransfers; ++i) {
+		unsigned char *buffer = (unsigned char *) malloc (TRANSFERSIZE);
+		if (buffer == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			dc_usb_queue_free (usb);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		struct libusb_transfer *transfer = libusb_alloc_transfer (0);
+		if (transfer == NULL) {
+			ERROR (abstract->context, "Failed to allocate the transfer.");
+			free (buffer);
+			dc_usb_queue_free (usb);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		libusb_fill_bulk_transfer (transfer, usb->handle, usb->endpoint_in,
+			buffer, TRANSFERSIZE, dc_usb_transfer_cb, usb, 0);
+
+		usb->transfers[i] = transfer;
+		usb->submitted[i] = 0;
+		usb->ntransfers++;
+	}
+
+	for (unsigned int i = 0; i < usb->ntransfers; ++i) {
+		dc_status_t status = dc_usb_submit (usb, i);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Read from the completed transfers. Just like a synchronous bulk
+ * transfer, the read only ends when the buffer is full, after a short
+ * packet, or when the timeout expires.
+ */
+static dc_status_t
+dc_usb_queue_read (dc_usb_t *usb, unsigned char data[], size_t size, int *actual)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) usb;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	int timeout = (usb->timeout == 0 ? -1 : (int) usb->timeout);
+	size_t nbytes = 0;
+	int done = 0;
+
+	for (;;) {
+		while (usb->count && nbytes < size) {
+			unsigned int idx = usb->queue[usb->head];
+			struct libusb_transfer *transfer = usb->transfers[idx];
+			size_t length = transfer->actual_length;
+
+			size_t n = length - usb->offset;
+			if (n > size - nbytes)
+				n = size - nbytes;
+			memcpy (data + nbytes, transfer->buffer + usb->offset, n);
+			usb->offset += n;
+			nbytes += n;
+
+			if (usb->offset < length)
+				break;
+
+			// Hand the buffer back to the endpoint.
+			usb->head = (usb->head + 1) % MAXTRANSFERS;
+			usb->count--;
+			usb->offset = 0;
+
+			status = dc_usb_submit (usb, idx);
+			if (status != DC_STATUS_SUCCESS)
+				goto out;
+
+			if (length < TRANSFERSIZE) {
+				done = 1;
+				break;
+			}
+		}
+
+		if (done || nbytes == size)
+			break;
+
+		if (usb->error != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Usb read bulk transfer failed (%s).",
+				libusb_error_name (usb->error));
+			status = syserror (usb->error);
+			goto out;
+		}
+
+		int slice = (timeout < 0 || timeout > SLICE) ? SLICE : timeout;
+
+		status = dc_usbsession_handle_events (usb->session->handle, abstract->context, slice);
+		if (status != DC_STATUS_SUCCESS)
+			goto out;
+
+		if (usb->count == 0 && timeout >= 0) {
+			if (timeout <= slice) {
+				status = DC_STATUS_TIMEOUT;
+				goto out;
+			}
+			timeout -= slice;
+		}
+	}
+
+out:
+	*actual = nbytes;
+
+	return status;
+}
+
 static dc_status_t
 dc_usb_close (dc_iostream_t *abstract)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_usb_t *usb = (dc_usb_t *) abstract;
 
+	dc_usb_queue_free (usb);
 	libusb_release_interface (usb->handle, usb->interface);
 	libusb_close (usb->handle);
 	dc_usb_session_unref (usb->session);
@@ -513,6 +774,11 @@ dc_usb_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
 	dc_usb_t *usb = (dc_usb_t *) abstract;
 	int nbytes = 0;
 
+	if (usb->ntransfers) {
+		status = dc_usb_queue_read (usb, data, size, &nbytes);
+		goto out;
+	}
+
 	int rc = libusb_bulk_transfer (usb->handle, usb->endpoint_in, data, size, &nbytes, usb->timeout);
 	if (rc != LIBUSB_SUCCESS || nbytes < 0) {
 		ERROR (abstract->context, "Usb read bulk transfer failed (%s).",
@@ -583,6 +849,8 @@ dc_usb_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size_t
 	case DC_IOCTL_USB_CONTROL_READ:
 	case DC_IOCTL_USB_CONTROL_WRITE:
 		return dc_usb_ioctl_control (abstract, data, size);
+	case DC_IOCTL_USB_SET_QUEUE:
+		return dc_usb_queue_new ((dc_usb_t *) abstract, *(unsigned int *) data);
 	default:
 		return DC_STATUS_UNSUPPORTED;
 	}
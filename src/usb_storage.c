@@ -61,9 +61,11 @@ static const dc_iostream_vtable_t dc_usbstorage_vtable = {
 	NULL, /* configure */
 	dc_usb_storage_read, /* read */
 	NULL, /* write */
+	NULL, /* writev */
 	NULL, /* flush */
 	NULL, /* purge */
 	NULL, /* sleep */
+	NULL, /* interrupt */
 	NULL, /* close */
 };
 
@@ -23,6 +23,7 @@
 #include "config.h"
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #ifdef HAVE_PTHREAD_H
@@ -60,6 +61,7 @@
 #include "descriptor-private.h"
 #include "iterator-private.h"
 #include "platform.h"
+#include "usbsession.h"
 
 #ifdef _WIN32
 typedef LONG dc_mutex_t;
@@ -71,6 +73,17 @@ typedef pthread_mutex_t dc_mutex_t;
 
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_usbhid_vtable)
 
+// The largest report size of a full-speed USB HID device.
+#define MAXREPORT 64
+
+// The interval to check for interrupt requests while waiting (ms).
+#define SLICE 100
+
+// The maximum number of queued asynchronous transfers, and the number
+// of reports that can be buffered.
+#define MAXTRANSFERS 8
+#define QUEUESIZE    32
+
 typedef struct dc_usbhid_session_t {
 	size_t refcount;
 #if defined(USE_LIBUSB)
@@ -100,6 +113,7 @@ static dc_status_t dc_usbhid_poll (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_usbhid_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 static dc_status_t dc_usbhid_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 static dc_status_t dc_usbhid_ioctl (dc_iostream_t *iostream, unsigned int request, void *data, size_t size);
+static dc_status_t dc_usbhid_interrupt (dc_iostream_t *iostream);
 static dc_status_t dc_usbhid_close (dc_iostream_t *iostream);
 
 typedef struct dc_usbhid_iterator_t {
@@ -126,10 +140,27 @@ typedef struct dc_usbhid_t {
 	unsigned char endpoint_in;
 	unsigned char endpoint_out;
 	unsigned int timeout;
+	/* Asynchronous transfers queued on the IN endpoint. */
+	struct libusb_transfer *transfers[MAXTRANSFERS];
+	unsigned char buffers[MAXTRANSFERS][MAXREPORT];
+	unsigned int submitted[MAXTRANSFERS];
+	unsigned int ntransfers;
+	unsigned int npending;
+	int error;
+	/* Ring buffer with the reports received by the transfers. */
+	unsigned char queue[QUEUESIZE][MAXREPORT];
+	unsigned int length[QUEUESIZE];
+	unsigned int head;
+	unsigned int count;
 #elif defined(USE_HIDAPI)
 	hid_device *handle;
 	int timeout;
 #endif
+	/* Report received by poll, and not yet read. */
+	unsigned char report[MAXREPORT];
+	size_t available;
+	/* Pending interrupt request. */
+	int interrupted;
 } dc_usbhid_t;
 
 static const dc_iterator_vtable_t dc_usbhid_iterator_vtable = {
@@ -150,10 +181,12 @@ static const dc_iostream_vtable_t dc_usbhid_vtable = {
 	dc_usbhid_poll, /* poll */
 	dc_usbhid_read, /* read */
 	dc_usbhid_write, /* write */
+	NULL, /* writev */
 	dc_usbhid_ioctl, /* ioctl */
 	NULL, /* flush */
 	NULL, /* purge */
 	NULL, /* sleep */
+	dc_usbhid_interrupt, /* interrupt */
 	dc_usbhid_close, /* close */
 };
 
@@ -162,6 +195,10 @@ static dc_mutex_t g_usbhid_mutex = DC_MUTEX_INIT;
 static dc_usbhid_session_t *g_usbhid_session = NULL;
 #endif
 
+#ifdef USBHID
+static dc_mutex_t g_usbhid_interrupt_mutex = DC_MUTEX_INIT;
+#endif
+
 #if defined(USE_LIBUSB)
 static dc_status_t
 syserror(int errcode)
@@ -185,7 +222,7 @@ syserror(int errcode)
 }
 #endif
 
-#ifdef USE_HIDAPI
+#ifdef USBHID
 static void
 dc_mutex_lock (dc_mutex_t *mutex)
 {
@@ -239,11 +276,9 @@ dc_usbhid_session_new (dc_usbhid_session_t **out, dc_context_t *context)
 	session->refcount = 1;
 
 #if defined(USE_LIBUSB)
-	int rc = libusb_init (&session->handle);
-	if (rc != LIBUSB_SUCCESS) {
-		ERROR (context, "Failed to initialize usb support (%s).",
-			libusb_error_name (rc));
-		status = syserror (rc);
+	// The libusb context is shared with all other sessions.
+	status = dc_usbsession_ref (&session->handle, context);
+	if (status != DC_STATUS_SUCCESS) {
 		goto error_free;
 	}
 #elif defined(USE_HIDAPI)
@@ -303,7 +338,7 @@ dc_usbhid_session_unref (dc_usbhid_session_t *session)
 
 	if (--session->refcount == 0) {
 #if defined(USE_LIBUSB)
-		libusb_exit (session->handle);
+		dc_usbsession_unref ();
 #elif defined(USE_HIDAPI)
 		hid_exit ();
 		g_usbhid_session = NULL;
@@ -337,6 +372,26 @@ dc_usbhid_device_get_pid (dc_usbhid_device_t *device)
 	return device->pid;
 }
 
+void
+dc_usbhid_device_get_key (dc_usbhid_device_t *device, char *key, size_t size)
+{
+	if (size == 0)
+		return;
+
+	key[0] = '\0';
+
+	if (device == NULL)
+		return;
+
+#if defined(USE_LIBUSB)
+	snprintf (key, size, "%04x:%04x@%u.%u", device->vid, device->pid,
+		libusb_get_bus_number (device->handle),
+		libusb_get_device_address (device->handle));
+#elif defined(USE_HIDAPI)
+	snprintf (key, size, "%04x:%04x@%s", device->vid, device->pid, device->path);
+#endif
+}
+
 void
 dc_usbhid_device_free(dc_usbhid_device_t *device)
 {
@@ -615,6 +670,11 @@ dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, dc_usbhid_device_t *
 	usbhid->endpoint_in = device->endpoint_in;
 	usbhid->endpoint_out = device->endpoint_out;
 	usbhid->timeout = 0;
+	usbhid->ntransfers = 0;
+	usbhid->npending = 0;
+	usbhid->error = LIBUSB_SUCCESS;
+	usbhid->head = 0;
+	usbhid->count = 0;
 
 #elif defined(USE_HIDAPI)
 	INFO (context, "Open: path=%s", device->path);
@@ -630,6 +690,9 @@ dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, dc_usbhid_device_t *
 	usbhid->timeout = -1;
 #endif
 
+	usbhid->available = 0;
+	usbhid->interrupted = 0;
+
 	*out = (dc_iostream_t *) usbhid;
 
 	return DC_STATUS_SUCCESS;
@@ -649,6 +712,139 @@ error_free:
 }
 
 #ifdef USBHID
+#if defined(USE_LIBUSB)
+static void LIBUSB_CALL dc_usbhid_transfer_cb (struct libusb_transfer *transfer);
+
+static dc_status_t
+dc_usbhid_submit (dc_usbhid_t *usbhid)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) usbhid;
+
+	// Only submit a transfer if its report is guaranteed to fit into
+	// the ring buffer.
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		if (usbhid->submitted[i])
+			continue;
+
+		if (usbhid->error != LIBUSB_SUCCESS ||
+			usbhid->count + usbhid->npending >= QUEUESIZE)
+			break;
+
+		int rc = libusb_submit_transfer (usbhid->transfers[i]);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Failed to submit the transfer (%s).",
+				libusb_error_name (rc));
+			usbhid->error = rc;
+			return syserror (rc);
+		}
+
+		usbhid->submitted[i] = 1;
+		usbhid->npending++;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void LIBUSB_CALL
+dc_usbhid_transfer_cb (struct libusb_transfer *transfer)
+{
+	dc_usbhid_t *usbhid = (dc_usbhid_t *) transfer->user_data;
+
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		if (usbhid->transfers[i] == transfer)
+			usbhid->submitted[i] = 0;
+	}
+	usbhid->npending--;
+
+	switch (transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		if (transfer->actual_length > 0) {
+			unsigned int idx = (usbhid->head + usbhid->count) % QUEUESIZE;
+			memcpy (usbhid->queue[idx], transfer->buffer, transfer->actual_length);
+			usbhid->length[idx] = transfer->actual_length;
+			usbhid->count++;
+		}
+		break;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+	case LIBUSB_TRANSFER_CANCELLED:
+		break;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		usbhid->error = LIBUSB_ERROR_NO_DEVICE;
+		break;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		usbhid->error = LIBUSB_ERROR_OVERFLOW;
+		break;
+	case LIBUSB_TRANSFER_STALL:
+		usbhid->error = LIBUSB_ERROR_PIPE;
+		break;
+	default:
+		usbhid->error = LIBUSB_ERROR_IO;
+		break;
+	}
+
+	// Keep the endpoint busy. The callback runs on the thread that
+	// handles the events, which is always the reading thread.
+	dc_usbhid_submit (usbhid);
+}
+
+/*
+ * Cancel and release the queued transfers. The remaining buffered
+ * reports stay available for reading.
+ */
+static void
+dc_usbhid_queue_free (dc_usbhid_t *usbhid)
+{
+	usbhid->error = LIBUSB_ERROR_INTERRUPTED;
+
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		if (usbhid->submitted[i])
+			libusb_cancel_transfer (usbhid->transfers[i]);
+	}
+
+	// Wait for the cancelled transfers to complete.
+	dc_usbsession_drain (usbhid->session->handle, &usbhid->npending);
+
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		libusb_free_transfer (usbhid->transfers[i]);
+		usbhid->transfers[i] = NULL;
+	}
+
+	usbhid->ntransfers = 0;
+	usbhid->npending = 0;
+	usbhid->error = LIBUSB_SUCCESS;
+}
+
+static dc_status_t
+dc_usbhid_queue_new (dc_usbhid_t *usbhid, unsigned int ntransfers)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) usbhid;
+
+	if (ntransfers > MAXTRANSFERS)
+		ntransfers = MAXTRANSFERS;
+
+	dc_usbhid_queue_free (usbhid);
+
+	for (unsigned int i = 0; i < ntransfers; ++i) {
+		struct libusb_transfer *transfer = libusb_alloc_transfer (0);
+		if (transfer == NULL) {
+			ERROR (abstract->context, "Failed to allocate the transfer.");
+			dc_usbhid_queue_free (usbhid);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		libusb_fill_interrupt_transfer (transfer, usbhid->handle, usbhid->endpoint_in,
+			usbhid->buffers[i], sizeof (usbhid->buffers[i]),
+			dc_usbhid_transfer_cb, usbhid, 0);
+
+		usbhid->transfers[i] = transfer;
+		usbhid->submitted[i] = 0;
+		usbhid->ntransfers++;
+	}
+
+	return dc_usbhid_submit (usbhid);
+}
+#endif
+
 static dc_status_t
 dc_usbhid_close (dc_iostream_t *abstract)
 {
@@ -656,6 +852,7 @@ dc_usbhid_close (dc_iostream_t *abstract)
 	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
 
 #if defined(USE_LIBUSB)
+	dc_usbhid_queue_free (usbhid);
 	libusb_release_interface (usbhid->handle, usbhid->interface);
 	libusb_close (usbhid->handle);
 #elif defined(USE_HIDAPI)
@@ -690,10 +887,124 @@ dc_usbhid_set_timeout (dc_iostream_t *abstract, int timeout)
 	return DC_STATUS_SUCCESS;
 }
 
+static int
+dc_usbhid_interrupted (dc_usbhid_t *usbhid)
+{
+	dc_mutex_lock (&g_usbhid_interrupt_mutex);
+	int interrupted = usbhid->interrupted;
+	usbhid->interrupted = 0;
+	dc_mutex_unlock (&g_usbhid_interrupt_mutex);
+
+	return interrupted;
+}
+
+/*
+ * Wait for an incoming report in short slices, to notice an interrupt
+ * request without waiting for the full timeout. A negative timeout
+ * waits forever.
+ */
+static dc_status_t
+dc_usbhid_receive (dc_usbhid_t *usbhid, unsigned char data[], size_t size, int timeout, int *actual)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) usbhid;
+	int nbytes = 0;
+
+	*actual = 0;
+
+	for (;;) {
+		if (dc_usbhid_interrupted (usbhid))
+			return DC_STATUS_CANCELLED;
+
+		int slice = (timeout < 0 || timeout > SLICE) ? SLICE : timeout;
+
+#if defined(USE_LIBUSB)
+		if (usbhid->ntransfers || usbhid->count) {
+			// Return the oldest buffered report.
+			if (usbhid->count) {
+				unsigned int n = usbhid->length[usbhid->head];
+				if (n > size)
+					n = size;
+				memcpy (data, usbhid->queue[usbhid->head], n);
+				usbhid->head = (usbhid->head + 1) % QUEUESIZE;
+				usbhid->count--;
+				*actual = n;
+				return dc_usbhid_submit (usbhid);
+			}
+
+			if (usbhid->error != LIBUSB_SUCCESS) {
+				ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
+					libusb_error_name (usbhid->error));
+				return syserror (usbhid->error);
+			}
+
+			dc_status_t status = dc_usbhid_submit (usbhid);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+
+			status = dc_usbsession_handle_events (usbhid->session->handle, abstract->context, slice);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+
+			if (usbhid->count)
+				continue;
+
+			if (timeout >= 0) {
+				if (timeout <= slice)
+					return DC_STATUS_TIMEOUT;
+				timeout -= slice;
+			}
+
+			continue;
+		}
+
+		// A zero timeout means infinite for libusb.
+		int rc = libusb_interrupt_transfer (usbhid->handle, usbhid->endpoint_in, data, size, &nbytes, slice == 0 ? 1 : slice);
+		if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_TIMEOUT) {
+			ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
+				libusb_error_name (rc));
+			return syserror (rc);
+		}
+#elif defined(USE_HIDAPI)
+		nbytes = hid_read_timeout (usbhid->handle, data, size, slice);
+		if (nbytes < 0) {
+			ERROR (abstract->context, "Usb read interrupt transfer failed.");
+			return DC_STATUS_IO;
+		}
+#endif
+
+		if (nbytes > 0)
+			break;
+
+		if (timeout >= 0) {
+			if (timeout <= slice)
+				return DC_STATUS_TIMEOUT;
+			timeout -= slice;
+		}
+	}
+
+	*actual = nbytes;
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_usbhid_poll (dc_iostream_t *abstract, int timeout)
 {
-	return DC_STATUS_UNSUPPORTED;
+	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
+	int nbytes = 0;
+
+	if (usbhid->available)
+		return DC_STATUS_SUCCESS;
+
+	// There is no way to wait for a report without receiving it, so the
+	// report is kept until the next read.
+	dc_status_t status = dc_usbhid_receive (usbhid, usbhid->report, sizeof (usbhid->report), timeout, &nbytes);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	usbhid->available = nbytes;
+
+	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
@@ -703,24 +1014,25 @@ dc_usbhid_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
 	int nbytes = 0;
 
-#if defined(USE_LIBUSB)
-	int rc = libusb_interrupt_transfer (usbhid->handle, usbhid->endpoint_in, data, size, &nbytes, usbhid->timeout);
-	if (rc != LIBUSB_SUCCESS || nbytes < 0) {
-		ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
-			libusb_error_name (rc));
-		status = syserror (rc);
-		if (nbytes < 0)
-			nbytes = 0;
+	// Return the report received by poll first.
+	if (usbhid->available) {
+		nbytes = (size < usbhid->available ? size : usbhid->available);
+		memcpy (data, usbhid->report, nbytes);
+		usbhid->available = 0;
 		goto out;
 	}
+
+#if defined(USE_LIBUSB)
+	int timeout = (usbhid->timeout == 0 ? -1 : (int) usbhid->timeout);
 #elif defined(USE_HIDAPI)
-	nbytes = hid_read_timeout(usbhid->handle, data, size, usbhid->timeout);
-	if (nbytes < 0) {
-		ERROR (abstract->context, "Usb read interrupt transfer failed.");
-		status = DC_STATUS_IO;
-		nbytes = 0;
-		goto out;
-	}
+	int timeout = usbhid->timeout;
+#endif
+
+	status = dc_usbhid_receive (usbhid, data, size, timeout, &nbytes);
+#if defined(USE_HIDAPI)
+	// A timeout is reported as an empty read.
+	if (status == DC_STATUS_TIMEOUT)
+		status = DC_STATUS_SUCCESS;
 #endif
 
 out:
@@ -730,6 +1042,18 @@ out:
 	return status;
 }
 
+static dc_status_t
+dc_usbhid_interrupt (dc_iostream_t *abstract)
+{
+	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
+
+	dc_mutex_lock (&g_usbhid_interrupt_mutex);
+	usbhid->interrupted = 1;
+	dc_mutex_unlock (&g_usbhid_interrupt_mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_usbhid_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
 {
@@ -792,6 +1116,15 @@ out:
 static dc_status_t
 dc_usbhid_ioctl (dc_iostream_t *abstract, unsigned int request, void *data, size_t size)
 {
-	return DC_STATUS_UNSUPPORTED;
+	switch (request) {
+	case DC_IOCTL_USBHID_SET_QUEUE:
+#if defined(USE_LIBUSB)
+		return dc_usbhid_queue_new ((dc_usbhid_t *) abstract, *(unsigned int *) data);
+#else
+		return DC_STATUS_SUCCESS;
+#endif
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
 }
 #endif
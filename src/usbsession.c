@@ -0,0 +1,139 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_LIBUSB
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#endif
+#include <libusb.h>
+#endif
+
+#include "usbsession.h"
+#include "context-private.h"
+#include "thread.h"
+
+#ifdef HAVE_LIBUSB
+static libusb_context *g_usbsession_handle = NULL;
+static size_t g_usbsession_refcount = 0;
+
+static dc_status_t
+syserror(int errcode)
+{
+	switch (errcode) {
+	case LIBUSB_ERROR_INVALID_PARAM:
+		return DC_STATUS_INVALIDARGS;
+	case LIBUSB_ERROR_NO_MEM:
+		return DC_STATUS_NOMEMORY;
+	case LIBUSB_ERROR_NO_DEVICE:
+	case LIBUSB_ERROR_NOT_FOUND:
+		return DC_STATUS_NODEVICE;
+	case LIBUSB_ERROR_ACCESS:
+	case LIBUSB_ERROR_BUSY:
+		return DC_STATUS_NOACCESS;
+	case LIBUSB_ERROR_TIMEOUT:
+		return DC_STATUS_TIMEOUT;
+	default:
+		return DC_STATUS_IO;
+	}
+}
+#endif
+
+dc_status_t
+dc_usbsession_ref (struct libusb_context **handle, dc_context_t *context)
+{
+#ifdef HAVE_LIBUSB
+	if (handle == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The global lock is only held to update the reference count, and
+	// for the initialization of the context itself.
+	dc_global_lock ();
+
+	if (g_usbsession_refcount == 0) {
+		int rc = libusb_init (&g_usbsession_handle);
+		if (rc != LIBUSB_SUCCESS) {
+			dc_global_unlock ();
+			ERROR (context, "Failed to initialize usb support (%s).",
+				libusb_error_name (rc));
+			return syserror (rc);
+		}
+	}
+
+	g_usbsession_refcount++;
+	*handle = g_usbsession_handle;
+
+	dc_global_unlock ();
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+void
+dc_usbsession_unref (void)
+{
+#ifdef HAVE_LIBUSB
+	dc_global_lock ();
+
+	if (g_usbsession_refcount && --g_usbsession_refcount == 0) {
+		libusb_exit (g_usbsession_handle);
+		g_usbsession_handle = NULL;
+	}
+
+	dc_global_unlock ();
+#endif
+}
+
+dc_status_t
+dc_usbsession_handle_events (struct libusb_context *handle, dc_context_t *context, int timeout)
+{
+#ifdef HAVE_LIBUSB
+	struct timeval tv = {timeout / 1000, (timeout % 1000) * 1000};
+	int rc = libusb_handle_events_timeout_completed (handle, &tv, NULL);
+	if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_INTERRUPTED) {
+		ERROR (context, "Failed to handle the usb events (%s).",
+			libusb_error_name (rc));
+		return syserror (rc);
+	}
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+void
+dc_usbsession_drain (struct libusb_context *handle, const unsigned int *npending)
+{
+#ifdef HAVE_LIBUSB
+	while (*npending) {
+		struct timeval tv = {0, 100 * 1000};
+		if (libusb_handle_events_timeout_completed (handle, &tv, NULL) != LIBUSB_SUCCESS)
+			break;
+	}
+#endif
+}
@@ -0,0 +1,75 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_USBSESSION_H
+#define DC_USBSESSION_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/usb.h>
+#include <libdivecomputer/usbhid.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct libusb_context;
+
+/*
+ * Acquire a reference to the libusb context shared by the USB and USB
+ * HID transports. The context is created on first use, and destroyed
+ * again when the last reference is released.
+ */
+dc_status_t
+dc_usbsession_ref (struct libusb_context **handle, dc_context_t *context);
+
+void
+dc_usbsession_unref (void);
+
+/*
+ * Handle the pending events of the asynchronous transfers, for at most
+ * the specified timeout (ms). The transfer callbacks run on the calling
+ * thread.
+ */
+dc_status_t
+dc_usbsession_handle_events (struct libusb_context *handle, dc_context_t *context, int timeout);
+
+/*
+ * Wait for the cancelled transfers to complete, until the number of
+ * pending transfers drops to zero.
+ */
+void
+dc_usbsession_drain (struct libusb_context *handle, const unsigned int *npending);
+
+/*
+ * Get a key that identifies the physical device, for as long as it
+ * stays connected. A device that is plugged in again gets a new key.
+ */
+void
+dc_usb_device_get_key (dc_usb_device_t *device, char *key, size_t size);
+
+void
+dc_usbhid_device_get_key (dc_usbhid_device_t *device, char *key, size_t size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_USBSESSION_H */
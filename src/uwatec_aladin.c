@@ -24,6 +24,7 @@
 
 #include "uwatec_aladin.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "ringbuffer.h"
 #include "checksum.h"
@@ -59,7 +60,9 @@ static const dc_device_vtable_t uwatec_aladin_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	uwatec_aladin_device_dump, /* dump */
+	NULL, /* dump_update */
 	uwatec_aladin_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -229,7 +232,7 @@ uwatec_aladin_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_aladin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
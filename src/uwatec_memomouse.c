@@ -25,6 +25,7 @@
 
 #include "uwatec_memomouse.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
@@ -33,6 +34,8 @@
 
 #define PACKETSIZE 126
 
+#define MAXRETRIES 3
+
 #define ACK 0x60
 #define NAK 0xA8
 
@@ -55,7 +58,9 @@ static const dc_device_vtable_t uwatec_memomouse_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	uwatec_memomouse_device_dump, /* dump */
+	NULL, /* dump_update */
 	uwatec_memomouse_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -198,11 +203,15 @@ uwatec_memomouse_read_packet_outer (uwatec_memomouse_device_t *device, unsigned
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
+	unsigned int ntimeouts = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = uwatec_memomouse_read_packet (device, data, size, result)) != DC_STATUS_SUCCESS) {
-		// Automatically discard a corrupted packet,
-		// and request a new one.
-		if (rc != DC_STATUS_PROTOCOL)
+		// Automatically discard a corrupted or incomplete packet,
+		// and request a new one. A timeout is only retried a few
+		// times, to detect an interface that stopped responding.
+		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
+			return rc;
+		if (rc == DC_STATUS_TIMEOUT && ntimeouts++ >= MAXRETRIES)
 			return rc;
 
 		// Flush the input buffer.
@@ -446,7 +455,7 @@ uwatec_memomouse_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_memomouse_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -471,6 +480,13 @@ uwatec_memomouse_extract_dives (dc_device_t *abstract, const unsigned char data[
 	if (abstract && !ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
+	dc_context_t *context = (abstract ? abstract->context : NULL);
+
+	// The offset of each dive is stored in a single pass, to be able to
+	// return the dives in reverse order without rescanning the stream.
+	unsigned int *offsets = NULL;
+	unsigned int capacity = 0;
+
 	// Parse the data stream to find the total number of dives.
 	unsigned int ndives = 0;
 	unsigned int previous = 0;
@@ -490,8 +506,25 @@ uwatec_memomouse_extract_dives (dc_device_t *abstract, const unsigned char data[
 		unsigned int len = array_uint16_le (data + current + 16);
 
 		// Check for a buffer overflow.
-		if (current + len + 18 > size)
+		if (current + len + 18 > size) {
+			dc_context_dealloc (context, offsets);
 			return DC_STATUS_DATAFORMAT;
+		}
+
+		// Grow the array with the offsets.
+		if (ndives == capacity) {
+			unsigned int n = capacity ? 2 * capacity : 64;
+			unsigned int *tmp = (unsigned int *) dc_context_realloc (context, offsets, n * sizeof (unsigned int));
+			if (tmp == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				dc_context_dealloc (context, offsets);
+				return DC_STATUS_NOMEMORY;
+			}
+			offsets = tmp;
+			capacity = n;
+		}
+
+		offsets[ndives] = current;
 
 		// A memomouse can store data from several dive computers, but only
 		// the data of the connected dive computer can be transferred.
@@ -512,28 +545,20 @@ uwatec_memomouse_extract_dives (dc_device_t *abstract, const unsigned char data[
 		ndives++;
 	}
 
-	// Parse the data stream again to return each dive in reverse order
-	// (newest dive first). This is less efficient, since the data stream
-	// needs to be scanned multiple times, but it makes the behaviour
-	// consistent with the equivalent function for the Uwatec Aladin.
+	// Return each dive in reverse order (newest dive first), to make the
+	// behaviour consistent with the equivalent function for the Uwatec
+	// Aladin.
 	for (unsigned int i = 0; i < ndives; ++i) {
-		// Skip the older dives.
-		unsigned int offset = 5;
-		unsigned int skip = ndives - i - 1;
-		while (skip) {
-			// Get the length of the profile data.
-			unsigned int len = array_uint16_le (data + offset + 16);
-			// Move to the next dive.
-			offset += len + 18;
-			skip--;
-		}
+		unsigned int offset = offsets[ndives - i - 1];
 
 		// Get the length of the profile data.
 		unsigned int length = array_uint16_le (data + offset + 16);
 
 		if (callback && !callback (data + offset, length + 18, data + offset + 11, 4, userdata))
-			return DC_STATUS_SUCCESS;
+			break;
 	}
 
+	dc_context_dealloc (context, offsets);
+
 	return DC_STATUS_SUCCESS;
 }
@@ -34,8 +34,6 @@ typedef struct uwatec_memomouse_parser_t uwatec_memomouse_parser_t;
 
 struct uwatec_memomouse_parser_t {
 	dc_parser_t base;
-	unsigned int devtime;
-	dc_ticks_t systime;
 };
 
 static dc_status_t uwatec_memomouse_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -70,8 +68,8 @@ uwatec_memomouse_parser_create (dc_parser_t **out, dc_context_t *context, unsign
 	}
 
 	// Set the default values.
-	parser->devtime = devtime;
-	parser->systime = systime;
+	parser->base.devtime = devtime;
+	parser->base.systime = systime;
 
 	*out = (dc_parser_t*) parser;
 
@@ -96,7 +94,7 @@ uwatec_memomouse_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *date
 
 	unsigned int timestamp = array_uint32_le (abstract->data + 11);
 
-	dc_ticks_t ticks = parser->systime - (parser->devtime - timestamp) / 2;
+	dc_ticks_t ticks = parser->base.systime - (parser->base.devtime - timestamp) / 2;
 
 	if (!dc_datetime_localtime (datetime, ticks))
 		return DC_STATUS_DATAFORMAT;
@@ -304,7 +302,8 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 				offset++;
 			}
 
-			if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
+			if (callback && dc_parser_wants (abstract, DC_SAMPLE_VENDOR))
+				callback (DC_SAMPLE_VENDOR, sample, userdata);
 		}
 
 		time += 20;
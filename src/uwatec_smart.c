@@ -22,8 +22,11 @@
 #include <stdlib.h> // malloc, free
 #include <string.h>	// strncmp, strstr
 
+#include <libdivecomputer/usbhid.h>
+
 #include "uwatec_smart.h"
 #include "context-private.h"
+#include "buffer-private.h"
 #include "device-private.h"
 #include "checksum.h"
 #include "platform.h"
@@ -37,6 +40,8 @@
 #define PACKETSIZE_USBHID_RX 64
 #define PACKETSIZE_USBHID_TX 32
 
+#define NTRANSFERS 4
+
 #define CMD_MODEL      0x10
 #define CMD_SERIAL     0x14
 #define CMD_DEVTIME    0x1A
@@ -75,7 +80,9 @@ static const dc_device_vtable_t uwatec_smart_device_vtable = {
 	NULL, /* read */
 	NULL, /* write */
 	uwatec_smart_device_dump, /* dump */
+	NULL, /* dump_update */
 	uwatec_smart_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -314,8 +321,18 @@ uwatec_smart_usbhid_receive (uwatec_smart_device_t *device, dc_event_progress_t
 
 	size_t nbytes = 0;
 	while (nbytes < size) {
+		// Receive the packet directly at its final location, with the
+		// length byte on top of the last byte of the previous payload,
+		// unless there is not enough space left for a full packet.
+		unsigned char *packet = buf;
+		unsigned char last = 0;
+		if (nbytes && nbytes - 1 + sizeof(buf) <= size) {
+			packet = data + nbytes - 1;
+			last = *packet;
+		}
+
 		size_t transferred = 0;
-		rc = dc_iostream_read (device->iostream, buf, sizeof(buf), &transferred);
+		rc = dc_iostream_read (device->iostream, packet, sizeof(buf), &transferred);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the packet.");
 			return rc;
@@ -364,13 +381,16 @@ uwatec_smart_usbhid_receive (uwatec_smart_device_t *device, dc_event_progress_t
 		 *
 		 * It may be just an oddly implemented sequence number. Whatever.
 		 */
-		unsigned int len = buf[0];
+		unsigned int len = packet[0];
 		if (len + 1 > transferred)
 			len = transferred-1;
 
-		HEXDUMP (abstract->context, DC_LOGLEVEL_DEBUG, "rcv", buf + 1, len);
+		if (packet != buf)
+			*packet = last;
 
-		if (len > size) {
+		HEXDUMP (abstract->context, DC_LOGLEVEL_DEBUG, "rcv", packet + 1, len);
+
+		if (len > size - nbytes) {
 			ERROR (abstract->context, "Insufficient buffer space available.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -381,7 +401,8 @@ uwatec_smart_usbhid_receive (uwatec_smart_device_t *device, dc_event_progress_t
 			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 		}
 
-		memcpy(data + nbytes, buf + 1, len);
+		if (packet == buf)
+			memcpy(data + nbytes, buf + 1, len);
 		nbytes += len;
 	}
 
@@ -509,6 +530,17 @@ uwatec_smart_device_open (dc_device_t **out, dc_context_t *context, dc_iostream_
 		goto error_free;
 	}
 
+	// Keep a few interrupt transfers queued, to receive the multi-packet
+	// replies at the full report rate.
+	if (transport == DC_TRANSPORT_USBHID) {
+		unsigned int ntransfers = NTRANSFERS;
+		status = dc_iostream_ioctl (device->iostream, DC_IOCTL_USBHID_SET_QUEUE, &ntransfers, sizeof (ntransfers));
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR (context, "Failed to set the transfer queue.");
+			goto error_free;
+		}
+	}
+
 	// Perform the handshaking.
 	status = uwatec_smart_handshake (device);
 	if (status != DC_STATUS_SUCCESS) {
@@ -655,7 +687,7 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_allocate (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
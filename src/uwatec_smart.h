@@ -37,6 +37,9 @@ uwatec_smart_device_open (dc_device_t **device, dc_context_t *context, dc_iostre
 dc_status_t
 uwatec_smart_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int model, unsigned int devtime, dc_ticks_t systime);
 
+unsigned int
+uwatec_smart_parser_probe (const unsigned char data[], unsigned int size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -28,12 +28,14 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
+#include "bitreader.h"
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &uwatec_smart_parser_vtable)
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
 #define NBITS 8
+#define NOTYPE 0xFF
 
 #define SMARTPRO          0x10
 #define GALILEO           0x11
@@ -140,17 +142,16 @@ typedef struct uwatec_smart_parser_t uwatec_smart_parser_t;
 struct uwatec_smart_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	unsigned int devtime;
-	dc_ticks_t systime;
 	const uwatec_smart_sample_info_t *samples;
 	const uwatec_smart_header_info_t *header;
 	unsigned int headersize;
 	unsigned int nsamples;
+	// Sample type id for every possible first byte.
+	const unsigned char *identify;
 	const uwatec_smart_event_info_t *events[NEVENTS];
 	unsigned int nevents[NEVENTS];
 	unsigned int trimix;
 	// Cached fields.
-	unsigned int cached;
 	unsigned int ngasmixes;
 	uwatec_smart_gasmix_t gasmix[NGASMIXES];
 	unsigned int ntanks;
@@ -166,6 +167,25 @@ static dc_status_t uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, d
 
 static dc_status_t uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+static unsigned int uwatec_smart_identify (const unsigned char data[], unsigned int size);
+static unsigned int uwatec_galileo_identify (unsigned char value);
+
+/*
+ * The sample type ids for every possible first byte only depend on the
+ * type of the sample table, and are shared by all parsers.
+ */
+typedef struct uwatec_smart_env_t {
+	dc_parser_env_t base;
+	unsigned char identify_smart[256];
+	unsigned char identify_galileo[256];
+} uwatec_smart_env_t;
+
+static dc_status_t uwatec_smart_env_init (dc_parser_env_t *env);
+
+static uwatec_smart_env_t uwatec_smart_env = {
+	DC_PARSER_ENV_INIT(uwatec_smart_env_init)
+};
+
 static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	sizeof(uwatec_smart_parser_t),
 	DC_FAMILY_UWATEC_SMART,
@@ -445,7 +465,7 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 	const unsigned char *data = parser->base.data;
 	unsigned int size = parser->base.size;
 
-	if (parser->cached) {
+	if (parser->base.cached) {
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -564,7 +584,7 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 	}
 	parser->watertype = watertype;
 	parser->divemode = divemode;
-	parser->cached = HEADER;
+	parser->base.cached = HEADER;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -588,8 +608,8 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 
 	// Set the default values.
 	parser->model = model;
-	parser->devtime = devtime;
-	parser->systime = systime;
+	parser->base.devtime = devtime;
+	parser->base.systime = systime;
 	parser->trimix = 0;
 	for (unsigned int i = 0; i < NEVENTS; ++i) {
 		parser->events[i] = NULL;
@@ -680,7 +700,6 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		goto error_free;
 	}
 
-	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
@@ -695,6 +714,16 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 	parser->watertype = DC_WATER_FRESH;
 	parser->divemode = DC_DIVEMODE_OC;
 
+	status = dc_parser_env_get (&uwatec_smart_env.base);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (parser->samples == uwatec_smart_galileo_samples) {
+		parser->identify = uwatec_smart_env.identify_galileo;
+	} else {
+		parser->identify = uwatec_smart_env.identify_smart;
+	}
+
 	*out = (dc_parser_t*) parser;
 
 	return DC_STATUS_SUCCESS;
@@ -705,13 +734,48 @@ error_free:
 }
 
 
+static dc_status_t
+uwatec_smart_env_init (dc_parser_env_t *abstract)
+{
+	uwatec_smart_env_t *env = (uwatec_smart_env_t *) abstract;
+
+	// Resolve the type bits of every possible first byte once, instead
+	// of scanning the bitstream for each sample. The only exception is
+	// a Smart type prefix spanning more than one byte, which is marked
+	// as unknown and still resolved by scanning.
+	for (unsigned int i = 0; i < sizeof (env->identify_smart); ++i) {
+		unsigned char value = i;
+		unsigned int smart = uwatec_smart_identify (&value, 1);
+		unsigned int galileo = uwatec_galileo_identify (value);
+		env->identify_smart[i] = smart < NOTYPE ? smart : NOTYPE;
+		env->identify_galileo[i] = galileo < NOTYPE ? galileo : NOTYPE;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+uwatec_smart_parser_probe (const unsigned char data[], unsigned int size)
+{
+	static const unsigned char header[4] = {0xa5, 0xa5, 0x5a, 0x5a};
+
+	if (size < 8 || memcmp (data, header, sizeof (header)) != 0)
+		return 0;
+
+	// The header contains the total length of the dive.
+	if (array_uint32_le (data + 4) == size)
+		return 100;
+
+	return 40;
+}
+
+
 static dc_status_t
 uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
 	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
@@ -777,11 +841,19 @@ uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+	// Cache the profile data. The gas mixes and tanks can also be
+	// defined in the profile, all other fields are available in the
+	// header.
+	if (parser->base.cached < PROFILE) {
+		if (dc_parser_is_summary (parser)) {
+			if (type == DC_FIELD_GASMIX_COUNT || type == DC_FIELD_GASMIX ||
+				type == DC_FIELD_TANK_COUNT || type == DC_FIELD_TANK)
+				return DC_STATUS_FULLSCAN;
+		} else {
+			rc = uwatec_smart_parse (parser, NULL, NULL);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
 	}
 
 	const uwatec_smart_header_info_t *table = parser->header;
@@ -891,25 +963,6 @@ uwatec_galileo_identify (unsigned char value)
 }
 
 
-static unsigned int
-uwatec_smart_fixsignbit (unsigned int x, unsigned int n)
-{
-	if (n <= 0 || n > 32)
-		return 0;
-
-	unsigned int signbit = (1 << (n - 1));
-	unsigned int mask = (signbit - 1);
-
-	// When turning a two's-complement number with a certain number
-	// of bits into one with more bits, the sign bit must be repeated
-	// in all the extra bits.
-	if ((x & signbit) == signbit)
-		return x | ~mask;
-	else
-		return x & mask;
-}
-
-
 static dc_status_t
 uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata)
 {
@@ -948,6 +1001,11 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 	// Previous gas mix - initialize with impossible value
 	unsigned int gasmix_previous = 0xFFFFFFFF;
 
+	// Tank index of the previous pressure sample. The tank rarely
+	// changes, so the lookup is only repeated after a change or a miss.
+	unsigned int tank_previous = 0xFFFFFFFF;
+	unsigned int tank_idx = 0;
+
 	double salinity = (parser->watertype == DC_WATER_SALT ? SALT : FRESH);
 
 	unsigned int interval = 4;
@@ -958,22 +1016,26 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 	int have_depth = 0, have_temperature = 0, have_pressure = 0, have_rbt = 0,
 		have_heartrate = 0, have_bearing = 0;
 
-	unsigned int offset = parser->headersize;
-	while (offset < size) {
+	// Every sample starts on a byte boundary, with the type bits
+	// followed by the data bits.
+	dc_bitreader_t bits;
+	dc_bitreader_init (&bits, data, size);
+	dc_bitreader_seek (&bits, parser->headersize * NBITS);
+
+	while (dc_bitreader_available (&bits)) {
 		dc_sample_value_t sample = {0};
 
+		dc_status_t rc = dc_parser_check_limits (abstract);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		// A single refill is sufficient for the largest sample.
+		dc_bitreader_refill (&bits);
+
 		// Process the type bits in the bitstream.
-		unsigned int id = 0;
-		if (parser->model == GALILEO || parser->model == GALILEOTRIMIX ||
-			parser->model == ALADIN2G || parser->model == MERIDIAN ||
-			parser->model == CHROMIS || parser->model == MANTIS2 ||
-			parser->model == G2 || parser->model == ALADINSPORTMATRIX ||
-			parser->model == ALADINSQUARE || parser->model == G2HUD ||
-			parser->model == ALADINA1) {
-			// Uwatec Galileo
-			id = uwatec_galileo_identify (data[offset]);
-		} else {
-			// Uwatec Smart
+		unsigned int id = parser->identify[dc_bitreader_peek (&bits, NBITS)];
+		if (id == NOTYPE) {
+			unsigned int offset = dc_bitreader_tell (&bits) / NBITS;
 			id = uwatec_smart_identify (data + offset, size - offset);
 		}
 		if (id >= entries) {
@@ -981,44 +1043,35 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 			return DC_STATUS_DATAFORMAT;
 		}
 
-		// Skip the processed type bytes.
-		offset += table[id].ntypebits / NBITS;
-
-		// Process the remaining data bits.
-		unsigned int nbits = 0;
-		unsigned int value = 0;
-		unsigned int n = table[id].ntypebits % NBITS;
-		if (n > 0) {
-			nbits = NBITS - n;
-			value = data[offset] & (0xFF >> n);
-			if (table[id].ignoretype) {
-				// Ignore any data bits that are stored in
-				// the last type byte for certain samples.
-				nbits = 0;
-				value = 0;
-			}
-			offset++;
+		// Get the number of data bits. The type bits are padded to a
+		// whole number of bytes. Any data bits stored in the last type
+		// byte are ignored for certain samples.
+		unsigned int ntypebits = table[id].ntypebits;
+		unsigned int npadding = (NBITS - ntypebits % NBITS) % NBITS;
+		unsigned int nbits = table[id].extrabytes * NBITS;
+		if (table[id].ignoretype) {
+			ntypebits += npadding;
+		} else {
+			nbits += npadding;
 		}
 
 		// Check for buffer overflows.
-		if (offset + table[id].extrabytes > size) {
+		if (ntypebits + nbits > dc_bitreader_available (&bits)) {
 			ERROR (abstract->context, "Incomplete sample data.");
 			return DC_STATUS_DATAFORMAT;
 		}
 
-		// Process the extra data bytes.
-		for (unsigned int i = 0; i < table[id].extrabytes; ++i) {
-			nbits += NBITS;
-			value <<= NBITS;
-			value += data[offset];
-			offset++;
-		}
+		// Process the data bits.
+		dc_bitreader_consume (&bits, ntypebits);
+		unsigned int value = dc_bitreader_peek (&bits, nbits);
+		dc_bitreader_consume (&bits, nbits);
 
 		// Fix the sign bit.
-		signed int svalue = uwatec_smart_fixsignbit (value, nbits);
+		signed int svalue = dc_bitreader_signed (value, nbits);
 
 		// Parse the value.
 		unsigned int idx = 0;
+		unsigned int offset = 0;
 		unsigned int subtype = 0;
 		unsigned int nevents = 0;
 		const uwatec_smart_event_info_t *events = NULL;
@@ -1091,6 +1144,11 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				return DC_STATUS_DATAFORMAT;
 			}
 
+			// The alarm bits only produce events and gas switches.
+			if (!dc_parser_wants (parser, DC_SAMPLE_EVENT) &&
+				!dc_parser_wants (parser, DC_SAMPLE_GASMIX))
+				break;
+
 			events = parser->events[idx];
 			nevents = parser->nevents[idx];
 
@@ -1113,18 +1171,19 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 			complete = value;
 			break;
 		case APNEA:
-			if (offset + 8 > size) {
+			if (8 * NBITS > dc_bitreader_available (&bits)) {
 				ERROR (abstract->context, "Incomplete sample data.");
 				return DC_STATUS_DATAFORMAT;
 			}
-			offset += 8;
+			dc_bitreader_skip (&bits, 8 * NBITS);
 			break;
 		case MISC:
-			if (value < 1 || offset + value - 1 > size) {
+			if (value < 1 || (value - 1) * NBITS > dc_bitreader_available (&bits)) {
 				ERROR (abstract->context, "Incomplete sample data.");
 				return DC_STATUS_DATAFORMAT;
 			}
 
+			offset = dc_bitreader_tell (&bits) / NBITS;
 			subtype = data[offset];
 			if (subtype >= 32 && subtype <= 41) {
 				if (value < 16) {
@@ -1170,10 +1229,11 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				}
 			}
 
-			offset += value - 1;
+			dc_bitreader_skip (&bits, (value - 1) * NBITS);
 			break;
 		default:
 			WARNING (abstract->context, "Unknown sample type.");
+			dc_parser_skipped (abstract);
 			break;
 		}
 
@@ -1181,7 +1241,8 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 			sample.time = time;
 			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-			if (parser->ngasmixes && gasmix != gasmix_previous) {
+			if (parser->ngasmixes && gasmix != gasmix_previous &&
+				dc_parser_wants (parser, DC_SAMPLE_GASMIX)) {
 				idx = uwatec_smart_find_gasmix (parser, gasmix);
 				if (idx >= parser->ngasmixes) {
 					ERROR (abstract->context, "Invalid gas mix index.");
@@ -1192,12 +1253,12 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				gasmix_previous = gasmix;
 			}
 
-			if (have_temperature) {
+			if (have_temperature && dc_parser_wants (parser, DC_SAMPLE_TEMPERATURE)) {
 				sample.temperature = temperature;
 				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 			}
 
-			if (bookmark) {
+			if (bookmark && dc_parser_wants (parser, DC_SAMPLE_EVENT)) {
 				sample.event.type = SAMPLE_EVENT_BOOKMARK;
 				sample.event.time = 0;
 				sample.event.flags = 0;
@@ -1205,32 +1266,35 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
 			}
 
-			if (have_rbt || have_pressure) {
+			if ((have_rbt || have_pressure) && dc_parser_wants (parser, DC_SAMPLE_RBT)) {
 				sample.rbt = rbt;
 				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
 			}
 
-			if (have_pressure) {
-				idx = uwatec_smart_find_tank(parser, tank);
-				if (idx < parser->ntanks) {
-					sample.pressure.tank = idx;
+			if (have_pressure && dc_parser_wants (parser, DC_SAMPLE_PRESSURE)) {
+				if (tank != tank_previous || tank_idx >= parser->ntanks) {
+					tank_idx = uwatec_smart_find_tank (parser, tank);
+					tank_previous = tank;
+				}
+				if (tank_idx < parser->ntanks) {
+					sample.pressure.tank = tank_idx;
 					sample.pressure.value = pressure;
 					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
 				}
 			}
 
-			if (have_heartrate) {
+			if (have_heartrate && dc_parser_wants (parser, DC_SAMPLE_HEARTBEAT)) {
 				sample.heartbeat = heartrate;
 				if (callback) callback (DC_SAMPLE_HEARTBEAT, sample, userdata);
 			}
 
-			if (have_bearing) {
+			if (have_bearing && dc_parser_wants (parser, DC_SAMPLE_BEARING)) {
 				sample.bearing = bearing;
 				if (callback) callback (DC_SAMPLE_BEARING, sample, userdata);
 				have_bearing = 0;
 			}
 
-			if (have_depth) {
+			if (have_depth && dc_parser_wants (parser, DC_SAMPLE_DEPTH)) {
 				sample.depth = (depth - depth_calibration) / salinity;
 				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 			}
@@ -1240,7 +1304,7 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 		}
 	}
 
-	parser->cached = PROFILE;
+	parser->base.cached = PROFILE;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1257,7 +1321,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 		return rc;
 
 	// Cache the profile data.
-	if (parser->cached < PROFILE) {
+	if (parser->base.cached < PROFILE) {
 		rc = uwatec_smart_parse (parser, NULL, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -36,6 +36,8 @@
 #define SZ_MEMORY 0x8000
 #define SZ_PACKET 64
 
+#define MAXRETRIES 2
+
 #define RB_PROFILE_BEGIN  0x3FA0
 #define RB_PROFILE_END    0x7EC0
 
@@ -61,7 +63,9 @@ static const dc_device_vtable_t zeagle_n2ition3_device_vtable = {
 	zeagle_n2ition3_device_read, /* read */
 	NULL, /* write */
 	zeagle_n2ition3_device_dump, /* dump */
+	NULL, /* dump_update */
 	zeagle_n2ition3_device_foreach, /* foreach */
+	NULL, /* extract */
 	NULL, /* timesync */
 	NULL /* close */
 };
@@ -197,38 +201,51 @@ zeagle_n2ition3_device_set_fingerprint (dc_device_t *abstract, const unsigned ch
 }
 
 
+static unsigned int
+zeagle_n2ition3_page_command (dc_device_t *abstract, unsigned char command[], unsigned int address, unsigned int npages)
+{
+	command[0] = 0x02;
+	command[1] = 0x08;
+	command[2] = 0x00;
+	command[3] = 0x4D;
+	command[4] = (address     ) & 0xFF; // low
+	command[5] = (address >> 8) & 0xFF; // high
+	command[6] = npages; // count
+	memset (command + 7, 0, 5);
+	command[12] = 0x03;
+	command[11] = ~checksum_add_uint8 (command + 3, 8, 0x00) + 1;
+
+	return 13;
+}
+
+
 static dc_status_t
-zeagle_n2ition3_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
+zeagle_n2ition3_page_transfer (dc_device_t *abstract, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
-	zeagle_n2ition3_device_t *device = (zeagle_n2ition3_device_t*) abstract;
+	return zeagle_n2ition3_packet ((zeagle_n2ition3_device_t *) abstract, command, csize, answer, asize);
+}
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the package size.
-		unsigned int len = size - nbytes;
-		if (len > SZ_PACKET)
-			len = SZ_PACKET;
-
-		// Read the package.
-		unsigned char answer[13 + SZ_PACKET + 6] = {0};
-		unsigned char command[13] = {0x02, 0x08, 0x00, 0x4D,
-				(address     ) & 0xFF, // low
-				(address >> 8) & 0xFF, // high
-				len, // count
-				0x00, 0x00, 0x00, 0x00, 0x00, 0x03};
-		command[11] = ~checksum_add_uint8 (command + 3, 8, 0x00) + 1;
-		dc_status_t rc = zeagle_n2ition3_packet (device, command, sizeof (command), answer, 13 + len + 6);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
 
-		memcpy (data, answer + 17, len);
+// The pages are single bytes, and the answer repeats the command.
+static const device_page_protocol_t zeagle_n2ition3_page_protocol = {
+	1, /* pagesize */
+	SZ_PACKET, /* maxpages */
+	13 + 4, /* header */
+	2, /* trailer */
+	DEVICE_PAGE_CHECKSUM_NONE, /* checksum */
+	MAXRETRIES, /* maxretries */
+	100, /* delay */
+	zeagle_n2ition3_page_command, /* command */
+	zeagle_n2ition3_page_transfer, /* transfer */
+};
 
-		nbytes += len;
-		address += len;
-		data += len;
-	}
 
-	return DC_STATUS_SUCCESS;
+static dc_status_t
+zeagle_n2ition3_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
+{
+	zeagle_n2ition3_device_t *device = (zeagle_n2ition3_device_t*) abstract;
+
+	return device_page_read (abstract, device->iostream, &zeagle_n2ition3_page_protocol, address, data, size);
 }
 
 
@@ -326,7 +343,7 @@ zeagle_n2ition3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, RB_PROFILE_BEGIN, RB_PROFILE_END, eop);
+	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, RB_PROFILE_BEGIN, RB_PROFILE_END, eop, DC_RBSTREAM_BACKWARD);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;